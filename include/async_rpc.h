@@ -0,0 +1,140 @@
+#ifndef FUNNELKVS_ASYNC_RPC_H
+#define FUNNELKVS_ASYNC_RPC_H
+
+#include "protocol.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Non-blocking inter-node RPC driven by one epoll thread.
+//
+// The loop thread owns every connection. A call from any thread is encoded
+// on the caller, handed to the loop and written (pipelined behind whatever
+// is already in flight) to one of a few persistent connections to the
+// peer; when the response arrives the call's callback runs on the loop
+// thread. Connects are non-blocking too, so a worker can have calls to
+// many peers in flight at once and pay for the slowest one instead of the
+// sum. The server answers a connection's frames in order, so responses are
+// matched to calls by position.
+//
+// A call that was outstanding on a reused connection when it broke (the
+// peer restarted or closed it while idle) is retried once on a fresh one,
+// like ConnectionPool::call. A call that times out fails, and because its
+// connection can no longer be trusted to stay in step, the connection is
+// closed as well.
+class AsyncRpc {
+public:
+    struct Config {
+        size_t max_connections_per_peer;
+        size_t pipeline_depth; // calls in flight on a connection before another is opened
+        std::chrono::milliseconds connect_timeout;
+        std::chrono::milliseconds call_timeout; // default per-call timeout
+        std::chrono::milliseconds idle_timeout; // close connections unused this long
+
+        Config()
+            : max_connections_per_peer(4), pipeline_depth(32), connect_timeout(1000),
+              call_timeout(5000), idle_timeout(30000) {}
+    };
+
+    struct Stats {
+        uint64_t calls;
+        uint64_t failures; // includes timeouts
+        uint64_t timeouts;
+        uint64_t retries;
+        uint64_t connects;
+        size_t in_flight;
+        size_t connections;
+    };
+
+    struct Result {
+        bool ok; // false on a transport failure or timeout
+        Response response;
+
+        Result() : ok(false) {}
+    };
+
+    // ok is false on a transport failure or timeout; response is then
+    // meaningless. May be moved from.
+    typedef std::function<void(bool ok, Response& response)> Callback;
+
+    AsyncRpc() : AsyncRpc(Config()) {}
+    explicit AsyncRpc(const Config& cfg);
+    ~AsyncRpc();
+
+    AsyncRpc(const AsyncRpc&) = delete;
+    AsyncRpc& operator=(const AsyncRpc&) = delete;
+
+    static AsyncRpc& instance();
+
+    // Send request to host:port. done runs exactly once, normally on the
+    // loop thread, so it must be quick and must not block; it may issue
+    // further calls. It runs on the calling thread only when the call
+    // cannot be started at all (pool shutting down). timeout 0 means
+    // Config::call_timeout.
+    void call(const std::string& host, uint16_t port, const Request& request, Callback done,
+              std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    // Future form, for callers that start several calls and then wait
+    // for all of them
+    std::future<Result> submit(const std::string& host, uint16_t port, const Request& request,
+                               std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    Stats get_stats() const;
+
+private:
+    struct Call;
+    struct Connection;
+    struct Peer;
+
+    Config config;
+    int epoll_fd;
+    int wake_fd;
+    std::atomic<bool> stop;
+
+    // Calls handed over by other threads, picked up by the loop
+    std::mutex submit_mutex;
+    std::vector<std::unique_ptr<Call>> submitted;
+
+    // Loop thread only
+    std::unordered_map<std::string, std::unique_ptr<Peer>> peers;
+    std::vector<std::unique_ptr<Connection>> closed; // freed after each epoll batch
+    std::vector<uint8_t> read_buffer;
+
+    std::atomic<uint64_t> call_count;
+    std::atomic<uint64_t> failure_count;
+    std::atomic<uint64_t> timeout_count;
+    std::atomic<uint64_t> retry_count;
+    std::atomic<uint64_t> connect_count;
+    std::atomic<size_t> in_flight;
+    std::atomic<size_t> connection_count;
+
+    std::thread loop_thread; // declared last: started once everything above exists
+
+    void run();
+    void dispatch(std::unique_ptr<Call> call);
+    Connection* open_connection(Peer& peer);
+    void handle_events(Connection* conn, uint32_t events);
+    bool finish_connect(Connection* conn);
+    bool flush(Connection* conn);
+    bool read_responses(Connection* conn);
+    void update_interest(Connection* conn);
+    void close_connection(Connection* conn);
+    void expire(std::chrono::steady_clock::time_point now);
+    void expire_queued(Connection* conn, std::chrono::steady_clock::time_point now);
+    void complete(Call& call, bool ok, Response& response);
+    void fail(std::unique_ptr<Call> call);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_ASYNC_RPC_H
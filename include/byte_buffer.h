@@ -0,0 +1,95 @@
+#ifndef FUNNELKVS_BYTE_BUFFER_H
+#define FUNNELKVS_BYTE_BUFFER_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace funnelkvs {
+
+// Growable byte FIFO used as a per-connection receive/send buffer.
+// Unlike std::vector<uint8_t>::resize it never zero-fills the space handed
+// to recv(), and consumed bytes are reclaimed by compaction instead of
+// shifting on every read.
+class ByteBuffer {
+private:
+    std::unique_ptr<uint8_t[]> storage;
+    size_t capacity;
+    size_t read_pos;
+    size_t write_pos;
+
+public:
+    explicit ByteBuffer(size_t initial_capacity = 4096)
+        : storage(new uint8_t[initial_capacity]), capacity(initial_capacity),
+          read_pos(0), write_pos(0) {}
+
+    ByteBuffer(const ByteBuffer&) = delete;
+    ByteBuffer& operator=(const ByteBuffer&) = delete;
+
+    // Readable region
+    const uint8_t* data() const { return storage.get() + read_pos; }
+    size_t size() const { return write_pos - read_pos; }
+    bool empty() const { return read_pos == write_pos; }
+
+    void consume(size_t n) {
+        read_pos += n;
+        if (read_pos >= write_pos) {
+            read_pos = write_pos = 0;
+        }
+    }
+
+    // Writable region: call ensure_writable() first, write into
+    // write_ptr(), then commit() the number of bytes produced.
+    uint8_t* write_ptr() { return storage.get() + write_pos; }
+    size_t writable() const { return capacity - write_pos; }
+
+    void ensure_writable(size_t n) {
+        if (capacity - write_pos >= n) {
+            return;
+        }
+        size_t live = size();
+        if (read_pos > 0 && capacity - live >= n) {
+            std::memmove(storage.get(), storage.get() + read_pos, live);
+        } else {
+            size_t new_capacity = capacity * 2;
+            while (new_capacity - live < n) {
+                new_capacity *= 2;
+            }
+            std::unique_ptr<uint8_t[]> grown(new uint8_t[new_capacity]);
+            std::memcpy(grown.get(), storage.get() + read_pos, live);
+            storage.swap(grown);
+            capacity = new_capacity;
+        }
+        read_pos = 0;
+        write_pos = live;
+    }
+
+    void commit(size_t n) { write_pos += n; }
+
+    void append(const uint8_t* bytes, size_t n) {
+        ensure_writable(n);
+        std::memcpy(write_ptr(), bytes, n);
+        commit(n);
+    }
+
+    void clear() { read_pos = write_pos = 0; }
+
+    // Give back memory after an unusually large frame so idle connections
+    // do not pin it.
+    void shrink_to(size_t target_capacity) {
+        if (capacity <= target_capacity || size() > target_capacity) {
+            return;
+        }
+        std::unique_ptr<uint8_t[]> shrunk(new uint8_t[target_capacity]);
+        size_t live = size();
+        std::memcpy(shrunk.get(), data(), live);
+        storage.swap(shrunk);
+        capacity = target_capacity;
+        read_pos = 0;
+        write_pos = live;
+    }
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_BYTE_BUFFER_H
@@ -3,7 +3,14 @@
 
 #include "hash.h"
 #include "storage.h"
+#include "persistence.h"
 #include "replication.h"
+#include "protocol.h"
+#include "thread_pool.h"
+#include "histogram.h"
+#include "read_cache.h"
+#include "metrics.h"
+#include "merkle.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -12,20 +19,28 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <unordered_map>
 
 namespace funnelkvs {
 
+// One ring position. A server may own several (virtual nodes, "tokens"):
+// token 0 sits at SHA1("address:port") and is written "address:port" on
+// the wire, token t > 0 at SHA1("address:port#t") and written that way.
 struct NodeInfo {
     Hash160 id;
     std::string address;
     uint16_t port;
+    uint16_t token;
     
-    NodeInfo() : port(0) {}
-    NodeInfo(const Hash160& node_id, const std::string& addr, uint16_t p)
-        : id(node_id), address(addr), port(p) {}
+    NodeInfo() : port(0), token(0) {}
+    NodeInfo(const Hash160& node_id, const std::string& addr, uint16_t p, uint16_t t = 0)
+        : id(node_id), address(addr), port(p), token(t) {}
     
     std::string to_string() const;
-    static NodeInfo from_address(const std::string& addr, uint16_t p);
+    std::string endpoint() const; // "address:port[#token]", as carried on the wire
+    std::string host_endpoint() const { return address + ":" + std::to_string(port); }
+    static NodeInfo from_address(const std::string& addr, uint16_t p, uint16_t t = 0);
+    static bool parse(const std::string& endpoint, NodeInfo& node);
     
     bool operator==(const NodeInfo& other) const {
         return id == other.id;
@@ -34,42 +49,194 @@ struct NodeInfo {
     bool operator!=(const NodeInfo& other) const {
         return !(*this == other);
     }
+    
+    // Another ring position of the same server
+    bool same_host(const NodeInfo& other) const {
+        return port == other.port && address == other.address;
+    }
+};
+
+// Chord finger table in compact form. Of the 160 fingers only about
+// log2(N) distinct nodes ever appear, so each distinct node is kept once,
+// in ring order starting just after the owner, with its id in a contiguous
+// array; every finger is a one-byte index into it. Fingers that point back
+// at the owner (the single-node ring) hold OWNER instead of an index.
+// Finding the closest preceding finger is a binary search over the ids.
+class FingerTable {
+public:
+    static constexpr int SIZE = 160; // 2^160 address space
+    
+    explicit FingerTable(std::shared_ptr<NodeInfo> owner);
+    
+    std::shared_ptr<NodeInfo> get(int index) const;
+    
+    // Point fingers [first, last] at node. Return true if any changed.
+    bool set(int first, int last, std::shared_ptr<NodeInfo> node);
+    void fill(std::shared_ptr<NodeInfo> node) { set(0, SIZE - 1, node); }
+    // Repoint every finger at failed to replacement
+    bool replace(const NodeInfo& failed, std::shared_ptr<NodeInfo> replacement);
+    
+    // Distinct fingers in (owner, id), closest to id first, at most max
+    // of them. Empty if no finger precedes id.
+    void preceding(const Hash160& id, size_t max, std::vector<std::shared_ptr<NodeInfo>>& out) const;
+    std::shared_ptr<NodeInfo> closest_preceding(const Hash160& id) const; // nullptr if none
+    
+    size_t distinct_nodes() const { return ids.size(); }
+    // Those nodes, in ring order after the owner
+    const std::vector<std::shared_ptr<NodeInfo>>& distinct() const { return nodes; }
+    
+private:
+    static constexpr uint8_t OWNER = 0xFF;
+    
+    std::shared_ptr<NodeInfo> owner;
+    std::vector<Hash160> ids;                      // ring order after owner
+    std::vector<std::shared_ptr<NodeInfo>> nodes;  // parallel to ids
+    uint8_t entries[SIZE];
+    
+    bool ring_before(const Hash160& a, const Hash160& b) const;
+    size_t lower_bound(const Hash160& id) const;
+    uint8_t slot_for(const std::shared_ptr<NodeInfo>& node);
+    void compact();
 };
 
 class ChordNode {
 private:
-    static constexpr int FINGER_TABLE_SIZE = 160; // 2^160 address space
+    static constexpr int FINGER_TABLE_SIZE = FingerTable::SIZE;
     static constexpr int SUCCESSOR_LIST_SIZE = 8;
+    static constexpr size_t MAINTENANCE_THREADS = 2;
+    static constexpr int MAX_LOOKUP_HOPS = 32;
+    static constexpr int FINGER_REFRESH_ROUNDS = 8; // lookup rounds of refresh_fingers
+    static constexpr size_t LOOKUP_ALTERNATIVES = 3; // next hops offered per step
+    static constexpr size_t TRANSFER_BATCH_MAX_KEYS = 512;
+    static constexpr size_t TRANSFER_BATCH_MAX_BYTES = 1024 * 1024;
+    static constexpr int TRANSFER_MAX_ATTEMPTS = 3;
+    static constexpr uint32_t READ_LEASE_MS = 2000;
+    static constexpr size_t MAX_LEASED_KEYS = 65536;
+    static constexpr size_t REPAIR_LEAVES_PER_CALL = 256;
+    static constexpr size_t CAS_LOCKS = 64;
     
     NodeInfo self_info;
-    std::shared_ptr<NodeInfo> predecessor;
-    std::vector<std::shared_ptr<NodeInfo>> successor_list;
-    std::vector<std::shared_ptr<NodeInfo>> finger_table;
+    std::shared_ptr<NodeInfo> self_ptr; // shared "self" entry, allocated once
+    Hash160 finger_starts[FINGER_TABLE_SIZE]; // self + 2^i, fixed for the node's lifetime
+    
+    // Routing state is published as an immutable snapshot. Readers never
+    // lock in the steady state: each thread keeps the last snapshot it saw
+    // and refreshes it (briefly, under routing_mutex) only when
+    // routing_version moves. Writers serialize on routing_mutex, copy the
+    // current table, change the copy and publish it under a new version.
+    struct RoutingTable {
+        std::shared_ptr<NodeInfo> predecessor;
+        std::chrono::steady_clock::time_point predecessor_since;
+        std::vector<std::shared_ptr<NodeInfo>> successor_list;
+        FingerTable fingers;
+        
+        explicit RoutingTable(std::shared_ptr<NodeInfo> self) : fingers(self) {}
+    };
+    typedef std::shared_ptr<const RoutingTable> RoutingSnapshot;
     
+    RoutingSnapshot routing; // guarded by routing_mutex
+    std::atomic<uint64_t> routing_version;
     mutable std::mutex routing_mutex;
-    std::unique_ptr<Storage> local_storage;
+    // Shared by every ring position of the server
+    std::shared_ptr<Storage> local_storage;
+    std::unique_ptr<Persistence> persistence; // after local_storage: detaches first
     
     // Replication and failure detection
     std::unique_ptr<ReplicationManager> replication_manager;
     std::unique_ptr<FailureDetector> failure_detector;
     
-    // Maintenance threads
+    // Lookup statistics: hops per lookup (index = hop count) and latency
+    std::atomic<uint64_t> lookup_hops[MAX_LOOKUP_HOPS + 1];
+    std::atomic<uint64_t> lookup_failures;
+    Histogram lookup_latency_us;
+    // Requests and batch shares proxied to a key's owner
+    std::atomic<uint64_t> forwarded_requests;
+    
+    // Key handoff. transfer_mutex serializes transfers and guards the
+    // checkpoints of interrupted ones, keyed by target address.
+    struct TransferCheckpoint {
+        Storage::RangeCursor cursor;
+        Hash160 start;    // the range the cursor walks, (start, boundary]
+        Hash160 boundary;
+        bool all_keys;
+    };
+    mutable std::mutex transfer_mutex;
+    std::unordered_map<std::string, TransferCheckpoint> transfer_checkpoints;
+    size_t transfer_batch_keys;
+    size_t transfer_batch_bytes;
+    std::atomic<uint64_t> transfer_keys_sent;
+    std::atomic<uint64_t> transfer_batches_sent;
+    std::atomic<uint64_t> transfer_failed_batches;
+    std::atomic<uint64_t> transfer_keys_received;
+    
+    // Anti-entropy counters, see verify_and_repair_replicas
+    std::atomic<uint64_t> repair_rounds;
+    std::atomic<uint64_t> repair_leaves;
+    std::atomic<uint64_t> repair_keys_pushed;
+    std::atomic<uint64_t> repair_keys_deleted;
+    std::atomic<uint64_t> repair_keys_applied;
+    
+    // Reads at a consistency other than PRIMARY, see retrieve_copy
+    std::atomic<uint64_t> replica_reads;
+    std::atomic<uint64_t> quorum_reads;
+    std::atomic<uint64_t> stale_replicas;
+    std::atomic<uint64_t> quorum_failures;
+    
+    // Read leases. Nodes that forward reads cache hot remote values in
+    // read_cache (null when disabled) for READ_LEASE_MS; as the owner, this
+    // node remembers who holds a lease on which of its keys and tells them
+    // to drop the value when the key is written. Holders are remembered for
+    // twice the lease so that a lease still counts while in flight.
+    struct ReadLease {
+        std::string holder; // "address:port"
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::unique_ptr<ReadCache> read_cache;
+    std::mutex lease_mutex;
+    std::unordered_map<std::string, std::vector<ReadLease>> read_leases;
+    std::chrono::steady_clock::time_point last_lease_prune;
+    
+    // compare_and_store holds a key's lock from the version check until
+    // the write is applied, keyed by hash of the key
+    std::mutex cas_locks[CAS_LOCKS];
+    
+    // Maintenance: stabilize, fix_fingers and failure detection run as
+    // periodic jobs on maintenance_pool while running is set
     std::atomic<bool> running;
-    std::thread stabilize_thread;
-    std::thread fix_fingers_thread;
-    std::thread failure_detection_thread;
+    std::unique_ptr<ThreadPool> maintenance_pool;
+    std::vector<uint64_t> maintenance_jobs;
     
     // Thread synchronization
     std::mutex shutdown_mutex;
     std::condition_variable shutdown_cv;
     
     int next_finger_to_fix;
+    // Stabilization is adaptive: every stabilize_min_interval while the
+    // routing state keeps changing, backing off by doubling to
+    // stabilize_interval while it does not. fix_fingers refreshes every
+    // finger at once after a change and one run of them otherwise. The
+    // versions are the routing_version each job last saw; only its own
+    // job touches them.
     std::chrono::milliseconds stabilize_interval;
+    std::chrono::milliseconds stabilize_min_interval;
+    std::atomic<int64_t> stabilize_backoff_ms;
+    std::chrono::steady_clock::time_point next_stabilize;
+    uint64_t stabilized_version;
+    uint64_t fingers_version;
     std::chrono::milliseconds fix_fingers_interval;
     std::chrono::milliseconds failure_check_interval;
+    std::chrono::milliseconds anti_entropy_interval;
+    
+    // Every ring position of this server, self included, sorted by id.
+    // Set once before create()/join(); the server owns them all.
+    std::vector<ChordNode*> host_tokens;
     
 public:
     explicit ChordNode(const std::string& address, uint16_t port);
+    // Ring position token of the server at address:port, storing into the
+    // server's shared storage
+    ChordNode(const std::string& address, uint16_t port, uint16_t token,
+              std::shared_ptr<Storage> storage);
     ~ChordNode();
     
     // Disable copy constructor and assignment
@@ -80,14 +247,73 @@ public:
     const NodeInfo& get_info() const { return self_info; }
     Hash160 get_id() const { return self_info.id; }
     
-    // Chord protocol operations
+    // Chord protocol operations. find_successor routes iteratively: this
+    // node asks each hop for its closest preceding fingers (one
+    // CLOSEST_PRECEDING_NODE round trip per hop) and moves on to the best
+    // reachable one until a hop reports that the id falls between itself
+    // and its successor. Unreachable hops are skipped in favour of the
+    // alternatives offered with them.
     std::shared_ptr<NodeInfo> find_successor(const Hash160& id);
     std::shared_ptr<NodeInfo> find_predecessor(const Hash160& id);
     std::shared_ptr<NodeInfo> closest_preceding_node(const Hash160& id);
     
+    // One step of an iterative lookup, answered from local routing state.
+    // final=true: nodes[0] is id's successor, followed by its successors as
+    // fallbacks. Otherwise nodes are up to LOOKUP_ALTERNATIVES fingers that
+    // precede id, closest first.
+    void lookup_step(const Hash160& id, bool& final, std::vector<std::shared_ptr<NodeInfo>>& nodes);
+    
+    struct LookupStats {
+        uint64_t lookups;
+        uint64_t failures;          // gave up and fell back to our successor
+        std::vector<uint64_t> hops; // hops[h] = lookups that took h remote hops
+        double mean_hops;
+        Histogram::Snapshot latency_us;
+    };
+    LookupStats get_lookup_stats() const;
+    Storage::MemoryStats get_memory_stats() const { return local_storage->memory_stats(); }
+    
+    // Recover the local store from directory and keep it durable there from
+    // now on. Call before create()/join(); throws std::runtime_error if the
+    // directory is unusable or its snapshot is corrupt.
+    Persistence::RecoveryStats enable_persistence(const std::string& directory);
+    // False once the log has failed; writes are then refused.
+    bool durable() const { return local_storage->durable(); }
+    // Keep at most hot_bytes of values in memory, the rest in directory.
+    // Call before enable_persistence so recovery can spill.
+    void enable_cold_tier(const std::string& directory, size_t hot_bytes);
+    // Size of the cache of hot keys owned by other nodes; 0 disables it.
+    // Call before create()/join().
+    void set_read_cache_capacity(size_t bytes);
+    // Compress values of at least threshold bytes written through this
+    // server, if that shrinks them; 0 (the default) stores them as sent.
+    // Shared by every ring position of the server.
+    void set_compression(size_t threshold) { local_storage->set_compression(threshold); }
+    ReadCache::Stats get_read_cache_stats() const;
+    // Routing, forwarding, caching, handoff and replication metrics as
+    // chord.*, read_cache.*, transfer.* and replication.* entries
+    void collect_stats(StatsReport& report) const;
+    
+    // Virtual nodes. A server with several ring positions runs one
+    // ChordNode per position over one Storage; each must be told about all
+    // of them (tokens includes this node). Data operations are then served
+    // for any key one of the server's positions owns, whichever node they
+    // arrive at, and replicas go to other servers only.
+    // Another ring position of this node's server, over the same storage
+    std::unique_ptr<ChordNode> make_token(uint16_t token) const;
+    void set_host_tokens(const std::vector<ChordNode*>& tokens);
+    size_t token_count() const { return host_tokens.size(); }
+    // The server's position owning key_id, if any
+    ChordNode* host_owner(const Hash160& key_id) const;
+    
     // Node lifecycle
     void create(); // Create new Chord ring
+    // Create a new ring made of the given positions of this server (self
+    // included), fully linked up front
+    void create_among(const std::vector<NodeInfo>& positions);
     void join(std::shared_ptr<NodeInfo> existing_node);
+    // Hand everything this position owns to the first successor on
+    // another server and drop out of the ring
     void leave();
     void start_maintenance();
     void stop_maintenance();
@@ -96,11 +322,103 @@ public:
     void stabilize();
     void notify(std::shared_ptr<NodeInfo> node);
     void fix_fingers();
+    // Look up every finger in parallel rounds: each round resolves the
+    // first unconfirmed finger of every run that shares a node, and an
+    // answer confirms the following fingers it also covers
+    void refresh_fingers();
+    // find_successor for many ids at once, the lookups advancing a hop
+    // per round with all of a round's requests in flight together.
+    // out[i] is nullptr where a lookup failed.
+    void find_successors(const std::vector<Hash160>& ids, std::vector<std::shared_ptr<NodeInfo>>& out);
     
     // Data operations with replication
     bool store_key(const std::string& key, const std::vector<uint8_t>& value);
+    bool store_key(const std::string& key, std::vector<uint8_t>&& value);
     bool retrieve_key(const std::string& key, std::vector<uint8_t>& value);
     bool remove_key(const std::string& key);
+    // As above, for callers that already hold SHA1::hash(key). Values are
+    // compressed once, where they enter the ring (see set_compression),
+    // and travel to the owner, its replicas and later owners as stored.
+    // store_key takes a value already in Compression form if compressed.
+    // Given compressed, the read functions may return the value as stored
+    // and set *compressed if they do; otherwise they return it decoded.
+    // A non-zero ttl_ms makes the key expire that long after its owner
+    // stores it (at most Protocol::MAX_TTL_MS); the owner's expiry time
+    // goes with every copy.
+    bool store_key(const std::string& key, const Hash160& key_id, std::vector<uint8_t>&& value,
+                   bool compressed = false, uint64_t ttl_ms = 0);
+    bool retrieve_key(const std::string& key, const Hash160& key_id, std::vector<uint8_t>& value,
+                      bool* compressed = nullptr);
+    bool remove_key(const std::string& key, const Hash160& key_id);
+    
+    // Versioned access (see Storage::apply), decided by the key's owner.
+    // compare_and_store writes value only if the key's version is still
+    // expected (0: absent). The write goes to the replicas first and is
+    // applied here only once they took it, so ERROR leaves the owner's
+    // copy as it was. version comes back as the new version, or with
+    // VERSION_MISMATCH as the current one.
+    // retrieve_versioned reads the owner's copy with its version.
+    StatusCode compare_and_store(const std::string& key, const Hash160& key_id,
+                                 std::vector<uint8_t>&& value, uint64_t expected, uint64_t& version,
+                                 bool compressed = false);
+    bool retrieve_versioned(const std::string& key, const Hash160& key_id,
+                            std::vector<uint8_t>& value, uint64_t& version, bool* compressed = nullptr);
+    
+    // Reads that relax or tighten retrieve_key (see ReadConsistency).
+    // retrieve_copy serves whatever copy this server holds, as owner or
+    // replica, and returns false without one so that the caller can route
+    // the read to the owner instead. retrieve_quorum, on the owner, also
+    // needs read_quorum - 1 replicas to answer a digest check: replicas
+    // whose copy differs from ours are counted as stale and rewritten with
+    // it, and ERROR means too few answered. The rewrite carries our copy's
+    // version, so a replica already holding a newer write keeps it; an
+    // owner without the key falls back to get_from_replicas exactly as
+    // retrieve_key does.
+    bool retrieve_copy(const std::string& key, const Hash160& key_id, std::vector<uint8_t>& value,
+                       bool* compressed = nullptr);
+    StatusCode retrieve_quorum(const std::string& key, const Hash160& key_id, std::vector<uint8_t>& value,
+                               bool* compressed = nullptr);
+    
+    struct ReadStats {
+        uint64_t replica_reads;   // ANY reads served by a replica's copy
+        uint64_t quorum_reads;
+        uint64_t stale_replicas;  // copies a quorum read found differing
+        uint64_t quorum_failures; // quorum reads with too few answers
+    };
+    ReadStats get_read_stats() const;
+    
+    // Batched MULTI_GET / MULTI_PUT / MULTI_DELETE. Keys are grouped by
+    // owner with one lookup per owner rather than per key; locally owned
+    // keys are served here while each remote owner receives a single
+    // sub-batch, in parallel. results[i] answers entries[i]. PUT values are
+    // moved out of entries. A forwarded sub-batch is not split again: keys
+    // this server does not own are answered REDIRECT to their owner, or
+    // ERROR if there is none.
+    void execute_batch(OpCode opcode, std::vector<BatchEntry>& entries,
+                       std::vector<BatchResult>& results, bool forwarded = false);
+    
+    // One chunk of a ring-wide SCAN from position from, as
+    // Storage::scan_ordered, within the range of the server position that
+    // owns the next id. Returns false with owner set when that id is owned
+    // by another server, which the client should ask instead. complete is
+    // set once the walk has passed the top of the ring. scan_local walks
+    // this server's store alone, replicas included.
+    bool scan_owned(Storage::RingPosition& from, const std::string& prefix, size_t max_entries,
+                    size_t max_bytes, Storage::EntryList& out, bool& complete,
+                    std::shared_ptr<NodeInfo>& owner);
+    bool scan_local(Storage::RingPosition& from, const std::string& prefix, size_t max_entries,
+                    size_t max_bytes, Storage::EntryList& out) const;
+    
+    // Read caching across nodes. forwards_read counts a GET for a key this
+    // node does not own and says whether to serve it through retrieve_key
+    // (and so the read cache) rather than redirect the client to the owner.
+    // retrieve_leased is the owner side of a caching read: it returns the
+    // value and, in lease_ms, how long holder may cache it (0: not at all).
+    // invalidate_cached drops this node's cached copy of key.
+    bool forwards_read(const std::string& key);
+    bool retrieve_leased(const std::string& key, const std::string& holder,
+                         std::vector<uint8_t>& value, uint32_t& lease_ms);
+    void invalidate_cached(const std::string& key);
     
     // Replication operations
     std::vector<std::shared_ptr<NodeInfo>> get_replica_nodes(const Hash160& key_id) const;
@@ -116,6 +434,10 @@ public:
     // Utility functions
     bool is_responsible_for_key(const Hash160& key_id) const;
     std::vector<std::shared_ptr<NodeInfo>> get_successor_list() const;
+    // Successor list (up to the first entry back at this node) and
+    // distinct fingers, from one snapshot, for GET_ROUTING
+    void get_routing_nodes(std::vector<std::shared_ptr<NodeInfo>>& successors,
+                           std::vector<std::shared_ptr<NodeInfo>>& fingers) const;
     std::shared_ptr<NodeInfo> get_predecessor() const;
     std::shared_ptr<NodeInfo> get_successor() const;
     
@@ -126,23 +448,113 @@ public:
     // Helper methods
     std::vector<std::shared_ptr<NodeInfo>> get_successor_nodes(int count) const;
     
-    // Data transfer methods
-    void transfer_keys_to_node(std::shared_ptr<NodeInfo> target_node);
-    void receive_transferred_key(const std::string& key, const std::vector<uint8_t>& value);
+    // Data transfer methods. Keys are streamed straight out of storage in
+    // TRANSFER_BATCH chunks, one chunk in flight at a time, and each chunk
+    // is removed locally once the target acks it. all_keys hands over
+    // everything this position owns (leave). Otherwise target is our new
+    // predecessor and the range it took over, (previous, target], moves.
+    // Without previous that range is unknown: the keys from the nearest of
+    // this server's positions before target are copied but kept, since
+    // some are replicas we still hold. A target on this server shares our storage,
+    // so nothing moves. If a chunk cannot be delivered the scan position
+    // is kept and the next transfer to the same target over the same range
+    // resumes from it. Returns true when the whole range has been handed
+    // over.
+    struct TransferStats {
+        uint64_t keys_sent;
+        uint64_t batches_sent;
+        uint64_t failed_batches;
+        uint64_t keys_received;
+    };
+    
+    bool transfer_keys_to_node(std::shared_ptr<NodeInfo> target_node, bool all_keys = false,
+                               std::shared_ptr<NodeInfo> previous = nullptr);
+    // Handed-over entries keep their versions and stored form; false if
+    // an entry of the batch (key / stored value) is malformed
+    void receive_transferred_key(const std::string& key, std::vector<uint8_t>&& value,
+                                 uint64_t version = 0, bool compressed = false, uint64_t expires = 0);
+    bool receive_transferred_batch(std::vector<BatchEntry>& entries);
+    void set_transfer_batch_limits(size_t max_keys, size_t max_bytes);
+    bool has_transfer_checkpoint(const NodeInfo& target) const;
+    TransferStats get_transfer_stats() const;
+    
+    // Replica copies pushed by a key's owner; applied to local storage
+    // without ownership checks, last writer wins (version 0: always)
+    bool store_replica(const std::string& key, std::vector<uint8_t>&& value, uint64_t version = 0,
+                       bool compressed = false, uint64_t expires = 0);
+    bool remove_replica(const std::string& key, uint64_t version = 0);
+    bool retrieve_replica(const std::string& key, std::vector<uint8_t>& value) const;
+    // Entry digest of the replica copy (see MerkleTree::entry_digest)
+    bool replica_digest(const std::string& key, uint64_t& digest) const;
+    
+    // Anti-entropy. verify_and_repair_replicas compares the range this node
+    // owns, (predecessor, self], with each replica's copy through their
+    // Merkle trees: one MERKLE_DIGESTS round trip per tree level, asking
+    // only about the children of nodes that differed, then one MERKLE_KEYS
+    // per run of differing leaves. Only those leaves' entries are repaired:
+    // values the replica lacks or holds differently are pushed and keys we
+    // hold a tombstone for are deleted there. It runs every anti_entropy_interval
+    // and after a node failure, and skips a node with no predecessor, or
+    // one whose predecessor changed within the interval, since a range
+    // handed over moments ago may still be arriving.
     void verify_and_repair_replicas();
+    // Bring replica's copy of (start, end] in line with ours. Returns the
+    // number of keys written or deleted there, or -1 if it did not answer.
+    long repair_range(const NodeInfo& replica, const Hash160& start, const Hash160& end);
+    
+    // Replica side of the exchange
+    void merkle_digests(const Hash160& start, const Hash160& end, int level,
+                        const std::vector<uint32_t>& indices, std::vector<uint64_t>& digests) const;
+    void merkle_keys(const Hash160& start, const Hash160& end,
+                     const std::vector<uint32_t>& leaves, Storage::DigestList& out) const;
+    // REPAIR entries, as described in protocol.h; false if one is malformed
+    bool apply_repair(const std::vector<BatchEntry>& entries);
+    
+    struct RepairStats {
+        uint64_t rounds;       // replica ranges compared
+        uint64_t leaves;       // leaves found to differ
+        uint64_t keys_pushed;
+        uint64_t keys_deleted;
+        uint64_t keys_applied; // as a replica
+    };
+    RepairStats get_repair_stats() const;
+    FailureDetector::Stats get_failure_detector_stats() const { return failure_detector->get_stats(); }
     
     // Thread management helpers
     bool interruptible_sleep(std::chrono::milliseconds duration);
     
 private:
-    void initialize_finger_table();
     void update_finger_table_entry(int index, std::shared_ptr<NodeInfo> node);
-    void stabilize_loop();
-    void fix_fingers_loop();
-    void failure_detection_loop();
-    Hash160 get_finger_start(int index) const;
+    // One failure detection round: ping neighbours, handle failed ones
+    void detect_failures();
+    const Hash160& get_finger_start(int index) const;
+    
+    RoutingSnapshot routing_snapshot() const;
+    // Apply mutate(RoutingTable&) to a copy of the current table and
+    // publish the copy if mutate returns true
+    template<typename F>
+    bool update_routing(F mutate);
+    bool owns(const RoutingTable& table, const Hash160& key_id) const;
+    bool is_local(const NodeInfo& node) const { return node.same_host(self_info); }
+    // Id of the server's position nearest before id (id itself excluded)
+    const Hash160& host_range_start(const Hash160& id) const;
+    std::shared_ptr<NodeInfo> closest_preceding(const RoutingTable& table, const Hash160& id) const;
+    void record_lookup(int hops, std::chrono::steady_clock::time_point started, bool failed);
+    bool remote_lookup_step(const NodeInfo& node, const Hash160& id, bool& final,
+                            std::vector<std::shared_ptr<NodeInfo>>& nodes);
+    void refresh_successor_list(std::shared_ptr<NodeInfo> successor);
+    // Our successor list is successor followed by its list (endpoints)
+    void adopt_successor_list(std::shared_ptr<NodeInfo> successor, const std::vector<std::string>& endpoints);
+    // Point every finger at the first of nodes (or self) at or after its start
+    void seed_fingers(std::vector<std::shared_ptr<NodeInfo>> nodes);
+    void stabilize_if_due();
+    uint32_t grant_lease(const std::string& key, const std::string& holder);
+    // Tell every current lease holder of key to drop it; waits for them
+    void revoke_leases(const std::string& key);
     
-    // Network communication helpers
+    // Network communication helpers. Operations: "find_successor",
+    // "get_predecessor", "notify". Returns nullptr if the node is
+    // unreachable or (get_predecessor) has no predecessor.
     std::shared_ptr<NodeInfo> contact_node(std::shared_ptr<NodeInfo> node, 
                                           const std::string& operation,
                                           const Hash160& param = Hash160{});
@@ -150,7 +562,10 @@ private:
 
 private:
     // Private helper methods
-    bool send_key_transfer(std::shared_ptr<NodeInfo> target, const std::string& key, const std::vector<uint8_t>& value);
+    bool send_transfer_batch(std::shared_ptr<NodeInfo> target, const Storage::EntryList& entries,
+                             const std::vector<Storage::EntryMeta>& meta);
+    bool call_node(const NodeInfo& node, const Request& request, Response& response);
+    bool send_repair(const NodeInfo& replica, const std::vector<BatchEntry>& entries);
 };
 
 } // namespace funnelkvs
@@ -5,18 +5,31 @@
 #include "chord.h"
 #include "client.h"
 #include <memory>
+#include <vector>
 
 namespace funnelkvs {
 
 class ChordServer : public Server {
 private:
+    // The server's first ring position, which also serves the data path
     std::unique_ptr<ChordNode> chord_node;
+    // Further positions (virtual nodes) over the same storage
+    std::vector<std::unique_ptr<ChordNode>> extra_tokens;
+    std::vector<ChordNode*> tokens; // all positions, sorted by id
     bool chord_enabled;
     
 public:
-    ChordServer(const std::string& address, uint16_t port, size_t num_threads = 8);
+    ChordServer(const std::string& address, uint16_t port, size_t num_threads = 8,
+                size_t num_event_loops = 1);
     ~ChordServer();
     
+    // Number of ring positions this server takes; more positions mean a
+    // share of the ring closer to count/total, and joins and leaves that
+    // move data to and from many servers at once. Call before
+    // create_ring/join_ring; default 1.
+    void set_tokens(size_t count);
+    size_t get_token_count() const { return tokens.size(); }
+    
     // Chord-specific methods
     void enable_chord();
     void disable_chord();
@@ -27,14 +40,34 @@ public:
     // Node information
     NodeInfo get_node_info() const;
     bool is_chord_enabled() const { return chord_enabled; }
+    ChordNode::LookupStats get_lookup_stats() const;
+    // The ring's local store in Chord mode, the standalone one otherwise
+    Storage::MemoryStats get_memory_stats() const override;
+    // See ChordNode::enable_persistence
+    void enable_persistence(const std::string& directory);
+    // See ChordNode::enable_cold_tier
+    void enable_cold_tier(const std::string& directory, size_t hot_bytes);
+    // See Storage::set_compression; applies to the ring's store and the
+    // standalone one alike
+    void set_compression(size_t threshold);
+    // See ChordNode::set_read_cache_capacity
+    void set_read_cache_capacity(size_t bytes);
+    ReadCache::Stats get_read_cache_stats() const;
     
     // Override server methods to handle Chord operations
     void start() override;
     void stop() override;
     
 protected:
-    void process_request(int client_fd, const Request& request) override;
-    bool handle_chord_operation(const Request& request, Response& response);
+    void process_request(Request& request, Response& response) override;
+    void collect_stats(StatsReport& report) const override;
+    bool handle_chord_operation(Request& request, Response& response);
+    
+    // The position a routing request names by id in its key (the first
+    // one for an empty key); null for an id that is not ours
+    ChordNode* token_for(const Request& request) const;
+    // The position that answers a lookup for id in the fewest hops
+    ChordNode* lookup_token(const Hash160& id) const;
     
     // Chord network operations
     std::shared_ptr<NodeInfo> remote_find_successor(const NodeInfo& target, const Hash160& id);
@@ -2,37 +2,219 @@
 #define FUNNELKVS_CLIENT_H
 
 #include "protocol.h"
+#include "hash.h"
+#include "ring_cache.h"
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <utility>
+#include <memory>
+#include <unordered_map>
+#include <random>
+#include <sys/uio.h>
 
 namespace funnelkvs {
 
 class Client {
+public:
+    static constexpr size_t DEFAULT_PIPELINE_DEPTH = 128;
+    static constexpr int MAX_REDIRECTS = 3;
+    static constexpr size_t MAX_RING_WALK = 256; // successor-list fetches per refresh
+    
+    struct RoutingStats {
+        uint64_t direct;    // answered by the first node asked
+        uint64_t redirects; // REDIRECTs followed
+        uint64_t refreshes; // ring layout fetches
+        uint64_t replica_reads; // ANY reads sent to a replica rather than the owner
+    };
+    
 private:
     std::string server_host;
     uint16_t server_port;
     int socket_fd;
     bool connected;
     
+    // Smart routing (null when disabled): the cached ring and one
+    // connection per owner node contacted so far
+    std::unique_ptr<RingCache> ring;
+    std::unordered_map<std::string, std::unique_ptr<Client>> peers;
+    RoutingStats routing_stats;
+    
+    // Consistency of get(); ANY reads pick among read_replicas copies by
+    // latency (smoothed round trip per server, in microseconds)
+    ReadConsistency read_consistency;
+    size_t read_replicas;
+    std::unordered_map<std::string, double> peer_latency_us;
+    std::minstd_rand chooser;
+    size_t compression_threshold;
+    
 public:
     Client(const std::string& host, uint16_t port);
     ~Client();
     
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+    
     bool connect();
     void disconnect();
     bool is_connected() const { return connected; }
     
-    bool put(const std::string& key, const std::vector<uint8_t>& value);
+    // True if the connection is open and the peer has neither closed it nor
+    // sent unsolicited bytes. Cheap (non-blocking poll); used before reusing
+    // a pooled connection.
+    bool is_healthy();
+    
+    const std::string& host() const { return server_host; }
+    uint16_t port() const { return server_port; }
+    
+    // Smart routing: fetch the ring layout from the connected node (its
+    // NODE_INFO, then successor lists around the ring) and send every
+    // single-key request straight to the key's owner, hashed locally.
+    // REDIRECTs still work as a fallback and teach the cache about nodes
+    // it missed; an unreachable owner is dropped from the cache and the
+    // request goes through the original node. Batch and replica calls are
+    // unaffected. enable_smart_routing returns false (and leaves routing
+    // off) if the layout cannot be fetched.
+    bool enable_smart_routing();
+    void disable_smart_routing();
+    bool refresh_ring();
+    bool smart_routing_enabled() const { return ring != nullptr; }
+    std::vector<std::string> known_nodes() const;
+    const RoutingStats& get_routing_stats() const { return routing_stats; }
+    
+    // Consistency of get() (see ReadConsistency); PRIMARY by default.
+    // With smart routing, ANY reads go to one of the key's first
+    // `replicas` copies (the ring's replication factor): two of them are
+    // drawn at random and the one with the lower measured latency is asked.
+    // Without smart routing the connected node serves its own copy if it
+    // holds one.
+    void set_read_consistency(ReadConsistency consistency, size_t replicas = 3);
+    ReadConsistency get_read_consistency() const { return read_consistency; }
+    
+    // Compress values of at least threshold bytes before put(),
+    // put_with_ttl(), put_many() and compare_and_put() send them, when that makes them smaller; 0
+    // (the default) sends values as they are. Independently of this, get()
+    // asks for values as the server stores them and decompresses them here.
+    void set_compression(size_t threshold) { compression_threshold = threshold; }
+    size_t get_compression() const { return compression_threshold; }
+    
+    // Send an arbitrary request and wait for its response (no redirect
+    // handling). Returns false on transport or framing errors.
+    bool call(const Request& request, Response& response);
+    
+    // Pipelining: write requests back to back without waiting for each
+    // response. responses[i] answers requests[i]; the server serves a
+    // connection's frames strictly in order, so no request ids are needed.
+    // At most max_in_flight requests are outstanding at any time. Sending
+    // and receiving are interleaved, so large bursts cannot deadlock on full
+    // socket buffers. Status codes (including REDIRECT) are returned as-is;
+    // false means a transport or framing error, in which case responses
+    // holds only the answers received before it.
+    bool pipeline(const std::vector<Request>& requests, std::vector<Response>& responses,
+                  size_t max_in_flight = DEFAULT_PIPELINE_DEPTH);
+    
+    // Pipelined PUTs for bulk ingest. Redirected keys are retried one by
+    // one through put(). Returns the number of entries stored.
+    size_t put_many(const std::vector<std::pair<std::string, std::vector<uint8_t>>>& entries,
+                    size_t max_in_flight = DEFAULT_PIPELINE_DEPTH);
+    
+    // Batch operations: one MULTI_* frame for many keys. The server splits
+    // the batch by owner and forwards it, so no redirects reach the
+    // client. results[i] answers the i-th key. Returns false if the batch
+    // as a whole failed (transport error or malformed reply).
+    bool multi(OpCode opcode, const std::vector<BatchEntry>& entries, std::vector<BatchResult>& results);
+    bool multi_get(const std::vector<std::string>& keys, std::vector<BatchResult>& results);
+    bool multi_put(const std::vector<BatchEntry>& entries, std::vector<BatchResult>& results);
+    bool multi_remove(const std::vector<std::string>& keys, std::vector<BatchResult>& results);
+    
+    // One chunk of a SCAN of the keys starting with prefix, in ring order,
+    // into entries. Start with an empty cursor and call again with
+    // the one returned until it comes back empty. local scans the
+    // connected server's own store, replicas included, instead of the
+    // ring. max_entries 0 lets the server choose.
+    bool scan(const std::string& prefix, std::vector<uint8_t>& cursor, std::vector<BatchEntry>& entries,
+              uint32_t max_entries = 0, bool local = false);
+    
+    // compressed: value is already in compressed form and is sent as is
+    bool put(const std::string& key, const std::vector<uint8_t>& value, bool compressed = false);
+    // As put, but the key expires ttl_ms after the owner stores it. A TTL
+    // of 0 is refused; one beyond Protocol::MAX_TTL_MS is capped there.
+    bool put_with_ttl(const std::string& key, const std::vector<uint8_t>& value, uint64_t ttl_ms,
+                      bool compressed = false);
     bool get(const std::string& key, std::vector<uint8_t>& value);
     bool remove(const std::string& key);
+    // Versioned access, answered by the key's owner. get also returns the
+    // version of the value read. compare_and_put stores value only if the
+    // key's version is still expected (0: the key must be absent) and
+    // returns SUCCESS with the new version, or VERSION_MISMATCH with the
+    // current one (0 if absent); ERROR if the request failed.
+    bool get(const std::string& key, std::vector<uint8_t>& value, uint64_t& version);
+    StatusCode compare_and_put(const std::string& key, const std::vector<uint8_t>& value,
+                               uint64_t expected, uint64_t& version, bool compressed = false);
     bool ping();
     bool admin_shutdown();
+    // The server's metrics, one "name value" pair per line (StatsReport)
+    bool stats(std::string& text);
+    // Change the server's log level at runtime: "debug", "info", "warn",
+    // "error" or "off"
+    bool set_log_level(const std::string& level);
+    
+    // Inter-node replica traffic: served from the target's local store
+    // without ownership checks or redirects. replicate_remove succeeds
+    // whether or not the replica held the key. version orders the write
+    // against others on the replica (0: apply unconditionally); compressed
+    // says value is in Compression form and is stored as such.
+    bool replicate(const std::string& key, const std::vector<uint8_t>& value, uint64_t version = 0,
+                   bool compressed = false);
+    bool replicate_remove(const std::string& key, uint64_t version = 0);
+    bool replica_get(const std::string& key, std::vector<uint8_t>& value);
+    
+    // Read-lease traffic between a forwarding node and a key's owner.
+    // get_leased reads key on behalf of holder ("address:port") and sets
+    // lease_ms to how long holder may cache the value (0: not at all);
+    // invalidate tells a holder to drop its copy.
+    bool get_leased(const std::string& key, const std::string& holder,
+                    std::vector<uint8_t>& value, uint32_t& lease_ms);
+    bool invalidate(const std::string& key);
+    
+    // Chord routing RPCs. Nodes are "address:port[#token]" strings.
+    // find_successor resolves id on the server (which itself routes
+    // iteratively); lookup_step performs one hop of an iterative lookup:
+    // final=true means nodes[0] is id's successor (the rest are its
+    // successors), otherwise nodes are the next hops to ask, best first.
+    // get_predecessor leaves node empty if the server has none.
+    // A server may own several ring positions; target (the position's id)
+    // picks the one to ask, otherwise the server's first answers.
+    bool find_successor(const Hash160& id, std::string& node);
+    bool lookup_step(const Hash160& id, bool& final, std::vector<std::string>& nodes);
+    bool get_predecessor(std::string& node, const Hash160* target = nullptr);
+    bool get_successor_list(std::vector<std::string>& nodes, const Hash160* target = nullptr);
+    // Successor list and distinct fingers in one round trip, for a joining
+    // node to start its own from
+    bool get_routing(std::vector<std::string>& successors, std::vector<std::string>& fingers,
+                     const Hash160* target = nullptr);
+    bool notify(const std::string& node, const Hash160* target = nullptr);
+    bool node_info(std::string& node);
     
 private:
+    // Send a single-key request to its owner, following REDIRECTs
+    bool route_request(const Request& request, Response& response);
+    Client* connection_for(const std::string& endpoint);
+    void drop_peer(const std::string& endpoint);
+    // Power of two choices among id's copies
+    bool pick_replica(const Hash160& id, std::string& endpoint);
+    double latency_of(const std::string& endpoint) const;
+    void record_latency(const std::string& server, double latency_us);
+    std::string endpoint() const { return server_host + ":" + std::to_string(server_port); }
+    // Apply the compression threshold to an outgoing value
+    bool pack(const std::vector<uint8_t>& value, std::vector<uint8_t>& packed) const;
+    void pack_request(Request& request) const;
+
     bool send_request(const Request& request, Response& response);
     bool send_data(const std::vector<uint8_t>& data);
     bool receive_data(std::vector<uint8_t>& buffer, size_t expected_size);
+    bool receive_exact(uint8_t* buffer, size_t expected_size);
+    bool send_vectored(struct iovec* iov, int iovcnt);
 };
 
 } // namespace funnelkvs
@@ -0,0 +1,102 @@
+#ifndef FUNNELKVS_COLD_TIER_H
+#define FUNNELKVS_COLD_TIER_H
+
+#include "rwlock.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Append-only, memory-mapped value store backing Storage's cold entries.
+//
+// Values are appended to the active segment, a file mapped read-only in
+// full, and read back in place through the mapping, so the kernel's page
+// cache decides which cold values occupy RAM. A full segment is sealed and
+// a new one started. Segment files are unlinked as soon as they are
+// created: the tier is scratch space that disappears with the process, and
+// durability is the job of Persistence.
+//
+// Each segment counts its live bytes; Storage compacts sealed segments
+// that have become mostly garbage by rewriting their live values into the
+// active segment and dropping them. A dropped segment stays mapped until
+// the last Segment reference to it (for example a ValueView) is released.
+class ColdTier {
+public:
+    static constexpr size_t DEFAULT_SEGMENT_BYTES = 256 * 1024 * 1024;
+
+    struct Location {
+        uint32_t segment;
+        uint64_t offset;
+    };
+
+    class Segment {
+    public:
+        Segment(int fd, uint8_t* data, size_t capacity);
+        ~Segment();
+
+        Segment(const Segment&) = delete;
+        Segment& operator=(const Segment&) = delete;
+
+        const uint8_t* at(uint64_t offset) const { return data + offset; }
+
+    private:
+        friend class ColdTier;
+        int fd;
+        uint8_t* data;
+        size_t capacity;
+        size_t used;       // guarded by the tier's append_mutex
+        size_t live_bytes; // guarded by the tier's append_mutex
+        bool sealed;
+    };
+
+    struct Stats {
+        size_t segments;
+        size_t file_bytes; // appended to segments still in use
+        size_t live_bytes;
+        uint64_t compactions;
+    };
+
+    // Throws std::runtime_error if the directory cannot be created
+    explicit ColdTier(const std::string& directory, size_t segment_bytes = DEFAULT_SEGMENT_BYTES);
+    ~ColdTier() = default;
+
+    ColdTier(const ColdTier&) = delete;
+    ColdTier& operator=(const ColdTier&) = delete;
+
+    // Copy size bytes into the active segment. Returns false on I/O errors
+    // (e.g. a full disk), in which case the value should stay in memory.
+    bool append(const uint8_t* data, size_t size, Location& out);
+    // The segment holding a location; null once the segment is dropped
+    std::shared_ptr<const Segment> segment(uint32_t id) const;
+    // A value previously appended is no longer referenced
+    void release(const Location& location, size_t size);
+
+    // Sealed segments whose live share is at most max_live_ratio
+    std::vector<uint32_t> compaction_candidates(double max_live_ratio) const;
+    void drop(uint32_t id);
+
+    Stats stats() const;
+
+private:
+    std::string directory;
+    size_t segment_bytes;
+
+    mutable RWLock segments_lock; // the segments map
+    std::unordered_map<uint32_t, std::shared_ptr<Segment>> segments;
+
+    mutable std::mutex append_mutex; // active segment and all byte counts
+    std::shared_ptr<Segment> active;
+    uint32_t active_id;
+    uint32_t next_id;
+    uint64_t compactions;
+
+    bool open_segment(size_t capacity);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_COLD_TIER_H
@@ -0,0 +1,46 @@
+#ifndef FUNNELKVS_COMPRESSION_H
+#define FUNNELKVS_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace funnelkvs {
+
+// Byte-oriented LZ77 codec for large values, in the LZ4 block format:
+// sequences of a token (literal length, match length), the literals, and a
+// two-byte offset back into the output, with no entropy stage. Compression
+// is a single greedy pass over a hash table of 4-byte prefixes and runs at
+// hundreds of MB/s; decompression is a copy loop, several times faster.
+//
+// A compressed value is RawLen(4, big-endian) followed by the block, so it
+// can be decoded without any other metadata. Values are only worth storing
+// compressed if that comes out smaller; compress() reports when it does not.
+class Compression {
+public:
+    static constexpr size_t HEADER_SIZE = 4;
+    // Values larger than this are never produced, and decompress() refuses
+    // to allocate for them
+    static constexpr size_t MAX_RAW_SIZE = 1u << 30;
+
+    // Replace out by the compressed form of data. Returns false, leaving
+    // out unspecified, if that would not be smaller than size.
+    static bool compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+    static bool compress(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+        return compress(data.data(), data.size(), out);
+    }
+
+    // Replace out by the original bytes. Returns false on malformed input;
+    // every read and write is bounds-checked, so untrusted bytes are safe.
+    static bool decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+    static bool decompress(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+        return decompress(data.data(), data.size(), out);
+    }
+
+    // Original size recorded in a compressed value, 0 if too short
+    static size_t raw_size(const uint8_t* data, size_t size);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_COMPRESSION_H
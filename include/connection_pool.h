@@ -0,0 +1,148 @@
+#ifndef FUNNELKVS_CONNECTION_POOL_H
+#define FUNNELKVS_CONNECTION_POOL_H
+
+#include "client.h"
+#include "heartbeat.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <chrono>
+#include <atomic>
+
+namespace funnelkvs {
+
+// Process-wide pool of persistent connections to peer nodes, keyed by
+// "address:port". Inter-node RPCs (forwarding, replication, lookups,
+// pings, key transfer) lease a connected Client instead of paying a TCP
+// handshake per call.
+class ConnectionPool {
+public:
+    struct PoolConfig {
+        size_t max_idle_per_peer;        // idle connections kept per peer
+        size_t max_connections_per_peer; // leased + idle
+        std::chrono::milliseconds idle_timeout;
+        std::chrono::milliseconds acquire_timeout; // wait when a peer is at its cap
+
+        PoolConfig()
+            : max_idle_per_peer(8), max_connections_per_peer(64),
+              idle_timeout(30000), acquire_timeout(1000) {}
+    };
+
+    struct PoolStats {
+        uint64_t connects;
+        uint64_t reuses;
+        uint64_t evictions;
+        size_t idle;
+        size_t leased;
+    };
+
+    // Exclusive use of one pooled connection; returned to the pool on
+    // destruction if it is still connected.
+    class Lease {
+    private:
+        ConnectionPool* pool;
+        std::string peer_key;
+        std::unique_ptr<Client> client;
+        bool reused;
+
+    public:
+        Lease() : pool(nullptr), reused(false) {}
+        Lease(ConnectionPool* p, const std::string& key, std::unique_ptr<Client> c, bool was_reused)
+            : pool(p), peer_key(key), client(std::move(c)), reused(was_reused) {}
+        Lease(Lease&& other);
+        Lease& operator=(Lease&& other);
+        ~Lease() { release(); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        explicit operator bool() const { return client != nullptr; }
+        Client* operator->() const { return client.get(); }
+        Client& operator*() const { return *client; }
+        bool was_reused() const { return reused; }
+
+        // Drop the connection instead of returning it (e.g. protocol error)
+        void discard();
+        void release();
+    };
+
+    ConnectionPool() : ConnectionPool(PoolConfig()) {}
+    explicit ConnectionPool(const PoolConfig& cfg);
+    ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    static ConnectionPool& instance();
+
+    // Returns an empty Lease if no connection could be established.
+    // fresh=true skips idle connections and always dials.
+    Lease acquire(const std::string& host, uint16_t port, bool fresh = false);
+
+    // Run fn(Client&) on a pooled connection. If it fails because a reused
+    // connection turned out to be dead, retry once on a fresh one. fn's
+    // return value is passed through.
+    template<typename F>
+    bool call(const std::string& host, uint16_t port, F fn);
+
+    void evict_idle();
+    void clear();
+    PoolStats get_stats() const;
+    size_t idle_connections(const std::string& host, uint16_t port) const;
+
+    void set_config(const PoolConfig& cfg);
+
+private:
+    struct IdleConnection {
+        std::unique_ptr<Client> client;
+        std::chrono::steady_clock::time_point idle_since;
+    };
+
+    struct Peer {
+        std::vector<IdleConnection> idle; // most recently used at the back
+        size_t leased;
+
+        Peer() : leased(0) {}
+    };
+
+    PoolConfig config;
+    mutable std::mutex mutex;
+    std::condition_variable slot_available;
+    std::unordered_map<std::string, Peer> peers;
+
+    std::atomic<uint64_t> connect_count;
+    std::atomic<uint64_t> reuse_count;
+    std::atomic<uint64_t> eviction_count;
+
+    static std::string make_key(const std::string& host, uint16_t port);
+    void return_connection(const std::string& peer_key, std::unique_ptr<Client> client);
+    void evict_expired_locked(Peer& peer, std::chrono::steady_clock::time_point now);
+};
+
+template<typename F>
+bool ConnectionPool::call(const std::string& host, uint16_t port, F fn) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        Lease lease = acquire(host, port, attempt > 0);
+        if (!lease) {
+            return false;
+        }
+        if (fn(*lease)) {
+            // Any answer doubles as a heartbeat for the failure detector
+            HeartbeatRegistry::instance().heard(host, port);
+            return true;
+        }
+        // A negative answer on a healthy connection is final; only a
+        // reused connection that broke underneath us earns a retry.
+        if (lease->is_connected() || !lease.was_reused()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_CONNECTION_POOL_H
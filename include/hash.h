@@ -2,6 +2,7 @@
 #define FUNNELKVS_HASH_H
 
 #include <cstdint>
+#include <cstring>
 #include <array>
 #include <string>
 #include <vector>
@@ -20,23 +21,109 @@ public:
     static std::string to_string(const Hash160& hash);
     static Hash160 from_string(const std::string& hex_str);
     
-private:
-    static void process_block(const uint8_t block[64], uint32_t h[5]);
+    // Blocks are compressed with the CPU's SHA-1 instructions (x86 SHA
+    // extensions, or ARMv8 crypto when built for it) if it has them, and
+    // portable code otherwise. implementation() names the one in use.
+    static const char* implementation();
+    // Switch between the hardware path (if available) and the portable
+    // one; returns whether hardware is in use. For tests and benchmarks.
+    static bool use_hardware(bool enable);
 };
 
+// Ring arithmetic on ids. A Hash160 is a big-endian 160-bit number; the
+// helpers below load it as two 64-bit words and one 32-bit word so that
+// comparisons and carries work a word at a time instead of a byte at a
+// time. They sit on every routing decision and every ownership check of
+// a store scan, hence inline.
+namespace hash_detail {
+
+inline uint64_t load_be64(const uint8_t* p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+inline uint32_t load_be32(const uint8_t* p) {
+    uint32_t word;
+    std::memcpy(&word, p, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    return word;
+}
+
+inline void store_be64(uint8_t* p, uint64_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    std::memcpy(p, &word, sizeof(word));
+}
+
+inline void store_be32(uint8_t* p, uint32_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap32(word);
+#endif
+    std::memcpy(p, &word, sizeof(word));
+}
+
+// -1, 0 or 1 as a is below, equal to or above b
+inline int compare(const Hash160& a, const Hash160& b) {
+    uint64_t a0 = load_be64(a.data()), b0 = load_be64(b.data());
+    if (a0 != b0) {
+        return a0 < b0 ? -1 : 1;
+    }
+    uint64_t a1 = load_be64(a.data() + 8), b1 = load_be64(b.data() + 8);
+    if (a1 != b1) {
+        return a1 < b1 ? -1 : 1;
+    }
+    uint32_t a2 = load_be32(a.data() + 16), b2 = load_be32(b.data() + 16);
+    return (a2 > b2) - (a2 < b2);
+}
+
+} // namespace hash_detail
+
 // Utility functions for Hash160 operations
-bool operator==(const Hash160& a, const Hash160& b);
-bool operator!=(const Hash160& a, const Hash160& b);
-bool operator<(const Hash160& a, const Hash160& b);
-bool operator<=(const Hash160& a, const Hash160& b);
-bool operator>(const Hash160& a, const Hash160& b);
-bool operator>=(const Hash160& a, const Hash160& b);
-
-// Chord-specific hash operations
+inline bool operator==(const Hash160& a, const Hash160& b) {
+    // Byte order does not matter for equality
+    uint64_t a0, a1, b0, b1;
+    uint32_t a2, b2;
+    std::memcpy(&a0, a.data(), 8);
+    std::memcpy(&b0, b.data(), 8);
+    std::memcpy(&a1, a.data() + 8, 8);
+    std::memcpy(&b1, b.data() + 8, 8);
+    std::memcpy(&a2, a.data() + 16, 4);
+    std::memcpy(&b2, b.data() + 16, 4);
+    return ((a0 ^ b0) | (a1 ^ b1) | static_cast<uint64_t>(a2 ^ b2)) == 0;
+}
+inline bool operator!=(const Hash160& a, const Hash160& b) { return !(a == b); }
+inline bool operator<(const Hash160& a, const Hash160& b) { return hash_detail::compare(a, b) < 0; }
+inline bool operator<=(const Hash160& a, const Hash160& b) { return hash_detail::compare(a, b) <= 0; }
+inline bool operator>(const Hash160& a, const Hash160& b) { return hash_detail::compare(a, b) > 0; }
+inline bool operator>=(const Hash160& a, const Hash160& b) { return hash_detail::compare(a, b) >= 0; }
+
+// Chord-specific hash operations, all modulo 2^160
 Hash160 add_power_of_two(const Hash160& base, int power);
-bool in_range(const Hash160& id, const Hash160& start, const Hash160& end, bool inclusive_end = true);
+// Clockwise distance from `from` to `to`, i.e. (to - from) mod 2^160
 Hash160 distance(const Hash160& from, const Hash160& to);
 
+// id in (start, end], or (start, end) when !inclusive_end, going clockwise.
+// A range with start == end is a single point when inclusive and empty
+// otherwise.
+inline bool in_range(const Hash160& id, const Hash160& start, const Hash160& end, bool inclusive_end = true) {
+    int start_end = hash_detail::compare(start, end);
+    if (start_end == 0) {
+        return inclusive_end && id == start;
+    }
+    bool after_start = hash_detail::compare(id, start) > 0;
+    int id_end = hash_detail::compare(id, end);
+    bool before_end = inclusive_end ? id_end <= 0 : id_end < 0;
+    // Normal range requires both; a range that wraps past zero either one
+    return start_end < 0 ? (after_start && before_end) : (after_start || before_end);
+}
+
 } // namespace funnelkvs
 
 #endif // FUNNELKVS_HASH_H
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef FUNNELKVS_HEARTBEAT_H
+#define FUNNELKVS_HEARTBEAT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace funnelkvs {
+
+// Process-wide record of when each peer ("address:port") last answered
+// anything. AsyncRpc and ConnectionPool stamp it on every successful
+// response, so ordinary lookups, forwarding and replication traffic double
+// as heartbeats and the failure detector only has to probe peers that
+// have been quiet. A peer's slot is created on first use and never freed,
+// so callers on hot paths can look it up once and keep the pointer.
+class HeartbeatRegistry {
+public:
+    typedef std::atomic<int64_t> Slot; // steady-clock microseconds, 0 = never
+
+    static HeartbeatRegistry& instance();
+
+    Slot* slot(const std::string& peer_key);
+
+    static int64_t now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static void beat(Slot* slot) { slot->store(now_us(), std::memory_order_relaxed); }
+
+    void heard(const std::string& peer_key) { beat(slot(peer_key)); }
+    void heard(const std::string& host, uint16_t port) { heard(host + ":" + std::to_string(port)); }
+
+    // Time of the peer's latest answer, 0 if it never answered
+    int64_t last_heard(const std::string& peer_key) const;
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<Slot>> slots;
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_HEARTBEAT_H
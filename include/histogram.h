@@ -0,0 +1,54 @@
+#ifndef FUNNELKVS_HISTOGRAM_H
+#define FUNNELKVS_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace funnelkvs {
+
+// Lock-free histogram of non-negative samples (latencies in microseconds,
+// sizes, ...) in power-of-two buckets: bucket 0 counts zeros and bucket i
+// counts values in [2^(i-1), 2^i). Recording is a couple of relaxed atomic
+// adds, so it is cheap enough for every request; reads taken while
+// writers are active are approximate.
+class Histogram {
+public:
+    static constexpr size_t NUM_BUCKETS = 65;
+    
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        
+        double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+        // Upper bound of the bucket holding the p-th quantile (0 < p <= 1).
+        // Never exceeds max.
+        uint64_t percentile(double p) const;
+        // Fold other into this one (e.g. per-thread histograms on read)
+        void merge(const Snapshot& other);
+    };
+    
+    Histogram();
+    
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+    
+    void record(uint64_t value);
+    Snapshot snapshot() const;
+    void reset();
+    
+    static size_t bucket_for(uint64_t value);
+    static uint64_t bucket_upper_bound(size_t bucket);
+    
+private:
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max_value;
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_HISTOGRAM_H
@@ -0,0 +1,60 @@
+#ifndef FUNNELKVS_HLC_H
+#define FUNNELKVS_HLC_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Hybrid logical clock: version stamps that follow wall-clock time but
+// never go backwards, and that always exceed every stamp this clock has
+// issued or observed. A stamp packs milliseconds since the epoch into its
+// upper 48 bits and a counter for stamps issued within one millisecond into
+// the lower 16. Nodes observe the stamps of the writes they receive, so a
+// write made after another one was seen gets a larger stamp even if the
+// node's wall clock lags. Lock-free. 0 is never issued; it marks a value
+// written without a version.
+class HybridClock {
+public:
+    static constexpr int LOGICAL_BITS = 16;
+
+    HybridClock() : last(0) {}
+
+    HybridClock(const HybridClock&) = delete;
+    HybridClock& operator=(const HybridClock&) = delete;
+
+    // A new stamp, larger than any before it
+    uint64_t now() {
+        uint64_t physical = wall_ms() << LOGICAL_BITS;
+        uint64_t previous = last.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            next = physical > previous ? physical : previous + 1;
+        } while (!last.compare_exchange_weak(previous, next, std::memory_order_relaxed));
+        return next;
+    }
+
+    // Account for a stamp issued elsewhere
+    void observe(uint64_t stamp) {
+        uint64_t previous = last.load(std::memory_order_relaxed);
+        while (stamp > previous &&
+               !last.compare_exchange_weak(previous, stamp, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t latest() const { return last.load(std::memory_order_relaxed); }
+
+    static uint64_t physical_ms(uint64_t stamp) { return stamp >> LOGICAL_BITS; }
+    static uint64_t wall_ms() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+private:
+    std::atomic<uint64_t> last;
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_HLC_H
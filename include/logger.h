@@ -0,0 +1,117 @@
+#ifndef FUNNELKVS_LOGGER_H
+#define FUNNELKVS_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstdio>
+
+namespace funnelkvs {
+
+enum class LogLevel : uint8_t {
+    DEBUG = 0,
+    INFO = 1,
+    WARN = 2,
+    ERROR = 3,
+    OFF = 4
+};
+
+// Process-wide leveled logger that keeps I/O off the calling thread.
+//
+// Callers format a line and push it into a bounded lock-free ring (a
+// Vyukov MPMC queue, one sequence number per slot); a background thread
+// drains the ring and writes each burst with one write per stream, DEBUG
+// and INFO to stdout, WARN and ERROR to stderr. Producers never block:
+// when the ring is full the line is dropped and counted. Use the FKVS_*
+// macros below, which test the level before evaluating their arguments,
+// so a disabled level costs one relaxed atomic load.
+class Logger {
+public:
+    static constexpr size_t RING_CAPACITY = 8192; // power of two
+
+    struct Stats {
+        uint64_t written;
+        uint64_t dropped; // ring full
+    };
+
+    // Created on first use and never destroyed, so logging from static
+    // destructors and detached threads stays safe; lines still queued at
+    // exit are flushed by an atexit handler
+    static Logger& instance();
+
+    void set_level(LogLevel level) { min_level.store(static_cast<uint8_t>(level), std::memory_order_relaxed); }
+    LogLevel level() const { return static_cast<LogLevel>(min_level.load(std::memory_order_relaxed)); }
+    bool enabled(LogLevel level) const {
+        return static_cast<uint8_t>(level) >= min_level.load(std::memory_order_relaxed);
+    }
+
+    // Write DEBUG/INFO lines to out and WARN/ERROR lines to err from now
+    // on (stdout and stderr by default). The streams must stay open.
+    void redirect(std::FILE* out, std::FILE* err);
+
+    void log(LogLevel level, std::string&& message);
+    // Wait until every line logged so far has been written
+    void flush();
+    Stats stats() const;
+
+    // "debug", "info", "warn", "error", "off" (case-insensitive)
+    static bool parse_level(const std::string& name, LogLevel& level);
+    static const char* level_name(LogLevel level);
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        std::chrono::system_clock::time_point time;
+        std::string message;
+    };
+
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<size_t> enqueue_pos;
+    size_t dequeue_pos; // writer thread only
+    std::atomic<uint8_t> min_level;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::atomic<std::FILE*> out_stream;
+    std::atomic<std::FILE*> err_stream;
+
+    // The writer sleeps when the ring is empty; producers wake it only
+    // when it says it is sleeping
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::condition_variable drained_cv;
+    std::atomic<bool> writer_sleeping;
+    std::atomic<uint64_t> flushed_pos; // lines taken through to the streams
+    std::thread writer;
+
+    Logger();
+    void run();
+    size_t drain(std::string& out, std::string& err);
+};
+
+} // namespace funnelkvs
+
+#define FKVS_LOG(level, expr) \
+    do { \
+        if (::funnelkvs::Logger::instance().enabled(level)) { \
+            std::ostringstream fkvs_log_line_; \
+            fkvs_log_line_ << expr; \
+            ::funnelkvs::Logger::instance().log(level, fkvs_log_line_.str()); \
+        } \
+    } while (0)
+
+#define FKVS_DEBUG(expr) FKVS_LOG(::funnelkvs::LogLevel::DEBUG, expr)
+#define FKVS_INFO(expr) FKVS_LOG(::funnelkvs::LogLevel::INFO, expr)
+#define FKVS_WARN(expr) FKVS_LOG(::funnelkvs::LogLevel::WARN, expr)
+#define FKVS_ERROR(expr) FKVS_LOG(::funnelkvs::LogLevel::ERROR, expr)
+
+#endif // FUNNELKVS_LOGGER_H
@@ -0,0 +1,73 @@
+#ifndef FUNNELKVS_MERKLE_H
+#define FUNNELKVS_MERKLE_H
+
+#include "hash.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace funnelkvs {
+
+// Hash tree over the id ring, for anti-entropy between a key's owner and
+// its replicas. The ring is cut into LEAVES equal segments by the top
+// bits of an id, and each node of a FANOUT-ary tree above them covers a
+// contiguous run of segments. A node holds the sum (mod 2^64) of the
+// digests of every entry in its segments, so a write moves one leaf and
+// its ancestors by the difference between the old and new digest: a few
+// relaxed atomic adds, no lock, no rehash of the rest of the range.
+// Two copies of a ring range are compared top down, descending only into
+// nodes whose sums differ. Reads taken while writers are active may see a
+// write in some levels and not yet in others; the next comparison settles it.
+class MerkleTree {
+public:
+    static constexpr int FANOUT_BITS = 4;
+    static constexpr size_t FANOUT = static_cast<size_t>(1) << FANOUT_BITS;
+    static constexpr int DEPTH = 3; // levels below the root; leaves are level DEPTH
+    static constexpr int LEAF_BITS = FANOUT_BITS * DEPTH;
+    static constexpr size_t LEAVES = static_cast<size_t>(1) << LEAF_BITS;
+
+    MerkleTree();
+
+    MerkleTree(const MerkleTree&) = delete;
+    MerkleTree& operator=(const MerkleTree&) = delete;
+
+    // Digest of one entry, over its key and value bytes and, if it has
+    // one, its expiry time
+    static uint64_t entry_digest(const char* key, size_t key_size,
+                                 const uint8_t* value, size_t value_size, uint64_t expires = 0);
+
+    static size_t leaf_of(const Hash160& id) {
+        return static_cast<size_t>(hash_detail::load_be32(id.data()) >> (32 - LEAF_BITS));
+    }
+    // Nodes at a level: FANOUT^level
+    static size_t level_size(int level) { return static_cast<size_t>(1) << (FANOUT_BITS * level); }
+    // Leaves [first_leaf, first_leaf + leaf_span) make up node index of level
+    static size_t first_leaf(int level, size_t index) { return index << (FANOUT_BITS * (DEPTH - level)); }
+    static size_t leaf_span(int level) { return static_cast<size_t>(1) << (FANOUT_BITS * (DEPTH - level)); }
+    // Smallest id in a leaf's segment
+    static Hash160 leaf_start(size_t leaf);
+
+    void add(const Hash160& id, uint64_t digest) { adjust(leaf_of(id), digest); }
+    void remove(const Hash160& id, uint64_t digest) { adjust(leaf_of(id), 0 - digest); }
+    // Replace old_digest by new_digest for an entry staying at id
+    void update(const Hash160& id, uint64_t old_digest, uint64_t new_digest) {
+        if (old_digest != new_digest) {
+            adjust(leaf_of(id), new_digest - old_digest);
+        }
+    }
+
+    uint64_t node(int level, size_t index) const;
+    uint64_t root() const { return node(0, 0); }
+
+private:
+    // Levels stored one after another, root first
+    std::unique_ptr<std::atomic<uint64_t>[]> nodes;
+
+    static size_t level_offset(int level);
+    void adjust(size_t leaf, uint64_t delta);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_MERKLE_H
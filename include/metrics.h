@@ -0,0 +1,86 @@
+#ifndef FUNNELKVS_METRICS_H
+#define FUNNELKVS_METRICS_H
+
+#include "histogram.h"
+#include "protocol.h"
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Per-opcode request metrics for the TCP front end: latency, errors,
+// redirects and bytes in and out. Every recording thread writes to its
+// own stripe (threads are assigned stripes round-robin on first use), so
+// the hot path is a handful of uncontended relaxed atomic adds; snapshot()
+// merges the stripes. An opcode's counters are allocated the first time
+// it is seen.
+class RequestMetrics {
+public:
+    static constexpr size_t STRIPES = 16;
+
+    struct OpSnapshot {
+        OpCode opcode;
+        uint64_t errors;    // ERROR responses
+        uint64_t redirects; // REDIRECT responses
+        uint64_t bytes_in;  // request frames
+        uint64_t bytes_out; // response frames
+        Histogram::Snapshot latency_us;
+    };
+
+    RequestMetrics();
+    ~RequestMetrics();
+
+    RequestMetrics(const RequestMetrics&) = delete;
+    RequestMetrics& operator=(const RequestMetrics&) = delete;
+
+    void record(OpCode opcode, StatusCode status, size_t bytes_in, size_t bytes_out,
+                uint64_t latency_us);
+    // Opcodes seen so far, in opcode order
+    std::vector<OpSnapshot> snapshot() const;
+
+private:
+    struct OpCounters {
+        Histogram latency_us;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint64_t> redirects;
+        std::atomic<uint64_t> bytes_in;
+        std::atomic<uint64_t> bytes_out;
+
+        OpCounters() : errors(0), redirects(0), bytes_in(0), bytes_out(0) {}
+    };
+    struct Stripe {
+        std::atomic<OpCounters*> ops[256];
+    };
+
+    Stripe stripes[STRIPES];
+
+    static size_t stripe_index();
+    OpCounters& counters(Stripe& stripe, OpCode opcode);
+};
+
+// Named values in the STATS reply: one "name value" pair per line, names
+// dotted from general to specific ("request.GET.p99_us").
+class StatsReport {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Entries;
+
+    void add(const std::string& name, uint64_t value);
+    void add(const std::string& name, double value);
+    void add(const std::string& name, const std::string& value);
+    // name.count, name.mean_us, name.p50_us, name.p99_us, name.p999_us, name.max_us
+    void add_latency(const std::string& name, const Histogram::Snapshot& latency_us);
+
+    const Entries& entries() const { return values; }
+    std::string to_text() const;
+    static Entries parse(const std::string& text);
+
+private:
+    Entries values;
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_METRICS_H
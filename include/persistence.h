@@ -0,0 +1,137 @@
+#ifndef FUNNELKVS_PERSISTENCE_H
+#define FUNNELKVS_PERSISTENCE_H
+
+#include "storage.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Durability for a Storage: a write-ahead log plus periodic snapshots, kept
+// in one directory.
+//
+// Every change is appended to the log as a numbered, checksummed record.
+// A single flusher thread writes whatever has accumulated and fdatasyncs it
+// once, so concurrent writers share each sync (group commit); a PUT returns
+// once its record is durable. The log is split into segments named after
+// their first record number.
+//
+// Once the log has grown by snapshot_bytes, a background thread writes a
+// snapshot of the whole store, records the last log number it is
+// guaranteed to include, and deletes the segments it covers. The snapshot
+// is taken shard by shard while writes continue, so it may also include
+// later changes; replaying the log after it converges to the same state
+// because the records of a key are replayed in order.
+//
+// Recovery maps the snapshot, loads it, and replays the log after it,
+// discarding a torn record at the tail.
+//
+// If a log write or sync fails, the journal fails for good: nothing more
+// is written, so the log ends at the last durable record (or a torn one
+// recovery discards), and sync() returns false for that change and every
+// later one.
+class Persistence : public StorageJournal {
+public:
+    static constexpr size_t DEFAULT_SNAPSHOT_BYTES = 256 * 1024 * 1024;
+    static constexpr size_t DEFAULT_SEGMENT_BYTES = 64 * 1024 * 1024;
+
+    struct RecoveryStats {
+        size_t snapshot_entries;
+        size_t log_records;    // replayed after the snapshot
+        bool truncated;        // a torn or corrupt log tail was discarded
+        uint64_t elapsed_ms;
+    };
+
+    struct Stats {
+        uint64_t records;   // appended since start
+        uint64_t syncs;     // group commits
+        uint64_t snapshots;
+        uint64_t log_bytes; // since the last snapshot
+        bool failed;        // a log write failed; see above
+    };
+
+    // Throws std::runtime_error if the directory cannot be created
+    explicit Persistence(const std::string& directory,
+                         size_t snapshot_bytes = DEFAULT_SNAPSHOT_BYTES,
+                         size_t segment_bytes = DEFAULT_SEGMENT_BYTES);
+    ~Persistence();
+
+    Persistence(const Persistence&) = delete;
+    Persistence& operator=(const Persistence&) = delete;
+
+    // Load the directory's contents into storage, which should be empty and
+    // not yet journaled. Throws std::runtime_error on a corrupt snapshot.
+    RecoveryStats recover(Storage& storage);
+
+    // Journal storage's changes from now on, until stop()
+    void start(Storage& storage);
+    // Detach from the store and make everything logged so far durable
+    void stop();
+
+    // Write a snapshot now and drop the log segments it covers
+    bool snapshot();
+
+    Stats get_stats() const;
+
+    uint64_t log_put(const std::string& key, const Hash160& id,
+                     const std::vector<uint8_t>& value, uint64_t version, bool compressed,
+                     uint64_t expires) override;
+    uint64_t log_remove(const std::string& key) override;
+    uint64_t log_clear() override;
+    bool sync(uint64_t ticket) override;
+
+private:
+    std::string directory;
+    size_t snapshot_bytes;
+    size_t segment_bytes;
+    Storage* storage;
+
+    // Log state, guarded by mutex
+    mutable std::mutex mutex;
+    std::condition_variable flush_cv;   // records pending or stopping
+    std::condition_variable durable_cv; // durable_seq advanced
+    std::condition_variable snapshot_cv;
+    std::vector<uint8_t> pending;       // encoded records not yet written
+    uint64_t pending_first_seq;
+    uint64_t last_seq;
+    uint64_t durable_seq;
+    bool failed;
+    bool running;
+    bool stopping;
+    Stats stats;
+
+    // Owned by the flusher thread once started
+    int segment_fd;
+    size_t segment_size;
+
+    // First record number of every segment on disk, oldest first
+    std::mutex segments_mutex;
+    std::vector<uint64_t> segments;
+
+    std::mutex snapshot_mutex; // one snapshot at a time
+    std::thread flusher;
+    std::thread snapshotter;
+
+    uint64_t append(uint8_t type, const std::string& key, const Hash160* id,
+                    const std::vector<uint8_t>* value, uint64_t version,
+                    bool compressed = false, uint64_t expires = 0);
+    void flush_loop();
+    void snapshot_loop();
+    bool write_batch(const std::vector<uint8_t>& batch, uint64_t first_seq);
+    bool open_segment(uint64_t first_seq);
+    void close_segment();
+    void remove_covered_segments(uint64_t covered_seq);
+    std::string segment_path(uint64_t first_seq) const;
+    std::string snapshot_path() const;
+    uint64_t load_snapshot(Storage& storage, RecoveryStats& result);
+    bool replay_segment(const std::string& path, uint64_t after_seq, Storage& storage,
+                        RecoveryStats& result);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_PERSISTENCE_H
@@ -4,64 +4,296 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <utility>
 #include <cstring>
 
 namespace funnelkvs {
 
 enum class OpCode : uint8_t {
-    GET = 0x01,
-    PUT = 0x02,
+    GET = 0x01,              // value: optionally ReadConsistency(1); compressed: a compressed
+                             // reply is accepted
+    PUT = 0x02,              // compressed: value is in Compression form
     DELETE = 0x03,
+    MULTI_GET = 0x04,    // value: encoded batch of keys
+    MULTI_PUT = 0x05,    // value: encoded batch of key/value pairs
+    MULTI_DELETE = 0x06, // value: encoded batch of keys
+    CAS = 0x07,          // value: stored value with Expected(8) as version; reply: Version(8),
+                         // see VERSION_MISMATCH
+    GET_VERSIONED = 0x08, // reply: stored value
+    PUT_TTL = 0x09,       // value: TtlMs(8) Value, laid out as a versioned value; the key
+                          // expires TtlMs after the owner stores it. compressed: as PUT
+    SCAN = 0x0A,          // key: key prefix to match; value: see encodeScanRequest
     JOIN = 0x10,
     STABILIZE = 0x11,
-    NOTIFY = 0x12,
+    NOTIFY = 0x12,           // key: optionally the 20-byte id of the ring position notified
     PING = 0x13,
-    REPLICATE = 0x14,
-    TRANSFER_KEY = 0x15,
+    REPLICATE = 0x14,        // store a replica copy, no ownership check; value: stored value
+    TRANSFER_KEY = 0x15,     // value: stored value
+    REPLICATE_DELETE = 0x16, // drop a replica copy, no ownership check; value: optionally Version(8)
+    REPLICATE_GET = 0x17,    // read a replica copy, no ownership check; value: optionally
+                             // Mode(1), 1 = reply with the copy's entry Digest(8) only
+    TRANSFER_BATCH = 0x18,   // value: encoded batch of key / stored value handed over
+    GET_LEASED = 0x19,       // value: requester "address:port"; reply: LeaseMs(4) Value
+    INVALIDATE = 0x1A,       // drop a cached copy handed out under a read lease
+    MERKLE_DIGESTS = 0x1B,   // anti-entropy: digests of hash tree nodes over a range
+    MERKLE_KEYS = 0x1C,      // anti-entropy: keys and entry digests of tree leaves
+    REPAIR = 0x1D,           // anti-entropy: replica puts and deletes from the owner
     FIND_SUCCESSOR = 0x20,
     FIND_PREDECESSOR = 0x21,
-    GET_PREDECESSOR = 0x22,
-    GET_SUCCESSOR = 0x23,
-    CLOSEST_PRECEDING_NODE = 0x24,
+    GET_PREDECESSOR = 0x22,  // key: optionally the 20-byte id of the ring position asked
+    GET_SUCCESSOR = 0x23,    // key: as GET_PREDECESSOR
+    CLOSEST_PRECEDING_NODE = 0x24, // one iterative lookup step, see lookup_step
     NODE_INFO = 0x25,
-    ADMIN_SHUTDOWN = 0x30
+    GET_SUCCESSOR_LIST = 0x26, // key: as GET_PREDECESSOR
+    GET_ROUTING = 0x27,      // key: as GET_PREDECESSOR; reply: Count(1) and one node list,
+                             // the first Count the successor list, then the distinct fingers
+    ADMIN_SHUTDOWN = 0x30,
+    STATS = 0x31,            // reply: "name value" lines, see StatsReport
+    SET_LOG_LEVEL = 0x32     // value: "debug", "info", "warn", "error" or "off"
 };
 
 enum class StatusCode : uint8_t {
     SUCCESS = 0x00,
     KEY_NOT_FOUND = 0x01,
     ERROR = 0x02,
-    REDIRECT = 0x03
+    REDIRECT = 0x03,
+    VERSION_MISMATCH = 0x04  // CAS lost; value: the key's current Version(8), 0 if absent
 };
 
+// How a GET may be served. PRIMARY (also a GET without the byte) reads
+// the owner's copy. ANY lets whichever node holds a copy, owner or
+// replica, answer, and may return a value a write has not reached yet.
+// QUORUM has the owner compare entry digests with its replicas until
+// read_quorum copies agree; copies found to differ are counted as stale
+// and repaired from the owner's.
+enum class ReadConsistency : uint8_t {
+    PRIMARY = 0x00,
+    ANY = 0x01,
+    QUORUM = 0x02
+};
+
+// compressed travels as Protocol::COMPRESSED_FLAG in the opcode byte
 struct Request {
     OpCode opcode;
     std::vector<uint8_t> key;
     std::vector<uint8_t> value;
+    bool compressed;
     
-    Request() : opcode(OpCode::GET) {}
+    Request() : opcode(OpCode::GET), compressed(false) {}
     Request(OpCode op, const std::vector<uint8_t>& k, const std::vector<uint8_t>& v = {})
-        : opcode(op), key(k), value(v) {}
+        : opcode(op), key(k), value(v), compressed(false) {}
+};
+
+// Non-owning view of bytes inside a receive buffer (C++11 has no
+// string_view/span). Valid only while the underlying buffer is untouched.
+struct ByteView {
+    const uint8_t* data;
+    size_t size;
+    
+    ByteView() : data(nullptr), size(0) {}
+    ByteView(const uint8_t* d, size_t n) : data(d), size(n) {}
+    
+    bool empty() const { return size == 0; }
+    std::string to_string() const {
+        return std::string(reinterpret_cast<const char*>(data), size);
+    }
+    std::vector<uint8_t> to_vector() const {
+        return std::vector<uint8_t>(data, data + size);
+    }
+};
+
+// A request decoded in place: key and value point into the frame
+struct RequestView {
+    OpCode opcode;
+    ByteView key;
+    ByteView value;
+    bool compressed;
+    
+    RequestView() : opcode(OpCode::GET), compressed(false) {}
 };
 
+// compressed travels as Protocol::COMPRESSED_FLAG in the status byte
 struct Response {
     StatusCode status;
     std::vector<uint8_t> value;
+    bool compressed;
     
-    Response() : status(StatusCode::ERROR) {}
+    Response() : status(StatusCode::ERROR), compressed(false) {}
     Response(StatusCode s, const std::vector<uint8_t>& v = {})
-        : status(s), value(v) {}
+        : status(s), value(v), compressed(false) {}
+};
+
+// One key of a MULTI_* batch; value is empty for MULTI_GET / MULTI_DELETE
+struct BatchEntry {
+    std::string key;
+    std::vector<uint8_t> value;
+    
+    BatchEntry() {}
+    BatchEntry(const std::string& k, const std::vector<uint8_t>& v = {})
+        : key(k), value(v) {}
+};
+
+// Per-key outcome of a batch, in the same order as the request entries.
+// For MULTI_GET a SUCCESS result carries the value.
+struct BatchResult {
+    StatusCode status;
+    std::vector<uint8_t> value;
+    
+    BatchResult() : status(StatusCode::ERROR) {}
+    explicit BatchResult(StatusCode s) : status(s) {}
+};
+
+enum class FrameStatus {
+    COMPLETE,
+    INCOMPLETE,
+    INVALID
 };
 
 class Protocol {
 public:
+    // Upper bound on a single request frame; larger length fields are
+    // treated as a corrupt stream rather than an allocation request.
+    static constexpr size_t MAX_FRAME_SIZE = 128 * 1024 * 1024;
+    static constexpr size_t REQUEST_HEADER_SIZE = 5;  // OpCode + KeyLen
+    static constexpr size_t RESPONSE_HEADER_SIZE = 5; // Status + ValueLen
+    // High bit of the opcode or status byte: the frame's value is in
+    // Compression form (for a GET request: the client can take it so)
+    static constexpr uint8_t COMPRESSED_FLAG = 0x80;
+    
     static std::vector<uint8_t> encodeRequest(const Request& req);
     static bool decodeRequest(const std::vector<uint8_t>& data, Request& req);
+    static bool decodeRequest(const uint8_t* data, size_t len, Request& req);
+    static bool decodeRequestView(const uint8_t* data, size_t len, RequestView& view);
+    
+    // Header bytes that precede the key / value on the wire, so callers can
+    // scatter-gather a frame with writev instead of assembling a copy.
+    static void encodeRequestPrefix(OpCode opcode, uint32_t key_len, uint8_t out[5],
+                                    bool compressed = false);
+    static void encodeLength(uint32_t len, uint8_t out[4]);
+    static void encodeResponseHeader(StatusCode status, uint32_t value_len, uint8_t out[5],
+                                     bool compressed = false);
+    static StatusCode decodeStatus(uint8_t byte, bool& compressed) {
+        compressed = (byte & COMPRESSED_FLAG) != 0;
+        return static_cast<StatusCode>(byte & ~COMPRESSED_FLAG);
+    }
+    
+    // Determine whether data holds a complete request frame and, if so, its
+    // total length. Used to frame requests out of a connection's byte stream.
+    static FrameStatus requestFrameSize(const uint8_t* data, size_t len, size_t& frame_size);
     
     static std::vector<uint8_t> encodeResponse(const Response& resp);
     static bool decodeResponse(const std::vector<uint8_t>& data, Response& resp);
+    static bool decodeResponse(const uint8_t* data, size_t len, Response& resp);
+    static FrameStatus responseFrameSize(const uint8_t* data, size_t len, size_t& frame_size);
+    
+    // Append an encoded frame to an existing buffer (used to batch several
+    // requests or responses into one write)
+    static void appendRequest(std::vector<uint8_t>& buffer, const Request& req);
+    
+    // MULTI_* payloads, carried in the value field of an ordinary frame:
+    //   request:  Count(4) { KeyLen(4) Key ValueLen(4) Value } * Count
+    //   response: Count(4) { Status(1) ValueLen(4) Value } * Count
+    //   TRANSFER_BATCH carries the request form
+    // A sub-batch a coordinator forwards to a key's owner has the key field
+    // BATCH_FORWARDED, so the receiver serves it without forwarding again.
+    static constexpr uint8_t BATCH_FORWARDED = 0x01;
+    static std::vector<uint8_t> encodeBatch(const std::vector<BatchEntry>& entries);
+    static std::vector<uint8_t> encodeBatch(
+        const std::vector<std::pair<std::string, std::vector<uint8_t>>>& entries);
+    static bool decodeBatch(const uint8_t* data, size_t len, std::vector<BatchEntry>& entries);
+    static std::vector<uint8_t> encodeBatchResults(const std::vector<BatchResult>& results);
+    static bool decodeBatchResults(const uint8_t* data, size_t len, std::vector<BatchResult>& results);
+    
+    // Anti-entropy payloads (see MerkleTree). MERKLE_DIGESTS and
+    // MERKLE_KEYS carry the ring range as key: Start(20) End(20).
+    //   MERKLE_DIGESTS request: Level(1) Count(4) { Index(4) } * Count
+    //                  reply:   Count(4) { Digest(8) } * Count
+    //   MERKLE_KEYS    request: as MERKLE_DIGESTS, Level being the leaf level
+    //                  reply:   batch of key / Digest(8)
+    //   REPAIR         request: batch of key / Op(1) stored value, Op 1 = put, 0 = delete
+    //                  (a delete's stored value is empty, at the delete's version)
+    static std::vector<uint8_t> encodeTreeNodes(uint8_t level, const std::vector<uint32_t>& indices);
+    static bool decodeTreeNodes(const uint8_t* data, size_t len, uint8_t& level,
+                                std::vector<uint32_t>& indices);
+    static std::vector<uint8_t> encodeDigests(const std::vector<uint64_t>& digests);
+    static bool decodeDigests(const uint8_t* data, size_t len, std::vector<uint64_t>& digests);
+    static void encodeDigest(uint64_t digest, uint8_t out[8]);
+    static uint64_t decodeDigest(const uint8_t in[8]);
+    
+    // SCAN walks the ring in key id order, one bounded chunk per request:
+    //   request: Flags(1) MaxEntries(4) MaxBytes(4) Cursor
+    //   reply:   CursorLen(4) Cursor, then a batch of key / value
+    // The cursor is opaque to clients: empty to start a scan, and empty in
+    // the reply once it is complete. Without SCAN_LOCAL the scan covers the
+    // whole ring and a node serves the part it owns, redirecting to the
+    // owner of the cursor's position; with it, only the node's own store,
+    // replica copies included. MaxEntries and MaxBytes of 0 ask for the
+    // server's defaults, and larger values are capped.
+    static constexpr uint8_t SCAN_LOCAL = 0x01;
+    static constexpr uint32_t SCAN_DEFAULT_ENTRIES = 1000;
+    static constexpr uint32_t SCAN_MAX_ENTRIES = 10000;
+    static constexpr uint32_t SCAN_MAX_BYTES = 4 * 1024 * 1024;
+    static std::vector<uint8_t> encodeScanRequest(uint8_t flags, uint32_t max_entries, uint32_t max_bytes,
+                                                  const std::vector<uint8_t>& cursor);
+    // Applies the defaults and caps
+    static bool decodeScanRequest(const uint8_t* data, size_t len, uint8_t& flags, uint32_t& max_entries,
+                                  uint32_t& max_bytes, std::vector<uint8_t>& cursor);
+    static std::vector<uint8_t> encodeScanReply(
+        const std::vector<uint8_t>& cursor,
+        const std::vector<std::pair<std::string, std::vector<uint8_t>>>& entries);
+    static bool decodeScanReply(const uint8_t* data, size_t len, std::vector<uint8_t>& cursor,
+                                std::vector<BatchEntry>& entries);
+    
+    // Versioned values, Version(8) Value: the HybridClock stamp of the
+    // write first. decodeVersioned strips the version off data, leaving
+    // the value; false if data is too short to hold one.
+    static std::vector<uint8_t> encodeVersioned(uint64_t version, const uint8_t* value, size_t len);
+    static std::vector<uint8_t> encodeVersioned(uint64_t version, const std::vector<uint8_t>& value) {
+        return encodeVersioned(version, value.data(), value.size());
+    }
+    static bool decodeVersioned(std::vector<uint8_t>& data, uint64_t& version);
+    
+    // PUT_TTL values use the same layout with the TTL in place of the
+    // version. decodeTtl fails on a TTL of 0, which would expire the key
+    // at once, and caps it at MAX_TTL_MS, so that the expiry time the
+    // owner computes from it cannot wrap around into the past.
+    static constexpr uint64_t MAX_TTL_MS = 100ULL * 365 * 24 * 60 * 60 * 1000; // 100 years
+    static bool decodeTtl(std::vector<uint8_t>& data, uint64_t& ttl_ms);
+    
+    // Stored values, Version(8) Flags(1) [Expires(8)] Value: a value
+    // exactly as its owner holds it, so replicas and new owners store the
+    // same bytes. Flags has VALUE_COMPRESSED set if Value is in
+    // Compression form, and VALUE_EXPIRES if the entry's wall-clock expiry
+    // time (ms) follows. decodeStored sets expires, if given, to it or 0.
+    static constexpr uint8_t VALUE_COMPRESSED = 0x01;
+    static constexpr uint8_t VALUE_EXPIRES = 0x02;
+    static std::vector<uint8_t> encodeStored(uint64_t version, bool compressed,
+                                             const uint8_t* value, size_t len, uint64_t expires = 0);
+    static std::vector<uint8_t> encodeStored(uint64_t version, bool compressed,
+                                             const std::vector<uint8_t>& value, uint64_t expires = 0) {
+        return encodeStored(version, compressed, value.data(), value.size(), expires);
+    }
+    static bool decodeStored(std::vector<uint8_t>& data, uint64_t& version, bool& compressed,
+                             uint64_t* expires = nullptr);
+    
+    // GET's optional consistency byte; false if value is not one
+    static bool decodeReadConsistency(const std::vector<uint8_t>& value, ReadConsistency& consistency);
+    
+    // Chord routing payloads: nodes as comma-separated "address:port"
+    static std::vector<uint8_t> encodeNodeList(const std::vector<std::string>& nodes);
+    static void decodeNodeList(const uint8_t* data, size_t len, std::vector<std::string>& nodes);
+    
+    // "GET", "REPLICATE", ...; "0x7f" style for unknown codes
+    static std::string opcodeName(OpCode opcode);
+    
+    static bool isBatchOpcode(OpCode opcode) {
+        return opcode == OpCode::MULTI_GET || opcode == OpCode::MULTI_PUT ||
+               opcode == OpCode::MULTI_DELETE;
+    }
     
 private:
+    template<typename Entry>
+    static std::vector<uint8_t> encodeEntries(const std::vector<Entry>& entries);
     static void writeUint32(std::vector<uint8_t>& buffer, uint32_t value);
     static bool readUint32(const uint8_t* data, size_t& offset, size_t len, uint32_t& value);
 };
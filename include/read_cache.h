@@ -0,0 +1,133 @@
+#ifndef FUNNELKVS_READ_CACHE_H
+#define FUNNELKVS_READ_CACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Bounded cache of values owned by other nodes, kept by a node that
+// forwards reads so that a few hot keys do not all land on their owner.
+//
+// Each shard is a segmented LRU (W-TinyLFU without the window): new
+// entries start in the probation segment and move to the protected
+// segment, which holds at most PROTECTED_SHARE of the shard, on their
+// second hit. Admission is frequency based: a count-min sketch of recent
+// accesses, aged by halving, estimates how often a key is read, and a new
+// key only displaces the probation victim if it has been seen more often.
+// One-off reads of cold keys therefore cannot flush the hot set.
+//
+// Entries expire with the owner's lease and are dropped early by
+// invalidate(). An insert carries the ticket() taken before the value
+// was fetched; if the key's shard was invalidated since, the value may
+// predate the write that caused it and is discarded.
+class ReadCache {
+public:
+    static constexpr size_t DEFAULT_CAPACITY_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t DEFAULT_SHARDS = 16;
+    static constexpr double PROTECTED_SHARE = 0.8;
+    static constexpr size_t ENTRY_OVERHEAD = 64; // charged per entry on top of key and value
+    static constexpr size_t SKETCH_WIDTH = 4096; // counters per row, per shard
+    static constexpr uint8_t HOT_READS = 4;      // sketch estimate that makes a key worth caching
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t rejections;    // refused by admission or a stale ticket
+        uint64_t invalidations; // entries dropped by invalidate()
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    explicit ReadCache(size_t capacity_bytes = DEFAULT_CAPACITY_BYTES,
+                       size_t num_shards = DEFAULT_SHARDS);
+
+    ReadCache(const ReadCache&) = delete;
+    ReadCache& operator=(const ReadCache&) = delete;
+
+    bool get(const std::string& key, std::vector<uint8_t>& value);
+    // Count a read that would otherwise bypass the cache (say, be redirected
+    // to the owner). True if the key is cached or has been read at least
+    // HOT_READS times lately, i.e. the read should go through get()
+    // instead, which then counts it.
+    bool should_cache(const std::string& key);
+    uint64_t ticket(const std::string& key) const;
+    // Returns true if the value was cached
+    bool put(const std::string& key, const std::vector<uint8_t>& value,
+             std::chrono::milliseconds ttl, uint64_t ticket);
+    void invalidate(const std::string& key);
+    void clear();
+
+    size_t capacity() const { return shard_capacity * shards.size(); }
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::vector<uint8_t> value;
+        Clock::time_point expires;
+        bool protected_segment;
+
+        size_t charge() const { return key.size() + value.size() + ENTRY_OVERHEAD; }
+    };
+    typedef std::list<Entry> EntryList;
+
+    // Count-min sketch with 4-bit counters, halved every
+    // 10 * SKETCH_WIDTH recorded accesses
+    class FrequencySketch {
+    public:
+        FrequencySketch();
+        void record(uint64_t hash);
+        uint8_t estimate(uint64_t hash) const;
+
+    private:
+        static constexpr int ROWS = 4;
+        static constexpr uint8_t MAX_COUNT = 15;
+        std::vector<uint8_t> counters; // ROWS * SKETCH_WIDTH
+        size_t samples;
+
+        size_t slot(uint64_t hash, int row) const;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, EntryList::iterator> index;
+        EntryList probation; // most recent first
+        EntryList protected_entries;
+        size_t bytes;
+        size_t protected_bytes;
+        uint64_t generation; // bumped by every invalidation
+        FrequencySketch sketch;
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t rejections;
+        uint64_t invalidations;
+        uint64_t evictions;
+
+        Shard();
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shard_capacity;
+
+    static uint64_t hash_key(const std::string& key);
+    Shard& shard_for(uint64_t hash) const;
+    void erase(Shard& shard, EntryList::iterator it);
+    void promote(Shard& shard, EntryList::iterator it);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_READ_CACHE_H
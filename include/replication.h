@@ -3,35 +3,59 @@
 
 #include "hash.h"
 #include "client.h"
+#include "histogram.h"
 #include <vector>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <chrono>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <algorithm>
 
 namespace funnelkvs {
 
 struct NodeInfo;
+class ReplicationStream;
 
 class ReplicationManager {
 public:
+    // Quorums count copies including the coordinator's own. write_quorum
+    // copies must acknowledge a write before it succeeds; read_quorum
+    // copies must report a miss before a read returns not-found. Choosing
+    // write_quorum + read_quorum > replication_factor makes every read see
+    // at least one copy of every acknowledged write. Both default to 0,
+    // meaning the replication factor (every copy), and are capped by it.
     struct ReplicationConfig {
         int replication_factor;
+        int write_quorum;
+        int read_quorum;
         int sync_timeout_ms;
         int max_retries;
         bool enable_async_replication;
         
+        // Async mode: per-peer stream limits. A writer blocks for up to
+        // sync_timeout_ms while a peer's stream holds more than
+        // async_max_pending_bytes, then the write is rejected.
+        size_t async_max_pending_bytes;
+        size_t async_batch_max_ops;
+        size_t async_batch_max_bytes;
+        
         ReplicationConfig() 
-            : replication_factor(3), sync_timeout_ms(5000), max_retries(3), enable_async_replication(false) {}
+            : replication_factor(3), write_quorum(0), read_quorum(0), sync_timeout_ms(5000),
+              max_retries(3), enable_async_replication(false),
+              async_max_pending_bytes(64 * 1024 * 1024), async_batch_max_ops(512),
+              async_batch_max_bytes(1024 * 1024) {}
         ReplicationConfig(int factor, int timeout_ms, bool async = false)
-            : replication_factor(factor), sync_timeout_ms(timeout_ms), max_retries(3), enable_async_replication(async) {}
+            : replication_factor(factor), write_quorum(0), read_quorum(0),
+              sync_timeout_ms(timeout_ms), max_retries(3), enable_async_replication(async),
+              async_max_pending_bytes(64 * 1024 * 1024), async_batch_max_ops(512),
+              async_batch_max_bytes(1024 * 1024) {}
     };
     
-    // Replication task for queue-based async processing
+    // A single replica operation
     struct ReplicationTask {
         enum TaskType { PUT, DELETE };
         TaskType type;
@@ -51,29 +75,64 @@ private:
     mutable std::mutex mutex;
     std::unordered_map<std::string, std::chrono::steady_clock::time_point> replication_timestamps;
     
-    // Queue-based async replication
-    std::queue<ReplicationTask> pending_tasks;
-    std::mutex queue_mutex;
-    std::condition_variable queue_cv;
+    // Async replication: one stream per replica peer, keyed by address:port
     std::atomic<bool> running;
-    std::thread processing_thread;
+    mutable std::mutex streams_mutex;
+    std::unordered_map<std::string, std::unique_ptr<ReplicationStream>> streams;
+    
+    std::atomic<uint64_t> straggler_failures;
+    
+    // Replica ack latency per peer (address:port): one round trip per
+    // synchronous write, one per batch for async streams. Entries are
+    // never removed, so the histograms stay put while streams use them.
+    mutable std::mutex ack_mutex;
+    std::unordered_map<std::string, std::unique_ptr<Histogram>> ack_latency_us;
+    
+    // Replica writes still in flight on AsyncRpc after fan_out returned.
+    // Their callbacks use this object, so the destructor waits for them
+    // (each is bounded by sync_timeout_ms).
+    std::mutex rpc_mutex;
+    std::condition_variable rpc_done;
+    size_t outstanding_rpcs;
     
 public:
     ReplicationManager() : ReplicationManager(ReplicationConfig()) {}
     explicit ReplicationManager(const ReplicationConfig& cfg);
     ~ReplicationManager();
     
-    // Core replication operations
+    // Core replication operations. Replicas are written in parallel and the
+    // call returns as soon as write_quorum - 1 of them acknowledge (the
+    // caller's local write is the remaining copy); slower replicas finish
+    // in the background. version is the write's stamp (see
+    // Storage::apply): replicas keep the newest write of a key whatever
+    // order the operations reach them in. 0 stores unconditionally.
+    // value is sent as the owner stores it; compressed says it is in
+    // Compression form, and replicas store it that way too. A non-zero
+    // expires is the entry's expiry time, which replicas keep and act on
+    // themselves, so an expiring key needs no delete messages.
     bool replicate_put(const std::string& key, const std::vector<uint8_t>& value,
-                      const std::vector<std::shared_ptr<NodeInfo>>& replicas);
+                      const std::vector<std::shared_ptr<NodeInfo>>& replicas,
+                      uint64_t version = 0, bool compressed = false, uint64_t expires = 0);
     
     bool replicate_delete(const std::string& key,
-                         const std::vector<std::shared_ptr<NodeInfo>>& replicas);
+                         const std::vector<std::shared_ptr<NodeInfo>>& replicas,
+                         uint64_t version = 0);
     
-    // Read from replicas with fallback
+    // Read from replicas in parallel: true on the first replica holding the
+    // key; false once read_quorum - 1 replicas (the caller's own miss being
+    // the other) or all of them report a miss.
     bool get_from_replicas(const std::string& key, std::vector<uint8_t>& value,
                           const std::vector<std::shared_ptr<NodeInfo>>& replicas);
     
+    // Quorum read check: ask replicas in parallel for the entry digest of
+    // their copy of key and compare it with ours. Waits until `needed`
+    // have answered, all have, or the sync timeout expires. Replicas that
+    // answered with a different copy, or none, are returned in stale.
+    // Returns the number of replicas that answered.
+    int check_replicas(const std::string& key, uint64_t digest,
+                       const std::vector<std::shared_ptr<NodeInfo>>& replicas, int needed,
+                       std::vector<std::shared_ptr<NodeInfo>>& stale);
+    
     // Failure handling
     void handle_replica_failure(std::shared_ptr<NodeInfo> failed_node,
                                const std::vector<std::shared_ptr<NodeInfo>>& new_replicas,
@@ -88,12 +147,28 @@ public:
         std::lock_guard<std::mutex> lock(mutex);
         return config.replication_factor; 
     }
+    void set_quorums(int write_quorum, int read_quorum) {
+        std::lock_guard<std::mutex> lock(mutex);
+        config.write_quorum = write_quorum;
+        config.read_quorum = read_quorum;
+    }
+    int get_write_quorum() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return effective_quorum(config.write_quorum);
+    }
+    int get_read_quorum() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return effective_quorum(config.read_quorum);
+    }
     
     // Statistics
     size_t get_replication_count() const {
         std::lock_guard<std::mutex> lock(mutex);
         return replication_timestamps.size();
     }
+    // Replica sends that failed after their write had already been
+    // acknowledged to the client by the quorum
+    uint64_t get_straggler_failures() const { return straggler_failures.load(); }
     
     // Node communication
     bool ping_node(std::shared_ptr<NodeInfo> node);
@@ -102,69 +177,260 @@ public:
     void start_async_processing();
     void stop_async_processing();
     
+    struct StreamStats {
+        std::string peer;
+        size_t pending_ops;     // queued + in flight
+        size_t pending_bytes;
+        uint64_t sent_ops;
+        uint64_t coalesced_ops; // overwrites absorbed while queued
+        uint64_t batches_sent;
+        uint64_t failed_batches;
+        uint64_t dropped_ops;   // gave up after max_retries
+        uint64_t rejected_ops;  // refused by backpressure
+        int64_t lag_ms;         // age of the oldest unacknowledged op
+    };
+    std::vector<StreamStats> get_stream_stats() const;
+    int64_t get_max_replication_lag_ms() const;
+    
+    struct PeerLatency {
+        std::string peer;
+        Histogram::Snapshot latency_us;
+    };
+    // Per replica peer, ordered by peer
+    std::vector<PeerLatency> get_ack_latency() const;
+    
+    // Wait until every async stream has drained; false on timeout
+    bool flush_async(std::chrono::milliseconds timeout);
+    
 private:
+    int effective_quorum(int quorum) const {
+        if (quorum <= 0 || quorum > config.replication_factor) {
+            return std::max(1, config.replication_factor);
+        }
+        return quorum;
+    }
+    
     bool send_replication_request(std::shared_ptr<NodeInfo> target,
                                  const std::string& operation,
                                  const std::string& key,
                                  const std::vector<uint8_t>& value = {});
     
-    // Async replication processing
-    void enqueue_replication_task(const ReplicationTask& task);
-    void process_replication_queue();
-    bool process_single_task(ReplicationTask& task);
+    // Send the task's operation to every target in parallel and wait until
+    // `required` acknowledge, success becomes impossible, or the sync
+    // timeout expires.
+    bool fan_out(ReplicationTask::TaskType type, const std::string& key,
+                 const std::shared_ptr<const std::vector<uint8_t>>& value,
+                 const std::vector<std::shared_ptr<NodeInfo>>& targets, int required);
+    std::vector<std::shared_ptr<NodeInfo>> select_targets(
+        const std::vector<std::shared_ptr<NodeInfo>>& replicas) const;
+    
+    // Async replication
+    bool enqueue_async(ReplicationTask::TaskType type, const std::string& key,
+                       const std::shared_ptr<const std::vector<uint8_t>>& value,
+                       const std::vector<std::shared_ptr<NodeInfo>>& replicas);
+    ReplicationStream* stream_for(const std::shared_ptr<NodeInfo>& peer);
+    Histogram* ack_histogram(const std::string& peer_key);
+};
+
+// Ordered, coalescing replication stream to one peer (async mode).
+//
+// Writers enqueue operations; a sender thread drains them in batches that
+// go out as one pipelined write of REPLICATE / REPLICATE_DELETE frames. An
+// operation on a key that is still queued replaces the queued one, so a
+// hot key is sent once per batch rather than once per write. Queued bytes
+// are bounded: enqueue blocks while the stream is full. Failed batches are
+// retried with backoff, up to max_retries times in a row.
+class ReplicationStream {
+public:
+    struct Limits {
+        size_t max_pending_bytes;
+        size_t batch_max_ops;
+        size_t batch_max_bytes;
+        int max_retries;
+    };
+    
+    // ack_latency_us (may be null) receives each acknowledged batch's
+    // round-trip time and must outlive the stream
+    ReplicationStream(std::shared_ptr<NodeInfo> peer, const Limits& limits,
+                      Histogram* ack_latency_us = nullptr);
+    ~ReplicationStream();
+    
+    ReplicationStream(const ReplicationStream&) = delete;
+    ReplicationStream& operator=(const ReplicationStream&) = delete;
+    
+    // False if the stream stayed full for max_wait or is stopping
+    bool enqueue(ReplicationManager::ReplicationTask::TaskType type, const std::string& key,
+                 const std::shared_ptr<const std::vector<uint8_t>>& value,
+                 std::chrono::milliseconds max_wait);
+    bool wait_idle(std::chrono::milliseconds timeout);
+    void stop();
+    ReplicationManager::StreamStats get_stats() const;
+    
+private:
+    struct PendingOp {
+        ReplicationManager::ReplicationTask::TaskType type;
+        std::shared_ptr<const std::vector<uint8_t>> value; // stored value; DELETE: Version(8) only
+        std::chrono::steady_clock::time_point enqueued_at;
+    };
+    typedef std::pair<std::string, PendingOp> BatchItem;
+    
+    std::shared_ptr<NodeInfo> peer;
+    Limits limits;
+    Histogram* ack_latency_us;
+    
+    mutable std::mutex mutex;
+    std::condition_variable work_cv;  // sender: ops available / stopping
+    std::condition_variable space_cv; // writers: bytes released
+    std::condition_variable idle_cv;  // flush: queue and batch empty
+    std::deque<std::string> order;    // FIFO of queued keys
+    std::unordered_map<std::string, PendingOp> pending;
+    size_t pending_bytes;             // queued + in flight
+    size_t inflight_ops;
+    std::chrono::steady_clock::time_point inflight_oldest;
+    bool stopping;
+    
+    uint64_t sent_ops;
+    uint64_t coalesced_ops;
+    uint64_t batches_sent;
+    uint64_t failed_batches;
+    uint64_t dropped_ops;
+    uint64_t rejected_ops;
+    
+    std::thread sender;
+    
+    static size_t op_bytes(const std::string& key, const PendingOp& op) {
+        return key.size() + (op.value ? op.value->size() : 0);
+    }
+    void run();
+    // Returns, per item, whether the peer acknowledged it
+    std::vector<bool> send_batch(const std::vector<BatchItem>& batch);
 };
 
-// Failure detector for monitoring node health
+// Phi-accrual failure detector (Hayashibara et al.).
+//
+// Each monitored node has a window of heartbeat inter-arrival times.
+// Instead of a yes/no timeout, the detector turns the time since the last
+// heartbeat into phi = -log10(P(a heartbeat arrives this late)), using a
+// normal fit of the window, so the verdict adapts to how regularly the
+// node is actually heard from. A node is suspected at phi_threshold / 2
+// and failed at phi_threshold.
+//
+// Heartbeats mostly come for free: every answer a peer gives over AsyncRpc
+// or ConnectionPool is stamped in the HeartbeatRegistry, and each probe
+// round takes the latest stamp as that node's heartbeat. Only nodes not
+// heard from within half a ping interval get a PING, sent to all of them
+// at once without waiting for the answers, so a round costs nothing on a
+// busy ring and never blocks on a dead node. A node that has never been
+// heard from has no history to judge by and is failed after
+// failure_threshold missed probes instead.
 class FailureDetector {
 public:
     struct FailureConfig {
-        int ping_interval_ms;
+        int ping_interval_ms; // expected time between probe rounds
         int ping_timeout_ms;
-        int failure_threshold;
+        int failure_threshold; // missed probes that fail a node with no history
+        double phi_threshold;
+        int min_std_dev_ms;    // floor for the fitted spread, against jitter
+        size_t window_size;    // inter-arrival samples kept per node
         
         FailureConfig() 
-            : ping_interval_ms(2000), ping_timeout_ms(5000), failure_threshold(3) {}
+            : ping_interval_ms(250), ping_timeout_ms(1000), failure_threshold(3),
+              phi_threshold(8.0), min_std_dev_ms(75), window_size(64) {}
         FailureConfig(int interval_ms, int timeout_ms, int threshold)
-            : ping_interval_ms(interval_ms), ping_timeout_ms(timeout_ms), failure_threshold(threshold) {}
+            : ping_interval_ms(interval_ms), ping_timeout_ms(timeout_ms), failure_threshold(threshold),
+              phi_threshold(8.0), min_std_dev_ms(75), window_size(64) {}
+    };
+    
+    struct Stats {
+        uint64_t rounds;
+        uint64_t probes_sent;
+        uint64_t probes_skipped; // heard from recently enough without a probe
+        uint64_t probe_failures;
+        uint64_t failures_detected;
+        size_t monitored;
+        size_t suspected;
+        size_t failed;
     };
     
 private:
     struct NodeStatus {
         std::chrono::steady_clock::time_point last_seen;
+        int64_t last_heartbeat_us; // latest heartbeat taken into the window
+        int64_t failed_at_us;      // heartbeats up to here do not revive the node
+        uint64_t last_round;       // probe round that last watched the node
+        std::deque<double> intervals_ms;
+        double interval_sum;
+        double interval_sum_sq;
         int consecutive_failures;
+        bool probing;
         bool is_suspected;
         bool is_failed;
         
-        NodeStatus() : consecutive_failures(0), is_suspected(false), is_failed(false) {}
+        NodeStatus()
+            : last_seen(std::chrono::steady_clock::now()), last_heartbeat_us(0), failed_at_us(0), last_round(0), interval_sum(0), interval_sum_sq(0),
+              consecutive_failures(0), probing(false), is_suspected(false), is_failed(false) {}
     };
     
-    FailureConfig config;
-    mutable std::mutex mutex;
-    std::unordered_map<std::string, NodeStatus> node_statuses; // key: address:port
+    // Shared with in-flight probe callbacks, which may outlive the detector
+    struct State {
+        FailureConfig config;
+        std::mutex mutex;
+        std::unordered_map<std::string, NodeStatus> node_statuses; // key: address:port
+        uint64_t rounds;
+        uint64_t probes_sent;
+        uint64_t probes_skipped;
+        uint64_t probe_failures;
+        uint64_t failures_detected;
+        
+        explicit State(const FailureConfig& cfg)
+            : config(cfg), rounds(0), probes_sent(0), probes_skipped(0), probe_failures(0),
+              failures_detected(0) {}
+    };
+    
+    std::shared_ptr<State> state;
     
 public:
     FailureDetector() : FailureDetector(FailureConfig()) {}
     explicit FailureDetector(const FailureConfig& cfg);
     ~FailureDetector() = default;
     
-    // Monitor node health
+    // One detection round: take in piggybacked heartbeats, PING the quiet
+    // nodes in the background and re-evaluate every node. Does not wait
+    // for the probes; their answers count from the next round on.
+    void probe(const std::vector<std::shared_ptr<NodeInfo>>& nodes);
+    
+    // Blocking probes: ping_nodes pings every node concurrently, waits for
+    // the answers and records them
     void ping_node(std::shared_ptr<NodeInfo> node);
+    void ping_nodes(const std::vector<std::shared_ptr<NodeInfo>>& nodes);
+    
+    // Direct evidence from other traffic. mark_node_failed holds until a
+    // newer heartbeat; report_unreachable counts as one missed probe.
     void mark_node_responsive(std::shared_ptr<NodeInfo> node);
     void mark_node_failed(std::shared_ptr<NodeInfo> node);
+    void report_unreachable(std::shared_ptr<NodeInfo> node);
     
     // Query node status
     bool is_node_failed(std::shared_ptr<NodeInfo> node) const;
     bool is_node_suspected(std::shared_ptr<NodeInfo> node) const;
+    // Current suspicion level; 0 for a node without heartbeat history
+    double phi(std::shared_ptr<NodeInfo> node) const;
     
     // Get failed nodes list
     std::vector<std::shared_ptr<NodeInfo>> get_failed_nodes() const;
+    Stats get_stats() const;
     
     // Cleanup
     void cleanup_old_entries(std::chrono::minutes max_age = std::chrono::minutes(30));
     
 private:
     std::string get_node_key(std::shared_ptr<NodeInfo> node) const;
-    bool ping_node_impl(std::shared_ptr<NodeInfo> node);
+    
+    // All of these expect state->mutex held
+    static void take_heartbeat(State& state, NodeStatus& status, int64_t at_us);
+    static void record_miss(State& state, NodeStatus& status, const std::string& node_key);
+    static double compute_phi(const State& state, const NodeStatus& status, int64_t now_us);
+    static void evaluate(State& state, NodeStatus& status, const std::string& node_key, int64_t now_us);
 };
 
 } // namespace funnelkvs
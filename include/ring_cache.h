@@ -0,0 +1,46 @@
+#ifndef FUNNELKVS_RING_CACHE_H
+#define FUNNELKVS_RING_CACHE_H
+
+#include "hash.h"
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Client-side copy of the ring layout: every known node's id (SHA-1 of
+// its endpoint, "address:port" or "address:port#token", exactly as the
+// nodes derive it) in ring order, so a client can hash a key and pick its
+// owner without asking the ring.
+// Not thread-safe; each Client owns its own.
+class RingCache {
+private:
+    std::vector<std::pair<Hash160, std::string>> ring; // sorted by id
+    
+public:
+    void add(const std::string& endpoint);
+    void add(const std::vector<std::string>& endpoints);
+    bool remove(const std::string& endpoint);
+    void clear() { ring.clear(); }
+    
+    // The first node at or after id, wrapping around the ring
+    bool owner_of(const Hash160& id, std::string& endpoint) const;
+    // id's owner followed by the next nodes on other servers, count in all
+    // (fewer if the ring is smaller): where a key's replicas live, as
+    // ChordNode::get_replica_nodes picks them
+    std::vector<std::string> replicas_of(const Hash160& id, size_t count) const;
+    bool contains(const std::string& endpoint) const;
+    
+    size_t size() const { return ring.size(); }
+    bool empty() const { return ring.empty(); }
+    std::vector<std::string> nodes() const;
+    
+    // "address:port" or "address:port#token"; token (if given) is 0 without one
+    static bool split_endpoint(const std::string& endpoint, std::string& host, uint16_t& port,
+                               uint16_t* token = nullptr);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_RING_CACHE_H
@@ -0,0 +1,69 @@
+#ifndef FUNNELKVS_RWLOCK_H
+#define FUNNELKVS_RWLOCK_H
+
+#include <pthread.h>
+#include <stdexcept>
+
+namespace funnelkvs {
+
+// Reader/writer lock (std::shared_mutex is not available in C++11).
+// Writers are preferred where the platform supports it so a steady stream of
+// readers cannot starve PUT/DELETE.
+class RWLock {
+private:
+    pthread_rwlock_t lock;
+
+public:
+    RWLock() {
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+#if defined(__GLIBC__)
+        pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        int rc = pthread_rwlock_init(&lock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+        if (rc != 0) {
+            throw std::runtime_error("Failed to initialize rwlock");
+        }
+    }
+
+    ~RWLock() {
+        pthread_rwlock_destroy(&lock);
+    }
+
+    RWLock(const RWLock&) = delete;
+    RWLock& operator=(const RWLock&) = delete;
+
+    void lock_shared() { pthread_rwlock_rdlock(&lock); }
+    void unlock_shared() { pthread_rwlock_unlock(&lock); }
+    void lock_exclusive() { pthread_rwlock_wrlock(&lock); }
+    void unlock_exclusive() { pthread_rwlock_unlock(&lock); }
+};
+
+class ReadGuard {
+private:
+    RWLock& rw;
+
+public:
+    explicit ReadGuard(RWLock& l) : rw(l) { rw.lock_shared(); }
+    ~ReadGuard() { rw.unlock_shared(); }
+
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+};
+
+class WriteGuard {
+private:
+    RWLock& rw;
+
+public:
+    explicit WriteGuard(RWLock& l) : rw(l) { rw.lock_exclusive(); }
+    ~WriteGuard() { rw.unlock_exclusive(); }
+
+    WriteGuard(const WriteGuard&) = delete;
+    WriteGuard& operator=(const WriteGuard&) = delete;
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_RWLOCK_H
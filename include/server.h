@@ -3,76 +3,117 @@
 
 #include "storage.h"
 #include "protocol.h"
+#include "byte_buffer.h"
+#include "thread_pool.h"
+#include "metrics.h"
 #include <thread>
 #include <vector>
 #include <atomic>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <memory>
+#include <unordered_set>
+#include <sys/uio.h>
 
 namespace funnelkvs {
 
-class ThreadPool {
-private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queue_mutex;
-    std::condition_variable condition;
-    std::atomic<bool> stop;
-
-public:
-    explicit ThreadPool(size_t threads);
-    ~ThreadPool();
-    
-    template<typename F>
-    void enqueue(F&& f);
-    
-private:
-    void worker_thread();
-};
-
+// Event-driven TCP front end.
+//
+// One or more event loops own non-blocking sockets registered with epoll in
+// EPOLLONESHOT mode. A loop reads whatever has arrived into the connection's
+// receive buffer and hands the connection to the worker pool only once it
+// holds at least one complete request frame; the worker serves every
+// complete frame in order and then re-arms the socket. Idle connections
+// therefore cost a buffer, not a thread, and at most one thread touches a
+// connection at a time, which keeps responses in request order. Clients may
+// pipeline: responses to every frame in a burst are queued and written with
+// a single send.
 class Server {
 protected:
     Storage storage;
     ThreadPool thread_pool;
-    int server_fd;
     std::atomic<bool> running;
-    std::thread accept_thread;
     uint16_t port;
-    
+    size_t num_event_loops;
+
 public:
-    explicit Server(uint16_t port, size_t num_threads = 8);
+    // num_event_loops > 1 gives every loop its own SO_REUSEPORT listening
+    // socket so the kernel spreads incoming connections across them.
+    explicit Server(uint16_t port, size_t num_threads = 8, size_t num_event_loops = 1);
     virtual ~Server();
-    
+
     virtual void start();
     virtual void stop();
     bool is_running() const { return running.load(); }
-    
+    size_t active_connections() const;
+    // Pin each worker thread to its own CPU; false if the OS refused
+    bool pin_workers() { return thread_pool.pin_workers(); }
+    // The store served by this node
+    virtual Storage::MemoryStats get_memory_stats() const;
+    // Everything the STATS opcode reports
+    StatsReport get_stats() const;
+
 protected:
-    void accept_loop();
-    void handle_client(int client_fd);
-    virtual void process_request(int client_fd, const Request& request);
-    bool receive_data(int fd, std::vector<uint8_t>& buffer, size_t expected_size);
+    // The request is passed by non-const reference so handlers can move
+    // its value into storage instead of copying it.
+    virtual void process_request(Request& request, Response& response);
+    // Adds this server's metrics to report; subclasses extend it
+    virtual void collect_stats(StatsReport& report) const;
     bool send_data(int fd, const std::vector<uint8_t>& data);
-    
+    bool send_response(int fd, const Response& response);
+
 private:
-    void setup_server_socket();
-};
+    struct EventLoop {
+        int epoll_fd;
+        int listen_fd;
+        int wake_fd;
+        std::thread thread;
+
+        EventLoop() : epoll_fd(-1), listen_fd(-1), wake_fd(-1) {}
+    };
+
+    struct Connection {
+        int fd;
+        EventLoop* loop;
+        ByteBuffer read_buffer;
+        ByteBuffer write_buffer; // responses queued during one burst
+
+        Connection(int f, EventLoop* l) : fd(f), loop(l) {}
+        ~Connection();
+    };
 
-template<typename F>
-void ThreadPool::enqueue(F&& f) {
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        if (stop.load()) {
-            return;
-        }
-        tasks.emplace(std::forward<F>(f));
-    }
-    condition.notify_one();
-}
+    std::vector<std::unique_ptr<EventLoop>> event_loops;
+    RequestMetrics request_metrics;
+    std::atomic<uint64_t> accepted_connections;
+    std::mutex lifecycle_mutex; // start()/stop()
+
+    // Every open connection, so stop() can release them. A connection is
+    // only ever handled by one thread at a time (EPOLLONESHOT), so this set
+    // is touched on accept/close only, never per request.
+    mutable std::mutex connections_mutex;
+    std::unordered_set<Connection*> connections;
+
+    // Connections currently handed to the worker pool
+    std::mutex in_flight_mutex;
+    std::condition_variable in_flight_cv;
+    size_t in_flight;
+
+    int create_listen_socket(bool reuse_port);
+    void close_event_loops();
+    void event_loop(EventLoop* loop);
+    void accept_connections(EventLoop* loop);
+    void on_readable(Connection* conn);
+    void serve_connection(Connection* conn, bool close_after);
+    bool queue_response(Connection* conn, const Response& response);
+    bool flush_responses(Connection* conn);
+    bool rearm(Connection* conn);
+    void close_connection(Connection* conn);
+    void finish_dispatch();
+    bool send_all(int fd, const uint8_t* data, size_t len);
+    bool send_vectored(int fd, struct iovec* iov, int iovcnt);
+};
 
 } // namespace funnelkvs
 
-#endif // FUNNELKVS_SERVER_H
\ No newline at end of file
+#endif // FUNNELKVS_SERVER_H
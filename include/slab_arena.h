@@ -0,0 +1,93 @@
+#ifndef FUNNELKVS_SLAB_ARENA_H
+#define FUNNELKVS_SLAB_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace funnelkvs {
+
+// Size-class allocator for small objects owned by one storage shard.
+//
+// Requests of up to MAX_SLOT_SIZE bytes are rounded up to a size class and
+// served from SLAB_SIZE slabs carved into equal slots, with a free list per
+// class. A slot carries no malloc header, and a freed slot is reused by the
+// next object of a similar size, so millions of ~100 byte entries neither
+// pay per-allocation overhead nor fragment the heap. Larger requests go to
+// the global heap. Slabs are only returned when the arena is destroyed.
+//
+// Not thread-safe: a shard allocates and frees only under its write lock.
+class SlabArena {
+public:
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+    static constexpr size_t MAX_SLOT_SIZE = 4096;
+    static constexpr size_t ALIGNMENT = 8;
+
+    struct Stats {
+        size_t slab_bytes;   // reserved in slabs
+        size_t slot_bytes;   // of which handed out, at slot granularity
+        size_t large_bytes;  // live allocations above MAX_SLOT_SIZE
+        size_t allocations;  // live allocations of any size
+    };
+
+    SlabArena();
+    ~SlabArena();
+
+    SlabArena(const SlabArena&) = delete;
+    SlabArena& operator=(const SlabArena&) = delete;
+
+    void* allocate(size_t size);
+    // size must be the one passed to allocate
+    void deallocate(void* ptr, size_t size);
+
+    // Bytes actually reserved for a request of size bytes
+    static size_t capacity(size_t size);
+
+    Stats stats() const { return counters; }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    static const size_t NUM_CLASSES;
+    static size_t class_index(size_t size);
+
+    std::vector<void*> slabs;
+    std::vector<FreeSlot*> free_lists; // one per size class
+    Stats counters;
+
+    void refill(size_t index);
+};
+
+// Standard allocator over a SlabArena, so containers inside a shard can
+// take their nodes from the same arena as the entries themselves.
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(SlabArena* a) : arena(a) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= SlabArena::ALIGNMENT, "slots are only 8-byte aligned");
+        return static_cast<T*>(arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        arena->deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    SlabArena* arena;
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_SLAB_ARENA_H
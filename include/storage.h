@@ -1,41 +1,481 @@
 #ifndef FUNNELKVS_STORAGE_H
 #define FUNNELKVS_STORAGE_H
 
+#include "rwlock.h"
+#include "hash.h"
+#include "slab_arena.h"
+#include "cold_tier.h"
+#include "merkle.h"
+#include "hlc.h"
+#include "compression.h"
+#include "timer_wheel.h"
 #include <unordered_map>
+#include <set>
 #include <vector>
 #include <string>
-#include <mutex>
 #include <memory>
 #include <functional>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
 
 namespace funnelkvs {
 
+// Receives every change made to a Storage. The log_* calls are made with the
+// key's shard lock held, so changes to a key are logged in the order they
+// were applied; they should only record the change and return a ticket.
+// The store then calls sync() with that ticket after releasing the lock,
+// and returns to its caller once sync() does. sync() returns false if the
+// change could not be made durable.
+class StorageJournal {
+public:
+    virtual ~StorageJournal() {}
+
+    virtual uint64_t log_put(const std::string& key, const Hash160& id,
+                             const std::vector<uint8_t>& value, uint64_t version, bool compressed,
+                             uint64_t expires) = 0;
+    virtual uint64_t log_remove(const std::string& key) = 0;
+    virtual uint64_t log_clear() = 0;
+    virtual bool sync(uint64_t ticket) = 0;
+};
+
 class Storage {
+public:
+    static constexpr size_t DEFAULT_NUM_SHARDS = 64;
+
 private:
-    std::unordered_map<std::string, std::vector<uint8_t>> data;
-    mutable std::mutex mutex;
+    // One stored entry, laid out in a single arena block: this header, then
+    // the key bytes, then either the value bytes or, for a cold entry, the
+    // value's location in the cold tier. The key's ring id is computed
+    // once, when the entry is written, so ownership checks over the whole
+    // store never rehash keys; so is its anti-entropy digest, which the
+    // Merkle tree gives back when the entry is overwritten or removed.
+    // version is the write's HybridClock stamp. A COMPRESSED value is held
+    // (and digested, replicated and logged) in its Compression form.
+    // expires is the wall-clock time (ms) the entry lapses at, 0 for never.
+    // A lapsed entry is hidden from reads at once and removed by the
+    // shard's timer wheel shortly after.
+    struct Record {
+        static constexpr uint32_t AFTER_ALL_KEYS = UINT32_MAX; // probes only
+        static constexpr uint8_t COLD = 1;
+        static constexpr uint8_t COMPRESSED = 2;
+        static constexpr size_t LOCATION_SIZE = 12; // packed ColdTier::Location
+
+        uint64_t digest; // MerkleTree::entry_digest of key, value and expiry
+        uint64_t version;
+        uint64_t expires;
+        Hash160 id;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint8_t flags;
+        // Set by reads, cleared as the eviction clock passes
+        mutable std::atomic<uint8_t> referenced;
+
+        bool cold() const { return (flags & COLD) != 0; }
+        bool compressed() const { return (flags & COMPRESSED) != 0; }
+        bool expired(uint64_t now_ms) const { return expires != 0 && expires <= now_ms; }
+        bool live() const { return expires == 0 || expires > HybridClock::wall_ms(); }
+        const char* key() const { return reinterpret_cast<const char*>(this + 1); }
+        char* key() { return reinterpret_cast<char*>(this + 1); }
+        // The inline value bytes of a hot entry
+        const uint8_t* value() const { return reinterpret_cast<const uint8_t*>(key() + key_size); }
+        uint8_t* value() { return reinterpret_cast<uint8_t*>(key() + key_size); }
+        ColdTier::Location location() const;
+        void set_location(const ColdTier::Location& location);
+        size_t footprint() const { return footprint(key_size, cold() ? LOCATION_SIZE : value_size); }
+        static size_t footprint(size_t key_size, size_t payload_size) {
+            return sizeof(Record) + key_size + payload_size;
+        }
+    };
+
+    // Map key referring to the record's own copy of the key, so the key is
+    // stored once and lookups need no temporary string
+    struct KeyRef {
+        const char* data;
+        size_t size;
+
+        KeyRef(const char* d, size_t n) : data(d), size(n) {}
+        explicit KeyRef(const std::string& key) : data(key.data()), size(key.size()) {}
+        explicit KeyRef(const Record* record) : data(record->key()), size(record->key_size) {}
+    };
+
+    struct KeyHash {
+        size_t operator()(const KeyRef& key) const;
+    };
+
+    struct KeyEqual {
+        bool operator()(const KeyRef& a, const KeyRef& b) const;
+    };
+
+    // Ring order: by id, then by key for the (theoretical) case of two keys
+    // sharing an id. A probe with key_size AFTER_ALL_KEYS sorts after every
+    // key with its id.
+    struct RecordOrder {
+        bool operator()(const Record* a, const Record* b) const;
+    };
+
+    typedef std::unordered_map<KeyRef, Record*, KeyHash, KeyEqual,
+                               ArenaAllocator<std::pair<const KeyRef, Record*>>> RecordMap;
+    typedef std::set<Record*, RecordOrder, ArenaAllocator<Record*>> RecordIndex;
+
+    // Each shard owns a disjoint subset of the keys (chosen by key hash) and
+    // its own reader/writer lock, so operations on different keys rarely meet
+    // on the same lock and concurrent GETs never block each other. Records,
+    // map nodes and index nodes all come from the shard's arena.
+    struct Shard {
+        SlabArena arena; // first, so it outlives the containers below
+        RecordMap data;
+        RecordIndex by_id; // secondary index over the records in ring order
+        size_t key_bytes;
+        size_t value_bytes;      // of all values, hot or cold
+        size_t cold_value_bytes; // of values in the cold tier
+        size_t compressed_value_bytes; // of values stored compressed
+        ColdTier* cold;
+        MerkleTree* tree;        // the store's, kept current by create/destroy
+        Hash160 clock_hand;      // id the eviction clock stopped at
+        // Versions of recent deletes, so that an older write arriving after
+        // the delete does not bring the key back. Pruned after TOMBSTONE_MS.
+        std::unordered_map<std::string, uint64_t> tombstones;
+        size_t tombstone_writes;
+        TimerWheel wheel; // deadlines of the entries that expire
+        mutable RWLock lock;
+
+        Shard();
+        ~Shard();
+
+        Record* create(const std::string& key, const Hash160& id, const std::vector<uint8_t>& value,
+                       bool compressed, uint64_t digest, uint64_t version, uint64_t expires);
+        void destroy(Record* record);
+        void erase(RecordMap::iterator it);
+    };
+
+    MerkleTree tree; // before shards, which update it until they are gone
+    HybridClock clock;
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_mask;
+    std::atomic<StorageJournal*> journal;
+    std::atomic<bool> journal_failed;
+    std::atomic<size_t> compression_threshold;
+
+    // Cold tier, if enabled: values beyond hot_limit bytes per shard move
+    // to it, least recently read first
+    std::unique_ptr<ColdTier> cold;
+    size_t hot_limit;
+    std::thread compactor;
+    // Started by the first write that expires
+    std::thread expirer;
+    std::once_flag expirer_started;
+    std::atomic<size_t> expired_total;
+    // Wakes and stops the background threads
+    std::mutex maintenance_mutex;
+    std::condition_variable maintenance_cv;
+    bool maintenance_stop;
+
+    Shard& shard_for(const std::string& key) const;
+    // How put_entry treats the key's current version
+    enum class WriteMode {
+        STAMP,  // a local write: stamp it with the clock
+        NEWER,  // last writer wins
+        FORCE,  // overwrite whatever is there
+        EXPECT  // only if the current version is `expected`
+    };
+    // Returns whether the value was stored. version is the stamp to store
+    // (ignored for STAMP and EXPECT) and comes back as the stamp stored, or
+    // for a rejected write the key's current version (0 if absent). A
+    // lapsed entry counts as absent for EXPECT.
+    bool put_entry(const std::string& key, const Hash160& id, const std::vector<uint8_t>& value,
+                   bool compressed, uint64_t expires, WriteMode mode, uint64_t& version,
+                   uint64_t expected = 0);
+    // Compress a local write's value into packed if compression is on, the
+    // value reaches the threshold and it shrinks
+    bool pack(const std::vector<uint8_t>& value, std::vector<uint8_t>& packed) const;
+    // Wait for ticket to be durable; a failure marks the store not durable
+    void sync_journal(StorageJournal* log, uint64_t ticket);
+    // Under the shard's write lock
+    void add_tombstone(Shard& shard, const std::string& key, uint64_t version);
+    // A record's value bytes, wherever they live; segment keeps a cold
+    // value's mapping alive
+    const uint8_t* value_of(const Record* record, std::shared_ptr<const ColdTier::Segment>& segment) const;
+    // The stored bytes, compressed or not
+    std::vector<uint8_t> copy_value(const Record* record) const;
+    // The original bytes; false if a compressed value fails to decode
+    bool read_value(const Record* record, std::vector<uint8_t>& value) const;
+    // Call visitor(record) for each entry of leaf whose id lies in
+    // (start, end], or anywhere when start == end, one shard at a time
+    // under its read lock
+    void visit_leaf(size_t leaf, const Hash160& start, const Hash160& end,
+                    const std::function<void(const Record*)>& visitor) const;
+    uint64_t range_digest(const Hash160& start, const Hash160& end, int level, size_t index) const;
+    void evict(Shard& shard);
+    bool demote(Shard& shard, RecordIndex::iterator& it);
+    void compaction_loop();
+    void expiry_loop();
 
 public:
-    Storage() = default;
-    ~Storage() = default;
-    
+    // Values shorter than this stay in memory: moving them would save little
+    static constexpr size_t MIN_COLD_VALUE = 64;
+    static constexpr double COMPACTION_LIVE_RATIO = 0.5;
+    static constexpr int COMPACTION_INTERVAL_MS = 1000;
+    // How long a delete's version is remembered (HybridClock time)
+    static constexpr uint64_t TOMBSTONE_MS = 60000;
+    // Granularity of expiry, and how often lapsed entries are removed
+    static constexpr uint64_t EXPIRY_TICK_MS = 100;
+
+    typedef std::vector<std::pair<std::string, std::vector<uint8_t>>> EntryList;
+    // Entry filter for scans, given the key and its cached ring id
+    typedef std::function<bool(const std::string& key, const Hash160& id)> IdPredicate;
+
+    // Resumable position in a whole-store scan: a shard and a bucket of
+    // that shard's hash table. If the shard rehashes between calls the scan
+    // restarts that shard, so entries may be visited twice but are never
+    // skipped.
+    struct ScanCursor {
+        size_t shard;
+        size_t bucket;
+        size_t bucket_count; // of the current shard when it was entered
+
+        ScanCursor() : shard(0), bucket(0), bucket_count(0) {}
+    };
+
+    // Resumable position in a ring-range scan: a shard and the last entry
+    // returned from it. The next chunk continues strictly after that
+    // entry, so writes between chunks never cause surviving entries to be
+    // skipped or returned twice.
+    struct RangeCursor {
+        size_t shard;
+        bool started; // last_id/last_key are set for this shard
+        Hash160 last_id;
+        std::string last_key;
+
+        RangeCursor() : shard(0), started(false), last_id() {}
+    };
+
+    // A place in ring order, the order of (id, key) across all shards:
+    // just after the entry (id, key), or after every entry with id if
+    // past_id. A position not yet started precedes every entry. token()
+    // packs it into bytes, Flags(1) Id(20) Key, for handing to clients;
+    // parse() takes such bytes back, empty ones meaning not started.
+    struct RingPosition {
+        bool started;
+        bool past_id;
+        Hash160 id;
+        std::string key;
+
+        RingPosition() : started(false), past_id(false), id() {}
+        std::vector<uint8_t> token() const;
+        bool parse(const std::vector<uint8_t>& token);
+    };
+
+    // A value read without copying it when it lives in the cold tier: data
+    // then points into the segment mapping that owner keeps alive. Hot
+    // values are copied, since they may be overwritten in place.
+    struct ValueView {
+        const uint8_t* data;
+        size_t size;
+        std::shared_ptr<const void> owner;
+
+        ValueView() : data(nullptr), size(0) {}
+    };
+
+    explicit Storage(size_t num_shards = DEFAULT_NUM_SHARDS);
+    ~Storage();
+
     Storage(const Storage&) = delete;
     Storage& operator=(const Storage&) = delete;
-    
+
+    // Reads return the value as written, decompressing it if need be
     bool get(const std::string& key, std::vector<uint8_t>& value) const;
-    void put(const std::string& key, const std::vector<uint8_t>& value);
+    bool get(const std::string& key, ValueView& view) const;
+    bool get(const std::string& key, std::vector<uint8_t>& value, uint64_t& version) const;
+    // The value as stored, for passing on to clients, replicas and new
+    // owners without decompressing it; expires, if given, receives the
+    // entry's expiry time (0: never)
+    bool get_stored(const std::string& key, std::vector<uint8_t>& value, uint64_t& version,
+                    bool& compressed, uint64_t* expires = nullptr) const;
+    // Local writes; each gets a new stamp from the store's clock, returned
+    uint64_t put(const std::string& key, const std::vector<uint8_t>& value);
+    uint64_t put(const std::string& key, std::vector<uint8_t>&& value);
+    // As put, with the key's SHA-1 already computed by the caller. If
+    // compressed, value is already in Compression form and stored as is.
+    // A non-zero expires is the wall-clock time (HybridClock::wall_ms) at
+    // which the entry lapses; any write without one clears it.
+    uint64_t put(const std::string& key, const Hash160& id, std::vector<uint8_t>&& value,
+                 bool compressed = false, uint64_t expires = 0);
     bool remove(const std::string& key);
     void clear();
+
+    // Versions. Every entry carries the HybridClock stamp of the write that
+    // made it. apply installs a write stamped elsewhere (a replica copy, a
+    // handed-over key) unless the key already holds a newer one, or was
+    // deleted at a newer one within TOMBSTONE_MS: the last writer wins, so
+    // copies of a key converge whatever order its writes arrive in. Equal
+    // stamps are ordered by entry digest, so every copy picks the same
+    // winner. A write stamped 0 predates versions and always applies.
+    // apply_remove deletes the key if its version is not newer than
+    // version and remembers the delete. Both advance the store's clock
+    // past version, so later local writes are stamped after it.
+    // restore stores a write with its stamp unconditionally (recovery).
+    // stamp issues a version for a write the caller applies itself. apply
+    // and restore store the bytes they are given, compressed or not, and
+    // with the expiry time they are given, so every copy of a write is the
+    // same and lapses at the same time.
+    bool apply(const std::string& key, const Hash160& id, std::vector<uint8_t>&& value, uint64_t version,
+               bool compressed = false, uint64_t expires = 0);
+    bool apply_remove(const std::string& key, uint64_t version);
+    void restore(const std::string& key, const Hash160& id, std::vector<uint8_t>&& value, uint64_t version,
+                 bool compressed = false, uint64_t expires = 0);
+    uint64_t stamp() { return clock.now(); }
+    // Version of the key's last delete while it is still remembered
+    // (TOMBSTONE_MS), else 0
+    uint64_t tombstone(const std::string& key) const;
+
+    // Conditional put: store value only if the key's version is expected
+    // (0: the key is absent). On success version is the new stamp;
+    // otherwise it is the key's current version, 0 if absent. Like apply,
+    // it stores the bytes given; the caller compresses them if it wants.
+    bool compare_and_put(const std::string& key, const Hash160& id, const std::vector<uint8_t>& value,
+                         uint64_t expected, uint64_t& version, bool compressed = false);
+
+    // Compress the values of local writes of at least threshold bytes (0,
+    // the default, turns it off) when that makes them smaller. Reads still
+    // return the original bytes. compress applies the same rule to a value
+    // the caller stores itself, in place; it returns whether it did.
+    void set_compression(size_t threshold) { compression_threshold.store(threshold, std::memory_order_relaxed); }
+    size_t compression() const { return compression_threshold.load(std::memory_order_relaxed); }
+    bool compress(std::vector<uint8_t>& value) const;
+
+    // Expiry. Entries whose expiry time has passed are hidden from every
+    // read and scan at once. Each shard keeps their deadlines in a
+    // TimerWheel; expire turns the wheels to now_ms and removes the lapsed
+    // entries, logging each removal and leaving a tombstone at its version
+    // so a late copy of the same write does not bring it back. A
+    // background thread does this every EXPIRY_TICK_MS once any entry has
+    // an expiry. Returns the number of entries removed.
+    size_t expire(uint64_t now_ms);
+    // The key's expiry time; 0 if it never expires or is absent
+    uint64_t expiry(const std::string& key) const;
+
     size_t size() const;
     bool exists(const std::string& key) const;
-    
-    // Methods for data migration and re-replication
+    size_t shard_count() const { return shard_mask + 1; }
+
+    // Memory accounting across all shards. allocated_bytes is what the
+    // store holds from the heap (slabs plus large records); the difference
+    // to key_bytes + value_bytes is per-entry and container overhead.
+    struct MemoryStats {
+        size_t entries;
+        size_t key_bytes;
+        size_t value_bytes;
+        size_t slab_bytes;      // reserved in slabs
+        size_t slab_used_bytes; // of which in use
+        size_t large_bytes;     // records too big for a slab
+        size_t allocated_bytes;
+        size_t cold_value_bytes; // of value_bytes, held in the cold tier
+        size_t cold_file_bytes;  // cold tier segments, including garbage
+        size_t compressed_value_bytes; // of value_bytes, stored compressed
+        size_t expiry_timers;   // pending, including ones for overwritten entries
+        size_t expired_entries; // removed by expiry so far
+    };
+    MemoryStats memory_stats() const;
+
+    // Two-tier mode: keep at most hot_bytes of values in memory and move
+    // the rest, least recently read first, to memory-mapped segments in
+    // directory, compacted in the background. Call before the store is
+    // shared between threads. Throws std::runtime_error if the directory
+    // cannot be created.
+    void enable_cold_tier(const std::string& directory, size_t hot_bytes,
+                          size_t segment_bytes = ColdTier::DEFAULT_SEGMENT_BYTES);
+    // Rewrite the live values of sealed cold segments that are at most
+    // max_live_ratio live and drop those segments. Returns how many were
+    // dropped.
+    size_t compact_cold_tier(double max_live_ratio = COMPACTION_LIVE_RATIO);
+
+    // Send every subsequent change to journal (nullptr to stop). Changes
+    // already in flight may still reach the previous journal.
+    void set_journal(StorageJournal* journal);
+    // False once the journal has failed to make a change durable. Changes
+    // are still applied in memory after that, but callers must not
+    // acknowledge writes as durable.
+    bool durable() const { return !journal_failed.load(std::memory_order_acquire); }
+
+    // Call visitor on every entry of one shard, under its read lock, with
+    // the entry's stored bytes in place. For writing snapshots; the visitor
+    // must not call back into the store.
+    typedef std::function<void(const char* key, size_t key_size, const Hash160& id, uint64_t version,
+                               bool compressed, uint64_t expires, const uint8_t* value,
+                               size_t value_size)> EntryVisitor;
+    void visit_shard(size_t shard, const EntryVisitor& visitor) const;
+
+    // Methods for data migration and re-replication.
+    // These visit the shards one at a time, so the result is a consistent
+    // view of each shard but not an atomic snapshot of the whole store.
     std::vector<std::string> get_all_keys() const;
+    std::vector<std::pair<std::string, Hash160>> get_all_key_ids() const;
     std::unordered_map<std::string, std::vector<uint8_t>> get_all_data() const;
     std::unordered_map<std::string, std::vector<uint8_t>> get_keys_in_range(
         const std::function<bool(const std::string&)>& predicate) const;
+
+    // Streaming alternative to get_keys_in_range: copy matching entries
+    // starting at the cursor into out (replacing its contents) until
+    // max_entries or max_bytes is reached, stopping at a bucket boundary,
+    // and advance the cursor. Returns false once the scan is complete.
+    bool scan(ScanCursor& cursor, const std::function<bool(const std::string&)>& predicate,
+              size_t max_entries, size_t max_bytes, EntryList& out) const;
+    bool scan(ScanCursor& cursor, const IdPredicate& predicate,
+              size_t max_entries, size_t max_bytes, EntryList& out) const;
+
+    // Copy entries whose id lies in the ring range (start, end], or the
+    // whole ring when start == end, into out, walking each shard's id
+    // index from the cursor. Each chunk holds one shard's read lock and
+    // stops at max_entries or max_bytes. Returns false once the range is
+    // exhausted. Values are copied as stored, for handing them over; meta,
+    // if given, receives each entry's version, whether it is compressed and
+    // its expiry time.
+    struct EntryMeta {
+        uint64_t version;
+        bool compressed;
+        uint64_t expires;
+    };
+    bool scan_range(RangeCursor& cursor, const Hash160& start, const Hash160& end,
+                    size_t max_entries, size_t max_bytes, EntryList& out,
+                    std::vector<EntryMeta>* meta = nullptr) const;
+
+    // Copy into out, in ring order, the entries after from with ids up to
+    // last whose keys start with prefix: at most max_entries of them,
+    // stopping after the one that reaches max_bytes; limits of 0 count as
+    // 1, so a chunk always holds an entry if any remain. Values come back
+    // decoded. Each shard's index is walked under its read lock only as
+    // far as it can still contribute to the chunk, keeping the smallest
+    // max_entries positions seen, and the values are then read key by
+    // key, so no lock is held for the whole chunk. Returns true with from
+    // at the last entry returned if more may follow; false, with from
+    // past last, once the range is exhausted.
+    bool scan_ordered(RingPosition& from, const Hash160& last, const std::string& prefix,
+                      size_t max_entries, size_t max_bytes, EntryList& out) const;
+
+    // Anti-entropy (see MerkleTree). range_digests sets digests[i] to the
+    // digest sum of node indices[i] of level, counting only entries whose
+    // id lies in the ring range (start, end], or the whole ring when
+    // start == end. Nodes inside the range come straight from the tree;
+    // only the (at most two) leaves the range boundaries cut are summed
+    // entry by entry. leaf_digests lists the keys in the given leaves
+    // within the range, each with its entry digest.
+    typedef std::vector<std::pair<std::string, uint64_t>> DigestList;
+    void range_digests(const Hash160& start, const Hash160& end, int level,
+                       const std::vector<uint32_t>& indices, std::vector<uint64_t>& digests) const;
+    void leaf_digests(const Hash160& start, const Hash160& end,
+                      const std::vector<uint32_t>& leaves, DigestList& out) const;
+    uint64_t merkle_root() const { return tree.root(); }
+
+    // Remove each entry whose stored bytes still equal the given ones, so
+    // keys overwritten since they were read survive. Takes each shard's
+    // lock once. Returns the number of entries removed.
+    size_t remove_if_unchanged(const EntryList& entries);
 };
 
 } // namespace funnelkvs
 
-#endif // FUNNELKVS_STORAGE_H
\ No newline at end of file
+#endif // FUNNELKVS_STORAGE_H
@@ -0,0 +1,224 @@
+#ifndef FUNNELKVS_THREAD_POOL_H
+#define FUNNELKVS_THREAD_POOL_H
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <chrono>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace funnelkvs {
+
+// Move-only void() callable. Callables up to INLINE_BYTES (a lambda with a
+// few captures, a packaged_task) are stored in place, so queuing one does
+// not allocate; larger ones go to the heap.
+class Task {
+public:
+    static constexpr size_t INLINE_BYTES = 48;
+
+    Task() : ops(nullptr) {}
+
+    template<typename F, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& f) : ops(nullptr) {
+        typedef typename std::decay<F>::type Callable;
+        emplace<Callable>(std::forward<F>(f),
+                          std::integral_constant<bool, fits_inline<Callable>()>());
+    }
+
+    Task(Task&& other) : ops(nullptr) { take(other); }
+    Task& operator=(Task&& other) {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+    ~Task() { reset(); }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    explicit operator bool() const { return ops != nullptr; }
+    void operator()() { ops->call(&storage); }
+
+    void reset() {
+        if (ops) {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*call)(void* storage);
+        void (*move)(void* to, void* from); // leaves from destroyed
+        void (*destroy)(void* storage);
+    };
+
+    template<typename F>
+    static constexpr bool fits_inline() {
+        return sizeof(F) <= INLINE_BYTES && alignof(F) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<F>::value;
+    }
+
+    template<typename F>
+    struct InlineOps {
+        static void call(void* s) { (*static_cast<F*>(s))(); }
+        static void move(void* to, void* from) {
+            new (to) F(std::move(*static_cast<F*>(from)));
+            static_cast<F*>(from)->~F();
+        }
+        static void destroy(void* s) { static_cast<F*>(s)->~F(); }
+        static const Ops ops;
+    };
+
+    template<typename F>
+    struct HeapOps {
+        static void call(void* s) { (**static_cast<F**>(s))(); }
+        static void move(void* to, void* from) { *static_cast<F**>(to) = *static_cast<F**>(from); }
+        static void destroy(void* s) { delete *static_cast<F**>(s); }
+        static const Ops ops;
+    };
+
+    template<typename F, typename G>
+    void emplace(G&& f, std::true_type) {
+        new (&storage) F(std::forward<G>(f));
+        ops = &InlineOps<F>::ops;
+    }
+    template<typename F, typename G>
+    void emplace(G&& f, std::false_type) {
+        *reinterpret_cast<F**>(&storage) = new F(std::forward<G>(f));
+        ops = &HeapOps<F>::ops;
+    }
+
+    void take(Task& other) {
+        if (other.ops) {
+            other.ops->move(&storage, &other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+
+    typename std::aligned_storage<INLINE_BYTES, alignof(std::max_align_t)>::type storage;
+    const Ops* ops;
+};
+
+template<typename F>
+const Task::Ops Task::InlineOps<F>::ops = {&InlineOps<F>::call, &InlineOps<F>::move, &InlineOps<F>::destroy};
+template<typename F>
+const Task::Ops Task::HeapOps<F>::ops = {&HeapOps<F>::call, &HeapOps<F>::move, &HeapOps<F>::destroy};
+
+// Fixed-size worker pool with per-worker queues and stealing.
+//
+// Each worker owns a bounded lock-free queue (a Vyukov MPMC ring of Task
+// slots). Tasks submitted from one of the pool's own workers land on that
+// worker's queue; tasks from other threads (event loops, callers) are
+// spread round-robin. A worker serves its own queue first and, when it is
+// empty, takes work from the others', so one busy queue cannot leave
+// workers idle. A mutex-guarded overflow list catches submissions while
+// every queue is full. Idle workers sleep on a condition variable that
+// producers only touch when someone is sleeping.
+//
+// The pool can also run periodic jobs (schedule_every), which replaces a
+// dedicated sleeping thread per maintenance loop.
+class ThreadPool {
+public:
+    static constexpr size_t QUEUE_CAPACITY = 1024; // per worker, power of two
+
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+    // Tasks waiting for a worker, and workers running one (for metrics)
+    size_t queue_depth() const;
+    size_t busy_workers() const { return busy.load(std::memory_order_relaxed); }
+    // Tasks a worker took from another worker's queue
+    uint64_t steals() const { return steal_count.load(std::memory_order_relaxed); }
+
+    // Pin worker i to CPU (first_cpu + i) modulo the number of CPUs. False
+    // if the platform refused for any worker.
+    bool pin_workers(size_t first_cpu = 0);
+
+    template<typename F>
+    void enqueue(F&& f) { push(Task(std::forward<F>(f))); }
+
+    // Run f on a worker and return a future for its result. Tasks still
+    // queued when the pool is destroyed are dropped, and their futures
+    // report std::future_errc::broken_promise. Never wait on a future from
+    // inside a task of the same pool: a saturated pool would deadlock.
+    template<typename F>
+    auto submit(F f) -> std::future<decltype(f())>;
+
+    // Run fn on the pool now and then again interval after each run
+    // finishes; runs never overlap. Returns an id for cancel().
+    uint64_t schedule_every(std::chrono::milliseconds interval, std::function<void()> fn);
+    // Stop a periodic job, waiting for a run in progress unless called
+    // from that run
+    void cancel(uint64_t id);
+
+private:
+    class TaskQueue;
+    struct Periodic;
+    class PeriodicRun;
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<TaskQueue>> queues; // queues[i] belongs to workers[i]
+    std::atomic<bool> stop;
+    std::atomic<size_t> busy; // workers running a task
+    std::atomic<size_t> next_queue;
+    std::atomic<uint64_t> steal_count;
+
+    std::mutex overflow_mutex;
+    std::deque<Task> overflow;
+    std::atomic<size_t> overflow_size;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<size_t> sleepers;
+
+    // Periodic jobs: timer_thread (started by the first schedule_every)
+    // queues each job when it is due
+    std::mutex timer_mutex;
+    std::condition_variable timer_cv;    // timer thread: new deadline / stopping
+    std::condition_variable periodic_cv; // cancel: a run finished
+    std::thread timer_thread;
+    std::multimap<std::chrono::steady_clock::time_point, uint64_t> deadlines;
+    std::map<uint64_t, std::shared_ptr<Periodic>> periodic;
+    uint64_t next_periodic_id;
+
+    void push(Task&& task);
+    bool take(size_t self, Task& task);
+    bool has_work() const;
+    void wake_one();
+    void worker_thread(size_t index);
+    void timer_loop();
+    void finish_run(const std::shared_ptr<Periodic>& job);
+};
+
+template<typename F>
+auto ThreadPool::submit(F f) -> std::future<decltype(f())> {
+    typedef decltype(f()) Result;
+    std::packaged_task<Result()> task(std::move(f));
+    std::future<Result> result = task.get_future();
+    push(Task(std::move(task)));
+    return result;
+}
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_THREAD_POOL_H
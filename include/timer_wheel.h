@@ -0,0 +1,56 @@
+#ifndef FUNNELKVS_TIMER_WHEEL_H
+#define FUNNELKVS_TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace funnelkvs {
+
+// Hierarchical timing wheel of key deadlines, in wall-clock milliseconds.
+// Time advances in ticks of tick_ms. Level 0 has one slot per tick for the
+// next SLOTS ticks; each level above has slots SLOTS times as wide. A timer
+// goes into the lowest level whose span reaches its deadline, and when the
+// wheel turns onto a higher-level slot that slot's timers move down a
+// level, so scheduling is O(1) and each timer is touched at most once per
+// level. Timers beyond the top level's span wait in its last slot and are
+// placed again when it comes round.
+//
+// Timers cannot be cancelled: the owner checks a fired key against its
+// current deadline and ignores stale ones. Not thread-safe.
+class TimerWheel {
+public:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr size_t SLOTS = static_cast<size_t>(1) << SLOT_BITS;
+
+    explicit TimerWheel(uint64_t tick_ms);
+
+    // Fire key once deadline_ms has passed. now_ms is the current time, for
+    // a wheel that has not been advanced recently.
+    void schedule(const std::string& key, uint64_t deadline_ms, uint64_t now_ms);
+    // Turn the wheel to now_ms, appending the key of every timer that fired
+    // to due. Timers fire on the first tick at or after their deadline.
+    void advance(uint64_t now_ms, std::vector<std::string>& due);
+
+    size_t size() const { return count; }
+    uint64_t tick_ms() const { return tick_length; }
+
+private:
+    struct Timer {
+        std::string key;
+        uint64_t tick;
+    };
+
+    std::vector<Timer> slots[LEVELS][SLOTS];
+    uint64_t tick_length;
+    uint64_t current; // last tick processed
+    size_t count;
+
+    void place(Timer&& timer);
+};
+
+} // namespace funnelkvs
+
+#endif // FUNNELKVS_TIMER_WHEEL_H
@@ -0,0 +1,560 @@
+#include "async_rpc.h"
+#include "heartbeat.h"
+#include "logger.h"
+#include <deque>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+namespace funnelkvs {
+
+namespace {
+
+// Timeouts are checked at least this often
+const int LOOP_TICK_MS = 20;
+const int MAX_EVENTS = 64;
+const int MAX_IOV = 64;
+const size_t READ_CHUNK = 64 * 1024;
+
+} // namespace
+
+struct AsyncRpc::Call {
+    std::string peer_key;
+    std::string host;
+    uint16_t port;
+    std::vector<uint8_t> frame; // kept until answered, for a retry
+    // Empty once answered; a call that timed out after it was sent stays
+    // queued to take its response
+    Callback done;
+    std::chrono::steady_clock::time_point deadline;
+    bool retried;
+};
+
+struct AsyncRpc::Connection {
+    Peer* peer;
+    int fd;
+    bool connecting;
+    bool want_write; // EPOLLOUT registered
+    std::chrono::steady_clock::time_point connect_deadline;
+    std::chrono::steady_clock::time_point last_used;
+    // Sent and unsent calls in wire order: in_flight[unsent] is the first
+    // not yet fully written, unsent_offset bytes of it are
+    std::deque<std::unique_ptr<Call>> in_flight;
+    size_t unsent;
+    size_t unsent_offset;
+    std::vector<uint8_t> in;
+    uint64_t completed;
+
+    Connection() : peer(nullptr), fd(-1), connecting(false), want_write(false),
+                   unsent(0), unsent_offset(0), completed(0) {}
+};
+
+struct AsyncRpc::Peer {
+    std::string host;
+    uint16_t port;
+    bool valid_address;
+    struct sockaddr_in address;
+    std::vector<std::unique_ptr<Connection>> connections;
+    HeartbeatRegistry::Slot* heartbeat; // stamped on every response
+};
+
+AsyncRpc::AsyncRpc(const Config& cfg)
+    : config(cfg), epoll_fd(-1), wake_fd(-1), stop(false), read_buffer(READ_CHUNK),
+      call_count(0), failure_count(0), timeout_count(0), retry_count(0), connect_count(0),
+      in_flight(0), connection_count(0) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        if (epoll_fd >= 0) close(epoll_fd);
+        if (wake_fd >= 0) close(wake_fd);
+        throw std::runtime_error("Failed to create RPC event loop");
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // wake-up eventfd
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    loop_thread = std::thread(&AsyncRpc::run, this);
+}
+
+AsyncRpc::~AsyncRpc() {
+    stop.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+    loop_thread.join();
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+AsyncRpc& AsyncRpc::instance() {
+    static AsyncRpc rpc;
+    return rpc;
+}
+
+void AsyncRpc::call(const std::string& host, uint16_t port, const Request& request, Callback done,
+                    std::chrono::milliseconds timeout) {
+    std::unique_ptr<Call> call(new Call());
+    call->peer_key = host + ":" + std::to_string(port);
+    call->host = host;
+    call->port = port;
+    Protocol::appendRequest(call->frame, request);
+    call->done = std::move(done);
+    call->deadline = std::chrono::steady_clock::now() +
+        (timeout.count() > 0 ? timeout : config.call_timeout);
+    call->retried = false;
+    call_count++;
+    in_flight++;
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        if (stop.load()) {
+            wake = false;
+        } else {
+            // The loop drains the whole list per wakeup, so only the first
+            // call of a burst has to signal it
+            wake = submitted.empty();
+            submitted.push_back(std::move(call));
+        }
+    }
+    if (call) {
+        fail(std::move(call));
+        return;
+    }
+    if (wake) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+std::future<AsyncRpc::Result> AsyncRpc::submit(const std::string& host, uint16_t port,
+                                               const Request& request,
+                                               std::chrono::milliseconds timeout) {
+    std::shared_ptr<std::promise<Result>> promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+    call(host, port, request, [promise](bool ok, Response& response) {
+        Result result;
+        result.ok = ok;
+        result.response = std::move(response);
+        promise->set_value(std::move(result));
+    }, timeout);
+    return future;
+}
+
+AsyncRpc::Stats AsyncRpc::get_stats() const {
+    Stats stats;
+    stats.calls = call_count.load();
+    stats.failures = failure_count.load();
+    stats.timeouts = timeout_count.load();
+    stats.retries = retry_count.load();
+    stats.connects = connect_count.load();
+    stats.in_flight = in_flight.load();
+    stats.connections = connection_count.load();
+    return stats;
+}
+
+void AsyncRpc::run() {
+    struct epoll_event events[MAX_EVENTS];
+    std::vector<std::unique_ptr<Call>> batch;
+    while (!stop.load()) {
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, LOOP_TICK_MS);
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == nullptr) {
+                uint64_t count;
+                ssize_t ignored = read(wake_fd, &count, sizeof(count));
+                (void)ignored;
+                continue;
+            }
+            handle_events(static_cast<Connection*>(events[i].data.ptr), events[i].events);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex);
+            batch.swap(submitted);
+        }
+        for (auto& call : batch) {
+            dispatch(std::move(call));
+        }
+        batch.clear();
+
+        expire(std::chrono::steady_clock::now());
+        // Connections closed during this batch may still have had events
+        // queued behind the one that closed them
+        closed.clear();
+    }
+
+    // Shutting down: everything still outstanding fails
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        batch.swap(submitted);
+    }
+    for (auto& call : batch) {
+        fail(std::move(call));
+    }
+    for (auto& entry : peers) {
+        Peer& peer = *entry.second;
+        while (!peer.connections.empty()) {
+            Connection* conn = peer.connections.back().get();
+            std::deque<std::unique_ptr<Call>> calls;
+            calls.swap(conn->in_flight);
+            close(conn->fd);
+            peer.connections.pop_back();
+            connection_count--;
+            for (auto& call : calls) {
+                fail(std::move(call));
+            }
+        }
+    }
+    peers.clear();
+}
+
+void AsyncRpc::dispatch(std::unique_ptr<Call> call) {
+    auto found = peers.find(call->peer_key);
+    if (found == peers.end()) {
+        std::unique_ptr<Peer> created(new Peer());
+        created->host = call->host;
+        created->port = call->port;
+        std::memset(&created->address, 0, sizeof(created->address));
+        created->address.sin_family = AF_INET;
+        created->address.sin_port = htons(call->port);
+        created->valid_address = inet_pton(AF_INET, call->host.c_str(), &created->address.sin_addr) > 0;
+        created->heartbeat = HeartbeatRegistry::instance().slot(call->peer_key);
+        found = peers.emplace(call->peer_key, std::move(created)).first;
+    }
+    Peer& peer = *found->second;
+
+    // Least loaded connection, or a new one once they are all pipelining
+    // pipeline_depth calls
+    Connection* target = nullptr;
+    for (auto& conn : peer.connections) {
+        if (!target || conn->in_flight.size() < target->in_flight.size()) {
+            target = conn.get();
+        }
+    }
+    if (!target || (target->in_flight.size() >= config.pipeline_depth &&
+                    peer.connections.size() < config.max_connections_per_peer)) {
+        Connection* opened = open_connection(peer);
+        if (opened) {
+            target = opened;
+        } else if (!target) {
+            fail(std::move(call));
+            return;
+        }
+    }
+
+    target->in_flight.push_back(std::move(call));
+    target->last_used = std::chrono::steady_clock::now();
+    if (!target->connecting) {
+        flush(target);
+    }
+}
+
+AsyncRpc::Connection* AsyncRpc::open_connection(Peer& peer) {
+    if (!peer.valid_address) {
+        return nullptr;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    std::unique_ptr<Connection> conn(new Connection());
+    conn->peer = &peer;
+    conn->fd = fd;
+    auto now = std::chrono::steady_clock::now();
+    conn->last_used = now;
+    int result = ::connect(fd, reinterpret_cast<struct sockaddr*>(&peer.address), sizeof(peer.address));
+    if (result < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return nullptr;
+    }
+    conn->connecting = result < 0;
+    conn->connect_deadline = now + config.connect_timeout;
+    conn->want_write = conn->connecting;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (conn->want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.ptr = conn.get();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    connect_count++;
+    connection_count++;
+    peer.connections.push_back(std::move(conn));
+    return peer.connections.back().get();
+}
+
+void AsyncRpc::handle_events(Connection* conn, uint32_t events) {
+    if (conn->fd < 0) {
+        return; // closed earlier in this batch
+    }
+    if (conn->connecting) {
+        if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            return;
+        }
+        if (!finish_connect(conn)) {
+            return;
+        }
+    }
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        if (!read_responses(conn)) {
+            return;
+        }
+    }
+    if (events & EPOLLOUT) {
+        flush(conn);
+    }
+}
+
+bool AsyncRpc::finish_connect(Connection* conn) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+        close_connection(conn);
+        return false;
+    }
+    conn->connecting = false;
+    return flush(conn);
+}
+
+bool AsyncRpc::flush(Connection* conn) {
+    while (conn->unsent < conn->in_flight.size()) {
+        struct iovec iov[MAX_IOV];
+        int iovcnt = 0;
+        for (size_t i = conn->unsent; i < conn->in_flight.size() && iovcnt < MAX_IOV; ++i) {
+            std::vector<uint8_t>& frame = conn->in_flight[i]->frame;
+            size_t offset = i == conn->unsent ? conn->unsent_offset : 0;
+            iov[iovcnt].iov_base = frame.data() + offset;
+            iov[iovcnt++].iov_len = frame.size() - offset;
+        }
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (sent <= 0) {
+            close_connection(conn);
+            return false;
+        }
+        size_t remaining = static_cast<size_t>(sent);
+        while (remaining > 0) {
+            size_t left = conn->in_flight[conn->unsent]->frame.size() - conn->unsent_offset;
+            if (remaining < left) {
+                conn->unsent_offset += remaining;
+                break;
+            }
+            remaining -= left;
+            conn->unsent++;
+            conn->unsent_offset = 0;
+        }
+    }
+    update_interest(conn);
+    return true;
+}
+
+bool AsyncRpc::read_responses(Connection* conn) {
+    bool open = true;
+    while (true) {
+        ssize_t received = recv(conn->fd, read_buffer.data(), read_buffer.size(), 0);
+        if (received > 0) {
+            conn->in.insert(conn->in.end(), read_buffer.begin(), read_buffer.begin() + received);
+            if (static_cast<size_t>(received) < read_buffer.size()) {
+                break;
+            }
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        open = false; // EOF or error: answer what arrived, then close
+        break;
+    }
+
+    size_t offset = 0;
+    while (offset < conn->in.size()) {
+        size_t frame_size = 0;
+        FrameStatus status = Protocol::responseFrameSize(conn->in.data() + offset,
+                                                         conn->in.size() - offset, frame_size);
+        if (status == FrameStatus::INCOMPLETE) {
+            break;
+        }
+        Response response;
+        if (status == FrameStatus::INVALID || conn->unsent == 0 ||
+            !Protocol::decodeResponse(conn->in.data() + offset, frame_size, response)) {
+            // Garbage, or an answer to nothing we sent
+            FKVS_WARN("Dropping RPC connection to " << conn->peer->host << ":" << conn->peer->port
+                      << ": malformed response");
+            conn->in.clear();
+            close_connection(conn);
+            return false;
+        }
+        offset += frame_size;
+        std::unique_ptr<Call> call = std::move(conn->in_flight.front());
+        conn->in_flight.pop_front();
+        conn->unsent--;
+        conn->completed++;
+        conn->last_used = std::chrono::steady_clock::now();
+        HeartbeatRegistry::beat(conn->peer->heartbeat);
+        complete(*call, true, response);
+    }
+    conn->in.erase(conn->in.begin(), conn->in.begin() + offset);
+
+    if (!open) {
+        close_connection(conn);
+        return false;
+    }
+    return true;
+}
+
+void AsyncRpc::update_interest(Connection* conn) {
+    bool want_write = conn->connecting || conn->unsent < conn->in_flight.size();
+    if (want_write == conn->want_write) {
+        return;
+    }
+    conn->want_write = want_write;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void AsyncRpc::close_connection(Connection* conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    conn->fd = -1;
+    connection_count--;
+
+    std::deque<std::unique_ptr<Call>> calls;
+    calls.swap(conn->in_flight);
+    bool reused = conn->completed > 0;
+    Peer& peer = *conn->peer;
+    for (auto it = peer.connections.begin(); it != peer.connections.end(); ++it) {
+        if (it->get() == conn) {
+            closed.push_back(std::move(*it));
+            peer.connections.erase(it);
+            break;
+        }
+    }
+
+    // A reused connection may simply have gone stale; give each of its
+    // calls one more try on a fresh connection
+    for (auto& call : calls) {
+        if (!call->done) {
+            continue; // timed out already
+        }
+        if (reused && !call->retried) {
+            call->retried = true;
+            retry_count++;
+            dispatch(std::move(call));
+        } else {
+            fail(std::move(call));
+        }
+    }
+}
+
+void AsyncRpc::expire(std::chrono::steady_clock::time_point now) {
+    std::vector<Connection*> expired;
+    for (auto& entry : peers) {
+        for (auto& conn : entry.second->connections) {
+            if (conn->connecting && now >= conn->connect_deadline) {
+                expired.push_back(conn.get());
+            } else if (!conn->in_flight.empty() && now >= conn->in_flight.front()->deadline) {
+                // The oldest call is still unanswered: the peer is stuck
+                if (conn->in_flight.front()->done) {
+                    timeout_count++;
+                }
+                fail(std::move(conn->in_flight.front()));
+                conn->in_flight.pop_front();
+                if (conn->unsent > 0) {
+                    conn->unsent--;
+                } else {
+                    conn->unsent_offset = 0; // half-written frame: the stream is unusable anyway
+                }
+                expired.push_back(conn.get());
+            } else if (conn->in_flight.empty() && now - conn->last_used >= config.idle_timeout) {
+                expired.push_back(conn.get());
+            } else {
+                expire_queued(conn.get(), now);
+            }
+        }
+    }
+    for (Connection* conn : expired) {
+        // Stale calls behind a timed-out one must not be retried past
+        // their own deadline
+        for (auto& call : conn->in_flight) {
+            if (now >= call->deadline) {
+                call->retried = true;
+            }
+        }
+        close_connection(conn);
+    }
+}
+
+void AsyncRpc::expire_queued(Connection* conn, std::chrono::steady_clock::time_point now) {
+    // Timeouts are per call, so one behind the oldest can lapse first. Not
+    // yet written, it just leaves the queue; sent, it fails now and its
+    // place stays to take the response when that arrives.
+    for (size_t i = 1; i < conn->in_flight.size();) {
+        Call& call = *conn->in_flight[i];
+        if (!call.done || now < call.deadline) {
+            ++i;
+            continue;
+        }
+        timeout_count++;
+        if (i > conn->unsent || (i == conn->unsent && conn->unsent_offset == 0)) {
+            std::unique_ptr<Call> unsent = std::move(conn->in_flight[i]);
+            conn->in_flight.erase(conn->in_flight.begin() + static_cast<std::ptrdiff_t>(i));
+            fail(std::move(unsent));
+            continue;
+        }
+        Response response;
+        complete(call, false, response);
+        ++i;
+    }
+    update_interest(conn);
+}
+
+void AsyncRpc::complete(Call& call, bool ok, Response& response) {
+    if (!call.done) {
+        return; // answered when it timed out
+    }
+    in_flight--;
+    if (!ok) {
+        failure_count++;
+    }
+    Callback done = std::move(call.done);
+    call.done = nullptr;
+    try {
+        done(ok, response);
+    } catch (const std::exception& e) {
+        FKVS_ERROR("RPC callback for " << call.peer_key << " threw: " << e.what());
+    }
+}
+
+void AsyncRpc::fail(std::unique_ptr<Call> call) {
+    Response response;
+    complete(*call, false, response);
+}
+
+} // namespace funnelkvs
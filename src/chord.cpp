@@ -1,61 +1,393 @@
 #include "chord.h"
 #include "client.h"
+#include "connection_pool.h"
+#include "async_rpc.h"
+#include "logger.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
+#include <functional>
+#include <iterator>
 
 namespace funnelkvs {
 
+constexpr uint32_t ChordNode::READ_LEASE_MS;
+
 std::string NodeInfo::to_string() const {
     std::stringstream ss;
-    ss << address << ":" << port << " [" << SHA1::to_string(id).substr(0, 8) << "...]";
+    ss << endpoint() << " [" << SHA1::to_string(id).substr(0, 8) << "...]";
     return ss.str();
 }
 
-NodeInfo NodeInfo::from_address(const std::string& addr, uint16_t p) {
-    std::string node_key = addr + ":" + std::to_string(p);
-    Hash160 node_id = SHA1::hash(node_key);
-    return NodeInfo(node_id, addr, p);
+std::string NodeInfo::endpoint() const {
+    std::string host = host_endpoint();
+    return token ? host + "#" + std::to_string(token) : host;
+}
+
+NodeInfo NodeInfo::from_address(const std::string& addr, uint16_t p, uint16_t t) {
+    NodeInfo node(Hash160{}, addr, p, t);
+    node.id = SHA1::hash(node.endpoint());
+    return node;
+}
+
+bool NodeInfo::parse(const std::string& endpoint, NodeInfo& node) {
+    std::string host;
+    uint16_t node_port = 0;
+    uint16_t node_token = 0;
+    if (!RingCache::split_endpoint(endpoint, host, node_port, &node_token)) {
+        return false;
+    }
+    node = from_address(host, node_port, node_token);
+    return true;
+}
+
+FingerTable::FingerTable(std::shared_ptr<NodeInfo> owner_node)
+    : owner(std::move(owner_node)) {
+    std::fill(entries, entries + SIZE, OWNER);
+}
+
+std::shared_ptr<NodeInfo> FingerTable::get(int index) const {
+    if (index < 0 || index >= SIZE || entries[index] == OWNER) {
+        return owner;
+    }
+    return nodes[entries[index]];
+}
+
+bool FingerTable::ring_before(const Hash160& a, const Hash160& b) const {
+    // Clockwise from just after the owner: ids above the owner come first,
+    // then those that wrapped past zero
+    bool a_wrapped = a <= owner->id;
+    bool b_wrapped = b <= owner->id;
+    if (a_wrapped != b_wrapped) {
+        return b_wrapped;
+    }
+    return a < b;
+}
+
+size_t FingerTable::lower_bound(const Hash160& id) const {
+    auto it = std::lower_bound(ids.begin(), ids.end(), id,
+        [this](const Hash160& a, const Hash160& b) { return ring_before(a, b); });
+    return static_cast<size_t>(it - ids.begin());
+}
+
+uint8_t FingerTable::slot_for(const std::shared_ptr<NodeInfo>& node) {
+    if (!node || node->id == owner->id) {
+        return OWNER;
+    }
+    size_t pos = lower_bound(node->id);
+    if (pos < ids.size() && ids[pos] == node->id) {
+        return static_cast<uint8_t>(pos);
+    }
+    ids.insert(ids.begin() + pos, node->id);
+    nodes.insert(nodes.begin() + pos, node);
+    for (uint8_t& entry : entries) {
+        if (entry != OWNER && entry >= pos) {
+            entry++;
+        }
+    }
+    return static_cast<uint8_t>(pos);
+}
+
+void FingerTable::compact() {
+    // Drop nodes no finger points at any more, keeping ring order
+    uint8_t remap[SIZE];
+    std::fill(remap, remap + ids.size(), OWNER);
+    for (uint8_t entry : entries) {
+        if (entry != OWNER) {
+            remap[entry] = 0;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (remap[i] == OWNER) {
+            continue;
+        }
+        remap[i] = static_cast<uint8_t>(kept);
+        if (kept != i) {
+            ids[kept] = ids[i];
+            nodes[kept] = std::move(nodes[i]);
+        }
+        kept++;
+    }
+    if (kept == ids.size()) {
+        return;
+    }
+    ids.resize(kept);
+    nodes.resize(kept);
+    for (uint8_t& entry : entries) {
+        if (entry != OWNER) {
+            entry = remap[entry];
+        }
+    }
+}
+
+bool FingerTable::set(int first, int last, std::shared_ptr<NodeInfo> node) {
+    first = std::max(first, 0);
+    last = std::min(last, SIZE - 1);
+    uint8_t slot = slot_for(node);
+    bool changed = false;
+    for (int i = first; i <= last; ++i) {
+        if (entries[i] != slot) {
+            entries[i] = slot;
+            changed = true;
+        }
+    }
+    compact();
+    return changed;
+}
+
+bool FingerTable::replace(const NodeInfo& failed, std::shared_ptr<NodeInfo> replacement) {
+    size_t pos = lower_bound(failed.id);
+    if (pos >= ids.size() || ids[pos] != failed.id) {
+        return false;
+    }
+    uint8_t to = slot_for(replacement);
+    // Inserting the replacement may have shifted the failed node's slot
+    uint8_t from = static_cast<uint8_t>(lower_bound(failed.id));
+    for (uint8_t& entry : entries) {
+        if (entry == from) {
+            entry = to;
+        }
+    }
+    compact();
+    return true;
+}
+
+void FingerTable::preceding(const Hash160& id, size_t max,
+                            std::vector<std::shared_ptr<NodeInfo>>& out) const {
+    if (id == owner->id) {
+        return; // (owner, owner) is empty
+    }
+    for (size_t pos = lower_bound(id); pos > 0 && max > 0; --pos, --max) {
+        out.push_back(nodes[pos - 1]);
+    }
+}
+
+std::shared_ptr<NodeInfo> FingerTable::closest_preceding(const Hash160& id) const {
+    if (id == owner->id || ids.empty()) {
+        return nullptr;
+    }
+    size_t pos = lower_bound(id);
+    return pos > 0 ? nodes[pos - 1] : nullptr;
+}
+
+namespace {
+
+std::atomic<uint64_t> next_routing_version(1);
+
+std::shared_ptr<NodeInfo> parse_node(const std::string& endpoint) {
+    NodeInfo node;
+    if (!NodeInfo::parse(endpoint, node)) {
+        return nullptr;
+    }
+    return std::make_shared<NodeInfo>(node);
+}
+
+} // namespace
+
+ChordNode::RoutingSnapshot ChordNode::routing_snapshot() const {
+    // Versions are unique across all nodes in the process, so a cached
+    // snapshot can never be mistaken for a current one of another node.
+    // A few slots keep the positions of a multi-token server from evicting
+    // each other when one thread serves them in turn.
+    struct CachedSnapshot {
+        const ChordNode* node;
+        uint64_t version;
+        RoutingSnapshot table;
+    };
+    static const size_t SLOTS = 8;
+    static thread_local CachedSnapshot slots[SLOTS] = {};
+    CachedSnapshot& cached = slots[(reinterpret_cast<uintptr_t>(this) >> 6) % SLOTS];
+    
+    uint64_t current = routing_version.load(std::memory_order_acquire);
+    if (cached.node != this || cached.version != current) {
+        std::lock_guard<std::mutex> lock(routing_mutex);
+        cached.node = this;
+        cached.table = routing;
+        cached.version = routing_version.load(std::memory_order_relaxed);
+    }
+    return cached.table;
+}
+
+template<typename F>
+bool ChordNode::update_routing(F mutate) {
+    std::lock_guard<std::mutex> lock(routing_mutex);
+    std::shared_ptr<RoutingTable> next = routing ? std::make_shared<RoutingTable>(*routing)
+                                                 : std::make_shared<RoutingTable>(self_ptr);
+    if (!mutate(*next)) {
+        return false;
+    }
+    routing = next;
+    routing_version.store(next_routing_version++, std::memory_order_release);
+    return true;
 }
 
 ChordNode::ChordNode(const std::string& address, uint16_t port)
-    : self_info(NodeInfo::from_address(address, port))
-    , predecessor(nullptr)
-    , successor_list(SUCCESSOR_LIST_SIZE)
-    , finger_table(FINGER_TABLE_SIZE)
-    , local_storage(std::unique_ptr<Storage>(new Storage()))
+    : ChordNode(address, port, 0, std::make_shared<Storage>()) {
+}
+
+ChordNode::ChordNode(const std::string& address, uint16_t port, uint16_t token,
+                     std::shared_ptr<Storage> storage)
+    : self_info(NodeInfo::from_address(address, port, token))
+    , self_ptr(std::make_shared<NodeInfo>(self_info))
+    , routing_version(0)
+    , local_storage(std::move(storage))
     , replication_manager(std::unique_ptr<ReplicationManager>(new ReplicationManager()))
     , failure_detector(std::unique_ptr<FailureDetector>(new FailureDetector()))
+    , lookup_failures(0)
+    , forwarded_requests(0)
+    , transfer_batch_keys(TRANSFER_BATCH_MAX_KEYS)
+    , transfer_batch_bytes(TRANSFER_BATCH_MAX_BYTES)
+    , transfer_keys_sent(0)
+    , transfer_batches_sent(0)
+    , transfer_failed_batches(0)
+    , transfer_keys_received(0)
+    , repair_rounds(0)
+    , repair_leaves(0)
+    , repair_keys_pushed(0)
+    , repair_keys_deleted(0)
+    , repair_keys_applied(0)
+    , replica_reads(0)
+    , quorum_reads(0)
+    , stale_replicas(0)
+    , quorum_failures(0)
+    , read_cache(std::unique_ptr<ReadCache>(new ReadCache()))
     , running(false)
+    , maintenance_pool(std::unique_ptr<ThreadPool>(new ThreadPool(MAINTENANCE_THREADS)))
     , next_finger_to_fix(0)
     , stabilize_interval(1000) // 1 second
+    , stabilize_min_interval(100) // 0.1 seconds
+    , stabilize_backoff_ms(100)
+    , stabilized_version(0)
+    , fingers_version(0)
     , fix_fingers_interval(500) // 0.5 seconds
-    , failure_check_interval(2000) // 2 seconds
+    , failure_check_interval(FailureDetector::FailureConfig().ping_interval_ms)
+    , anti_entropy_interval(30000) // 30 seconds
+    , host_tokens(1, this)
 {
+    for (int i = 0; i < FINGER_TABLE_SIZE; ++i) {
+        finger_starts[i] = add_power_of_two(self_info.id, i);
+    }
+    
     // Initialize successor list and finger table to point to self (single node ring)
-    auto self_ptr = std::make_shared<NodeInfo>(self_info);
-    std::fill(successor_list.begin(), successor_list.end(), self_ptr);
-    std::fill(finger_table.begin(), finger_table.end(), self_ptr);
+    update_routing([this](RoutingTable& table) {
+        table.successor_list.assign(SUCCESSOR_LIST_SIZE, self_ptr);
+        return true;
+    });
+    for (int i = 0; i <= MAX_LOOKUP_HOPS; ++i) {
+        lookup_hops[i].store(0);
+    }
 }
 
 ChordNode::~ChordNode() {
     stop_maintenance();
 }
 
+void ChordNode::enable_cold_tier(const std::string& directory, size_t hot_bytes) {
+    local_storage->enable_cold_tier(directory, hot_bytes);
+    FKVS_INFO("Node " << self_info.to_string() << " keeps up to " << hot_bytes / (1024 * 1024)
+              << " MB of values in memory, the rest in " << directory);
+}
+
+void ChordNode::set_read_cache_capacity(size_t bytes) {
+    read_cache.reset(bytes ? new ReadCache(bytes) : nullptr);
+}
+
+ReadCache::Stats ChordNode::get_read_cache_stats() const {
+    return read_cache ? read_cache->stats() : ReadCache::Stats();
+}
+
+Persistence::RecoveryStats ChordNode::enable_persistence(const std::string& directory) {
+    std::unique_ptr<Persistence> next(new Persistence(directory));
+    Persistence::RecoveryStats stats = next->recover(*local_storage);
+    next->start(*local_storage);
+    persistence = std::move(next);
+    
+    FKVS_INFO("Node " << self_info.to_string() << " recovered " << local_storage->size()
+              << " keys from " << directory << " in " << stats.elapsed_ms << " ms ("
+              << stats.snapshot_entries << " from snapshot, " << stats.log_records
+              << " log records)");
+    return stats;
+}
+
+std::unique_ptr<ChordNode> ChordNode::make_token(uint16_t token) const {
+    return std::unique_ptr<ChordNode>(new ChordNode(self_info.address, self_info.port, token, local_storage));
+}
+
+void ChordNode::set_host_tokens(const std::vector<ChordNode*>& tokens) {
+    host_tokens = tokens;
+    if (std::find(host_tokens.begin(), host_tokens.end(), this) == host_tokens.end()) {
+        host_tokens.push_back(this);
+    }
+    std::sort(host_tokens.begin(), host_tokens.end(), [](const ChordNode* a, const ChordNode* b) {
+        return a->self_info.id < b->self_info.id;
+    });
+}
+
+ChordNode* ChordNode::host_owner(const Hash160& key_id) const {
+    // Ranges end at their node, so only the first of our positions at or
+    // after key_id (wrapping around) can own it
+    auto it = std::lower_bound(host_tokens.begin(), host_tokens.end(), key_id,
+        [](const ChordNode* token, const Hash160& id) { return token->self_info.id < id; });
+    ChordNode* candidate = it == host_tokens.end() ? host_tokens.front() : *it;
+    return candidate->owns(*candidate->routing_snapshot(), key_id) ? candidate : nullptr;
+}
+
+const Hash160& ChordNode::host_range_start(const Hash160& id) const {
+    auto it = std::lower_bound(host_tokens.begin(), host_tokens.end(), id,
+        [](const ChordNode* token, const Hash160& value) { return token->self_info.id < value; });
+    return (it == host_tokens.begin() ? host_tokens.back() : *std::prev(it))->self_info.id;
+}
+
 void ChordNode::create() {
-    std::lock_guard<std::mutex> lock(routing_mutex);
-    
     // In a single-node ring, predecessor is null and successor is self
-    predecessor = nullptr;
-    auto self_ptr = std::make_shared<NodeInfo>(self_info);
-    std::fill(successor_list.begin(), successor_list.end(), self_ptr);
-    std::fill(finger_table.begin(), finger_table.end(), self_ptr);
+    update_routing([this](RoutingTable& table) {
+        table.predecessor = nullptr;
+        std::fill(table.successor_list.begin(), table.successor_list.end(), self_ptr);
+        table.fingers.fill(self_ptr);
+        return true;
+    });
     
-    std::cout << "Created new Chord ring with node " << self_info.to_string() << std::endl;
+    FKVS_INFO("Created new Chord ring with node " << self_info.to_string());
+}
+
+void ChordNode::create_among(const std::vector<NodeInfo>& positions) {
+    std::vector<std::shared_ptr<NodeInfo>> ring;
+    for (const auto& position : positions) {
+        ring.push_back(position == self_info ? self_ptr : std::make_shared<NodeInfo>(position));
+    }
+    if (std::find(ring.begin(), ring.end(), self_ptr) == ring.end()) {
+        ring.push_back(self_ptr);
+    }
+    std::sort(ring.begin(), ring.end(),
+        [](const std::shared_ptr<NodeInfo>& a, const std::shared_ptr<NodeInfo>& b) { return a->id < b->id; });
+    if (ring.size() == 1) {
+        create();
+        return;
+    }
+    
+    size_t self_index = std::find(ring.begin(), ring.end(), self_ptr) - ring.begin();
+    // Successor of an id among the positions: the first at or after it
+    auto successor_of = [&ring](const Hash160& id) {
+        auto it = std::lower_bound(ring.begin(), ring.end(), id,
+            [](const std::shared_ptr<NodeInfo>& node, const Hash160& value) { return node->id < value; });
+        return it == ring.end() ? ring.front() : *it;
+    };
+    update_routing([this, &ring, self_index, &successor_of](RoutingTable& table) {
+        table.predecessor = ring[(self_index + ring.size() - 1) % ring.size()];
+        table.predecessor_since = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < table.successor_list.size(); ++i) {
+            table.successor_list[i] = i + 1 < ring.size() ? ring[(self_index + 1 + i) % ring.size()]
+                                                          : self_ptr;
+        }
+        for (int i = 0; i < FINGER_TABLE_SIZE; ++i) {
+            table.fingers.set(i, i, successor_of(finger_starts[i]));
+        }
+        return true;
+    });
+    
+    FKVS_INFO("Created new Chord ring with node " << self_info.to_string() << " and "
+              << ring.size() - 1 << " other positions");
 }
 
 void ChordNode::join(std::shared_ptr<NodeInfo> existing_node) {
@@ -64,21 +396,53 @@ void ChordNode::join(std::shared_ptr<NodeInfo> existing_node) {
         return;
     }
     
-    std::lock_guard<std::mutex> lock(routing_mutex);
-    
-    // Initialize predecessor to null
-    predecessor = nullptr;
+    // Ask the existing node to look up our successor (without holding the
+    // routing lock). If it cannot be reached, start from the existing node
+    // itself and let stabilization correct it.
+    auto successor = contact_node(existing_node, "find_successor", self_info.id);
+    if (!successor) {
+        successor = existing_node;
+    }
     
-    // Find successor using existing node
-    // For now, we'll implement a simple version that sets successor to existing_node
-    // In full implementation, this would contact the existing node
-    successor_list[0] = existing_node;
+    update_routing([&successor](RoutingTable& table) {
+        table.predecessor = nullptr;
+        table.successor_list[0] = successor;
+        table.fingers.fill(successor);
+        return true;
+    });
     
-    // Initialize finger table
-    initialize_finger_table();
+    // The successor sits right after us, so its successor list and fingers
+    // are nearly ours: one round trip gives a routing table to start from,
+    // and a parallel refresh corrects it, instead of fix_fingers finding
+    // each finger in turn
+    std::vector<std::string> successors;
+    std::vector<std::string> fingers;
+    bool fetched = false;
+    try {
+        fetched = ConnectionPool::instance().call(successor->address, successor->port,
+            [&successors, &fingers, &successor](Client& client) {
+                return client.get_routing(successors, fingers, &successor->id);
+            });
+    } catch (const std::exception&) {
+        fetched = false;
+    }
+    if (fetched) {
+        adopt_successor_list(successor, successors);
+        std::vector<std::shared_ptr<NodeInfo>> known = get_successor_list();
+        for (const auto& endpoint : fingers) {
+            auto node = parse_node(endpoint);
+            if (node) {
+                known.push_back(node);
+            }
+        }
+        seed_fingers(known);
+    }
+    refresh_fingers();
     
-    std::cout << "Node " << self_info.to_string() 
-              << " joined ring via " << existing_node->to_string() << std::endl;
+    FKVS_INFO("Node " << self_info.to_string()
+              << " joined ring via " << existing_node->to_string()
+              << ", successor " << successor->to_string()
+              << ", " << routing_snapshot()->fingers.distinct_nodes() << " distinct fingers");
     
     // Keys will be transferred automatically when this node becomes 
     // the predecessor of existing nodes during stabilization process
@@ -87,29 +451,30 @@ void ChordNode::join(std::shared_ptr<NodeInfo> existing_node) {
 void ChordNode::leave() {
     stop_maintenance();
     
-    // Get successor to transfer keys to (while holding lock briefly)
+    // Our keys go to the first successor on another server; the server's
+    // other positions share our storage and keep theirs
     std::shared_ptr<NodeInfo> successor_to_transfer;
-    {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        if (successor_list[0] && *successor_list[0] != self_info) {
-            successor_to_transfer = successor_list[0];
+    for (const auto& successor : get_successor_list()) {
+        if (successor && !is_local(*successor)) {
+            successor_to_transfer = successor;
+            break;
         }
     }
     
     // Transfer keys without holding lock (prevents deadlock)
     if (successor_to_transfer) {
-        std::cout << "Node " << self_info.to_string() << " leaving ring, transferring keys to successor" << std::endl;
-        transfer_keys_to_node(successor_to_transfer);
+        FKVS_INFO("Node " << self_info.to_string() << " leaving ring, transferring keys to "
+                  << successor_to_transfer->to_string());
+        transfer_keys_to_node(successor_to_transfer, true);
     }
     
     // Now reset to single-node state
-    {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        predecessor = nullptr;
-        auto self_ptr = std::make_shared<NodeInfo>(self_info);
-        std::fill(successor_list.begin(), successor_list.end(), self_ptr);
-        std::fill(finger_table.begin(), finger_table.end(), self_ptr);
-    }
+    update_routing([this](RoutingTable& table) {
+        table.predecessor = nullptr;
+        std::fill(table.successor_list.begin(), table.successor_list.end(), self_ptr);
+        table.fingers.fill(self_ptr);
+        return true;
+    });
 }
 
 void ChordNode::start_maintenance() {
@@ -118,11 +483,36 @@ void ChordNode::start_maintenance() {
     }
     
     running.store(true);
-    stabilize_thread = std::thread(&ChordNode::stabilize_loop, this);
-    fix_fingers_thread = std::thread(&ChordNode::fix_fingers_loop, this);
-    failure_detection_thread = std::thread(&ChordNode::failure_detection_loop, this);
+    maintenance_jobs.push_back(maintenance_pool->schedule_every(stabilize_min_interval, [this] {
+        try {
+            stabilize_if_due();
+        } catch (const std::exception& e) {
+            FKVS_ERROR("Error in stabilize: " << e.what());
+        }
+    }));
+    maintenance_jobs.push_back(maintenance_pool->schedule_every(fix_fingers_interval, [this] {
+        try {
+            fix_fingers();
+        } catch (const std::exception& e) {
+            FKVS_ERROR("Error in fix_fingers: " << e.what());
+        }
+    }));
+    maintenance_jobs.push_back(maintenance_pool->schedule_every(failure_check_interval, [this] {
+        try {
+            detect_failures();
+        } catch (const std::exception& e) {
+            FKVS_ERROR("Error in failure_detection: " << e.what());
+        }
+    }));
+    maintenance_jobs.push_back(maintenance_pool->schedule_every(anti_entropy_interval, [this] {
+        try {
+            verify_and_repair_replicas();
+        } catch (const std::exception& e) {
+            FKVS_ERROR("Error in anti-entropy: " << e.what());
+        }
+    }));
     
-    std::cout << "Started maintenance threads for node " << self_info.to_string() << std::endl;
+    FKVS_INFO("Started maintenance for node " << self_info.to_string());
 }
 
 void ChordNode::stop_maintenance() {
@@ -137,116 +527,310 @@ void ChordNode::stop_maintenance() {
         replication_manager->stop_async_processing();
     }
     
-    // Wake up any sleeping threads
+    // Wake anything in interruptible_sleep
     shutdown_cv.notify_all();
     
-    // For graceful shutdown, detach threads instead of joining to avoid blocking
-    // The threads will check running.load() and exit naturally
-    if (stabilize_thread.joinable()) {
-        stabilize_thread.detach();
-    }
-    if (fix_fingers_thread.joinable()) {
-        fix_fingers_thread.detach();
-    }
-    if (failure_detection_thread.joinable()) {
-        failure_detection_thread.detach();
+    // Rounds check running between network calls, so a round in progress
+    // ends soon; cancel waits for it
+    for (uint64_t job : maintenance_jobs) {
+        maintenance_pool->cancel(job);
     }
+    maintenance_jobs.clear();
     
-    // Give threads a moment to see the shutdown signal
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    
-    std::cout << "Stopped maintenance threads for node " << self_info.to_string() << std::endl;
+    FKVS_INFO("Stopped maintenance for node " << self_info.to_string());
 }
 
 std::shared_ptr<NodeInfo> ChordNode::find_successor(const Hash160& id) {
-    if (is_responsible_for_key(id)) {
-        return std::make_shared<NodeInfo>(self_info);
-    }
+    auto started = std::chrono::steady_clock::now();
     
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    bool final = false;
+    std::vector<std::shared_ptr<NodeInfo>> candidates;
+    lookup_step(id, final, candidates);
     
-    // Check if id is between self and immediate successor
-    auto successor = successor_list[0];
-    if (successor && in_range(id, self_info.id, successor->id, true)) {
-        return successor;
+    int hops = 0;
+    while (!final) {
+        if (hops >= MAX_LOOKUP_HOPS) {
+            break;
+        }
+        
+        // Ask the best candidate that answers; a dead hop costs one failed
+        // dial before falling back to the next alternative
+        bool answered = false;
+        bool next_final = false;
+        std::vector<std::shared_ptr<NodeInfo>> next;
+        for (const auto& candidate : candidates) {
+            if (!candidate || *candidate == self_info) {
+                continue;
+            }
+            if (remote_lookup_step(*candidate, id, next_final, next)) {
+                answered = true;
+                break;
+            }
+        }
+        if (!answered) {
+            break;
+        }
+        
+        hops++;
+        final = next_final;
+        candidates.swap(next);
     }
     
-    // Find closest preceding node and continue search
-    auto closest = closest_preceding_node(id);
-    if (closest && *closest != self_info) {
-        // In full implementation, this would be a remote call
-        return contact_node(closest, "find_successor", id);
+    if (final && !candidates.empty()) {
+        record_lookup(hops, started, false);
+        return candidates[0];
     }
     
-    return successor;
+    // Lookup failed: our successor is the best local guess
+    record_lookup(hops, started, true);
+    return get_successor();
 }
 
 std::shared_ptr<NodeInfo> ChordNode::find_predecessor(const Hash160& id) {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    auto successor = find_successor(id);
+    if (!successor || *successor == self_info) {
+        auto pred = get_predecessor();
+        return pred ? pred : self_ptr;
+    }
+    auto pred = contact_node(successor, "get_predecessor");
+    return pred ? pred : successor;
+}
+
+std::shared_ptr<NodeInfo> ChordNode::closest_preceding_node(const Hash160& id) {
+    return closest_preceding(*routing_snapshot(), id);
+}
+
+std::shared_ptr<NodeInfo> ChordNode::closest_preceding(const RoutingTable& table, const Hash160& id) const {
+    auto finger = table.fingers.closest_preceding(id);
     
-    auto current = std::make_shared<NodeInfo>(self_info);
-    auto successor = successor_list[0];
+    // If no finger is in range, return self
+    return finger ? finger : self_ptr;
+}
+
+void ChordNode::lookup_step(const Hash160& id, bool& final,
+                            std::vector<std::shared_ptr<NodeInfo>>& nodes) {
+    nodes.clear();
+    RoutingSnapshot table = routing_snapshot();
+    
+    const auto& successor = table->successor_list[0];
+    if (owns(*table, id)) {
+        final = true;
+        nodes.push_back(self_ptr);
+        return;
+    }
     
-    while (successor && !in_range(id, current->id, successor->id, true)) {
-        if (*current == self_info) {
-            current = closest_preceding_node(id);
-        } else {
-            // In full implementation, this would be a remote call
-            current = contact_node(current, "closest_preceding_node", id);
+    if (!successor || *successor == self_info || in_range(id, self_info.id, successor->id, true)) {
+        final = true;
+        for (const auto& node : table->successor_list) {
+            if (node && *node != self_info) {
+                nodes.push_back(node);
+            }
         }
-        
-        if (!current || *current == self_info) {
-            break;
+        if (nodes.empty()) {
+            nodes.push_back(self_ptr);
         }
-        
-        // Get successor of current node
-        successor = contact_node(current, "get_successor");
+        return;
     }
     
-    return current;
+    // Preceding fingers, closest to id first, without repeats
+    final = false;
+    table->fingers.preceding(id, LOOKUP_ALTERNATIVES, nodes);
+    // The successor precedes id too and is always a valid (slow) next hop
+    if (nodes.empty() || *nodes.back() != *successor) {
+        nodes.push_back(successor);
+    }
 }
 
-std::shared_ptr<NodeInfo> ChordNode::closest_preceding_node(const Hash160& id) {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+bool ChordNode::remote_lookup_step(const NodeInfo& node, const Hash160& id, bool& final,
+                                   std::vector<std::shared_ptr<NodeInfo>>& nodes) {
+    std::vector<std::string> endpoints;
+    bool answered = false;
+    try {
+        answered = ConnectionPool::instance().call(node.address, node.port,
+            [&id, &final, &endpoints](Client& client) { return client.lookup_step(id, final, endpoints); });
+    } catch (const std::exception&) {
+        answered = false;
+    }
+    if (!answered) {
+        return false;
+    }
     
-    // Search finger table from highest to lowest
-    for (int i = FINGER_TABLE_SIZE - 1; i >= 0; i--) {
-        auto finger = finger_table[i];
-        if (finger && *finger != self_info && 
-            in_range(finger->id, self_info.id, id, false)) {
-            return finger;
+    nodes.clear();
+    for (const auto& endpoint : endpoints) {
+        auto parsed = parse_node(endpoint);
+        if (parsed) {
+            nodes.push_back(parsed);
         }
     }
-    
-    // If no finger is in range, return self
-    return std::make_shared<NodeInfo>(self_info);
+    return !nodes.empty();
+}
+
+void ChordNode::record_lookup(int hops, std::chrono::steady_clock::time_point started, bool failed) {
+    lookup_hops[std::min(hops, MAX_LOOKUP_HOPS)]++;
+    if (failed) {
+        lookup_failures++;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started);
+    lookup_latency_us.record(static_cast<uint64_t>(elapsed.count()));
+}
+
+ChordNode::LookupStats ChordNode::get_lookup_stats() const {
+    LookupStats stats;
+    stats.lookups = 0;
+    stats.failures = lookup_failures.load();
+    uint64_t total_hops = 0;
+    stats.hops.resize(MAX_LOOKUP_HOPS + 1);
+    for (int i = 0; i <= MAX_LOOKUP_HOPS; ++i) {
+        stats.hops[i] = lookup_hops[i].load();
+        stats.lookups += stats.hops[i];
+        total_hops += stats.hops[i] * static_cast<uint64_t>(i);
+    }
+    stats.mean_hops = stats.lookups ? static_cast<double>(total_hops) / stats.lookups : 0.0;
+    stats.latency_us = lookup_latency_us.snapshot();
+    return stats;
+}
+
+void ChordNode::collect_stats(StatsReport& report) const {
+    report.add("chord.forwards", forwarded_requests.load());
+    LookupStats lookups = get_lookup_stats();
+    report.add("chord.lookups", lookups.lookups);
+    report.add("chord.lookup_failures", lookups.failures);
+    report.add("chord.lookup_mean_hops", lookups.mean_hops);
+    report.add_latency("chord.lookup", lookups.latency_us);
+    
+    // Process-wide: every node in the process shares the RPC loop
+    AsyncRpc::Stats rpc = AsyncRpc::instance().get_stats();
+    report.add("rpc.calls", rpc.calls);
+    report.add("rpc.failures", rpc.failures);
+    report.add("rpc.timeouts", rpc.timeouts);
+    report.add("rpc.retries", rpc.retries);
+    report.add("rpc.connects", rpc.connects);
+    report.add("rpc.in_flight", static_cast<uint64_t>(rpc.in_flight));
+    report.add("rpc.connections", static_cast<uint64_t>(rpc.connections));
+    
+    ReadCache::Stats cache = get_read_cache_stats();
+    report.add("read_cache.hits", cache.hits);
+    report.add("read_cache.misses", cache.misses);
+    report.add("read_cache.insertions", cache.insertions);
+    report.add("read_cache.rejections", cache.rejections);
+    report.add("read_cache.invalidations", cache.invalidations);
+    report.add("read_cache.evictions", cache.evictions);
+    report.add("read_cache.entries", static_cast<uint64_t>(cache.entries));
+    report.add("read_cache.bytes", static_cast<uint64_t>(cache.bytes));
+    
+    // Moves and repairs are per position; the server reports their sum
+    TransferStats transfer = {};
+    RepairStats repair = {};
+    for (const ChordNode* token : host_tokens) {
+        TransferStats moved = token->get_transfer_stats();
+        transfer.keys_sent += moved.keys_sent;
+        transfer.batches_sent += moved.batches_sent;
+        transfer.failed_batches += moved.failed_batches;
+        transfer.keys_received += moved.keys_received;
+        RepairStats repaired = token->get_repair_stats();
+        repair.rounds += repaired.rounds;
+        repair.leaves += repaired.leaves;
+        repair.keys_pushed += repaired.keys_pushed;
+        repair.keys_deleted += repaired.keys_deleted;
+        repair.keys_applied += repaired.keys_applied;
+    }
+    report.add("chord.tokens", static_cast<uint64_t>(host_tokens.size()));
+    report.add("chord.fingers", static_cast<uint64_t>(routing_snapshot()->fingers.distinct_nodes()));
+    report.add("chord.stabilize_interval_ms", static_cast<uint64_t>(stabilize_backoff_ms.load()));
+    report.add("transfer.keys_sent", transfer.keys_sent);
+    report.add("transfer.batches_sent", transfer.batches_sent);
+    report.add("transfer.failed_batches", transfer.failed_batches);
+    report.add("transfer.keys_received", transfer.keys_received);
+    
+    report.add("anti_entropy.rounds", repair.rounds);
+    report.add("anti_entropy.leaves", repair.leaves);
+    report.add("anti_entropy.keys_pushed", repair.keys_pushed);
+    report.add("anti_entropy.keys_deleted", repair.keys_deleted);
+    report.add("anti_entropy.keys_applied", repair.keys_applied);
+    
+    ReadStats reads = get_read_stats();
+    report.add("read.replica_served", reads.replica_reads);
+    report.add("read.quorum", reads.quorum_reads);
+    report.add("read.stale_replicas", reads.stale_replicas);
+    report.add("read.quorum_failures", reads.quorum_failures);
+    
+    FailureDetector::Stats detector = get_failure_detector_stats();
+    report.add("failure_detector.rounds", detector.rounds);
+    report.add("failure_detector.probes_sent", detector.probes_sent);
+    report.add("failure_detector.probes_skipped", detector.probes_skipped);
+    report.add("failure_detector.probe_failures", detector.probe_failures);
+    report.add("failure_detector.failures_detected", detector.failures_detected);
+    report.add("failure_detector.monitored", static_cast<uint64_t>(detector.monitored));
+    report.add("failure_detector.suspected", static_cast<uint64_t>(detector.suspected));
+    report.add("failure_detector.failed", static_cast<uint64_t>(detector.failed));
+    
+    report.add("replication.factor", static_cast<uint64_t>(replication_manager->get_replication_factor()));
+    report.add("replication.straggler_failures", replication_manager->get_straggler_failures());
+    int64_t lag = replication_manager->get_max_replication_lag_ms();
+    report.add("replication.max_lag_ms", static_cast<uint64_t>(std::max<int64_t>(lag, 0)));
+    for (const auto& stream : replication_manager->get_stream_stats()) {
+        std::string name = "replication.stream." + stream.peer;
+        report.add(name + ".pending_ops", static_cast<uint64_t>(stream.pending_ops));
+        report.add(name + ".pending_bytes", static_cast<uint64_t>(stream.pending_bytes));
+        report.add(name + ".dropped_ops", stream.dropped_ops);
+    }
+    for (const auto& peer : replication_manager->get_ack_latency()) {
+        report.add_latency("replication.ack." + peer.peer, peer.latency_us);
+    }
+}
+
+void ChordNode::stabilize_if_due() {
+    if (std::chrono::steady_clock::now() < next_stabilize) {
+        return;
+    }
+    stabilize();
+    
+    // Any routing change since the last round, from stabilization,
+    // notifies, failures or fingers, means the ring is still settling
+    uint64_t version = routing_version.load(std::memory_order_acquire);
+    std::chrono::milliseconds backoff = version != stabilized_version ? stabilize_min_interval :
+        std::min(std::chrono::milliseconds(stabilize_backoff_ms.load() * 2), stabilize_interval);
+    stabilized_version = version;
+    stabilize_backoff_ms.store(backoff.count());
+    next_stabilize = std::chrono::steady_clock::now() + backoff;
 }
 
 void ChordNode::stabilize() {
     // Check for shutdown before network operations
     if (!running.load()) return;
     
-    std::shared_ptr<NodeInfo> successor;
-    {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        successor = successor_list[0];
-    }
+    RoutingSnapshot table = routing_snapshot();
+    std::shared_ptr<NodeInfo> successor = table->successor_list[0];
+    std::shared_ptr<NodeInfo> local_predecessor = table->predecessor;
     
+    std::shared_ptr<NodeInfo> x;
     if (!successor || *successor == self_info) {
-        return;
+        // Alone in our view of the ring: whoever notified us is our
+        // successor as well as our predecessor
+        if (!local_predecessor) {
+            return;
+        }
+        x = local_predecessor;
+        successor = self_ptr;
+    } else {
+        // Ask successor for its predecessor (without holding mutex)
+        x = contact_node(successor, "get_predecessor");
     }
     
-    // Check for shutdown before network operations
-    if (!running.load()) return;
-    
-    // Ask successor for its predecessor (without holding mutex)
-    auto x = contact_node(successor, "get_predecessor");
-    
-    {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        if (x && *x != self_info && in_range(x->id, self_info.id, successor->id, false)) {
-            // Update successor
-            successor_list[0] = x;
+    if (x && *x != self_info &&
+        (*successor == self_info || in_range(x->id, self_info.id, successor->id, false))) {
+        // Update successor, unless it changed while we were asking
+        std::shared_ptr<NodeInfo> expected = successor;
+        if (update_routing([&x, &expected](RoutingTable& routing_table) {
+                if (routing_table.successor_list[0] != expected &&
+                    !(routing_table.successor_list[0] && expected &&
+                      *routing_table.successor_list[0] == *expected)) {
+                    return false;
+                }
+                routing_table.successor_list[0] = x;
+                return true;
+            })) {
             successor = x;
         }
     }
@@ -254,10 +838,61 @@ void ChordNode::stabilize() {
     // Check for shutdown before network operations
     if (!running.load()) return;
     
-    // Notify successor about this node (without holding mutex)
+    // Notify successor about this node and adopt its successor list
+    // (without holding mutex)
     if (successor && *successor != self_info) {
         contact_node(successor, "notify", self_info.id);
+        refresh_successor_list(successor);
+    }
+}
+
+void ChordNode::refresh_successor_list(std::shared_ptr<NodeInfo> successor) {
+    std::vector<std::string> endpoints;
+    bool fetched = false;
+    try {
+        fetched = ConnectionPool::instance().call(successor->address, successor->port,
+            [&endpoints, &successor](Client& client) {
+                return client.get_successor_list(endpoints, &successor->id);
+            });
+    } catch (const std::exception&) {
+        fetched = false;
+    }
+    if (fetched) {
+        adopt_successor_list(successor, endpoints);
+    }
+}
+
+void ChordNode::adopt_successor_list(std::shared_ptr<NodeInfo> successor,
+                                     const std::vector<std::string>& endpoints) {
+    // Our list is the successor followed by its own list, up to the point
+    // where the ring wraps back to us
+    std::vector<std::shared_ptr<NodeInfo>> tail;
+    for (const auto& endpoint : endpoints) {
+        if (tail.size() + 1 >= static_cast<size_t>(SUCCESSOR_LIST_SIZE)) {
+            break;
+        }
+        auto node = parse_node(endpoint);
+        if (!node || *node == self_info) {
+            break;
+        }
+        tail.push_back(node);
     }
+    
+    update_routing([this, &successor, &tail](RoutingTable& table) {
+        auto& list = table.successor_list;
+        if (!list[0] || *list[0] != *successor) {
+            return false; // changed while we were asking
+        }
+        bool changed = false;
+        for (size_t i = 1; i < list.size(); ++i) {
+            const std::shared_ptr<NodeInfo>& node = i - 1 < tail.size() ? tail[i - 1] : self_ptr;
+            if (!list[i] || *list[i] != *node) {
+                list[i] = node;
+                changed = true;
+            }
+        }
+        return changed;
+    });
 }
 
 void ChordNode::notify(std::shared_ptr<NodeInfo> node) {
@@ -268,21 +903,25 @@ void ChordNode::notify(std::shared_ptr<NodeInfo> node) {
     std::shared_ptr<NodeInfo> old_predecessor;
     bool predecessor_changed = false;
     
-    {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        
-        if (!predecessor || in_range(node->id, predecessor->id, self_info.id, false)) {
-            old_predecessor = predecessor;
-            predecessor = node;
-            predecessor_changed = true;
-            std::cout << "Node " << self_info.to_string() 
-                      << " updated predecessor to " << node->to_string() << std::endl;
+    predecessor_changed = update_routing([this, &node, &old_predecessor](RoutingTable& table) {
+        if (table.predecessor && !in_range(node->id, table.predecessor->id, self_info.id, false)) {
+            return false;
         }
+        old_predecessor = table.predecessor;
+        table.predecessor = node;
+        table.predecessor_since = std::chrono::steady_clock::now();
+        return true;
+    });
+    if (predecessor_changed) {
+        FKVS_INFO("Node " << self_info.to_string()
+                  << " updated predecessor to " << node->to_string());
     }
     
-    // If we have a new predecessor, transfer keys that now belong to them
+    // If we have a new predecessor, hand over the range it took over from
+    // us, (old predecessor, node]. Keys outside our range are mostly
+    // replicas for other nodes and stay where they are.
     if (predecessor_changed && old_predecessor != node) {
-        transfer_keys_to_node(node);
+        transfer_keys_to_node(node, false, old_predecessor);
     }
 }
 
@@ -290,116 +929,462 @@ void ChordNode::fix_fingers() {
     // Check for shutdown before network operations
     if (!running.load()) return;
     
-    int finger_index;
-    Hash160 finger_start;
-    
-    {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        next_finger_to_fix = (next_finger_to_fix + 1) % FINGER_TABLE_SIZE;
-        finger_index = next_finger_to_fix;
-        finger_start = get_finger_start(finger_index);
+    uint64_t version = routing_version.load(std::memory_order_acquire);
+    if (version != fingers_version) {
+        refresh_fingers();
+        fingers_version = routing_version.load(std::memory_order_acquire);
+        return;
     }
     
+    // Only the maintenance thread advances next_finger_to_fix
+    next_finger_to_fix = (next_finger_to_fix + 1) % FINGER_TABLE_SIZE;
+    int finger_index = next_finger_to_fix;
+    Hash160 finger_start = get_finger_start(finger_index);
+    
     // Check for shutdown before network operations
     if (!running.load()) return;
     
     // Call find_successor without holding mutex (it may do network operations)
     auto successor = find_successor(finger_start);
+    if (!successor) {
+        return;
+    }
     
-    if (successor) {
-        std::lock_guard<std::mutex> lock(routing_mutex);
-        finger_table[finger_index] = successor;
+    // Following fingers whose start also falls before that node share
+    // its answer, so one lookup fixes the whole run
+    int last = finger_index;
+    while (last + 1 < FINGER_TABLE_SIZE &&
+           in_range(get_finger_start(last + 1), self_info.id, successor->id, true)) {
+        last++;
+    }
+    next_finger_to_fix = last;
+    
+    update_routing([&successor, finger_index, last](RoutingTable& table) {
+        return table.fingers.set(finger_index, last, successor);
+    });
+}
+
+void ChordNode::refresh_fingers() {
+    bool confirmed[FINGER_TABLE_SIZE] = {};
+    for (int round = 0; round < FINGER_REFRESH_ROUNDS; ++round) {
+        RoutingSnapshot table = routing_snapshot();
+        std::vector<int> firsts;
+        std::shared_ptr<NodeInfo> previous;
+        for (int i = 0; i < FINGER_TABLE_SIZE; ++i) {
+            if (confirmed[i]) {
+                previous = nullptr;
+                continue;
+            }
+            auto finger = table->fingers.get(i);
+            if (!previous || !finger || *finger != *previous) {
+                firsts.push_back(i);
+            }
+            previous = finger;
+        }
+        if (firsts.empty()) {
+            return;
+        }
+        
+        std::vector<Hash160> ids;
+        for (int first : firsts) {
+            ids.push_back(get_finger_start(first));
+        }
+        std::vector<std::shared_ptr<NodeInfo>> answers;
+        find_successors(ids, answers);
+        
+        // As in fix_fingers, an answer also holds for the following
+        // fingers whose start falls before it
+        std::vector<std::pair<int, int>> runs(firsts.size(), std::make_pair(0, -1));
+        bool resolved = false;
+        for (size_t k = 0; k < firsts.size(); ++k) {
+            if (!answers[k]) {
+                continue;
+            }
+            int last = firsts[k];
+            while (last + 1 < FINGER_TABLE_SIZE && !confirmed[last + 1] &&
+                   in_range(get_finger_start(last + 1), self_info.id, answers[k]->id, true)) {
+                last++;
+            }
+            runs[k] = std::make_pair(firsts[k], last);
+            std::fill(confirmed + firsts[k], confirmed + last + 1, true);
+            resolved = true;
+        }
+        if (!resolved) {
+            return;
+        }
+        update_routing([&runs, &answers](RoutingTable& routing_table) {
+            bool changed = false;
+            for (size_t k = 0; k < runs.size(); ++k) {
+                if (answers[k]) {
+                    changed = routing_table.fingers.set(runs[k].first, runs[k].second, answers[k]) || changed;
+                }
+            }
+            return changed;
+        });
     }
 }
 
-bool ChordNode::store_key(const std::string& key, const std::vector<uint8_t>& value) {
-    Hash160 key_id = SHA1::hash(key);
+void ChordNode::find_successors(const std::vector<Hash160>& ids, std::vector<std::shared_ptr<NodeInfo>>& out) {
+    auto started = std::chrono::steady_clock::now();
+    struct Lookup {
+        bool final;
+        bool failed;
+        int hops;
+        size_t next; // candidate to ask
+        std::vector<std::shared_ptr<NodeInfo>> candidates;
+    };
+    std::vector<Lookup> lookups(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        Lookup& lookup = lookups[i];
+        lookup.failed = false;
+        lookup.hops = 0;
+        lookup.next = 0;
+        lookup_step(ids[i], lookup.final, lookup.candidates);
+    }
     
-    if (is_responsible_for_key(key_id)) {
-        // Store locally first
-        local_storage->put(key, value);
+    for (int round = 0; round < MAX_LOOKUP_HOPS; ++round) {
+        std::vector<size_t> asked;
+        std::vector<std::future<AsyncRpc::Result>> pending;
+        for (size_t i = 0; i < lookups.size(); ++i) {
+            Lookup& lookup = lookups[i];
+            if (lookup.final || lookup.failed) {
+                continue;
+            }
+            while (lookup.next < lookup.candidates.size() &&
+                   (!lookup.candidates[lookup.next] || *lookup.candidates[lookup.next] == self_info)) {
+                lookup.next++;
+            }
+            if (lookup.next == lookup.candidates.size()) {
+                lookup.failed = true;
+                continue;
+            }
+            const NodeInfo& hop = *lookup.candidates[lookup.next];
+            Request request(OpCode::CLOSEST_PRECEDING_NODE, std::vector<uint8_t>(ids[i].begin(), ids[i].end()));
+            pending.push_back(AsyncRpc::instance().submit(hop.address, hop.port, request));
+            asked.push_back(i);
+        }
+        if (pending.empty()) {
+            break;
+        }
         
+        // A hop that does not answer costs its lookup a round; the next
+        // alternative is asked in the following one
+        for (size_t k = 0; k < pending.size(); ++k) {
+            AsyncRpc::Result result = pending[k].get();
+            Lookup& lookup = lookups[asked[k]];
+            std::vector<std::shared_ptr<NodeInfo>> nodes;
+            if (result.ok && result.response.status == StatusCode::SUCCESS && !result.response.value.empty()) {
+                std::vector<std::string> endpoints;
+                const std::vector<uint8_t>& value = result.response.value;
+                Protocol::decodeNodeList(value.data() + 1, value.size() - 1, endpoints);
+                for (const auto& endpoint : endpoints) {
+                    auto parsed = parse_node(endpoint);
+                    if (parsed) {
+                        nodes.push_back(parsed);
+                    }
+                }
+            }
+            if (nodes.empty()) {
+                lookup.next++;
+                continue;
+            }
+            lookup.final = result.response.value[0] != 0;
+            lookup.candidates.swap(nodes);
+            lookup.next = 0;
+            lookup.hops++;
+        }
+    }
+    
+    out.assign(ids.size(), nullptr);
+    for (size_t i = 0; i < lookups.size(); ++i) {
+        bool found = lookups[i].final && !lookups[i].candidates.empty();
+        if (found) {
+            out[i] = lookups[i].candidates[0];
+        }
+        record_lookup(lookups[i].hops, started, !found);
+    }
+}
+
+bool ChordNode::store_key(const std::string& key, const std::vector<uint8_t>& value) {
+    return store_key(key, std::vector<uint8_t>(value));
+}
+
+bool ChordNode::store_key(const std::string& key, std::vector<uint8_t>&& value) {
+    return store_key(key, SHA1::hash(key), std::move(value));
+}
+
+bool ChordNode::store_key(const std::string& key, const Hash160& key_id, std::vector<uint8_t>&& value,
+                          bool compressed, uint64_t ttl_ms) {
+    if (!compressed) {
+        compressed = local_storage->compress(value);
+    }
+    if (ChordNode* owner = host_owner(key_id)) {
         // Get replica nodes for replication
-        auto replicas = get_replica_nodes(key_id);
+        auto replicas = owner->get_replica_nodes(key_id);
         
         // Synchronous replication as specified in DESIGN.md
-        // Must complete replication before returning success
+        // Must complete replication before returning success. Replicating
+        // before the local write lets the value be moved into storage
+        // afterwards and means a failed write leaves the previous local
+        // value untouched instead of needing a rollback. The version is
+        // taken first, so that of two concurrent writes every copy keeps
+        // the later one whichever finishes first.
+        uint64_t version = local_storage->stamp();
+        uint64_t expires = ttl_ms != 0 ? HybridClock::wall_ms() + std::min(ttl_ms, Protocol::MAX_TTL_MS) : 0;
         if (!replicas.empty()) {
-            bool replication_success = replication_manager->replicate_put(key, value, replicas);
+            bool replication_success = replication_manager->replicate_put(key, value, replicas, version,
+                                                                          compressed, expires);
             if (!replication_success) {
-                // Replication failed - rollback local storage and return failure
-                local_storage->remove(key);
-                std::cerr << "Error: Synchronous replication failed for key '" << key << "'" << std::endl;
+                FKVS_ERROR("Synchronous replication failed for key '" << key << "'");
                 return false;
             }
         }
         
-        // Replication successful (or no replicas needed)
-        return true;
+        local_storage->apply(key, key_id, std::move(value), version, compressed, expires);
+        revoke_leases(key);
+        return local_storage->durable();
     } else {
         // Forward to responsible node
+        forwarded_requests++;
         auto responsible = find_successor(key_id);
-        if (responsible && *responsible != self_info) {
+        bool stored = false;
+        if (responsible && !is_local(*responsible)) {
             // Send to responsible node via client
             try {
-                Client client(responsible->address, responsible->port);
-                if (client.connect()) {
-                    return client.put(key, value);
-                }
+                stored = ConnectionPool::instance().call(responsible->address, responsible->port,
+                    [&key, &value, compressed, ttl_ms](Client& client) {
+                        return ttl_ms != 0 ? client.put_with_ttl(key, value, ttl_ms, compressed) :
+                                             client.put(key, value, compressed);
+                    });
             } catch (const std::exception& e) {
-                std::cerr << "Failed to forward PUT to " << responsible->to_string() 
-                          << ": " << e.what() << std::endl;
+                FKVS_WARN("Failed to forward PUT to " << responsible->to_string()
+                          << ": " << e.what());
             }
         }
+        invalidate_cached(key);
+        return stored;
+    }
+}
+
+StatusCode ChordNode::compare_and_store(const std::string& key, const Hash160& key_id,
+                                        std::vector<uint8_t>&& value, uint64_t expected,
+                                        uint64_t& version, bool compressed) {
+    if (!compressed) {
+        compressed = local_storage->compress(value);
+    }
+    ChordNode* owner = host_owner(key_id);
+    if (!owner) {
+        forwarded_requests++;
+        auto responsible = find_successor(key_id);
+        StatusCode status = StatusCode::ERROR;
+        if (responsible && !is_local(*responsible)) {
+            try {
+                ConnectionPool::instance().call(responsible->address, responsible->port,
+                    [&](Client& client) {
+                        status = client.compare_and_put(key, value, expected, version, compressed);
+                        return status != StatusCode::ERROR;
+                    });
+            } catch (const std::exception& e) {
+                FKVS_WARN("Failed to forward CAS to " << responsible->to_string()
+                          << ": " << e.what());
+            }
+        }
+        invalidate_cached(key);
+        return status;
+    }
+    
+    // The owner decides, replicates, and only then applies, as store_key
+    // does, so a write the replicas did not take is never served here.
+    // CASes of a key are serialized from the check to the apply; a plain
+    // PUT racing one is ordered against it by version, like two PUTs.
+    std::lock_guard<std::mutex> reserve(owner->cas_locks[std::hash<std::string>()(key) % CAS_LOCKS]);
+    std::vector<uint8_t> current;
+    uint64_t current_version = 0;
+    if (!local_storage->get(key, current, current_version)) {
+        current_version = 0;
+    }
+    if (current_version != expected) {
+        version = current_version;
+        return StatusCode::VERSION_MISMATCH;
+    }
+    version = local_storage->stamp();
+    auto replicas = owner->get_replica_nodes(key_id);
+    if (!replicas.empty() &&
+        !replication_manager->replicate_put(key, value, replicas, version, compressed)) {
+        FKVS_ERROR("Synchronous replication failed for CAS of key '" << key << "'");
+        return StatusCode::ERROR;
+    }
+    local_storage->apply(key, key_id, std::move(value), version, compressed);
+    revoke_leases(key);
+    if (!local_storage->durable()) {
+        return StatusCode::ERROR;
+    }
+    return StatusCode::SUCCESS;
+}
+
+bool ChordNode::retrieve_versioned(const std::string& key, const Hash160& key_id,
+                                   std::vector<uint8_t>& value, uint64_t& version, bool* compressed) {
+    if (host_owner(key_id)) {
+        return compressed ? local_storage->get_stored(key, value, version, *compressed) :
+                            local_storage->get(key, value, version);
+    }
+    if (compressed) {
+        *compressed = false; // the client call below decodes
+    }
+    forwarded_requests++;
+    auto responsible = find_successor(key_id);
+    if (!responsible || is_local(*responsible)) {
+        return false;
+    }
+    try {
+        return ConnectionPool::instance().call(responsible->address, responsible->port,
+            [&key, &value, &version](Client& client) { return client.get(key, value, version); });
+    } catch (const std::exception& e) {
+        FKVS_WARN("Failed to forward GET_VERSIONED to " << responsible->to_string()
+                  << ": " << e.what());
         return false;
     }
 }
 
 bool ChordNode::retrieve_key(const std::string& key, std::vector<uint8_t>& value) {
-    Hash160 key_id = SHA1::hash(key);
-    
-    if (is_responsible_for_key(key_id)) {
+    return retrieve_key(key, SHA1::hash(key), value);
+}
+
+bool ChordNode::retrieve_key(const std::string& key, const Hash160& key_id, std::vector<uint8_t>& value,
+                             bool* compressed) {
+    // Only a local read can hand out the stored form
+    if (compressed) {
+        *compressed = false;
+    }
+    if (ChordNode* owner = host_owner(key_id)) {
         // Try local storage first
-        if (local_storage->get(key, value)) {
+        uint64_t version = 0;
+        if (compressed ? local_storage->get_stored(key, value, version, *compressed) :
+                         local_storage->get(key, value)) {
             return true;
         }
         
         // If not found locally, try replicas (fallback)
-        auto replicas = get_replica_nodes(key_id);
+        auto replicas = owner->get_replica_nodes(key_id);
         if (!replicas.empty()) {
             return replication_manager->get_from_replicas(key, value, replicas);
         }
         
         return false;
     } else {
+        if (read_cache && read_cache->get(key, value)) {
+            return true;
+        }
+        
         // Forward to responsible node
+        forwarded_requests++;
         auto responsible = find_successor(key_id);
-        if (responsible && *responsible != self_info) {
+        if (responsible && !is_local(*responsible)) {
             try {
-                Client client(responsible->address, responsible->port);
-                if (client.connect()) {
-                    return client.get(key, value);
+                if (!read_cache) {
+                    return ConnectionPool::instance().call(responsible->address, responsible->port,
+                        [&key, &value](Client& client) { return client.get(key, value); });
+                }
+                // Taken before the read: an invalidation that overtakes the
+                // reply then keeps the (possibly older) value out
+                uint64_t ticket = read_cache->ticket(key);
+                std::string holder = self_info.endpoint();
+                uint32_t lease_ms = 0;
+                bool found = ConnectionPool::instance().call(responsible->address, responsible->port,
+                    [&key, &holder, &value, &lease_ms](Client& client) {
+                        return client.get_leased(key, holder, value, lease_ms);
+                    });
+                if (found && lease_ms > 0) {
+                    read_cache->put(key, value, std::chrono::milliseconds(lease_ms), ticket);
                 }
+                return found;
             } catch (const std::exception& e) {
-                std::cerr << "Failed to forward GET to " << responsible->to_string() 
-                          << ": " << e.what() << std::endl;
+                FKVS_WARN("Failed to forward GET to " << responsible->to_string()
+                          << ": " << e.what());
             }
         }
         return false;
     }
 }
 
-bool ChordNode::remove_key(const std::string& key) {
-    Hash160 key_id = SHA1::hash(key);
+bool ChordNode::retrieve_copy(const std::string& key, const Hash160& key_id, std::vector<uint8_t>& value,
+                              bool* compressed) {
+    uint64_t version = 0;
+    if (compressed ? !local_storage->get_stored(key, value, version, *compressed) :
+                     !local_storage->get(key, value)) {
+        return false;
+    }
+    if (!host_owner(key_id)) {
+        replica_reads++;
+    }
+    return true;
+}
+
+StatusCode ChordNode::retrieve_quorum(const std::string& key, const Hash160& key_id,
+                                      std::vector<uint8_t>& value, bool* compressed) {
+    // Copies are compared, and repaired, in their stored form
+    ChordNode* owner = host_owner(key_id);
+    uint64_t version = 0;
+    bool stored_compressed = false;
+    uint64_t expires = 0;
+    if (!owner || !local_storage->get_stored(key, value, version, stored_compressed, &expires)) {
+        return retrieve_key(key, key_id, value, compressed) ? StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+    }
+    quorum_reads++;
+    
+    StatusCode status = StatusCode::SUCCESS;
+    auto replicas = owner->get_replica_nodes(key_id);
+    int needed = std::min(replication_manager->get_read_quorum() - 1, static_cast<int>(replicas.size()));
+    if (needed > 0) {
+        uint64_t digest = MerkleTree::entry_digest(key.data(), key.size(), value.data(), value.size(), expires);
+        std::vector<std::shared_ptr<NodeInfo>> stale;
+        int answered = replication_manager->check_replicas(key, digest, replicas, needed, stale);
+        if (!stale.empty()) {
+            // Read repair
+            stale_replicas += stale.size();
+            FKVS_DEBUG("Quorum read of " << key << " found " << stale.size() << " stale replica(s)");
+            replication_manager->replicate_put(key, value, stale, version, stored_compressed, expires);
+        }
+        if (answered < needed) {
+            quorum_failures++;
+            status = StatusCode::ERROR;
+        }
+    }
     
-    if (is_responsible_for_key(key_id)) {
+    if (compressed) {
+        *compressed = stored_compressed;
+    } else if (stored_compressed) {
+        std::vector<uint8_t> raw;
+        if (!Compression::decompress(value, raw)) {
+            return StatusCode::ERROR;
+        }
+        value.swap(raw);
+    }
+    return status;
+}
+
+ChordNode::ReadStats ChordNode::get_read_stats() const {
+    ReadStats stats;
+    stats.replica_reads = replica_reads.load();
+    stats.quorum_reads = quorum_reads.load();
+    stats.stale_replicas = stale_replicas.load();
+    stats.quorum_failures = quorum_failures.load();
+    return stats;
+}
+
+bool ChordNode::remove_key(const std::string& key) {
+    return remove_key(key, SHA1::hash(key));
+}
+
+bool ChordNode::remove_key(const std::string& key, const Hash160& key_id) {
+    if (ChordNode* owner = host_owner(key_id)) {
         // Check if key exists locally, or in replicas if not local
         std::vector<uint8_t> dummy;
         bool key_exists = local_storage->get(key, dummy);
         
         if (!key_exists) {
             // Check if key exists in replicas (like retrieve_key does)
-            auto replicas = get_replica_nodes(key_id);
+            auto replicas = owner->get_replica_nodes(key_id);
             if (!replicas.empty()) {
                 key_exists = replication_manager->get_from_replicas(key, dummy, replicas);
             }
@@ -409,204 +1394,418 @@ bool ChordNode::remove_key(const std::string& key) {
             }
         }
         
-        // Remove from local storage (this will only succeed if key exists locally)
-        local_storage->remove(key);
-        
-        // Synchronously remove from replicas
-        auto replicas = get_replica_nodes(key_id);
-        if (!replicas.empty()) {
-            bool replication_success = replication_manager->replicate_delete(key, replicas);
-            if (!replication_success) {
-                // For delete, we've already removed locally
-                // Log error but don't fail the operation
-                std::cerr << "Warning: Synchronous replication delete failed for key '" << key 
-                          << "' - local deletion succeeded but some replicas may be inconsistent" << std::endl;
+        // Remove from local storage (this will only succeed if key exists
+        // locally). The delete's version keeps replicas from reviving the
+        // key with an older write that reaches them afterwards.
+        uint64_t version = local_storage->stamp();
+        local_storage->apply_remove(key, version);
+        revoke_leases(key);
+        
+        // Synchronously remove from replicas
+        auto replicas = owner->get_replica_nodes(key_id);
+        if (!replicas.empty()) {
+            bool replication_success = replication_manager->replicate_delete(key, replicas, version);
+            if (!replication_success) {
+                // For delete, we've already removed locally
+                // Log error but don't fail the operation
+                FKVS_WARN("Synchronous replication delete failed for key '" << key
+                          << "' - local deletion succeeded but some replicas may be inconsistent");
+            }
+        }
+        
+        return local_storage->durable();
+    } else {
+        // Forward to responsible node
+        forwarded_requests++;
+        auto responsible = find_successor(key_id);
+        bool removed = false;
+        if (responsible && !is_local(*responsible)) {
+            try {
+                removed = ConnectionPool::instance().call(responsible->address, responsible->port,
+                    [&key](Client& client) { return client.remove(key); });
+            } catch (const std::exception& e) {
+                FKVS_WARN("Failed to forward DELETE to " << responsible->to_string()
+                          << ": " << e.what());
+            }
+        }
+        invalidate_cached(key);
+        return removed;
+    }
+}
+
+bool ChordNode::forwards_read(const std::string& key) {
+    return read_cache && read_cache->should_cache(key);
+}
+
+bool ChordNode::retrieve_leased(const std::string& key, const std::string& holder,
+                                std::vector<uint8_t>& value, uint32_t& lease_ms) {
+    Hash160 key_id = SHA1::hash(key);
+    lease_ms = 0;
+    if (is_responsible_for_key(key_id)) {
+        // Granted before the read: a write after the read finds the lease
+        // and revokes it, a write before the read is in the value
+        lease_ms = grant_lease(key, holder);
+        // A cached copy must not outlive the key
+        uint64_t expires = local_storage->expiry(key);
+        if (lease_ms > 0 && expires != 0) {
+            uint64_t now = HybridClock::wall_ms();
+            lease_ms = expires > now ? static_cast<uint32_t>(std::min<uint64_t>(lease_ms, expires - now)) : 0;
+        }
+    }
+    return retrieve_key(key, key_id, value);
+}
+
+void ChordNode::invalidate_cached(const std::string& key) {
+    if (read_cache) {
+        read_cache->invalidate(key);
+    }
+}
+
+uint32_t ChordNode::grant_lease(const std::string& key, const std::string& holder) {
+    auto now = std::chrono::steady_clock::now();
+    auto expires = now + std::chrono::milliseconds(2 * READ_LEASE_MS);
+    std::lock_guard<std::mutex> lock(lease_mutex);
+    
+    auto it = read_leases.find(key);
+    if (it == read_leases.end()) {
+        if (read_leases.size() >= MAX_LEASED_KEYS &&
+            now - last_lease_prune >= std::chrono::milliseconds(READ_LEASE_MS)) {
+            last_lease_prune = now;
+            for (auto entry = read_leases.begin(); entry != read_leases.end();) {
+                auto& leases = entry->second;
+                leases.erase(std::remove_if(leases.begin(), leases.end(),
+                    [now](const ReadLease& lease) { return lease.expires <= now; }), leases.end());
+                entry = leases.empty() ? read_leases.erase(entry) : std::next(entry);
+            }
+        }
+        if (read_leases.size() >= MAX_LEASED_KEYS) {
+            return 0; // full: serve the read uncached
+        }
+        it = read_leases.emplace(key, std::vector<ReadLease>()).first;
+    }
+    
+    for (auto& lease : it->second) {
+        if (lease.holder == holder) {
+            lease.expires = expires;
+            return READ_LEASE_MS;
+        }
+    }
+    it->second.push_back(ReadLease{holder, expires});
+    return READ_LEASE_MS;
+}
+
+void ChordNode::revoke_leases(const std::string& key) {
+    std::vector<std::string> holders;
+    {
+        std::lock_guard<std::mutex> lock(lease_mutex);
+        auto it = read_leases.find(key);
+        if (it == read_leases.end()) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& lease : it->second) {
+            if (lease.expires > now) {
+                holders.push_back(lease.holder);
+            }
+        }
+        read_leases.erase(it);
+    }
+    
+    // A holder that cannot be reached keeps serving its copy until the
+    // lease runs out, which bounds how stale it gets
+    std::vector<std::future<AsyncRpc::Result>> pending;
+    Request request(OpCode::INVALIDATE, std::vector<uint8_t>(key.begin(), key.end()));
+    for (const auto& holder : holders) {
+        NodeInfo node;
+        if (!NodeInfo::parse(holder, node) || is_local(node)) {
+            continue;
+        }
+        pending.push_back(AsyncRpc::instance().submit(node.address, node.port, request));
+    }
+    for (auto& result : pending) {
+        result.wait();
+    }
+}
+
+void ChordNode::execute_batch(OpCode opcode, std::vector<BatchEntry>& entries,
+                              std::vector<BatchResult>& results, bool forwarded) {
+    results.assign(entries.size(), BatchResult(StatusCode::ERROR));
+    
+    // Visit keys in ring order: a lookup for id x answers every following
+    // id up to the owner's own id, so one find_successor covers a whole run
+    // of keys that land on the same node.
+    std::vector<std::pair<Hash160, size_t>> order;
+    order.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        order.emplace_back(SHA1::hash(entries[i].key), i);
+    }
+    std::sort(order.begin(), order.end());
+    
+    struct OwnerBatch {
+        std::shared_ptr<NodeInfo> owner;
+        std::vector<size_t> indices;
+    };
+    std::vector<std::pair<Hash160, size_t>> local;
+    std::vector<OwnerBatch> remote;
+    
+    std::shared_ptr<NodeInfo> owner;
+    Hash160 range_start{};
+    OwnerBatch* current = nullptr;
+    for (const auto& item : order) {
+        const Hash160& key_id = item.first;
+        if (is_responsible_for_key(key_id)) {
+            local.push_back(item);
+            continue;
+        }
+        if (forwarded) {
+            // A coordinator's routing was stale: name the owner instead of
+            // forwarding a second time
+            auto responsible = find_successor(key_id);
+            if (responsible && !is_local(*responsible)) {
+                std::string node_str = responsible->endpoint();
+                results[item.second].status = StatusCode::REDIRECT;
+                results[item.second].value.assign(node_str.begin(), node_str.end());
+            }
+            continue;
+        }
+        
+        if (!owner || !(key_id == range_start || in_range(key_id, range_start, owner->id, true))) {
+            owner = find_successor(key_id);
+            range_start = key_id;
+            current = nullptr;
+            if (owner && !is_local(*owner)) {
+                // The ring wraps, so the same owner can come up twice
+                for (auto& batch : remote) {
+                    if (*batch.owner == *owner) {
+                        current = &batch;
+                        break;
+                    }
+                }
+                if (!current) {
+                    remote.push_back(OwnerBatch{owner, {}});
+                    current = &remote.back();
+                }
             }
         }
         
-        return true;
-    } else {
-        // Forward to responsible node
-        auto responsible = find_successor(key_id);
-        if (responsible && *responsible != self_info) {
-            try {
-                Client client(responsible->address, responsible->port);
-                if (client.connect()) {
-                    return client.remove(key);
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "Failed to forward DELETE to " << responsible->to_string() 
-                          << ": " << e.what() << std::endl;
+        if (current) {
+            current->indices.push_back(item.second);
+        } else if (owner) {
+            local.push_back(item); // lookup resolved to this node
+        }
+        // No owner found: leave the ERROR result in place
+    }
+    
+    // One sub-batch per remote owner, all in flight at once
+    forwarded_requests += remote.size();
+    std::vector<std::future<AsyncRpc::Result>> pending;
+    for (size_t b = 0; b < remote.size(); ++b) {
+        std::vector<BatchEntry> sub;
+        sub.reserve(remote[b].indices.size());
+        for (size_t index : remote[b].indices) {
+            sub.push_back(BatchEntry());
+            sub.back().key = entries[index].key;
+            sub.back().value = std::move(entries[index].value);
+        }
+        Request request(opcode, {Protocol::BATCH_FORWARDED});
+        request.value = Protocol::encodeBatch(sub);
+        pending.push_back(AsyncRpc::instance().submit(remote[b].owner->address,
+                                                      remote[b].owner->port, request));
+    }
+    
+    // Serve the local share while the sub-batches are in flight
+    for (const auto& item : local) {
+        const Hash160& key_id = item.first;
+        size_t index = item.second;
+        const std::string& key = entries[index].key;
+        BatchResult& result = results[index];
+        if (opcode == OpCode::MULTI_GET) {
+            result.status = retrieve_key(key, key_id, result.value) ?
+                StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+        } else if (opcode == OpCode::MULTI_PUT) {
+            result.status = store_key(key, key_id, std::move(entries[index].value)) ?
+                StatusCode::SUCCESS : StatusCode::ERROR;
+        } else {
+            result.status = remove_key(key, key_id) ?
+                StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+        }
+    }
+    
+    for (size_t b = 0; b < remote.size(); ++b) {
+        AsyncRpc::Result reply = pending[b].get();
+        std::vector<BatchResult> answers;
+        if (!reply.ok || reply.response.status != StatusCode::SUCCESS ||
+            !Protocol::decodeBatchResults(reply.response.value.data(), reply.response.value.size(),
+                                          answers) ||
+            answers.size() != remote[b].indices.size()) {
+            FKVS_WARN("Failed to forward batch to " << remote[b].owner->to_string());
+            continue; // whole sub-batch stays ERROR
+        }
+        for (size_t k = 0; k < answers.size(); ++k) {
+            results[remote[b].indices[k]] = std::move(answers[k]);
+        }
+    }
+    
+    if (opcode != OpCode::MULTI_GET) {
+        for (const auto& batch : remote) {
+            for (size_t index : batch.indices) {
+                invalidate_cached(entries[index].key);
             }
         }
-        return false;
     }
 }
 
 bool ChordNode::is_responsible_for_key(const Hash160& key_id) const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
-    
-    if (!predecessor) {
-        // Single node is responsible for all keys
-        return true;
+    return host_owner(key_id) != nullptr;
+}
+
+bool ChordNode::owns(const RoutingTable& table, const Hash160& key_id) const {
+    if (!table.predecessor) {
+        // A single node is responsible for all keys. A node that has just
+        // joined owns nothing until its successor's notify hands it a range.
+        return !table.successor_list[0] || *table.successor_list[0] == self_info;
     }
     
     // Key is in range (predecessor, self]
-    return in_range(key_id, predecessor->id, self_info.id, true);
+    return in_range(key_id, table.predecessor->id, self_info.id, true);
 }
 
 std::shared_ptr<NodeInfo> ChordNode::get_successor() const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
-    return successor_list[0];
+    return routing_snapshot()->successor_list[0];
 }
 
 std::shared_ptr<NodeInfo> ChordNode::get_predecessor() const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
-    return predecessor;
+    return routing_snapshot()->predecessor;
 }
 
 std::vector<std::shared_ptr<NodeInfo>> ChordNode::get_successor_list() const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
-    return successor_list;
+    return routing_snapshot()->successor_list;
+}
+
+void ChordNode::get_routing_nodes(std::vector<std::shared_ptr<NodeInfo>>& successors,
+                                  std::vector<std::shared_ptr<NodeInfo>>& fingers) const {
+    RoutingSnapshot table = routing_snapshot();
+    for (const auto& node : table->successor_list) {
+        if (!node || *node == self_info) {
+            break;
+        }
+        successors.push_back(node);
+    }
+    fingers = table->fingers.distinct();
 }
 
-void ChordNode::initialize_finger_table() {
-    // Initialize all fingers to point to immediate successor initially
-    auto successor = successor_list[0];
-    std::fill(finger_table.begin(), finger_table.end(), successor);
+void ChordNode::seed_fingers(std::vector<std::shared_ptr<NodeInfo>> nodes) {
+    nodes.push_back(self_ptr);
+    std::sort(nodes.begin(), nodes.end(),
+        [](const std::shared_ptr<NodeInfo>& a, const std::shared_ptr<NodeInfo>& b) { return a->id < b->id; });
+    nodes.erase(std::unique(nodes.begin(), nodes.end(),
+        [](const std::shared_ptr<NodeInfo>& a, const std::shared_ptr<NodeInfo>& b) { return *a == *b; }),
+        nodes.end());
+    update_routing([this, &nodes](RoutingTable& table) {
+        bool changed = false;
+        for (int i = 0; i < FINGER_TABLE_SIZE; ++i) {
+            auto it = std::lower_bound(nodes.begin(), nodes.end(), finger_starts[i],
+                [](const std::shared_ptr<NodeInfo>& node, const Hash160& value) { return node->id < value; });
+            const std::shared_ptr<NodeInfo>& node = it == nodes.end() ? nodes.front() : *it;
+            changed = table.fingers.set(i, i, node) || changed;
+        }
+        return changed;
+    });
 }
 
-Hash160 ChordNode::get_finger_start(int index) const {
+const Hash160& ChordNode::get_finger_start(int index) const {
     if (index < 0 || index >= FINGER_TABLE_SIZE) {
         return self_info.id;
     }
-    return add_power_of_two(self_info.id, index);
+    return finger_starts[index];
 }
 
-void ChordNode::stabilize_loop() {
-    while (running.load()) {
-        try {
-            // Check for shutdown before network operations
-            if (!running.load()) break;
-            stabilize();
-        } catch (const std::exception& e) {
-            std::cerr << "Error in stabilize: " << e.what() << std::endl;
-        }
+void ChordNode::detect_failures() {
+    // Copy nodes to check (avoid holding mutex during network operations)
+    std::vector<std::shared_ptr<NodeInfo>> nodes_to_check;
+    {
+        RoutingSnapshot table = routing_snapshot();
         
-        // Use interruptible sleep - returns true if interrupted
-        if (interruptible_sleep(stabilize_interval)) {
-            break; // Shutdown requested
-        }
-    }
-}
-
-void ChordNode::fix_fingers_loop() {
-    while (running.load()) {
-        try {
-            // Check for shutdown before network operations
-            if (!running.load()) break;
-            fix_fingers();
-        } catch (const std::exception& e) {
-            std::cerr << "Error in fix_fingers: " << e.what() << std::endl;
+        // Copy successor list nodes
+        // The server's other positions are not watched: they fail with us
+        for (const auto& successor : table->successor_list) {
+            if (successor && !is_local(*successor)) {
+                nodes_to_check.push_back(successor);
+            }
         }
         
-        // Use interruptible sleep - returns true if interrupted
-        if (interruptible_sleep(fix_fingers_interval)) {
-            break; // Shutdown requested
+        // Copy predecessor
+        if (table->predecessor && !is_local(*table->predecessor)) {
+            nodes_to_check.push_back(table->predecessor);
         }
     }
-}
-
-void ChordNode::failure_detection_loop() {
-    while (running.load()) {
-        try {
-            // Copy nodes to check (avoid holding mutex during network operations)
-            std::vector<std::shared_ptr<NodeInfo>> nodes_to_check;
-            {
-                std::lock_guard<std::mutex> lock(routing_mutex);
-                
-                // Copy successor list nodes
-                for (auto& successor : successor_list) {
-                    if (successor && *successor != self_info) {
-                        nodes_to_check.push_back(successor);
-                    }
-                }
-                
-                // Copy predecessor
-                if (predecessor && *predecessor != self_info) {
-                    nodes_to_check.push_back(predecessor);
-                }
-            }
-            
-            // Check nodes without holding mutex (avoid deadlock)
-            std::vector<std::shared_ptr<NodeInfo>> failed_nodes;
-            for (auto& node : nodes_to_check) {
-                if (!running.load()) break; // Check for shutdown during loop
-                
-                failure_detector->ping_node(node);
-                if (failure_detector->is_node_failed(node)) {
-                    failed_nodes.push_back(node);
-                }
-            }
-            
-            // Handle failures (this will reacquire mutex as needed)
-            for (auto& failed_node : failed_nodes) {
-                if (!running.load()) break;
-                handle_node_failure(failed_node);
-            }
-            
-            // Cleanup old failure detection entries
-            failure_detector->cleanup_old_entries();
-            
-        } catch (const std::exception& e) {
-            std::cerr << "Error in failure_detection: " << e.what() << std::endl;
-        }
+    
+    // One non-blocking round: nodes heard from recently (any answer
+    // counts) are left alone, the rest are pinged in the background
+    failure_detector->probe(nodes_to_check);
+    std::vector<std::shared_ptr<NodeInfo>> failed_nodes;
+    for (auto& node : nodes_to_check) {
+        if (!running.load()) return; // Check for shutdown during loop
         
-        // Use interruptible sleep - returns true if interrupted
-        if (interruptible_sleep(failure_check_interval)) {
-            break; // Shutdown requested
+        if (failure_detector->is_node_failed(node)) {
+            failed_nodes.push_back(node);
         }
     }
+    
+    // Handle failures (this will reacquire mutex as needed)
+    for (auto& failed_node : failed_nodes) {
+        if (!running.load()) return;
+        handle_node_failure(failed_node);
+    }
+    
+    // Cleanup old failure detection entries and idle peer connections
+    failure_detector->cleanup_old_entries();
+    ConnectionPool::instance().evict_idle();
 }
 
 std::shared_ptr<NodeInfo> ChordNode::contact_node(std::shared_ptr<NodeInfo> node, 
                                                   const std::string& operation,
                                                   const Hash160& param) {
     if (!node || *node == self_info) {
-        return std::make_shared<NodeInfo>(self_info);
+        return self_ptr;
     }
     
+    std::string endpoint;
+    bool reached = false;
     try {
-        Client client(node->address, node->port);
-        if (!client.connect()) {
-            failure_detector->mark_node_failed(node);
-            return nullptr;
-        }
-        
-        failure_detector->mark_node_responsive(node);
-        
+        ConnectionPool& pool = ConnectionPool::instance();
+        // Calls about a node's own state name it by id, since a server may
+        // hold several ring positions
         if (operation == "get_predecessor") {
-            // Request predecessor information via custom protocol
-            // For now, return placeholder since full RPC not implemented
-            return node;
+            reached = pool.call(node->address, node->port,
+                [&endpoint, &node](Client& client) { return client.get_predecessor(endpoint, &node->id); });
         } else if (operation == "find_successor") {
-            // Request successor for given ID
-            // For now, return placeholder
-            return node;
+            reached = pool.call(node->address, node->port,
+                [&param, &endpoint](Client& client) { return client.find_successor(param, endpoint); });
         } else if (operation == "notify") {
-            // Notify node about this node as predecessor
-            // For now, just ping
-            client.ping();
-            return node;
+            // Tell node that we might be its predecessor
+            std::string self_endpoint = self_info.endpoint();
+            reached = pool.call(node->address, node->port,
+                [&self_endpoint, &node](Client& client) { return client.notify(self_endpoint, &node->id); });
+            endpoint = node->endpoint();
+        } else {
+            reached = pool.call(node->address, node->port,
+                [](Client& client) { return client.ping(); });
+            endpoint = node->endpoint();
         }
-        
-        return node;
     } catch (const std::exception& e) {
-        std::cerr << "Failed to contact node " << node->to_string() 
-                  << ": " << e.what() << std::endl;
-        failure_detector->mark_node_failed(node);
+        FKVS_DEBUG("Failed to contact node " << node->to_string()
+                   << ": " << e.what());
+        reached = false;
+    }
+    
+    if (!reached) {
+        // One failed call is not a verdict; the detector weighs it
+        failure_detector->report_unreachable(node);
         return nullptr;
     }
+    failure_detector->mark_node_responsive(node);
+    return endpoint.empty() ? nullptr : parse_node(endpoint);
 }
 
 bool ChordNode::ping_node(std::shared_ptr<NodeInfo> node) {
@@ -614,15 +1813,26 @@ bool ChordNode::ping_node(std::shared_ptr<NodeInfo> node) {
 }
 
 std::vector<std::shared_ptr<NodeInfo>> ChordNode::get_replica_nodes(const Hash160& key_id) const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    RoutingSnapshot table = routing_snapshot();
     
     std::vector<std::shared_ptr<NodeInfo>> replicas;
     int replication_factor = replication_manager->get_replication_factor();
     
-    // Get successors for replication (excluding self)
-    for (int i = 0; i < replication_factor - 1 && i < SUCCESSOR_LIST_SIZE; ++i) {
-        if (successor_list[i] && *successor_list[i] != self_info) {
-            replicas.push_back(successor_list[i]);
+    // The next distinct servers along the ring; our own other positions
+    // share our storage and would not add a copy
+    for (const auto& successor : table->successor_list) {
+        if (static_cast<int>(replicas.size()) >= replication_factor - 1) {
+            break;
+        }
+        if (!successor || is_local(*successor)) {
+            continue;
+        }
+        bool seen = false;
+        for (const auto& replica : replicas) {
+            seen = seen || replica->same_host(*successor);
+        }
+        if (!seen) {
+            replicas.push_back(successor);
         }
     }
     
@@ -630,35 +1840,38 @@ std::vector<std::shared_ptr<NodeInfo>> ChordNode::get_replica_nodes(const Hash16
 }
 
 void ChordNode::handle_node_failure(std::shared_ptr<NodeInfo> failed_node) {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    FKVS_INFO("Handling failure of node: " << failed_node->to_string());
     
-    std::cout << "Handling failure of node: " << failed_node->to_string() << std::endl;
-    
-    // Update successor list if failed node is a successor
-    for (size_t i = 0; i < successor_list.size(); ++i) {
-        if (successor_list[i] && *successor_list[i] == *failed_node) {
-            // Remove failed node and shift list
-            for (size_t j = i; j < successor_list.size() - 1; ++j) {
-                successor_list[j] = successor_list[j + 1];
+    bool predecessor_failed = false;
+    update_routing([this, &failed_node, &predecessor_failed](RoutingTable& table) {
+        auto& successors = table.successor_list;
+        
+        // Update successor list if failed node is a successor
+        for (size_t i = 0; i < successors.size(); ++i) {
+            if (successors[i] && *successors[i] == *failed_node) {
+                // Remove failed node and shift list
+                for (size_t j = i; j < successors.size() - 1; ++j) {
+                    successors[j] = successors[j + 1];
+                }
+                
+                // Stabilization refills the tail from the new first successor
+                successors[successors.size() - 1] = self_ptr;
+                break;
             }
-            
-            // Find new successor to fill the list
-            successor_list[successor_list.size() - 1] = find_successor(self_info.id);
-            break;
         }
-    }
-    
-    // Update predecessor if it's the failed node
-    if (predecessor && *predecessor == *failed_node) {
-        predecessor = nullptr;
-        std::cout << "Predecessor failed, will be updated via stabilization" << std::endl;
-    }
-    
-    // Update finger table entries pointing to failed node
-    for (size_t i = 0; i < finger_table.size(); ++i) {
-        if (finger_table[i] && *finger_table[i] == *failed_node) {
-            finger_table[i] = successor_list[0]; // Point to first successor
+        
+        // Update predecessor if it's the failed node
+        if (table.predecessor && *table.predecessor == *failed_node) {
+            table.predecessor = nullptr;
+            predecessor_failed = true;
         }
+        
+        // Update finger table entries pointing to failed node
+        table.fingers.replace(*failed_node, successors[0]); // Point to first successor
+        return true;
+    });
+    if (predecessor_failed) {
+        FKVS_INFO("Predecessor failed, will be updated via stabilization");
     }
     
     // Trigger re-replication for keys that were replicated to the failed node
@@ -666,48 +1879,20 @@ void ChordNode::handle_node_failure(std::shared_ptr<NodeInfo> failed_node) {
 }
 
 void ChordNode::trigger_re_replication() {
-    std::cout << "Triggering re-replication after node failure" << std::endl;
-    
-    // Get all keys from local storage
-    auto all_keys = local_storage->get_all_keys();
-    
-    for (const auto& key : all_keys) {
-        Hash160 key_id = SHA1::hash(key);
-        
-        // Check if we are the primary owner of this key
-        if (is_responsible_for_key(key_id)) {
-            // Get current replica nodes
-            auto replica_nodes = get_replica_nodes(key_id);
-            
-            // Ensure we have enough replicas (REPLICATION_FACTOR - 1)
-            if (replica_nodes.size() < static_cast<size_t>(replication_manager->get_replication_factor() - 1)) {
-                std::vector<uint8_t> value;
-                if (local_storage->get(key, value)) {
-                    // Re-replicate to ensure proper replication factor
-                    for (auto& replica : replica_nodes) {
-                        if (replica && *replica != self_info) {
-                            // Send replication request to replica node
-                            // This would use replication_manager->replicate_put() in full implementation
-                        }
-                    }
-                    
-                    std::cout << "Re-replicated key " << key << " to maintain replication factor" << std::endl;
-                }
-            }
-        }
-    }
+    FKVS_INFO("Triggering re-replication after node failure");
     
-    // Also verify replicas we're holding are still valid
+    // A successor that took the failed node's place in the replica set
+    // differs from us in every leaf we hold; anti-entropy fills it in
     verify_and_repair_replicas();
 }
 
 std::vector<std::shared_ptr<NodeInfo>> ChordNode::get_successor_nodes(int count) const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    RoutingSnapshot table = routing_snapshot();
     
     std::vector<std::shared_ptr<NodeInfo>> successors;
     for (int i = 0; i < count && i < SUCCESSOR_LIST_SIZE; ++i) {
-        if (successor_list[i]) {
-            successors.push_back(successor_list[i]);
+        if (table->successor_list[i]) {
+            successors.push_back(table->successor_list[i]);
         }
     }
     return successors;
@@ -719,12 +1904,12 @@ bool ChordNode::interruptible_sleep(std::chrono::milliseconds duration) {
 }
 
 void ChordNode::print_finger_table() const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    RoutingSnapshot table = routing_snapshot();
     std::cout << "Finger table for node " << self_info.to_string() << ":" << std::endl;
     
     for (int i = 0; i < std::min(10, FINGER_TABLE_SIZE); ++i) {
-        Hash160 start = get_finger_start(i);
-        auto finger = finger_table[i];
+        const Hash160& start = get_finger_start(i);
+        auto finger = table->fingers.get(i);
         std::cout << "  [" << i << "] start=" << SHA1::to_string(start).substr(0, 8)
                   << " -> " << (finger ? finger->to_string() : "null") << std::endl;
     }
@@ -734,11 +1919,11 @@ void ChordNode::print_finger_table() const {
 }
 
 void ChordNode::print_successor_list() const {
-    std::lock_guard<std::mutex> lock(routing_mutex);
+    RoutingSnapshot table = routing_snapshot();
     std::cout << "Successor list for node " << self_info.to_string() << ":" << std::endl;
     
-    for (size_t i = 0; i < successor_list.size(); ++i) {
-        auto successor = successor_list[i];
+    for (size_t i = 0; i < table->successor_list.size(); ++i) {
+        const auto& successor = table->successor_list[i];
         std::cout << "  [" << i << "] " << (successor ? successor->to_string() : "null") << std::endl;
     }
 }
@@ -760,175 +1945,450 @@ bool ChordNode::rpc_ping() {
     return true;
 }
 
-void ChordNode::transfer_keys_to_node(std::shared_ptr<NodeInfo> target_node) {
+bool ChordNode::transfer_keys_to_node(std::shared_ptr<NodeInfo> target_node, bool all_keys,
+                                      std::shared_ptr<NodeInfo> previous) {
     if (!target_node || *target_node == self_info) {
-        return;
+        return false;
+    }
+    if (is_local(*target_node)) {
+        return true; // same storage
     }
     
-    std::cout << "Transferring keys from " << self_info.to_string() 
-              << " to " << target_node->to_string() << std::endl;
+    // Keys we no longer own once target_node is our predecessor are the
+    // ones outside (target, self]; with a single position that is the ring
+    // range (self, target]. Leaving, a single position hands over the
+    // whole ring, (self, self], and one of several its own range.
+    Hash160 boundary = target_node->id;
+    Hash160 range_start;
+    if (all_keys) {
+        auto predecessor = get_predecessor();
+        range_start = host_tokens.size() == 1 ? self_info.id :
+                      predecessor ? predecessor->id : host_range_start(self_info.id);
+    } else {
+        range_start = previous ? previous->id : host_range_start(boundary);
+    }
+    const Hash160& range_end = all_keys ? self_info.id : boundary;
+    // Without the previous predecessor the range may reach into ranges we
+    // replicate, so the new owner gets copies and ours stay
+    bool keep_copies = !all_keys && !previous;
+    
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    
+    std::string peer = target_node->to_string();
+    TransferCheckpoint checkpoint;
+    checkpoint.start = range_start;
+    checkpoint.boundary = boundary;
+    checkpoint.all_keys = all_keys;
+    bool resumed = false;
+    auto saved = transfer_checkpoints.find(peer);
+    if (saved != transfer_checkpoints.end()) {
+        // A checkpoint only applies to the range it was taken over
+        if (saved->second.start == range_start && saved->second.boundary == boundary &&
+            saved->second.all_keys == all_keys) {
+            checkpoint.cursor = saved->second.cursor;
+            resumed = true;
+        }
+        transfer_checkpoints.erase(saved);
+    }
     
-    // Get all keys that should be transferred to the target node
-    auto keys_to_transfer = local_storage->get_keys_in_range([this, &target_node](const std::string& key) {
-        Hash160 key_id = SHA1::hash(key);
+    FKVS_INFO((resumed ? "Resuming key transfer from " : "Transferring keys from ")
+              << self_info.to_string() << " to " << peer);
+    
+    Storage::EntryList chunk;
+    std::vector<Storage::EntryMeta> meta;
+    size_t keys_moved = 0;
+    size_t batches = 0;
+    bool more = true;
+    while (more) {
+        Storage::RangeCursor chunk_start = checkpoint.cursor;
+        more = local_storage->scan_range(checkpoint.cursor, range_start, range_end,
+                                         transfer_batch_keys, transfer_batch_bytes, chunk, &meta);
+        if (chunk.empty()) {
+            continue;
+        }
         
-        // Transfer keys that the target node should be responsible for
-        // This happens when a new node joins between us and our predecessor
-        if (predecessor) {
-            return in_range(key_id, predecessor->id, target_node->id, true);
+        if (!send_transfer_batch(target_node, chunk, meta)) {
+            transfer_failed_batches++;
+            checkpoint.cursor = chunk_start;
+            transfer_checkpoints[peer] = checkpoint;
+            FKVS_INFO("Key transfer to " << peer << " interrupted after " << keys_moved
+                      << " keys; will resume from checkpoint");
+            return false;
         }
-        return false;
-    });
-    
-    // Transfer each key to the target node
-    for (const auto& kvp : keys_to_transfer) {
-        const std::string& key = kvp.first;
-        const std::vector<uint8_t>& value = kvp.second;
         
-        // Send the key-value pair to the target node
-        if (send_key_transfer(target_node, key, value)) {
-            // Only remove from our storage if transfer was successful
-            local_storage->remove(key);
-            std::cout << "Successfully transferred key: " << key << " to " << target_node->to_string() << std::endl;
-        } else {
-            std::cout << "Failed to transfer key: " << key << " to " << target_node->to_string() << std::endl;
+        // Keys rewritten since the scan keep their newer local value; the
+        // write path forwards them to the new owner
+        if (!keep_copies) {
+            local_storage->remove_if_unchanged(chunk);
+        }
+        keys_moved += chunk.size();
+        batches++;
+        transfer_keys_sent += chunk.size();
+        transfer_batches_sent++;
+    }
+    
+    FKVS_INFO("Transferred " << keys_moved << " keys in " << batches
+              << " batches to " << peer);
+    return true;
+}
+
+void ChordNode::receive_transferred_key(const std::string& key, std::vector<uint8_t>&& value,
+                                        uint64_t version, bool compressed, uint64_t expires) {
+    // A write that reached us as the new owner beats the handed-over copy
+    local_storage->apply(key, SHA1::hash(key), std::move(value), version, compressed, expires);
+    transfer_keys_received++;
+}
+
+bool ChordNode::receive_transferred_batch(std::vector<BatchEntry>& entries) {
+    for (const auto& entry : entries) {
+        if (entry.value.size() < 9 ||
+            ((entry.value[8] & Protocol::VALUE_EXPIRES) && entry.value.size() < 17)) {
+            return false;
         }
     }
+    for (auto& entry : entries) {
+        uint64_t version = 0;
+        bool compressed = false;
+        uint64_t expires = 0;
+        Protocol::decodeStored(entry.value, version, compressed, &expires);
+        local_storage->apply(entry.key, SHA1::hash(entry.key), std::move(entry.value), version, compressed,
+                             expires);
+    }
+    transfer_keys_received += entries.size();
+    return local_storage->durable();
+}
+
+void ChordNode::set_transfer_batch_limits(size_t max_keys, size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    transfer_batch_keys = std::max<size_t>(1, max_keys);
+    transfer_batch_bytes = std::max<size_t>(1, max_bytes);
+}
+
+bool ChordNode::has_transfer_checkpoint(const NodeInfo& target) const {
+    std::lock_guard<std::mutex> lock(transfer_mutex);
+    return transfer_checkpoints.count(target.to_string()) > 0;
+}
+
+ChordNode::TransferStats ChordNode::get_transfer_stats() const {
+    TransferStats stats;
+    stats.keys_sent = transfer_keys_sent.load();
+    stats.batches_sent = transfer_batches_sent.load();
+    stats.failed_batches = transfer_failed_batches.load();
+    stats.keys_received = transfer_keys_received.load();
+    return stats;
+}
+
+bool ChordNode::store_replica(const std::string& key, std::vector<uint8_t>&& value, uint64_t version,
+                              bool compressed, uint64_t expires) {
+    return local_storage->apply(key, SHA1::hash(key), std::move(value), version, compressed, expires);
 }
 
+bool ChordNode::remove_replica(const std::string& key, uint64_t version) {
+    return version == 0 ? local_storage->remove(key) : local_storage->apply_remove(key, version);
+}
+
+bool ChordNode::retrieve_replica(const std::string& key, std::vector<uint8_t>& value) const {
+    return local_storage->get(key, value);
+}
+
+bool ChordNode::scan_owned(Storage::RingPosition& from, const std::string& prefix, size_t max_entries,
+                           size_t max_bytes, Storage::EntryList& out, bool& complete,
+                           std::shared_ptr<NodeInfo>& owner) {
+    Hash160 top;
+    top.fill(0xFF);
+    complete = from.started && from.past_id && from.id == top;
+    if (complete) {
+        return true;
+    }
+    Hash160 next{};
+    if (from.started) {
+        next = from.past_id ? add_power_of_two(from.id, 0) : from.id;
+    }
+    ChordNode* position = host_owner(next);
+    if (!position) {
+        owner = find_successor(next);
+        return false;
+    }
+    // The position's range runs up to its id, unless it wraps past the
+    // top of the ring first
+    const Hash160& last = next <= position->self_info.id ? position->self_info.id : top;
+    local_storage->scan_ordered(from, last, prefix, max_entries, max_bytes, out);
+    complete = from.past_id && from.id == top;
+    return true;
+}
 
-void ChordNode::receive_transferred_key(const std::string& key, const std::vector<uint8_t>& value) {
-    // Store the transferred key in local storage
-    local_storage->put(key, value);
-    std::cout << "Received transferred key: " << key << " to " << self_info.to_string() << std::endl;
+bool ChordNode::scan_local(Storage::RingPosition& from, const std::string& prefix, size_t max_entries,
+                           size_t max_bytes, Storage::EntryList& out) const {
+    Hash160 top;
+    top.fill(0xFF);
+    return local_storage->scan_ordered(from, top, prefix, max_entries, max_bytes, out);
 }
 
-bool ChordNode::send_key_transfer(std::shared_ptr<NodeInfo> target, const std::string& key, const std::vector<uint8_t>& value) {
-    if (!target || *target == self_info) {
+bool ChordNode::replica_digest(const std::string& key, uint64_t& digest) const {
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    bool compressed = false;
+    uint64_t expires = 0;
+    if (!local_storage->get_stored(key, value, version, compressed, &expires)) {
         return false;
     }
+    digest = MerkleTree::entry_digest(key.data(), key.size(), value.data(), value.size(), expires);
+    return true;
+}
+
+bool ChordNode::send_transfer_batch(std::shared_ptr<NodeInfo> target, const Storage::EntryList& entries,
+                                    const std::vector<Storage::EntryMeta>& meta) {
+    Storage::EntryList stored;
+    stored.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        stored.push_back(std::make_pair(entries[i].first,
+            Protocol::encodeStored(meta[i].version, meta[i].compressed, entries[i].second, meta[i].expires)));
+    }
+    Request request(OpCode::TRANSFER_BATCH, std::vector<uint8_t>(), Protocol::encodeBatch(stored));
     
-    try {
-        // Create socket connection to target node
-        int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-        if (socket_fd == -1) {
-            return false;
-        }
-        
-        // Set socket timeout
-        struct timeval timeout;
-        timeout.tv_sec = 5;
-        timeout.tv_usec = 0;
-        setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-        setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-        
-        // Connect to target node
-        struct sockaddr_in server_addr;
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(target->port);
-        
-        if (inet_pton(AF_INET, target->address.c_str(), &server_addr.sin_addr) <= 0) {
-            close(socket_fd);
-            return false;
-        }
-        
-        if (connect(socket_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
-            close(socket_fd);
-            return false;
-        }
-        
-        // Create and send transfer request
-        Request request;
-        request.opcode = OpCode::TRANSFER_KEY;
-        request.key.assign(key.begin(), key.end());
-        request.value = value;
-        
-        std::vector<uint8_t> request_data = Protocol::encodeRequest(request);
-        
-        if (send(socket_fd, request_data.data(), request_data.size(), 0) == -1) {
-            close(socket_fd);
-            return false;
+    for (int attempt = 0; attempt < TRANSFER_MAX_ATTEMPTS; ++attempt) {
+        if (attempt > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100 << attempt));
         }
-        
-        // Read response
-        uint8_t response_buffer[1024];
-        ssize_t bytes_received = recv(socket_fd, response_buffer, sizeof(response_buffer), 0);
-        
-        close(socket_fd);
-        
-        if (bytes_received > 0) {
+        try {
             Response response;
-            if (Protocol::decodeResponse(std::vector<uint8_t>(response_buffer, response_buffer + bytes_received), response)) {
-                return response.status == StatusCode::SUCCESS;
+            bool delivered = ConnectionPool::instance().call(target->address, target->port,
+                [&request, &response](Client& client) { return client.call(request, response); });
+            if (delivered && response.status == StatusCode::SUCCESS) {
+                return true;
             }
+        } catch (const std::exception&) {
         }
-        
-        return false;
+    }
+    return false;
+}
+
+bool ChordNode::call_node(const NodeInfo& node, const Request& request, Response& response) {
+    try {
+        return ConnectionPool::instance().call(node.address, node.port,
+            [&request, &response](Client& client) { return client.call(request, response); }) &&
+            response.status == StatusCode::SUCCESS;
     } catch (const std::exception&) {
         return false;
     }
 }
 
 void ChordNode::verify_and_repair_replicas() {
-    std::cout << "Verifying and repairing replicas" << std::endl;
-    
-    // Get all keys from local storage
-    auto all_data = local_storage->get_all_data();
+    RoutingSnapshot table = routing_snapshot();
+    if (!table->predecessor) {
+        return; // alone, or just joined and owning nothing yet
+    }
+    if (std::chrono::steady_clock::now() - table->predecessor_since < anti_entropy_interval) {
+        FKVS_DEBUG("Anti-entropy deferred: predecessor of " << self_info.to_string()
+                   << " changed recently");
+        return;
+    }
     
-    for (const auto& kvp : all_data) {
-        const std::string& key = kvp.first;
-        const std::vector<uint8_t>& value = kvp.second;
-        Hash160 key_id = SHA1::hash(key);
-        
-        // Check if this is a replica we're holding
-        auto responsible_node = find_successor(key_id);
+    Hash160 start = table->predecessor->id;
+    for (const auto& replica : get_replica_nodes(self_info.id)) {
+        if (!running.load()) {
+            return;
+        }
+        long repaired = repair_range(*replica, start, self_info.id);
+        if (repaired < 0) {
+            FKVS_WARN("Anti-entropy with " << replica->to_string() << " failed");
+        } else if (repaired > 0) {
+            FKVS_INFO("Anti-entropy repaired " << repaired << " keys on " << replica->to_string());
+        }
+    }
+}
+
+long ChordNode::repair_range(const NodeInfo& replica, const Hash160& start, const Hash160& end) {
+    std::vector<uint8_t> range(start.begin(), start.end());
+    range.insert(range.end(), end.begin(), end.end());
+    repair_rounds++;
+    
+    // Descend level by level, keeping only nodes whose digests differ
+    std::vector<uint32_t> nodes(1, 0);
+    std::vector<uint32_t> differing;
+    for (int level = 0; level <= MerkleTree::DEPTH; ++level) {
+        std::vector<uint64_t> local;
+        std::vector<uint64_t> remote;
+        local_storage->range_digests(start, end, level, nodes, local);
+        Request request(OpCode::MERKLE_DIGESTS, range,
+                        Protocol::encodeTreeNodes(static_cast<uint8_t>(level), nodes));
+        Response response;
+        if (!call_node(replica, request, response) ||
+            !Protocol::decodeDigests(response.value.data(), response.value.size(), remote) ||
+            remote.size() != nodes.size()) {
+            return -1;
+        }
         
-        if (responsible_node && *responsible_node != self_info) {
-            // This is a replica we're holding
-            // Verify the primary node is still alive
-            if (!ping_node(responsible_node)) {
-                // Primary node is down, check if we should become the primary
-                auto our_predecessor = get_predecessor();
-                if (our_predecessor && in_range(key_id, our_predecessor->id, self_info.id, true)) {
-                    // We are now the primary owner
-                    std::cout << "Taking ownership of key " << key << " (previous owner failed)" << std::endl;
-                    
-                    // Re-replicate to maintain replication factor
-                    auto replica_nodes = get_replica_nodes(key_id);
-                    for (auto& replica : replica_nodes) {
-                        if (replica && *replica != self_info) {
-                            // Send replication request to replica node
-                            // This would use replication_manager->replicate_put() in full implementation
-                        }
-                    }
-                }
+        differing.clear();
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (local[i] != remote[i]) {
+                differing.push_back(nodes[i]);
             }
-        } else if (responsible_node && *responsible_node == self_info) {
-            // We are the primary owner, ensure proper replication
-            auto replica_nodes = get_replica_nodes(key_id);
-            int alive_replicas = 0;
-            
-            for (auto& replica : replica_nodes) {
-                if (replica && *replica != self_info && ping_node(replica)) {
-                    alive_replicas++;
+        }
+        if (differing.empty()) {
+            return 0;
+        }
+        if (level < MerkleTree::DEPTH) {
+            nodes.clear();
+            for (uint32_t parent : differing) {
+                for (uint32_t child = 0; child < MerkleTree::FANOUT; ++child) {
+                    nodes.push_back((parent << MerkleTree::FANOUT_BITS) + child);
                 }
             }
-            
-            // If we don't have enough alive replicas, find new ones
-            if (alive_replicas < replication_manager->get_replication_factor() - 1) {
-                std::cout << "Insufficient replicas for key " << key 
-                          << " (" << alive_replicas << " alive), re-replicating" << std::endl;
-                
-                // Re-replicate to new nodes
-                for (auto& replica : replica_nodes) {
-                    if (replica && *replica != self_info) {
-                        // Send replication request to replica node
-                        // This would use replication_manager->replicate_put() in full implementation
-                    }
-                }
+        }
+    }
+    repair_leaves += differing.size();
+    
+    // Compare the differing leaves key by key and send what differs
+    long repaired = 0;
+    for (size_t first = 0; first < differing.size(); first += REPAIR_LEAVES_PER_CALL) {
+        std::vector<uint32_t> leaves(differing.begin() + first,
+            differing.begin() + std::min(differing.size(), first + REPAIR_LEAVES_PER_CALL));
+        Request request(OpCode::MERKLE_KEYS, range,
+                        Protocol::encodeTreeNodes(MerkleTree::DEPTH, leaves));
+        Response response;
+        std::vector<BatchEntry> theirs;
+        if (!call_node(replica, request, response) ||
+            !Protocol::decodeBatch(response.value.data(), response.value.size(), theirs)) {
+            return -1;
+        }
+        std::unordered_map<std::string, uint64_t> remote;
+        for (const auto& entry : theirs) {
+            if (entry.value.size() == 8) {
+                remote[entry.key] = Protocol::decodeDigest(entry.value.data());
+            }
+        }
+        
+        Storage::DigestList ours;
+        local_storage->leaf_digests(start, end, leaves, ours);
+        std::vector<BatchEntry> repairs;
+        size_t bytes = 0;
+        size_t pushed = 0;
+        size_t deleted = 0;
+        auto flush = [&]() {
+            if (repairs.empty()) {
+                return true;
+            }
+            if (!send_repair(replica, repairs)) {
+                return false;
+            }
+            repair_keys_pushed += pushed;
+            repair_keys_deleted += deleted;
+            repaired += static_cast<long>(pushed + deleted);
+            repairs.clear();
+            bytes = pushed = deleted = 0;
+            return true;
+        };
+        auto add = [&](const std::string& key, bool put, uint64_t version, bool compressed,
+                       uint64_t expires, std::vector<uint8_t>& value) {
+            repairs.push_back(BatchEntry());
+            repairs.back().key = key;
+            repairs.back().value = Protocol::encodeStored(version, compressed, value, expires);
+            repairs.back().value.insert(repairs.back().value.begin(), put ? 1 : 0);
+            bytes += key.size() + repairs.back().value.size();
+            (put ? pushed : deleted)++;
+            if (repairs.size() < transfer_batch_keys && bytes < transfer_batch_bytes) {
+                return true;
+            }
+            return flush();
+        };
+        
+        std::vector<uint8_t> value;
+        uint64_t version = 0;
+        bool compressed = false;
+        uint64_t expires = 0;
+        for (const auto& entry : ours) {
+            auto it = remote.find(entry.first);
+            bool same = it != remote.end() && it->second == entry.second;
+            if (it != remote.end()) {
+                remote.erase(it);
             }
+            if (same) {
+                continue;
+            }
+            // Deleted since the leaf was listed: nothing to push, and the
+            // delete already went to the replicas
+            if (!local_storage->get_stored(entry.first, value, version, compressed, &expires)) {
+                continue;
+            }
+            if (!add(entry.first, true, version, compressed, expires, value)) {
+                return -1;
+            }
+        }
+        value.clear();
+        for (const auto& extra : remote) {
+            // Only a delete we remember goes out, at its version, so the
+            // replica keeps a write made after it. Without a tombstone the
+            // key may be a PUT that reached the replica before our store:
+            // it is left alone.
+            uint64_t deleted_at = local_storage->tombstone(extra.first);
+            if (deleted_at == 0) {
+                continue;
+            }
+            if (!add(extra.first, false, deleted_at, false, 0, value)) {
+                return -1;
+            }
+        }
+        if (!flush()) {
+            return -1;
+        }
+    }
+    return repaired;
+}
+
+bool ChordNode::send_repair(const NodeInfo& replica, const std::vector<BatchEntry>& entries) {
+    Request request(OpCode::REPAIR, std::vector<uint8_t>(), Protocol::encodeBatch(entries));
+    Response response;
+    return call_node(replica, request, response);
+}
+
+void ChordNode::merkle_digests(const Hash160& start, const Hash160& end, int level,
+                               const std::vector<uint32_t>& indices,
+                               std::vector<uint64_t>& digests) const {
+    local_storage->range_digests(start, end, level, indices, digests);
+}
+
+void ChordNode::merkle_keys(const Hash160& start, const Hash160& end,
+                            const std::vector<uint32_t>& leaves, Storage::DigestList& out) const {
+    local_storage->leaf_digests(start, end, leaves, out);
+}
+
+bool ChordNode::apply_repair(const std::vector<BatchEntry>& entries) {
+    for (const auto& entry : entries) {
+        if (entry.value.size() < 10 ||
+            ((entry.value[9] & Protocol::VALUE_EXPIRES) && entry.value.size() < 18)) {
+            return false;
+        }
+    }
+    // The owner's copy is applied by version like any replicated write:
+    // a newer write already here (a PUT still on its way to the owner's
+    // store) is kept, and a delete, sent at the owner's tombstone, only
+    // removes what it is newer than
+    for (const auto& entry : entries) {
+        std::vector<uint8_t> value(entry.value.begin() + 1, entry.value.end());
+        uint64_t version = 0;
+        bool compressed = false;
+        uint64_t expires = 0;
+        Protocol::decodeStored(value, version, compressed, &expires);
+        if (entry.value[0]) {
+            local_storage->apply(entry.key, SHA1::hash(entry.key), std::move(value), version, compressed,
+                                 expires);
+        } else {
+            local_storage->apply_remove(entry.key, version);
         }
     }
+    repair_keys_applied += entries.size();
+    return true;
+}
+
+ChordNode::RepairStats ChordNode::get_repair_stats() const {
+    RepairStats stats;
+    stats.rounds = repair_rounds.load();
+    stats.leaves = repair_leaves.load();
+    stats.keys_pushed = repair_keys_pushed.load();
+    stats.keys_deleted = repair_keys_deleted.load();
+    stats.keys_applied = repair_keys_applied.load();
+    return stats;
 }
 
 } // namespace funnelkvs
\ No newline at end of file
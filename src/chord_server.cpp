@@ -1,34 +1,91 @@
 #include "chord_server.h"
-#include <iostream>
+#include "connection_pool.h"
+#include "logger.h"
+#include <algorithm>
+#include <future>
 
 namespace funnelkvs {
 
-ChordServer::ChordServer(const std::string& address, uint16_t port, size_t num_threads)
-    : Server(port, num_threads)
+ChordServer::ChordServer(const std::string& address, uint16_t port, size_t num_threads,
+                         size_t num_event_loops)
+    : Server(port, num_threads, num_event_loops)
     , chord_enabled(false)
 {
     setup_chord_node(address);
 }
 
 ChordServer::~ChordServer() {
-    if (chord_enabled && chord_node) {
-        chord_node->stop_maintenance();
+    if (chord_enabled) {
+        for (ChordNode* token : tokens) {
+            token->stop_maintenance();
+        }
     }
 }
 
 void ChordServer::setup_chord_node(const std::string& address) {
     chord_node = std::unique_ptr<ChordNode>(new ChordNode(address, port));
+    tokens.assign(1, chord_node.get());
+}
+
+void ChordServer::set_tokens(size_t count) {
+    if (!chord_node || chord_enabled) {
+        FKVS_ERROR("Ring positions can only be set before the node joins a ring");
+        return;
+    }
+    count = std::max<size_t>(1, std::min<size_t>(count, 65535));
+    
+    extra_tokens.clear();
+    tokens.assign(1, chord_node.get());
+    for (size_t i = 1; i < count; ++i) {
+        extra_tokens.push_back(chord_node->make_token(static_cast<uint16_t>(i)));
+        tokens.push_back(extra_tokens.back().get());
+    }
+    std::sort(tokens.begin(), tokens.end(), [](const ChordNode* a, const ChordNode* b) {
+        return a->get_info().id < b->get_info().id;
+    });
+    for (ChordNode* token : tokens) {
+        token->set_host_tokens(tokens);
+    }
+}
+
+ChordNode* ChordServer::token_for(const Request& request) const {
+    if (request.key.empty()) {
+        return chord_node.get();
+    }
+    if (request.key.size() != 20) {
+        return nullptr;
+    }
+    Hash160 id;
+    std::copy(request.key.begin(), request.key.end(), id.begin());
+    for (ChordNode* token : tokens) {
+        if (token->get_info().id == id) {
+            return token;
+        }
+    }
+    return nullptr;
+}
+
+ChordNode* ChordServer::lookup_token(const Hash160& id) const {
+    if (ChordNode* owner = chord_node->host_owner(id)) {
+        return owner;
+    }
+    // Otherwise the position nearest before id is the closest to it
+    auto it = std::lower_bound(tokens.begin(), tokens.end(), id,
+        [](const ChordNode* token, const Hash160& value) { return token->get_info().id < value; });
+    return it == tokens.begin() ? tokens.back() : *std::prev(it);
 }
 
 void ChordServer::enable_chord() {
     if (!chord_node) {
-        std::cerr << "Chord node not initialized" << std::endl;
+        FKVS_ERROR("Chord node not initialized");
         return;
     }
     
     chord_enabled = true;
-    chord_node->start_maintenance();
-    std::cout << "Chord DHT enabled for node " << chord_node->get_info().to_string() << std::endl;
+    for (ChordNode* token : tokens) {
+        token->start_maintenance();
+    }
+    FKVS_INFO("Chord DHT enabled for node " << chord_node->get_info().to_string());
 }
 
 void ChordServer::disable_chord() {
@@ -36,25 +93,39 @@ void ChordServer::disable_chord() {
         return;
     }
     
-    chord_node->stop_maintenance();
+    for (ChordNode* token : tokens) {
+        token->stop_maintenance();
+    }
     chord_enabled = false;
-    std::cout << "Chord DHT disabled" << std::endl;
+    FKVS_INFO("Chord DHT disabled");
 }
 
 void ChordServer::create_ring() {
     if (!chord_node) {
-        std::cerr << "Chord node not initialized" << std::endl;
+        FKVS_ERROR("Chord node not initialized");
         return;
     }
     
-    chord_node->create();
+    if (tokens.size() > 1) {
+        // Our positions make up the whole ring, so they can be linked up
+        // directly instead of through stabilization
+        std::vector<NodeInfo> positions;
+        for (ChordNode* token : tokens) {
+            positions.push_back(token->get_info());
+        }
+        for (ChordNode* token : tokens) {
+            token->create_among(positions);
+        }
+    } else {
+        chord_node->create();
+    }
     enable_chord();
-    std::cout << "Created new Chord ring" << std::endl;
+    FKVS_INFO("Created new Chord ring");
 }
 
 void ChordServer::join_ring(const std::string& known_address, uint16_t known_port) {
     if (!chord_node) {
-        std::cerr << "Chord node not initialized" << std::endl;
+        FKVS_ERROR("Chord node not initialized");
         return;
     }
     
@@ -62,9 +133,17 @@ void ChordServer::join_ring(const std::string& known_address, uint16_t known_por
         NodeInfo::from_address(known_address, known_port)
     );
     
-    chord_node->join(known_node);
+    // Every position joins on its own; each then takes its range from its
+    // own successor, so the data arrives from many servers at once
+    std::vector<std::future<void>> joins;
+    for (ChordNode* token : tokens) {
+        joins.push_back(std::async(std::launch::async, [token, &known_node] { token->join(known_node); }));
+    }
+    for (auto& join : joins) {
+        join.get();
+    }
     enable_chord();
-    std::cout << "Joined Chord ring via " << known_node->to_string() << std::endl;
+    FKVS_INFO("Joined Chord ring via " << known_node->to_string());
 }
 
 void ChordServer::leave_ring() {
@@ -72,9 +151,16 @@ void ChordServer::leave_ring() {
         return;
     }
     
-    chord_node->leave();
+    // Each position hands its range to its own successor, all at once
+    std::vector<std::future<void>> leaves;
+    for (ChordNode* token : tokens) {
+        leaves.push_back(std::async(std::launch::async, [token] { token->leave(); }));
+    }
+    for (auto& leave : leaves) {
+        leave.get();
+    }
     disable_chord();
-    std::cout << "Left Chord ring" << std::endl;
+    FKVS_INFO("Left Chord ring");
 }
 
 NodeInfo ChordServer::get_node_info() const {
@@ -84,6 +170,62 @@ NodeInfo ChordServer::get_node_info() const {
     return NodeInfo{};
 }
 
+ChordNode::LookupStats ChordServer::get_lookup_stats() const {
+    if (chord_node) {
+        return chord_node->get_lookup_stats();
+    }
+    return ChordNode::LookupStats();
+}
+
+void ChordServer::enable_persistence(const std::string& directory) {
+    if (!chord_node) {
+        FKVS_ERROR("Chord node not initialized");
+        return;
+    }
+    chord_node->enable_persistence(directory);
+}
+
+void ChordServer::enable_cold_tier(const std::string& directory, size_t hot_bytes) {
+    if (!chord_node) {
+        FKVS_ERROR("Chord node not initialized");
+        return;
+    }
+    chord_node->enable_cold_tier(directory, hot_bytes);
+}
+
+void ChordServer::set_compression(size_t threshold) {
+    storage.set_compression(threshold);
+    if (chord_node) {
+        chord_node->set_compression(threshold);
+    }
+}
+
+void ChordServer::set_read_cache_capacity(size_t bytes) {
+    if (!chord_node) {
+        FKVS_ERROR("Chord node not initialized");
+        return;
+    }
+    chord_node->set_read_cache_capacity(bytes);
+}
+
+ReadCache::Stats ChordServer::get_read_cache_stats() const {
+    return chord_node ? chord_node->get_read_cache_stats() : ReadCache::Stats();
+}
+
+Storage::MemoryStats ChordServer::get_memory_stats() const {
+    if (chord_node) {
+        return chord_node->get_memory_stats();
+    }
+    return storage.memory_stats();
+}
+
+void ChordServer::collect_stats(StatsReport& report) const {
+    Server::collect_stats(report);
+    if (chord_node) {
+        chord_node->collect_stats(report);
+    }
+}
+
 void ChordServer::start() {
     // Start the base server first
     Server::start();
@@ -99,19 +241,14 @@ void ChordServer::stop() {
     Server::stop();
 }
 
-void ChordServer::process_request(int client_fd, const Request& request) {
-    Response response;
-    
-    if (handle_chord_operation(request, response)) {
-        std::vector<uint8_t> encoded = Protocol::encodeResponse(response);
-        send_data(client_fd, encoded);
-    } else {
+void ChordServer::process_request(Request& request, Response& response) {
+    if (!handle_chord_operation(request, response)) {
         // Handle as regular storage operation
-        Server::process_request(client_fd, request);
+        Server::process_request(request, response);
     }
 }
 
-bool ChordServer::handle_chord_operation(const Request& request, Response& response) {
+bool ChordServer::handle_chord_operation(Request& request, Response& response) {
     if (!chord_enabled || !chord_node) {
         return false;
     }
@@ -126,10 +263,10 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
             Hash160 target_id;
             std::copy(request.key.begin(), request.key.end(), target_id.begin());
             
-            auto successor = chord_node->find_successor(target_id);
+            auto successor = lookup_token(target_id)->find_successor(target_id);
             if (successor) {
                 // Encode NodeInfo in response value
-                std::string node_str = successor->address + ":" + std::to_string(successor->port);
+                std::string node_str = successor->endpoint();
                 response.value.assign(node_str.begin(), node_str.end());
                 response.status = StatusCode::SUCCESS;
             } else {
@@ -138,10 +275,16 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
             return true;
         }
         
+        // key: optionally the id of the ring position asked
         case OpCode::GET_PREDECESSOR: {
-            auto predecessor = chord_node->get_predecessor();
+            ChordNode* token = token_for(request);
+            if (!token) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            auto predecessor = token->get_predecessor();
             if (predecessor) {
-                std::string node_str = predecessor->address + ":" + std::to_string(predecessor->port);
+                std::string node_str = predecessor->endpoint();
                 response.value.assign(node_str.begin(), node_str.end());
                 response.status = StatusCode::SUCCESS;
             } else {
@@ -151,9 +294,14 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
         }
         
         case OpCode::GET_SUCCESSOR: {
-            auto successor = chord_node->get_successor();
+            ChordNode* token = token_for(request);
+            if (!token) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            auto successor = token->get_successor();
             if (successor) {
-                std::string node_str = successor->address + ":" + std::to_string(successor->port);
+                std::string node_str = successor->endpoint();
                 response.value.assign(node_str.begin(), node_str.end());
                 response.status = StatusCode::SUCCESS;
             } else {
@@ -162,24 +310,85 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
             return true;
         }
         
-        case OpCode::NOTIFY: {
-            if (request.value.size() > 0) {
-                std::string node_str(request.value.begin(), request.value.end());
-                size_t colon_pos = node_str.find(':');
-                if (colon_pos != std::string::npos) {
-                    std::string addr = node_str.substr(0, colon_pos);
-                    uint16_t port = static_cast<uint16_t>(std::stoi(node_str.substr(colon_pos + 1)));
-                    auto node = std::make_shared<NodeInfo>(NodeInfo::from_address(addr, port));
-                    chord_node->notify(node);
+        case OpCode::CLOSEST_PRECEDING_NODE: {
+            if (request.key.size() != 20) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            
+            Hash160 target_id;
+            std::copy(request.key.begin(), request.key.end(), target_id.begin());
+            
+            // value: Final(1) followed by the node list
+            bool final = false;
+            std::vector<std::shared_ptr<NodeInfo>> nodes;
+            lookup_token(target_id)->lookup_step(target_id, final, nodes);
+            std::vector<std::string> endpoints;
+            for (const auto& node : nodes) {
+                endpoints.push_back(node->endpoint());
+            }
+            response.value.push_back(final ? 1 : 0);
+            std::vector<uint8_t> list = Protocol::encodeNodeList(endpoints);
+            response.value.insert(response.value.end(), list.begin(), list.end());
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::GET_SUCCESSOR_LIST: {
+            ChordNode* token = token_for(request);
+            if (!token) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            std::vector<std::string> endpoints;
+            for (const auto& node : token->get_successor_list()) {
+                if (node) {
+                    endpoints.push_back(node->endpoint());
                 }
             }
+            response.value = Protocol::encodeNodeList(endpoints);
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::GET_ROUTING: {
+            ChordNode* token = token_for(request);
+            if (!token) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            std::vector<std::shared_ptr<NodeInfo>> successors;
+            std::vector<std::shared_ptr<NodeInfo>> fingers;
+            token->get_routing_nodes(successors, fingers);
+            std::vector<std::string> endpoints;
+            for (const auto& node : successors) {
+                endpoints.push_back(node->endpoint());
+            }
+            for (const auto& node : fingers) {
+                endpoints.push_back(node->endpoint());
+            }
+            response.value.push_back(static_cast<uint8_t>(successors.size()));
+            std::vector<uint8_t> list = Protocol::encodeNodeList(endpoints);
+            response.value.insert(response.value.end(), list.begin(), list.end());
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::NOTIFY: {
+            std::string node_str(request.value.begin(), request.value.end());
+            NodeInfo node;
+            ChordNode* token = token_for(request);
+            if (!token || !NodeInfo::parse(node_str, node)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            token->notify(std::make_shared<NodeInfo>(node));
             response.status = StatusCode::SUCCESS;
             return true;
         }
         
         case OpCode::NODE_INFO: {
-            NodeInfo info = chord_node->get_info();
-            std::string node_str = info.address + ":" + std::to_string(info.port);
+            std::string node_str = chord_node->get_info().endpoint();
             response.value.assign(node_str.begin(), node_str.end());
             response.status = StatusCode::SUCCESS;
             return true;
@@ -188,7 +397,147 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
         case OpCode::TRANSFER_KEY: {
             // Key transfer operation - store the received key-value pair
             std::string key_str(request.key.begin(), request.key.end());
-            chord_node->receive_transferred_key(key_str, request.value);
+            uint64_t version = 0;
+            bool compressed = false;
+            uint64_t expires = 0;
+            if (!Protocol::decodeStored(request.value, version, compressed, &expires)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            chord_node->receive_transferred_key(key_str, std::move(request.value), version, compressed, expires);
+            response.status = chord_node->durable() ? StatusCode::SUCCESS : StatusCode::ERROR;
+            return true;
+        }
+        
+        case OpCode::TRANSFER_BATCH: {
+            // One chunk of a streamed range handoff
+            std::vector<BatchEntry> entries;
+            if (!Protocol::decodeBatch(request.value.data(), request.value.size(), entries) ||
+                !chord_node->receive_transferred_batch(entries)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::REPLICATE: {
+            // A write older than the copy held is acknowledged all the
+            // same: the replica already has what it would have become
+            std::string key_str(request.key.begin(), request.key.end());
+            uint64_t version = 0;
+            bool compressed = false;
+            uint64_t expires = 0;
+            if (!Protocol::decodeStored(request.value, version, compressed, &expires)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            chord_node->store_replica(key_str, std::move(request.value), version, compressed, expires);
+            response.status = chord_node->durable() ? StatusCode::SUCCESS : StatusCode::ERROR;
+            return true;
+        }
+        
+        case OpCode::REPLICATE_DELETE: {
+            std::string key_str(request.key.begin(), request.key.end());
+            uint64_t version = 0;
+            if (!request.value.empty() && !Protocol::decodeVersioned(request.value, version)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            if (!chord_node->remove_replica(key_str, version)) {
+                response.status = StatusCode::KEY_NOT_FOUND;
+            } else {
+                response.status = chord_node->durable() ? StatusCode::SUCCESS : StatusCode::ERROR;
+            }
+            return true;
+        }
+        
+        case OpCode::REPLICATE_GET: {
+            std::string key_str(request.key.begin(), request.key.end());
+            if (request.value.size() == 1 && request.value[0] == 1) {
+                // Digest mode, for quorum reads: over the stored bytes,
+                // as the owner computes it
+                uint64_t digest = 0;
+                if (!chord_node->replica_digest(key_str, digest)) {
+                    response.status = StatusCode::KEY_NOT_FOUND;
+                    return true;
+                }
+                response.value.resize(8);
+                Protocol::encodeDigest(digest, response.value.data());
+            } else if (!chord_node->retrieve_replica(key_str, response.value)) {
+                response.status = StatusCode::KEY_NOT_FOUND;
+                return true;
+            }
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::MERKLE_DIGESTS:
+        case OpCode::MERKLE_KEYS: {
+            // key: the ring range, Start(20) End(20)
+            uint8_t level = 0;
+            std::vector<uint32_t> indices;
+            if (request.key.size() != 40 ||
+                !Protocol::decodeTreeNodes(request.value.data(), request.value.size(), level, indices)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            Hash160 start;
+            Hash160 end;
+            std::copy(request.key.begin(), request.key.begin() + 20, start.begin());
+            std::copy(request.key.begin() + 20, request.key.end(), end.begin());
+            
+            if (request.opcode == OpCode::MERKLE_DIGESTS) {
+                std::vector<uint64_t> digests;
+                chord_node->merkle_digests(start, end, level, indices, digests);
+                response.value = Protocol::encodeDigests(digests);
+            } else {
+                Storage::DigestList keys;
+                chord_node->merkle_keys(start, end, indices, keys);
+                Storage::EntryList entries;
+                entries.reserve(keys.size());
+                for (const auto& key : keys) {
+                    std::vector<uint8_t> digest(8);
+                    Protocol::encodeDigest(key.second, digest.data());
+                    entries.push_back(std::make_pair(key.first, std::move(digest)));
+                }
+                response.value = Protocol::encodeBatch(entries);
+            }
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::REPAIR: {
+            std::vector<BatchEntry> entries;
+            if (!Protocol::decodeBatch(request.value.data(), request.value.size(), entries) ||
+                !chord_node->apply_repair(entries)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::GET_LEASED: {
+            // value: the requester, who may cache the reply for LeaseMs
+            std::string key_str(request.key.begin(), request.key.end());
+            std::string holder(request.value.begin(), request.value.end());
+            std::vector<uint8_t> value;
+            uint32_t lease_ms = 0;
+            if (!chord_node->retrieve_leased(key_str, holder, value, lease_ms)) {
+                response.status = StatusCode::KEY_NOT_FOUND;
+                return true;
+            }
+            response.value.resize(4);
+            Protocol::encodeLength(lease_ms, response.value.data());
+            response.value.insert(response.value.end(), value.begin(), value.end());
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::INVALIDATE: {
+            std::string key_str(request.key.begin(), request.key.end());
+            chord_node->invalidate_cached(key_str);
             response.status = StatusCode::SUCCESS;
             return true;
         }
@@ -198,48 +547,167 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
             // Schedule shutdown in a separate thread to allow response to be sent
             std::thread shutdown_thread([this]() {
                 std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                std::cout << "Admin shutdown requested. Stopping server..." << std::endl;
+                FKVS_INFO("Admin shutdown requested. Stopping server...");
                 this->stop();
             });
             shutdown_thread.detach();
             return true;
         }
         
+        case OpCode::MULTI_GET:
+        case OpCode::MULTI_PUT:
+        case OpCode::MULTI_DELETE: {
+            // Coordinate the batch: split by owner, forward, merge
+            std::vector<BatchEntry> entries;
+            if (!Protocol::decodeBatch(request.value.data(), request.value.size(), entries)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            std::vector<BatchResult> results;
+            bool forwarded = request.key.size() == 1 && request.key[0] == Protocol::BATCH_FORWARDED;
+            chord_node->execute_batch(request.opcode, entries, results, forwarded);
+            response.value = Protocol::encodeBatchResults(results);
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
+        case OpCode::SCAN: {
+            uint8_t flags = 0;
+            uint32_t max_entries = 0;
+            uint32_t max_bytes = 0;
+            std::vector<uint8_t> cursor;
+            Storage::RingPosition position;
+            if (!Protocol::decodeScanRequest(request.value.data(), request.value.size(), flags,
+                                             max_entries, max_bytes, cursor) ||
+                !position.parse(cursor)) {
+                response.status = StatusCode::ERROR;
+                return true;
+            }
+            std::string prefix(request.key.begin(), request.key.end());
+            Storage::EntryList entries;
+            bool more = false;
+            if (flags & Protocol::SCAN_LOCAL) {
+                more = chord_node->scan_local(position, prefix, max_entries, max_bytes, entries);
+            } else {
+                bool complete = false;
+                std::shared_ptr<NodeInfo> owner;
+                if (!chord_node->scan_owned(position, prefix, max_entries, max_bytes, entries,
+                                            complete, owner)) {
+                    // The position belongs to another server; an owner on
+                    // this one means the ring is still settling
+                    if (!owner || owner->same_host(chord_node->get_info())) {
+                        response.status = StatusCode::ERROR;
+                        return true;
+                    }
+                    response.status = StatusCode::REDIRECT;
+                    std::string node_str = owner->endpoint();
+                    response.value.assign(node_str.begin(), node_str.end());
+                    return true;
+                }
+                more = !complete;
+            }
+            response.value = Protocol::encodeScanReply(more ? position.token() : std::vector<uint8_t>(),
+                                                       entries);
+            response.status = StatusCode::SUCCESS;
+            return true;
+        }
+        
         case OpCode::GET:
         case OpCode::PUT:
-        case OpCode::DELETE: {
+        case OpCode::PUT_TTL:
+        case OpCode::DELETE:
+        case OpCode::CAS:
+        case OpCode::GET_VERSIONED: {
             // Handle distributed storage operations
             std::string key(request.key.begin(), request.key.end());
             Hash160 key_id = SHA1::hash(key);
             
-            if (!chord_node->is_responsible_for_key(key_id)) {
+            // A GET that accepts the compressed form gets it, flagged,
+            // wherever the value is read in that form
+            bool* compressed = request.opcode == OpCode::GET && request.compressed ?
+                &response.compressed : nullptr;
+            ReadConsistency consistency = ReadConsistency::PRIMARY;
+            if (request.opcode == OpCode::GET) {
+                if (!Protocol::decodeReadConsistency(request.value, consistency)) {
+                    response.status = StatusCode::ERROR;
+                    return true;
+                }
+                // A replica answers from its own copy; without one the
+                // read goes to the owner like any other
+                if (consistency == ReadConsistency::ANY &&
+                    chord_node->retrieve_copy(key, key_id, response.value, compressed)) {
+                    response.status = StatusCode::SUCCESS;
+                    return true;
+                }
+            }
+            
+            // Hot keys owned elsewhere are read through this node's cache
+            // instead of sending every client to their owner. Quorum reads
+            // always go to the owner.
+            if (!chord_node->is_responsible_for_key(key_id) &&
+                !(request.opcode == OpCode::GET && consistency != ReadConsistency::QUORUM &&
+                  chord_node->forwards_read(key))) {
                 // Forward to responsible node
                 auto responsible = chord_node->find_successor(key_id);
-                if (responsible && *responsible != chord_node->get_info()) {
+                if (responsible && !responsible->same_host(chord_node->get_info())) {
                     response.status = StatusCode::REDIRECT;
-                    std::string node_str = responsible->address + ":" + std::to_string(responsible->port);
+                    std::string node_str = responsible->endpoint();
                     response.value.assign(node_str.begin(), node_str.end());
                     return true;
                 }
             }
             
             // Handle locally
-            if (request.opcode == OpCode::GET) {
-                std::vector<uint8_t> value;
-                if (chord_node->retrieve_key(key, value)) {
+            if (request.opcode == OpCode::GET && consistency == ReadConsistency::QUORUM) {
+                response.status = chord_node->retrieve_quorum(key, key_id, response.value, compressed);
+            } else if (request.opcode == OpCode::GET) {
+                if (chord_node->retrieve_key(key, key_id, response.value, compressed)) {
                     response.status = StatusCode::SUCCESS;
-                    response.value = value;
                 } else {
                     response.status = StatusCode::KEY_NOT_FOUND;
                 }
-            } else if (request.opcode == OpCode::PUT) {
-                if (chord_node->store_key(key, request.value)) {
+            } else if (request.opcode == OpCode::PUT || request.opcode == OpCode::PUT_TTL) {
+                // A value that arrives compressed is checked once, here,
+                // and stored and forwarded as it is from then on
+                uint64_t ttl = 0;
+                std::vector<uint8_t> raw;
+                if ((request.opcode == OpCode::PUT_TTL && !Protocol::decodeTtl(request.value, ttl)) ||
+                    (request.compressed && !Compression::decompress(request.value, raw))) {
+                    response.status = StatusCode::ERROR;
+                    return true;
+                }
+                if (chord_node->store_key(key, key_id, std::move(request.value), request.compressed, ttl)) {
                     response.status = StatusCode::SUCCESS;
                 } else {
                     response.status = StatusCode::ERROR;
                 }
             } else if (request.opcode == OpCode::DELETE) {
-                if (chord_node->remove_key(key)) {
+                if (chord_node->remove_key(key, key_id)) {
+                    response.status = StatusCode::SUCCESS;
+                } else {
+                    response.status = StatusCode::KEY_NOT_FOUND;
+                }
+            } else if (request.opcode == OpCode::CAS) {
+                uint64_t expected = 0;
+                uint64_t version = 0;
+                bool compressed = false;
+                std::vector<uint8_t> raw;
+                if (!Protocol::decodeStored(request.value, expected, compressed) ||
+                    (compressed && !Compression::decompress(request.value, raw))) {
+                    response.status = StatusCode::ERROR;
+                    return true;
+                }
+                response.status = chord_node->compare_and_store(key, key_id, std::move(request.value),
+                                                                expected, version, compressed);
+                if (response.status != StatusCode::ERROR) {
+                    response.value = Protocol::encodeVersioned(version, nullptr, 0);
+                }
+            } else if (request.opcode == OpCode::GET_VERSIONED) {
+                std::vector<uint8_t> value;
+                uint64_t version = 0;
+                bool compressed = false;
+                if (chord_node->retrieve_versioned(key, key_id, value, version, &compressed)) {
+                    response.value = Protocol::encodeStored(version, compressed, value);
                     response.status = StatusCode::SUCCESS;
                 } else {
                     response.status = StatusCode::KEY_NOT_FOUND;
@@ -253,21 +721,17 @@ bool ChordServer::handle_chord_operation(const Request& request, Response& respo
     }
 }
 
-// Network operation implementations (simplified for Phase 2)
+// Network operation implementations
 std::shared_ptr<NodeInfo> ChordServer::remote_find_successor(const NodeInfo& target, const Hash160& id) {
     try {
-        Client client(target.address, target.port);
-        if (!client.connect()) {
-            return nullptr;
+        std::string endpoint;
+        NodeInfo node;
+        if (ConnectionPool::instance().call(target.address, target.port,
+                [&id, &endpoint](Client& client) { return client.find_successor(id, endpoint); }) &&
+            NodeInfo::parse(endpoint, node)) {
+            return std::make_shared<NodeInfo>(node);
         }
-        
-        // Send FIND_SUCCESSOR request
-        std::vector<uint8_t> id_bytes(id.begin(), id.end());
-        Request request(OpCode::FIND_SUCCESSOR, id_bytes);
-        Response response;
-        
-        // This is a simplified implementation - full version would use the protocol
-        return std::make_shared<NodeInfo>(target); // Placeholder
+        return nullptr;
     } catch (...) {
         return nullptr;
     }
@@ -275,14 +739,13 @@ std::shared_ptr<NodeInfo> ChordServer::remote_find_successor(const NodeInfo& tar
 
 std::shared_ptr<NodeInfo> ChordServer::remote_get_predecessor(const NodeInfo& target) {
     try {
-        Client client(target.address, target.port);
-        if (!client.connect()) {
-            return nullptr;
+        std::string endpoint;
+        NodeInfo node;
+        if (ConnectionPool::instance().call(target.address, target.port,
+                [&endpoint](Client& client) { return client.get_predecessor(endpoint); }) &&
+            NodeInfo::parse(endpoint, node)) {
+            return std::make_shared<NodeInfo>(node);
         }
-        
-        // Send GET_PREDECESSOR request
-        Request request(OpCode::GET_PREDECESSOR, {});
-        // Placeholder implementation
         return nullptr;
     } catch (...) {
         return nullptr;
@@ -291,17 +754,9 @@ std::shared_ptr<NodeInfo> ChordServer::remote_get_predecessor(const NodeInfo& ta
 
 bool ChordServer::remote_notify(const NodeInfo& target, std::shared_ptr<NodeInfo> node) {
     try {
-        Client client(target.address, target.port);
-        if (!client.connect()) {
-            return false;
-        }
-        
-        // Send NOTIFY request
-        std::string node_str = node->address + ":" + std::to_string(node->port);
-        std::vector<uint8_t> node_data(node_str.begin(), node_str.end());
-        Request request(OpCode::NOTIFY, {}, node_data);
-        // Placeholder implementation
-        return true;
+        std::string endpoint = node->endpoint();
+        return ConnectionPool::instance().call(target.address, target.port,
+            [&endpoint](Client& client) { return client.notify(endpoint); });
     } catch (...) {
         return false;
     }
@@ -309,8 +764,8 @@ bool ChordServer::remote_notify(const NodeInfo& target, std::shared_ptr<NodeInfo
 
 bool ChordServer::remote_ping(const NodeInfo& target) {
     try {
-        Client client(target.address, target.port);
-        return client.connect() && client.ping();
+        return ConnectionPool::instance().call(target.address, target.port,
+            [](Client& client) { return client.ping(); });
     } catch (...) {
         return false;
     }
@@ -1,8 +1,11 @@
 #include "chord_server.h"
+#include "logger.h"
 #include <iostream>
 #include <csignal>
 #include <atomic>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
 #include <string>
 
 std::atomic<bool> shutdown_requested(false);
@@ -19,11 +22,23 @@ void signal_handler(int signal) {
 }
 
 void print_usage(const char* program_name) {
-    std::cout << "Usage: " << program_name << " -p PORT [-j EXISTING_NODE]" << std::endl;
+    std::cout << "Usage: " << program_name << " -p PORT [-j EXISTING_NODE] [-d DATA_DIR] [-c COLD_DIR [-m MB]] [-r MB] [-z BYTES] [-T TOKENS [-w WEIGHT]] [-l LEVEL] [-a]" << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "  -p PORT          Server port (required)" << std::endl;
     std::cout << "  -j NODE          Join existing ring via NODE (format: host:port)" << std::endl;
     std::cout << "  -t THREADS       Number of worker threads (default: 8)" << std::endl;
+    std::cout << "  -e LOOPS         Number of epoll event loops (default: 1, >1 uses SO_REUSEPORT)" << std::endl;
+    std::cout << "  -a               Pin each worker thread to its own CPU" << std::endl;
+    std::cout << "  -d DIR           Keep data durable in DIR (write-ahead log + snapshots)" << std::endl;
+    std::cout << "                   and recover it from there on restart" << std::endl;
+    std::cout << "  -c DIR           Move values beyond the memory limit to mapped files in DIR" << std::endl;
+    std::cout << "  -m MB            Memory limit for values with -c (default: 1024)" << std::endl;
+    std::cout << "  -r MB            Cache for hot keys owned by other nodes (default: 64, 0: off)" << std::endl;
+    std::cout << "  -z BYTES         Compress values of at least BYTES (default: 0, off)" << std::endl;
+    std::cout << "  -T TOKENS        Ring positions (virtual nodes) to take (default: 1)" << std::endl;
+    std::cout << "  -w WEIGHT        Capacity relative to other nodes; scales -T (default: 1.0)" << std::endl;
+    std::cout << "  -l LEVEL         Log level: debug, info, warn, error, off (default: info);" << std::endl;
+    std::cout << "                   change it later with client_tool loglevel" << std::endl;
     std::cout << "  -h               Show this help message" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
@@ -31,12 +46,25 @@ void print_usage(const char* program_name) {
     std::cout << "  " << program_name << " -p 8001" << std::endl;
     std::cout << "  # Join existing ring" << std::endl;
     std::cout << "  " << program_name << " -p 8002 -j 127.0.0.1:8001" << std::endl;
+    std::cout << "  # Durable node that keeps its data across restarts" << std::endl;
+    std::cout << "  " << program_name << " -p 8003 -j 127.0.0.1:8001 -d /var/lib/funnelkvs/8003" << std::endl;
+    std::cout << "  # Node with twice the capacity of its 32-token peers" << std::endl;
+    std::cout << "  " << program_name << " -p 8004 -j 127.0.0.1:8001 -T 32 -w 2" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     uint16_t port = 0;
     size_t num_threads = 8;
+    size_t num_event_loops = 1;
+    bool pin_workers = false;
     std::string join_node;
+    std::string data_dir;
+    std::string cold_dir;
+    size_t hot_mb = 1024;
+    size_t read_cache_mb = funnelkvs::ReadCache::DEFAULT_CAPACITY_BYTES / (1024 * 1024);
+    size_t compression_bytes = 0;
+    size_t token_count = 1;
+    double weight = 1.0;
     std::string host = "127.0.0.1";
     
     for (int i = 1; i < argc; i++) {
@@ -47,6 +75,32 @@ int main(int argc, char* argv[]) {
             join_node = argv[++i];
         } else if (arg == "-t" && i + 1 < argc) {
             num_threads = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-e" && i + 1 < argc) {
+            num_event_loops = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-a") {
+            pin_workers = true;
+        } else if (arg == "-d" && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (arg == "-c" && i + 1 < argc) {
+            cold_dir = argv[++i];
+        } else if (arg == "-m" && i + 1 < argc) {
+            hot_mb = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-r" && i + 1 < argc) {
+            read_cache_mb = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-z" && i + 1 < argc) {
+            compression_bytes = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-T" && i + 1 < argc) {
+            token_count = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-w" && i + 1 < argc) {
+            weight = std::atof(argv[++i]);
+        } else if (arg == "-l" && i + 1 < argc) {
+            funnelkvs::LogLevel level;
+            if (!funnelkvs::Logger::parse_level(argv[++i], level)) {
+                std::cerr << "Unknown log level: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            funnelkvs::Logger::instance().set_level(level);
         } else if (arg == "-h") {
             print_usage(argv[0]);
             return 0;
@@ -65,14 +119,38 @@ int main(int argc, char* argv[]) {
     
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
+    // A write to a peer that has disconnected fails with EPIPE instead
+    std::signal(SIGPIPE, SIG_IGN);
     
     try {
-        funnelkvs::ChordServer server(host, port, num_threads);
+        funnelkvs::ChordServer server(host, port, num_threads, num_event_loops);
         g_server = &server;
         
         std::cout << "FunnelKVS Chord Server" << std::endl;
         std::cout << "Address: " << host << ":" << port << std::endl;
         std::cout << "Worker threads: " << num_threads << std::endl;
+        std::cout << "Event loops: " << num_event_loops << std::endl;
+        if (pin_workers && !server.pin_workers()) {
+            std::cerr << "Could not pin worker threads to CPUs" << std::endl;
+        }
+        
+        // A node's share of the ring follows its share of the positions
+        size_t tokens = static_cast<size_t>(std::max(1.0, std::round(token_count * weight)));
+        server.set_tokens(tokens);
+        std::cout << "Ring positions: " << server.get_token_count() << std::endl;
+        
+        server.set_read_cache_capacity(read_cache_mb * 1024 * 1024);
+        if (compression_bytes > 0) {
+            std::cout << "Compressing values of at least " << compression_bytes << " bytes" << std::endl;
+            server.set_compression(compression_bytes);
+        }
+        if (!cold_dir.empty()) {
+            server.enable_cold_tier(cold_dir, hot_mb * 1024 * 1024);
+        }
+        if (!data_dir.empty()) {
+            std::cout << "Data directory: " << data_dir << std::endl;
+            server.enable_persistence(data_dir);
+        }
         
         if (!join_node.empty()) {
             // Parse join node address
@@ -1,4 +1,5 @@
 #include "client.h"
+#include "compression.h"
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <netinet/in.h>
@@ -9,11 +10,34 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <algorithm>
+#include "byte_buffer.h"
 
 namespace funnelkvs {
 
+constexpr size_t Client::DEFAULT_PIPELINE_DEPTH;
+constexpr int Client::MAX_REDIRECTS;
+constexpr size_t Client::MAX_RING_WALK;
+
+static constexpr int PIPELINE_TIMEOUT_MS = 5000;
+static constexpr size_t PIPELINE_READ_CHUNK = 64 * 1024;
+// Weight of the newest sample in a peer's smoothed latency, and the decay
+// of the copy passed over, so that a peer that was slow once is retried
+static constexpr double LATENCY_SMOOTHING = 0.2;
+static constexpr double LATENCY_DECAY = 0.9;
+
 Client::Client(const std::string& host, uint16_t port)
-    : server_host(host), server_port(port), socket_fd(-1), connected(false) {
+    : server_host(host), server_port(port), socket_fd(-1), connected(false),
+      read_consistency(ReadConsistency::PRIMARY), read_replicas(3),
+      chooser(static_cast<std::minstd_rand::result_type>(
+          std::chrono::steady_clock::now().time_since_epoch().count())),
+      compression_threshold(0) {
+    routing_stats.direct = 0;
+    routing_stats.redirects = 0;
+    routing_stats.refreshes = 0;
+    routing_stats.replica_reads = 0;
 }
 
 Client::~Client() {
@@ -127,11 +151,34 @@ void Client::disconnect() {
     }
 }
 
+bool Client::is_healthy() {
+    if (!connected || socket_fd < 0) {
+        return false;
+    }
+    
+    struct pollfd pfd;
+    pfd.fd = socket_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, 0);
+    if (ready == 0) {
+        return true; // nothing pending: idle and open
+    }
+    // Readable while idle means EOF, an error, or stray data; none of
+    // which is safe to send a new request after.
+    disconnect();
+    return false;
+}
+
+bool Client::call(const Request& request, Response& response) {
+    return send_request(request, response);
+}
+
 bool Client::send_data(const std::vector<uint8_t>& data) {
     size_t total_sent = 0;
     while (total_sent < data.size()) {
         ssize_t sent = send(socket_fd, data.data() + total_sent,
-                           data.size() - total_sent, 0);
+                           data.size() - total_sent, MSG_NOSIGNAL);
         if (sent <= 0) {
             return false;
         }
@@ -142,11 +189,18 @@ bool Client::send_data(const std::vector<uint8_t>& data) {
 
 bool Client::receive_data(std::vector<uint8_t>& buffer, size_t expected_size) {
     buffer.resize(expected_size);
+    return receive_exact(buffer.data(), expected_size);
+}
+
+bool Client::receive_exact(uint8_t* buffer, size_t expected_size) {
     size_t total_received = 0;
     
     while (total_received < expected_size) {
-        ssize_t received = recv(socket_fd, buffer.data() + total_received,
+        ssize_t received = recv(socket_fd, buffer + total_received,
                                 expected_size - total_received, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
         if (received <= 0) {
             return false;
         }
@@ -155,19 +209,67 @@ bool Client::receive_data(std::vector<uint8_t>& buffer, size_t expected_size) {
     return true;
 }
 
+bool Client::send_vectored(struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t sent = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        size_t remaining = static_cast<size_t>(sent);
+        while (iovcnt > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
 bool Client::send_request(const Request& request, Response& response) {
     if (!connected) {
         return false;
     }
     
-    std::vector<uint8_t> encoded_request = Protocol::encodeRequest(request);
-    if (!send_data(encoded_request)) {
+    // Scatter-gather the frame straight from the caller's key/value buffers
+    uint8_t prefix[Protocol::REQUEST_HEADER_SIZE];
+    uint8_t value_len_bytes[4];
+    Protocol::encodeRequestPrefix(request.opcode, static_cast<uint32_t>(request.key.size()), prefix,
+                                  request.compressed);
+    Protocol::encodeLength(static_cast<uint32_t>(request.value.size()), value_len_bytes);
+    
+    struct iovec iov[4];
+    int iovcnt = 0;
+    iov[iovcnt].iov_base = prefix;
+    iov[iovcnt++].iov_len = sizeof(prefix);
+    if (!request.key.empty()) {
+        iov[iovcnt].iov_base = const_cast<uint8_t*>(request.key.data());
+        iov[iovcnt++].iov_len = request.key.size();
+    }
+    iov[iovcnt].iov_base = value_len_bytes;
+    iov[iovcnt++].iov_len = sizeof(value_len_bytes);
+    if (!request.value.empty()) {
+        iov[iovcnt].iov_base = const_cast<uint8_t*>(request.value.data());
+        iov[iovcnt++].iov_len = request.value.size();
+    }
+    
+    if (!send_vectored(iov, iovcnt)) {
         disconnect();
         return false;
     }
     
-    std::vector<uint8_t> header(5);
-    if (!receive_data(header, 5)) {
+    uint8_t header[Protocol::RESPONSE_HEADER_SIZE];
+    if (!receive_exact(header, sizeof(header))) {
         disconnect();
         return false;
     }
@@ -176,52 +278,211 @@ bool Client::send_request(const Request& request, Response& response) {
                         (static_cast<uint32_t>(header[2]) << 16) |
                         (static_cast<uint32_t>(header[3]) << 8) |
                         static_cast<uint32_t>(header[4]);
+    if (value_len > Protocol::MAX_FRAME_SIZE) {
+        disconnect();
+        return false;
+    }
+    
+    // Read the payload directly into the response
+    response.status = Protocol::decodeStatus(header[0], response.compressed);
+    response.value.resize(value_len);
+    if (value_len > 0 && !receive_exact(response.value.data(), value_len)) {
+        disconnect();
+        return false;
+    }
     
-    std::vector<uint8_t> payload;
-    if (value_len > 0) {
-        if (!receive_data(payload, value_len)) {
+    return true;
+}
+
+bool Client::pipeline(const std::vector<Request>& requests, std::vector<Response>& responses,
+                      size_t max_in_flight) {
+    responses.clear();
+    if (!connected) {
+        return false;
+    }
+    responses.reserve(requests.size());
+    if (max_in_flight == 0) {
+        max_in_flight = 1;
+    }
+    
+    std::vector<uint8_t> out; // encoded requests not yet written
+    size_t out_offset = 0;
+    size_t next = 0;          // next request to encode
+    ByteBuffer in;
+    
+    while (responses.size() < requests.size()) {
+        // Top up the window
+        while (next < requests.size() && next - responses.size() < max_in_flight) {
+            if (out_offset == out.size()) {
+                out.clear();
+                out_offset = 0;
+            }
+            Protocol::appendRequest(out, requests[next++]);
+        }
+        
+        struct pollfd pfd;
+        pfd.fd = socket_fd;
+        pfd.events = POLLIN;
+        if (out_offset < out.size()) {
+            pfd.events |= POLLOUT;
+        }
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, PIPELINE_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
             disconnect();
             return false;
         }
+        
+        if (pfd.revents & POLLOUT) {
+            ssize_t sent = send(socket_fd, out.data() + out_offset, out.size() - out_offset,
+                                MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0) {
+                out_offset += static_cast<size_t>(sent);
+            } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                disconnect();
+                return false;
+            }
+        }
+        
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            in.ensure_writable(PIPELINE_READ_CHUNK);
+            ssize_t received = recv(socket_fd, in.write_ptr(), in.writable(), MSG_DONTWAIT);
+            if (received == 0) {
+                disconnect();
+                return false;
+            }
+            if (received < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    disconnect();
+                    return false;
+                }
+                continue;
+            }
+            in.commit(static_cast<size_t>(received));
+            
+            // Hand out every complete response in the buffer
+            while (responses.size() < next) {
+                size_t frame_size = 0;
+                FrameStatus status = Protocol::responseFrameSize(in.data(), in.size(), frame_size);
+                if (status == FrameStatus::INCOMPLETE) {
+                    break;
+                }
+                responses.emplace_back();
+                if (status == FrameStatus::INVALID ||
+                    !Protocol::decodeResponse(in.data(), frame_size, responses.back())) {
+                    responses.pop_back();
+                    disconnect();
+                    return false;
+                }
+                in.consume(frame_size);
+            }
+        }
+    }
+    
+    return true;
+}
+
+size_t Client::put_many(const std::vector<std::pair<std::string, std::vector<uint8_t>>>& entries,
+                        size_t max_in_flight) {
+    std::vector<Request> requests;
+    requests.reserve(entries.size());
+    for (const auto& entry : entries) {
+        requests.emplace_back(OpCode::PUT,
+                              std::vector<uint8_t>(entry.first.begin(), entry.first.end()),
+                              entry.second);
+        pack_request(requests.back());
     }
     
-    std::vector<uint8_t> full_response = header;
-    full_response.insert(full_response.end(), payload.begin(), payload.end());
+    std::vector<Response> responses;
+    pipeline(requests, responses, max_in_flight);
     
-    if (!Protocol::decodeResponse(full_response, response)) {
-        disconnect();
-        return false;
+    size_t stored = 0;
+    for (size_t i = 0; i < responses.size(); ++i) {
+        if (responses[i].status == StatusCode::SUCCESS) {
+            stored++;
+        } else if (responses[i].status == StatusCode::REDIRECT &&
+                   put(entries[i].first, entries[i].second)) {
+            stored++;
+        }
     }
+    return stored;
+}
+
+bool Client::multi(OpCode opcode, const std::vector<BatchEntry>& entries,
+                   std::vector<BatchResult>& results) {
+    results.clear();
+    Request request(opcode, {});
+    request.value = Protocol::encodeBatch(entries);
+    Response response;
     
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    if (!Protocol::decodeBatchResults(response.value.data(), response.value.size(), results) ||
+        results.size() != entries.size()) {
+        results.clear();
+        return false;
+    }
     return true;
 }
 
-bool Client::put(const std::string& key, const std::vector<uint8_t>& value) {
+bool Client::multi_get(const std::vector<std::string>& keys, std::vector<BatchResult>& results) {
+    std::vector<BatchEntry> entries(keys.begin(), keys.end());
+    return multi(OpCode::MULTI_GET, entries, results);
+}
+
+bool Client::multi_put(const std::vector<BatchEntry>& entries, std::vector<BatchResult>& results) {
+    return multi(OpCode::MULTI_PUT, entries, results);
+}
+
+bool Client::multi_remove(const std::vector<std::string>& keys, std::vector<BatchResult>& results) {
+    std::vector<BatchEntry> entries(keys.begin(), keys.end());
+    return multi(OpCode::MULTI_DELETE, entries, results);
+}
+
+bool Client::pack(const std::vector<uint8_t>& value, std::vector<uint8_t>& packed) const {
+    return compression_threshold != 0 && value.size() >= compression_threshold &&
+           Compression::compress(value, packed);
+}
+
+void Client::pack_request(Request& request) const {
+    std::vector<uint8_t> packed;
+    if (pack(request.value, packed)) {
+        request.value.swap(packed);
+        request.compressed = true;
+    }
+}
+
+bool Client::put(const std::string& key, const std::vector<uint8_t>& value, bool compressed) {
     std::vector<uint8_t> key_bytes(key.begin(), key.end());
     Request request(OpCode::PUT, key_bytes, value);
+    if (compressed) {
+        request.compressed = true;
+    } else {
+        pack_request(request);
+    }
     Response response;
     
-    if (!send_request(request, response)) {
+    if (!route_request(request, response)) {
         return false;
     }
     
-    // Handle redirect
-    if (response.status == StatusCode::REDIRECT && !response.value.empty()) {
-        std::string redirect_node(response.value.begin(), response.value.end());
-        size_t colon_pos = redirect_node.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string redirect_host = redirect_node.substr(0, colon_pos);
-            int redirect_port = std::stoi(redirect_node.substr(colon_pos + 1));
-            
-            // Create temporary client for redirect
-            Client redirect_client(redirect_host, redirect_port);
-            if (redirect_client.connect()) {
-                Response redirect_response;
-                if (redirect_client.send_request(request, redirect_response)) {
-                    return redirect_response.status == StatusCode::SUCCESS;
-                }
-            }
-        }
+    return response.status == StatusCode::SUCCESS;
+}
+
+bool Client::put_with_ttl(const std::string& key, const std::vector<uint8_t>& value, uint64_t ttl_ms,
+                          bool compressed) {
+    std::vector<uint8_t> packed;
+    bool packed_here = !compressed && pack(value, packed);
+    Request request(OpCode::PUT_TTL, std::vector<uint8_t>(key.begin(), key.end()),
+                    Protocol::encodeVersioned(ttl_ms, packed_here ? packed : value));
+    request.compressed = compressed || packed_here;
+    Response response;
+    
+    if (!route_request(request, response)) {
         return false;
     }
     
@@ -231,42 +492,69 @@ bool Client::put(const std::string& key, const std::vector<uint8_t>& value) {
 bool Client::get(const std::string& key, std::vector<uint8_t>& value) {
     std::vector<uint8_t> key_bytes(key.begin(), key.end());
     Request request(OpCode::GET, key_bytes);
+    request.compressed = true;
+    if (read_consistency != ReadConsistency::PRIMARY) {
+        request.value.push_back(static_cast<uint8_t>(read_consistency));
+    }
     Response response;
     
-    if (!send_request(request, response)) {
+    if (!route_request(request, response) || response.status != StatusCode::SUCCESS) {
         return false;
     }
+    if (response.compressed) {
+        return Compression::decompress(response.value, value);
+    }
+    value.swap(response.value);
+    return true;
+}
+
+bool Client::get(const std::string& key, std::vector<uint8_t>& value, uint64_t& version) {
+    Request request(OpCode::GET_VERSIONED, std::vector<uint8_t>(key.begin(), key.end()));
+    Response response;
     
-    // Handle redirect
-    if (response.status == StatusCode::REDIRECT && !response.value.empty()) {
-        std::string redirect_node(response.value.begin(), response.value.end());
-        size_t colon_pos = redirect_node.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string redirect_host = redirect_node.substr(0, colon_pos);
-            int redirect_port = std::stoi(redirect_node.substr(colon_pos + 1));
-            
-            // Create temporary client for redirect
-            Client redirect_client(redirect_host, redirect_port);
-            if (redirect_client.connect()) {
-                Response redirect_response;
-                if (redirect_client.send_request(request, redirect_response)) {
-                    if (redirect_response.status == StatusCode::SUCCESS) {
-                        value = redirect_response.value;
-                        return true;
-                    }
-                    return false;
-                }
-            }
-        }
+    bool compressed = false;
+    if (!route_request(request, response) || response.status != StatusCode::SUCCESS ||
+        !Protocol::decodeStored(response.value, version, compressed)) {
         return false;
     }
+    if (compressed) {
+        return Compression::decompress(response.value, value);
+    }
+    value.swap(response.value);
+    return true;
+}
+
+StatusCode Client::compare_and_put(const std::string& key, const std::vector<uint8_t>& value,
+                                   uint64_t expected, uint64_t& version, bool compressed) {
+    std::vector<uint8_t> packed;
+    bool packed_here = !compressed && pack(value, packed);
+    Request request(OpCode::CAS, std::vector<uint8_t>(key.begin(), key.end()),
+                    Protocol::encodeStored(expected, compressed || packed_here, packed_here ? packed : value));
+    Response response;
     
-    if (response.status == StatusCode::SUCCESS) {
-        value = response.value;
-        return true;
+    if (!route_request(request, response)) {
+        return StatusCode::ERROR;
+    }
+    if ((response.status == StatusCode::SUCCESS || response.status == StatusCode::VERSION_MISMATCH) &&
+        Protocol::decodeVersioned(response.value, version)) {
+        return response.status;
     }
+    return StatusCode::ERROR;
+}
+
+bool Client::scan(const std::string& prefix, std::vector<uint8_t>& cursor, std::vector<BatchEntry>& entries,
+                  uint32_t max_entries, bool local) {
+    Request request(OpCode::SCAN, std::vector<uint8_t>(prefix.begin(), prefix.end()),
+                    Protocol::encodeScanRequest(local ? Protocol::SCAN_LOCAL : 0, max_entries, 0, cursor));
+    Response response;
     
-    return false;
+    // A ring scan starts wherever it is sent; its server redirects to the
+    // owner of the cursor's position
+    if (!(local ? send_request(request, response) : route_request(request, response)) ||
+        response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    return Protocol::decodeScanReply(response.value.data(), response.value.size(), cursor, entries);
 }
 
 bool Client::remove(const std::string& key) {
@@ -274,31 +562,247 @@ bool Client::remove(const std::string& key) {
     Request request(OpCode::DELETE, key_bytes);
     Response response;
     
-    if (!send_request(request, response)) {
+    if (!route_request(request, response)) {
         return false;
     }
     
-    // Handle redirect
-    if (response.status == StatusCode::REDIRECT && !response.value.empty()) {
-        std::string redirect_node(response.value.begin(), response.value.end());
-        size_t colon_pos = redirect_node.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string redirect_host = redirect_node.substr(0, colon_pos);
-            int redirect_port = std::stoi(redirect_node.substr(colon_pos + 1));
-            
-            // Create temporary client for redirect
-            Client redirect_client(redirect_host, redirect_port);
-            if (redirect_client.connect()) {
-                Response redirect_response;
-                if (redirect_client.send_request(request, redirect_response)) {
-                    return redirect_response.status == StatusCode::SUCCESS;
-                }
+    return response.status == StatusCode::SUCCESS;
+}
+
+bool Client::route_request(const Request& request, Response& response) {
+    Client* target = this;
+    std::unique_ptr<Client> one_shot; // redirect target when not caching peers
+    
+    if (ring && request.opcode != OpCode::SCAN) {
+        std::string owner;
+        std::string key(request.key.begin(), request.key.end());
+        Hash160 id = SHA1::hash(key);
+        bool any_copy = request.opcode == OpCode::GET && read_consistency == ReadConsistency::ANY;
+        if (any_copy ? pick_replica(id, owner) : ring->owner_of(id, owner)) {
+            target = connection_for(owner);
+            if (!target) {
+                drop_peer(owner);
+                target = this;
+            }
+        }
+    }
+    
+    for (int hop = 0; hop <= MAX_REDIRECTS; ++hop) {
+        auto started = std::chrono::steady_clock::now();
+        bool sent = target->send_request(request, response);
+        if (sent && ring) {
+            record_latency(target->endpoint(), static_cast<double>(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started).count()));
+        }
+        if (!sent) {
+            if (target != this && ring) {
+                // Stale owner: forget it and let the original node route
+                drop_peer(target->endpoint());
+                target = this;
+                continue;
+            }
+            return false;
+        }
+        
+        if (response.status != StatusCode::REDIRECT || response.value.empty()) {
+            if (hop == 0) {
+                routing_stats.direct++;
             }
+            return true;
         }
+        
+        routing_stats.redirects++;
+        std::string owner(response.value.begin(), response.value.end());
+        if (ring) {
+            ring->add(owner);
+            target = connection_for(owner);
+        } else {
+            std::string redirect_host;
+            uint16_t redirect_port = 0;
+            if (!RingCache::split_endpoint(owner, redirect_host, redirect_port)) {
+                return false;
+            }
+            one_shot.reset(new Client(redirect_host, redirect_port));
+            target = one_shot->connect() ? one_shot.get() : nullptr;
+        }
+        if (!target) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void Client::set_read_consistency(ReadConsistency consistency, size_t replicas) {
+    read_consistency = consistency;
+    read_replicas = std::max<size_t>(1, replicas);
+}
+
+bool Client::pick_replica(const Hash160& id, std::string& endpoint) {
+    std::vector<std::string> candidates = ring->replicas_of(id, read_replicas);
+    if (candidates.empty()) {
         return false;
     }
+    size_t choice = 0;
+    if (candidates.size() > 1) {
+        size_t first = chooser() % candidates.size();
+        size_t second = (first + 1 + chooser() % (candidates.size() - 1)) % candidates.size();
+        bool second_faster = latency_of(candidates[second]) < latency_of(candidates[first]);
+        choice = second_faster ? second : first;
+        std::string host;
+        uint16_t port = 0;
+        RingCache::split_endpoint(candidates[second_faster ? first : second], host, port);
+        auto it = peer_latency_us.find(host + ":" + std::to_string(port));
+        if (it != peer_latency_us.end()) {
+            it->second *= LATENCY_DECAY;
+        }
+    }
+    if (choice != 0) {
+        routing_stats.replica_reads++;
+    }
+    endpoint = candidates[choice];
+    return true;
+}
+
+double Client::latency_of(const std::string& endpoint) const {
+    // Servers not measured yet count as fastest, so each gets tried
+    std::string host;
+    uint16_t port = 0;
+    if (!RingCache::split_endpoint(endpoint, host, port)) {
+        return 0;
+    }
+    auto it = peer_latency_us.find(host + ":" + std::to_string(port));
+    return it == peer_latency_us.end() ? 0 : it->second;
+}
+
+void Client::record_latency(const std::string& server, double latency_us) {
+    auto it = peer_latency_us.find(server);
+    if (it == peer_latency_us.end()) {
+        peer_latency_us[server] = latency_us;
+    } else {
+        it->second += LATENCY_SMOOTHING * (latency_us - it->second);
+    }
+}
+
+Client* Client::connection_for(const std::string& endpoint) {
+    // One connection per server, whichever of its ring positions is meant
+    std::string host;
+    uint16_t port = 0;
+    if (!RingCache::split_endpoint(endpoint, host, port)) {
+        return nullptr;
+    }
+    if (host == server_host && port == server_port) {
+        return connected ? this : nullptr;
+    }
+    std::string server = host + ":" + std::to_string(port);
+    auto it = peers.find(server);
+    if (it != peers.end()) {
+        if (it->second->is_connected() || it->second->connect()) {
+            return it->second.get();
+        }
+        return nullptr;
+    }
     
-    return response.status == StatusCode::SUCCESS;
+    std::unique_ptr<Client> peer(new Client(host, port));
+    if (!peer->connect()) {
+        return nullptr;
+    }
+    Client* raw = peer.get();
+    peers[server] = std::move(peer);
+    return raw;
+}
+
+void Client::drop_peer(const std::string& endpoint) {
+    std::string host;
+    uint16_t port = 0;
+    if (!RingCache::split_endpoint(endpoint, host, port)) {
+        return;
+    }
+    peers.erase(host + ":" + std::to_string(port));
+    peer_latency_us.erase(host + ":" + std::to_string(port));
+    if (ring) {
+        // Every ring position of the server goes with it
+        for (const auto& node : ring->nodes()) {
+            std::string node_host;
+            uint16_t node_port = 0;
+            if (RingCache::split_endpoint(node, node_host, node_port) &&
+                node_host == host && node_port == port) {
+                ring->remove(node);
+            }
+        }
+    }
+}
+
+bool Client::enable_smart_routing() {
+    if (!ring) {
+        ring.reset(new RingCache());
+    }
+    if (!refresh_ring()) {
+        disable_smart_routing();
+        return false;
+    }
+    return true;
+}
+
+void Client::disable_smart_routing() {
+    ring.reset();
+    peers.clear();
+}
+
+bool Client::refresh_ring() {
+    if (!ring) {
+        return false;
+    }
+    std::string self_endpoint;
+    if (!node_info(self_endpoint)) {
+        return false;
+    }
+    routing_stats.refreshes++;
+    
+    // Walk the ring a successor list at a time until it wraps
+    RingCache fresh;
+    fresh.add(self_endpoint);
+    std::string cursor = self_endpoint;
+    for (size_t fetch = 0; fetch < MAX_RING_WALK; ++fetch) {
+        std::vector<std::string> successors;
+        bool fetched = false;
+        if (cursor == self_endpoint) {
+            fetched = get_successor_list(successors);
+        } else {
+            // The cursor may be any of its server's ring positions
+            Client* peer = connection_for(cursor);
+            Hash160 position = SHA1::hash(cursor);
+            fetched = peer && peer->get_successor_list(successors, &position);
+        }
+        if (!fetched) {
+            break;
+        }
+        
+        std::string next;
+        bool wrapped = false;
+        for (const auto& node : successors) {
+            if (node == cursor) {
+                continue; // short lists are padded with the node itself
+            }
+            if (node == self_endpoint) {
+                wrapped = true;
+                break;
+            }
+            fresh.add(node);
+            next = node;
+        }
+        if (wrapped || next.empty() || next == cursor) {
+            break;
+        }
+        cursor = next;
+    }
+    
+    *ring = fresh;
+    return true;
+}
+
+std::vector<std::string> Client::known_nodes() const {
+    return ring ? ring->nodes() : std::vector<std::string>();
 }
 
 bool Client::ping() {
@@ -323,4 +827,193 @@ bool Client::admin_shutdown() {
     return response.status == StatusCode::SUCCESS;
 }
 
+bool Client::stats(std::string& text) {
+    Request request(OpCode::STATS, std::vector<uint8_t>());
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    
+    text.assign(response.value.begin(), response.value.end());
+    return true;
+}
+
+bool Client::set_log_level(const std::string& level) {
+    Request request(OpCode::SET_LOG_LEVEL, std::vector<uint8_t>(),
+                    std::vector<uint8_t>(level.begin(), level.end()));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    return response.status == StatusCode::SUCCESS;
+}
+
+bool Client::replicate(const std::string& key, const std::vector<uint8_t>& value, uint64_t version,
+                       bool compressed) {
+    Request request(OpCode::REPLICATE, std::vector<uint8_t>(key.begin(), key.end()),
+                    Protocol::encodeStored(version, compressed, value));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    
+    return response.status == StatusCode::SUCCESS;
+}
+
+bool Client::replicate_remove(const std::string& key, uint64_t version) {
+    Request request(OpCode::REPLICATE_DELETE, std::vector<uint8_t>(key.begin(), key.end()),
+                    Protocol::encodeVersioned(version, nullptr, 0));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    
+    return response.status == StatusCode::SUCCESS || response.status == StatusCode::KEY_NOT_FOUND;
+}
+
+bool Client::replica_get(const std::string& key, std::vector<uint8_t>& value) {
+    Request request(OpCode::REPLICATE_GET, std::vector<uint8_t>(key.begin(), key.end()));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    
+    if (response.status == StatusCode::SUCCESS) {
+        value.swap(response.value);
+        return true;
+    }
+    return false;
+}
+
+bool Client::get_leased(const std::string& key, const std::string& holder,
+                        std::vector<uint8_t>& value, uint32_t& lease_ms) {
+    Request request(OpCode::GET_LEASED, std::vector<uint8_t>(key.begin(), key.end()),
+                    std::vector<uint8_t>(holder.begin(), holder.end()));
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS ||
+        response.value.size() < 4) {
+        return false;
+    }
+    const uint8_t* p = response.value.data();
+    lease_ms = (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    value.assign(response.value.begin() + 4, response.value.end());
+    return true;
+}
+
+bool Client::invalidate(const std::string& key) {
+    Request request(OpCode::INVALIDATE, std::vector<uint8_t>(key.begin(), key.end()));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    return response.status == StatusCode::SUCCESS;
+}
+
+bool Client::find_successor(const Hash160& id, std::string& node) {
+    Request request(OpCode::FIND_SUCCESSOR, std::vector<uint8_t>(id.begin(), id.end()));
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    node.assign(response.value.begin(), response.value.end());
+    return !node.empty();
+}
+
+bool Client::lookup_step(const Hash160& id, bool& final, std::vector<std::string>& nodes) {
+    Request request(OpCode::CLOSEST_PRECEDING_NODE, std::vector<uint8_t>(id.begin(), id.end()));
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS ||
+        response.value.empty()) {
+        return false;
+    }
+    final = response.value[0] != 0;
+    Protocol::decodeNodeList(response.value.data() + 1, response.value.size() - 1, nodes);
+    return !nodes.empty();
+}
+
+namespace {
+
+std::vector<uint8_t> target_key(const Hash160* target) {
+    return target ? std::vector<uint8_t>(target->begin(), target->end()) : std::vector<uint8_t>();
+}
+
+} // namespace
+
+bool Client::get_predecessor(std::string& node, const Hash160* target) {
+    Request request(OpCode::GET_PREDECESSOR, target_key(target));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    if (response.status == StatusCode::KEY_NOT_FOUND) {
+        node.clear();
+        return true;
+    }
+    if (response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    node.assign(response.value.begin(), response.value.end());
+    return true;
+}
+
+bool Client::get_successor_list(std::vector<std::string>& nodes, const Hash160* target) {
+    Request request(OpCode::GET_SUCCESSOR_LIST, target_key(target));
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    Protocol::decodeNodeList(response.value.data(), response.value.size(), nodes);
+    return true;
+}
+
+bool Client::get_routing(std::vector<std::string>& successors, std::vector<std::string>& fingers,
+                         const Hash160* target) {
+    Request request(OpCode::GET_ROUTING, target_key(target));
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS ||
+        response.value.empty()) {
+        return false;
+    }
+    std::vector<std::string> nodes;
+    Protocol::decodeNodeList(response.value.data() + 1, response.value.size() - 1, nodes);
+    size_t count = std::min<size_t>(response.value[0], nodes.size());
+    successors.assign(nodes.begin(), nodes.begin() + count);
+    fingers.assign(nodes.begin() + count, nodes.end());
+    return true;
+}
+
+bool Client::node_info(std::string& node) {
+    Request request(OpCode::NODE_INFO, {});
+    Response response;
+    
+    if (!send_request(request, response) || response.status != StatusCode::SUCCESS) {
+        return false;
+    }
+    node.assign(response.value.begin(), response.value.end());
+    return !node.empty();
+}
+
+bool Client::notify(const std::string& node, const Hash160* target) {
+    Request request(OpCode::NOTIFY, target_key(target), std::vector<uint8_t>(node.begin(), node.end()));
+    Response response;
+    
+    if (!send_request(request, response)) {
+        return false;
+    }
+    return response.status == StatusCode::SUCCESS;
+}
+
 } // namespace funnelkvs
\ No newline at end of file
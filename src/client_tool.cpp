@@ -9,23 +9,40 @@ void print_usage(const char* program_name) {
     std::cout << "Options:" << std::endl;
     std::cout << "  -h HOST    Server host (default: 127.0.0.1)" << std::endl;
     std::cout << "  -p PORT    Server port (default: 8001)" << std::endl;
+    std::cout << "  -s         Smart routing: send requests straight to each key's owner" << std::endl;
+    std::cout << "  -c MODE    Read consistency: primary (default), any or quorum" << std::endl;
+    std::cout << "  -z BYTES   Compress values of at least BYTES before sending them" << std::endl;
     std::cout << std::endl;
     std::cout << "Commands:" << std::endl;
-    std::cout << "  put KEY VALUE    Store a key-value pair" << std::endl;
+    std::cout << "  put KEY VALUE [TTL_MS]  Store a key-value pair, expiring after TTL_MS if given" << std::endl;
     std::cout << "  get KEY          Retrieve value for a key" << std::endl;
     std::cout << "  delete KEY       Delete a key" << std::endl;
+    std::cout << "  vget KEY         Retrieve a key's value and version" << std::endl;
+    std::cout << "  cas KEY VERSION VALUE  Store VALUE only if KEY is still at VERSION (0: absent)" << std::endl;
+    std::cout << "  mput KEY VALUE [KEY VALUE ...]  Store several pairs in one batch" << std::endl;
+    std::cout << "  mget KEY [KEY ...]              Retrieve several keys in one batch" << std::endl;
+    std::cout << "  mdelete KEY [KEY ...]           Delete several keys in one batch" << std::endl;
+    std::cout << "  scan [PREFIX]    List every key and value in the ring, optionally only keys starting with PREFIX" << std::endl;
     std::cout << "  ping             Check server connectivity" << std::endl;
+    std::cout << "  stats [PREFIX]   Show server metrics, optionally only those starting with PREFIX" << std::endl;
+    std::cout << "  loglevel LEVEL   Set the server's log level (debug, info, warn, error, off)" << std::endl;
     std::cout << "  shutdown         Shutdown the server (admin command)" << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  " << program_name << " put mykey myvalue" << std::endl;
     std::cout << "  " << program_name << " get mykey" << std::endl;
+    std::cout << "  " << program_name << " mget key1 key2 key3" << std::endl;
+    std::cout << "  " << program_name << " scan user:" << std::endl;
+    std::cout << "  " << program_name << " stats request.GET" << std::endl;
     std::cout << "  " << program_name << " -h 192.168.1.100 -p 8080 get mykey" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     std::string host = "127.0.0.1";
     uint16_t port = 8001;
+    bool smart_routing = false;
+    funnelkvs::ReadConsistency consistency = funnelkvs::ReadConsistency::PRIMARY;
+    size_t compression_bytes = 0;
     
     int arg_index = 1;
     while (arg_index < argc && argv[arg_index][0] == '-') {
@@ -35,6 +52,22 @@ int main(int argc, char* argv[]) {
             host = argv[++arg_index];
         } else if (option == "-p" && arg_index + 1 < argc) {
             port = static_cast<uint16_t>(std::atoi(argv[++arg_index]));
+        } else if (option == "-s") {
+            smart_routing = true;
+        } else if (option == "-c" && arg_index + 1 < argc) {
+            std::string mode = argv[++arg_index];
+            if (mode == "primary") {
+                consistency = funnelkvs::ReadConsistency::PRIMARY;
+            } else if (mode == "any") {
+                consistency = funnelkvs::ReadConsistency::ANY;
+            } else if (mode == "quorum") {
+                consistency = funnelkvs::ReadConsistency::QUORUM;
+            } else {
+                std::cerr << "Unknown read consistency: " << mode << std::endl;
+                return 1;
+            }
+        } else if (option == "-z" && arg_index + 1 < argc) {
+            compression_bytes = static_cast<size_t>(std::atoi(argv[++arg_index]));
         } else if (option == "--help") {
             print_usage(argv[0]);
             return 0;
@@ -60,6 +93,12 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    if (smart_routing && !client.enable_smart_routing()) {
+        std::cerr << "Could not fetch ring layout; falling back to redirects" << std::endl;
+    }
+    client.set_read_consistency(consistency);
+    client.set_compression(compression_bytes);
+    
     try {
         if (command == "put") {
             if (arg_index + 1 >= argc) {
@@ -69,8 +108,9 @@ int main(int argc, char* argv[]) {
             std::string key = argv[arg_index];
             std::string value_str = argv[arg_index + 1];
             std::vector<uint8_t> value(value_str.begin(), value_str.end());
+            uint64_t ttl_ms = arg_index + 2 < argc ? std::strtoull(argv[arg_index + 2], nullptr, 10) : 0;
             
-            if (client.put(key, value)) {
+            if (ttl_ms != 0 ? client.put_with_ttl(key, value, ttl_ms) : client.put(key, value)) {
                 std::cout << "OK" << std::endl;
             } else {
                 std::cerr << "Failed to store key" << std::endl;
@@ -107,6 +147,118 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
+        } else if (command == "vget") {
+            if (arg_index >= argc) {
+                std::cerr << "VGET requires KEY argument" << std::endl;
+                return 1;
+            }
+            std::string key = argv[arg_index];
+            std::vector<uint8_t> value;
+            uint64_t version = 0;
+            
+            if (client.get(key, value, version)) {
+                std::cout << version << " " << std::string(value.begin(), value.end()) << std::endl;
+            } else {
+                std::cerr << "Key not found" << std::endl;
+                return 1;
+            }
+            
+        } else if (command == "cas") {
+            if (arg_index + 2 >= argc) {
+                std::cerr << "CAS requires KEY, VERSION and VALUE arguments" << std::endl;
+                return 1;
+            }
+            std::string key = argv[arg_index];
+            uint64_t expected = std::strtoull(argv[arg_index + 1], nullptr, 10);
+            std::string value_str = argv[arg_index + 2];
+            std::vector<uint8_t> value(value_str.begin(), value_str.end());
+            uint64_t version = 0;
+            
+            funnelkvs::StatusCode status = client.compare_and_put(key, value, expected, version);
+            if (status == funnelkvs::StatusCode::SUCCESS) {
+                std::cout << "OK " << version << std::endl;
+            } else if (status == funnelkvs::StatusCode::VERSION_MISMATCH) {
+                std::cerr << "Version mismatch: current version is " << version << std::endl;
+                return 1;
+            } else {
+                std::cerr << "Failed to store key" << std::endl;
+                return 1;
+            }
+            
+        } else if (command == "mput") {
+            int remaining = argc - arg_index;
+            if (remaining < 2 || remaining % 2 != 0) {
+                std::cerr << "MPUT requires KEY VALUE pairs" << std::endl;
+                return 1;
+            }
+            std::vector<funnelkvs::BatchEntry> entries;
+            for (int i = arg_index; i + 1 < argc; i += 2) {
+                std::string value_str = argv[i + 1];
+                entries.emplace_back(argv[i], std::vector<uint8_t>(value_str.begin(), value_str.end()));
+            }
+            
+            std::vector<funnelkvs::BatchResult> results;
+            if (!client.multi_put(entries, results)) {
+                std::cerr << "Batch request failed" << std::endl;
+                return 1;
+            }
+            bool all_ok = true;
+            for (size_t i = 0; i < results.size(); ++i) {
+                bool ok = results[i].status == funnelkvs::StatusCode::SUCCESS;
+                all_ok = all_ok && ok;
+                std::cout << entries[i].key << ": " << (ok ? "OK" : "FAILED") << std::endl;
+            }
+            if (!all_ok) {
+                return 1;
+            }
+            
+        } else if (command == "mget" || command == "mdelete") {
+            if (arg_index >= argc) {
+                std::cerr << "Command requires at least one KEY argument" << std::endl;
+                return 1;
+            }
+            std::vector<std::string> keys(argv + arg_index, argv + argc);
+            
+            std::vector<funnelkvs::BatchResult> results;
+            bool sent = command == "mget" ? client.multi_get(keys, results)
+                                          : client.multi_remove(keys, results);
+            if (!sent) {
+                std::cerr << "Batch request failed" << std::endl;
+                return 1;
+            }
+            bool all_ok = true;
+            for (size_t i = 0; i < results.size(); ++i) {
+                std::cout << keys[i] << ": ";
+                if (results[i].status == funnelkvs::StatusCode::SUCCESS) {
+                    if (command == "mget") {
+                        std::cout << std::string(results[i].value.begin(), results[i].value.end()) << std::endl;
+                    } else {
+                        std::cout << "OK" << std::endl;
+                    }
+                } else {
+                    all_ok = false;
+                    std::cout << (results[i].status == funnelkvs::StatusCode::KEY_NOT_FOUND ?
+                                  "(not found)" : "(error)") << std::endl;
+                }
+            }
+            if (!all_ok) {
+                return 1;
+            }
+            
+        } else if (command == "scan") {
+            std::string prefix = arg_index < argc ? argv[arg_index] : "";
+            std::vector<uint8_t> cursor;
+            do {
+                std::vector<funnelkvs::BatchEntry> entries;
+                if (!client.scan(prefix, cursor, entries)) {
+                    std::cerr << "Scan failed" << std::endl;
+                    return 1;
+                }
+                for (const auto& entry : entries) {
+                    std::cout << entry.key << ": " << std::string(entry.value.begin(), entry.value.end()) << std::endl;
+                }
+            } while (!cursor.empty());
+            
         } else if (command == "ping") {
             if (client.ping()) {
                 std::cout << "PONG" << std::endl;
@@ -115,6 +267,33 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
+        } else if (command == "stats") {
+            std::string prefix = arg_index < argc ? argv[arg_index] : "";
+            std::string text;
+            if (!client.stats(text)) {
+                std::cerr << "Failed to fetch stats" << std::endl;
+                return 1;
+            }
+            std::istringstream lines(text);
+            std::string line;
+            while (std::getline(lines, line)) {
+                if (line.compare(0, prefix.size(), prefix) == 0) {
+                    std::cout << line << std::endl;
+                }
+            }
+            
+        } else if (command == "loglevel") {
+            if (arg_index >= argc) {
+                std::cerr << "LOGLEVEL requires LEVEL argument" << std::endl;
+                return 1;
+            }
+            if (client.set_log_level(argv[arg_index])) {
+                std::cout << "Log level set to " << argv[arg_index] << std::endl;
+            } else {
+                std::cerr << "Failed to set log level (unknown level?)" << std::endl;
+                return 1;
+            }
+            
         } else if (command == "shutdown") {
             if (client.admin_shutdown()) {
                 std::cout << "Shutdown command sent successfully" << std::endl;
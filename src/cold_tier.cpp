@@ -0,0 +1,175 @@
+#include "cold_tier.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace funnelkvs {
+
+constexpr size_t ColdTier::DEFAULT_SEGMENT_BYTES;
+
+ColdTier::Segment::Segment(int f, uint8_t* d, size_t c)
+    : fd(f), data(d), capacity(c), used(0), live_bytes(0), sealed(false) {
+}
+
+ColdTier::Segment::~Segment() {
+    ::munmap(data, capacity);
+    ::close(fd);
+}
+
+ColdTier::ColdTier(const std::string& dir, size_t segment_limit)
+    : directory(dir)
+    , segment_bytes(segment_limit)
+    , active_id(0)
+    , next_id(1)
+    , compactions(0)
+{
+    if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create cold tier directory " + directory + ": " + std::strerror(errno));
+    }
+}
+
+bool ColdTier::open_segment(size_t capacity) {
+    uint32_t id = next_id++;
+    char name[32];
+    std::snprintf(name, sizeof(name), "/cold-%d-%u.seg", static_cast<int>(::getpid()), id);
+    std::string path = directory + name;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        FKVS_WARN("Cold tier: cannot create " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    ::unlink(path.c_str());
+    // Sparse: blocks are only allocated as values are appended
+    if (::ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+        ::close(fd);
+        return false;
+    }
+    void* data = ::mmap(nullptr, capacity, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    auto segment = std::make_shared<Segment>(fd, static_cast<uint8_t*>(data), capacity);
+    {
+        WriteGuard lock(segments_lock);
+        segments[id] = segment;
+    }
+    if (active) {
+        active->sealed = true;
+    }
+    active = segment;
+    active_id = id;
+    return true;
+}
+
+bool ColdTier::append(const uint8_t* data, size_t size, Location& out) {
+    std::lock_guard<std::mutex> lock(append_mutex);
+    if (!active || active->capacity - active->used < size) {
+        if (!open_segment(std::max(segment_bytes, size))) {
+            return false;
+        }
+    }
+
+    // Written through the descriptor rather than the read-only mapping so
+    // that a full disk is an error here instead of a SIGBUS later
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::pwrite(active->fd, data + written, size - written,
+                             static_cast<off_t>(active->used + written));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            FKVS_ERROR("Cold tier: write failed: " << std::strerror(errno));
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    out.segment = active_id;
+    out.offset = active->used;
+    active->used += size;
+    active->live_bytes += size;
+    return true;
+}
+
+std::shared_ptr<const ColdTier::Segment> ColdTier::segment(uint32_t id) const {
+    ReadGuard lock(segments_lock);
+    auto it = segments.find(id);
+    return it != segments.end() ? it->second : nullptr;
+}
+
+void ColdTier::release(const Location& location, size_t size) {
+    std::shared_ptr<Segment> holder;
+    {
+        ReadGuard lock(segments_lock);
+        auto it = segments.find(location.segment);
+        if (it == segments.end()) {
+            return;
+        }
+        holder = it->second;
+    }
+    std::lock_guard<std::mutex> lock(append_mutex);
+    holder->live_bytes -= std::min(holder->live_bytes, size);
+}
+
+std::vector<uint32_t> ColdTier::compaction_candidates(double max_live_ratio) const {
+    std::vector<std::pair<double, uint32_t>> scored;
+    {
+        // Same order as append(): append_mutex, then segments_lock
+        std::lock_guard<std::mutex> lock(append_mutex);
+        ReadGuard segments_guard(segments_lock);
+        for (const auto& pair : segments) {
+            const Segment& segment = *pair.second;
+            if (!segment.sealed || segment.used == 0) {
+                continue;
+            }
+            double live = static_cast<double>(segment.live_bytes) / segment.used;
+            if (live <= max_live_ratio) {
+                scored.push_back(std::make_pair(live, pair.first));
+            }
+        }
+    }
+    std::sort(scored.begin(), scored.end());
+    std::vector<uint32_t> ids;
+    for (const auto& entry : scored) {
+        ids.push_back(entry.second);
+    }
+    return ids;
+}
+
+void ColdTier::drop(uint32_t id) {
+    std::shared_ptr<Segment> holder; // unmapped once the locks are released
+    std::lock_guard<std::mutex> lock(append_mutex);
+    WriteGuard segments_guard(segments_lock);
+    auto it = segments.find(id);
+    if (it == segments.end() || it->second == active) {
+        return;
+    }
+    holder = it->second;
+    segments.erase(it);
+    compactions++;
+}
+
+ColdTier::Stats ColdTier::stats() const {
+    Stats result = Stats();
+    std::lock_guard<std::mutex> lock(append_mutex);
+    ReadGuard segments_guard(segments_lock);
+    result.segments = segments.size();
+    for (const auto& pair : segments) {
+        result.file_bytes += pair.second->used;
+        result.live_bytes += pair.second->live_bytes;
+    }
+    result.compactions = compactions;
+    return result;
+}
+
+} // namespace funnelkvs
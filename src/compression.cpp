@@ -0,0 +1,211 @@
+#include "compression.h"
+#include "hash.h"
+#include <cstring>
+
+namespace funnelkvs {
+
+constexpr size_t Compression::HEADER_SIZE;
+constexpr size_t Compression::MAX_RAW_SIZE;
+
+namespace {
+
+// Format limits shared with LZ4 so blocks stay decodable by its tools: a
+// match is at least MIN_MATCH bytes, the last LAST_LITERALS bytes are
+// always literals, and no match starts in the final MATCH_LIMIT bytes.
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_BITS = 12;
+// After this many misses in a row the search skips ahead faster, so
+// incompressible data costs little more than a scan
+constexpr int SKIP_SHIFT = 6;
+
+inline uint32_t load32(const uint8_t* p) {
+    uint32_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+inline uint32_t hash_of(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Length continuation bytes: 255 while more follows, then the remainder
+inline uint8_t* put_length(uint8_t* op, size_t length) {
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+// Worst-case bytes for a sequence with these lengths, for the bound check
+inline size_t sequence_bound(size_t literals, size_t match) {
+    return 1 + literals + literals / 255 + 1 + 2 + match / 255 + 1;
+}
+
+inline bool get_length(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+bool Compression::compress(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    if (size <= MATCH_LIMIT + HEADER_SIZE || size > MAX_RAW_SIZE) {
+        return false;
+    }
+    // Anything that reaches size bytes is no gain, so write at most size - 1
+    out.resize(size);
+    uint8_t* const begin = out.data();
+    uint8_t* const limit = begin + size - 1;
+    hash_detail::store_be32(begin, static_cast<uint32_t>(size));
+    uint8_t* op = begin + HEADER_SIZE;
+
+    uint32_t table[1u << HASH_BITS];
+    std::memset(table, 0, sizeof(table));
+
+    const size_t search_end = size - MATCH_LIMIT;
+    const size_t match_end = size - LAST_LITERALS;
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t misses = 0;
+    while (ip < search_end) {
+        uint32_t sequence = load32(data + ip);
+        uint32_t h = hash_of(sequence);
+        size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(ip);
+        if (candidate >= ip || ip - candidate > MAX_OFFSET || load32(data + candidate) != sequence) {
+            ip += 1 + (misses++ >> SKIP_SHIFT);
+            continue;
+        }
+        misses = 0;
+
+        size_t length = MIN_MATCH;
+        while (ip + length < match_end && data[candidate + length] == data[ip + length]) {
+            ++length;
+        }
+        while (ip > anchor && candidate > 0 && data[ip - 1] == data[candidate - 1]) {
+            --ip;
+            --candidate;
+            ++length;
+        }
+
+        size_t literals = ip - anchor;
+        size_t extra = length - MIN_MATCH;
+        if (sequence_bound(literals, extra) > static_cast<size_t>(limit - op)) {
+            return false;
+        }
+        uint8_t* token = op++;
+        *token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+        if (literals >= 15) {
+            op = put_length(op, literals - 15);
+        }
+        std::memcpy(op, data + anchor, literals);
+        op += literals;
+        size_t offset = ip - candidate;
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        *token |= static_cast<uint8_t>(extra < 15 ? extra : 15);
+        if (extra >= 15) {
+            op = put_length(op, extra - 15);
+        }
+
+        ip += length;
+        anchor = ip;
+        // Index a position inside the match too; long runs find themselves
+        if (ip - 2 < search_end) {
+            table[hash_of(load32(data + ip - 2))] = static_cast<uint32_t>(ip - 2);
+        }
+    }
+
+    size_t literals = size - anchor;
+    if (1 + literals + literals / 255 + 1 > static_cast<size_t>(limit - op)) {
+        return false;
+    }
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+        op = put_length(op, literals - 15);
+    }
+    std::memcpy(op, data + anchor, literals);
+    op += literals;
+
+    out.resize(static_cast<size_t>(op - begin));
+    return true;
+}
+
+bool Compression::decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    if (size < HEADER_SIZE) {
+        return false;
+    }
+    size_t raw = hash_detail::load_be32(data);
+    if (raw > MAX_RAW_SIZE) {
+        return false;
+    }
+    out.resize(raw);
+    uint8_t* const begin = out.data();
+    size_t op = 0;
+    const uint8_t* ip = data + HEADER_SIZE;
+    const uint8_t* const end = data + size;
+
+    for (;;) {
+        if (ip >= end) {
+            return false;
+        }
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(ip, end, literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(end - ip) || literals > raw - op) {
+            return false;
+        }
+        std::memcpy(begin + op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == end) {
+            break; // the last sequence has no match
+        }
+
+        if (end - ip < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(ip[0]) | static_cast<size_t>(ip[1]) << 8;
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !get_length(ip, end, length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > op || length > raw - op) {
+            return false;
+        }
+        uint8_t* dst = begin + op;
+        const uint8_t* src = dst - offset;
+        if (offset >= length) {
+            std::memcpy(dst, src, length);
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < length; ++i) {
+                dst[i] = src[i];
+            }
+        }
+        op += length;
+    }
+    return op == raw;
+}
+
+size_t Compression::raw_size(const uint8_t* data, size_t size) {
+    return size < HEADER_SIZE ? 0 : hash_detail::load_be32(data);
+}
+
+} // namespace funnelkvs
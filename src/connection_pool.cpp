@@ -0,0 +1,194 @@
+#include "connection_pool.h"
+#include <algorithm>
+
+namespace funnelkvs {
+
+ConnectionPool::Lease::Lease(Lease&& other)
+    : pool(other.pool), peer_key(std::move(other.peer_key)),
+      client(std::move(other.client)), reused(other.reused) {
+    other.pool = nullptr;
+}
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator=(Lease&& other) {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        peer_key = std::move(other.peer_key);
+        client = std::move(other.client);
+        reused = other.reused;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+void ConnectionPool::Lease::discard() {
+    if (client) {
+        client->disconnect();
+    }
+    release();
+}
+
+void ConnectionPool::Lease::release() {
+    if (pool && client) {
+        pool->return_connection(peer_key, std::move(client));
+    }
+    client.reset();
+    pool = nullptr;
+}
+
+ConnectionPool::ConnectionPool(const PoolConfig& cfg)
+    : config(cfg), connect_count(0), reuse_count(0), eviction_count(0) {
+}
+
+ConnectionPool::~ConnectionPool() {
+    clear();
+}
+
+ConnectionPool& ConnectionPool::instance() {
+    static ConnectionPool pool;
+    return pool;
+}
+
+std::string ConnectionPool::make_key(const std::string& host, uint16_t port) {
+    return host + ":" + std::to_string(port);
+}
+
+void ConnectionPool::set_config(const PoolConfig& cfg) {
+    std::lock_guard<std::mutex> lock(mutex);
+    config = cfg;
+}
+
+void ConnectionPool::evict_expired_locked(Peer& peer, std::chrono::steady_clock::time_point now) {
+    // idle is ordered by idle_since, oldest first
+    auto first_fresh = std::find_if(peer.idle.begin(), peer.idle.end(),
+        [this, now](const IdleConnection& conn) {
+            return now - conn.idle_since < config.idle_timeout;
+        });
+    size_t expired = static_cast<size_t>(first_fresh - peer.idle.begin());
+    if (expired > 0) {
+        peer.idle.erase(peer.idle.begin(), first_fresh);
+        eviction_count += expired;
+    }
+}
+
+ConnectionPool::Lease ConnectionPool::acquire(const std::string& host, uint16_t port, bool fresh) {
+    std::string key = make_key(host, port);
+    std::unique_ptr<Client> client;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        Peer& peer = peers[key];
+        auto now = std::chrono::steady_clock::now();
+        evict_expired_locked(peer, now);
+
+        // Reuse the most recently returned connection that still looks alive
+        while (!fresh && !peer.idle.empty()) {
+            std::unique_ptr<Client> candidate = std::move(peer.idle.back().client);
+            peer.idle.pop_back();
+            if (candidate->is_healthy()) {
+                client = std::move(candidate);
+                break;
+            }
+            eviction_count++;
+        }
+
+        if (client) {
+            peer.leased++;
+            reuse_count++;
+            return Lease(this, key, std::move(client), true);
+        }
+
+        // Respect the per-peer cap before dialing a new connection
+        bool have_slot = slot_available.wait_for(lock, config.acquire_timeout, [this, &key] {
+            return peers[key].leased < config.max_connections_per_peer;
+        });
+        if (!have_slot) {
+            return Lease();
+        }
+        // peers may have rehashed while we waited
+        Peer& current = peers[key];
+        while (!current.idle.empty() &&
+               current.leased + current.idle.size() >= config.max_connections_per_peer) {
+            // At the cap: make room by closing the oldest idle connection
+            current.idle.erase(current.idle.begin());
+            eviction_count++;
+        }
+        current.leased++;
+    }
+
+    // Dial without holding the pool lock
+    client.reset(new Client(host, port));
+    if (!client->connect()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        peers[key].leased--;
+        slot_available.notify_one();
+        return Lease();
+    }
+    connect_count++;
+    return Lease(this, key, std::move(client), false);
+}
+
+void ConnectionPool::return_connection(const std::string& peer_key, std::unique_ptr<Client> client) {
+    std::unique_ptr<Client> to_close;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Peer& peer = peers[peer_key];
+        if (peer.leased > 0) {
+            peer.leased--;
+        }
+        if (client->is_connected() && peer.idle.size() < config.max_idle_per_peer) {
+            IdleConnection idle;
+            idle.client = std::move(client);
+            idle.idle_since = std::chrono::steady_clock::now();
+            peer.idle.push_back(std::move(idle));
+        } else {
+            to_close = std::move(client);
+        }
+    }
+    slot_available.notify_one();
+    // to_close disconnects outside the lock
+}
+
+void ConnectionPool::evict_idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = peers.begin(); it != peers.end();) {
+        evict_expired_locked(it->second, now);
+        if (it->second.idle.empty() && it->second.leased == 0) {
+            it = peers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ConnectionPool::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& entry : peers) {
+        eviction_count += entry.second.idle.size();
+        entry.second.idle.clear();
+    }
+}
+
+ConnectionPool::PoolStats ConnectionPool::get_stats() const {
+    PoolStats stats;
+    stats.connects = connect_count.load();
+    stats.reuses = reuse_count.load();
+    stats.evictions = eviction_count.load();
+    stats.idle = 0;
+    stats.leased = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : peers) {
+        stats.idle += entry.second.idle.size();
+        stats.leased += entry.second.leased;
+    }
+    return stats;
+}
+
+size_t ConnectionPool::idle_connections(const std::string& host, uint16_t port) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(make_key(host, port));
+    return it == peers.end() ? 0 : it->second.idle.size();
+}
+
+} // namespace funnelkvs
@@ -2,13 +2,218 @@
 #include <iomanip>
 #include <sstream>
 #include <cstring>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 namespace funnelkvs {
 
-static uint32_t left_rotate(uint32_t value, int amount) {
+namespace {
+
+// Compress `count` consecutive 64-byte blocks into the state
+typedef void (*CompressFn)(uint32_t state[5], const uint8_t* blocks, size_t count);
+
+inline uint32_t left_rotate(uint32_t value, int amount) {
     return (value << amount) | (value >> (32 - amount));
 }
 
+void compress_portable(uint32_t state[5], const uint8_t* blocks, size_t count) {
+    for (; count > 0; --count, blocks += 64) {
+        // The message schedule only ever looks 16 words back, so keep a
+        // rolling window instead of expanding all 80 words up front
+        uint32_t w[16];
+        for (int i = 0; i < 16; i++) {
+            w[i] = hash_detail::load_be32(blocks + i * 4);
+        }
+        
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+        
+        for (int i = 0; i < 80; i++) {
+            if (i >= 16) {
+                w[i & 15] = left_rotate(w[(i - 3) & 15] ^ w[(i - 8) & 15] ^
+                                        w[(i - 14) & 15] ^ w[i & 15], 1);
+            }
+            uint32_t f, k;
+            if (i < 20) {
+                f = d ^ (b & (c ^ d));
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (d & (b | c));
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            
+            uint32_t temp = left_rotate(a, 5) + f + e + k + w[i & 15];
+            e = d;
+            d = c;
+            c = left_rotate(b, 30);
+            b = a;
+            a = temp;
+        }
+        
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FUNNELKVS_SHA1_HARDWARE "sha-ni"
+
+// Four rounds with the x86 SHA extensions. g is the round group (0-19);
+// message words rotate through m[0..3] and the expanded schedule is
+// produced a few groups ahead of its use, as in Intel's reference code.
+#define SHA1_ROUNDS4(g, func, e_cur, e_next)                                          \
+    e_cur = (g) == 0 ? _mm_add_epi32(e_cur, m[0]) : _mm_sha1nexte_epu32(e_cur, m[(g) % 4]); \
+    e_next = abcd;                                                                    \
+    if ((g) >= 3 && (g) <= 18) m[((g) + 1) % 4] = _mm_sha1msg2_epu32(m[((g) + 1) % 4], m[(g) % 4]); \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_cur, func);                                    \
+    if ((g) >= 1 && (g) <= 16) m[((g) + 3) % 4] = _mm_sha1msg1_epu32(m[((g) + 3) % 4], m[(g) % 4]); \
+    if ((g) >= 2 && (g) <= 17) m[((g) + 2) % 4] = _mm_xor_si128(m[((g) + 2) % 4], m[(g) % 4]);
+
+__attribute__((target("sha,sse4.1")))
+void compress_hardware(uint32_t state[5], const uint8_t* blocks, size_t count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+    __m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+    __m128i e1;
+    
+    for (; count > 0; --count, blocks += 64) {
+        __m128i abcd_saved = abcd;
+        __m128i e0_saved = e0;
+        __m128i m[4];
+        for (int i = 0; i < 4; ++i) {
+            m[i] = _mm_shuffle_epi8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i * 16)), byte_swap);
+        }
+        
+        SHA1_ROUNDS4(0, 0, e0, e1)
+        SHA1_ROUNDS4(1, 0, e1, e0)
+        SHA1_ROUNDS4(2, 0, e0, e1)
+        SHA1_ROUNDS4(3, 0, e1, e0)
+        SHA1_ROUNDS4(4, 0, e0, e1)
+        SHA1_ROUNDS4(5, 1, e1, e0)
+        SHA1_ROUNDS4(6, 1, e0, e1)
+        SHA1_ROUNDS4(7, 1, e1, e0)
+        SHA1_ROUNDS4(8, 1, e0, e1)
+        SHA1_ROUNDS4(9, 1, e1, e0)
+        SHA1_ROUNDS4(10, 2, e0, e1)
+        SHA1_ROUNDS4(11, 2, e1, e0)
+        SHA1_ROUNDS4(12, 2, e0, e1)
+        SHA1_ROUNDS4(13, 2, e1, e0)
+        SHA1_ROUNDS4(14, 2, e0, e1)
+        SHA1_ROUNDS4(15, 3, e1, e0)
+        SHA1_ROUNDS4(16, 3, e0, e1)
+        SHA1_ROUNDS4(17, 3, e1, e0)
+        SHA1_ROUNDS4(18, 3, e0, e1)
+        SHA1_ROUNDS4(19, 3, e1, e0)
+        
+        e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+        abcd = _mm_add_epi32(abcd, abcd_saved);
+    }
+    
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+
+#undef SHA1_ROUNDS4
+
+bool hardware_supported() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+        return false;
+    }
+    if (__get_cpuid_max(0, nullptr) < 7) {
+        return false;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & bit_SHA) != 0;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define FUNNELKVS_SHA1_HARDWARE "armv8"
+
+// ARMv8 crypto extensions: only built when the compiler targets them
+// (e.g. -march=armv8-a+crypto); the CPU is still checked at run time.
+void compress_hardware(uint32_t state[5], const uint8_t* blocks, size_t count) {
+    static const uint32_t K[4] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e = state[4];
+    
+    for (; count > 0; --count, blocks += 64) {
+        uint32x4_t abcd_saved = abcd;
+        uint32_t e_saved = e;
+        uint32x4_t w[4];
+        for (int i = 0; i < 4; ++i) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + i * 16)));
+        }
+        
+        for (int g = 0; g < 20; ++g) {
+            uint32x4_t wk = vaddq_u32(w[g % 4], vdupq_n_u32(K[g / 5]));
+            uint32_t e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (g < 5) {
+                abcd = vsha1cq_u32(abcd, e, wk);
+            } else if (g < 10 || g >= 15) {
+                abcd = vsha1pq_u32(abcd, e, wk);
+            } else {
+                abcd = vsha1mq_u32(abcd, e, wk);
+            }
+            e = e_next;
+            if (g < 16) {
+                // Next schedule words from the four most recent ones
+                w[g % 4] = vsha1su1q_u32(vsha1su0q_u32(w[g % 4], w[(g + 1) % 4], w[(g + 2) % 4]),
+                                         w[(g + 3) % 4]);
+            }
+        }
+        
+        abcd = vaddq_u32(abcd, abcd_saved);
+        e += e_saved;
+    }
+    
+    vst1q_u32(state, abcd);
+    state[4] = e;
+}
+
+bool hardware_supported() {
+    return (getauxval(AT_HWCAP) & HWCAP_SHA1) != 0;
+}
+
+#endif
+
+CompressFn best_available() {
+#ifdef FUNNELKVS_SHA1_HARDWARE
+    if (hardware_supported()) {
+        return compress_hardware;
+    }
+#endif
+    return compress_portable;
+}
+
+std::atomic<CompressFn>& active_compress() {
+    static std::atomic<CompressFn> fn(best_available());
+    return fn;
+}
+
+} // namespace
+
 Hash160 SHA1::hash(const std::string& input) {
     return hash(reinterpret_cast<const uint8_t*>(input.data()), input.size());
 }
@@ -26,98 +231,44 @@ Hash160 SHA1::hash(const uint8_t* data, size_t length) {
         0x10325476,
         0xC3D2E1F0
     };
+    CompressFn compress = active_compress().load(std::memory_order_relaxed);
     
-    // Pre-processing: adding padding bits
-    uint64_t bit_len = length * 8;
-    size_t new_len = length + 1; // +1 for the '1' bit padding
-    
-    // Pad until message length in bits ≡ 448 (mod 512)
-    while (new_len % 64 != 56) {
-        new_len++;
-    }
-    
-    std::vector<uint8_t> padded_message(new_len + 8); // +8 for length
-    std::memcpy(padded_message.data(), data, length);
-    
-    padded_message[length] = 0x80; // Add '1' bit padding
-    
-    // Add original length in bits as 64-bit big-endian integer
-    for (int i = 0; i < 8; i++) {
-        padded_message[new_len + i] = (bit_len >> (8 * (7 - i))) & 0xFF;
-    }
+    // Whole blocks straight from the input, then the padded tail: the
+    // remaining bytes, a '1' bit, zeros and the 64-bit big-endian bit
+    // length, which takes one block or two
+    size_t full_blocks = length / 64;
+    compress(h, data, full_blocks);
     
-    // Process message in 512-bit chunks
-    for (size_t chunk_start = 0; chunk_start < padded_message.size(); chunk_start += 64) {
-        process_block(padded_message.data() + chunk_start, h);
+    size_t remaining = length - full_blocks * 64;
+    uint8_t tail[128] = {};
+    if (remaining > 0) {
+        std::memcpy(tail, data + full_blocks * 64, remaining);
     }
+    tail[remaining] = 0x80;
+    size_t tail_blocks = remaining < 56 ? 1 : 2;
+    uint64_t bit_len = static_cast<uint64_t>(length) * 8;
+    hash_detail::store_be64(tail + tail_blocks * 64 - 8, bit_len);
+    compress(h, tail, tail_blocks);
     
-    // Convert hash values to byte array
     Hash160 result;
     for (int i = 0; i < 5; i++) {
-        result[i * 4 + 0] = (h[i] >> 24) & 0xFF;
-        result[i * 4 + 1] = (h[i] >> 16) & 0xFF;
-        result[i * 4 + 2] = (h[i] >> 8) & 0xFF;
-        result[i * 4 + 3] = h[i] & 0xFF;
+        hash_detail::store_be32(result.data() + i * 4, h[i]);
     }
-    
     return result;
 }
 
-void SHA1::process_block(const uint8_t block[64], uint32_t h[5]) {
-    uint32_t w[80];
-    
-    // Break chunk into sixteen 32-bit big-endian words
-    for (int i = 0; i < 16; i++) {
-        w[i] = (block[i * 4] << 24) |
-               (block[i * 4 + 1] << 16) |
-               (block[i * 4 + 2] << 8) |
-               block[i * 4 + 3];
+const char* SHA1::implementation() {
+#ifdef FUNNELKVS_SHA1_HARDWARE
+    if (active_compress().load() == compress_hardware) {
+        return FUNNELKVS_SHA1_HARDWARE;
     }
-    
-    // Extend the sixteen 32-bit words into eighty 32-bit words
-    for (int i = 16; i < 80; i++) {
-        w[i] = left_rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
-    }
-    
-    // Initialize hash value for this chunk
-    uint32_t a = h[0];
-    uint32_t b = h[1];
-    uint32_t c = h[2];
-    uint32_t d = h[3];
-    uint32_t e = h[4];
-    
-    // Main loop
-    for (int i = 0; i < 80; i++) {
-        uint32_t f, k;
-        
-        if (i < 20) {
-            f = (b & c) | (~b & d);
-            k = 0x5A827999;
-        } else if (i < 40) {
-            f = b ^ c ^ d;
-            k = 0x6ED9EBA1;
-        } else if (i < 60) {
-            f = (b & c) | (b & d) | (c & d);
-            k = 0x8F1BBCDC;
-        } else {
-            f = b ^ c ^ d;
-            k = 0xCA62C1D6;
-        }
-        
-        uint32_t temp = left_rotate(a, 5) + f + e + k + w[i];
-        e = d;
-        d = c;
-        c = left_rotate(b, 30);
-        b = a;
-        a = temp;
-    }
-    
-    // Add this chunk's hash to result so far
-    h[0] += a;
-    h[1] += b;
-    h[2] += c;
-    h[3] += d;
-    h[4] += e;
+#endif
+    return "portable";
+}
+
+bool SHA1::use_hardware(bool enable) {
+    active_compress().store(enable ? best_available() : compress_portable);
+    return std::strcmp(implementation(), "portable") != 0;
 }
 
 std::string SHA1::to_string(const Hash160& hash) {
@@ -143,100 +294,72 @@ Hash160 SHA1::from_string(const std::string& hex_str) {
     return result;
 }
 
-// Comparison operators
-bool operator==(const Hash160& a, const Hash160& b) {
-    return std::memcmp(a.data(), b.data(), 20) == 0;
-}
-
-bool operator!=(const Hash160& a, const Hash160& b) {
-    return !(a == b);
-}
+// Chord-specific operations
+namespace {
 
-bool operator<(const Hash160& a, const Hash160& b) {
-    return std::memcmp(a.data(), b.data(), 20) < 0;
-}
+// A Hash160 as three big-endian words, most significant first
+struct Words {
+    uint64_t high;
+    uint64_t mid;
+    uint32_t low;
+};
 
-bool operator<=(const Hash160& a, const Hash160& b) {
-    return std::memcmp(a.data(), b.data(), 20) <= 0;
+Words load(const Hash160& h) {
+    Words w;
+    w.high = hash_detail::load_be64(h.data());
+    w.mid = hash_detail::load_be64(h.data() + 8);
+    w.low = hash_detail::load_be32(h.data() + 16);
+    return w;
 }
 
-bool operator>(const Hash160& a, const Hash160& b) {
-    return std::memcmp(a.data(), b.data(), 20) > 0;
+Hash160 store(const Words& w) {
+    Hash160 h;
+    hash_detail::store_be64(h.data(), w.high);
+    hash_detail::store_be64(h.data() + 8, w.mid);
+    hash_detail::store_be32(h.data() + 16, w.low);
+    return h;
 }
 
-bool operator>=(const Hash160& a, const Hash160& b) {
-    return std::memcmp(a.data(), b.data(), 20) >= 0;
-}
+} // namespace
 
-// Chord-specific operations
 Hash160 add_power_of_two(const Hash160& base, int power) {
     if (power < 0 || power >= 160) {
         return base; // Invalid power
     }
     
-    Hash160 result = base;
-    
-    // Calculate which byte and bit to modify
-    int byte_index = 19 - (power / 8);
-    int bit_index = power % 8;
-    
-    // Add 2^power (carry propagation)
-    bool carry = true;
-    for (int i = byte_index; i >= 0 && carry; i--) {
-        if (i == byte_index) {
-            uint16_t sum = result[i] + (1 << bit_index);
-            result[i] = sum & 0xFF;
-            carry = (sum > 0xFF);
-        } else {
-            uint16_t sum = result[i] + (carry ? 1 : 0);
-            result[i] = sum & 0xFF;
-            carry = (sum > 0xFF);
+    // Add 2^power to the word holding that bit and carry upwards; a carry
+    // out of the top word wraps around the ring
+    Words w = load(base);
+    if (power < 32) {
+        uint32_t low = w.low + (static_cast<uint32_t>(1) << power);
+        bool carry = low < w.low;
+        w.low = low;
+        if (carry && ++w.mid == 0) {
+            ++w.high;
         }
-    }
-    
-    return result;
-}
-
-bool in_range(const Hash160& id, const Hash160& start, const Hash160& end, bool inclusive_end) {
-    if (start == end) {
-        return inclusive_end ? (id == start) : false;
-    }
-    
-    if (start < end) {
-        // Normal range: start < end
-        return (id > start) && (inclusive_end ? (id <= end) : (id < end));
+    } else if (power < 96) {
+        uint64_t mid = w.mid + (static_cast<uint64_t>(1) << (power - 32));
+        if (mid < w.mid) {
+            ++w.high;
+        }
+        w.mid = mid;
     } else {
-        // Wrap-around range: start > end
-        return (id > start) || (inclusive_end ? (id <= end) : (id < end));
+        w.high += static_cast<uint64_t>(1) << (power - 96);
     }
+    return store(w);
 }
 
 Hash160 distance(const Hash160& from, const Hash160& to) {
-    if (to >= from) {
-        // Simple subtraction
-        Hash160 result = {};
-        bool borrow = false;
-        
-        for (int i = 19; i >= 0; i--) {
-            int diff = to[i] - from[i] - (borrow ? 1 : 0);
-            if (diff < 0) {
-                diff += 256;
-                borrow = true;
-            } else {
-                borrow = false;
-            }
-            result[i] = static_cast<uint8_t>(diff);
-        }
-        return result;
-    } else {
-        // Wrap-around: calculate (2^160 - from) + to
-        Hash160 max_hash = {};
-        std::memset(max_hash.data(), 0xFF, 20);
-        
-        // Calculate max_hash - from + 1 + to
-        Hash160 temp = distance(from, max_hash);
-        return add_power_of_two(distance({}, to), 0); // Simplified for wrap-around
-    }
+    // Unsigned subtraction with borrow wraps modulo 2^160 by itself
+    Words a = load(to);
+    Words b = load(from);
+    Words d;
+    d.low = a.low - b.low;
+    uint64_t borrow = a.low < b.low ? 1 : 0;
+    d.mid = a.mid - b.mid - borrow;
+    borrow = (a.mid < b.mid || (a.mid == b.mid && borrow)) ? 1 : 0;
+    d.high = a.high - b.high - borrow;
+    return store(d);
 }
 
 } // namespace funnelkvs
\ No newline at end of file
@@ -0,0 +1,25 @@
+#include "heartbeat.h"
+
+namespace funnelkvs {
+
+HeartbeatRegistry& HeartbeatRegistry::instance() {
+    static HeartbeatRegistry registry;
+    return registry;
+}
+
+HeartbeatRegistry::Slot* HeartbeatRegistry::slot(const std::string& peer_key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<Slot>& entry = slots[peer_key];
+    if (!entry) {
+        entry.reset(new Slot(0));
+    }
+    return entry.get();
+}
+
+int64_t HeartbeatRegistry::last_heard(const std::string& peer_key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = slots.find(peer_key);
+    return it == slots.end() ? 0 : it->second->load(std::memory_order_relaxed);
+}
+
+} // namespace funnelkvs
@@ -0,0 +1,90 @@
+#include "histogram.h"
+
+namespace funnelkvs {
+
+Histogram::Histogram() : total(0), max_value(0) {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t Histogram::bucket_for(uint64_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    return 64 - static_cast<size_t>(__builtin_clzll(value));
+}
+
+uint64_t Histogram::bucket_upper_bound(size_t bucket) {
+    if (bucket == 0) {
+        return 0;
+    }
+    if (bucket >= 64) {
+        return UINT64_MAX;
+    }
+    return (static_cast<uint64_t>(1) << bucket) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+    buckets[bucket_for(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(value, std::memory_order_relaxed);
+    
+    uint64_t current = max_value.load(std::memory_order_relaxed);
+    while (value > current &&
+           !max_value.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    snap.buckets.resize(NUM_BUCKETS);
+    snap.count = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        snap.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        snap.count += snap.buckets[i];
+    }
+    snap.sum = total.load(std::memory_order_relaxed);
+    snap.max = max_value.load(std::memory_order_relaxed);
+    return snap;
+}
+
+void Histogram::reset() {
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Snapshot::percentile(double p) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p * count);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+void Histogram::Snapshot::merge(const Snapshot& other) {
+    if (buckets.size() < other.buckets.size()) {
+        buckets.resize(other.buckets.size(), 0);
+    }
+    for (size_t i = 0; i < other.buckets.size(); ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    max = max > other.max ? max : other.max;
+}
+
+} // namespace funnelkvs
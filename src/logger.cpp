@@ -0,0 +1,198 @@
+#include "logger.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+namespace funnelkvs {
+
+constexpr size_t Logger::RING_CAPACITY;
+
+namespace {
+
+// Backstop for a wakeup lost between the writer's last check and its sleep
+const std::chrono::milliseconds WRITER_IDLE_WAIT(50);
+const std::chrono::milliseconds FLUSH_TIMEOUT(2000);
+
+void flush_at_exit() {
+    Logger::instance().flush();
+}
+
+void append_timestamp(std::string& out, std::chrono::system_clock::time_point time) {
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch()).count() % 1000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char buffer[32];
+    int n = std::snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d.%03d ",
+                          local.tm_hour, local.tm_min, local.tm_sec, millis);
+    out.append(buffer, static_cast<size_t>(n));
+}
+
+} // namespace
+
+Logger& Logger::instance() {
+    static Logger* logger = [] {
+        Logger* created = new Logger();
+        std::atexit(flush_at_exit);
+        return created;
+    }();
+    return *logger;
+}
+
+Logger::Logger()
+    : ring(new Slot[RING_CAPACITY]), enqueue_pos(0), dequeue_pos(0),
+      min_level(static_cast<uint8_t>(LogLevel::INFO)), written(0), dropped(0),
+      out_stream(stdout), err_stream(stderr), writer_sleeping(false), flushed_pos(0) {
+    for (size_t i = 0; i < RING_CAPACITY; ++i) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer = std::thread(&Logger::run, this);
+}
+
+void Logger::redirect(std::FILE* out, std::FILE* err) {
+    flush();
+    out_stream.store(out, std::memory_order_release);
+    err_stream.store(err, std::memory_order_release);
+}
+
+void Logger::log(LogLevel level, std::string&& message) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &ring[pos & (RING_CAPACITY - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed); // full
+            return;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->time = std::chrono::system_clock::now();
+    slot->message = std::move(message);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Pairs with the fence in run(): either the writer sees this line when
+    // it rechecks, or we see that it is going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writer_sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake_cv.notify_one();
+    }
+}
+
+size_t Logger::drain(std::string& out, std::string& err) {
+    size_t count = 0;
+    while (count < RING_CAPACITY) {
+        Slot& slot = ring[dequeue_pos & (RING_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+            break;
+        }
+        std::string& target = slot.level >= LogLevel::WARN ? err : out;
+        append_timestamp(target, slot.time);
+        target += level_name(slot.level);
+        target += ' ';
+        target += slot.message;
+        target += '\n';
+        std::string().swap(slot.message);
+        slot.sequence.store(dequeue_pos + RING_CAPACITY, std::memory_order_release);
+        ++dequeue_pos;
+        ++count;
+    }
+    return count;
+}
+
+void Logger::run() {
+    std::string out;
+    std::string err;
+    while (true) {
+        size_t count = drain(out, err);
+        if (!out.empty()) {
+            std::FILE* stream = out_stream.load(std::memory_order_acquire);
+            std::fwrite(out.data(), 1, out.size(), stream);
+            std::fflush(stream);
+            out.clear();
+        }
+        if (!err.empty()) {
+            std::FILE* stream = err_stream.load(std::memory_order_acquire);
+            std::fwrite(err.data(), 1, err.size(), stream);
+            std::fflush(stream);
+            err.clear();
+        }
+        if (count > 0) {
+            written.fetch_add(count, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                flushed_pos.store(dequeue_pos, std::memory_order_relaxed);
+            }
+            drained_cv.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        writer_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const Slot& next = ring[dequeue_pos & (RING_CAPACITY - 1)];
+        if (next.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+            wake_cv.wait_for(lock, WRITER_IDLE_WAIT);
+        }
+        writer_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void Logger::flush() {
+    uint64_t target = enqueue_pos.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    wake_cv.notify_one();
+    drained_cv.wait_for(lock, FLUSH_TIMEOUT, [this, target] {
+        return flushed_pos.load(std::memory_order_relaxed) >= target;
+    });
+}
+
+Logger::Stats Logger::stats() const {
+    Stats stats;
+    stats.written = written.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool Logger::parse_level(const std::string& name, LogLevel& level) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    const LogLevel levels[] = {LogLevel::DEBUG, LogLevel::INFO, LogLevel::WARN,
+                               LogLevel::ERROR, LogLevel::OFF};
+    for (LogLevel candidate : levels) {
+        std::string candidate_name(level_name(candidate));
+        std::transform(candidate_name.begin(), candidate_name.end(), candidate_name.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (lower == candidate_name) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* Logger::level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::WARN: return "WARN";
+        case LogLevel::ERROR: return "ERROR";
+        case LogLevel::OFF: return "OFF";
+    }
+    return "?";
+}
+
+} // namespace funnelkvs
@@ -0,0 +1,85 @@
+#include "merkle.h"
+#include <cstring>
+
+namespace funnelkvs {
+
+constexpr int MerkleTree::FANOUT_BITS;
+constexpr size_t MerkleTree::FANOUT;
+constexpr int MerkleTree::DEPTH;
+constexpr int MerkleTree::LEAF_BITS;
+constexpr size_t MerkleTree::LEAVES;
+
+MerkleTree::MerkleTree() {
+    size_t total = level_offset(DEPTH + 1);
+    nodes.reset(new std::atomic<uint64_t>[total]);
+    for (size_t i = 0; i < total; ++i) {
+        nodes[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t MerkleTree::level_offset(int level) {
+    // 1 + FANOUT + FANOUT^2 + ... for the levels above
+    return (level_size(level) - 1) / (FANOUT - 1);
+}
+
+namespace {
+
+// MurmurHash64A's inner mix, applied eight bytes at a time
+inline uint64_t mix_bytes(uint64_t h, const uint8_t* p, size_t n) {
+    const uint64_t m = 0xC6A4A7935BD1E995ULL;
+    const int r = 47;
+    h ^= n * m;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t k;
+        std::memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (n > 0) {
+        uint64_t k = 0;
+        std::memcpy(&k, p, n);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+} // namespace
+
+uint64_t MerkleTree::entry_digest(const char* key, size_t key_size,
+                                  const uint8_t* value, size_t value_size, uint64_t expires) {
+    uint64_t h = mix_bytes(0x9E3779B97F4A7C15ULL, reinterpret_cast<const uint8_t*>(key), key_size);
+    h = mix_bytes(h, value, value_size);
+    if (expires != 0) {
+        uint8_t bytes[8];
+        hash_detail::store_be64(bytes, expires);
+        h = mix_bytes(h, bytes, sizeof(bytes));
+    }
+    return h;
+}
+
+Hash160 MerkleTree::leaf_start(size_t leaf) {
+    Hash160 id{};
+    hash_detail::store_be32(id.data(), static_cast<uint32_t>(leaf) << (32 - LEAF_BITS));
+    return id;
+}
+
+uint64_t MerkleTree::node(int level, size_t index) const {
+    return nodes[level_offset(level) + index].load(std::memory_order_relaxed);
+}
+
+void MerkleTree::adjust(size_t leaf, uint64_t delta) {
+    size_t index = leaf;
+    for (int level = DEPTH; level >= 0; --level) {
+        nodes[level_offset(level) + index].fetch_add(delta, std::memory_order_relaxed);
+        index >>= FANOUT_BITS;
+    }
+}
+
+} // namespace funnelkvs
@@ -0,0 +1,132 @@
+#include "metrics.h"
+#include <sstream>
+
+namespace funnelkvs {
+
+constexpr size_t RequestMetrics::STRIPES;
+
+RequestMetrics::RequestMetrics() {
+    for (auto& stripe : stripes) {
+        for (auto& op : stripe.ops) {
+            op.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+}
+
+RequestMetrics::~RequestMetrics() {
+    for (auto& stripe : stripes) {
+        for (auto& op : stripe.ops) {
+            delete op.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t RequestMetrics::stripe_index() {
+    static std::atomic<size_t> next_stripe(0);
+    static thread_local size_t index = next_stripe.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    return index;
+}
+
+RequestMetrics::OpCounters& RequestMetrics::counters(Stripe& stripe, OpCode opcode) {
+    std::atomic<OpCounters*>& slot = stripe.ops[static_cast<uint8_t>(opcode)];
+    OpCounters* op = slot.load(std::memory_order_acquire);
+    if (op) {
+        return *op;
+    }
+    // Two threads can share a stripe, so the first one to publish wins
+    OpCounters* created = new OpCounters();
+    if (slot.compare_exchange_strong(op, created, std::memory_order_acq_rel)) {
+        return *created;
+    }
+    delete created;
+    return *op;
+}
+
+void RequestMetrics::record(OpCode opcode, StatusCode status, size_t bytes_in, size_t bytes_out,
+                            uint64_t latency_us) {
+    OpCounters& op = counters(stripes[stripe_index()], opcode);
+    op.latency_us.record(latency_us);
+    op.bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+    op.bytes_out.fetch_add(bytes_out, std::memory_order_relaxed);
+    if (status == StatusCode::ERROR) {
+        op.errors.fetch_add(1, std::memory_order_relaxed);
+    } else if (status == StatusCode::REDIRECT) {
+        op.redirects.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::vector<RequestMetrics::OpSnapshot> RequestMetrics::snapshot() const {
+    std::vector<OpSnapshot> result;
+    for (size_t code = 0; code < 256; ++code) {
+        OpSnapshot merged = OpSnapshot();
+        merged.opcode = static_cast<OpCode>(code);
+        bool seen = false;
+        for (const auto& stripe : stripes) {
+            const OpCounters* op = stripe.ops[code].load(std::memory_order_acquire);
+            if (!op) {
+                continue;
+            }
+            seen = true;
+            merged.errors += op->errors.load(std::memory_order_relaxed);
+            merged.redirects += op->redirects.load(std::memory_order_relaxed);
+            merged.bytes_in += op->bytes_in.load(std::memory_order_relaxed);
+            merged.bytes_out += op->bytes_out.load(std::memory_order_relaxed);
+            merged.latency_us.merge(op->latency_us.snapshot());
+        }
+        if (seen) {
+            result.push_back(merged);
+        }
+    }
+    return result;
+}
+
+void StatsReport::add(const std::string& name, uint64_t value) {
+    values.emplace_back(name, std::to_string(value));
+}
+
+void StatsReport::add(const std::string& name, double value) {
+    std::ostringstream out;
+    out.precision(3);
+    out << std::fixed << value;
+    values.emplace_back(name, out.str());
+}
+
+void StatsReport::add(const std::string& name, const std::string& value) {
+    values.emplace_back(name, value);
+}
+
+void StatsReport::add_latency(const std::string& name, const Histogram::Snapshot& latency_us) {
+    add(name + ".count", latency_us.count);
+    add(name + ".mean_us", latency_us.mean());
+    add(name + ".p50_us", latency_us.percentile(0.50));
+    add(name + ".p99_us", latency_us.percentile(0.99));
+    add(name + ".p999_us", latency_us.percentile(0.999));
+    add(name + ".max_us", latency_us.max);
+}
+
+std::string StatsReport::to_text() const {
+    std::string text;
+    for (const auto& entry : values) {
+        text += entry.first;
+        text += ' ';
+        text += entry.second;
+        text += '\n';
+    }
+    return text;
+}
+
+StatsReport::Entries StatsReport::parse(const std::string& text) {
+    Entries entries;
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos || space == 0) {
+            continue;
+        }
+        entries.emplace_back(line.substr(0, space), line.substr(space + 1));
+    }
+    return entries;
+}
+
+} // namespace funnelkvs
@@ -0,0 +1,719 @@
+#include "persistence.h"
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace funnelkvs {
+
+constexpr size_t Persistence::DEFAULT_SNAPSHOT_BYTES;
+constexpr size_t Persistence::DEFAULT_SEGMENT_BYTES;
+
+namespace {
+
+// Log record: u32 body length, u32 CRC-32 of the body, then the body:
+// u64 record number, u8 type and the type's payload.
+//   PUT:    id[20], u32 key length, u32 value length, key, value
+//   REMOVE: u32 key length, key
+//   CLEAR:  nothing
+//   PUT_VERSIONED: id[20], u64 version, then as PUT
+//   PUT_COMPRESSED: as PUT_VERSIONED, with the value in Compression form
+//   PUT_EXPIRING: id[20], u64 version, u8 flags (ENTRY_COMPRESSED),
+//                 u64 expiry time, u32 key length, u32 value length, key, value
+// Logs written before versions hold plain PUTs, replayed as version 0.
+// Only entries that expire are logged as PUT_EXPIRING.
+const uint8_t RECORD_PUT = 1;
+const uint8_t RECORD_REMOVE = 2;
+const uint8_t RECORD_CLEAR = 3;
+const uint8_t RECORD_PUT_VERSIONED = 4;
+const uint8_t RECORD_PUT_COMPRESSED = 5;
+const uint8_t RECORD_PUT_EXPIRING = 6;
+const size_t FRAME_HEADER = 8;
+const size_t BODY_HEADER = 9;
+
+// Snapshot: magic, u64 last record number included, entries (id[20],
+// u64 version, u8 flags, u32 key length, u32 value length, key, value),
+// u64 entry count, and a CRC-32 of everything before it. An entry flagged
+// ENTRY_EXPIRES has its u64 expiry time between the header and the key.
+// Version 3 snapshots have no expiry times, version 2 snapshots no flags
+// byte, and version 1 snapshots no version either; they still load,
+// as entries that never expire, uncompressed, version 0.
+const char SNAPSHOT_MAGIC[8] = {'F', 'K', 'V', 'S', 'N', 'A', 'P', '4'};
+const char SNAPSHOT_MAGIC_V3[8] = {'F', 'K', 'V', 'S', 'N', 'A', 'P', '3'};
+const char SNAPSHOT_MAGIC_V2[8] = {'F', 'K', 'V', 'S', 'N', 'A', 'P', '2'};
+const char SNAPSHOT_MAGIC_V1[8] = {'F', 'K', 'V', 'S', 'N', 'A', 'P', '1'};
+const size_t SNAPSHOT_TRAILER = 12;
+const size_t ENTRY_HEADER = 28;
+const size_t VERSIONED_ENTRY_HEADER = 36;
+const size_t FLAGGED_ENTRY_HEADER = 37;
+const size_t EXPIRING_RECORD_HEADER = 45;
+const uint8_t ENTRY_COMPRESSED = 1;
+const uint8_t ENTRY_EXPIRES = 2;
+
+const size_t SNAPSHOT_BUFFER = 1024 * 1024;
+
+struct Crc32Table {
+    uint32_t entries[256];
+
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+// CRC-32 (IEEE), continuing from crc
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size) {
+    static const Crc32Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+}
+
+void store_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+uint32_t get_u32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+bool write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Read-only mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(int fd) : data(nullptr), size(0) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<const uint8_t*>(p);
+                size = static_cast<size_t>(st.st_size);
+                ::madvise(p, size, MADV_SEQUENTIAL);
+            }
+        }
+    }
+    ~MappedFile() {
+        if (data) {
+            ::munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data;
+    size_t size;
+};
+
+// Buffered snapshot output with a running checksum
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(int f) : fd(f), crc(0), ok(true) {
+        buffer.reserve(SNAPSHOT_BUFFER);
+    }
+
+    void put(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        crc = crc32_update(crc, bytes, size);
+        if (buffer.size() + size > SNAPSHOT_BUFFER) {
+            flush();
+        }
+        if (size > SNAPSHOT_BUFFER) {
+            ok = ok && write_all(fd, bytes, size);
+            return;
+        }
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    void put_u32(uint32_t v) {
+        uint8_t b[4];
+        store_u32(b, v);
+        put(b, 4);
+    }
+
+    void put_u64(uint64_t v) {
+        put_u32(static_cast<uint32_t>(v));
+        put_u32(static_cast<uint32_t>(v >> 32));
+    }
+
+    bool finish() {
+        uint8_t b[4];
+        store_u32(b, crc);
+        buffer.insert(buffer.end(), b, b + 4);
+        flush();
+        return ok;
+    }
+
+private:
+    int fd;
+    uint32_t crc;
+    bool ok;
+    std::vector<uint8_t> buffer;
+
+    void flush() {
+        ok = ok && write_all(fd, buffer.data(), buffer.size());
+        buffer.clear();
+    }
+};
+
+} // namespace
+
+Persistence::Persistence(const std::string& dir, size_t snapshot_threshold, size_t segment_limit)
+    : directory(dir)
+    , snapshot_bytes(snapshot_threshold)
+    , segment_bytes(segment_limit)
+    , storage(nullptr)
+    , pending_first_seq(0)
+    , last_seq(0)
+    , durable_seq(0)
+    , failed(false)
+    , running(false)
+    , stopping(false)
+    , stats()
+    , segment_fd(-1)
+    , segment_size(0)
+{
+    if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create data directory " + directory + ": " + std::strerror(errno));
+    }
+}
+
+Persistence::~Persistence() {
+    stop();
+    close_segment();
+}
+
+std::string Persistence::segment_path(uint64_t first_seq) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "wal-%016llx.log", static_cast<unsigned long long>(first_seq));
+    return directory + "/" + name;
+}
+
+std::string Persistence::snapshot_path() const {
+    return directory + "/snapshot";
+}
+
+Persistence::RecoveryStats Persistence::recover(Storage& target) {
+    auto started = std::chrono::steady_clock::now();
+    RecoveryStats result = RecoveryStats();
+    uint64_t covered = load_snapshot(target, result);
+    last_seq = covered;
+
+    std::vector<uint64_t> found;
+    DIR* dir = ::opendir(directory.c_str());
+    if (dir) {
+        while (struct dirent* entry = ::readdir(dir)) {
+            unsigned long long first = 0;
+            char tail[8] = {0};
+            if (std::sscanf(entry->d_name, "wal-%16llx.%4s", &first, tail) == 2 &&
+                std::strcmp(tail, "log") == 0) {
+                found.push_back(static_cast<uint64_t>(first));
+            }
+        }
+        ::closedir(dir);
+    }
+    std::sort(found.begin(), found.end());
+
+    for (size_t i = 0; i < found.size(); ++i) {
+        if (!replay_segment(segment_path(found[i]), covered, target, result)) {
+            // Nothing after a damaged record can be applied in order
+            for (size_t j = i + 1; j < found.size(); ++j) {
+                ::unlink(segment_path(found[j]).c_str());
+            }
+            found.resize(i + 1);
+            break;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex);
+        segments = found;
+    }
+    durable_seq = last_seq;
+    result.elapsed_ms = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count());
+    return result;
+}
+
+uint64_t Persistence::load_snapshot(Storage& target, RecoveryStats& result) {
+    int fd = ::open(snapshot_path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    MappedFile file(fd);
+    ::close(fd);
+
+    const uint8_t* data = file.data;
+    size_t size = file.size;
+    if (!data || size < sizeof(SNAPSHOT_MAGIC) + 8 + SNAPSHOT_TRAILER ||
+        (std::memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 &&
+         std::memcmp(data, SNAPSHOT_MAGIC_V3, sizeof(SNAPSHOT_MAGIC_V3)) != 0 &&
+         std::memcmp(data, SNAPSHOT_MAGIC_V2, sizeof(SNAPSHOT_MAGIC_V2)) != 0 &&
+         std::memcmp(data, SNAPSHOT_MAGIC_V1, sizeof(SNAPSHOT_MAGIC_V1)) != 0) ||
+        crc32_update(0, data, size - 4) != get_u32(data + size - 4)) {
+        throw std::runtime_error("Corrupt snapshot in " + directory);
+    }
+    bool expiring = std::memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+    bool flagged = expiring || std::memcmp(data, SNAPSHOT_MAGIC_V3, sizeof(SNAPSHOT_MAGIC_V3)) == 0;
+    bool versioned = flagged || std::memcmp(data, SNAPSHOT_MAGIC_V2, sizeof(SNAPSHOT_MAGIC_V2)) == 0;
+    size_t header = flagged ? FLAGGED_ENTRY_HEADER : versioned ? VERSIONED_ENTRY_HEADER : ENTRY_HEADER;
+
+    uint64_t covered = get_u64(data + sizeof(SNAPSHOT_MAGIC));
+    size_t end = size - SNAPSHOT_TRAILER;
+    size_t offset = sizeof(SNAPSHOT_MAGIC) + 8;
+    size_t entries = 0;
+    while (offset < end) {
+        if (end - offset < header) {
+            throw std::runtime_error("Corrupt snapshot in " + directory);
+        }
+        Hash160 id;
+        std::memcpy(id.data(), data + offset, id.size());
+        uint64_t version = versioned ? get_u64(data + offset + 20) : 0;
+        uint8_t flags = flagged ? data[offset + 28] : 0;
+        size_t key_size = get_u32(data + offset + header - 8);
+        size_t value_size = get_u32(data + offset + header - 4);
+        offset += header;
+        uint64_t expires = 0;
+        if (expiring && (flags & ENTRY_EXPIRES) != 0) {
+            if (end - offset < 8) {
+                throw std::runtime_error("Corrupt snapshot in " + directory);
+            }
+            expires = get_u64(data + offset);
+            offset += 8;
+        }
+        if (end - offset < key_size + value_size) {
+            throw std::runtime_error("Corrupt snapshot in " + directory);
+        }
+        const char* key = reinterpret_cast<const char*>(data + offset);
+        const uint8_t* value = data + offset + key_size;
+        target.restore(std::string(key, key_size), id, std::vector<uint8_t>(value, value + value_size),
+                       version, (flags & ENTRY_COMPRESSED) != 0, expires);
+        offset += key_size + value_size;
+        entries++;
+    }
+    if (entries != get_u64(data + end)) {
+        throw std::runtime_error("Corrupt snapshot in " + directory);
+    }
+    result.snapshot_entries = entries;
+    return covered;
+}
+
+bool Persistence::replay_segment(const std::string& path, uint64_t after_seq, Storage& target,
+                                 RecoveryStats& result) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return true;
+    }
+    size_t offset = 0;
+    bool intact = true;
+    {
+        MappedFile file(fd);
+        const uint8_t* data = file.data;
+        size_t size = file.size;
+        while (offset < size) {
+            if (size - offset < FRAME_HEADER) {
+                intact = false;
+                break;
+            }
+            size_t length = get_u32(data + offset);
+            uint32_t crc = get_u32(data + offset + 4);
+            const uint8_t* body = data + offset + FRAME_HEADER;
+            if (length < BODY_HEADER || length > size - offset - FRAME_HEADER ||
+                crc32_update(0, body, length) != crc) {
+                intact = false;
+                break;
+            }
+
+            uint64_t seq = get_u64(body);
+            uint8_t type = body[8];
+            const uint8_t* payload = body + BODY_HEADER;
+            size_t payload_size = length - BODY_HEADER;
+            if (seq > after_seq) {
+                bool expiring = type == RECORD_PUT_EXPIRING;
+                bool versioned = expiring || type == RECORD_PUT_VERSIONED || type == RECORD_PUT_COMPRESSED;
+                size_t header = expiring ? EXPIRING_RECORD_HEADER :
+                                versioned ? VERSIONED_ENTRY_HEADER : ENTRY_HEADER;
+                if ((type == RECORD_PUT || versioned) && payload_size >= header) {
+                    Hash160 id;
+                    std::memcpy(id.data(), payload, id.size());
+                    uint64_t version = versioned ? get_u64(payload + 20) : 0;
+                    bool compressed = expiring ? (payload[28] & ENTRY_COMPRESSED) != 0 :
+                                      type == RECORD_PUT_COMPRESSED;
+                    uint64_t expires = expiring ? get_u64(payload + 29) : 0;
+                    size_t key_size = get_u32(payload + header - 8);
+                    size_t value_size = get_u32(payload + header - 4);
+                    if (payload_size != header + key_size + value_size) {
+                        intact = false;
+                        break;
+                    }
+                    const char* key = reinterpret_cast<const char*>(payload + header);
+                    const uint8_t* value = payload + header + key_size;
+                    target.restore(std::string(key, key_size), id,
+                                   std::vector<uint8_t>(value, value + value_size), version,
+                                   compressed, expires);
+                } else if (type == RECORD_REMOVE && payload_size >= 4 &&
+                           payload_size == 4 + get_u32(payload)) {
+                    target.remove(std::string(reinterpret_cast<const char*>(payload + 4), payload_size - 4));
+                } else if (type == RECORD_CLEAR && payload_size == 0) {
+                    target.clear();
+                } else {
+                    intact = false;
+                    break;
+                }
+                result.log_records++;
+                last_seq = std::max(last_seq, seq);
+            }
+            offset += FRAME_HEADER + length;
+        }
+    }
+    if (!intact) {
+        // A torn write from a crash: drop it and anything after it
+        FKVS_WARN("Persistence: discarding damaged log tail of " << path
+                  << " at offset " << offset);
+        if (::ftruncate(fd, static_cast<off_t>(offset)) == 0) {
+            ::fsync(fd);
+        }
+        result.truncated = true;
+    }
+    ::close(fd);
+    return intact;
+}
+
+void Persistence::start(Storage& target) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return;
+    }
+    storage = &target;
+    running = true;
+    stopping = false;
+    stats = Stats();
+    flusher = std::thread(&Persistence::flush_loop, this);
+    snapshotter = std::thread(&Persistence::snapshot_loop, this);
+    storage->set_journal(this);
+}
+
+void Persistence::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    storage->set_journal(nullptr);
+    flush_cv.notify_all();
+    snapshot_cv.notify_all();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+    if (snapshotter.joinable()) {
+        snapshotter.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        stopping = false;
+        if (!failed) {
+            durable_seq = last_seq;
+        }
+    }
+    durable_cv.notify_all();
+}
+
+uint64_t Persistence::append(uint8_t type, const std::string& key, const Hash160* id,
+                             const std::vector<uint8_t>* value, uint64_t version,
+                             bool compressed, uint64_t expires) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!running) {
+        return 0;
+    }
+    uint64_t seq = ++last_seq;
+    if (pending.empty()) {
+        pending_first_seq = seq;
+    }
+
+    size_t frame = pending.size();
+    pending.resize(frame + FRAME_HEADER);
+    put_u64(pending, seq);
+    pending.push_back(type);
+    if (type == RECORD_PUT_VERSIONED || type == RECORD_PUT_COMPRESSED || type == RECORD_PUT_EXPIRING) {
+        pending.insert(pending.end(), id->begin(), id->end());
+        put_u64(pending, version);
+        if (type == RECORD_PUT_EXPIRING) {
+            pending.push_back(compressed ? ENTRY_COMPRESSED : 0);
+            put_u64(pending, expires);
+        }
+        put_u32(pending, static_cast<uint32_t>(key.size()));
+        put_u32(pending, static_cast<uint32_t>(value->size()));
+        pending.insert(pending.end(), key.begin(), key.end());
+        pending.insert(pending.end(), value->begin(), value->end());
+    } else if (type == RECORD_REMOVE) {
+        put_u32(pending, static_cast<uint32_t>(key.size()));
+        pending.insert(pending.end(), key.begin(), key.end());
+    }
+    size_t length = pending.size() - frame - FRAME_HEADER;
+    store_u32(&pending[frame], static_cast<uint32_t>(length));
+    store_u32(&pending[frame + 4], crc32_update(0, &pending[frame + FRAME_HEADER], length));
+    stats.records++;
+
+    flush_cv.notify_one();
+    return seq;
+}
+
+uint64_t Persistence::log_put(const std::string& key, const Hash160& id,
+                              const std::vector<uint8_t>& value, uint64_t version, bool compressed,
+                              uint64_t expires) {
+    if (expires != 0) {
+        return append(RECORD_PUT_EXPIRING, key, &id, &value, version, compressed, expires);
+    }
+    return append(compressed ? RECORD_PUT_COMPRESSED : RECORD_PUT_VERSIONED, key, &id, &value, version);
+}
+
+uint64_t Persistence::log_remove(const std::string& key) {
+    return append(RECORD_REMOVE, key, nullptr, nullptr, 0);
+}
+
+uint64_t Persistence::log_clear() {
+    return append(RECORD_CLEAR, std::string(), nullptr, nullptr, 0);
+}
+
+bool Persistence::sync(uint64_t ticket) {
+    if (ticket == 0) {
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    durable_cv.wait(lock, [this, ticket] { return durable_seq >= ticket || failed || !running; });
+    return durable_seq >= ticket;
+}
+
+void Persistence::flush_loop() {
+    std::vector<uint8_t> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        flush_cv.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            break;
+        }
+        // Everything appended while the previous batch was being synced
+        // goes out in this one
+        batch.swap(pending);
+        uint64_t first = pending_first_seq;
+        uint64_t target = last_seq;
+        lock.unlock();
+
+        // After a failure nothing more is written: a record past a hole
+        // or a torn one would be lost on recovery anyway
+        bool written = !failed && write_batch(batch, first);
+
+        lock.lock();
+        if (written) {
+            durable_seq = target;
+            stats.syncs++;
+            stats.log_bytes += batch.size();
+            if (stats.log_bytes >= snapshot_bytes) {
+                snapshot_cv.notify_one();
+            }
+        } else if (!failed) {
+            FKVS_ERROR("Persistence: log in " << directory
+                       << " failed; no further changes will be acknowledged as durable");
+            failed = true;
+        }
+        durable_cv.notify_all();
+        batch.clear();
+    }
+}
+
+bool Persistence::write_batch(const std::vector<uint8_t>& batch, uint64_t first_seq) {
+    if (segment_fd < 0 || segment_size >= segment_bytes) {
+        close_segment();
+        if (!open_segment(first_seq)) {
+            return false;
+        }
+    }
+    if (!write_all(segment_fd, batch.data(), batch.size()) || ::fdatasync(segment_fd) != 0) {
+        FKVS_ERROR("Persistence: log write failed: " << std::strerror(errno));
+        return false;
+    }
+    segment_size += batch.size();
+    return true;
+}
+
+bool Persistence::open_segment(uint64_t first_seq) {
+    std::string path = segment_path(first_seq);
+    segment_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment_fd < 0) {
+        FKVS_WARN("Persistence: cannot open " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    segment_size = 0;
+    sync_directory(directory);
+    std::lock_guard<std::mutex> lock(segments_mutex);
+    if (segments.empty() || segments.back() != first_seq) {
+        segments.push_back(first_seq);
+    }
+    return true;
+}
+
+void Persistence::close_segment() {
+    if (segment_fd >= 0) {
+        ::close(segment_fd);
+        segment_fd = -1;
+    }
+}
+
+void Persistence::snapshot_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        snapshot_cv.wait(lock, [this] { return stopping || stats.log_bytes >= snapshot_bytes; });
+        if (stopping) {
+            break;
+        }
+        lock.unlock();
+        snapshot();
+        lock.lock();
+    }
+}
+
+bool Persistence::snapshot() {
+    std::lock_guard<std::mutex> guard(snapshot_mutex);
+    if (!storage) {
+        return false;
+    }
+
+    // Every change numbered up to covered was applied before it was logged,
+    // under its shard's lock, so the shard-by-shard copy below includes it
+    uint64_t covered;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        covered = last_seq;
+        stats.log_bytes = 0;
+    }
+
+    std::string temp = snapshot_path() + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        FKVS_WARN("Persistence: cannot create " << temp << ": " << std::strerror(errno));
+        return false;
+    }
+
+    SnapshotWriter writer(fd);
+    writer.put(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writer.put_u64(covered);
+    uint64_t count = 0;
+    for (size_t i = 0; i < storage->shard_count(); ++i) {
+        storage->visit_shard(i, [&writer, &count](const char* key, size_t key_size, const Hash160& id,
+                                                  uint64_t version, bool compressed, uint64_t expires,
+                                                  const uint8_t* value, size_t value_size) {
+            writer.put(id.data(), id.size());
+            writer.put_u64(version);
+            uint8_t flags = (compressed ? ENTRY_COMPRESSED : 0) | (expires != 0 ? ENTRY_EXPIRES : 0);
+            writer.put(&flags, 1);
+            writer.put_u32(static_cast<uint32_t>(key_size));
+            writer.put_u32(static_cast<uint32_t>(value_size));
+            if (expires != 0) {
+                writer.put_u64(expires);
+            }
+            writer.put(key, key_size);
+            writer.put(value, value_size);
+            count++;
+        });
+    }
+    writer.put_u64(count);
+    bool ok = writer.finish() && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(temp.c_str(), snapshot_path().c_str()) != 0) {
+        FKVS_ERROR("Persistence: snapshot failed: " << std::strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+    sync_directory(directory);
+
+    remove_covered_segments(covered);
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.snapshots++;
+    return true;
+}
+
+void Persistence::remove_covered_segments(uint64_t covered_seq) {
+    // A segment ends where the next one begins, so the segment being
+    // written (the last) is never removed
+    std::lock_guard<std::mutex> lock(segments_mutex);
+    size_t removable = 0;
+    while (removable + 1 < segments.size() && segments[removable + 1] - 1 <= covered_seq) {
+        ::unlink(segment_path(segments[removable]).c_str());
+        removable++;
+    }
+    segments.erase(segments.begin(), segments.begin() + removable);
+}
+
+Persistence::Stats Persistence::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = stats;
+    result.failed = failed;
+    return result;
+}
+
+} // namespace funnelkvs
@@ -1,8 +1,22 @@
 #include "protocol.h"
 #include <algorithm>
+#include <cstring>
 
 namespace funnelkvs {
 
+constexpr size_t Protocol::MAX_FRAME_SIZE;
+constexpr size_t Protocol::REQUEST_HEADER_SIZE;
+constexpr size_t Protocol::RESPONSE_HEADER_SIZE;
+constexpr uint8_t Protocol::COMPRESSED_FLAG;
+constexpr uint8_t Protocol::VALUE_COMPRESSED;
+constexpr uint8_t Protocol::VALUE_EXPIRES;
+constexpr uint8_t Protocol::SCAN_LOCAL;
+constexpr uint8_t Protocol::BATCH_FORWARDED;
+constexpr uint64_t Protocol::MAX_TTL_MS;
+constexpr uint32_t Protocol::SCAN_DEFAULT_ENTRIES;
+constexpr uint32_t Protocol::SCAN_MAX_ENTRIES;
+constexpr uint32_t Protocol::SCAN_MAX_BYTES;
+
 void Protocol::writeUint32(std::vector<uint8_t>& buffer, uint32_t value) {
     buffer.push_back((value >> 24) & 0xFF);
     buffer.push_back((value >> 16) & 0xFF);
@@ -24,41 +38,45 @@ bool Protocol::readUint32(const uint8_t* data, size_t& offset, size_t len, uint3
 
 std::vector<uint8_t> Protocol::encodeRequest(const Request& req) {
     std::vector<uint8_t> buffer;
-    
-    buffer.push_back(static_cast<uint8_t>(req.opcode));
-    
-    writeUint32(buffer, static_cast<uint32_t>(req.key.size()));
-    buffer.insert(buffer.end(), req.key.begin(), req.key.end());
-    
-    writeUint32(buffer, static_cast<uint32_t>(req.value.size()));
-    buffer.insert(buffer.end(), req.value.begin(), req.value.end());
-    
+    buffer.reserve(REQUEST_HEADER_SIZE + req.key.size() + 4 + req.value.size());
+    appendRequest(buffer, req);
     return buffer;
 }
 
 bool Protocol::decodeRequest(const std::vector<uint8_t>& data, Request& req) {
-    if (data.empty()) {
+    return decodeRequest(data.data(), data.size(), req);
+}
+
+bool Protocol::decodeRequest(const uint8_t* ptr, size_t len, Request& req) {
+    RequestView view;
+    if (!decodeRequestView(ptr, len, view)) {
         return false;
     }
-    
-    size_t offset = 0;
-    const uint8_t* ptr = data.data();
-    size_t len = data.size();
-    
-    if (offset >= len) {
+    req.opcode = view.opcode;
+    req.compressed = view.compressed;
+    req.key.assign(view.key.data, view.key.data + view.key.size);
+    req.value.assign(view.value.data, view.value.data + view.value.size);
+    return true;
+}
+
+bool Protocol::decodeRequestView(const uint8_t* ptr, size_t len, RequestView& view) {
+    if (len == 0) {
         return false;
     }
-    req.opcode = static_cast<OpCode>(ptr[offset++]);
+    
+    size_t offset = 0;
+    view.compressed = (ptr[offset] & COMPRESSED_FLAG) != 0;
+    view.opcode = static_cast<OpCode>(ptr[offset++] & ~COMPRESSED_FLAG);
     
     uint32_t keyLen = 0;
     if (!readUint32(ptr, offset, len, keyLen)) {
         return false;
     }
     
-    if (offset + keyLen > len) {
+    if (keyLen > len - offset) {
         return false;
     }
-    req.key.assign(ptr + offset, ptr + offset + keyLen);
+    view.key = ByteView(ptr + offset, keyLen);
     offset += keyLen;
     
     uint32_t valueLen = 0;
@@ -66,18 +84,64 @@ bool Protocol::decodeRequest(const std::vector<uint8_t>& data, Request& req) {
         return false;
     }
     
-    if (offset + valueLen > len) {
+    if (valueLen > len - offset) {
         return false;
     }
-    req.value.assign(ptr + offset, ptr + offset + valueLen);
+    view.value = ByteView(ptr + offset, valueLen);
     
     return true;
 }
 
+void Protocol::encodeLength(uint32_t len, uint8_t out[4]) {
+    out[0] = (len >> 24) & 0xFF;
+    out[1] = (len >> 16) & 0xFF;
+    out[2] = (len >> 8) & 0xFF;
+    out[3] = len & 0xFF;
+}
+
+void Protocol::encodeRequestPrefix(OpCode opcode, uint32_t key_len, uint8_t out[5], bool compressed) {
+    out[0] = static_cast<uint8_t>(opcode) | (compressed ? COMPRESSED_FLAG : 0);
+    encodeLength(key_len, out + 1);
+}
+
+void Protocol::encodeResponseHeader(StatusCode status, uint32_t value_len, uint8_t out[5], bool compressed) {
+    out[0] = static_cast<uint8_t>(status) | (compressed ? COMPRESSED_FLAG : 0);
+    encodeLength(value_len, out + 1);
+}
+
+FrameStatus Protocol::requestFrameSize(const uint8_t* data, size_t len, size_t& frame_size) {
+    size_t offset = 1;
+    uint32_t keyLen = 0;
+    if (!readUint32(data, offset, len, keyLen)) {
+        return FrameStatus::INCOMPLETE;
+    }
+    if (keyLen > MAX_FRAME_SIZE) {
+        return FrameStatus::INVALID;
+    }
+    
+    offset += keyLen;
+    uint32_t valueLen = 0;
+    if (!readUint32(data, offset, len, valueLen)) {
+        return FrameStatus::INCOMPLETE;
+    }
+    
+    size_t total = offset + valueLen;
+    if (total > MAX_FRAME_SIZE) {
+        return FrameStatus::INVALID;
+    }
+    if (total > len) {
+        return FrameStatus::INCOMPLETE;
+    }
+    
+    frame_size = total;
+    return FrameStatus::COMPLETE;
+}
+
 std::vector<uint8_t> Protocol::encodeResponse(const Response& resp) {
     std::vector<uint8_t> buffer;
+    buffer.reserve(RESPONSE_HEADER_SIZE + resp.value.size());
     
-    buffer.push_back(static_cast<uint8_t>(resp.status));
+    buffer.push_back(static_cast<uint8_t>(resp.status) | (resp.compressed ? COMPRESSED_FLAG : 0));
     
     writeUint32(buffer, static_cast<uint32_t>(resp.value.size()));
     buffer.insert(buffer.end(), resp.value.begin(), resp.value.end());
@@ -86,30 +150,423 @@ std::vector<uint8_t> Protocol::encodeResponse(const Response& resp) {
 }
 
 bool Protocol::decodeResponse(const std::vector<uint8_t>& data, Response& resp) {
-    if (data.empty()) {
+    return decodeResponse(data.data(), data.size(), resp);
+}
+
+bool Protocol::decodeResponse(const uint8_t* ptr, size_t len, Response& resp) {
+    if (len == 0) {
         return false;
     }
     
     size_t offset = 0;
-    const uint8_t* ptr = data.data();
-    size_t len = data.size();
+    resp.status = decodeStatus(ptr[offset++], resp.compressed);
     
-    if (offset >= len) {
+    uint32_t valueLen = 0;
+    if (!readUint32(ptr, offset, len, valueLen)) {
         return false;
     }
-    resp.status = static_cast<StatusCode>(ptr[offset++]);
     
+    if (valueLen > len - offset) {
+        return false;
+    }
+    resp.value.assign(ptr + offset, ptr + offset + valueLen);
+    
+    return true;
+}
+
+FrameStatus Protocol::responseFrameSize(const uint8_t* data, size_t len, size_t& frame_size) {
+    size_t offset = 1;
     uint32_t valueLen = 0;
-    if (!readUint32(ptr, offset, len, valueLen)) {
+    if (!readUint32(data, offset, len, valueLen)) {
+        return FrameStatus::INCOMPLETE;
+    }
+    size_t total = offset + valueLen;
+    if (total > MAX_FRAME_SIZE) {
+        return FrameStatus::INVALID;
+    }
+    if (total > len) {
+        return FrameStatus::INCOMPLETE;
+    }
+    frame_size = total;
+    return FrameStatus::COMPLETE;
+}
+
+void Protocol::appendRequest(std::vector<uint8_t>& buffer, const Request& req) {
+    buffer.push_back(static_cast<uint8_t>(req.opcode) | (req.compressed ? COMPRESSED_FLAG : 0));
+    writeUint32(buffer, static_cast<uint32_t>(req.key.size()));
+    buffer.insert(buffer.end(), req.key.begin(), req.key.end());
+    writeUint32(buffer, static_cast<uint32_t>(req.value.size()));
+    buffer.insert(buffer.end(), req.value.begin(), req.value.end());
+}
+
+namespace {
+
+const std::string& entry_key(const BatchEntry& entry) { return entry.key; }
+const std::vector<uint8_t>& entry_value(const BatchEntry& entry) { return entry.value; }
+const std::string& entry_key(const std::pair<std::string, std::vector<uint8_t>>& entry) { return entry.first; }
+const std::vector<uint8_t>& entry_value(const std::pair<std::string, std::vector<uint8_t>>& entry) { return entry.second; }
+
+} // namespace
+
+template<typename Entry>
+std::vector<uint8_t> Protocol::encodeEntries(const std::vector<Entry>& entries) {
+    size_t total = 4;
+    for (const auto& entry : entries) {
+        total += 8 + entry_key(entry).size() + entry_value(entry).size();
+    }
+    std::vector<uint8_t> buffer;
+    buffer.reserve(total);
+    
+    writeUint32(buffer, static_cast<uint32_t>(entries.size()));
+    for (const auto& entry : entries) {
+        const std::string& key = entry_key(entry);
+        const std::vector<uint8_t>& value = entry_value(entry);
+        writeUint32(buffer, static_cast<uint32_t>(key.size()));
+        buffer.insert(buffer.end(), key.begin(), key.end());
+        writeUint32(buffer, static_cast<uint32_t>(value.size()));
+        buffer.insert(buffer.end(), value.begin(), value.end());
+    }
+    return buffer;
+}
+
+std::vector<uint8_t> Protocol::encodeBatch(const std::vector<BatchEntry>& entries) {
+    return encodeEntries(entries);
+}
+
+std::vector<uint8_t> Protocol::encodeBatch(
+    const std::vector<std::pair<std::string, std::vector<uint8_t>>>& entries) {
+    return encodeEntries(entries);
+}
+
+bool Protocol::decodeBatch(const uint8_t* data, size_t len, std::vector<BatchEntry>& entries) {
+    size_t offset = 0;
+    uint32_t count = 0;
+    if (!readUint32(data, offset, len, count)) {
+        return false;
+    }
+    // Every entry needs at least its two length fields
+    if (count > (len - offset) / 8) {
         return false;
     }
     
-    if (offset + valueLen > len) {
+    entries.clear();
+    entries.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t keyLen = 0;
+        if (!readUint32(data, offset, len, keyLen) || keyLen > len - offset) {
+            return false;
+        }
+        entries[i].key.assign(reinterpret_cast<const char*>(data + offset), keyLen);
+        offset += keyLen;
+        
+        uint32_t valueLen = 0;
+        if (!readUint32(data, offset, len, valueLen) || valueLen > len - offset) {
+            return false;
+        }
+        entries[i].value.assign(data + offset, data + offset + valueLen);
+        offset += valueLen;
+    }
+    return offset == len;
+}
+
+std::vector<uint8_t> Protocol::encodeBatchResults(const std::vector<BatchResult>& results) {
+    size_t total = 4;
+    for (const auto& result : results) {
+        total += 5 + result.value.size();
+    }
+    std::vector<uint8_t> buffer;
+    buffer.reserve(total);
+    
+    writeUint32(buffer, static_cast<uint32_t>(results.size()));
+    for (const auto& result : results) {
+        buffer.push_back(static_cast<uint8_t>(result.status));
+        writeUint32(buffer, static_cast<uint32_t>(result.value.size()));
+        buffer.insert(buffer.end(), result.value.begin(), result.value.end());
+    }
+    return buffer;
+}
+
+bool Protocol::decodeBatchResults(const uint8_t* data, size_t len, std::vector<BatchResult>& results) {
+    size_t offset = 0;
+    uint32_t count = 0;
+    if (!readUint32(data, offset, len, count)) {
+        return false;
+    }
+    if (count > (len - offset) / 5) {
         return false;
     }
-    resp.value.assign(ptr + offset, ptr + offset + valueLen);
     
+    results.clear();
+    results.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (offset >= len) {
+            return false;
+        }
+        results[i].status = static_cast<StatusCode>(data[offset++]);
+        uint32_t valueLen = 0;
+        if (!readUint32(data, offset, len, valueLen) || valueLen > len - offset) {
+            return false;
+        }
+        results[i].value.assign(data + offset, data + offset + valueLen);
+        offset += valueLen;
+    }
+    return offset == len;
+}
+
+std::vector<uint8_t> Protocol::encodeTreeNodes(uint8_t level, const std::vector<uint32_t>& indices) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(5 + 4 * indices.size());
+    buffer.push_back(level);
+    writeUint32(buffer, static_cast<uint32_t>(indices.size()));
+    for (uint32_t index : indices) {
+        writeUint32(buffer, index);
+    }
+    return buffer;
+}
+
+bool Protocol::decodeTreeNodes(const uint8_t* data, size_t len, uint8_t& level,
+                               std::vector<uint32_t>& indices) {
+    if (len < 1) {
+        return false;
+    }
+    level = data[0];
+    size_t offset = 1;
+    uint32_t count = 0;
+    if (!readUint32(data, offset, len, count) || len - offset != 4 * static_cast<size_t>(count)) {
+        return false;
+    }
+    indices.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        readUint32(data, offset, len, indices[i]);
+    }
+    return true;
+}
+
+void Protocol::encodeDigest(uint64_t digest, uint8_t out[8]) {
+    for (int i = 7; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(digest & 0xFF);
+        digest >>= 8;
+    }
+}
+
+uint64_t Protocol::decodeDigest(const uint8_t in[8]) {
+    uint64_t digest = 0;
+    for (int i = 0; i < 8; ++i) {
+        digest = (digest << 8) | in[i];
+    }
+    return digest;
+}
+
+std::vector<uint8_t> Protocol::encodeDigests(const std::vector<uint64_t>& digests) {
+    std::vector<uint8_t> buffer;
+    writeUint32(buffer, static_cast<uint32_t>(digests.size()));
+    buffer.resize(4 + 8 * digests.size());
+    for (size_t i = 0; i < digests.size(); ++i) {
+        encodeDigest(digests[i], &buffer[4 + 8 * i]);
+    }
+    return buffer;
+}
+
+bool Protocol::decodeDigests(const uint8_t* data, size_t len, std::vector<uint64_t>& digests) {
+    size_t offset = 0;
+    uint32_t count = 0;
+    if (!readUint32(data, offset, len, count) || len - offset != 8 * static_cast<size_t>(count)) {
+        return false;
+    }
+    digests.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        digests[i] = decodeDigest(data + offset + 8 * i);
+    }
+    return true;
+}
+
+std::vector<uint8_t> Protocol::encodeScanRequest(uint8_t flags, uint32_t max_entries, uint32_t max_bytes,
+                                                 const std::vector<uint8_t>& cursor) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(9 + cursor.size());
+    buffer.push_back(flags);
+    writeUint32(buffer, max_entries);
+    writeUint32(buffer, max_bytes);
+    buffer.insert(buffer.end(), cursor.begin(), cursor.end());
+    return buffer;
+}
+
+bool Protocol::decodeScanRequest(const uint8_t* data, size_t len, uint8_t& flags, uint32_t& max_entries,
+                                 uint32_t& max_bytes, std::vector<uint8_t>& cursor) {
+    if (len < 9) {
+        return false;
+    }
+    flags = data[0];
+    size_t offset = 1;
+    readUint32(data, offset, len, max_entries);
+    readUint32(data, offset, len, max_bytes);
+    max_entries = max_entries == 0 ? SCAN_DEFAULT_ENTRIES : std::min(max_entries, SCAN_MAX_ENTRIES);
+    max_bytes = max_bytes == 0 ? SCAN_MAX_BYTES : std::min(max_bytes, SCAN_MAX_BYTES);
+    cursor.assign(data + offset, data + len);
+    return true;
+}
+
+std::vector<uint8_t> Protocol::encodeScanReply(
+    const std::vector<uint8_t>& cursor,
+    const std::vector<std::pair<std::string, std::vector<uint8_t>>>& entries) {
+    std::vector<uint8_t> batch = encodeEntries(entries);
+    std::vector<uint8_t> buffer;
+    buffer.reserve(4 + cursor.size() + batch.size());
+    writeUint32(buffer, static_cast<uint32_t>(cursor.size()));
+    buffer.insert(buffer.end(), cursor.begin(), cursor.end());
+    buffer.insert(buffer.end(), batch.begin(), batch.end());
+    return buffer;
+}
+
+bool Protocol::decodeScanReply(const uint8_t* data, size_t len, std::vector<uint8_t>& cursor,
+                               std::vector<BatchEntry>& entries) {
+    size_t offset = 0;
+    uint32_t cursor_len = 0;
+    if (!readUint32(data, offset, len, cursor_len) || cursor_len > len - offset) {
+        return false;
+    }
+    cursor.assign(data + offset, data + offset + cursor_len);
+    offset += cursor_len;
+    return decodeBatch(data + offset, len - offset, entries);
+}
+
+std::vector<uint8_t> Protocol::encodeVersioned(uint64_t version, const uint8_t* value, size_t len) {
+    std::vector<uint8_t> buffer(8 + len);
+    encodeDigest(version, buffer.data());
+    if (len > 0) {
+        std::memcpy(buffer.data() + 8, value, len);
+    }
+    return buffer;
+}
+
+bool Protocol::decodeVersioned(std::vector<uint8_t>& data, uint64_t& version) {
+    if (data.size() < 8) {
+        return false;
+    }
+    version = decodeDigest(data.data());
+    data.erase(data.begin(), data.begin() + 8);
+    return true;
+}
+
+bool Protocol::decodeTtl(std::vector<uint8_t>& data, uint64_t& ttl_ms) {
+    if (!decodeVersioned(data, ttl_ms) || ttl_ms == 0) {
+        return false;
+    }
+    ttl_ms = std::min(ttl_ms, MAX_TTL_MS);
+    return true;
+}
+
+std::vector<uint8_t> Protocol::encodeStored(uint64_t version, bool compressed,
+                                            const uint8_t* value, size_t len, uint64_t expires) {
+    size_t header = expires != 0 ? 17 : 9;
+    std::vector<uint8_t> buffer(header + len);
+    encodeDigest(version, buffer.data());
+    buffer[8] = (compressed ? VALUE_COMPRESSED : 0) | (expires != 0 ? VALUE_EXPIRES : 0);
+    if (expires != 0) {
+        encodeDigest(expires, buffer.data() + 9);
+    }
+    if (len > 0) {
+        std::memcpy(buffer.data() + header, value, len);
+    }
+    return buffer;
+}
+
+bool Protocol::decodeStored(std::vector<uint8_t>& data, uint64_t& version, bool& compressed,
+                            uint64_t* expires) {
+    if (data.size() < 9) {
+        return false;
+    }
+    bool expiring = (data[8] & VALUE_EXPIRES) != 0;
+    size_t header = expiring ? 17 : 9;
+    if (data.size() < header) {
+        return false;
+    }
+    version = decodeDigest(data.data());
+    compressed = (data[8] & VALUE_COMPRESSED) != 0;
+    if (expires) {
+        *expires = expiring ? decodeDigest(data.data() + 9) : 0;
+    }
+    data.erase(data.begin(), data.begin() + header);
+    return true;
+}
+
+bool Protocol::decodeReadConsistency(const std::vector<uint8_t>& value, ReadConsistency& consistency) {
+    if (value.empty()) {
+        consistency = ReadConsistency::PRIMARY;
+        return true;
+    }
+    if (value.size() != 1 || value[0] > static_cast<uint8_t>(ReadConsistency::QUORUM)) {
+        return false;
+    }
+    consistency = static_cast<ReadConsistency>(value[0]);
     return true;
 }
 
+std::string Protocol::opcodeName(OpCode opcode) {
+    switch (opcode) {
+        case OpCode::GET: return "GET";
+        case OpCode::PUT: return "PUT";
+        case OpCode::DELETE: return "DELETE";
+        case OpCode::MULTI_GET: return "MULTI_GET";
+        case OpCode::MULTI_PUT: return "MULTI_PUT";
+        case OpCode::MULTI_DELETE: return "MULTI_DELETE";
+        case OpCode::CAS: return "CAS";
+        case OpCode::GET_VERSIONED: return "GET_VERSIONED";
+        case OpCode::PUT_TTL: return "PUT_TTL";
+        case OpCode::SCAN: return "SCAN";
+        case OpCode::JOIN: return "JOIN";
+        case OpCode::STABILIZE: return "STABILIZE";
+        case OpCode::NOTIFY: return "NOTIFY";
+        case OpCode::PING: return "PING";
+        case OpCode::REPLICATE: return "REPLICATE";
+        case OpCode::TRANSFER_KEY: return "TRANSFER_KEY";
+        case OpCode::REPLICATE_DELETE: return "REPLICATE_DELETE";
+        case OpCode::REPLICATE_GET: return "REPLICATE_GET";
+        case OpCode::TRANSFER_BATCH: return "TRANSFER_BATCH";
+        case OpCode::GET_LEASED: return "GET_LEASED";
+        case OpCode::INVALIDATE: return "INVALIDATE";
+        case OpCode::MERKLE_DIGESTS: return "MERKLE_DIGESTS";
+        case OpCode::MERKLE_KEYS: return "MERKLE_KEYS";
+        case OpCode::REPAIR: return "REPAIR";
+        case OpCode::FIND_SUCCESSOR: return "FIND_SUCCESSOR";
+        case OpCode::FIND_PREDECESSOR: return "FIND_PREDECESSOR";
+        case OpCode::GET_PREDECESSOR: return "GET_PREDECESSOR";
+        case OpCode::GET_SUCCESSOR: return "GET_SUCCESSOR";
+        case OpCode::CLOSEST_PRECEDING_NODE: return "CLOSEST_PRECEDING_NODE";
+        case OpCode::NODE_INFO: return "NODE_INFO";
+        case OpCode::GET_SUCCESSOR_LIST: return "GET_SUCCESSOR_LIST";
+        case OpCode::GET_ROUTING: return "GET_ROUTING";
+        case OpCode::ADMIN_SHUTDOWN: return "ADMIN_SHUTDOWN";
+        case OpCode::STATS: return "STATS";
+        case OpCode::SET_LOG_LEVEL: return "SET_LOG_LEVEL";
+    }
+    static const char digits[] = "0123456789abcdef";
+    uint8_t code = static_cast<uint8_t>(opcode);
+    return std::string("0x") + digits[code >> 4] + digits[code & 0xF];
+}
+
+std::vector<uint8_t> Protocol::encodeNodeList(const std::vector<std::string>& nodes) {
+    std::vector<uint8_t> buffer;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (i > 0) {
+            buffer.push_back(',');
+        }
+        buffer.insert(buffer.end(), nodes[i].begin(), nodes[i].end());
+    }
+    return buffer;
+}
+
+void Protocol::decodeNodeList(const uint8_t* data, size_t len, std::vector<std::string>& nodes) {
+    nodes.clear();
+    size_t start = 0;
+    for (size_t i = 0; i <= len; ++i) {
+        if (i == len || data[i] == ',') {
+            if (i > start) {
+                nodes.push_back(std::string(reinterpret_cast<const char*>(data) + start, i - start));
+            }
+            start = i + 1;
+        }
+    }
+}
+
 } // namespace funnelkvs
\ No newline at end of file
@@ -0,0 +1,248 @@
+#include "read_cache.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+namespace funnelkvs {
+
+constexpr size_t ReadCache::DEFAULT_CAPACITY_BYTES;
+constexpr size_t ReadCache::DEFAULT_SHARDS;
+constexpr double ReadCache::PROTECTED_SHARE;
+constexpr size_t ReadCache::ENTRY_OVERHEAD;
+constexpr size_t ReadCache::SKETCH_WIDTH;
+constexpr uint8_t ReadCache::HOT_READS;
+constexpr int ReadCache::FrequencySketch::ROWS;
+constexpr uint8_t ReadCache::FrequencySketch::MAX_COUNT;
+
+ReadCache::FrequencySketch::FrequencySketch()
+    : counters(ROWS * SKETCH_WIDTH, 0)
+    , samples(0)
+{
+}
+
+size_t ReadCache::FrequencySketch::slot(uint64_t hash, int row) const {
+    // Double hashing: row i probes h1 + i * h2
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    return row * SKETCH_WIDTH + ((h1 + row * h2) & (SKETCH_WIDTH - 1));
+}
+
+void ReadCache::FrequencySketch::record(uint64_t hash) {
+    for (int row = 0; row < ROWS; ++row) {
+        uint8_t& counter = counters[slot(hash, row)];
+        if (counter < MAX_COUNT) {
+            counter++;
+        }
+    }
+    // Age every count so that yesterday's hot keys make way
+    if (++samples >= 10 * SKETCH_WIDTH) {
+        for (auto& counter : counters) {
+            counter >>= 1;
+        }
+        samples /= 2;
+    }
+}
+
+uint8_t ReadCache::FrequencySketch::estimate(uint64_t hash) const {
+    uint8_t result = MAX_COUNT;
+    for (int row = 0; row < ROWS; ++row) {
+        result = std::min(result, counters[slot(hash, row)]);
+    }
+    return result;
+}
+
+ReadCache::Shard::Shard()
+    : bytes(0)
+    , protected_bytes(0)
+    , generation(0)
+    , hits(0)
+    , misses(0)
+    , insertions(0)
+    , rejections(0)
+    , invalidations(0)
+    , evictions(0)
+{
+}
+
+ReadCache::ReadCache(size_t capacity_bytes, size_t num_shards)
+    : shard_capacity(capacity_bytes / std::max<size_t>(num_shards, 1))
+{
+    num_shards = std::max<size_t>(num_shards, 1);
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards.push_back(std::unique_ptr<Shard>(new Shard()));
+    }
+}
+
+uint64_t ReadCache::hash_key(const std::string& key) {
+    // std::hash promises nothing about how well its bits are mixed, and
+    // both the shard and the sketch rows use slices of this hash; finalize
+    // it (MurmurHash3 fmix64)
+    uint64_t h = std::hash<std::string>()(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+ReadCache::Shard& ReadCache::shard_for(uint64_t hash) const {
+    // The low bits pick sketch counters, so shard on the high ones
+    return *shards[(hash >> 48) % shards.size()];
+}
+
+void ReadCache::erase(Shard& shard, EntryList::iterator it) {
+    size_t charge = it->charge();
+    shard.bytes -= charge;
+    if (it->protected_segment) {
+        shard.protected_bytes -= charge;
+        shard.index.erase(it->key);
+        shard.protected_entries.erase(it);
+    } else {
+        shard.index.erase(it->key);
+        shard.probation.erase(it);
+    }
+}
+
+void ReadCache::promote(Shard& shard, EntryList::iterator it) {
+    if (it->protected_segment) {
+        shard.protected_entries.splice(shard.protected_entries.begin(), shard.protected_entries, it);
+        return;
+    }
+    it->protected_segment = true;
+    shard.protected_bytes += it->charge();
+    shard.protected_entries.splice(shard.protected_entries.begin(), shard.probation, it);
+
+    // Overflow goes back to probation, where it gets another chance
+    size_t limit = static_cast<size_t>(shard_capacity * PROTECTED_SHARE);
+    while (shard.protected_bytes > limit && shard.protected_entries.size() > 1) {
+        EntryList::iterator last = std::prev(shard.protected_entries.end());
+        last->protected_segment = false;
+        shard.protected_bytes -= last->charge();
+        shard.probation.splice(shard.probation.begin(), shard.protected_entries, last);
+    }
+}
+
+bool ReadCache::get(const std::string& key, std::vector<uint8_t>& value) {
+    uint64_t hash = hash_key(key);
+    Shard& shard = shard_for(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.sketch.record(hash);
+
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+    EntryList::iterator it = found->second;
+    if (Clock::now() >= it->expires) {
+        erase(shard, it);
+        shard.misses++;
+        return false;
+    }
+    shard.hits++;
+    promote(shard, it);
+    value = it->value;
+    return true;
+}
+
+bool ReadCache::should_cache(const std::string& key) {
+    uint64_t hash = hash_key(key);
+    Shard& shard = shard_for(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.index.count(key)) {
+        return true;
+    }
+    shard.sketch.record(hash);
+    return shard.sketch.estimate(hash) >= HOT_READS;
+}
+
+uint64_t ReadCache::ticket(const std::string& key) const {
+    Shard& shard = shard_for(hash_key(key));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.generation;
+}
+
+bool ReadCache::put(const std::string& key, const std::vector<uint8_t>& value,
+                    std::chrono::milliseconds ttl, uint64_t ticket) {
+    uint64_t hash = hash_key(key);
+    Shard& shard = shard_for(hash);
+    size_t charge = key.size() + value.size() + ENTRY_OVERHEAD;
+    Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // A single entry may take at most an eighth of its shard
+    if (ticket != shard.generation || ttl.count() <= 0 || charge > shard_capacity / 8) {
+        shard.rejections++;
+        return false;
+    }
+
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        erase(shard, found->second);
+    }
+
+    uint8_t frequency = shard.sketch.estimate(hash);
+    while (shard.bytes + charge > shard_capacity) {
+        EntryList& segment = shard.probation.empty() ? shard.protected_entries : shard.probation;
+        EntryList::iterator victim = std::prev(segment.end());
+        if (victim->expires > now && frequency <= shard.sketch.estimate(hash_key(victim->key))) {
+            shard.rejections++;
+            return false;
+        }
+        erase(shard, victim);
+        shard.evictions++;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.value = value;
+    entry.expires = now + ttl;
+    entry.protected_segment = false;
+    shard.probation.push_front(std::move(entry));
+    shard.index[key] = shard.probation.begin();
+    shard.bytes += charge;
+    shard.insertions++;
+    return true;
+}
+
+void ReadCache::invalidate(const std::string& key) {
+    Shard& shard = shard_for(hash_key(key));
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.generation++;
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+        erase(shard, found->second);
+        shard.invalidations++;
+    }
+}
+
+void ReadCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->generation++;
+        shard->index.clear();
+        shard->probation.clear();
+        shard->protected_entries.clear();
+        shard->bytes = 0;
+        shard->protected_bytes = 0;
+    }
+}
+
+ReadCache::Stats ReadCache::stats() const {
+    Stats result = Stats();
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.hits += shard->hits;
+        result.misses += shard->misses;
+        result.insertions += shard->insertions;
+        result.rejections += shard->rejections;
+        result.invalidations += shard->invalidations;
+        result.evictions += shard->evictions;
+        result.entries += shard->index.size();
+        result.bytes += shard->bytes;
+    }
+    return result;
+}
+
+} // namespace funnelkvs
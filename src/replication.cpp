@@ -1,13 +1,17 @@
 #include "replication.h"
 #include "chord.h"
 #include "protocol.h"
-#include <iostream>
+#include "connection_pool.h"
+#include "async_rpc.h"
+#include "heartbeat.h"
+#include "logger.h"
 #include <algorithm>
+#include <cmath>
 
 namespace funnelkvs {
 
 ReplicationManager::ReplicationManager(const ReplicationConfig& cfg) 
-    : config(cfg), running(false) {
+    : config(cfg), running(false), straggler_failures(0), outstanding_rpcs(0) {
     if (config.enable_async_replication) {
         start_async_processing();
     }
@@ -15,39 +19,153 @@ ReplicationManager::ReplicationManager(const ReplicationConfig& cfg)
 
 ReplicationManager::~ReplicationManager() {
     stop_async_processing();
+    std::unique_lock<std::mutex> lock(rpc_mutex);
+    rpc_done.wait(lock, [this] { return outstanding_rpcs == 0; });
+}
+
+std::vector<std::shared_ptr<NodeInfo>> ReplicationManager::select_targets(
+    const std::vector<std::shared_ptr<NodeInfo>>& replicas) const {
+    int limit = get_replication_factor() - 1;
+    std::vector<std::shared_ptr<NodeInfo>> targets;
+    for (int i = 0; i < limit && i < static_cast<int>(replicas.size()); ++i) {
+        if (replicas[i] && replicas[i]->port != 0) {
+            targets.push_back(replicas[i]);
+        }
+    }
+    return targets;
+}
+
+namespace {
+
+// Shared between a fan-out and its in-flight sends, which may outlive the
+// caller once the quorum has been decided.
+struct QuorumState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int acks;
+    int failures;
+    bool decided;
+    std::vector<uint8_t> value; // first value found by a read
+    
+    QuorumState() : acks(0), failures(0), decided(false) {}
+};
+
+// Shared by a quorum read check and the callbacks of its digest requests
+struct DigestCheckState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int answered;
+    int pending;
+    bool decided;
+    std::vector<std::shared_ptr<NodeInfo>> stale;
+    
+    DigestCheckState() : answered(0), pending(0), decided(false) {}
+};
+
+} // namespace
+
+bool ReplicationManager::fan_out(ReplicationTask::TaskType type, const std::string& key,
+                                 const std::shared_ptr<const std::vector<uint8_t>>& value,
+                                 const std::vector<std::shared_ptr<NodeInfo>>& targets, int required) {
+    if (required <= 0) {
+        // Nothing to wait for, but keep every replica up to date
+        required = 0;
+    }
+    
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timeout_ms = config.sync_timeout_ms;
+    }
+    
+    // REPLICATE* store on the target unconditionally; a plain PUT would be
+    // redirected back to the owner by a node that does not own the key
+    Request request(type == ReplicationTask::PUT ? OpCode::REPLICATE : OpCode::REPLICATE_DELETE,
+                    std::vector<uint8_t>(key.begin(), key.end()));
+    if (value) {
+        request.value = *value;
+    }
+    
+    std::shared_ptr<QuorumState> state = std::make_shared<QuorumState>();
+    int total = static_cast<int>(targets.size());
+    {
+        std::lock_guard<std::mutex> lock(rpc_mutex);
+        outstanding_rpcs += targets.size();
+    }
+    
+    // All sends go out at once on the RPC loop; this thread only waits for
+    // the quorum
+    auto started = std::chrono::steady_clock::now();
+    for (const auto& target : targets) {
+        Histogram* latency = ack_histogram(target->address + ":" + std::to_string(target->port));
+        AsyncRpc::instance().call(target->address, target->port, request,
+            [this, state, type, key, target, latency, started](bool sent, Response& response) {
+                bool ok = sent && (response.status == StatusCode::SUCCESS ||
+                                   (type == ReplicationTask::DELETE &&
+                                    response.status == StatusCode::KEY_NOT_FOUND));
+                if (ok) {
+                    latency->record(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - started).count());
+                }
+                bool late;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    ok ? state->acks++ : state->failures++;
+                    late = state->decided;
+                }
+                state->cv.notify_all();
+                if (!ok && late) {
+                    straggler_failures++;
+                    FKVS_WARN("Background replication to " << target->to_string()
+                              << " failed for key '" << key << "'");
+                }
+                std::lock_guard<std::mutex> lock(rpc_mutex);
+                if (--outstanding_rpcs == 0) {
+                    rpc_done.notify_all();
+                }
+            }, std::chrono::milliseconds(timeout_ms));
+    }
+    
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [state, total, required] {
+        return state->acks >= required || total - state->failures < required;
+    });
+    state->decided = true;
+    
+    if (state->acks < required) {
+        FKVS_WARN("Replication failed for key '" << key << "': "
+                  << state->acks << "/" << required << " acknowledged");
+        return false;
+    }
+    return true;
 }
 
 bool ReplicationManager::replicate_put(const std::string& key, const std::vector<uint8_t>& value,
-                                       const std::vector<std::shared_ptr<NodeInfo>>& replicas) {
-    // If async replication is enabled, enqueue the task and return immediately
+                                       const std::vector<std::shared_ptr<NodeInfo>>& replicas,
+                                       uint64_t version, bool compressed, uint64_t expires) {
+    // In async mode, hand the write to the per-peer streams and return
     if (config.enable_async_replication) {
-        ReplicationTask task(ReplicationTask::PUT, key, value, replicas);
-        enqueue_replication_task(task);
+        std::shared_ptr<const std::vector<uint8_t>> shared_value =
+            std::make_shared<const std::vector<uint8_t>>(Protocol::encodeStored(version, compressed, value, expires));
+        bool accepted = enqueue_async(ReplicationTask::PUT, key, shared_value, replicas);
         
         // Record timestamp without holding main mutex
         {
             std::lock_guard<std::mutex> lock(mutex);
             replication_timestamps[key] = std::chrono::steady_clock::now();
         }
-        return true; // Async replication always returns success immediately
+        return accepted;
     }
     
-    // Synchronous replication - perform network operations without holding lock
-    int successful_replications = 0;
-    int required_replications = std::min(config.replication_factor - 1, static_cast<int>(replicas.size()));
+    auto targets = select_targets(replicas);
+    int required = std::min(get_write_quorum() - 1, static_cast<int>(targets.size()));
     
-    // Perform network operations without holding mutex
-    for (int i = 0; i < required_replications; ++i) {
-        if (!replicas[i] || replicas[i]->port == 0) {
-            continue;
-        }
-        
-        bool success = send_replication_request(replicas[i], "PUT", key, value);
-        if (success) {
-            successful_replications++;
-        } else {
-            std::cerr << "Synchronous replication failed to " << replicas[i]->to_string() << std::endl;
-        }
+    bool result = true;
+    if (!targets.empty()) {
+        // One copy of the value shared by every in-flight send
+        std::shared_ptr<const std::vector<uint8_t>> shared_value =
+            std::make_shared<const std::vector<uint8_t>>(Protocol::encodeStored(version, compressed, value, expires));
+        result = fan_out(ReplicationTask::PUT, key, shared_value, targets, required);
     }
     
     // Record replication timestamp after network operations
@@ -56,46 +174,32 @@ bool ReplicationManager::replicate_put(const std::string& key, const std::vector
         replication_timestamps[key] = std::chrono::steady_clock::now();
     }
     
-    // For sync replication, we need all replications to succeed
-    bool result = (successful_replications == required_replications);
-    
-    if (!result) {
-        std::cerr << "Replication failed for key '" << key << "': " 
-                  << successful_replications << "/" << required_replications << " succeeded" << std::endl;
-    }
-    
     return result;
 }
 
 bool ReplicationManager::replicate_delete(const std::string& key,
-                                          const std::vector<std::shared_ptr<NodeInfo>>& replicas) {
-    // If async replication is enabled, enqueue the task and return immediately
+                                          const std::vector<std::shared_ptr<NodeInfo>>& replicas,
+                                          uint64_t version) {
+    std::shared_ptr<const std::vector<uint8_t>> stamp =
+        std::make_shared<const std::vector<uint8_t>>(Protocol::encodeVersioned(version, nullptr, 0));
+    // In async mode, hand the delete to the per-peer streams and return
     if (config.enable_async_replication) {
-        ReplicationTask task(ReplicationTask::DELETE, key, {}, replicas);
-        enqueue_replication_task(task);
+        bool accepted = enqueue_async(ReplicationTask::DELETE, key, stamp, replicas);
         
         // Remove from timestamp tracking
         {
             std::lock_guard<std::mutex> lock(mutex);
             replication_timestamps.erase(key);
         }
-        return true; // Async replication always returns success immediately
+        return accepted;
     }
     
-    // Synchronous replication - perform network operations without holding lock
-    int successful_replications = 0;
-    int required_replications = std::min(config.replication_factor - 1, static_cast<int>(replicas.size()));
+    auto targets = select_targets(replicas);
+    int required = std::min(get_write_quorum() - 1, static_cast<int>(targets.size()));
     
-    // Perform network operations without holding mutex
-    for (int i = 0; i < required_replications; ++i) {
-        if (!replicas[i] || replicas[i]->port == 0) {
-            continue;
-        }
-        
-        bool success = send_replication_request(replicas[i], "DELETE", key);
-        if (success) {
-            successful_replications++;
-        }
+    bool result = true;
+    if (!targets.empty()) {
+        result = fan_out(ReplicationTask::DELETE, key, stamp, targets, required);
     }
     
     // Remove from timestamp tracking after network operations
@@ -104,40 +208,121 @@ bool ReplicationManager::replicate_delete(const std::string& key,
         replication_timestamps.erase(key);
     }
     
-    return (successful_replications == required_replications);
+    return result;
 }
 
 bool ReplicationManager::get_from_replicas(const std::string& key, std::vector<uint8_t>& value,
                                           const std::vector<std::shared_ptr<NodeInfo>>& replicas) {
-    // Try to read from each replica in order until successful
+    std::vector<std::shared_ptr<NodeInfo>> targets;
     for (const auto& replica : replicas) {
-        if (!replica || replica->port == 0) {
-            continue;
+        if (replica && replica->port != 0) {
+            targets.push_back(replica);
         }
-        
-        try {
-            Client client(replica->address, replica->port);
-            if (client.connect()) {
-                if (client.get(key, value)) {
-                    return true;
+    }
+    if (targets.empty()) {
+        return false;
+    }
+    
+    int total = static_cast<int>(targets.size());
+    int misses_needed = std::min(get_read_quorum() - 1, total);
+    if (misses_needed <= 0) {
+        misses_needed = total; // no quorum configured: ask everyone
+    }
+    
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timeout_ms = config.sync_timeout_ms;
+    }
+    
+    Request request(OpCode::REPLICATE_GET, std::vector<uint8_t>(key.begin(), key.end()));
+    std::shared_ptr<QuorumState> state = std::make_shared<QuorumState>();
+    for (const auto& replica : targets) {
+        AsyncRpc::instance().call(replica->address, replica->port, request,
+            [state](bool sent, Response& response) {
+                bool ok = sent && response.status == StatusCode::SUCCESS;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (ok && state->acks == 0 && !state->decided) {
+                        state->value.swap(response.value);
+                    }
+                    ok ? state->acks++ : state->failures++;
                 }
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Failed to read from replica " << replica->to_string() 
-                      << ": " << e.what() << std::endl;
-            continue;
-        }
+                state->cv.notify_all();
+            }, std::chrono::milliseconds(timeout_ms));
     }
     
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [state, misses_needed] {
+        return state->acks > 0 || state->failures >= misses_needed;
+    });
+    state->decided = true;
+    
+    if (state->acks > 0) {
+        value.swap(state->value);
+        return true;
+    }
     return false;
 }
 
+int ReplicationManager::check_replicas(const std::string& key, uint64_t digest,
+                                       const std::vector<std::shared_ptr<NodeInfo>>& replicas, int needed,
+                                       std::vector<std::shared_ptr<NodeInfo>>& stale) {
+    std::vector<std::shared_ptr<NodeInfo>> targets;
+    for (const auto& replica : replicas) {
+        if (replica && replica->port != 0) {
+            targets.push_back(replica);
+        }
+    }
+    if (targets.empty()) {
+        return 0;
+    }
+    
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timeout_ms = config.sync_timeout_ms;
+    }
+    
+    Request request(OpCode::REPLICATE_GET, std::vector<uint8_t>(key.begin(), key.end()),
+                    std::vector<uint8_t>{1});
+    std::shared_ptr<DigestCheckState> state = std::make_shared<DigestCheckState>();
+    state->pending = static_cast<int>(targets.size());
+    for (const auto& replica : targets) {
+        AsyncRpc::instance().call(replica->address, replica->port, request,
+            [state, replica, digest](bool sent, Response& response) {
+                bool missing = sent && response.status == StatusCode::KEY_NOT_FOUND;
+                bool present = sent && response.status == StatusCode::SUCCESS &&
+                               response.value.size() == 8;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->pending--;
+                    if ((missing || present) && !state->decided) {
+                        state->answered++;
+                        if (missing || Protocol::decodeDigest(response.value.data()) != digest) {
+                            state->stale.push_back(replica);
+                        }
+                    }
+                }
+                state->cv.notify_all();
+            }, std::chrono::milliseconds(timeout_ms));
+    }
+    
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [state, needed] {
+        return state->answered >= needed || state->pending == 0;
+    });
+    state->decided = true;
+    stale.swap(state->stale);
+    return state->answered;
+}
+
 void ReplicationManager::handle_replica_failure(std::shared_ptr<NodeInfo> failed_node,
                                                const std::vector<std::shared_ptr<NodeInfo>>& new_replicas,
                                                const std::unordered_map<std::string, std::vector<uint8_t>>& keys_to_replicate) {
     std::lock_guard<std::mutex> lock(mutex);
     
-    std::cout << "Handling replica failure for node: " << failed_node->to_string() << std::endl;
+    FKVS_INFO("Handling replica failure for node: " << failed_node->to_string());
     
     // Re-replicate all keys that were stored on the failed node
     int successful_re_replications = 0;
@@ -151,172 +336,609 @@ void ReplicationManager::handle_replica_failure(std::shared_ptr<NodeInfo> failed
                 continue;
             }
             
-            if (send_replication_request(new_replica, "PUT", key, value)) {
+            if (send_replication_request(new_replica, "PUT", key, Protocol::encodeStored(0, false, value))) {
                 successful_re_replications++;
                 break; // Successfully replicated to this new node
             }
         }
     }
     
-    std::cout << "Re-replicated " << successful_re_replications 
-              << "/" << keys_to_replicate.size() << " keys after node failure" << std::endl;
+    FKVS_INFO("Re-replicated " << successful_re_replications
+              << "/" << keys_to_replicate.size() << " keys after node failure");
 }
 
 bool ReplicationManager::send_replication_request(std::shared_ptr<NodeInfo> target,
                                                   const std::string& operation,
                                                   const std::string& key,
                                                   const std::vector<uint8_t>& value) {
-    try {
-        Client client(target->address, target->port);
-        if (!client.connect()) {
-            return false;
-        }
-        
-        if (operation == "PUT") {
-            return client.put(key, value);
-        } else if (operation == "DELETE") {
-            return client.remove(key);
-        }
-        
+    // REPLICATE* store on the target unconditionally; a plain PUT would
+    // be redirected back to the owner by a node that does not own the key
+    Request request;
+    if (operation == "PUT") {
+        request = Request(OpCode::REPLICATE, std::vector<uint8_t>(key.begin(), key.end()), value);
+    } else if (operation == "DELETE") {
+        request = Request(OpCode::REPLICATE_DELETE, std::vector<uint8_t>(key.begin(), key.end()));
+    } else {
         return false;
-    } catch (const std::exception& e) {
-        std::cerr << "Replication request failed to " << target->to_string() 
-                  << ": " << e.what() << std::endl;
+    }
+    
+    AsyncRpc::Result result = AsyncRpc::instance().submit(target->address, target->port, request).get();
+    if (!result.ok) {
+        FKVS_DEBUG("Replication request failed to " << target->to_string());
         return false;
     }
+    return result.response.status == StatusCode::SUCCESS ||
+           (operation == "DELETE" && result.response.status == StatusCode::KEY_NOT_FOUND);
 }
 
 bool ReplicationManager::ping_node(std::shared_ptr<NodeInfo> node) {
-    try {
-        Client client(node->address, node->port);
-        return client.connect() && client.ping();
-    } catch (...) {
-        return false;
-    }
+    AsyncRpc::Result result = AsyncRpc::instance().submit(node->address, node->port,
+                                                          Request(OpCode::PING, {})).get();
+    return result.ok && result.response.status == StatusCode::SUCCESS;
 }
 
 void ReplicationManager::start_async_processing() {
-    if (running.load()) {
-        return; // Already running
-    }
-    
     running = true;
-    processing_thread = std::thread(&ReplicationManager::process_replication_queue, this);
 }
 
 void ReplicationManager::stop_async_processing() {
+    running = false;
+    
+    // Streams still holding unsent operations drop them; their threads are
+    // joined outside the map lock
+    std::unordered_map<std::string, std::unique_ptr<ReplicationStream>> stopped;
+    {
+        std::lock_guard<std::mutex> lock(streams_mutex);
+        stopped.swap(streams);
+    }
+    for (auto& entry : stopped) {
+        entry.second->stop();
+    }
+}
+
+ReplicationStream* ReplicationManager::stream_for(const std::shared_ptr<NodeInfo>& peer) {
+    std::string peer_key = peer->address + ":" + std::to_string(peer->port);
+    std::lock_guard<std::mutex> lock(streams_mutex);
     if (!running.load()) {
-        return; // Not running
+        return nullptr;
     }
     
-    running = false;
-    queue_cv.notify_all(); // Wake up the processing thread
+    std::unique_ptr<ReplicationStream>& stream = streams[peer_key];
+    if (!stream) {
+        ReplicationStream::Limits limits;
+        {
+            std::lock_guard<std::mutex> config_lock(mutex);
+            limits.max_pending_bytes = config.async_max_pending_bytes;
+            limits.batch_max_ops = config.async_batch_max_ops;
+            limits.batch_max_bytes = config.async_batch_max_bytes;
+            limits.max_retries = config.max_retries;
+        }
+        stream.reset(new ReplicationStream(peer, limits, ack_histogram(peer_key)));
+    }
+    return stream.get();
+}
+
+bool ReplicationManager::enqueue_async(ReplicationTask::TaskType type, const std::string& key,
+                                       const std::shared_ptr<const std::vector<uint8_t>>& value,
+                                       const std::vector<std::shared_ptr<NodeInfo>>& replicas) {
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timeout_ms = config.sync_timeout_ms;
+    }
     
-    if (processing_thread.joinable()) {
-        processing_thread.join();
+    bool accepted = true;
+    for (const auto& target : select_targets(replicas)) {
+        ReplicationStream* stream = stream_for(target);
+        if (!stream || !stream->enqueue(type, key, value, std::chrono::milliseconds(timeout_ms))) {
+            accepted = false;
+        }
+    }
+    return accepted;
+}
+
+std::vector<ReplicationManager::StreamStats> ReplicationManager::get_stream_stats() const {
+    std::vector<StreamStats> stats;
+    std::lock_guard<std::mutex> lock(streams_mutex);
+    for (const auto& entry : streams) {
+        stats.push_back(entry.second->get_stats());
+    }
+    return stats;
+}
+
+Histogram* ReplicationManager::ack_histogram(const std::string& peer_key) {
+    std::lock_guard<std::mutex> lock(ack_mutex);
+    std::unique_ptr<Histogram>& histogram = ack_latency_us[peer_key];
+    if (!histogram) {
+        histogram.reset(new Histogram());
     }
+    return histogram.get();
 }
 
-void ReplicationManager::enqueue_replication_task(const ReplicationTask& task) {
+std::vector<ReplicationManager::PeerLatency> ReplicationManager::get_ack_latency() const {
+    std::vector<PeerLatency> result;
     {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        pending_tasks.push(task);
+        std::lock_guard<std::mutex> lock(ack_mutex);
+        for (const auto& entry : ack_latency_us) {
+            result.push_back(PeerLatency{entry.first, entry.second->snapshot()});
+        }
     }
-    queue_cv.notify_one(); // Wake up the processing thread
+    std::sort(result.begin(), result.end(), [](const PeerLatency& a, const PeerLatency& b) {
+        return a.peer < b.peer;
+    });
+    return result;
 }
 
-void ReplicationManager::process_replication_queue() {
-    while (running.load()) {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        
-        // Wait for tasks or shutdown signal
-        queue_cv.wait(lock, [this] {
-            return !pending_tasks.empty() || !running.load();
-        });
-        
-        while (!pending_tasks.empty() && running.load()) {
-            ReplicationTask task = pending_tasks.front();
-            pending_tasks.pop();
-            
-            // Release lock while processing the task (prevents deadlock)
-            lock.unlock();
-            
-            // Process the task with retries
-            bool success = process_single_task(task);
-            
-            if (!success && task.retry_count < config.max_retries) {
-                // Re-enqueue for retry
-                task.retry_count++;
-                std::cerr << "Replication task failed for key '" << task.key 
-                         << "', retry " << task.retry_count << "/" << config.max_retries << std::endl;
-                enqueue_replication_task(task);
-            } else if (!success) {
-                std::cerr << "Replication task permanently failed for key '" << task.key 
-                         << "' after " << config.max_retries << " retries" << std::endl;
-            }
-            
-            // Re-acquire lock for next iteration
-            lock.lock();
+int64_t ReplicationManager::get_max_replication_lag_ms() const {
+    int64_t lag = 0;
+    for (const auto& stream : get_stream_stats()) {
+        lag = std::max(lag, stream.lag_ms);
+    }
+    return lag;
+}
+
+bool ReplicationManager::flush_async(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::vector<ReplicationStream*> active;
+    {
+        std::lock_guard<std::mutex> lock(streams_mutex);
+        for (auto& entry : streams) {
+            active.push_back(entry.second.get());
+        }
+    }
+    // Streams are only destroyed by stop_async_processing, which callers
+    // must not run concurrently with a flush
+    for (ReplicationStream* stream : active) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() < 0 || !stream->wait_idle(remaining)) {
+            return false;
         }
     }
+    return true;
 }
 
-bool ReplicationManager::process_single_task(ReplicationTask& task) {
-    int successful_replications = 0;
-    int required_replications = std::min(config.replication_factor - 1, 
-                                        static_cast<int>(task.replicas.size()));
+// ReplicationStream implementation
+ReplicationStream::ReplicationStream(std::shared_ptr<NodeInfo> p, const Limits& l,
+                                     Histogram* ack_latency)
+    : peer(p), limits(l), ack_latency_us(ack_latency), pending_bytes(0), inflight_ops(0), stopping(false),
+      sent_ops(0), coalesced_ops(0), batches_sent(0), failed_batches(0),
+      dropped_ops(0), rejected_ops(0) {
+    sender = std::thread(&ReplicationStream::run, this);
+}
+
+ReplicationStream::~ReplicationStream() {
+    stop();
+}
+
+void ReplicationStream::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    space_cv.notify_all();
+    if (sender.joinable()) {
+        sender.join();
+    }
+    idle_cv.notify_all();
+}
+
+bool ReplicationStream::enqueue(ReplicationManager::ReplicationTask::TaskType type, const std::string& key,
+                                const std::shared_ptr<const std::vector<uint8_t>>& value,
+                                std::chrono::milliseconds max_wait) {
+    PendingOp op;
+    op.type = type;
+    op.value = value;
+    op.enqueued_at = std::chrono::steady_clock::now();
+    size_t bytes = op_bytes(key, op);
     
-    for (int i = 0; i < required_replications; ++i) {
-        if (!task.replicas[i] || task.replicas[i]->port == 0) {
-            continue;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stopping) {
+        return false;
+    }
+    
+    auto queued = pending.find(key);
+    if (queued != pending.end()) {
+        // Coalesce: the newer operation replaces the queued one but keeps
+        // its place in line (and its age, for lag accounting)
+        pending_bytes -= op_bytes(key, queued->second);
+        queued->second.type = op.type;
+        queued->second.value = op.value;
+        pending_bytes += bytes;
+        coalesced_ops++;
+        return true;
+    }
+    
+    // Backpressure; an empty stream always accepts, however large the op
+    bool has_space = space_cv.wait_for(lock, max_wait, [this, bytes] {
+        return stopping || pending_bytes == 0 || pending_bytes + bytes <= limits.max_pending_bytes;
+    });
+    if (!has_space || stopping) {
+        rejected_ops++;
+        return false;
+    }
+    
+    // The key may have been queued by another writer while we waited
+    queued = pending.find(key);
+    if (queued != pending.end()) {
+        pending_bytes -= op_bytes(key, queued->second);
+        queued->second.type = op.type;
+        queued->second.value = op.value;
+        pending_bytes += bytes;
+        coalesced_ops++;
+        return true;
+    }
+    
+    order.push_back(key);
+    pending.emplace(key, op);
+    pending_bytes += bytes;
+    lock.unlock();
+    work_cv.notify_one();
+    return true;
+}
+
+void ReplicationStream::run() {
+    int consecutive_failures = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    while (true) {
+        work_cv.wait(lock, [this] { return stopping || !order.empty(); });
+        if (stopping) {
+            break;
         }
         
-        bool success = false;
-        if (task.type == ReplicationTask::PUT) {
-            success = send_replication_request(task.replicas[i], "PUT", task.key, task.value);
-        } else if (task.type == ReplicationTask::DELETE) {
-            success = send_replication_request(task.replicas[i], "DELETE", task.key);
+        // Everything queued while the previous batch was in flight goes
+        // out together, up to the batch limits
+        std::vector<BatchItem> batch;
+        size_t batch_bytes = 0;
+        while (!order.empty() && batch.size() < limits.batch_max_ops &&
+               (batch.empty() || batch_bytes < limits.batch_max_bytes)) {
+            auto it = pending.find(order.front());
+            order.pop_front();
+            batch_bytes += op_bytes(it->first, it->second);
+            batch.push_back(BatchItem(it->first, std::move(it->second)));
+            pending.erase(it);
         }
+        inflight_ops = batch.size();
+        inflight_oldest = batch.front().second.enqueued_at;
+        for (const auto& item : batch) {
+            inflight_oldest = std::min(inflight_oldest, item.second.enqueued_at);
+        }
+        
+        lock.unlock();
+        std::vector<bool> acked = send_batch(batch);
+        lock.lock();
+        
+        size_t failed = 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!acked[i]) {
+                failed++;
+            }
+        }
+        
+        if (failed == 0) {
+            consecutive_failures = 0;
+            batches_sent++;
+        } else {
+            consecutive_failures++;
+            failed_batches++;
+        }
+        bool give_up = consecutive_failures > limits.max_retries;
+        
+        // Release acknowledged (and abandoned) bytes; put failures back at
+        // the front unless a newer write for the key is already queued
+        for (size_t i = batch.size(); i-- > 0;) {
+            const std::string& key = batch[i].first;
+            size_t bytes = op_bytes(key, batch[i].second);
+            if (acked[i]) {
+                sent_ops++;
+                pending_bytes -= bytes;
+            } else if (give_up || pending.count(key)) {
+                if (give_up) {
+                    dropped_ops++;
+                }
+                pending_bytes -= bytes;
+            } else {
+                order.push_front(key);
+                pending.emplace(key, std::move(batch[i].second));
+            }
+        }
+        if (give_up) {
+            FKVS_WARN("Async replication to " << peer->to_string() << " dropped "
+                      << failed << " operations after " << limits.max_retries << " retries");
+            consecutive_failures = 0;
+        }
+        inflight_ops = 0;
         
-        if (success) {
-            successful_replications++;
+        space_cv.notify_all();
+        if (order.empty()) {
+            idle_cv.notify_all();
+        }
+        
+        if (failed > 0 && !give_up) {
+            // Back off before retrying: 100ms, 200ms, 400ms, ...
+            auto backoff = std::chrono::milliseconds(100 << std::min(consecutive_failures - 1, 5));
+            work_cv.wait_for(lock, backoff, [this] { return stopping; });
         }
     }
+}
+
+std::vector<bool> ReplicationStream::send_batch(const std::vector<BatchItem>& batch) {
+    std::vector<Request> requests;
+    requests.reserve(batch.size());
+    for (const auto& item : batch) {
+        std::vector<uint8_t> key_bytes(item.first.begin(), item.first.end());
+        if (item.second.type == ReplicationManager::ReplicationTask::PUT) {
+            requests.emplace_back(OpCode::REPLICATE, key_bytes, *item.second.value);
+        } else {
+            requests.emplace_back(OpCode::REPLICATE_DELETE, key_bytes,
+                                  item.second.value ? *item.second.value : std::vector<uint8_t>());
+        }
+    }
+    
+    std::vector<Response> responses;
+    try {
+        auto started = std::chrono::steady_clock::now();
+        bool sent = ConnectionPool::instance().call(peer->address, peer->port,
+            [&requests, &responses](Client& client) {
+                return client.pipeline(requests, responses, requests.size());
+            });
+        if (sent && ack_latency_us) {
+            ack_latency_us->record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count());
+        }
+    } catch (const std::exception& e) {
+        FKVS_WARN("Async replication batch to " << peer->to_string()
+                  << " failed: " << e.what());
+    }
+    
+    std::vector<bool> acked(batch.size(), false);
+    for (size_t i = 0; i < responses.size() && i < batch.size(); ++i) {
+        acked[i] = responses[i].status == StatusCode::SUCCESS ||
+                   (batch[i].second.type == ReplicationManager::ReplicationTask::DELETE &&
+                    responses[i].status == StatusCode::KEY_NOT_FOUND);
+    }
+    return acked;
+}
+
+ReplicationManager::StreamStats ReplicationStream::get_stats() const {
+    ReplicationManager::StreamStats stats;
+    auto now = std::chrono::steady_clock::now();
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.peer = peer->address + ":" + std::to_string(peer->port);
+    stats.pending_ops = order.size() + inflight_ops;
+    stats.pending_bytes = pending_bytes;
+    stats.sent_ops = sent_ops;
+    stats.coalesced_ops = coalesced_ops;
+    stats.batches_sent = batches_sent;
+    stats.failed_batches = failed_batches;
+    stats.dropped_ops = dropped_ops;
+    stats.rejected_ops = rejected_ops;
     
-    // Return true if we achieved the required replication factor
-    return (successful_replications >= required_replications);
+    // Queued ops are FIFO (retries rejoin at the front, coalescing keeps
+    // the original age), so the oldest is at the front or in flight
+    stats.lag_ms = 0;
+    bool have_oldest = false;
+    std::chrono::steady_clock::time_point oldest;
+    if (inflight_ops > 0) {
+        oldest = inflight_oldest;
+        have_oldest = true;
+    }
+    if (!order.empty()) {
+        auto front = pending.find(order.front());
+        if (front != pending.end() && (!have_oldest || front->second.enqueued_at < oldest)) {
+            oldest = front->second.enqueued_at;
+            have_oldest = true;
+        }
+    }
+    if (have_oldest) {
+        stats.lag_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - oldest).count();
+    }
+    return stats;
+}
+
+bool ReplicationStream::wait_idle(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return idle_cv.wait_for(lock, timeout, [this] {
+        return stopping || (order.empty() && inflight_ops == 0);
+    });
 }
 
 // FailureDetector implementation
-FailureDetector::FailureDetector(const FailureConfig& cfg) : config(cfg) {
+FailureDetector::FailureDetector(const FailureConfig& cfg) : state(std::make_shared<State>(cfg)) {
+}
+
+void FailureDetector::probe(const std::vector<std::shared_ptr<NodeInfo>>& nodes) {
+    HeartbeatRegistry& registry = HeartbeatRegistry::instance();
+    int64_t now = HeartbeatRegistry::now_us();
+    
+    std::vector<std::pair<std::string, std::shared_ptr<NodeInfo>>> quiet;
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->rounds++;
+        timeout_ms = state->config.ping_timeout_ms;
+        int64_t fresh_us = static_cast<int64_t>(state->config.ping_interval_ms) * 1000 / 2;
+        for (const auto& node : nodes) {
+            if (!node) {
+                continue;
+            }
+            std::string node_key = get_node_key(node);
+            NodeStatus& status = state->node_statuses[node_key];
+            if (status.last_heartbeat_us > 0 && status.last_round + 1 < state->rounds) {
+                // Not watched since an earlier round (a predecessor that was
+                // replaced and came back, say): the gap says nothing about
+                // the node, so watching starts over from now
+                status.intervals_ms.clear();
+                status.interval_sum = 0;
+                status.interval_sum_sq = 0;
+                status.last_heartbeat_us = now;
+                status.is_suspected = false;
+                status.is_failed = false;
+            }
+            status.last_round = state->rounds;
+            // At most one heartbeat per node per round, however much
+            // traffic it answered, so the window tracks the round cadence
+            take_heartbeat(*state, status, registry.last_heard(node_key));
+            if (status.last_heartbeat_us > 0 && now - status.last_heartbeat_us < fresh_us) {
+                state->probes_skipped++;
+            } else if (!status.probing) {
+                status.probing = true;
+                state->probes_sent++;
+                quiet.push_back(std::make_pair(node_key, node));
+            }
+            evaluate(*state, status, node_key, now);
+        }
+    }
+    
+    std::weak_ptr<State> weak_state = state;
+    for (const auto& entry : quiet) {
+        std::string node_key = entry.first;
+        AsyncRpc::instance().call(entry.second->address, entry.second->port, Request(OpCode::PING, {}),
+            [weak_state, node_key](bool ok, Response& response) {
+                std::shared_ptr<State> shared = weak_state.lock();
+                if (!shared) {
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                NodeStatus& status = shared->node_statuses[node_key];
+                status.probing = false;
+                if (ok && response.status == StatusCode::SUCCESS) {
+                    take_heartbeat(*shared, status, HeartbeatRegistry::now_us());
+                } else {
+                    record_miss(*shared, status, node_key);
+                }
+            }, std::chrono::milliseconds(timeout_ms));
+    }
 }
 
 void FailureDetector::ping_node(std::shared_ptr<NodeInfo> node) {
     if (!node) {
         return;
     }
+    ping_nodes({node});
+}
+
+void FailureDetector::ping_nodes(const std::vector<std::shared_ptr<NodeInfo>>& nodes) {
+    int timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        timeout_ms = state->config.ping_timeout_ms;
+    }
     
-    std::string node_key = get_node_key(node);
-    bool is_responsive = ping_node_impl(node);
-    
-    std::lock_guard<std::mutex> lock(mutex);
-    auto& status = node_statuses[node_key];
-    
-    if (is_responsive) {
-        status.last_seen = std::chrono::steady_clock::now();
-        status.consecutive_failures = 0;
-        status.is_suspected = false;
-        status.is_failed = false;
-    } else {
-        status.consecutive_failures++;
-        
-        if (status.consecutive_failures >= config.failure_threshold) {
-            status.is_failed = true;
-            std::cout << "Node marked as failed: " << node->to_string() << std::endl;
-        } else if (status.consecutive_failures >= config.failure_threshold / 2) {
-            status.is_suspected = true;
+    // All pings in flight at once: a round costs the slowest node's
+    // answer (or the ping timeout), not the sum
+    std::vector<std::future<AsyncRpc::Result>> pending;
+    for (const auto& node : nodes) {
+        if (node) {
+            pending.push_back(AsyncRpc::instance().submit(node->address, node->port,
+                Request(OpCode::PING, {}), std::chrono::milliseconds(timeout_ms)));
         }
     }
+    size_t next = 0;
+    for (const auto& node : nodes) {
+        if (!node) {
+            continue;
+        }
+        AsyncRpc::Result result = pending[next++].get();
+        std::string node_key = get_node_key(node);
+        std::lock_guard<std::mutex> lock(state->mutex);
+        NodeStatus& status = state->node_statuses[node_key];
+        int64_t now = HeartbeatRegistry::now_us();
+        if (result.ok && result.response.status == StatusCode::SUCCESS) {
+            take_heartbeat(*state, status, now);
+        } else {
+            record_miss(*state, status, node_key);
+        }
+        evaluate(*state, status, node_key, now);
+    }
+}
+
+void FailureDetector::take_heartbeat(State& state, NodeStatus& status, int64_t at_us) {
+    if (at_us <= status.last_heartbeat_us || at_us <= status.failed_at_us) {
+        return;
+    }
+    if (status.is_failed) {
+        // Back after a failure, possibly restarted: judge it afresh
+        status.intervals_ms.clear();
+        status.interval_sum = 0;
+        status.interval_sum_sq = 0;
+    } else if (status.last_heartbeat_us > 0) {
+        double interval = static_cast<double>(at_us - status.last_heartbeat_us) / 1000.0;
+        status.intervals_ms.push_back(interval);
+        status.interval_sum += interval;
+        status.interval_sum_sq += interval * interval;
+        if (status.intervals_ms.size() > state.config.window_size) {
+            double oldest = status.intervals_ms.front();
+            status.intervals_ms.pop_front();
+            status.interval_sum -= oldest;
+            status.interval_sum_sq -= oldest * oldest;
+        }
+    }
+    status.last_heartbeat_us = at_us;
+    status.last_seen = std::chrono::steady_clock::now();
+    status.consecutive_failures = 0;
+    status.is_suspected = false;
+    status.is_failed = false;
+}
+
+void FailureDetector::record_miss(State& state, NodeStatus& status, const std::string& node_key) {
+    state.probe_failures++;
+    status.consecutive_failures++;
+    if (status.last_heartbeat_us > 0 || status.is_failed) {
+        return; // phi decides for nodes with a history
+    }
+    if (status.consecutive_failures >= state.config.failure_threshold) {
+        status.is_failed = true;
+        status.failed_at_us = HeartbeatRegistry::now_us();
+        state.failures_detected++;
+        FKVS_INFO("Node marked as failed: " << node_key << " (never answered)");
+    } else if (status.consecutive_failures >= state.config.failure_threshold / 2) {
+        status.is_suspected = true;
+    }
+}
+
+double FailureDetector::compute_phi(const State& state, const NodeStatus& status, int64_t now_us) {
+    if (status.last_heartbeat_us == 0) {
+        return 0.0;
+    }
+    double mean;
+    double std_dev;
+    size_t samples = status.intervals_ms.size();
+    if (samples == 0) {
+        // No interval yet: assume the probe cadence
+        mean = state.config.ping_interval_ms;
+        std_dev = mean / 4;
+    } else {
+        mean = status.interval_sum / samples;
+        std_dev = std::sqrt(std::max(0.0, status.interval_sum_sq / samples - mean * mean));
+    }
+    std_dev = std::max(std_dev, static_cast<double>(state.config.min_std_dev_ms));
+    
+    // Logistic approximation of the normal CDF's upper tail
+    double elapsed = static_cast<double>(now_us - status.last_heartbeat_us) / 1000.0;
+    double y = (elapsed - mean) / std_dev;
+    double e = std::exp(-y * (1.5976 + 0.070566 * y * y));
+    if (elapsed > mean) {
+        return -std::log10(e / (1.0 + e));
+    }
+    return -std::log10(1.0 - 1.0 / (1.0 + e));
+}
+
+void FailureDetector::evaluate(State& state, NodeStatus& status, const std::string& node_key, int64_t now_us) {
+    if (status.last_heartbeat_us == 0) {
+        return; // judged by record_miss
+    }
+    double phi = compute_phi(state, status, now_us);
+    if (!status.is_failed && phi >= state.config.phi_threshold) {
+        status.is_failed = true;
+        status.failed_at_us = now_us;
+        state.failures_detected++;
+        FKVS_INFO("Node marked as failed: " << node_key << " (phi " << phi << ")");
+    }
+    status.is_suspected = status.is_failed || phi >= state.config.phi_threshold / 2;
 }
 
 void FailureDetector::mark_node_responsive(std::shared_ptr<NodeInfo> node) {
@@ -324,11 +946,14 @@ void FailureDetector::mark_node_responsive(std::shared_ptr<NodeInfo> node) {
         return;
     }
     
+    // The stamp is taken in as a heartbeat by the next probe round
     std::string node_key = get_node_key(node);
-    std::lock_guard<std::mutex> lock(mutex);
+    HeartbeatRegistry::instance().heard(node_key);
+    std::lock_guard<std::mutex> lock(state->mutex);
     
-    auto& status = node_statuses[node_key];
+    auto& status = state->node_statuses[node_key];
     status.last_seen = std::chrono::steady_clock::now();
+    status.failed_at_us = 0;
     status.consecutive_failures = 0;
     status.is_suspected = false;
     status.is_failed = false;
@@ -340,11 +965,22 @@ void FailureDetector::mark_node_failed(std::shared_ptr<NodeInfo> node) {
     }
     
     std::string node_key = get_node_key(node);
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(state->mutex);
     
-    auto& status = node_statuses[node_key];
+    auto& status = state->node_statuses[node_key];
     status.is_failed = true;
-    status.consecutive_failures = config.failure_threshold;
+    status.failed_at_us = HeartbeatRegistry::now_us();
+    status.consecutive_failures = state->config.failure_threshold;
+}
+
+void FailureDetector::report_unreachable(std::shared_ptr<NodeInfo> node) {
+    if (!node) {
+        return;
+    }
+    
+    std::string node_key = get_node_key(node);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    record_miss(*state, state->node_statuses[node_key], node_key);
 }
 
 bool FailureDetector::is_node_failed(std::shared_ptr<NodeInfo> node) const {
@@ -353,10 +989,10 @@ bool FailureDetector::is_node_failed(std::shared_ptr<NodeInfo> node) const {
     }
     
     std::string node_key = get_node_key(node);
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(state->mutex);
     
-    auto it = node_statuses.find(node_key);
-    return it != node_statuses.end() && it->second.is_failed;
+    auto it = state->node_statuses.find(node_key);
+    return it != state->node_statuses.end() && it->second.is_failed;
 }
 
 bool FailureDetector::is_node_suspected(std::shared_ptr<NodeInfo> node) const {
@@ -365,18 +1001,33 @@ bool FailureDetector::is_node_suspected(std::shared_ptr<NodeInfo> node) const {
     }
     
     std::string node_key = get_node_key(node);
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(state->mutex);
     
-    auto it = node_statuses.find(node_key);
-    return it != node_statuses.end() && it->second.is_suspected;
+    auto it = state->node_statuses.find(node_key);
+    return it != state->node_statuses.end() && it->second.is_suspected;
+}
+
+double FailureDetector::phi(std::shared_ptr<NodeInfo> node) const {
+    if (!node) {
+        return 0.0;
+    }
+    
+    std::string node_key = get_node_key(node);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    
+    auto it = state->node_statuses.find(node_key);
+    if (it == state->node_statuses.end()) {
+        return 0.0;
+    }
+    return compute_phi(*state, it->second, HeartbeatRegistry::now_us());
 }
 
 std::vector<std::shared_ptr<NodeInfo>> FailureDetector::get_failed_nodes() const {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(state->mutex);
     
     std::vector<std::shared_ptr<NodeInfo>> failed_nodes;
     
-    for (const auto& entry : node_statuses) {
+    for (const auto& entry : state->node_statuses) {
         const std::string& node_key = entry.first;
         const NodeStatus& status = entry.second;
         if (status.is_failed) {
@@ -393,15 +1044,38 @@ std::vector<std::shared_ptr<NodeInfo>> FailureDetector::get_failed_nodes() const
     return failed_nodes;
 }
 
+FailureDetector::Stats FailureDetector::get_stats() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    
+    Stats stats;
+    stats.rounds = state->rounds;
+    stats.probes_sent = state->probes_sent;
+    stats.probes_skipped = state->probes_skipped;
+    stats.probe_failures = state->probe_failures;
+    stats.failures_detected = state->failures_detected;
+    stats.monitored = state->node_statuses.size();
+    stats.suspected = 0;
+    stats.failed = 0;
+    for (const auto& entry : state->node_statuses) {
+        if (entry.second.is_failed) {
+            stats.failed++;
+        } else if (entry.second.is_suspected) {
+            stats.suspected++;
+        }
+    }
+    return stats;
+}
+
 void FailureDetector::cleanup_old_entries(std::chrono::minutes max_age) {
-    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(state->mutex);
     
     auto now = std::chrono::steady_clock::now();
     auto cutoff = now - max_age;
     
-    for (auto it = node_statuses.begin(); it != node_statuses.end();) {
-        if (it->second.last_seen < cutoff) {
-            it = node_statuses.erase(it);
+    for (auto it = state->node_statuses.begin(); it != state->node_statuses.end();) {
+        // Keep nodes with a probe in flight; its answer lands here
+        if (it->second.last_seen < cutoff && !it->second.probing) {
+            it = state->node_statuses.erase(it);
         } else {
             ++it;
         }
@@ -412,14 +1086,4 @@ std::string FailureDetector::get_node_key(std::shared_ptr<NodeInfo> node) const
     return node->address + ":" + std::to_string(node->port);
 }
 
-bool FailureDetector::ping_node_impl(std::shared_ptr<NodeInfo> node) {
-    try {
-        Client client(node->address, node->port);
-        client.connect();
-        return client.ping();
-    } catch (...) {
-        return false;
-    }
-}
-
 } // namespace funnelkvs
\ No newline at end of file
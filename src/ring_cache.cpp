@@ -0,0 +1,133 @@
+#include "ring_cache.h"
+#include <algorithm>
+
+namespace funnelkvs {
+
+namespace {
+
+bool id_less(const std::pair<Hash160, std::string>& entry, const Hash160& id) {
+    return entry.first < id;
+}
+
+} // namespace
+
+void RingCache::add(const std::string& endpoint) {
+    std::string host;
+    uint16_t port = 0;
+    if (!split_endpoint(endpoint, host, port)) {
+        return;
+    }
+    Hash160 id = SHA1::hash(endpoint);
+    auto it = std::lower_bound(ring.begin(), ring.end(), id, id_less);
+    if (it != ring.end() && it->first == id) {
+        return;
+    }
+    ring.insert(it, std::make_pair(id, endpoint));
+}
+
+void RingCache::add(const std::vector<std::string>& endpoints) {
+    for (const auto& endpoint : endpoints) {
+        add(endpoint);
+    }
+}
+
+bool RingCache::remove(const std::string& endpoint) {
+    Hash160 id = SHA1::hash(endpoint);
+    auto it = std::lower_bound(ring.begin(), ring.end(), id, id_less);
+    if (it == ring.end() || it->first != id) {
+        return false;
+    }
+    ring.erase(it);
+    return true;
+}
+
+bool RingCache::owner_of(const Hash160& id, std::string& endpoint) const {
+    if (ring.empty()) {
+        return false;
+    }
+    auto it = std::lower_bound(ring.begin(), ring.end(), id, id_less);
+    if (it == ring.end()) {
+        it = ring.begin();
+    }
+    endpoint = it->second;
+    return true;
+}
+
+std::vector<std::string> RingCache::replicas_of(const Hash160& id, size_t count) const {
+    std::vector<std::string> endpoints;
+    std::vector<std::string> servers;
+    if (ring.empty()) {
+        return endpoints;
+    }
+    size_t start = static_cast<size_t>(std::lower_bound(ring.begin(), ring.end(), id, id_less) - ring.begin());
+    for (size_t i = 0; i < ring.size() && endpoints.size() < count; ++i) {
+        const std::string& endpoint = ring[(start + i) % ring.size()].second;
+        std::string host;
+        uint16_t port = 0;
+        split_endpoint(endpoint, host, port);
+        std::string server = host + ":" + std::to_string(port);
+        if (std::find(servers.begin(), servers.end(), server) == servers.end()) {
+            servers.push_back(server);
+            endpoints.push_back(endpoint);
+        }
+    }
+    return endpoints;
+}
+
+bool RingCache::contains(const std::string& endpoint) const {
+    Hash160 id = SHA1::hash(endpoint);
+    auto it = std::lower_bound(ring.begin(), ring.end(), id, id_less);
+    return it != ring.end() && it->first == id;
+}
+
+std::vector<std::string> RingCache::nodes() const {
+    std::vector<std::string> endpoints;
+    endpoints.reserve(ring.size());
+    for (const auto& entry : ring) {
+        endpoints.push_back(entry.second);
+    }
+    return endpoints;
+}
+
+bool RingCache::split_endpoint(const std::string& endpoint, std::string& host, uint16_t& port,
+                               uint16_t* token) {
+    size_t hash_pos = endpoint.find('#');
+    size_t port_end = hash_pos == std::string::npos ? endpoint.size() : hash_pos;
+    size_t colon_pos = endpoint.rfind(':', port_end);
+    if (colon_pos == std::string::npos || colon_pos == 0 || colon_pos + 1 >= port_end) {
+        return false;
+    }
+    unsigned long value = 0;
+    for (size_t i = colon_pos + 1; i < port_end; ++i) {
+        if (endpoint[i] < '0' || endpoint[i] > '9') {
+            return false;
+        }
+        value = value * 10 + static_cast<unsigned long>(endpoint[i] - '0');
+        if (value > 65535) {
+            return false;
+        }
+    }
+    unsigned long token_value = 0;
+    if (hash_pos != std::string::npos) {
+        if (hash_pos + 1 == endpoint.size()) {
+            return false;
+        }
+        for (size_t i = hash_pos + 1; i < endpoint.size(); ++i) {
+            if (endpoint[i] < '0' || endpoint[i] > '9') {
+                return false;
+            }
+            token_value = token_value * 10 + static_cast<unsigned long>(endpoint[i] - '0');
+            if (token_value > 65535) {
+                return false;
+            }
+        }
+    }
+    host = endpoint.substr(0, colon_pos);
+    port = static_cast<uint16_t>(value);
+    if (token) {
+        *token = static_cast<uint16_t>(token_value);
+    }
+    return true;
+}
+
+} // namespace funnelkvs
@@ -1,245 +1,588 @@
 #include "server.h"
-#include <iostream>
+#include "logger.h"
 #include <cstring>
+#include <algorithm>
+#include <chrono>
 #include <sys/socket.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <errno.h>
 
 namespace funnelkvs {
 
-ThreadPool::ThreadPool(size_t threads) : stop(false) {
-    for (size_t i = 0; i < threads; ++i) {
-        workers.emplace_back(&ThreadPool::worker_thread, this);
-    }
-}
-
-ThreadPool::~ThreadPool() {
-    stop.store(true);
-    condition.notify_all();
-    for (std::thread& worker : workers) {
-        worker.join();
-    }
-}
-
-void ThreadPool::worker_thread() {
-    while (!stop.load()) {
-        std::function<void()> task;
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            condition.wait(lock, [this] { return stop.load() || !tasks.empty(); });
-            if (stop.load() && tasks.empty()) {
-                return;
-            }
-            if (!tasks.empty()) {
-                task = std::move(tasks.front());
-                tasks.pop();
-            }
-        }
-        if (task) {
-            task();
-        }
-    }
-}
+static constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+static constexpr size_t READ_BUDGET_PER_EVENT = 1024 * 1024;
+static constexpr size_t IDLE_BUFFER_CAPACITY = 16 * 1024;
+// Responses to a pipelined burst are coalesced into one write; values
+// larger than this bypass the buffer and go out with writev instead.
+static constexpr size_t COALESCE_VALUE_LIMIT = 16 * 1024;
+static constexpr size_t COALESCE_FLUSH_THRESHOLD = 256 * 1024;
+static constexpr int MAX_EPOLL_EVENTS = 256;
+static constexpr int SEND_TIMEOUT_MS = 5000;
 
-Server::Server(uint16_t port, size_t num_threads) 
-    : thread_pool(num_threads), server_fd(-1), running(false), port(port) {
+Server::Server(uint16_t port, size_t num_threads, size_t num_event_loops)
+    : thread_pool(num_threads), running(false), port(port),
+      num_event_loops(num_event_loops == 0 ? 1 : num_event_loops), accepted_connections(0),
+      in_flight(0) {
 }
 
 Server::~Server() {
     stop();
 }
 
-void Server::setup_server_socket() {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
+Server::Connection::~Connection() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+int Server::create_listen_socket(bool reuse_port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
         throw std::runtime_error("Failed to create socket");
     }
     
     int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        close(server_fd);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        close(fd);
         throw std::runtime_error("Failed to set socket options");
     }
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(fd);
+        throw std::runtime_error("Failed to set SO_REUSEPORT");
+    }
     
     struct sockaddr_in address;
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
     
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        close(server_fd);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
         throw std::runtime_error("Failed to bind to port " + std::to_string(port));
     }
     
-    if (listen(server_fd, 128) < 0) {
-        close(server_fd);
+    if (listen(fd, 1024) < 0) {
+        close(fd);
         throw std::runtime_error("Failed to listen on socket");
     }
+    return fd;
+}
+
+void Server::close_event_loops() {
+    for (auto& loop : event_loops) {
+        if (loop->listen_fd >= 0) close(loop->listen_fd);
+        if (loop->wake_fd >= 0) close(loop->wake_fd);
+        if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    }
+    event_loops.clear();
 }
 
 void Server::start() {
+    std::lock_guard<std::mutex> lifecycle(lifecycle_mutex);
     if (running.load()) {
         return;
     }
     
-    setup_server_socket();
+    bool reuse_port = num_event_loops > 1;
+    try {
+        for (size_t i = 0; i < num_event_loops; ++i) {
+            std::unique_ptr<EventLoop> loop(new EventLoop());
+            EventLoop* raw = loop.get();
+            event_loops.push_back(std::move(loop));
+            
+            raw->listen_fd = create_listen_socket(reuse_port);
+            raw->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            raw->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (raw->epoll_fd < 0 || raw->wake_fd < 0) {
+                throw std::runtime_error("Failed to create event loop");
+            }
+            
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = raw; // listening socket
+            epoll_ctl(raw->epoll_fd, EPOLL_CTL_ADD, raw->listen_fd, &ev);
+            ev.data.ptr = nullptr; // wake-up eventfd
+            epoll_ctl(raw->epoll_fd, EPOLL_CTL_ADD, raw->wake_fd, &ev);
+        }
+    } catch (...) {
+        close_event_loops();
+        throw;
+    }
+    
     running.store(true);
-    accept_thread = std::thread(&Server::accept_loop, this);
-    std::cout << "Server started on port " << port << std::endl;
+    for (auto& loop : event_loops) {
+        loop->thread = std::thread(&Server::event_loop, this, loop.get());
+    }
+    FKVS_INFO("Server started on port " << port);
 }
 
 void Server::stop() {
-    if (!running.load()) {
+    // Serialized so a second caller (e.g. the destructor racing an
+    // ADMIN_SHUTDOWN thread) waits for teardown instead of returning while
+    // the loop threads are still being joined.
+    std::lock_guard<std::mutex> lifecycle(lifecycle_mutex);
+    if (event_loops.empty()) {
         return;
     }
     
     running.store(false);
-    if (server_fd >= 0) {
-        shutdown(server_fd, SHUT_RDWR);
-        close(server_fd);
+    for (auto& loop : event_loops) {
+        uint64_t one = 1;
+        ssize_t ignored = write(loop->wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    for (auto& loop : event_loops) {
+        if (loop->thread.joinable()) {
+            loop->thread.join();
+        }
     }
     
-    if (accept_thread.joinable()) {
-        accept_thread.join();
+    // Unblock workers that are mid-send, then wait for them to hand
+    // their connections back before releasing anything.
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        for (Connection* conn : connections) {
+            shutdown(conn->fd, SHUT_RDWR);
+        }
     }
-    std::cout << "Server stopped" << std::endl;
+    {
+        std::unique_lock<std::mutex> lock(in_flight_mutex);
+        in_flight_cv.wait(lock, [this] { return in_flight == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        for (Connection* conn : connections) {
+            delete conn;
+        }
+        connections.clear();
+    }
+    
+    close_event_loops();
+    FKVS_INFO("Server stopped");
 }
 
-void Server::accept_loop() {
-    struct timeval timeout;
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
+size_t Server::active_connections() const {
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    return connections.size();
+}
+
+Storage::MemoryStats Server::get_memory_stats() const {
+    return storage.memory_stats();
+}
+
+StatsReport Server::get_stats() const {
+    StatsReport report;
+    collect_stats(report);
+    return report;
+}
+
+void Server::collect_stats(StatsReport& report) const {
+    report.add("server.connections.active", static_cast<uint64_t>(active_connections()));
+    report.add("server.connections.accepted", accepted_connections.load(std::memory_order_relaxed));
+    report.add("server.pool.threads", static_cast<uint64_t>(thread_pool.size()));
+    report.add("server.pool.busy", static_cast<uint64_t>(thread_pool.busy_workers()));
+    report.add("server.pool.queue_depth", static_cast<uint64_t>(thread_pool.queue_depth()));
+    report.add("server.pool.steals", thread_pool.steals());
     
-    if (setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        std::cerr << "Failed to set socket timeout" << std::endl;
+    for (const auto& op : request_metrics.snapshot()) {
+        std::string name = "request." + Protocol::opcodeName(op.opcode);
+        report.add_latency(name, op.latency_us);
+        report.add(name + ".errors", op.errors);
+        report.add(name + ".redirects", op.redirects);
+        report.add(name + ".bytes_in", op.bytes_in);
+        report.add(name + ".bytes_out", op.bytes_out);
     }
     
+    Logger::Stats log = Logger::instance().stats();
+    report.add("log.level", std::string(Logger::level_name(Logger::instance().level())));
+    report.add("log.written", log.written);
+    report.add("log.dropped", log.dropped);
+    
+    Storage::MemoryStats memory = get_memory_stats();
+    report.add("storage.entries", static_cast<uint64_t>(memory.entries));
+    report.add("storage.key_bytes", static_cast<uint64_t>(memory.key_bytes));
+    report.add("storage.value_bytes", static_cast<uint64_t>(memory.value_bytes));
+    report.add("storage.allocated_bytes", static_cast<uint64_t>(memory.allocated_bytes));
+    report.add("storage.slab_bytes", static_cast<uint64_t>(memory.slab_bytes));
+    report.add("storage.slab_used_bytes", static_cast<uint64_t>(memory.slab_used_bytes));
+    report.add("storage.large_bytes", static_cast<uint64_t>(memory.large_bytes));
+    report.add("storage.cold_value_bytes", static_cast<uint64_t>(memory.cold_value_bytes));
+    report.add("storage.cold_file_bytes", static_cast<uint64_t>(memory.cold_file_bytes));
+    report.add("storage.compressed_value_bytes", static_cast<uint64_t>(memory.compressed_value_bytes));
+    report.add("storage.expiry_timers", static_cast<uint64_t>(memory.expiry_timers));
+    report.add("storage.expired_keys", static_cast<uint64_t>(memory.expired_entries));
+}
+
+void Server::event_loop(EventLoop* loop) {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    
     while (running.load()) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
+        int n = epoll_wait(loop->epoll_fd, events, MAX_EPOLL_EVENTS, 1000);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            FKVS_ERROR("epoll_wait failed: " << strerror(errno));
+            break;
+        }
         
-        int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
+        for (int i = 0; i < n && running.load(); ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == nullptr) {
+                continue; // woken up by stop()
+            }
+            if (tag == loop) {
+                accept_connections(loop);
+                continue;
+            }
+            on_readable(static_cast<Connection*>(tag));
+        }
+    }
+}
+
+void Server::accept_connections(EventLoop* loop) {
+    while (running.load()) {
+        int client_fd = accept4(loop->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_fd < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            if (errno == EINTR) {
                 continue;
             }
-            if (running.load()) {
-                std::cerr << "Failed to accept connection" << std::endl;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && running.load()) {
+                FKVS_WARN("Failed to accept connection: " << strerror(errno));
             }
-            continue;
+            return;
         }
         
-        thread_pool.enqueue([this, client_fd]() {
-            handle_client(client_fd);
-        });
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        
+        Connection* conn = new Connection(client_fd, loop);
+        accepted_connections.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            connections.insert(conn);
+        }
+        
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            close_connection(conn);
+        }
     }
 }
 
-bool Server::receive_data(int fd, std::vector<uint8_t>& buffer, size_t expected_size) {
-    buffer.resize(expected_size);
-    size_t total_received = 0;
-    
-    while (total_received < expected_size) {
-        ssize_t received = recv(fd, buffer.data() + total_received, 
-                                expected_size - total_received, 0);
-        if (received <= 0) {
-            return false;
+void Server::on_readable(Connection* conn) {
+    // Drain what the kernel has buffered, bounded so one fast sender
+    // cannot monopolize the loop; EPOLLIN is level-triggered, so any
+    // remainder fires again after re-arming.
+    bool peer_closed = false;
+    size_t budget = READ_BUDGET_PER_EVENT;
+    while (budget > 0) {
+        conn->read_buffer.ensure_writable(READ_CHUNK_SIZE);
+        size_t want = std::min(conn->read_buffer.writable(), budget);
+        ssize_t received = recv(conn->fd, conn->read_buffer.write_ptr(), want, 0);
+        if (received > 0) {
+            conn->read_buffer.commit(static_cast<size_t>(received));
+            budget -= static_cast<size_t>(received);
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
         }
-        total_received += received;
+        peer_closed = true; // orderly shutdown or hard error
+        break;
     }
-    return true;
-}
-
-bool Server::send_data(int fd, const std::vector<uint8_t>& data) {
-    size_t total_sent = 0;
-    while (total_sent < data.size()) {
-        ssize_t sent = send(fd, data.data() + total_sent, 
-                           data.size() - total_sent, 0);
-        if (sent <= 0) {
-            return false;
+    
+    size_t frame_size = 0;
+    FrameStatus status = Protocol::requestFrameSize(conn->read_buffer.data(),
+                                                    conn->read_buffer.size(), frame_size);
+    if (status == FrameStatus::INCOMPLETE) {
+        if (peer_closed || !rearm(conn)) {
+            close_connection(conn);
         }
-        total_sent += sent;
+        return;
     }
-    return true;
+    
+    // At least one complete request (or a corrupt stream the worker will
+    // answer with an error): hand the connection to the pool.
+    {
+        std::lock_guard<std::mutex> lock(in_flight_mutex);
+        ++in_flight;
+    }
+    thread_pool.enqueue([this, conn, peer_closed]() {
+        serve_connection(conn, peer_closed);
+        finish_dispatch();
+    });
 }
 
-void Server::handle_client(int client_fd) {
-    // Set socket timeouts for client operations (5 seconds)
-    struct timeval timeout;
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        // Non-fatal, continue without timeout
-    }
-    if (setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0) {
-        // Non-fatal, continue without timeout
-    }
+void Server::serve_connection(Connection* conn, bool close_after) {
+    ByteBuffer& buffer = conn->read_buffer;
     
     while (true) {
-        // Read opcode and key length first
-        std::vector<uint8_t> initial_header(5);
-        if (!receive_data(client_fd, initial_header, 5)) {
+        size_t frame_size = 0;
+        FrameStatus status = Protocol::requestFrameSize(buffer.data(), buffer.size(), frame_size);
+        if (status == FrameStatus::INCOMPLETE) {
             break;
         }
         
-        uint32_t key_len = (static_cast<uint32_t>(initial_header[1]) << 24) |
-                           (static_cast<uint32_t>(initial_header[2]) << 16) |
-                           (static_cast<uint32_t>(initial_header[3]) << 8) |
-                           static_cast<uint32_t>(initial_header[4]);
-        
-        // Read key and value length
-        std::vector<uint8_t> key_and_value_len(key_len + 4);
-        if (!receive_data(client_fd, key_and_value_len, key_len + 4)) {
-            break;
+        RequestView view;
+        if (status == FrameStatus::INVALID ||
+            !Protocol::decodeRequestView(buffer.data(), frame_size, view)) {
+            queue_response(conn, Response(StatusCode::ERROR));
+            flush_responses(conn);
+            close_connection(conn);
+            return;
         }
         
-        uint32_t value_len = (static_cast<uint32_t>(key_and_value_len[key_len]) << 24) |
-                            (static_cast<uint32_t>(key_and_value_len[key_len + 1]) << 16) |
-                            (static_cast<uint32_t>(key_and_value_len[key_len + 2]) << 8) |
-                            static_cast<uint32_t>(key_and_value_len[key_len + 3]);
+        // The only copy of the payload: out of the reusable receive buffer
+        // into the request, from where handlers move it into storage.
+        Request request;
+        request.opcode = view.opcode;
+        request.compressed = view.compressed;
+        request.key.assign(view.key.data, view.key.data + view.key.size);
+        request.value.assign(view.value.data, view.value.data + view.value.size);
+        buffer.consume(frame_size);
         
-        // Read value if present
-        std::vector<uint8_t> value_data;
-        if (value_len > 0) {
-            value_data.resize(value_len);
-            if (!receive_data(client_fd, value_data, value_len)) {
-                break;
+        Response response;
+        auto started = std::chrono::steady_clock::now();
+        process_request(request, response);
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        request_metrics.record(request.opcode, response.status, frame_size,
+                               Protocol::RESPONSE_HEADER_SIZE + response.value.size(),
+                               std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        if (!queue_response(conn, response)) {
+            close_connection(conn);
+            return;
+        }
+    }
+    
+    // One write for every response produced by this burst
+    if (!flush_responses(conn)) {
+        close_connection(conn);
+        return;
+    }
+    
+    if (close_after || !running.load()) {
+        if (close_after) {
+            close_connection(conn);
+        }
+        // When stopping, stop() releases the connection
+        return;
+    }
+    
+    if (buffer.empty()) {
+        buffer.shrink_to(IDLE_BUFFER_CAPACITY);
+    }
+    conn->write_buffer.shrink_to(IDLE_BUFFER_CAPACITY);
+    if (!rearm(conn)) {
+        close_connection(conn);
+    }
+}
+
+bool Server::queue_response(Connection* conn, const Response& response) {
+    ByteBuffer& out = conn->write_buffer;
+    
+    if (response.value.size() > COALESCE_VALUE_LIMIT) {
+        // Large value: keep ordering by flushing what is queued, then send
+        // it without copying
+        return flush_responses(conn) && send_response(conn->fd, response);
+    }
+    
+    uint8_t header[Protocol::RESPONSE_HEADER_SIZE];
+    Protocol::encodeResponseHeader(response.status, static_cast<uint32_t>(response.value.size()), header,
+                                   response.compressed);
+    out.append(header, sizeof(header));
+    if (!response.value.empty()) {
+        out.append(response.value.data(), response.value.size());
+    }
+    
+    if (out.size() >= COALESCE_FLUSH_THRESHOLD) {
+        return flush_responses(conn);
+    }
+    return true;
+}
+
+bool Server::flush_responses(Connection* conn) {
+    ByteBuffer& out = conn->write_buffer;
+    if (out.empty()) {
+        return true;
+    }
+    bool ok = send_all(conn->fd, out.data(), out.size());
+    out.clear();
+    return ok;
+}
+
+bool Server::rearm(Connection* conn) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    return epoll_ctl(conn->loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == 0;
+}
+
+void Server::close_connection(Connection* conn) {
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connections.erase(conn);
+    }
+    delete conn; // closing the fd also removes it from epoll
+}
+
+void Server::finish_dispatch() {
+    std::lock_guard<std::mutex> lock(in_flight_mutex);
+    if (--in_flight == 0) {
+        in_flight_cv.notify_all();
+    }
+}
+
+bool Server::send_all(int fd, const uint8_t* data, size_t len) {
+    size_t total_sent = 0;
+    while (total_sent < len) {
+        ssize_t sent = send(fd, data + total_sent, len - total_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            total_sent += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket buffer full: wait for the peer to drain it
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, SEND_TIMEOUT_MS) <= 0) {
+                return false;
             }
+            continue;
         }
-        
-        // Reconstruct complete request
-        std::vector<uint8_t> full_request = initial_header;
-        full_request.insert(full_request.end(), key_and_value_len.begin(), key_and_value_len.end());
-        full_request.insert(full_request.end(), value_data.begin(), value_data.end());
-        
-        Request request;
-        if (Protocol::decodeRequest(full_request, request)) {
-            process_request(client_fd, request);
-        } else {
-            Response error_response(StatusCode::ERROR);
-            std::vector<uint8_t> encoded = Protocol::encodeResponse(error_response);
-            send_data(client_fd, encoded);
-            break;
+        return false;
+    }
+    return true;
+}
+
+bool Server::send_vectored(int fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        // sendmsg rather than writev, for MSG_NOSIGNAL: a peer that has
+        // gone away must not raise SIGPIPE
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = static_cast<size_t>(iovcnt);
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, SEND_TIMEOUT_MS) <= 0) {
+                    return false;
+                }
+                continue;
+            }
+            return false;
+        }
+        // Skip fully written segments and advance into a partial one
+        size_t remaining = static_cast<size_t>(sent);
+        while (iovcnt > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
         }
     }
+    return true;
+}
+
+bool Server::send_data(int fd, const std::vector<uint8_t>& data) {
+    return send_all(fd, data.data(), data.size());
+}
+
+bool Server::send_response(int fd, const Response& response) {
+    // Header and value go out in one writev, without first copying the
+    // value into an encoded frame.
+    uint8_t header[Protocol::RESPONSE_HEADER_SIZE];
+    Protocol::encodeResponseHeader(response.status, static_cast<uint32_t>(response.value.size()), header,
+                                   response.compressed);
     
-    close(client_fd);
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<uint8_t*>(response.value.data());
+    iov[1].iov_len = response.value.size();
+    return send_vectored(fd, iov, response.value.empty() ? 1 : 2);
 }
 
-void Server::process_request(int client_fd, const Request& request) {
-    Response response;
+void Server::process_request(Request& request, Response& response) {
     std::string key(request.key.begin(), request.key.end());
     
     switch (request.opcode) {
         case OpCode::GET: {
+            // A client that takes compressed values gets them as stored
+            uint64_t version = 0;
+            bool found = request.compressed ?
+                storage.get_stored(key, response.value, version, response.compressed) :
+                storage.get(key, response.value);
+            response.status = found ? StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+            break;
+        }
+        
+        case OpCode::REPLICATE_GET: {
+            if (storage.get(key, response.value)) {
+                response.status = StatusCode::SUCCESS;
+            } else {
+                response.status = StatusCode::KEY_NOT_FOUND;
+            }
+            break;
+        }
+        
+        case OpCode::SCAN: {
+            // One node holds the whole ring, so both kinds of scan walk it all
+            uint8_t flags = 0;
+            uint32_t max_entries = 0;
+            uint32_t max_bytes = 0;
+            std::vector<uint8_t> cursor;
+            Storage::RingPosition position;
+            if (!Protocol::decodeScanRequest(request.value.data(), request.value.size(), flags,
+                                             max_entries, max_bytes, cursor) ||
+                !position.parse(cursor)) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            Hash160 top;
+            top.fill(0xFF);
+            Storage::EntryList entries;
+            bool more = storage.scan_ordered(position, top, key, max_entries, max_bytes, entries);
+            response.value = Protocol::encodeScanReply(more ? position.token() : std::vector<uint8_t>(), entries);
+            response.status = StatusCode::SUCCESS;
+            break;
+        }
+        
+        case OpCode::GET_VERSIONED: {
             std::vector<uint8_t> value;
-            if (storage.get(key, value)) {
+            uint64_t version = 0;
+            bool compressed = false;
+            uint64_t expires = 0;
+            if (storage.get_stored(key, value, version, compressed, &expires)) {
+                response.value = Protocol::encodeStored(version, compressed, value, expires);
                 response.status = StatusCode::SUCCESS;
-                response.value = value;
             } else {
                 response.status = StatusCode::KEY_NOT_FOUND;
             }
@@ -247,11 +590,65 @@ void Server::process_request(int client_fd, const Request& request) {
         }
         
         case OpCode::PUT: {
-            storage.put(key, request.value);
+            // Decoded once here, so a malformed value is refused up front
+            // rather than failing every later read
+            std::vector<uint8_t> raw;
+            if (request.compressed && !Compression::decompress(request.value, raw)) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            storage.put(key, SHA1::hash(key), std::move(request.value), request.compressed);
+            response.status = StatusCode::SUCCESS;
+            break;
+        }
+        
+        case OpCode::PUT_TTL: {
+            uint64_t ttl = 0;
+            std::vector<uint8_t> raw;
+            if (!Protocol::decodeTtl(request.value, ttl) ||
+                (request.compressed && !Compression::decompress(request.value, raw))) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            storage.put(key, SHA1::hash(key), std::move(request.value), request.compressed,
+                        HybridClock::wall_ms() + ttl);
             response.status = StatusCode::SUCCESS;
             break;
         }
         
+        case OpCode::REPLICATE: {
+            uint64_t version = 0;
+            bool compressed = false;
+            uint64_t expires = 0;
+            if (!Protocol::decodeStored(request.value, version, compressed, &expires)) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            storage.apply(key, SHA1::hash(key), std::move(request.value), version, compressed, expires);
+            response.status = StatusCode::SUCCESS;
+            break;
+        }
+        
+        case OpCode::CAS: {
+            uint64_t expected = 0;
+            uint64_t version = 0;
+            bool compressed = false;
+            std::vector<uint8_t> raw;
+            if (!Protocol::decodeStored(request.value, expected, compressed) ||
+                (compressed && !Compression::decompress(request.value, raw))) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            if (!compressed) {
+                compressed = storage.compress(request.value);
+            }
+            response.status = storage.compare_and_put(key, SHA1::hash(key), request.value,
+                                                      expected, version, compressed) ?
+                StatusCode::SUCCESS : StatusCode::VERSION_MISMATCH;
+            response.value = Protocol::encodeVersioned(version, nullptr, 0);
+            break;
+        }
+        
         case OpCode::DELETE: {
             if (storage.remove(key)) {
                 response.status = StatusCode::SUCCESS;
@@ -261,18 +658,72 @@ void Server::process_request(int client_fd, const Request& request) {
             break;
         }
         
+        case OpCode::REPLICATE_DELETE: {
+            uint64_t version = 0;
+            if (!request.value.empty() && !Protocol::decodeVersioned(request.value, version)) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            bool removed = version == 0 ? storage.remove(key) : storage.apply_remove(key, version);
+            response.status = removed ? StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+            break;
+        }
+        
         case OpCode::PING: {
             response.status = StatusCode::SUCCESS;
             break;
         }
         
+        case OpCode::STATS: {
+            std::string text = get_stats().to_text();
+            response.value.assign(text.begin(), text.end());
+            response.status = StatusCode::SUCCESS;
+            break;
+        }
+        
+        case OpCode::SET_LOG_LEVEL: {
+            LogLevel level;
+            if (!Logger::parse_level(std::string(request.value.begin(), request.value.end()), level)) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            Logger::instance().set_level(level);
+            response.status = StatusCode::SUCCESS;
+            break;
+        }
+        
+        case OpCode::MULTI_GET:
+        case OpCode::MULTI_PUT:
+        case OpCode::MULTI_DELETE: {
+            std::vector<BatchEntry> entries;
+            if (!Protocol::decodeBatch(request.value.data(), request.value.size(), entries)) {
+                response.status = StatusCode::ERROR;
+                break;
+            }
+            
+            std::vector<BatchResult> results(entries.size());
+            for (size_t i = 0; i < entries.size(); ++i) {
+                BatchResult& result = results[i];
+                if (request.opcode == OpCode::MULTI_GET) {
+                    result.status = storage.get(entries[i].key, result.value) ?
+                        StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+                } else if (request.opcode == OpCode::MULTI_PUT) {
+                    storage.put(entries[i].key, std::move(entries[i].value));
+                    result.status = StatusCode::SUCCESS;
+                } else {
+                    result.status = storage.remove(entries[i].key) ?
+                        StatusCode::SUCCESS : StatusCode::KEY_NOT_FOUND;
+                }
+            }
+            response.value = Protocol::encodeBatchResults(results);
+            response.status = StatusCode::SUCCESS;
+            break;
+        }
+        
         default:
             response.status = StatusCode::ERROR;
             break;
     }
-    
-    std::vector<uint8_t> encoded = Protocol::encodeResponse(response);
-    send_data(client_fd, encoded);
 }
 
-} // namespace funnelkvs
\ No newline at end of file
+} // namespace funnelkvs
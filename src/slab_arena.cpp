@@ -0,0 +1,109 @@
+#include "slab_arena.h"
+#include <algorithm>
+#include <new>
+
+namespace funnelkvs {
+
+constexpr size_t SlabArena::SLAB_SIZE;
+constexpr size_t SlabArena::MAX_SLOT_SIZE;
+constexpr size_t SlabArena::ALIGNMENT;
+
+namespace {
+
+// Steps of 8 bytes up to 64, then four classes per doubling, so a slot
+// wastes at most ~20% of its size
+const uint16_t CLASS_SIZES[] = {
+    16, 24, 32, 40, 48, 56, 64,
+    80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512,
+    640, 768, 896, 1024,
+    1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096
+};
+
+} // namespace
+
+const size_t SlabArena::NUM_CLASSES = sizeof(CLASS_SIZES) / sizeof(CLASS_SIZES[0]);
+
+SlabArena::SlabArena() : free_lists(NUM_CLASSES, nullptr) {
+    counters.slab_bytes = 0;
+    counters.slot_bytes = 0;
+    counters.large_bytes = 0;
+    counters.allocations = 0;
+}
+
+SlabArena::~SlabArena() {
+    for (void* slab : slabs) {
+        ::operator delete(slab);
+    }
+}
+
+size_t SlabArena::class_index(size_t size) {
+    return static_cast<size_t>(
+        std::lower_bound(CLASS_SIZES, CLASS_SIZES + NUM_CLASSES, size) - CLASS_SIZES);
+}
+
+size_t SlabArena::capacity(size_t size) {
+    if (size > MAX_SLOT_SIZE) {
+        return size;
+    }
+    return CLASS_SIZES[class_index(size)];
+}
+
+void SlabArena::refill(size_t index) {
+    size_t slot_size = CLASS_SIZES[index];
+    char* slab = static_cast<char*>(::operator new(SLAB_SIZE));
+    slabs.push_back(slab);
+    counters.slab_bytes += SLAB_SIZE;
+
+    // Thread the new slots onto the free list so they are handed out in
+    // address order
+    FreeSlot* head = free_lists[index];
+    size_t count = SLAB_SIZE / slot_size;
+    for (size_t i = count; i > 0; --i) {
+        FreeSlot* slot = reinterpret_cast<FreeSlot*>(slab + (i - 1) * slot_size);
+        slot->next = head;
+        head = slot;
+    }
+    free_lists[index] = head;
+}
+
+void* SlabArena::allocate(size_t size) {
+    if (size > MAX_SLOT_SIZE) {
+        void* ptr = ::operator new(size);
+        counters.large_bytes += size;
+        counters.allocations++;
+        return ptr;
+    }
+
+    size_t index = class_index(size);
+    if (!free_lists[index]) {
+        refill(index);
+    }
+    FreeSlot* slot = free_lists[index];
+    free_lists[index] = slot->next;
+    counters.slot_bytes += CLASS_SIZES[index];
+    counters.allocations++;
+    return slot;
+}
+
+void SlabArena::deallocate(void* ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    counters.allocations--;
+    if (size > MAX_SLOT_SIZE) {
+        counters.large_bytes -= size;
+        ::operator delete(ptr);
+        return;
+    }
+
+    size_t index = class_index(size);
+    FreeSlot* slot = static_cast<FreeSlot*>(ptr);
+    slot->next = free_lists[index];
+    free_lists[index] = slot;
+    counters.slot_bytes -= CLASS_SIZES[index];
+}
+
+} // namespace funnelkvs
@@ -1,67 +1,1221 @@
 #include "storage.h"
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <iterator>
+#include <new>
 
 namespace funnelkvs {
 
+constexpr size_t Storage::DEFAULT_NUM_SHARDS;
+constexpr size_t Storage::MIN_COLD_VALUE;
+constexpr double Storage::COMPACTION_LIVE_RATIO;
+constexpr int Storage::COMPACTION_INTERVAL_MS;
+constexpr uint64_t Storage::TOMBSTONE_MS;
+constexpr uint64_t Storage::EXPIRY_TICK_MS;
+
+static size_t round_up_to_power_of_two(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+Storage::Storage(size_t num_shards)
+    : journal(nullptr), journal_failed(false), compression_threshold(0), hot_limit(0), expired_total(0), maintenance_stop(false) {
+    size_t count = round_up_to_power_of_two(num_shards == 0 ? 1 : num_shards);
+    shards.reset(new Shard[count]);
+    shard_mask = count - 1;
+    for (size_t i = 0; i < count; ++i) {
+        shards[i].tree = &tree;
+    }
+}
+
+Storage::~Storage() {
+    {
+        std::lock_guard<std::mutex> lock(maintenance_mutex);
+        maintenance_stop = true;
+    }
+    maintenance_cv.notify_all();
+    if (compactor.joinable()) {
+        compactor.join();
+    }
+    if (expirer.joinable()) {
+        expirer.join();
+    }
+}
+
+constexpr uint32_t Storage::Record::AFTER_ALL_KEYS;
+constexpr uint8_t Storage::Record::COLD;
+constexpr uint8_t Storage::Record::COMPRESSED;
+constexpr size_t Storage::Record::LOCATION_SIZE;
+
+ColdTier::Location Storage::Record::location() const {
+    // Unaligned: the location follows the key bytes
+    ColdTier::Location location;
+    std::memcpy(&location.segment, value(), 4);
+    std::memcpy(&location.offset, value() + 4, 8);
+    return location;
+}
+
+void Storage::Record::set_location(const ColdTier::Location& location) {
+    std::memcpy(value(), &location.segment, 4);
+    std::memcpy(value() + 4, &location.offset, 8);
+}
+
+size_t Storage::KeyHash::operator()(const KeyRef& key) const {
+    // MurmurHash64A over the key bytes, eight at a time
+    const uint64_t m = 0xC6A4A7935BD1E995ULL;
+    const int r = 47;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (key.size * m);
+    const char* p = key.data;
+    size_t n = key.size;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t k;
+        std::memcpy(&k, p, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (n > 0) {
+        uint64_t k = 0;
+        std::memcpy(&k, p, n);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return static_cast<size_t>(h);
+}
+
+bool Storage::KeyEqual::operator()(const KeyRef& a, const KeyRef& b) const {
+    return a.size == b.size && std::memcmp(a.data, b.data, a.size) == 0;
+}
+
+bool Storage::RecordOrder::operator()(const Record* a, const Record* b) const {
+    int by_id = hash_detail::compare(a->id, b->id);
+    if (by_id != 0) {
+        return by_id < 0;
+    }
+    bool a_probe = a->key_size == Record::AFTER_ALL_KEYS;
+    bool b_probe = b->key_size == Record::AFTER_ALL_KEYS;
+    if (a_probe || b_probe) {
+        return !a_probe && b_probe;
+    }
+    int by_key = std::memcmp(a->key(), b->key(), std::min(a->key_size, b->key_size));
+    return by_key != 0 ? by_key < 0 : a->key_size < b->key_size;
+}
+
+Storage::Shard::Shard()
+    : data(0, KeyHash(), KeyEqual(), ArenaAllocator<std::pair<const KeyRef, Record*>>(&arena)),
+      by_id(RecordOrder(), ArenaAllocator<Record*>(&arena)),
+      key_bytes(0), value_bytes(0), cold_value_bytes(0), compressed_value_bytes(0), cold(nullptr),
+      tree(nullptr), clock_hand(),
+      tombstone_writes(0), wheel(EXPIRY_TICK_MS) {
+}
+
+Storage::Shard::~Shard() {
+    // Large records live on the heap, not in the arena's slabs
+    for (auto& pair : data) {
+        arena.deallocate(pair.second, pair.second->footprint());
+    }
+}
+
+Storage::Record* Storage::Shard::create(const std::string& key, const Hash160& id,
+                                        const std::vector<uint8_t>& value, bool compressed,
+                                        uint64_t digest, uint64_t version, uint64_t expires) {
+    size_t bytes = Record::footprint(key.size(), value.size());
+    Record* record = new (arena.allocate(bytes)) Record;
+    record->digest = digest;
+    record->version = version;
+    record->expires = expires;
+    record->id = id;
+    record->key_size = static_cast<uint32_t>(key.size());
+    record->value_size = static_cast<uint32_t>(value.size());
+    record->flags = compressed ? Record::COMPRESSED : 0;
+    record->referenced.store(1, std::memory_order_relaxed); // new writes get a full round
+    if (!key.empty()) {
+        std::memcpy(record->key(), key.data(), key.size());
+    }
+    if (!value.empty()) {
+        std::memcpy(record->value(), value.data(), value.size());
+    }
+    key_bytes += key.size();
+    value_bytes += value.size();
+    if (compressed) {
+        compressed_value_bytes += value.size();
+    }
+    tree->add(id, digest);
+    return record;
+}
+
+void Storage::Shard::destroy(Record* record) {
+    tree->remove(record->id, record->digest);
+    key_bytes -= record->key_size;
+    value_bytes -= record->value_size;
+    if (record->compressed()) {
+        compressed_value_bytes -= record->value_size;
+    }
+    if (record->cold()) {
+        cold_value_bytes -= record->value_size;
+        cold->release(record->location(), record->value_size);
+    }
+    arena.deallocate(record, record->footprint());
+}
+
+void Storage::Shard::erase(RecordMap::iterator it) {
+    Record* record = it->second;
+    by_id.erase(record);
+    data.erase(it);
+    destroy(record);
+}
+
+Storage::Shard& Storage::shard_for(const std::string& key) const {
+    // Fibonacci mixing so the shard index does not reuse the low bits the
+    // per-shard unordered_map uses for bucket selection.
+    uint64_t h = static_cast<uint64_t>(KeyHash()(KeyRef(key)));
+    h *= 0x9E3779B97F4A7C15ULL;
+    return shards[static_cast<size_t>(h >> 32) & shard_mask];
+}
+
+namespace {
+
+void mark_referenced(std::atomic<uint8_t>& flag) {
+    // Read first, so repeated reads do not keep dirtying the cache line
+    if (!flag.load(std::memory_order_relaxed)) {
+        flag.store(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
+const uint8_t* Storage::value_of(const Record* record,
+                                 std::shared_ptr<const ColdTier::Segment>& segment) const {
+    if (!record->cold()) {
+        return record->value();
+    }
+    // Compaction moves records off a segment, under their shard's write
+    // lock, before dropping it, so the segment exists while we hold the lock
+    ColdTier::Location location = record->location();
+    segment = cold->segment(location.segment);
+    return segment->at(location.offset);
+}
+
+std::vector<uint8_t> Storage::copy_value(const Record* record) const {
+    std::shared_ptr<const ColdTier::Segment> segment;
+    const uint8_t* data = value_of(record, segment);
+    return std::vector<uint8_t>(data, data + record->value_size);
+}
+
+bool Storage::read_value(const Record* record, std::vector<uint8_t>& value) const {
+    std::shared_ptr<const ColdTier::Segment> segment;
+    const uint8_t* data = value_of(record, segment);
+    if (record->compressed()) {
+        return Compression::decompress(data, record->value_size, value);
+    }
+    value.assign(data, data + record->value_size);
+    return true;
+}
+
 bool Storage::get(const std::string& key, std::vector<uint8_t>& value) const {
-    std::lock_guard<std::mutex> lock(mutex);
-    auto it = data.find(key);
-    if (it != data.end()) {
-        value = it->second;
-        return true;
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.data.find(KeyRef(key));
+    if (it != shard.data.end() && it->second->live()) {
+        const Record* record = it->second;
+        mark_referenced(record->referenced);
+        return read_value(record, value);
     }
     return false;
 }
 
-void Storage::put(const std::string& key, const std::vector<uint8_t>& value) {
-    std::lock_guard<std::mutex> lock(mutex);
-    data[key] = value;
+bool Storage::get(const std::string& key, ValueView& view) const {
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.data.find(KeyRef(key));
+    if (it == shard.data.end() || !it->second->live()) {
+        return false;
+    }
+    const Record* record = it->second;
+    mark_referenced(record->referenced);
+    if (record->compressed()) {
+        auto copy = std::make_shared<std::vector<uint8_t>>();
+        if (!read_value(record, *copy)) {
+            return false;
+        }
+        view.data = copy->data();
+        view.size = copy->size();
+        view.owner = copy;
+        return true;
+    }
+    view.size = record->value_size;
+    if (record->cold()) {
+        std::shared_ptr<const ColdTier::Segment> segment;
+        view.data = value_of(record, segment);
+        view.owner = segment;
+    } else {
+        auto copy = std::make_shared<std::vector<uint8_t>>(record->value(), record->value() + record->value_size);
+        view.data = copy->data();
+        view.owner = copy;
+    }
+    return true;
+}
+
+bool Storage::get(const std::string& key, std::vector<uint8_t>& value, uint64_t& version) const {
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.data.find(KeyRef(key));
+    if (it == shard.data.end() || !it->second->live()) {
+        return false;
+    }
+    const Record* record = it->second;
+    mark_referenced(record->referenced);
+    version = record->version;
+    return read_value(record, value);
+}
+
+bool Storage::get_stored(const std::string& key, std::vector<uint8_t>& value, uint64_t& version,
+                         bool& compressed, uint64_t* expires) const {
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.data.find(KeyRef(key));
+    if (it == shard.data.end() || !it->second->live()) {
+        return false;
+    }
+    const Record* record = it->second;
+    mark_referenced(record->referenced);
+    std::shared_ptr<const ColdTier::Segment> segment;
+    const uint8_t* data = value_of(record, segment);
+    value.assign(data, data + record->value_size);
+    version = record->version;
+    compressed = record->compressed();
+    if (expires) {
+        *expires = record->expires;
+    }
+    return true;
+}
+
+bool Storage::pack(const std::vector<uint8_t>& value, std::vector<uint8_t>& packed) const {
+    size_t threshold = compression();
+    return threshold != 0 && value.size() >= threshold && Compression::compress(value, packed);
+}
+
+bool Storage::compress(std::vector<uint8_t>& value) const {
+    std::vector<uint8_t> packed;
+    if (!pack(value, packed)) {
+        return false;
+    }
+    value.swap(packed);
+    return true;
+}
+
+uint64_t Storage::put(const std::string& key, const std::vector<uint8_t>& value) {
+    uint64_t version = 0;
+    std::vector<uint8_t> packed;
+    bool compressed = pack(value, packed);
+    put_entry(key, SHA1::hash(key), compressed ? packed : value, compressed, 0, WriteMode::STAMP, version);
+    return version;
+}
+
+uint64_t Storage::put(const std::string& key, std::vector<uint8_t>&& value) {
+    return put(key, SHA1::hash(key), std::move(value));
+}
+
+uint64_t Storage::put(const std::string& key, const Hash160& id, std::vector<uint8_t>&& value, bool compressed,
+                      uint64_t expires) {
+    uint64_t version = 0;
+    if (!compressed) {
+        compressed = compress(value);
+    }
+    put_entry(key, id, value, compressed, expires, WriteMode::STAMP, version);
+    return version;
+}
+
+bool Storage::apply(const std::string& key, const Hash160& id, std::vector<uint8_t>&& value, uint64_t version,
+                    bool compressed, uint64_t expires) {
+    clock.observe(version);
+    return put_entry(key, id, value, compressed, expires, WriteMode::NEWER, version);
+}
+
+void Storage::restore(const std::string& key, const Hash160& id, std::vector<uint8_t>&& value, uint64_t version,
+                      bool compressed, uint64_t expires) {
+    clock.observe(version);
+    put_entry(key, id, value, compressed, expires, WriteMode::FORCE, version);
+}
+
+bool Storage::compare_and_put(const std::string& key, const Hash160& id, const std::vector<uint8_t>& value,
+                              uint64_t expected, uint64_t& version, bool compressed) {
+    return put_entry(key, id, value, compressed, 0, WriteMode::EXPECT, version, expected);
+}
+
+bool Storage::put_entry(const std::string& key, const Hash160& id, const std::vector<uint8_t>& value,
+                        bool compressed, uint64_t expires, WriteMode mode, uint64_t& version,
+                        uint64_t expected) {
+    StorageJournal* log = journal.load(std::memory_order_acquire);
+    uint64_t ticket = 0;
+    uint64_t digest = MerkleTree::entry_digest(key.data(), key.size(), value.data(), value.size(), expires);
+    Shard& shard = shard_for(key);
+    {
+        WriteGuard lock(shard.lock);
+        auto it = shard.data.find(KeyRef(key));
+        Record* record = it != shard.data.end() ? it->second : nullptr;
+        if (mode == WriteMode::NEWER && version != 0) {
+            if (record && (record->version > version ||
+                           (record->version == version && record->digest >= digest))) {
+                version = record->version;
+                return false;
+            }
+            auto tombstone = shard.tombstones.find(key);
+            if (!record && tombstone != shard.tombstones.end() && tombstone->second >= version) {
+                version = 0;
+                return false;
+            }
+        }
+        if (mode == WriteMode::EXPECT) {
+            uint64_t current = record && record->live() ? record->version : 0;
+            if (current != expected) {
+                version = current;
+                return false;
+            }
+        }
+        if (mode == WriteMode::STAMP || mode == WriteMode::EXPECT) {
+            // Stamped under the lock, so a key's versions follow the order
+            // its writes are applied in
+            version = clock.now();
+        }
+        if (!shard.tombstones.empty()) {
+            shard.tombstones.erase(key);
+        }
+        if (record && !record->cold() && record->id == id &&
+            SlabArena::capacity(Record::footprint(key.size(), value.size())) ==
+            SlabArena::capacity(record->footprint())) {
+            // Same slot size: overwrite the value in place. The key, and so
+            // the map and index entries, stay as they are.
+            shard.value_bytes += value.size();
+            shard.value_bytes -= record->value_size;
+            if (record->compressed()) {
+                shard.compressed_value_bytes -= record->value_size;
+            }
+            if (compressed) {
+                shard.compressed_value_bytes += value.size();
+            }
+            record->value_size = static_cast<uint32_t>(value.size());
+            record->flags = compressed ? Record::COMPRESSED : 0;
+            if (!value.empty()) {
+                std::memcpy(record->value(), value.data(), value.size());
+            }
+            tree.update(id, record->digest, digest);
+            record->digest = digest;
+            record->version = version;
+            record->expires = expires;
+        } else {
+            if (record) {
+                shard.erase(it);
+            }
+            record = shard.create(key, id, value, compressed, digest, version, expires);
+            shard.data.emplace(KeyRef(record), record);
+            shard.by_id.insert(record);
+        }
+        if (expires != 0) {
+            // Any earlier timer for the key stays behind; expire() ignores
+            // it unless the entry has lapsed by then
+            shard.wheel.schedule(key, expires, HybridClock::wall_ms());
+        }
+        if (log) {
+            ticket = log->log_put(key, id, value, version, compressed, expires);
+        }
+        if (cold && shard.value_bytes - shard.cold_value_bytes > hot_limit) {
+            evict(shard);
+        }
+    }
+    if (log) {
+        sync_journal(log, ticket);
+    }
+    if (expires != 0) {
+        std::call_once(expirer_started, [this]() {
+            expirer = std::thread(&Storage::expiry_loop, this);
+        });
+    }
+    return true;
+}
+
+void Storage::add_tombstone(Shard& shard, const std::string& key, uint64_t version) {
+    uint64_t& stamp = shard.tombstones[key];
+    stamp = std::max(stamp, version);
+    // Sweep now and then rather than on a timer; a tombstone only matters
+    // while replication of the writes it beat can still be in flight
+    if (++shard.tombstone_writes % 1024 != 0) {
+        return;
+    }
+    uint64_t now = HybridClock::wall_ms();
+    for (auto it = shard.tombstones.begin(); it != shard.tombstones.end();) {
+        if (HybridClock::physical_ms(it->second) + TOMBSTONE_MS < now) {
+            it = shard.tombstones.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+uint64_t Storage::tombstone(const std::string& key) const {
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.tombstones.find(key);
+    return it != shard.tombstones.end() ? it->second : 0;
 }
 
 bool Storage::remove(const std::string& key) {
-    std::lock_guard<std::mutex> lock(mutex);
-    return data.erase(key) > 0;
+    return apply_remove(key, clock.now());
+}
+
+bool Storage::apply_remove(const std::string& key, uint64_t version) {
+    clock.observe(version);
+    StorageJournal* log = journal.load(std::memory_order_acquire);
+    uint64_t ticket = 0;
+    Shard& shard = shard_for(key);
+    {
+        WriteGuard lock(shard.lock);
+        auto it = shard.data.find(KeyRef(key));
+        if (it != shard.data.end() && version != 0 && it->second->version > version) {
+            return false; // the key was written again after the delete
+        }
+        if (version != 0) {
+            add_tombstone(shard, key, version);
+        }
+        if (it == shard.data.end()) {
+            return false;
+        }
+        shard.erase(it);
+        if (log) {
+            ticket = log->log_remove(key);
+        }
+    }
+    if (log) {
+        sync_journal(log, ticket);
+    }
+    return true;
 }
 
 void Storage::clear() {
-    std::lock_guard<std::mutex> lock(mutex);
-    data.clear();
+    // Every shard stays locked until the clear is logged, so no change made
+    // concurrently in another shard can be logged on the wrong side of it
+    StorageJournal* log = journal.load(std::memory_order_acquire);
+    uint64_t ticket = 0;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        Shard& shard = shards[i];
+        shard.lock.lock_exclusive();
+        shard.by_id.clear();
+        for (auto& pair : shard.data) {
+            shard.destroy(pair.second);
+        }
+        shard.data.clear();
+        shard.tombstones.clear();
+    }
+    if (log) {
+        ticket = log->log_clear();
+    }
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        shards[i].lock.unlock_exclusive();
+    }
+    if (log) {
+        sync_journal(log, ticket);
+    }
+}
+
+void Storage::sync_journal(StorageJournal* log, uint64_t ticket) {
+    if (!log->sync(ticket)) {
+        journal_failed.store(true, std::memory_order_release);
+    }
+}
+
+void Storage::set_journal(StorageJournal* next) {
+    journal.store(next, std::memory_order_release);
+}
+
+void Storage::visit_shard(size_t index, const EntryVisitor& visitor) const {
+    const Shard& shard = shards[index];
+    ReadGuard lock(shard.lock);
+    uint64_t now = HybridClock::wall_ms();
+    for (const auto& pair : shard.data) {
+        const Record* record = pair.second;
+        if (record->expired(now)) {
+            continue;
+        }
+        std::shared_ptr<const ColdTier::Segment> segment;
+        visitor(record->key(), record->key_size, record->id, record->version, record->compressed(),
+                record->expires, value_of(record, segment), record->value_size);
+    }
+}
+
+void Storage::enable_cold_tier(const std::string& directory, size_t hot_bytes, size_t segment_bytes) {
+    if (cold) {
+        return;
+    }
+    cold.reset(new ColdTier(directory, segment_bytes));
+    hot_limit = std::max<size_t>(hot_bytes / (shard_mask + 1), 1);
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        WriteGuard lock(shards[i].lock);
+        shards[i].cold = cold.get();
+        if (shards[i].value_bytes > hot_limit) {
+            evict(shards[i]);
+        }
+    }
+    compactor = std::thread(&Storage::compaction_loop, this);
+}
+
+void Storage::evict(Shard& shard) {
+    // CLOCK over the ring-order index: a hot value read since the hand last
+    // passed it gets another round, otherwise it moves to the cold tier
+    if (shard.by_id.empty()) {
+        return;
+    }
+    alignas(Record) char buffer[sizeof(Record)];
+    Record* hand = new (buffer) Record;
+    hand->id = shard.clock_hand;
+    hand->key_size = Record::AFTER_ALL_KEYS;
+    auto it = shard.by_id.upper_bound(hand);
+
+    size_t steps = 2 * shard.by_id.size();
+    while (shard.value_bytes - shard.cold_value_bytes > hot_limit && steps-- > 0) {
+        if (it == shard.by_id.end()) {
+            it = shard.by_id.begin();
+        }
+        Record* record = *it;
+        shard.clock_hand = record->id;
+        if (record->cold() || record->value_size < MIN_COLD_VALUE) {
+            ++it;
+        } else if (record->referenced.load(std::memory_order_relaxed)) {
+            record->referenced.store(0, std::memory_order_relaxed);
+            ++it;
+        } else if (!demote(shard, it)) {
+            return;
+        }
+    }
+}
+
+bool Storage::demote(Shard& shard, RecordIndex::iterator& it) {
+    Record* record = *it;
+    ColdTier::Location location;
+    if (!cold->append(record->value(), record->value_size, location)) {
+        return false;
+    }
+
+    Record* moved = new (shard.arena.allocate(Record::footprint(record->key_size, Record::LOCATION_SIZE))) Record;
+    moved->digest = record->digest;
+    moved->version = record->version;
+    moved->expires = record->expires;
+    moved->id = record->id;
+    moved->key_size = record->key_size;
+    moved->value_size = record->value_size;
+    moved->flags = Record::COLD | (record->flags & Record::COMPRESSED);
+    moved->referenced.store(0, std::memory_order_relaxed);
+    std::memcpy(moved->key(), record->key(), record->key_size);
+    moved->set_location(location);
+
+    // The map's key points at the record's own key bytes, so the entry is
+    // replaced rather than updated
+    shard.data.erase(KeyRef(record));
+    shard.data.emplace(KeyRef(moved), moved);
+    it = shard.by_id.erase(it);
+    it = std::next(shard.by_id.insert(it, moved));
+    shard.cold_value_bytes += record->value_size;
+    shard.arena.deallocate(record, record->footprint());
+    return true;
+}
+
+size_t Storage::compact_cold_tier(double max_live_ratio) {
+    if (!cold) {
+        return 0;
+    }
+    std::vector<uint32_t> victims = cold->compaction_candidates(max_live_ratio);
+    if (victims.empty()) {
+        return 0;
+    }
+
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        Shard& shard = shards[i];
+        WriteGuard lock(shard.lock);
+        for (auto& pair : shard.data) {
+            Record* record = pair.second;
+            if (!record->cold()) {
+                continue;
+            }
+            ColdTier::Location from = record->location();
+            if (std::find(victims.begin(), victims.end(), from.segment) == victims.end()) {
+                continue;
+            }
+            std::shared_ptr<const ColdTier::Segment> segment = cold->segment(from.segment);
+            ColdTier::Location to;
+            if (!cold->append(segment->at(from.offset), record->value_size, to)) {
+                // Keep every victim: moved records' old copies are garbage now
+                return 0;
+            }
+            record->set_location(to);
+        }
+    }
+
+    for (uint32_t id : victims) {
+        cold->drop(id);
+    }
+    return victims.size();
+}
+
+void Storage::compaction_loop() {
+    std::unique_lock<std::mutex> lock(maintenance_mutex);
+    while (!maintenance_stop) {
+        maintenance_cv.wait_for(lock, std::chrono::milliseconds(COMPACTION_INTERVAL_MS));
+        if (maintenance_stop) {
+            break;
+        }
+        lock.unlock();
+        compact_cold_tier();
+        lock.lock();
+    }
+}
+
+size_t Storage::expire(uint64_t now_ms) {
+    StorageJournal* log = journal.load(std::memory_order_acquire);
+    uint64_t ticket = 0;
+    size_t removed = 0;
+    std::vector<std::string> due;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        Shard& shard = shards[i];
+        WriteGuard lock(shard.lock);
+        due.clear();
+        shard.wheel.advance(now_ms, due);
+        for (const auto& key : due) {
+            auto it = shard.data.find(KeyRef(key));
+            // The timer may belong to a write since overwritten or removed
+            if (it == shard.data.end() || !it->second->expired(now_ms)) {
+                continue;
+            }
+            add_tombstone(shard, key, it->second->version);
+            shard.erase(it);
+            removed++;
+            if (log) {
+                ticket = log->log_remove(key);
+            }
+        }
+    }
+    if (log && removed > 0) {
+        sync_journal(log, ticket);
+    }
+    expired_total.fetch_add(removed, std::memory_order_relaxed);
+    return removed;
+}
+
+void Storage::expiry_loop() {
+    std::unique_lock<std::mutex> lock(maintenance_mutex);
+    while (!maintenance_stop) {
+        maintenance_cv.wait_for(lock, std::chrono::milliseconds(EXPIRY_TICK_MS));
+        if (maintenance_stop) {
+            break;
+        }
+        lock.unlock();
+        expire(HybridClock::wall_ms());
+        lock.lock();
+    }
+}
+
+uint64_t Storage::expiry(const std::string& key) const {
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.data.find(KeyRef(key));
+    return it != shard.data.end() && it->second->live() ? it->second->expires : 0;
 }
 
 size_t Storage::size() const {
-    std::lock_guard<std::mutex> lock(mutex);
-    return data.size();
+    size_t total = 0;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        ReadGuard lock(shards[i].lock);
+        total += shards[i].data.size();
+    }
+    return total;
 }
 
 bool Storage::exists(const std::string& key) const {
-    std::lock_guard<std::mutex> lock(mutex);
-    return data.find(key) != data.end();
+    Shard& shard = shard_for(key);
+    ReadGuard lock(shard.lock);
+    auto it = shard.data.find(KeyRef(key));
+    return it != shard.data.end() && it->second->live();
+}
+
+Storage::MemoryStats Storage::memory_stats() const {
+    MemoryStats stats = MemoryStats();
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        const Shard& shard = shards[i];
+        ReadGuard lock(shard.lock);
+        SlabArena::Stats arena = shard.arena.stats();
+        stats.entries += shard.data.size();
+        stats.key_bytes += shard.key_bytes;
+        stats.value_bytes += shard.value_bytes;
+        stats.slab_bytes += arena.slab_bytes;
+        stats.slab_used_bytes += arena.slot_bytes;
+        stats.large_bytes += arena.large_bytes;
+        stats.cold_value_bytes += shard.cold_value_bytes;
+        stats.compressed_value_bytes += shard.compressed_value_bytes;
+        stats.expiry_timers += shard.wheel.size();
+    }
+    stats.expired_entries = expired_total.load(std::memory_order_relaxed);
+    stats.allocated_bytes = stats.slab_bytes + stats.large_bytes;
+    stats.cold_file_bytes = cold ? cold->stats().file_bytes : 0;
+    return stats;
 }
 
 std::vector<std::string> Storage::get_all_keys() const {
-    std::lock_guard<std::mutex> lock(mutex);
     std::vector<std::string> keys;
-    keys.reserve(data.size());
-    for (const auto& pair : data) {
-        keys.push_back(pair.first);
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        ReadGuard lock(shards[i].lock);
+        uint64_t now = HybridClock::wall_ms();
+        keys.reserve(keys.size() + shards[i].data.size());
+        for (const auto& pair : shards[i].data) {
+            if (pair.second->expired(now)) {
+                continue;
+            }
+            keys.push_back(std::string(pair.first.data, pair.first.size));
+        }
+    }
+    return keys;
+}
+
+std::vector<std::pair<std::string, Hash160>> Storage::get_all_key_ids() const {
+    std::vector<std::pair<std::string, Hash160>> keys;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        ReadGuard lock(shards[i].lock);
+        uint64_t now = HybridClock::wall_ms();
+        keys.reserve(keys.size() + shards[i].data.size());
+        for (const auto& pair : shards[i].data) {
+            if (pair.second->expired(now)) {
+                continue;
+            }
+            keys.push_back(std::make_pair(std::string(pair.first.data, pair.first.size),
+                                          pair.second->id));
+        }
     }
     return keys;
 }
 
 std::unordered_map<std::string, std::vector<uint8_t>> Storage::get_all_data() const {
-    std::lock_guard<std::mutex> lock(mutex);
-    return data;
+    std::unordered_map<std::string, std::vector<uint8_t>> result;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        ReadGuard lock(shards[i].lock);
+        uint64_t now = HybridClock::wall_ms();
+        for (const auto& pair : shards[i].data) {
+            const Record* record = pair.second;
+            std::vector<uint8_t> value;
+            if (!record->expired(now) && read_value(record, value)) {
+                result[std::string(record->key(), record->key_size)] = std::move(value);
+            }
+        }
+    }
+    return result;
 }
 
 std::unordered_map<std::string, std::vector<uint8_t>> Storage::get_keys_in_range(
     const std::function<bool(const std::string&)>& predicate) const {
-    std::lock_guard<std::mutex> lock(mutex);
     std::unordered_map<std::string, std::vector<uint8_t>> result;
-    for (const auto& pair : data) {
-        if (predicate(pair.first)) {
-            result[pair.first] = pair.second;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        ReadGuard lock(shards[i].lock);
+        uint64_t now = HybridClock::wall_ms();
+        for (const auto& pair : shards[i].data) {
+            const Record* record = pair.second;
+            if (record->expired(now)) {
+                continue;
+            }
+            std::string key(record->key(), record->key_size);
+            std::vector<uint8_t> value;
+            if (predicate(key) && read_value(record, value)) {
+                result[key] = std::move(value);
+            }
         }
     }
     return result;
 }
 
-} // namespace funnelkvs
\ No newline at end of file
+bool Storage::scan(ScanCursor& cursor, const std::function<bool(const std::string&)>& predicate,
+                   size_t max_entries, size_t max_bytes, EntryList& out) const {
+    return scan(cursor, IdPredicate([&predicate](const std::string& key, const Hash160&) {
+        return predicate(key);
+    }), max_entries, max_bytes, out);
+}
+
+bool Storage::scan(ScanCursor& cursor, const IdPredicate& predicate,
+                   size_t max_entries, size_t max_bytes, EntryList& out) const {
+    out.clear();
+    size_t bytes = 0;
+
+    while (cursor.shard <= shard_mask) {
+        const Shard& shard = shards[cursor.shard];
+        {
+            ReadGuard lock(shard.lock);
+            uint64_t now = HybridClock::wall_ms();
+            size_t buckets = shard.data.bucket_count();
+            if (cursor.bucket_count != buckets) {
+                // First visit, or the table rehashed since the last chunk
+                cursor.bucket = 0;
+                cursor.bucket_count = buckets;
+            }
+
+            while (cursor.bucket < buckets) {
+                if (out.size() >= max_entries || bytes >= max_bytes) {
+                    return true;
+                }
+                for (auto it = shard.data.begin(cursor.bucket); it != shard.data.end(cursor.bucket); ++it) {
+                    const Record* record = it->second;
+                    if (record->expired(now)) {
+                        continue;
+                    }
+                    std::string key(record->key(), record->key_size);
+                    std::vector<uint8_t> value;
+                    if (predicate(key, record->id) && read_value(record, value)) {
+                        bytes += key.size() + value.size();
+                        out.push_back(std::make_pair(std::move(key), std::move(value)));
+                    }
+                }
+                cursor.bucket++;
+            }
+        }
+        cursor.shard++;
+        cursor.bucket = 0;
+        cursor.bucket_count = 0;
+    }
+    return false;
+}
+
+bool Storage::scan_range(RangeCursor& cursor, const Hash160& start, const Hash160& end,
+                         size_t max_entries, size_t max_bytes, EntryList& out,
+                         std::vector<EntryMeta>* meta) const {
+    out.clear();
+    if (meta) {
+        meta->clear();
+    }
+    size_t bytes = 0;
+    std::vector<char> probe;
+
+    while (cursor.shard <= shard_mask) {
+        const Shard& shard = shards[cursor.shard];
+        {
+            ReadGuard lock(shard.lock);
+            uint64_t now = HybridClock::wall_ms();
+
+            // What is left of the range is (from, end] in ring order. It
+            // passes zero if from lies above end; from == end either means
+            // the whole ring (before the first entry) or that only entries
+            // sharing end's id remain. from is a probe record built in a
+            // scratch buffer, since the index holds records, not keys.
+            probe.assign(sizeof(Record) + (cursor.started ? cursor.last_key.size() : 0), 0);
+            Record* from = new (&probe[0]) Record;
+            if (cursor.started) {
+                from->id = cursor.last_id;
+                from->key_size = static_cast<uint32_t>(cursor.last_key.size());
+                std::memcpy(from->key(), cursor.last_key.data(), cursor.last_key.size());
+            } else {
+                from->id = start;
+                from->key_size = Record::AFTER_ALL_KEYS;
+            }
+            bool wraps = end < from->id || (end == from->id && !cursor.started);
+            auto it = shard.by_id.upper_bound(from);
+
+            while (true) {
+                if (it == shard.by_id.end()) {
+                    if (!wraps) {
+                        break;
+                    }
+                    it = shard.by_id.begin();
+                    wraps = false;
+                    continue;
+                }
+                const Record* record = *it;
+                if (!wraps && end < record->id) {
+                    break;
+                }
+                if (record->expired(now)) {
+                    ++it;
+                    continue;
+                }
+                if (out.size() >= max_entries || bytes >= max_bytes) {
+                    return true;
+                }
+                out.push_back(std::make_pair(std::string(record->key(), record->key_size),
+                                             copy_value(record)));
+                if (meta) {
+                    EntryMeta entry = {record->version, record->compressed(), record->expires};
+                    meta->push_back(entry);
+                }
+                bytes += record->key_size + record->value_size;
+                cursor.started = true;
+                cursor.last_id = record->id;
+                cursor.last_key = out.back().first;
+                ++it;
+            }
+        }
+        cursor.shard++;
+        cursor.started = false;
+        cursor.last_key.clear();
+    }
+    return false;
+}
+
+std::vector<uint8_t> Storage::RingPosition::token() const {
+    std::vector<uint8_t> bytes;
+    if (!started) {
+        return bytes;
+    }
+    bytes.reserve(1 + id.size() + key.size());
+    bytes.push_back(past_id ? 1 : 0);
+    bytes.insert(bytes.end(), id.begin(), id.end());
+    bytes.insert(bytes.end(), key.begin(), key.end());
+    return bytes;
+}
+
+bool Storage::RingPosition::parse(const std::vector<uint8_t>& token) {
+    if (token.empty()) {
+        *this = RingPosition();
+        return true;
+    }
+    if (token.size() < 1 + id.size() || token[0] > 1) {
+        return false;
+    }
+    started = true;
+    past_id = token[0] != 0;
+    std::copy(token.begin() + 1, token.begin() + 1 + id.size(), id.begin());
+    key.assign(token.begin() + 1 + id.size(), token.end());
+    return true;
+}
+
+namespace {
+
+struct ScanCandidate {
+    Hash160 id;
+    std::string key;
+    size_t bytes;
+};
+
+bool candidate_before(const ScanCandidate& a, const ScanCandidate& b) {
+    int by_id = hash_detail::compare(a.id, b.id);
+    return by_id != 0 ? by_id < 0 : a.key < b.key;
+}
+
+} // namespace
+
+bool Storage::scan_ordered(RingPosition& from, const Hash160& last, const std::string& prefix,
+                           size_t max_entries, size_t max_bytes, EntryList& out) const {
+    out.clear();
+    // At least one entry per chunk, whatever the limits, so a scan always
+    // moves on
+    max_entries = std::max<size_t>(max_entries, 1);
+    max_bytes = std::max<size_t>(max_bytes, 1);
+
+    // The first max_entries positions after from, as a max-heap: a shard's
+    // walk stops at the first entry that could not make the chunk
+    std::vector<char> probe(sizeof(Record) + from.key.size(), 0);
+    Record* after = new (&probe[0]) Record;
+    after->id = from.id;
+    after->key_size = from.past_id ? Record::AFTER_ALL_KEYS : static_cast<uint32_t>(from.key.size());
+    if (!from.past_id && !from.key.empty()) {
+        std::memcpy(after->key(), from.key.data(), from.key.size());
+    }
+    std::vector<ScanCandidate> best;
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        const Shard& shard = shards[i];
+        ReadGuard lock(shard.lock);
+        uint64_t now = HybridClock::wall_ms();
+        auto it = from.started ? shard.by_id.upper_bound(after) : shard.by_id.begin();
+        for (; it != shard.by_id.end(); ++it) {
+            const Record* record = *it;
+            if (last < record->id) {
+                break;
+            }
+            if (best.size() == max_entries) {
+                const ScanCandidate& worst = best.front();
+                int by_id = hash_detail::compare(record->id, worst.id);
+                int by_key = std::memcmp(record->key(), worst.key.data(),
+                                         std::min<size_t>(record->key_size, worst.key.size()));
+                bool before = by_id != 0 ? by_id < 0 :
+                              by_key != 0 ? by_key < 0 : record->key_size < worst.key.size();
+                if (!before) {
+                    break;
+                }
+            }
+            if (record->expired(now) || record->key_size < prefix.size() ||
+                std::memcmp(record->key(), prefix.data(), prefix.size()) != 0) {
+                continue;
+            }
+            ScanCandidate candidate;
+            candidate.id = record->id;
+            candidate.key.assign(record->key(), record->key_size);
+            candidate.bytes = record->key_size + record->value_size;
+            best.push_back(std::move(candidate));
+            std::push_heap(best.begin(), best.end(), candidate_before);
+            if (best.size() > max_entries) {
+                std::pop_heap(best.begin(), best.end(), candidate_before);
+                best.pop_back();
+            }
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end(), candidate_before);
+    bool exhausted = best.size() < max_entries;
+    size_t keep = 0;
+    size_t bytes = 0;
+    while (keep < best.size() && bytes < max_bytes) {
+        bytes += best[keep++].bytes;
+    }
+    if (keep < best.size()) {
+        exhausted = false;
+    }
+
+    // Entries removed since the walk are left out; the position still
+    // moves past them
+    for (size_t i = 0; i < keep; ++i) {
+        const Shard& shard = shard_for(best[i].key);
+        ReadGuard lock(shard.lock);
+        auto it = shard.data.find(KeyRef(best[i].key));
+        std::vector<uint8_t> value;
+        if (it != shard.data.end() && it->second->live() && read_value(it->second, value)) {
+            out.push_back(std::make_pair(best[i].key, std::move(value)));
+        }
+    }
+
+    from.started = true;
+    if (exhausted) {
+        from.past_id = true;
+        from.id = last;
+        from.key.clear();
+        return false;
+    }
+    from.past_id = false;
+    from.id = best[keep - 1].id;
+    from.key = best[keep - 1].key;
+    return true;
+}
+
+void Storage::visit_leaf(size_t leaf, const Hash160& start, const Hash160& end,
+                         const std::function<void(const Record*)>& visitor) const {
+    bool whole_ring = start == end;
+    alignas(Record) char buffer[sizeof(Record)];
+    Record* from = new (buffer) Record;
+    from->id = MerkleTree::leaf_start(leaf);
+    from->key_size = 0; // sorts before every key with that id
+
+    for (size_t i = 0; i <= shard_mask; ++i) {
+        const Shard& shard = shards[i];
+        ReadGuard lock(shard.lock);
+        for (auto it = shard.by_id.lower_bound(from); it != shard.by_id.end(); ++it) {
+            const Record* record = *it;
+            if (MerkleTree::leaf_of(record->id) != leaf) {
+                break;
+            }
+            if (whole_ring || in_range(record->id, start, end, true)) {
+                visitor(record);
+            }
+        }
+    }
+}
+
+uint64_t Storage::range_digest(const Hash160& start, const Hash160& end, int level, size_t index) const {
+    // The range covers the leaves strictly between the two it starts and
+    // ends in; those two it cuts. When both ends share a leaf the range
+    // either stays inside it or wraps around the rest of the ring.
+    if (start == end) {
+        return tree.node(level, index);
+    }
+    size_t first = MerkleTree::leaf_of(start);
+    size_t last = MerkleTree::leaf_of(end);
+    size_t lo = MerkleTree::first_leaf(level, index);
+    size_t span = MerkleTree::leaf_span(level);
+    bool cut = (first >= lo && first < lo + span) || (last >= lo && last < lo + span);
+
+    if (cut) {
+        if (level == MerkleTree::DEPTH) {
+            uint64_t sum = 0;
+            visit_leaf(lo, start, end, [&sum](const Record* record) { sum += record->digest; });
+            return sum;
+        }
+        uint64_t sum = 0;
+        for (size_t child = 0; child < MerkleTree::FANOUT; ++child) {
+            sum += range_digest(start, end, level + 1, (index << MerkleTree::FANOUT_BITS) + child);
+        }
+        return sum;
+    }
+
+    // Not cut, so wholly inside or outside: decide by the first leaf
+    bool inside;
+    if (first == last) {
+        inside = end < start;
+    } else {
+        size_t offset = (lo - first) & (MerkleTree::LEAVES - 1);
+        size_t length = (last - first) & (MerkleTree::LEAVES - 1);
+        inside = offset > 0 && offset < length;
+    }
+    return inside ? tree.node(level, index) : 0;
+}
+
+void Storage::range_digests(const Hash160& start, const Hash160& end, int level,
+                            const std::vector<uint32_t>& indices, std::vector<uint64_t>& digests) const {
+    digests.clear();
+    digests.reserve(indices.size());
+    for (uint32_t index : indices) {
+        bool valid = level >= 0 && level <= MerkleTree::DEPTH && index < MerkleTree::level_size(level);
+        digests.push_back(valid ? range_digest(start, end, level, index) : 0);
+    }
+}
+
+void Storage::leaf_digests(const Hash160& start, const Hash160& end,
+                           const std::vector<uint32_t>& leaves, DigestList& out) const {
+    out.clear();
+    for (uint32_t leaf : leaves) {
+        if (leaf >= MerkleTree::LEAVES) {
+            continue;
+        }
+        visit_leaf(leaf, start, end, [&out](const Record* record) {
+            out.push_back(std::make_pair(std::string(record->key(), record->key_size), record->digest));
+        });
+    }
+}
+
+size_t Storage::remove_if_unchanged(const EntryList& entries) {
+    // Group by shard so each lock is taken once
+    std::vector<std::pair<Shard*, const std::pair<std::string, std::vector<uint8_t>>*>> order;
+    order.reserve(entries.size());
+    for (const auto& entry : entries) {
+        order.push_back(std::make_pair(&shard_for(entry.first), &entry));
+    }
+    std::sort(order.begin(), order.end(),
+        [](const std::pair<Shard*, const std::pair<std::string, std::vector<uint8_t>>*>& a,
+           const std::pair<Shard*, const std::pair<std::string, std::vector<uint8_t>>*>& b) {
+            return a.first < b.first;
+        });
+
+    StorageJournal* log = journal.load(std::memory_order_acquire);
+    uint64_t ticket = 0;
+    size_t removed = 0;
+    size_t i = 0;
+    while (i < order.size()) {
+        Shard* shard = order[i].first;
+        WriteGuard lock(shard->lock);
+        for (; i < order.size() && order[i].first == shard; ++i) {
+            const std::vector<uint8_t>& expected = order[i].second->second;
+            auto it = shard->data.find(KeyRef(order[i].second->first));
+            std::shared_ptr<const ColdTier::Segment> segment;
+            if (it != shard->data.end() && it->second->value_size == expected.size() &&
+                std::memcmp(value_of(it->second, segment), expected.data(), expected.size()) == 0) {
+                shard->erase(it);
+                removed++;
+                if (log) {
+                    ticket = log->log_remove(order[i].second->first);
+                }
+            }
+        }
+    }
+    if (log && removed > 0) {
+        sync_journal(log, ticket);
+    }
+    return removed;
+}
+
+} // namespace funnelkvs
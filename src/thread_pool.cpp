@@ -0,0 +1,349 @@
+#include "thread_pool.h"
+#include <iterator>
+#include <pthread.h>
+#include <sched.h>
+
+namespace funnelkvs {
+
+constexpr size_t Task::INLINE_BYTES;
+constexpr size_t ThreadPool::QUEUE_CAPACITY;
+
+namespace {
+
+// Which pool and queue the current thread works for, so tasks submitted
+// from a worker stay on its own queue
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+// The periodic job the current thread is running, if any
+thread_local uint64_t current_periodic = 0;
+
+} // namespace
+
+// Bounded MPMC ring (Vyukov): each slot's sequence number says whether it
+// is free for the producer at that position or holds the task for the
+// consumer at that position, so pushes and pops are one CAS each.
+class ThreadPool::TaskQueue {
+public:
+    TaskQueue() : slots(new Slot[QUEUE_CAPACITY]), enqueue_pos(0), dequeue_pos(0) {
+        for (size_t i = 0; i < QUEUE_CAPACITY; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Moves from task only on success
+    bool try_push(Task& task) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & (QUEUE_CAPACITY - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.task = std::move(task);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(Task& task) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & (QUEUE_CAPACITY - 1)];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    task = std::move(slot.task);
+                    slot.sequence.store(pos + QUEUE_CAPACITY, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool empty() const {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        return slots[pos & (QUEUE_CAPACITY - 1)].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    size_t size() const {
+        size_t head = dequeue_pos.load(std::memory_order_relaxed);
+        size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Task task;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    // Producers and consumers each hammer their own index; keep them on
+    // separate cache lines
+    std::atomic<size_t> enqueue_pos;
+    char padding[64];
+    std::atomic<size_t> dequeue_pos;
+};
+
+struct ThreadPool::Periodic {
+    uint64_t id;
+    std::chrono::milliseconds interval;
+    std::function<void()> fn;
+    bool running;   // queued or running; guarded by timer_mutex
+    bool cancelled;
+
+    Periodic(uint64_t i, std::chrono::milliseconds every, std::function<void()> f)
+        : id(i), interval(every), fn(std::move(f)), running(false), cancelled(false) {}
+};
+
+// One queued run of a periodic job. Reports back to the pool when it is
+// done, or when it is dropped unrun because the pool is shutting down.
+class ThreadPool::PeriodicRun {
+public:
+    PeriodicRun(ThreadPool* p, std::shared_ptr<Periodic> j) : pool(p), job(std::move(j)) {}
+    PeriodicRun(PeriodicRun&& other) noexcept : pool(other.pool), job(std::move(other.job)) {}
+    ~PeriodicRun() {
+        if (job) {
+            pool->finish_run(job);
+        }
+    }
+
+    void operator()() {
+        current_periodic = job->id;
+        job->fn();
+        current_periodic = 0;
+        pool->finish_run(job);
+        job.reset();
+    }
+
+private:
+    ThreadPool* pool;
+    std::shared_ptr<Periodic> job;
+};
+
+ThreadPool::ThreadPool(size_t threads)
+    : stop(false), busy(0), next_queue(0), steal_count(0), overflow_size(0), sleepers(0),
+      next_periodic_id(1) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues.emplace_back(new TaskQueue());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::worker_thread, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex);
+        stop.store(true);
+    }
+    timer_cv.notify_all();
+    if (timer_thread.joinable()) {
+        timer_thread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    sleep_cv.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    // Drop what is still queued while the rest of the pool is intact:
+    // an unrun periodic job reports back on destruction
+    queues.clear();
+    overflow.clear();
+}
+
+size_t ThreadPool::queue_depth() const {
+    size_t depth = overflow_size.load(std::memory_order_relaxed);
+    for (const auto& queue : queues) {
+        depth += queue->size();
+    }
+    return depth;
+}
+
+bool ThreadPool::pin_workers(size_t first_cpu) {
+    unsigned cpus = std::thread::hardware_concurrency();
+    if (cpus == 0) {
+        return false;
+    }
+    bool all_pinned = true;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET((first_cpu + i) % cpus, &set);
+        if (pthread_setaffinity_np(workers[i].native_handle(), sizeof(set), &set) != 0) {
+            all_pinned = false;
+        }
+    }
+    return all_pinned;
+}
+
+void ThreadPool::push(Task&& task) {
+    if (stop.load(std::memory_order_relaxed)) {
+        return;
+    }
+    size_t count = queues.size();
+    size_t start = current_pool == this ? current_queue
+                                        : next_queue.fetch_add(1, std::memory_order_relaxed) % count;
+    bool queued = false;
+    for (size_t i = 0; i < count && !queued; ++i) {
+        queued = queues[(start + i) % count]->try_push(task);
+    }
+    if (!queued) {
+        std::lock_guard<std::mutex> lock(overflow_mutex);
+        overflow.push_back(std::move(task));
+        overflow_size.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake_one();
+}
+
+void ThreadPool::wake_one() {
+    // Pairs with the fence in worker_thread: either the worker sees the
+    // task on its last check or we see it going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_cv.notify_one();
+    }
+}
+
+bool ThreadPool::take(size_t self, Task& task) {
+    if (queues[self]->try_pop(task)) {
+        return true;
+    }
+    if (overflow_size.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(overflow_mutex);
+        if (!overflow.empty()) {
+            task = std::move(overflow.front());
+            overflow.pop_front();
+            overflow_size.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    size_t count = queues.size();
+    for (size_t i = 1; i < count; ++i) {
+        if (queues[(self + i) % count]->try_pop(task)) {
+            steal_count.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::has_work() const {
+    if (overflow_size.load(std::memory_order_relaxed) > 0) {
+        return true;
+    }
+    for (const auto& queue : queues) {
+        if (!queue->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_thread(size_t index) {
+    current_pool = this;
+    current_queue = index;
+    while (!stop.load()) {
+        Task task;
+        if (take(index, task)) {
+            busy.fetch_add(1, std::memory_order_relaxed);
+            task();
+            busy.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!stop.load() && !has_work()) {
+            sleep_cv.wait(lock);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t ThreadPool::schedule_every(std::chrono::milliseconds interval, std::function<void()> fn) {
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    uint64_t id = next_periodic_id++;
+    periodic[id] = std::make_shared<Periodic>(id, interval, std::move(fn));
+    deadlines.emplace(std::chrono::steady_clock::now(), id);
+    if (!timer_thread.joinable() && !stop.load()) {
+        timer_thread = std::thread(&ThreadPool::timer_loop, this);
+    }
+    timer_cv.notify_all();
+    return id;
+}
+
+void ThreadPool::cancel(uint64_t id) {
+    std::unique_lock<std::mutex> lock(timer_mutex);
+    auto it = periodic.find(id);
+    if (it == periodic.end()) {
+        return;
+    }
+    std::shared_ptr<Periodic> job = it->second;
+    periodic.erase(it);
+    job->cancelled = true;
+    for (auto deadline = deadlines.begin(); deadline != deadlines.end();) {
+        deadline = deadline->second == id ? deadlines.erase(deadline) : std::next(deadline);
+    }
+    if (current_periodic != id) {
+        periodic_cv.wait(lock, [&job] { return !job->running; });
+    }
+}
+
+void ThreadPool::finish_run(const std::shared_ptr<Periodic>& job) {
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex);
+        job->running = false;
+        if (!job->cancelled && !stop.load()) {
+            deadlines.emplace(std::chrono::steady_clock::now() + job->interval, job->id);
+        }
+    }
+    timer_cv.notify_all();
+    periodic_cv.notify_all();
+}
+
+void ThreadPool::timer_loop() {
+    std::unique_lock<std::mutex> lock(timer_mutex);
+    while (!stop.load()) {
+        if (deadlines.empty()) {
+            timer_cv.wait(lock);
+            continue;
+        }
+        auto next = deadlines.begin();
+        if (next->first > std::chrono::steady_clock::now()) {
+            timer_cv.wait_until(lock, next->first);
+            continue;
+        }
+        uint64_t id = next->second;
+        deadlines.erase(next);
+        auto it = periodic.find(id);
+        if (it == periodic.end() || it->second->running) {
+            continue;
+        }
+        it->second->running = true;
+        PeriodicRun run(this, it->second);
+        lock.unlock();
+        push(Task(std::move(run)));
+        lock.lock();
+    }
+}
+
+} // namespace funnelkvs
@@ -0,0 +1,68 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+namespace funnelkvs {
+
+constexpr int TimerWheel::LEVELS;
+constexpr int TimerWheel::SLOT_BITS;
+constexpr size_t TimerWheel::SLOTS;
+
+TimerWheel::TimerWheel(uint64_t tick_ms)
+    : tick_length(tick_ms == 0 ? 1 : tick_ms), current(0), count(0) {
+}
+
+void TimerWheel::schedule(const std::string& key, uint64_t deadline_ms, uint64_t now_ms) {
+    if (count == 0) {
+        // Nothing to fire in between, so an idle wheel jumps ahead
+        current = std::max(current, now_ms / tick_length);
+    }
+    Timer timer;
+    timer.key = key;
+    // Rounded up, so a timer never fires before its deadline; one already
+    // due fires on the next tick
+    timer.tick = std::max(deadline_ms / tick_length + (deadline_ms % tick_length != 0), current + 1);
+    place(std::move(timer));
+    count++;
+}
+
+void TimerWheel::place(Timer&& timer) {
+    uint64_t delta = timer.tick > current ? timer.tick - current : 0;
+    for (int level = 0; level < LEVELS; ++level) {
+        if ((delta >> (SLOT_BITS * (level + 1))) == 0) {
+            slots[level][(timer.tick >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(std::move(timer));
+            return;
+        }
+    }
+    // Beyond the top level: park in the furthest slot it can see
+    const int top = LEVELS - 1;
+    uint64_t furthest = current + (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)) - 1;
+    slots[top][(furthest >> (SLOT_BITS * top)) & (SLOTS - 1)].push_back(std::move(timer));
+}
+
+void TimerWheel::advance(uint64_t now_ms, std::vector<std::string>& due) {
+    uint64_t target = now_ms / tick_length;
+    while (current < target && count > 0) {
+        ++current;
+        // Higher levels first, so timers can drop through several levels
+        // on the tick their slots line up
+        for (int level = LEVELS - 1; level > 0; --level) {
+            if ((current & ((static_cast<uint64_t>(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                continue;
+            }
+            std::vector<Timer> moving;
+            moving.swap(slots[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+            for (auto& timer : moving) {
+                place(std::move(timer));
+            }
+        }
+        std::vector<Timer> firing;
+        firing.swap(slots[0][current & (SLOTS - 1)]);
+        for (auto& timer : firing) {
+            due.push_back(std::move(timer.key));
+        }
+        count -= firing.size();
+    }
+    current = std::max(current, target);
+}
+
+} // namespace funnelkvs
@@ -0,0 +1,184 @@
+#include "../include/hash.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstring>
+
+using namespace funnelkvs;
+
+// Byte-at-a-time versions of the ring operations, as hash.cpp used to
+// implement them, to measure the word-wise ones against.
+namespace bytewise {
+
+bool less(const Hash160& a, const Hash160& b) {
+    for (int i = 0; i < 20; ++i) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i];
+        }
+    }
+    return false;
+}
+
+bool equal(const Hash160& a, const Hash160& b) {
+    for (int i = 0; i < 20; ++i) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool in_range(const Hash160& id, const Hash160& start, const Hash160& end, bool inclusive_end) {
+    if (equal(start, end)) {
+        return inclusive_end ? equal(id, start) : false;
+    }
+    bool after_start = less(start, id);
+    bool before_end = inclusive_end ? !less(end, id) : less(id, end);
+    return less(start, end) ? (after_start && before_end) : (after_start || before_end);
+}
+
+Hash160 add_power_of_two(const Hash160& base, int power) {
+    Hash160 result = base;
+    int byte_index = 19 - (power / 8);
+    uint16_t add = static_cast<uint16_t>(1 << (power % 8));
+    for (int i = byte_index; i >= 0 && add; i--) {
+        uint16_t sum = result[i] + add;
+        result[i] = sum & 0xFF;
+        add = sum >> 8;
+    }
+    return result;
+}
+
+Hash160 distance(const Hash160& from, const Hash160& to) {
+    Hash160 result = {};
+    int borrow = 0;
+    for (int i = 19; i >= 0; i--) {
+        int diff = to[i] - from[i] - borrow;
+        borrow = diff < 0 ? 1 : 0;
+        result[i] = static_cast<uint8_t>(diff + (borrow << 8));
+    }
+    return result;
+}
+
+} // namespace bytewise
+
+namespace {
+
+const size_t NUM_IDS = 4096;
+const int ROUNDS = 200;
+
+volatile uint64_t sink;
+
+template<typename F>
+double time_ns_per_op(F op, size_t ops) {
+    auto start = std::chrono::steady_clock::now();
+    op();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+void report(const std::string& name, double before, double after) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(8) << before << " ns  ->"
+              << std::setw(8) << after << " ns  (" << std::setprecision(1)
+              << before / after << "x)" << std::endl;
+}
+
+} // namespace
+
+int main() {
+    std::vector<Hash160> ids;
+    for (size_t i = 0; i < NUM_IDS; ++i) {
+        ids.push_back(SHA1::hash("bench_" + std::to_string(i)));
+    }
+    const size_t ops = NUM_IDS * ROUNDS;
+
+    std::cout << "Hash160 ring arithmetic, byte-wise -> word-wise (per op)" << std::endl;
+
+    double before = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 1; i < NUM_IDS; ++i) n += bytewise::less(ids[i - 1], ids[i]);
+        sink = n;
+    }, ops);
+    double after = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 1; i < NUM_IDS; ++i) n += ids[i - 1] < ids[i];
+        sink = n;
+    }, ops);
+    report("operator<", before, after);
+
+    before = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 2; i < NUM_IDS; ++i) n += bytewise::in_range(ids[i], ids[i - 1], ids[i - 2], true);
+        sink = n;
+    }, ops);
+    after = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 2; i < NUM_IDS; ++i) n += in_range(ids[i], ids[i - 1], ids[i - 2], true);
+        sink = n;
+    }, ops);
+    report("in_range", before, after);
+
+    before = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 0; i < NUM_IDS; ++i) n += bytewise::add_power_of_two(ids[i], (i + r) % 160)[0];
+        sink = n;
+    }, ops);
+    after = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 0; i < NUM_IDS; ++i) n += add_power_of_two(ids[i], (i + r) % 160)[0];
+        sink = n;
+    }, ops);
+    report("add_power_of_two", before, after);
+
+    before = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 1; i < NUM_IDS; ++i) n += bytewise::distance(ids[i - 1], ids[i])[0];
+        sink = n;
+    }, ops);
+    after = time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < ROUNDS; ++r)
+            for (size_t i = 1; i < NUM_IDS; ++i) n += distance(ids[i - 1], ids[i])[0];
+        sink = n;
+    }, ops);
+    report("distance", before, after);
+
+    std::cout << "SHA-1, portable -> " << (SHA1::use_hardware(true) ? SHA1::implementation() : "portable")
+              << " (per hash)" << std::endl;
+    const size_t sizes[] = {16, 64, 1024};
+    for (size_t size : sizes) {
+        std::vector<uint8_t> input(size, 'k');
+        const size_t hashes = size < 1024 ? 200000 : 20000;
+        SHA1::use_hardware(false);
+        before = time_ns_per_op([&] {
+            uint64_t n = 0;
+            for (size_t i = 0; i < hashes; ++i) {
+                input[0] = static_cast<uint8_t>(i);
+                n += SHA1::hash(input)[0];
+            }
+            sink = n;
+        }, hashes);
+        SHA1::use_hardware(true);
+        after = time_ns_per_op([&] {
+            uint64_t n = 0;
+            for (size_t i = 0; i < hashes; ++i) {
+                input[0] = static_cast<uint8_t>(i);
+                n += SHA1::hash(input)[0];
+            }
+            sink = n;
+        }, hashes);
+        report(std::to_string(size) + "-byte input", before, after);
+    }
+
+    return 0;
+}
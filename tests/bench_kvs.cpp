@@ -0,0 +1,166 @@
+#include "../include/storage.h"
+#include "../include/protocol.h"
+#include "../include/hash.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace funnelkvs;
+
+// Single-node microbenchmarks of the request path's building blocks:
+// storage, request framing, key hashing and ring arithmetic. Numbers are
+// per operation; compare runs on the same machine only.
+
+namespace {
+
+const size_t NUM_KEYS = 100000;
+const size_t READER_THREADS = 4;
+
+volatile uint64_t sink;
+
+template<typename F>
+double time_ns_per_op(F op, size_t ops) {
+    auto start = std::chrono::steady_clock::now();
+    op();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+void report(const std::string& name, double ns) {
+    std::cout << "  " << std::left << std::setw(28) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(9) << ns << " ns/op"
+              << std::setprecision(2) << std::setw(10) << 1000.0 / ns << " Mops/s" << std::endl;
+}
+
+std::vector<std::string> make_keys(size_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("user:" + std::to_string(i * 7919 % 1000003));
+    }
+    return keys;
+}
+
+void bench_storage(const std::vector<std::string>& keys) {
+    std::cout << "Storage (" << keys.size() << " keys, 100-byte values)" << std::endl;
+    std::vector<uint8_t> value(100, 'v');
+    Storage storage;
+
+    report("put (insert)", time_ns_per_op([&] {
+        for (const auto& key : keys) storage.put(key, value);
+    }, keys.size()));
+    report("put (overwrite)", time_ns_per_op([&] {
+        for (const auto& key : keys) storage.put(key, value);
+    }, keys.size()));
+    report("get (hit, copy)", time_ns_per_op([&] {
+        std::vector<uint8_t> out;
+        uint64_t n = 0;
+        for (const auto& key : keys) n += storage.get(key, out);
+        sink = n;
+    }, keys.size()));
+    report("get (hit, view)", time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (const auto& key : keys) {
+            Storage::ValueView view;
+            n += storage.get(key, view) ? view.size : 0;
+        }
+        sink = n;
+    }, keys.size()));
+    report("get (miss)", time_ns_per_op([&] {
+        std::vector<uint8_t> out;
+        uint64_t n = 0;
+        for (const auto& key : keys) n += storage.get(key + "!", out);
+        sink = n;
+    }, keys.size()));
+
+    // Aggregate: total time for every reader to get every key
+    double ns = time_ns_per_op([&] {
+        std::vector<std::thread> readers;
+        for (size_t t = 0; t < READER_THREADS; ++t) {
+            readers.emplace_back([&storage, &keys, t] {
+                std::vector<uint8_t> out;
+                uint64_t n = 0;
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    n += storage.get(keys[(i + t * 997) % keys.size()], out);
+                }
+                sink = n;
+            });
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+    }, keys.size() * READER_THREADS);
+    report("get (" + std::to_string(READER_THREADS) + " threads, aggregate)", ns);
+
+    report("remove", time_ns_per_op([&] {
+        for (const auto& key : keys) storage.remove(key);
+    }, keys.size()));
+}
+
+void bench_protocol(const std::vector<std::string>& keys) {
+    const size_t sizes[] = {100, 4096};
+    for (size_t size : sizes) {
+        std::cout << "Protocol (PUT frame, " << size << "-byte value)" << std::endl;
+        std::vector<uint8_t> value(size, 'p');
+        const size_t ops = size < 1024 ? keys.size() : keys.size() / 10;
+
+        std::vector<Request> requests;
+        for (size_t i = 0; i < ops; ++i) {
+            requests.emplace_back(OpCode::PUT,
+                                  std::vector<uint8_t>(keys[i].begin(), keys[i].end()), value);
+        }
+        std::vector<std::vector<uint8_t>> frames(ops);
+        report("encodeRequest", time_ns_per_op([&] {
+            for (size_t i = 0; i < ops; ++i) frames[i] = Protocol::encodeRequest(requests[i]);
+        }, ops));
+        report("decodeRequest", time_ns_per_op([&] {
+            Request request;
+            uint64_t n = 0;
+            for (size_t i = 0; i < ops; ++i) n += Protocol::decodeRequest(frames[i], request);
+            sink = n;
+        }, ops));
+        report("decodeRequestView", time_ns_per_op([&] {
+            RequestView view;
+            uint64_t n = 0;
+            for (size_t i = 0; i < ops; ++i) {
+                n += Protocol::decodeRequestView(frames[i].data(), frames[i].size(), view);
+            }
+            sink = n;
+        }, ops));
+    }
+}
+
+void bench_hashing(const std::vector<std::string>& keys) {
+    std::cout << "Hashing and ring arithmetic (" << SHA1::implementation() << " SHA-1)" << std::endl;
+    report("SHA1::hash (key)", time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (const auto& key : keys) n += SHA1::hash(key)[0];
+        sink = n;
+    }, keys.size()));
+
+    std::vector<Hash160> ids;
+    ids.reserve(keys.size());
+    for (const auto& key : keys) {
+        ids.push_back(SHA1::hash(key));
+    }
+    const int rounds = 20;
+    report("in_range", time_ns_per_op([&] {
+        uint64_t n = 0;
+        for (int r = 0; r < rounds; ++r)
+            for (size_t i = 2; i < ids.size(); ++i) n += in_range(ids[i], ids[i - 1], ids[i - 2], true);
+        sink = n;
+    }, (ids.size() - 2) * rounds));
+}
+
+} // namespace
+
+int main() {
+    std::vector<std::string> keys = make_keys(NUM_KEYS);
+    bench_storage(keys);
+    bench_protocol(keys);
+    bench_hashing(keys);
+    return 0;
+}
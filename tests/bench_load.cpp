@@ -0,0 +1,491 @@
+#include "../include/chord_server.h"
+#include "../include/client.h"
+#include "../include/ring_cache.h"
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace funnelkvs;
+
+// Closed-loop load generator. Each worker thread keeps one connection per
+// ring node, draws keys from a uniform or Zipfian distribution, groups
+// every window of `pipeline` operations by owner and pipelines each group
+// to its owner. Latency is measured per window on the owner's connection,
+// so with -P 1 it is the latency of a single request.
+//
+// Without -p the generator starts a ring of -n nodes in this process,
+// which is what `make bench` runs; with -p it drives an existing ring
+// reached through HOST:PORT.
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    size_t local_nodes = 3;
+    uint16_t local_base_port = 19201;
+    size_t threads = 4;
+    double seconds = 5.0;
+    size_t keyspace = 100000;
+    double zipf_theta = 0.0;   // 0: uniform
+    size_t value_min = 100;
+    size_t value_max = 100;
+    double read_ratio = 0.9;
+    size_t pipeline = 1;
+    bool front_end = false;    // send everything to the entry node
+    bool preload = true;
+};
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [-h HOST -p PORT | -n NODES] [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -h HOST          Entry node of an existing ring (default: 127.0.0.1)" << std::endl;
+    std::cout << "  -p PORT          Entry node port; without it a local ring is started" << std::endl;
+    std::cout << "  -n NODES         Size of the local ring (default: 3)" << std::endl;
+    std::cout << "  -t THREADS       Worker threads, each with its own connections (default: 4)" << std::endl;
+    std::cout << "  -d SECONDS       Run time (default: 5)" << std::endl;
+    std::cout << "  -k KEYS          Key space (default: 100000)" << std::endl;
+    std::cout << "  -z THETA         Zipfian skew, e.g. 0.99 (default: 0, uniform)" << std::endl;
+    std::cout << "  -s BYTES[-MAX]   Value size, or a uniform range (default: 100)" << std::endl;
+    std::cout << "  -r RATIO         Share of reads, 0..1 (default: 0.9)" << std::endl;
+    std::cout << "  -P DEPTH         Pipelining depth (default: 1)" << std::endl;
+    std::cout << "  -f               Send every request to the entry node (redirects, read cache)" << std::endl;
+    std::cout << "  -L               Skip loading the key space before the run" << std::endl;
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "-h" && has_value) {
+            options.host = argv[++i];
+        } else if (arg == "-p" && has_value) {
+            options.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "-n" && has_value) {
+            options.local_nodes = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-t" && has_value) {
+            options.threads = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-d" && has_value) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (arg == "-k" && has_value) {
+            options.keyspace = static_cast<size_t>(std::atol(argv[++i]));
+        } else if (arg == "-z" && has_value) {
+            options.zipf_theta = std::atof(argv[++i]);
+        } else if (arg == "-s" && has_value) {
+            std::string sizes = argv[++i];
+            size_t dash = sizes.find('-');
+            options.value_min = static_cast<size_t>(std::atol(sizes.substr(0, dash).c_str()));
+            options.value_max = dash == std::string::npos ? options.value_min :
+                static_cast<size_t>(std::atol(sizes.substr(dash + 1).c_str()));
+        } else if (arg == "-r" && has_value) {
+            options.read_ratio = std::atof(argv[++i]);
+        } else if (arg == "-P" && has_value) {
+            options.pipeline = static_cast<size_t>(std::atoi(argv[++i]));
+        } else if (arg == "-f") {
+            options.front_end = true;
+        } else if (arg == "-L") {
+            options.preload = false;
+        } else {
+            return false;
+        }
+    }
+    return options.threads > 0 && options.keyspace > 0 && options.pipeline > 0 &&
+           options.local_nodes > 0 && options.value_min <= options.value_max &&
+           options.zipf_theta >= 0.0 && options.zipf_theta != 1.0;
+}
+
+// Zipfian ranks in [0, n) as in YCSB (Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases"). Rank 0 is the most popular; ranks
+// are scattered over the key space by hashing so that the hot keys do not
+// all land on one node.
+class KeyChooser {
+public:
+    KeyChooser(size_t n, double theta) : items(n), theta(theta), zeta_n(0), alpha(0), eta(0) {
+        if (theta > 0.0) {
+            for (size_t i = 1; i <= n; ++i) {
+                zeta_n += 1.0 / std::pow(static_cast<double>(i), theta);
+            }
+            double zeta_2 = 1.0 + 1.0 / std::pow(2.0, theta);
+            alpha = 1.0 / (1.0 - theta);
+            eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+        }
+    }
+
+    size_t next(std::mt19937_64& rng) const {
+        if (theta <= 0.0) {
+            return rng() % items;
+        }
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zeta_n;
+        size_t rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < 1.0 + std::pow(0.5, theta)) {
+            rank = 1;
+        } else {
+            rank = static_cast<size_t>(items * std::pow(eta * u - eta + 1.0, alpha));
+        }
+        return scatter(std::min(rank, items - 1));
+    }
+
+    size_t size() const { return items; }
+
+private:
+    size_t items;
+    double theta;
+    double zeta_n;
+    double alpha;
+    double eta;
+
+    size_t scatter(size_t rank) const {
+        uint64_t h = rank * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+        return h % items;
+    }
+};
+
+std::string key_name(size_t index) {
+    return "bench:" + std::to_string(index);
+}
+
+// Log-linear latency histogram in the spirit of HdrHistogram: each
+// power-of-two range is split into SUB_BUCKETS linear buckets, so every
+// reported value is within 1/SUB_BUCKETS (about 3%) of the truth. One per
+// worker thread, merged at the end; not thread-safe.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+
+    LatencyHistogram() : counts(64 * SUB_BUCKETS, 0), total(0), max_value(0) {}
+
+    void record(uint64_t ns, uint64_t times = 1) {
+        counts[index_of(ns)] += times;
+        total += times;
+        max_value = std::max(max_value, ns);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_value; }
+
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank && counts[i]) {
+                return std::min(value_of(i), max_value);
+            }
+        }
+        return max_value;
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t max_value;
+
+    static size_t index_of(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        uint64_t sub = (value >> shift) & (SUB_BUCKETS - 1);
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + sub);
+    }
+
+    // Upper end of a bucket
+    static uint64_t value_of(size_t index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+        uint64_t sub = index % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+    }
+};
+
+struct WorkerResult {
+    LatencyHistogram reads;
+    LatencyHistogram writes;
+    uint64_t not_found = 0;
+    uint64_t errors = 0;
+    uint64_t redirects = 0;
+};
+
+struct Connections {
+    std::unordered_map<std::string, std::unique_ptr<Client>> by_node;
+
+    Client* get(const std::string& endpoint) {
+        auto it = by_node.find(endpoint);
+        if (it != by_node.end()) {
+            return it->second.get();
+        }
+        std::string host;
+        uint16_t port;
+        if (!RingCache::split_endpoint(endpoint, host, port)) {
+            return nullptr;
+        }
+        std::unique_ptr<Client> client(new Client(host, port));
+        if (!client->connect()) {
+            return nullptr;
+        }
+        Client* raw = client.get();
+        by_node[endpoint] = std::move(client);
+        return raw;
+    }
+};
+
+void run_worker(const Options& options, const RingCache& ring, const std::string& entry,
+                const KeyChooser& chooser, size_t seed, const std::atomic<bool>& stop,
+                WorkerResult& result) {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<size_t> value_size(options.value_min, options.value_max);
+    std::vector<uint8_t> payload(options.value_max, 'x');
+    Connections connections;
+
+    std::unordered_map<std::string, std::vector<Request>> groups;
+    std::vector<Response> responses;
+    while (!stop.load(std::memory_order_relaxed)) {
+        for (auto& group : groups) {
+            group.second.clear();
+        }
+        for (size_t i = 0; i < options.pipeline; ++i) {
+            std::string key = key_name(chooser.next(rng));
+            std::string owner = entry;
+            if (!options.front_end) {
+                ring.owner_of(SHA1::hash(key), owner);
+            }
+            std::vector<uint8_t> key_bytes(key.begin(), key.end());
+            if (coin(rng) < options.read_ratio) {
+                groups[owner].emplace_back(OpCode::GET, key_bytes);
+            } else {
+                payload[0] = static_cast<uint8_t>(rng());
+                groups[owner].emplace_back(OpCode::PUT, key_bytes,
+                    std::vector<uint8_t>(payload.begin(), payload.begin() + value_size(rng)));
+            }
+        }
+
+        for (auto& group : groups) {
+            const std::vector<Request>& requests = group.second;
+            if (requests.empty()) {
+                continue;
+            }
+            Client* client = connections.get(group.first);
+            auto started = std::chrono::steady_clock::now();
+            bool ok = client && client->pipeline(requests, responses, options.pipeline);
+            uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - started).count());
+            if (!ok) {
+                // Reconnect on the next window
+                result.errors += requests.size();
+                connections.by_node.erase(group.first);
+                continue;
+            }
+
+            for (size_t i = 0; i < requests.size(); ++i) {
+                Response& response = responses[i];
+                uint64_t latency = ns;
+                if (response.status == StatusCode::REDIRECT) {
+                    // Follow it synchronously and charge the extra round trip
+                    result.redirects++;
+                    std::string target(response.value.begin(), response.value.end());
+                    Client* owner = connections.get(target);
+                    auto retried = std::chrono::steady_clock::now();
+                    if (!owner || !owner->call(requests[i], response)) {
+                        response.status = StatusCode::ERROR;
+                        connections.by_node.erase(target);
+                    }
+                    latency += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - retried).count());
+                }
+                if (response.status == StatusCode::KEY_NOT_FOUND) {
+                    result.not_found++;
+                } else if (response.status != StatusCode::SUCCESS) {
+                    result.errors++;
+                    continue;
+                }
+                (requests[i].opcode == OpCode::GET ? result.reads : result.writes).record(latency);
+            }
+        }
+    }
+}
+
+bool ring_linked(const std::vector<uint16_t>& ports) {
+    std::vector<std::string> endpoints;
+    RingCache ring;
+    for (uint16_t port : ports) {
+        endpoints.push_back("127.0.0.1:" + std::to_string(port));
+    }
+    ring.add(endpoints);
+    std::vector<std::string> order = ring.nodes();
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::string host;
+        uint16_t port;
+        RingCache::split_endpoint(order[i], host, port);
+        Client client(host, port);
+        std::vector<std::string> successors;
+        if (!client.connect() || !client.get_successor_list(successors) || successors.empty() ||
+            successors[0] != order[(i + 1) % order.size()]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool start_local_ring(const Options& options, std::vector<std::unique_ptr<ChordServer>>& servers) {
+    std::vector<uint16_t> ports;
+    for (size_t i = 0; i < options.local_nodes; ++i) {
+        uint16_t port = static_cast<uint16_t>(options.local_base_port + i);
+        ports.push_back(port);
+        servers.emplace_back(new ChordServer("127.0.0.1", port));
+        servers.back()->start();
+    }
+    for (size_t i = 1; i < servers.size(); ++i) {
+        servers[i]->join_ring("127.0.0.1", ports[0]);
+    }
+    for (int attempt = 0; attempt < 60; ++attempt) {
+        if (ring_linked(ports)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    return false;
+}
+
+void report(const std::string& name, const LatencyHistogram& histogram, double seconds) {
+    std::cout << "  " << std::left << std::setw(5) << name << std::right
+              << std::setw(10) << histogram.count() << " ops " << std::fixed << std::setprecision(0)
+              << std::setw(10) << histogram.count() / seconds << " ops/s   latency us: "
+              << std::setprecision(1)
+              << "p50 " << histogram.percentile(0.50) / 1000.0
+              << "  p99 " << histogram.percentile(0.99) / 1000.0
+              << "  p999 " << histogram.percentile(0.999) / 1000.0
+              << "  max " << histogram.max() / 1000.0 << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    if (options.port == 0) {
+        std::cout << "Starting a local ring of " << options.local_nodes << " nodes..." << std::endl;
+        if (!start_local_ring(options, servers)) {
+            std::cerr << "Local ring did not converge" << std::endl;
+            return 1;
+        }
+        options.port = options.local_base_port;
+    }
+    std::string entry = options.host + ":" + std::to_string(options.port);
+
+    // Learn the ring layout once; the workers route with a shared copy
+    Client seed_client(options.host, options.port);
+    if (!seed_client.connect() || !seed_client.enable_smart_routing()) {
+        std::cerr << "Cannot reach the ring through " << entry << std::endl;
+        return 1;
+    }
+    RingCache ring;
+    ring.add(seed_client.known_nodes());
+
+    KeyChooser chooser(options.keyspace, options.zipf_theta);
+    if (options.preload) {
+        // Pipelined straight to each owner
+        std::unordered_map<std::string, std::vector<std::pair<std::string, std::vector<uint8_t>>>> by_owner;
+        for (size_t i = 0; i < options.keyspace; ++i) {
+            std::string key = key_name(i);
+            std::string owner = entry;
+            ring.owner_of(SHA1::hash(key), owner);
+            by_owner[owner].emplace_back(key, std::vector<uint8_t>(options.value_min, 'x'));
+        }
+        Connections connections;
+        size_t stored = 0;
+        for (const auto& group : by_owner) {
+            Client* client = connections.get(group.first);
+            if (client) {
+                stored += client->put_many(group.second);
+            }
+        }
+        std::cout << "Loaded " << stored << " of " << options.keyspace << " keys" << std::endl;
+    }
+
+    std::cout << "Load: " << ring.size() << " nodes, " << options.threads << " threads, "
+              << options.keyspace << " keys ";
+    if (options.zipf_theta > 0.0) {
+        std::cout << "zipfian(" << options.zipf_theta << ")";
+    } else {
+        std::cout << "uniform";
+    }
+    std::cout << ", values " << options.value_min;
+    if (options.value_max != options.value_min) {
+        std::cout << "-" << options.value_max;
+    }
+    std::cout << " bytes, " << static_cast<int>(options.read_ratio * 100 + 0.5) << "% reads, pipeline "
+              << options.pipeline << (options.front_end ? ", via entry node" : ", owner-routed")
+              << ", " << options.seconds << " s" << std::endl;
+
+    std::atomic<bool> stop(false);
+    std::vector<WorkerResult> results(options.threads);
+    std::vector<std::thread> workers;
+    auto started = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < options.threads; ++t) {
+        workers.emplace_back(run_worker, std::cref(options), std::cref(ring), std::cref(entry),
+                             std::cref(chooser), t + 1, std::cref(stop), std::ref(results[t]));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int64_t>(options.seconds * 1000)));
+    stop.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    WorkerResult total;
+    for (const auto& result : results) {
+        total.reads.merge(result.reads);
+        total.writes.merge(result.writes);
+        total.not_found += result.not_found;
+        total.errors += result.errors;
+        total.redirects += result.redirects;
+    }
+    LatencyHistogram all;
+    all.merge(total.reads);
+    all.merge(total.writes);
+    report("GET", total.reads, elapsed);
+    report("PUT", total.writes, elapsed);
+    report("all", all, elapsed);
+    std::cout << "  not found " << total.not_found << ", errors " << total.errors
+              << ", redirects " << total.redirects << std::endl;
+
+    seed_client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    return total.errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#include "../include/async_rpc.h"
+#include "../include/server.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace funnelkvs;
+
+namespace {
+
+Request make_request(OpCode opcode, const std::string& key, const std::string& value = "") {
+    return Request(opcode, std::vector<uint8_t>(key.begin(), key.end()),
+                   std::vector<uint8_t>(value.begin(), value.end()));
+}
+
+// Accepts connections (via the backlog) but never answers
+int silent_listener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    assert(listen(fd, 16) == 0);
+    return fd;
+}
+
+} // namespace
+
+void test_pipelined_calls() {
+    Server server(8301, 4);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    AsyncRpc rpc;
+    const int CALLS = 2000;
+    std::mutex mutex;
+    std::condition_variable cv;
+    int done = 0;
+    int succeeded = 0;
+    for (int i = 0; i < CALLS; ++i) {
+        rpc.call("127.0.0.1", 8301, make_request(OpCode::PUT, "key" + std::to_string(i), "v" + std::to_string(i)),
+                 [&](bool ok, Response& response) {
+                     std::lock_guard<std::mutex> lock(mutex);
+                     done++;
+                     if (ok && response.status == StatusCode::SUCCESS) {
+                         succeeded++;
+                     }
+                     cv.notify_all();
+                 });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        assert(cv.wait_for(lock, std::chrono::seconds(10), [&] { return done == CALLS; }));
+    }
+    assert(succeeded == CALLS);
+
+    // Responses come back matched to their own calls
+    std::vector<std::future<AsyncRpc::Result>> reads;
+    for (int i = 0; i < CALLS; ++i) {
+        reads.push_back(rpc.submit("127.0.0.1", 8301, make_request(OpCode::GET, "key" + std::to_string(i))));
+    }
+    for (int i = 0; i < CALLS; ++i) {
+        AsyncRpc::Result result = reads[i].get();
+        assert(result.ok && result.response.status == StatusCode::SUCCESS);
+        std::string expected = "v" + std::to_string(i);
+        assert(std::string(result.response.value.begin(), result.response.value.end()) == expected);
+    }
+
+    AsyncRpc::Stats stats = rpc.get_stats();
+    assert(stats.calls == 2 * CALLS);
+    assert(stats.failures == 0);
+    assert(stats.in_flight == 0);
+    assert(stats.connects >= 1 && stats.connects <= AsyncRpc::Config().max_connections_per_peer);
+
+    server.stop();
+    std::cout << "✓ test_pipelined_calls passed" << std::endl;
+}
+
+void test_unreachable_peer() {
+    AsyncRpc rpc;
+    auto started = std::chrono::steady_clock::now();
+    AsyncRpc::Result refused = rpc.submit("127.0.0.1", 8302, make_request(OpCode::PING, "")).get();
+    assert(!refused.ok);
+    AsyncRpc::Result bad_address = rpc.submit("not-an-address", 8302, make_request(OpCode::PING, "")).get();
+    assert(!bad_address.ok);
+    assert(std::chrono::steady_clock::now() - started < std::chrono::seconds(1));
+    assert(rpc.get_stats().failures == 2);
+    std::cout << "✓ test_unreachable_peer passed" << std::endl;
+}
+
+void test_call_timeout() {
+    int listener = silent_listener(8303);
+    AsyncRpc rpc;
+    auto started = std::chrono::steady_clock::now();
+    std::future<AsyncRpc::Result> first = rpc.submit("127.0.0.1", 8303, make_request(OpCode::PING, ""),
+                                                     std::chrono::milliseconds(200));
+    std::future<AsyncRpc::Result> second = rpc.submit("127.0.0.1", 8303, make_request(OpCode::PING, ""),
+                                                      std::chrono::milliseconds(200));
+    assert(!first.get().ok);
+    assert(!second.get().ok);
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    assert(elapsed >= std::chrono::milliseconds(200));
+    assert(elapsed < std::chrono::seconds(2));
+    AsyncRpc::Stats stats = rpc.get_stats();
+    assert(stats.timeouts >= 1);
+    assert(stats.in_flight == 0);
+    close(listener);
+    std::cout << "✓ test_call_timeout passed" << std::endl;
+}
+
+void test_peer_restart() {
+    AsyncRpc rpc;
+    {
+        Server server(8304, 2);
+        server.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        assert(rpc.submit("127.0.0.1", 8304, make_request(OpCode::PING, "")).get().ok);
+        server.stop();
+    }
+    // The idle connection died with the old server; the next call gets a
+    // fresh one
+    Server restarted(8304, 2);
+    restarted.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    AsyncRpc::Result result = rpc.submit("127.0.0.1", 8304, make_request(OpCode::PING, "")).get();
+    assert(result.ok && result.response.status == StatusCode::SUCCESS);
+    assert(rpc.get_stats().connects == 2);
+    restarted.stop();
+    std::cout << "✓ test_peer_restart passed" << std::endl;
+}
+
+void test_shutdown_fails_outstanding() {
+    int listener = silent_listener(8305);
+    std::future<AsyncRpc::Result> pending;
+    {
+        AsyncRpc rpc;
+        pending = rpc.submit("127.0.0.1", 8305, make_request(OpCode::PING, ""));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    assert(!pending.get().ok);
+    close(listener);
+    std::cout << "✓ test_shutdown_fails_outstanding passed" << std::endl;
+}
+
+void test_shorter_timeout_behind_longer() {
+    int listener = silent_listener(8306);
+    AsyncRpc::Config config;
+    config.max_connections_per_peer = 1;
+    AsyncRpc rpc(config);
+    // Both calls share one connection; the later one lapses first
+    std::future<AsyncRpc::Result> slow = rpc.submit("127.0.0.1", 8306, make_request(OpCode::PING, ""),
+                                                    std::chrono::milliseconds(1500));
+    std::future<AsyncRpc::Result> fast = rpc.submit("127.0.0.1", 8306, make_request(OpCode::PING, ""),
+                                                    std::chrono::milliseconds(200));
+    assert(fast.wait_for(std::chrono::milliseconds(700)) == std::future_status::ready);
+    assert(!fast.get().ok);
+    assert(slow.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout);
+    assert(!slow.get().ok);
+    AsyncRpc::Stats stats = rpc.get_stats();
+    assert(stats.timeouts == 2);
+    assert(stats.failures == 2);
+    assert(stats.in_flight == 0);
+    close(listener);
+    std::cout << "✓ test_shorter_timeout_behind_longer passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running async RPC tests..." << std::endl;
+
+    test_pipelined_calls();
+    test_unreachable_peer();
+    test_call_timeout();
+    test_shorter_timeout_behind_longer();
+    test_peer_restart();
+    test_shutdown_fails_outstanding();
+
+    std::cout << "\nAll async RPC tests passed!" << std::endl;
+    return 0;
+}
@@ -3,6 +3,9 @@
 #include <cassert>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 using namespace funnelkvs;
 
@@ -100,6 +103,80 @@ void test_finger_table_initialization() {
     std::cout << "✓ test_finger_table_initialization passed" << std::endl;
 }
 
+void test_compact_finger_table() {
+    auto owner = std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", 8001));
+    FingerTable fingers(owner);
+    
+    // A fresh table points everywhere at the owner and precedes nothing
+    assert(fingers.distinct_nodes() == 0);
+    assert(fingers.get(0) == owner);
+    assert(fingers.closest_preceding(SHA1::hash("anything")) == nullptr);
+    
+    // Fill the table the way fix_fingers would: each finger points at the
+    // first node at or after owner + 2^i
+    std::vector<std::shared_ptr<NodeInfo>> ring;
+    for (uint16_t port = 9100; port < 9116; ++port) {
+        ring.push_back(std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", port)));
+    }
+    std::vector<std::shared_ptr<NodeInfo>> expected(FingerTable::SIZE);
+    for (int i = 0; i < FingerTable::SIZE; ++i) {
+        Hash160 start = add_power_of_two(owner->id, i);
+        std::shared_ptr<NodeInfo> best = owner;
+        for (const auto& node : ring) {
+            if (in_range(node->id, start, best->id, false) || node->id == start) {
+                best = node;
+            }
+        }
+        expected[i] = best;
+        fingers.set(i, i, best);
+    }
+    for (int i = 0; i < FingerTable::SIZE; ++i) {
+        assert(fingers.get(i)->id == expected[i]->id);
+    }
+    assert(fingers.distinct_nodes() <= ring.size());
+    
+    // Binary search agrees with a linear scan from the top
+    for (int k = 0; k < 500; ++k) {
+        Hash160 id = SHA1::hash("probe_" + std::to_string(k));
+        std::shared_ptr<NodeInfo> linear;
+        for (int i = FingerTable::SIZE - 1; i >= 0 && !linear; --i) {
+            if (*expected[i] != *owner && in_range(expected[i]->id, owner->id, id, false)) {
+                linear = expected[i];
+            }
+        }
+        auto found = fingers.closest_preceding(id);
+        assert((found == nullptr) == (linear == nullptr));
+        assert(!found || found->id == linear->id);
+        
+        std::vector<std::shared_ptr<NodeInfo>> alternatives;
+        fingers.preceding(id, 3, alternatives);
+        assert(alternatives.size() <= 3);
+        assert(alternatives.empty() || alternatives[0]->id == found->id);
+        for (size_t j = 1; j < alternatives.size(); ++j) {
+            assert(in_range(alternatives[j]->id, owner->id, alternatives[j - 1]->id, false));
+        }
+    }
+    
+    // Repointing a failed finger keeps the table consistent
+    auto failed = fingers.get(FingerTable::SIZE - 1);
+    auto replacement = ring[0]->id == failed->id ? ring[1] : ring[0];
+    assert(fingers.replace(*failed, replacement));
+    for (int i = 0; i < FingerTable::SIZE; ++i) {
+        assert(fingers.get(i)->id != failed->id);
+        if (expected[i]->id != failed->id) {
+            assert(fingers.get(i)->id == expected[i]->id);
+        }
+    }
+    assert(!fingers.replace(*failed, replacement));
+    
+    // Collapsing every finger back to the owner frees the entries
+    fingers.fill(owner);
+    assert(fingers.distinct_nodes() == 0);
+    assert(fingers.get(FingerTable::SIZE - 1) == owner);
+    
+    std::cout << "✓ test_compact_finger_table passed" << std::endl;
+}
+
 void test_node_join_operation() {
     // Create first node
     ChordNode node1("127.0.0.1", 8001);
@@ -236,6 +313,49 @@ void test_concurrent_operations() {
     std::cout << "✓ test_concurrent_operations passed" << std::endl;
 }
 
+void test_routing_snapshot_under_updates() {
+    ChordNode node("127.0.0.1", 8001);
+    ChordNode other("127.0.0.1", 8003);
+    node.create();
+    other.create();
+    
+    auto peer = std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", 8002));
+    const size_t list_size = node.get_successor_list().size();
+    std::atomic<bool> done(false);
+    
+    // Readers never see a torn table: the predecessor is always either
+    // unset or the peer, and the successor list keeps its full length
+    auto reader = [&]() {
+        while (!done.load()) {
+            auto pred = node.get_predecessor();
+            assert(!pred || *pred == *peer);
+            assert(node.get_successor_list().size() == list_size);
+            assert(node.get_successor()->id == node.get_info().id);
+            
+            // Snapshots cached per thread must not leak between nodes
+            assert(other.get_predecessor() == nullptr);
+            assert(other.get_successor()->id == other.get_info().id);
+        }
+    };
+    
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back(reader);
+    }
+    for (int i = 0; i < 200; ++i) {
+        node.notify(peer);
+        assert(node.get_predecessor() && *node.get_predecessor() == *peer);
+        node.handle_node_failure(peer);
+        assert(node.get_predecessor() == nullptr);
+    }
+    done.store(true);
+    for (auto& t : readers) {
+        t.join();
+    }
+    
+    std::cout << "✓ test_routing_snapshot_under_updates passed" << std::endl;
+}
+
 void test_debug_functions() {
     ChordNode node("127.0.0.1", 8001);
     node.create();
@@ -250,14 +370,86 @@ void test_debug_functions() {
     std::cout << "✓ test_debug_functions passed" << std::endl;
 }
 
+void test_node_info_tokens() {
+    NodeInfo plain = NodeInfo::from_address("127.0.0.1", 8001);
+    NodeInfo token = NodeInfo::from_address("127.0.0.1", 8001, 3);
+    
+    // Token 0 keeps the plain endpoint and id; others get their own
+    assert(plain.endpoint() == "127.0.0.1:8001");
+    assert(plain.id == SHA1::hash("127.0.0.1:8001"));
+    assert(token.endpoint() == "127.0.0.1:8001#3");
+    assert(token.id == SHA1::hash("127.0.0.1:8001#3"));
+    assert(token.host_endpoint() == "127.0.0.1:8001");
+    assert(token != plain);
+    assert(token.same_host(plain));
+    assert(!token.same_host(NodeInfo::from_address("127.0.0.1", 8002)));
+    
+    NodeInfo parsed;
+    assert(NodeInfo::parse(token.endpoint(), parsed));
+    assert(parsed == token && parsed.token == 3);
+    assert(NodeInfo::parse("127.0.0.1:8001", parsed));
+    assert(parsed == plain && parsed.token == 0);
+    
+    std::cout << "✓ test_node_info_tokens passed" << std::endl;
+}
+
+void test_host_tokens_share_ownership() {
+    // One server with four ring positions, linked without the network
+    ChordNode primary("127.0.0.1", 8001);
+    std::vector<std::unique_ptr<ChordNode>> extra;
+    std::vector<ChordNode*> tokens = {&primary};
+    for (uint16_t t = 1; t < 4; ++t) {
+        extra.push_back(primary.make_token(t));
+        tokens.push_back(extra.back().get());
+    }
+    std::vector<NodeInfo> positions;
+    for (ChordNode* token : tokens) {
+        token->set_host_tokens(tokens);
+        positions.push_back(token->get_info());
+    }
+    for (ChordNode* token : tokens) {
+        token->create_among(positions);
+        assert(token->token_count() == 4);
+        assert(token->get_predecessor() && token->get_predecessor()->same_host(token->get_info()));
+    }
+    
+    // Every key is owned by the position that follows it, and every
+    // position serves it
+    for (int i = 0; i < 200; ++i) {
+        Hash160 key_id = SHA1::hash("token_key_" + std::to_string(i));
+        const NodeInfo* expected = nullptr;
+        for (const auto& position : positions) {
+            if (!expected || in_range(position.id, key_id, expected->id, true)) {
+                expected = &position;
+            }
+        }
+        for (ChordNode* token : tokens) {
+            assert(token->host_owner(key_id) && token->host_owner(key_id)->get_info() == *expected);
+            assert(token->is_responsible_for_key(key_id));
+        }
+        // No other server: nothing to replicate to
+        assert(primary.host_owner(key_id)->get_replica_nodes(key_id).empty());
+    }
+    
+    // The positions share one store
+    assert(extra[1]->store_key("shared", {'s'}));
+    std::vector<uint8_t> value;
+    assert(primary.retrieve_key("shared", value));
+    assert(value == std::vector<uint8_t>({'s'}));
+    
+    std::cout << "✓ test_host_tokens_share_ownership passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running Chord DHT tests..." << std::endl;
     
     test_node_info_creation();
+    test_node_info_tokens();
     test_chord_node_creation();
     test_single_node_ring();
     test_key_storage_single_node();
     test_finger_table_initialization();
+    test_compact_finger_table();
     test_node_join_operation();
     // test_maintenance_threads(); // Skip for now due to threading issues
     test_node_responsibility();
@@ -265,6 +457,8 @@ int main() {
     test_stabilization_process();
     test_notify_operation();
     test_concurrent_operations();
+    test_routing_snapshot_under_updates();
+    test_host_tokens_share_ownership();
     test_debug_functions();
     
     std::cout << "\nAll Chord DHT tests passed!" << std::endl;
@@ -1,10 +1,14 @@
 #include "../include/chord_server.h"
 #include "../include/client.h"
+#include "../include/async_rpc.h"
 #include <iostream>
 #include <cassert>
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <memory>
+#include <map>
+#include <set>
 
 using namespace funnelkvs;
 
@@ -210,6 +214,1117 @@ void test_chord_ring_operations() {
     std::cout << "✓ test_chord_ring_operations passed" << std::endl;
 }
 
+void test_chord_batch_operations() {
+    std::cout << "Testing batched MULTI_* operations..." << std::endl;
+    
+    ChordServer server("127.0.0.1", 9008);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    Client client("127.0.0.1", 9008);
+    assert(client.connect());
+    
+    std::vector<BatchEntry> entries;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 50; ++i) {
+        std::string key = "batch_" + std::to_string(i);
+        entries.emplace_back(key, std::vector<uint8_t>{'b', static_cast<uint8_t>(i)});
+        keys.push_back(key);
+    }
+    
+    std::vector<BatchResult> results;
+    assert(client.multi_put(entries, results));
+    assert(results.size() == entries.size());
+    for (const auto& result : results) {
+        assert(result.status == StatusCode::SUCCESS);
+    }
+    
+    // Results follow request order, including keys that do not exist
+    keys.push_back("batch_missing");
+    assert(client.multi_get(keys, results));
+    assert(results.size() == keys.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        assert(results[i].status == StatusCode::SUCCESS);
+        assert(results[i].value == entries[i].value);
+    }
+    assert(results.back().status == StatusCode::KEY_NOT_FOUND);
+    
+    // Single-key reads see batched writes
+    std::vector<uint8_t> value;
+    assert(client.get("batch_7", value));
+    assert(value == entries[7].value);
+    
+    assert(client.multi_remove(keys, results));
+    for (size_t i = 0; i < entries.size(); ++i) {
+        assert(results[i].status == StatusCode::SUCCESS);
+    }
+    assert(results.back().status == StatusCode::KEY_NOT_FOUND);
+    assert(!client.get("batch_7", value));
+    
+    // An empty batch is valid
+    assert(client.multi_get(std::vector<std::string>(), results));
+    assert(results.empty());
+    
+    client.disconnect();
+    server.stop();
+    
+    std::cout << "✓ test_chord_batch_operations passed" << std::endl;
+}
+
+void test_streamed_key_transfer() {
+    std::cout << "Testing streamed key transfer..." << std::endl;
+    
+    ChordServer receiver("127.0.0.1", 9009);
+    receiver.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    ChordNode donor("127.0.0.1", 9109);
+    donor.set_transfer_batch_limits(16, 1024 * 1024);
+    for (int i = 0; i < 300; ++i) {
+        std::string key = "xfer_" + std::to_string(i);
+        donor.receive_transferred_key(key, std::vector<uint8_t>{'x', static_cast<uint8_t>(i)});
+    }
+    
+    // The donor first has a predecessor before the receiver; nothing
+    // listens there, so that handoff fails and the keys stay
+    auto target = std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", 9009));
+    std::shared_ptr<NodeInfo> previous;
+    for (int port = 9125; !previous; ++port) {
+        auto candidate = std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", port));
+        if (in_range(target->id, candidate->id, donor.get_id(), false)) {
+            previous = candidate;
+        }
+    }
+    donor.notify(previous);
+    
+    // The receiver then joins between them and takes over (previous,
+    // receiver]; keys outside the donor's old range are replicas it keeps
+    size_t expected = 0;
+    for (int i = 0; i < 300; ++i) {
+        Hash160 key_id = SHA1::hash("xfer_" + std::to_string(i));
+        if (in_range(key_id, previous->id, target->id, true)) {
+            expected++;
+        }
+    }
+    assert(expected > 0);
+    donor.notify(target);
+    
+    Client client("127.0.0.1", 9009);
+    assert(client.connect());
+    size_t moved = 0;
+    for (int i = 0; i < 300; ++i) {
+        std::string key = "xfer_" + std::to_string(i);
+        std::vector<uint8_t> value;
+        bool on_donor = donor.retrieve_replica(key, value);
+        bool on_receiver = client.get(key, value);
+        // Every key lives in exactly one place afterwards
+        assert(on_donor != on_receiver);
+        if (on_receiver) {
+            assert(value == std::vector<uint8_t>({'x', static_cast<uint8_t>(i)}));
+            moved++;
+        }
+    }
+    assert(moved == expected);
+    
+    ChordNode::TransferStats stats = donor.get_transfer_stats();
+    assert(stats.keys_sent == expected);
+    assert(stats.batches_sent * 32 >= expected);
+    assert(!donor.has_transfer_checkpoint(*target));
+    
+    client.disconnect();
+    receiver.stop();
+    std::cout << "✓ test_streamed_key_transfer passed" << std::endl;
+}
+
+void test_key_transfer_resumes_from_checkpoint() {
+    std::cout << "Testing interrupted key transfer..." << std::endl;
+    
+    ChordNode donor("127.0.0.1", 9110);
+    for (int i = 0; i < 100; ++i) {
+        donor.receive_transferred_key("resume_" + std::to_string(i), std::vector<uint8_t>{'r'});
+    }
+    
+    // Nothing listens on the target yet: the transfer stops and keeps the data
+    auto target = std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", 9010));
+    assert(!donor.transfer_keys_to_node(target, true));
+    assert(donor.has_transfer_checkpoint(*target));
+    assert(donor.get_transfer_stats().failed_batches == 1);
+    std::vector<uint8_t> value;
+    for (int i = 0; i < 100; ++i) {
+        assert(donor.retrieve_replica("resume_" + std::to_string(i), value));
+    }
+    
+    ChordServer receiver("127.0.0.1", 9010);
+    receiver.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    assert(donor.transfer_keys_to_node(target, true));
+    assert(!donor.has_transfer_checkpoint(*target));
+    
+    Client client("127.0.0.1", 9010);
+    assert(client.connect());
+    for (int i = 0; i < 100; ++i) {
+        std::string key = "resume_" + std::to_string(i);
+        assert(!donor.retrieve_replica(key, value));
+        assert(client.get(key, value));
+    }
+    
+    client.disconnect();
+    receiver.stop();
+    std::cout << "✓ test_key_transfer_resumes_from_checkpoint passed" << std::endl;
+}
+
+// The owner of an id is the first node clockwise from it
+static std::string expected_owner(const std::vector<NodeInfo>& nodes, const Hash160& id) {
+    const NodeInfo* best = nullptr;
+    for (const auto& node : nodes) {
+        if (node.id == id) {
+            return node.endpoint();
+        }
+        if (!best || in_range(node.id, id, best->id, true)) {
+            best = &node;
+        }
+    }
+    return best->endpoint();
+}
+
+// Wait until every server resolves a set of ids to their true owners
+// among the ring positions in nodes
+static bool wait_for_ring(const std::vector<uint16_t>& ports, const std::vector<NodeInfo>& nodes) {
+    std::vector<Hash160> ids;
+    for (int i = 0; i < 20; ++i) {
+        ids.push_back(SHA1::hash("lookup_" + std::to_string(i)));
+    }
+    for (const auto& node : nodes) {
+        ids.push_back(node.id); // a node owns its own id
+    }
+    
+    // Wait for stabilization to link the ring up
+    for (int attempt = 0; attempt < 60; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        bool converged = true;
+        for (uint16_t port : ports) {
+            Client client("127.0.0.1", port);
+            if (!client.connect()) {
+                converged = false;
+                break;
+            }
+            for (const auto& id : ids) {
+                std::string owner;
+                if (!client.find_successor(id, owner) || owner != expected_owner(nodes, id)) {
+                    converged = false;
+                    break;
+                }
+            }
+            if (!converged) {
+                break;
+            }
+        }
+        if (converged) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Start one server per port, join them all via the first and wait until
+// every node resolves a set of ids to their true owners
+static bool start_ring(const std::vector<uint16_t>& ports,
+                       std::vector<std::unique_ptr<ChordServer>>& servers,
+                       std::vector<NodeInfo>& nodes) {
+    for (uint16_t port : ports) {
+        servers.emplace_back(new ChordServer("127.0.0.1", port));
+        servers.back()->start();
+        nodes.push_back(NodeInfo::from_address("127.0.0.1", port));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (size_t i = 1; i < servers.size(); ++i) {
+        servers[i]->join_ring("127.0.0.1", ports[0]);
+    }
+    return wait_for_ring(ports, nodes);
+}
+
+void test_multi_node_lookup() {
+    std::cout << "Testing lookups across a four-node ring..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9021, 9022, 9023, 9024};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    // Data written through any node is readable through any other
+    Client writer("127.0.0.1", ports[1]);
+    assert(writer.connect());
+    for (int i = 0; i < 20; ++i) {
+        assert(writer.put("ring_" + std::to_string(i), {'r', static_cast<uint8_t>(i)}));
+    }
+    Client reader("127.0.0.1", ports[3]);
+    assert(reader.connect());
+    for (int i = 0; i < 20; ++i) {
+        std::vector<uint8_t> value;
+        assert(reader.get("ring_" + std::to_string(i), value));
+        assert(value == std::vector<uint8_t>({'r', static_cast<uint8_t>(i)}));
+    }
+    
+    // Lookups that left the node were counted with their hops
+    uint64_t remote_lookups = 0;
+    for (const auto& server : servers) {
+        ChordNode::LookupStats stats = server->get_lookup_stats();
+        assert(stats.lookups > 0);
+        assert(stats.latency_us.count == stats.lookups);
+        for (size_t h = 1; h < stats.hops.size(); ++h) {
+            remote_lookups += stats.hops[h];
+            // Four nodes never need more than a few hops
+            if (h > 3) {
+                assert(stats.hops[h] == 0);
+            }
+        }
+    }
+    assert(remote_lookups > 0);
+    
+    // Every copy of every key is accounted for by the node holding it
+    size_t stored = 0;
+    for (const auto& server : servers) {
+        Storage::MemoryStats memory = server->get_memory_stats();
+        assert(memory.value_bytes == memory.entries * 2);
+        assert(memory.allocated_bytes >= memory.key_bytes + memory.value_bytes);
+        stored += memory.entries;
+    }
+    assert(stored >= 20);
+    
+    writer.disconnect();
+    reader.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_multi_node_lookup passed" << std::endl;
+}
+
+void test_smart_client_routing() {
+    std::cout << "Testing smart client routing..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9031, 9032, 9033, 9034};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    Client client("127.0.0.1", ports[2]);
+    assert(client.connect());
+    assert(client.enable_smart_routing());
+    assert(client.smart_routing_enabled());
+    assert(client.known_nodes().size() == nodes.size());
+    
+    // Every request goes straight to its owner
+    for (int i = 0; i < 40; ++i) {
+        assert(client.put("smart_" + std::to_string(i), {'s', static_cast<uint8_t>(i)}));
+    }
+    for (int i = 0; i < 40; ++i) {
+        std::vector<uint8_t> value;
+        assert(client.get("smart_" + std::to_string(i), value));
+        assert(value == std::vector<uint8_t>({'s', static_cast<uint8_t>(i)}));
+    }
+    assert(client.remove("smart_0"));
+    Client::RoutingStats stats = client.get_routing_stats();
+    assert(stats.redirects == 0);
+    assert(stats.direct == 81);
+    
+    // A plain client pays for redirects on most keys
+    Client plain("127.0.0.1", ports[2]);
+    assert(plain.connect());
+    for (int i = 1; i < 40; ++i) {
+        std::vector<uint8_t> value;
+        assert(plain.get("smart_" + std::to_string(i), value));
+    }
+    assert(plain.get_routing_stats().redirects > 0);
+    
+    client.disconnect();
+    plain.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_smart_client_routing passed" << std::endl;
+}
+
+void test_hot_key_read_cache() {
+    std::cout << "Testing the hot-key read cache..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9041, 9042, 9043, 9044};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    const std::string key = "viral";
+    std::string owner = expected_owner(nodes, SHA1::hash(key));
+    size_t reader_index = 0;
+    while (nodes[reader_index].endpoint() == owner) {
+        reader_index++;
+    }
+    ChordServer& front = *servers[reader_index];
+    
+    Client writer("127.0.0.1", ports[0]);
+    assert(writer.connect());
+    assert(writer.put(key, {'v', '1'}));
+    
+    // Once the key is hot the non-owner serves it from its cache
+    Client reader("127.0.0.1", ports[reader_index]);
+    assert(reader.connect());
+    for (int i = 0; i < 20; ++i) {
+        std::vector<uint8_t> value;
+        assert(reader.get(key, value));
+        assert(value == std::vector<uint8_t>({'v', '1'}));
+    }
+    ReadCache::Stats stats = front.get_read_cache_stats();
+    assert(stats.insertions == 1);
+    assert(stats.hits > 10);
+    assert(stats.entries == 1);
+    
+    // The owner revokes the lease on write: the next read sees the new value
+    assert(writer.put(key, {'v', '2'}));
+    assert(front.get_read_cache_stats().invalidations == 1);
+    std::vector<uint8_t> value;
+    assert(reader.get(key, value));
+    assert(value == std::vector<uint8_t>({'v', '2'}));
+    assert(reader.get(key, value));
+    assert(front.get_read_cache_stats().hits > stats.hits);
+    
+    assert(writer.remove(key));
+    assert(!reader.get(key, value));
+    
+    writer.disconnect();
+    reader.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_hot_key_read_cache passed" << std::endl;
+}
+
+void test_stats_opcode() {
+    std::cout << "Testing the STATS opcode..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9051, 9052, 9053};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    Client client("127.0.0.1", ports[0]);
+    assert(client.connect());
+    bool owns_some = false;
+    for (int i = 0; i < 30; ++i) {
+        std::string key = "stats_" + std::to_string(i);
+        assert(client.put(key, {'x'}));
+        std::vector<uint8_t> value;
+        assert(client.get(key, value));
+        owns_some = owns_some || expected_owner(nodes, SHA1::hash(key)) == nodes[0].endpoint();
+    }
+    assert(client.get_routing_stats().redirects > 0);
+    
+    std::string text;
+    assert(client.stats(text));
+    StatsReport::Entries entries = StatsReport::parse(text);
+    std::map<std::string, std::string> stats(entries.begin(), entries.end());
+    
+    // Every request reached some node; this one saw the first hop of all
+    // of them and redirected those it does not own
+    assert(std::stoull(stats["request.PUT.count"]) >= 1);
+    assert(std::stoull(stats["request.GET.count"]) >= 1);
+    assert(std::stoull(stats["request.PUT.bytes_in"]) > 0);
+    assert(std::stoull(stats["request.PUT.redirects"]) + std::stoull(stats["request.GET.redirects"]) > 0);
+    assert(stats.count("request.GET.p99_us") && stats.count("request.GET.max_us"));
+    assert(std::stoull(stats["server.connections.active"]) >= 1);
+    assert(std::stoull(stats["server.pool.threads"]) > 0);
+    assert(stats.count("server.pool.queue_depth"));
+    assert(stats.count("storage.entries") && stats.count("storage.allocated_bytes"));
+    assert(stats.count("chord.forwards") && stats.count("chord.lookup.p99_us"));
+    assert(stats.count("read_cache.hits") && stats.count("transfer.keys_sent"));
+    assert(stats["replication.factor"] == "3");
+    
+    // Writes this node owns were replicated synchronously: ack latency per peer
+    bool replica_latency = false;
+    for (const auto& entry : entries) {
+        if (entry.first.compare(0, 16, "replication.ack.") == 0) {
+            replica_latency = true;
+        }
+    }
+    assert(!owns_some || replica_latency);
+    
+    // The same report is available in-process
+    StatsReport local = servers[0]->get_stats();
+    assert(!local.entries().empty());
+    
+    client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_stats_opcode passed" << std::endl;
+}
+
+void test_anti_entropy_repairs_divergence() {
+    std::cout << "Testing Merkle anti-entropy..." << std::endl;
+    
+    ChordServer replica("127.0.0.1", 9061);
+    replica.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    // The owner need not listen: it only calls the replica
+    ChordNode owner("127.0.0.1", 9161);
+    Hash160 start = SHA1::hash("anti_entropy_start");
+    Hash160 end = owner.get_id();
+    
+    Client client("127.0.0.1", 9061);
+    assert(client.connect());
+    std::vector<std::string> inside;
+    std::vector<std::string> outside;
+    for (int i = 0; i < 2000; ++i) {
+        std::string key = "ae_" + std::to_string(i);
+        std::vector<uint8_t> value = {'v', static_cast<uint8_t>(i), static_cast<uint8_t>(i >> 8)};
+        if (in_range(SHA1::hash(key), start, end, true)) {
+            inside.push_back(key);
+            owner.receive_transferred_key(key, std::vector<uint8_t>(value));
+        } else {
+            outside.push_back(key);
+        }
+        assert(client.replicate(key, value));
+    }
+    assert(inside.size() > 20 && outside.size() > 20);
+    
+    // Both copies of the range agree: one round trip settles it
+    assert(owner.repair_range(*std::make_shared<NodeInfo>(replica.get_node_info()), start, end) == 0);
+    
+    // Diverge: the replica misses 5 keys, holds 3 stale values and 2 keys
+    // the owner deleted
+    for (int i = 0; i < 5; ++i) {
+        assert(client.replicate_remove(inside[i]));
+    }
+    for (int i = 5; i < 8; ++i) {
+        assert(client.replicate(inside[i], {'s', 't', 'a', 'l', 'e'}));
+    }
+    for (int i = 8; i < 10; ++i) {
+        std::vector<uint8_t> value;
+        assert(owner.retrieve_replica(inside[i], value));
+        assert(owner.remove_replica(inside[i]));
+    }
+    
+    NodeInfo target = replica.get_node_info();
+    assert(owner.repair_range(target, start, end) == 10);
+    for (size_t i = 0; i < inside.size(); ++i) {
+        std::vector<uint8_t> expected;
+        std::vector<uint8_t> value;
+        bool on_owner = owner.retrieve_replica(inside[i], expected);
+        bool on_replica = client.replica_get(inside[i], value);
+        assert(on_owner == on_replica);
+        assert(!on_owner || value == expected);
+    }
+    // Keys outside the range are none of the owner's business
+    for (const auto& key : outside) {
+        std::vector<uint8_t> value;
+        assert(client.replica_get(key, value));
+    }
+    
+    ChordNode::RepairStats stats = owner.get_repair_stats();
+    assert(stats.rounds == 2);
+    assert(stats.leaves >= 1 && stats.leaves <= 10);
+    assert(stats.keys_pushed == 8);
+    assert(stats.keys_deleted == 2);
+    assert(owner.repair_range(target, start, end) == 0);
+    
+    // A write that reached the replica before the owner's own store (a
+    // PUT still in flight there) is newer than what repair sends: it stays,
+    // whether the owner holds an older value or deleted the key before
+    uint64_t now = HybridClock::wall_ms();
+    assert(owner.store_replica(inside[10], {'o', 'l', 'd'}, now << HybridClock::LOGICAL_BITS));
+    std::vector<uint8_t> newer = {'n', 'e', 'w'};
+    uint64_t stamp = (now + 60000) << HybridClock::LOGICAL_BITS;
+    assert(client.replicate(inside[10], newer, stamp));
+    assert(client.replicate(inside[8], newer, stamp));
+    owner.repair_range(target, start, end);
+    std::vector<uint8_t> value;
+    assert(client.replica_get(inside[10], value) && value == newer);
+    assert(client.replica_get(inside[8], value) && value == newer);
+    
+    // A PUT stamped before the repair started that has reached the replica
+    // but not yet the owner's store is not taken for a deleted key
+    std::string in_flight;
+    for (int i = 0; in_flight.empty(); ++i) {
+        std::string key = "ae_in_flight_" + std::to_string(i);
+        if (in_range(SHA1::hash(key), start, end, true)) {
+            in_flight = key;
+        }
+    }
+    std::vector<uint8_t> put = {'p', 'u', 't'};
+    uint64_t put_version = HybridClock::wall_ms() << HybridClock::LOGICAL_BITS;
+    assert(client.replicate(in_flight, put, put_version));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    owner.repair_range(target, start, end);
+    assert(client.replica_get(in_flight, value) && value == put);
+    assert(owner.store_replica(in_flight, std::vector<uint8_t>(put), put_version));
+    
+    client.disconnect();
+    replica.stop();
+    std::cout << "✓ test_anti_entropy_repairs_divergence passed" << std::endl;
+}
+
+void test_virtual_nodes() {
+    std::cout << "Testing servers with several ring positions..." << std::endl;
+    
+    const size_t TOKENS = 8;
+    std::vector<uint16_t> ports = {9071, 9072, 9073};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    for (uint16_t port : ports) {
+        servers.emplace_back(new ChordServer("127.0.0.1", port));
+        servers.back()->set_tokens(TOKENS);
+        assert(servers.back()->get_token_count() == TOKENS);
+        for (size_t t = 0; t < TOKENS; ++t) {
+            nodes.push_back(NodeInfo::from_address("127.0.0.1", port, static_cast<uint16_t>(t)));
+        }
+    }
+    
+    // On its own a server's positions make up a complete ring at once
+    servers[0]->start();
+    std::vector<NodeInfo> first(nodes.begin(), nodes.begin() + TOKENS);
+    assert(wait_for_ring({ports[0]}, first));
+    Client client("127.0.0.1", ports[0]);
+    assert(client.connect());
+    for (int i = 0; i < 60; ++i) {
+        assert(client.put("vnode_" + std::to_string(i), {'v', static_cast<uint8_t>(i)}));
+    }
+    
+    for (size_t i = 1; i < servers.size(); ++i) {
+        servers[i]->start();
+        servers[i]->join_ring("127.0.0.1", ports[0]);
+    }
+    assert(wait_for_ring(ports, nodes));
+    
+    // Every server owns a share, and every key stays readable everywhere
+    std::map<uint16_t, int> owned;
+    for (int i = 0; i < 60; ++i) {
+        NodeInfo owner;
+        assert(NodeInfo::parse(expected_owner(nodes, SHA1::hash("vnode_" + std::to_string(i))), owner));
+        owned[owner.port]++;
+    }
+    assert(owned.size() == ports.size());
+    for (uint16_t port : ports) {
+        Client reader("127.0.0.1", port);
+        assert(reader.connect());
+        for (int i = 0; i < 60; ++i) {
+            std::vector<uint8_t> value;
+            assert(reader.get("vnode_" + std::to_string(i), value));
+            assert(value == std::vector<uint8_t>({'v', static_cast<uint8_t>(i)}));
+        }
+    }
+    
+    // A smart client sees every position but keeps one connection per
+    // server. Successor lists trail lookups by a few stabilize rounds.
+    assert(client.enable_smart_routing());
+    for (int attempt = 0; attempt < 20 && client.known_nodes().size() != nodes.size(); ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        assert(client.refresh_ring());
+    }
+    assert(client.known_nodes().size() == nodes.size());
+    for (int i = 0; i < 60; ++i) {
+        std::vector<uint8_t> value;
+        assert(client.get("vnode_" + std::to_string(i), value));
+    }
+    assert(client.get_routing_stats().redirects == 0);
+    client.disable_smart_routing();
+    
+    // All positions of a leaving server hand their ranges on
+    servers[2]->leave_ring();
+    servers[2]->stop();
+    std::vector<uint16_t> remaining(ports.begin(), ports.begin() + 2);
+    std::vector<NodeInfo> remaining_nodes(nodes.begin(), nodes.begin() + 2 * TOKENS);
+    assert(wait_for_ring(remaining, remaining_nodes));
+    // Until the failure detector retires the departed predecessors, the
+    // ranges they held are answered by nobody
+    bool readable = false;
+    for (int attempt = 0; attempt < 40 && !readable; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        readable = true;
+        for (int i = 0; i < 60 && readable; ++i) {
+            std::vector<uint8_t> value;
+            readable = client.get("vnode_" + std::to_string(i), value) &&
+                       value == std::vector<uint8_t>({'v', static_cast<uint8_t>(i)});
+        }
+    }
+    assert(readable);
+    
+    client.disconnect();
+    servers[0]->stop();
+    servers[1]->stop();
+    std::cout << "✓ test_virtual_nodes passed" << std::endl;
+}
+
+static uint64_t stat_of(ChordServer& server, const std::string& name) {
+    StatsReport report = server.get_stats();
+    for (const auto& entry : report.entries()) {
+        if (entry.first == name) {
+            return std::stoull(entry.second);
+        }
+    }
+    return 0;
+}
+
+void test_read_consistency() {
+    std::cout << "Testing replica reads and quorum reads..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9081, 9082, 9083};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    const std::string key = "consistency_key";
+    const std::vector<uint8_t> fresh = {'f', 'r', 'e', 's', 'h'};
+    size_t owner = 0;
+    while (nodes[owner].endpoint() != expected_owner(nodes, SHA1::hash(key))) {
+        owner++;
+    }
+    size_t replica = (owner + 1) % ports.size();
+    
+    // Successor lists trail lookups: write until every server holds a copy
+    Client client("127.0.0.1", ports[replica]);
+    assert(client.connect());
+    bool replicated = false;
+    for (int attempt = 0; attempt < 20 && !replicated; ++attempt) {
+        assert(client.put(key, fresh));
+        replicated = true;
+        for (uint16_t port : ports) {
+            Client peer("127.0.0.1", port);
+            std::vector<uint8_t> value;
+            replicated = replicated && peer.connect() && peer.replica_get(key, value) && value == fresh;
+        }
+        if (!replicated) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+    }
+    assert(replicated);
+    
+    // A replica serves ANY reads from its own copy, stale or not
+    assert(client.replicate(key, {'o', 'l', 'd'}));
+    std::vector<uint8_t> value;
+    assert(client.get(key, value) && value == fresh);
+    uint64_t redirects = client.get_routing_stats().redirects;
+    client.set_read_consistency(ReadConsistency::ANY);
+    assert(client.get(key, value) && value == std::vector<uint8_t>({'o', 'l', 'd'}));
+    assert(client.get_routing_stats().redirects == redirects);
+    assert(stat_of(*servers[replica], "read.replica_served") == 1);
+    
+    // A quorum read goes to the owner, which finds and repairs the stale copy
+    client.set_read_consistency(ReadConsistency::QUORUM);
+    assert(client.get(key, value) && value == fresh);
+    assert(stat_of(*servers[owner], "read.quorum") == 1);
+    assert(stat_of(*servers[owner], "read.stale_replicas") == 1);
+    assert(stat_of(*servers[owner], "read.quorum_failures") == 0);
+    assert(client.replica_get(key, value) && value == fresh);
+    assert(!client.get("consistency_missing", value));
+    
+    // Smart clients spread ANY reads over each key's copies
+    for (int i = 0; i < 30; ++i) {
+        assert(client.put("spread_" + std::to_string(i), {'s', static_cast<uint8_t>(i)}));
+    }
+    assert(client.enable_smart_routing());
+    client.set_read_consistency(ReadConsistency::ANY);
+    for (int i = 0; i < 30; ++i) {
+        assert(client.get("spread_" + std::to_string(i), value));
+        assert(value == std::vector<uint8_t>({'s', static_cast<uint8_t>(i)}));
+    }
+    assert(client.get_routing_stats().replica_reads > 0);
+    
+    // An unknown consistency byte is refused
+    Response response;
+    assert(client.call(Request(OpCode::GET, {'k'}, {9}), response));
+    assert(response.status == StatusCode::ERROR);
+    
+    client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_read_consistency passed" << std::endl;
+}
+
+void test_versioned_writes() {
+    std::cout << "Testing versioned writes and CAS..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9091, 9092, 9093};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    const std::string key = "versioned_key";
+    size_t owner = 0;
+    while (nodes[owner].endpoint() != expected_owner(nodes, SHA1::hash(key))) {
+        owner++;
+    }
+    size_t replica = (owner + 1) % ports.size();
+    
+    // CAS through a node that does not own the key is redirected to the
+    // owner, which decides it
+    Client client("127.0.0.1", ports[replica]);
+    assert(client.connect());
+    uint64_t version = 0;
+    assert(client.compare_and_put(key, {'a'}, 0, version) == StatusCode::SUCCESS);
+    uint64_t created = version;
+    assert(created != 0);
+    assert(client.compare_and_put(key, {'b'}, 0, version) == StatusCode::VERSION_MISMATCH);
+    assert(version == created);
+    assert(client.compare_and_put(key, {'b'}, created, version) == StatusCode::SUCCESS);
+    uint64_t updated = version;
+    assert(updated > created);
+    
+    std::vector<uint8_t> value;
+    uint64_t read_version = 0;
+    assert(client.get(key, value, read_version));
+    assert(value == std::vector<uint8_t>{'b'} && read_version == updated);
+    
+    // A plain PUT moves the version on too
+    assert(client.put(key, {'c'}));
+    assert(client.get(key, value, read_version) && read_version > updated);
+    uint64_t latest = read_version;
+    
+    // Replicas keep the newest write whatever order writes reach them in:
+    // a late, older copy and a late, older delete are both ignored
+    Client peer("127.0.0.1", ports[replica]);
+    assert(peer.connect());
+    bool replicated = false;
+    for (int attempt = 0; attempt < 20 && !replicated; ++attempt) {
+        replicated = peer.replica_get(key, value) && value == std::vector<uint8_t>{'c'};
+        if (!replicated) {
+            assert(client.put(key, {'c'}));
+            assert(client.get(key, value, latest));
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+    }
+    assert(replicated);
+    assert(peer.replicate(key, {'o', 'l', 'd'}, latest - 1));
+    assert(peer.replicate_remove(key, latest - 1));
+    assert(peer.replica_get(key, value) && value == std::vector<uint8_t>{'c'});
+    assert(peer.replicate(key, {'n', 'e', 'w'}, latest + 1));
+    assert(peer.replica_get(key, value) && value == std::vector<uint8_t>({'n', 'e', 'w'}));
+    
+    assert(!client.get("versioned_missing", value, read_version));
+    
+    // A CAS the replicas cannot take answers ERROR and leaves the owner's
+    // copy as it was
+    peer.disconnect();
+    client.disconnect();
+    Client at_owner("127.0.0.1", ports[owner]);
+    assert(at_owner.connect());
+    assert(at_owner.get(key, value, latest));
+    servers[replica]->stop();
+    assert(at_owner.compare_and_put(key, {'d'}, latest, version) == StatusCode::ERROR);
+    assert(at_owner.get(key, value, read_version));
+    assert(value == std::vector<uint8_t>{'c'} && read_version == latest);
+    at_owner.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_versioned_writes passed" << std::endl;
+}
+
+void test_compressed_values() {
+    std::cout << "Testing compressed values..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9094, 9095, 9096};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    for (auto& server : servers) {
+        server->set_compression(1024);
+    }
+    
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "{\"order\":" + std::to_string(i) + ",\"state\":\"shipped\"}";
+    }
+    const std::vector<uint8_t> large(text.begin(), text.end());
+    const std::string key = "compressed_key";
+    size_t owner = 0;
+    while (nodes[owner].endpoint() != expected_owner(nodes, SHA1::hash(key))) {
+        owner++;
+    }
+    size_t replica = (owner + 1) % ports.size();
+    
+    // A plain client's value is compressed by the node it reaches, and
+    // its copies are the same bytes: quorum reads find nothing stale
+    Client client("127.0.0.1", ports[replica]);
+    assert(client.connect());
+    bool replicated = false;
+    std::vector<uint8_t> value;
+    for (int attempt = 0; attempt < 20 && !replicated; ++attempt) {
+        assert(client.put(key, large));
+        Client peer("127.0.0.1", ports[replica]);
+        replicated = peer.connect() && peer.replica_get(key, value) && value == large;
+        if (!replicated) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+    }
+    assert(replicated);
+    assert(stat_of(*servers[owner], "storage.compressed_value_bytes") > 0);
+    assert(stat_of(*servers[owner], "storage.compressed_value_bytes") < large.size());
+    assert(client.get(key, value) && value == large);
+    client.set_read_consistency(ReadConsistency::QUORUM);
+    assert(client.get(key, value) && value == large);
+    assert(stat_of(*servers[owner], "read.stale_replicas") == 0);
+    client.set_read_consistency(ReadConsistency::PRIMARY);
+    
+    // A GET that accepts the compressed form gets it from the owner
+    Client direct("127.0.0.1", ports[owner]);
+    assert(direct.connect());
+    Request request(OpCode::GET, std::vector<uint8_t>(key.begin(), key.end()));
+    request.compressed = true;
+    Response response;
+    assert(direct.call(request, response) && response.status == StatusCode::SUCCESS);
+    assert(response.compressed && response.value.size() < large.size());
+    std::vector<uint8_t> raw;
+    assert(Compression::decompress(response.value, raw) && raw == large);
+    
+    // A compressing client sends compressed PUTs and CAS writes, and reads
+    // and versioned reads come back decoded
+    client.set_compression(1024);
+    assert(client.put(key, large));
+    uint64_t version = 0;
+    assert(client.get(key, value, version) && value == large);
+    std::vector<uint8_t> updated = large;
+    updated[0] = '[';
+    assert(client.compare_and_put(key, updated, version, version) == StatusCode::SUCCESS);
+    assert(client.get(key, value) && value == updated);
+    
+    // Compressed bytes that do not decode are refused
+    Request bogus(OpCode::PUT, std::vector<uint8_t>(key.begin(), key.end()), {0, 0, 0, 9, 0xF0});
+    bogus.compressed = true;
+    assert(direct.call(bogus, response) && response.status == StatusCode::ERROR);
+    assert(client.get(key, value) && value == updated);
+    
+    direct.disconnect();
+    client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_compressed_values passed" << std::endl;
+}
+
+void test_expiring_keys() {
+    std::cout << "Testing expiring keys..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9097, 9098, 9099};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    const std::string key = "expiring_key";
+    size_t owner = 0;
+    while (nodes[owner].endpoint() != expected_owner(nodes, SHA1::hash(key))) {
+        owner++;
+    }
+    size_t replica = (owner + 1) % ports.size();
+    
+    // A TTL put sent to any node is stored by the owner with its expiry,
+    // and the replicas get the same expiry with their copies
+    Client client("127.0.0.1", ports[replica]);
+    assert(client.connect());
+    const std::vector<uint8_t> value = {'t', 't', 'l'};
+    std::vector<uint8_t> read;
+    bool replicated = false;
+    for (int attempt = 0; attempt < 20 && !replicated; ++attempt) {
+        assert(client.put_with_ttl(key, value, 1500));
+        Client peer("127.0.0.1", ports[replica]);
+        replicated = peer.connect() && peer.replica_get(key, read) && read == value;
+        if (!replicated) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    assert(replicated);
+    assert(client.get(key, read) && read == value);
+    
+    // Every copy lapses on its own, without any delete being sent
+    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+    assert(!client.get(key, read));
+    for (size_t i = 0; i < ports.size(); ++i) {
+        Client peer("127.0.0.1", ports[i]);
+        assert(peer.connect() && !peer.replica_get(key, read));
+        assert(stat_of(*servers[i], "storage.expired_keys") <= 1);
+    }
+    assert(stat_of(*servers[owner], "storage.expired_keys") == 1);
+    assert(stat_of(*servers[replica], "storage.expired_keys") == 1);
+    
+    // A plain put of the key afterwards does not expire
+    assert(client.put(key, value));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    assert(client.get(key, read) && read == value);
+    
+    // A TTL of 0 is refused rather than expiring the key at once, and a
+    // huge one is capped instead of wrapping to a time in the past
+    assert(!client.put_with_ttl(key, {'z'}, 0));
+    assert(client.get(key, read) && read == value);
+    assert(client.put_with_ttl(key, {'h'}, UINT64_MAX));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    assert(client.get(key, read) && read == std::vector<uint8_t>{'h'});
+    
+    client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_expiring_keys passed" << std::endl;
+}
+
+void test_ring_scan() {
+    std::cout << "Testing ring scan..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9111, 9112, 9113};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    Client client("127.0.0.1", ports[0]);
+    assert(client.connect());
+    std::set<std::string> keys;
+    for (int i = 0; i < 200; ++i) {
+        std::string key = (i % 4 == 0 ? "scan:a:" : "scan:b:") + std::to_string(i);
+        assert(client.put(key, std::vector<uint8_t>(key.begin(), key.end())));
+        keys.insert(key);
+    }
+    
+    // Small chunks cross every node's range; each key comes back once,
+    // with its value, whichever node the scan starts at
+    for (uint16_t port : ports) {
+        Client scanner("127.0.0.1", port);
+        assert(scanner.connect());
+        std::set<std::string> seen;
+        std::vector<uint8_t> cursor;
+        do {
+            std::vector<BatchEntry> entries;
+            assert(scanner.scan("", cursor, entries, 7));
+            for (const auto& entry : entries) {
+                assert(std::string(entry.value.begin(), entry.value.end()) == entry.key);
+                assert(seen.insert(entry.key).second);
+            }
+        } while (!cursor.empty());
+        assert(seen == keys);
+    }
+    
+    // Prefix filter
+    size_t matched = 0;
+    std::vector<uint8_t> cursor;
+    do {
+        std::vector<BatchEntry> entries;
+        assert(client.scan("scan:a:", cursor, entries));
+        for (const auto& entry : entries) {
+            assert(entry.key.compare(0, 7, "scan:a:") == 0);
+        }
+        matched += entries.size();
+    } while (!cursor.empty());
+    assert(matched == 50);
+    
+    // A local scan stays on the server, replicas included
+    std::set<std::string> local;
+    do {
+        std::vector<BatchEntry> entries;
+        assert(client.scan("", cursor, entries, 0, true));
+        for (const auto& entry : entries) {
+            assert(keys.count(entry.key) == 1 && local.insert(entry.key).second);
+        }
+    } while (!cursor.empty());
+    assert(!local.empty());
+    
+    client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_ring_scan passed" << std::endl;
+}
+
+void test_fast_join() {
+    std::cout << "Testing fast join..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9120, 9121, 9122, 9123};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    // The ring's answer for every finger of the newcomer, which the others
+    // do not know about yet
+    const uint16_t port = 9124;
+    NodeInfo joining = NodeInfo::from_address("127.0.0.1", port);
+    std::set<std::string> fingers;
+    for (int i = 0; i < FingerTable::SIZE; ++i) {
+        fingers.insert(expected_owner(nodes, add_power_of_two(joining.id, i)));
+    }
+    
+    // Bootstrapped from its successor and refreshed in parallel, the
+    // finger table is complete as soon as join returns
+    servers.emplace_back(new ChordServer("127.0.0.1", port));
+    servers.back()->start();
+    auto started = std::chrono::steady_clock::now();
+    servers.back()->join_ring("127.0.0.1", ports[0]);
+    assert(stat_of(*servers.back(), "chord.fingers") == fingers.size());
+    
+    // Stabilization runs fast while the ring settles, so the whole ring
+    // agrees on the newcomer within a few seconds
+    ports.push_back(port);
+    nodes.push_back(joining);
+    assert(wait_for_ring(ports, nodes));
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    std::cout << "  ring converged " << elapsed << " ms after the join" << std::endl;
+    
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_fast_join passed" << std::endl;
+}
+
+void test_forwarded_batch_is_not_forwarded_again() {
+    std::cout << "Testing forwarded batches..." << std::endl;
+    
+    std::vector<uint16_t> ports = {9125, 9126};
+    std::vector<std::unique_ptr<ChordServer>> servers;
+    std::vector<NodeInfo> nodes;
+    assert(start_ring(ports, servers, nodes));
+    
+    Client client("127.0.0.1", ports[0]);
+    assert(client.connect());
+    std::vector<BatchEntry> entries;
+    for (int i = 0; i < 40; ++i) {
+        entries.emplace_back("fwd_" + std::to_string(i), std::vector<uint8_t>{'f', static_cast<uint8_t>(i)});
+    }
+    std::vector<BatchResult> results;
+    assert(client.multi_put(entries, results));
+    for (const auto& result : results) {
+        assert(result.status == StatusCode::SUCCESS);
+    }
+    
+    // Sent as a coordinator's sub-batch, the second node serves its own
+    // keys and names the owner of the others instead of forwarding them
+    std::vector<BatchEntry> keys;
+    for (const auto& entry : entries) {
+        keys.emplace_back(entry.key);
+    }
+    Request request(OpCode::MULTI_GET, {Protocol::BATCH_FORWARDED}, Protocol::encodeBatch(keys));
+    AsyncRpc::Result reply = AsyncRpc::instance().submit("127.0.0.1", ports[1], request).get();
+    assert(reply.ok && reply.response.status == StatusCode::SUCCESS);
+    assert(Protocol::decodeBatchResults(reply.response.value.data(), reply.response.value.size(),
+                                        results));
+    assert(results.size() == entries.size());
+    size_t redirected = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        std::string owner = expected_owner(nodes, SHA1::hash(entries[i].key));
+        if (owner == nodes[1].endpoint()) {
+            assert(results[i].status == StatusCode::SUCCESS);
+            assert(results[i].value == entries[i].value);
+        } else {
+            assert(results[i].status == StatusCode::REDIRECT);
+            assert(std::string(results[i].value.begin(), results[i].value.end()) == owner);
+            redirected++;
+        }
+    }
+    assert(redirected > 0 && redirected < entries.size());
+    
+    client.disconnect();
+    for (auto& server : servers) {
+        server->stop();
+    }
+    std::cout << "✓ test_forwarded_batch_is_not_forwarded_again passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running Chord integration tests..." << std::endl;
     std::cout << "(Note: Multi-node network tests are simplified in Phase 2)" << std::endl;
@@ -222,6 +1337,22 @@ int main() {
     test_chord_hash_consistency();
     test_chord_server_lifecycle();
     test_chord_ring_operations();
+    test_chord_batch_operations();
+    test_streamed_key_transfer();
+    test_key_transfer_resumes_from_checkpoint();
+    test_multi_node_lookup();
+    test_smart_client_routing();
+    test_hot_key_read_cache();
+    test_stats_opcode();
+    test_anti_entropy_repairs_divergence();
+    test_virtual_nodes();
+    test_read_consistency();
+    test_versioned_writes();
+    test_compressed_values();
+    test_expiring_keys();
+    test_ring_scan();
+    test_fast_join();
+    test_forwarded_batch_is_not_forwarded_again();
     
     std::cout << std::endl;
     std::cout << "All Chord integration tests passed!" << std::endl;
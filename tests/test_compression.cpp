@@ -0,0 +1,116 @@
+#include "../include/compression.h"
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace funnelkvs;
+
+static std::vector<uint8_t> bytes_of(const std::string& text) {
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static void assert_round_trip(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> packed;
+    if (!Compression::compress(data, packed)) {
+        return;
+    }
+    assert(packed.size() < data.size());
+    assert(Compression::raw_size(packed.data(), packed.size()) == data.size());
+    std::vector<uint8_t> unpacked;
+    assert(Compression::decompress(packed, unpacked));
+    assert(unpacked == data);
+}
+
+void test_round_trip() {
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "{\"user\":" + std::to_string(i) + ",\"name\":\"funnel\",\"tags\":[\"kv\",\"dht\"]}";
+    }
+    std::vector<uint8_t> json = bytes_of(text);
+    std::vector<uint8_t> packed;
+    assert(Compression::compress(json, packed));
+    assert(packed.size() * 4 < json.size());
+    assert_round_trip(json);
+
+    // Runs longer than any length nibble, overlapping matches, and sizes
+    // around the point where the last literals begin
+    assert_round_trip(std::vector<uint8_t>(100000, 'a'));
+    std::vector<uint8_t> pattern;
+    for (int i = 0; i < 70000; ++i) {
+        pattern.push_back(static_cast<uint8_t>("abc"[i % 3]));
+    }
+    assert_round_trip(pattern);
+    for (size_t size = 0; size < 64; ++size) {
+        assert_round_trip(std::vector<uint8_t>(size, 'z'));
+    }
+
+    // Matches further back than the 64 KB window are not used
+    std::mt19937 rng(7);
+    std::vector<uint8_t> far;
+    for (int i = 0; i < 81000; ++i) {
+        far.push_back(i < 80000 ? static_cast<uint8_t>(rng()) : far[i - 80000]);
+    }
+    assert_round_trip(far);
+
+    std::cout << "✓ test_round_trip passed" << std::endl;
+}
+
+void test_incompressible() {
+    std::mt19937 rng(42);
+    std::vector<uint8_t> noise(4096);
+    for (auto& byte : noise) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    std::vector<uint8_t> packed;
+    assert(!Compression::compress(noise, packed));
+    assert(!Compression::compress(bytes_of("short"), packed));
+
+    std::cout << "✓ test_incompressible passed" << std::endl;
+}
+
+void test_rejects_malformed() {
+    std::vector<uint8_t> data = bytes_of(std::string(500, 'q') + "tail" + std::string(500, 'r'));
+    std::vector<uint8_t> packed;
+    assert(Compression::compress(data, packed));
+    std::vector<uint8_t> out;
+
+    // Truncated anywhere, or claiming a different size, fails cleanly
+    for (size_t cut = 0; cut < packed.size(); ++cut) {
+        assert(!Compression::decompress(packed.data(), cut, out));
+    }
+    std::vector<uint8_t> resized = packed;
+    resized[3] ^= 1;
+    assert(!Compression::decompress(resized, out));
+    resized = packed;
+    resized[0] = 0xFF;
+    assert(!Compression::decompress(resized, out));
+
+    // Random corruption never reads or writes out of bounds
+    std::mt19937 rng(3);
+    for (int i = 0; i < 2000; ++i) {
+        std::vector<uint8_t> corrupt = packed;
+        corrupt[Compression::HEADER_SIZE + rng() % (corrupt.size() - Compression::HEADER_SIZE)] =
+            static_cast<uint8_t>(rng());
+        if (Compression::decompress(corrupt, out)) {
+            assert(out.size() == data.size());
+        }
+    }
+
+    std::cout << "✓ test_rejects_malformed passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running compression tests..." << std::endl;
+    std::cout << std::endl;
+
+    test_round_trip();
+    test_incompressible();
+    test_rejects_malformed();
+
+    std::cout << std::endl;
+    std::cout << "All compression tests passed!" << std::endl;
+    return 0;
+}
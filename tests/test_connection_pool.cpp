@@ -0,0 +1,140 @@
+#include "../include/connection_pool.h"
+#include "../include/server.h"
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <chrono>
+
+using namespace funnelkvs;
+
+void test_connection_reuse() {
+    Server server(8101, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ConnectionPool pool;
+    {
+        ConnectionPool::Lease lease = pool.acquire("127.0.0.1", 8101);
+        assert(lease);
+        assert(!lease.was_reused());
+        assert(lease->ping());
+    }
+    assert(pool.idle_connections("127.0.0.1", 8101) == 1);
+
+    {
+        ConnectionPool::Lease lease = pool.acquire("127.0.0.1", 8101);
+        assert(lease);
+        assert(lease.was_reused());
+        assert(lease->put("pooled", {'v'}));
+    }
+
+    ConnectionPool::PoolStats stats = pool.get_stats();
+    assert(stats.connects == 1);
+    assert(stats.reuses == 1);
+    assert(stats.leased == 0);
+
+    server.stop();
+    std::cout << "✓ test_connection_reuse passed" << std::endl;
+}
+
+void test_dead_connection_is_redialed() {
+    ConnectionPool pool;
+    {
+        Server server(8102, 2);
+        server.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        assert(pool.call("127.0.0.1", 8102, [](Client& c) { return c.ping(); }));
+        server.stop();
+    }
+    assert(pool.idle_connections("127.0.0.1", 8102) == 1);
+
+    // The pooled connection now points at a closed server socket
+    Server restarted(8102, 2);
+    restarted.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    assert(pool.call("127.0.0.1", 8102, [](Client& c) { return c.ping(); }));
+    assert(pool.get_stats().connects == 2);
+
+    restarted.stop();
+    std::cout << "✓ test_dead_connection_is_redialed passed" << std::endl;
+}
+
+void test_idle_cap_and_eviction() {
+    Server server(8103, 4);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ConnectionPool::PoolConfig config;
+    config.max_idle_per_peer = 2;
+    config.idle_timeout = std::chrono::milliseconds(200);
+    ConnectionPool pool(config);
+
+    {
+        std::vector<ConnectionPool::Lease> leases;
+        for (int i = 0; i < 4; ++i) {
+            leases.push_back(pool.acquire("127.0.0.1", 8103));
+            assert(leases.back());
+        }
+        assert(pool.get_stats().leased == 4);
+    }
+    // Only max_idle_per_peer survive being returned
+    assert(pool.idle_connections("127.0.0.1", 8103) == 2);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    pool.evict_idle();
+    assert(pool.idle_connections("127.0.0.1", 8103) == 0);
+
+    server.stop();
+    std::cout << "✓ test_idle_cap_and_eviction passed" << std::endl;
+}
+
+void test_per_peer_cap() {
+    Server server(8104, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ConnectionPool::PoolConfig config;
+    config.max_connections_per_peer = 2;
+    config.acquire_timeout = std::chrono::milliseconds(100);
+    ConnectionPool pool(config);
+
+    ConnectionPool::Lease first = pool.acquire("127.0.0.1", 8104);
+    ConnectionPool::Lease second = pool.acquire("127.0.0.1", 8104);
+    assert(first && second);
+
+    // A third concurrent lease is refused once the wait times out
+    assert(!pool.acquire("127.0.0.1", 8104));
+
+    first.release();
+    ConnectionPool::Lease third = pool.acquire("127.0.0.1", 8104);
+    assert(third);
+    assert(third.was_reused());
+
+    third.release();
+    second.release();
+    server.stop();
+    std::cout << "✓ test_per_peer_cap passed" << std::endl;
+}
+
+void test_unreachable_peer() {
+    ConnectionPool pool;
+    assert(!pool.acquire("127.0.0.1", 8199));
+    assert(!pool.call("127.0.0.1", 8199, [](Client& c) { return c.ping(); }));
+    assert(pool.get_stats().leased == 0);
+
+    std::cout << "✓ test_unreachable_peer passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running connection pool tests..." << std::endl;
+
+    test_connection_reuse();
+    test_dead_connection_is_redialed();
+    test_idle_cap_and_eviction();
+    test_per_peer_cap();
+    test_unreachable_peer();
+
+    std::cout << "\nAll connection pool tests passed!" << std::endl;
+    return 0;
+}
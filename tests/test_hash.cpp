@@ -45,6 +45,32 @@ void test_sha1_long_string() {
     std::cout << "✓ test_sha1_long_string passed" << std::endl;
 }
 
+void test_sha1_implementations_agree() {
+    // Standard vectors, including a message that pads into a second block
+    // and one spanning many blocks, on every available implementation
+    const std::string two_block = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    const std::string million(1000000, 'a');
+    const bool hardware = SHA1::use_hardware(true);
+    for (int pass = 0; pass < (hardware ? 2 : 1); ++pass) {
+        SHA1::use_hardware(pass == 0);
+        assert(SHA1::to_string(SHA1::hash("abc")) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+        assert(SHA1::to_string(SHA1::hash(two_block)) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+        assert(SHA1::to_string(SHA1::hash(million)) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    }
+    
+    // Every length across the padding boundaries gives the same digest
+    std::vector<uint8_t> data;
+    for (int len = 0; len <= 200; ++len) {
+        SHA1::use_hardware(false);
+        Hash160 portable = SHA1::hash(data);
+        SHA1::use_hardware(true);
+        assert(SHA1::hash(data) == portable);
+        data.push_back(static_cast<uint8_t>(len * 7 + 1));
+    }
+    
+    std::cout << "✓ test_sha1_implementations_agree passed (" << SHA1::implementation() << ")" << std::endl;
+}
+
 void test_hash_string_conversion() {
     Hash160 original = SHA1::hash("test");
     std::string hex_str = SHA1::to_string(original);
@@ -153,8 +179,14 @@ void test_distance_calculation() {
     to_wrap[19] = 50;
     
     Hash160 dist_wrap = distance(from_wrap, to_wrap);
-    // Distance should be (256 - 200) + 50 = 106 in the last byte
-    // But this is a simplified test - actual implementation may vary
+    // Distance is 2^160 - 200 + 50: 106 in the last byte, all ones above
+    assert(dist_wrap[19] == 106);
+    for (int i = 0; i < 19; ++i) {
+        assert(dist_wrap[i] == 0xFF);
+    }
+    
+    // Going from a point to itself covers no distance
+    assert(distance(from, from) == Hash160());
     
     std::cout << "✓ test_distance_calculation passed" << std::endl;
 }
@@ -170,7 +202,9 @@ void test_edge_cases() {
     
     // Test maximum value operations
     Hash160 result = add_power_of_two(max, 0);
-    // Adding to max should wrap around (implementation dependent)
+    // Adding to max wraps around the ring
+    assert(result == zero);
+    assert(add_power_of_two(max, 159)[0] == 0x7F);
     
     std::cout << "✓ test_edge_cases passed" << std::endl;
 }
@@ -192,12 +226,78 @@ void test_hash_distribution() {
     std::cout << "✓ test_hash_distribution passed" << std::endl;
 }
 
+void test_word_boundaries() {
+    // Carries cross the 32- and 64-bit words ids are processed in
+    Hash160 low_full = {};
+    std::memset(low_full.data() + 16, 0xFF, 4);
+    Hash160 carried = add_power_of_two(low_full, 0);
+    assert(carried[15] == 1);
+    for (int i = 16; i < 20; ++i) {
+        assert(carried[i] == 0);
+    }
+    
+    Hash160 mid_full = {};
+    std::memset(mid_full.data() + 8, 0xFF, 8);
+    carried = add_power_of_two(mid_full, 32);
+    assert(carried[7] == 1);
+    assert(carried[8] == 0 && carried[15] == 0);
+    
+    assert(add_power_of_two(Hash160(), 31)[16] == 0x80);
+    assert(add_power_of_two(Hash160(), 32)[15] == 0x01);
+    assert(add_power_of_two(Hash160(), 95)[8] == 0x80);
+    assert(add_power_of_two(Hash160(), 96)[7] == 0x01);
+    
+    // Ordering is decided by the most significant differing byte
+    Hash160 a = {};
+    Hash160 b = {};
+    a[7] = 1;   // end of the first word
+    b[19] = 0xFF;
+    assert(b < a && a > b && b <= a && a >= b && a != b);
+    b[7] = 1;
+    assert(a < b);
+    a[16] = 1;  // start of the last word
+    assert(b < a);
+    
+    // Borrows across words in distance
+    Hash160 one = add_power_of_two(Hash160(), 0);
+    Hash160 word_base = add_power_of_two(Hash160(), 64);
+    Hash160 below = distance(one, word_base); // 2^64 - 1
+    for (int i = 0; i < 20; ++i) {
+        assert(below[i] == (i >= 12 ? 0xFF : 0x00));
+    }
+    
+    std::cout << "✓ test_word_boundaries passed" << std::endl;
+}
+
+void test_ring_arithmetic_consistency() {
+    // in_range agrees with clockwise distances and add/distance invert
+    for (int i = 0; i < 200; ++i) {
+        Hash160 start = SHA1::hash("start_" + std::to_string(i));
+        Hash160 end = SHA1::hash("end_" + std::to_string(i));
+        Hash160 id = SHA1::hash("id_" + std::to_string(i));
+        
+        Hash160 to_id = distance(start, id);
+        Hash160 to_end = distance(start, end);
+        bool expected = to_id != Hash160() && to_id <= to_end;
+        assert(in_range(id, start, end, true) == expected);
+        assert(in_range(id, start, end, false) == (expected && id != end));
+        
+        int power = i % 160;
+        Hash160 stepped = add_power_of_two(start, power);
+        Hash160 step = distance(start, stepped);
+        assert(step == add_power_of_two(Hash160(), power));
+    }
+    
+    std::cout << "✓ test_ring_arithmetic_consistency passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running hash utility tests..." << std::endl;
     
     test_sha1_basic();
     test_sha1_empty_string();
     test_sha1_long_string();
+    test_sha1_implementations_agree();
     test_hash_string_conversion();
     test_hash_comparisons();
     test_add_power_of_two();
@@ -205,6 +305,8 @@ int main() {
     test_in_range_wraparound();
     test_distance_calculation();
     test_edge_cases();
+    test_word_boundaries();
+    test_ring_arithmetic_consistency();
     test_hash_distribution();
     
     std::cout << "\nAll hash utility tests passed!" << std::endl;
@@ -0,0 +1,89 @@
+#include "../include/histogram.h"
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+using namespace funnelkvs;
+
+void test_bucket_boundaries() {
+    assert(Histogram::bucket_for(0) == 0);
+    assert(Histogram::bucket_for(1) == 1);
+    assert(Histogram::bucket_for(2) == 2);
+    assert(Histogram::bucket_for(3) == 2);
+    assert(Histogram::bucket_for(4) == 3);
+    assert(Histogram::bucket_for(1023) == 10);
+    assert(Histogram::bucket_for(1024) == 11);
+    assert(Histogram::bucket_for(UINT64_MAX) == 64);
+    
+    for (size_t b = 1; b < 64; ++b) {
+        assert(Histogram::bucket_for(Histogram::bucket_upper_bound(b)) == b);
+        assert(Histogram::bucket_for(Histogram::bucket_upper_bound(b) + 1) == b + 1);
+    }
+    
+    std::cout << "✓ test_bucket_boundaries passed" << std::endl;
+}
+
+void test_snapshot_and_percentiles() {
+    Histogram histogram;
+    Histogram::Snapshot empty = histogram.snapshot();
+    assert(empty.count == 0 && empty.percentile(0.5) == 0);
+    
+    // 90 fast samples, 10 slow ones
+    for (int i = 0; i < 90; ++i) {
+        histogram.record(100);
+    }
+    for (int i = 0; i < 10; ++i) {
+        histogram.record(5000);
+    }
+    
+    Histogram::Snapshot snap = histogram.snapshot();
+    assert(snap.count == 100);
+    assert(snap.sum == 90 * 100 + 10 * 5000);
+    assert(snap.max == 5000);
+    assert(snap.mean() == 590.0);
+    
+    // Percentiles report the bucket's upper bound, capped at the max
+    assert(snap.percentile(0.5) == 127);
+    assert(snap.percentile(0.9) == 127);
+    assert(snap.percentile(0.99) == 5000);
+    assert(snap.percentile(1.0) == 5000);
+    
+    histogram.reset();
+    assert(histogram.snapshot().count == 0);
+    assert(histogram.snapshot().max == 0);
+    
+    std::cout << "✓ test_snapshot_and_percentiles passed" << std::endl;
+}
+
+void test_concurrent_recording() {
+    Histogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram, t]() {
+            for (int i = 0; i < 10000; ++i) {
+                histogram.record(static_cast<uint64_t>(t * 10000 + i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    Histogram::Snapshot snap = histogram.snapshot();
+    assert(snap.count == 40000);
+    assert(snap.max == 39999);
+    
+    std::cout << "✓ test_concurrent_recording passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running histogram tests..." << std::endl;
+    
+    test_bucket_boundaries();
+    test_snapshot_and_percentiles();
+    test_concurrent_recording();
+    
+    std::cout << "\nAll histogram tests passed!" << std::endl;
+    return 0;
+}
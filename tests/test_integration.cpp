@@ -4,6 +4,12 @@
 #include <cassert>
 #include <thread>
 #include <chrono>
+#include <memory>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 using namespace funnelkvs;
 
@@ -181,6 +187,226 @@ void test_reconnect() {
     std::cout << "✓ test_reconnect passed" << std::endl;
 }
 
+void test_idle_connections_do_not_starve_workers() {
+    // Far more open connections than worker threads
+    Server server(8007, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    std::vector<std::unique_ptr<Client>> idle_clients;
+    for (int i = 0; i < 50; ++i) {
+        std::unique_ptr<Client> idle(new Client("127.0.0.1", 8007));
+        assert(idle->connect());
+        assert(idle->ping());
+        idle_clients.push_back(std::move(idle));
+    }
+    
+    Client active("127.0.0.1", 8007);
+    assert(active.connect());
+    std::vector<uint8_t> value = {'o', 'k'};
+    assert(active.put("busy_key", value));
+    
+    std::vector<uint8_t> retrieved;
+    assert(active.get("busy_key", retrieved));
+    assert(retrieved == value);
+    assert(server.active_connections() == 51);
+    
+    // Idle connections remain usable afterwards
+    assert(idle_clients.front()->get("busy_key", retrieved));
+    assert(idle_clients.back()->ping());
+    
+    idle_clients.clear();
+    active.disconnect();
+    server.stop();
+    
+    std::cout << "✓ test_idle_connections_do_not_starve_workers passed" << std::endl;
+}
+
+void test_multiple_event_loops() {
+    Server server(8008, 4, 4);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t]() {
+            Client client("127.0.0.1", 8008);
+            assert(client.connect());
+            for (int i = 0; i < 20; ++i) {
+                std::string key = "loop" + std::to_string(t) + "_" + std::to_string(i);
+                std::vector<uint8_t> value = {static_cast<uint8_t>(t), static_cast<uint8_t>(i)};
+                assert(client.put(key, value));
+                std::vector<uint8_t> retrieved;
+                assert(client.get(key, retrieved));
+                assert(retrieved == value);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    server.stop();
+    
+    std::cout << "✓ test_multiple_event_loops passed" << std::endl;
+}
+
+void test_pipelined_requests() {
+    Server server(8009, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    Client client("127.0.0.1", 8009);
+    assert(client.connect());
+    
+    const int count = 2000;
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> entries;
+    for (int i = 0; i < count; ++i) {
+        entries.emplace_back("pipe" + std::to_string(i),
+                             std::vector<uint8_t>(i % 64 + 1, static_cast<uint8_t>(i)));
+    }
+    assert(client.put_many(entries, 256) == static_cast<size_t>(count));
+    
+    // Mixed burst: responses come back in request order
+    std::vector<Request> requests;
+    for (int i = 0; i < count; ++i) {
+        std::string key = "pipe" + std::to_string(i);
+        requests.emplace_back(OpCode::GET, std::vector<uint8_t>(key.begin(), key.end()));
+    }
+    requests.emplace_back(OpCode::GET, std::vector<uint8_t>({'n', 'o', 'n', 'e'}));
+    requests.emplace_back(OpCode::PING, std::vector<uint8_t>());
+    
+    std::vector<Response> responses;
+    assert(client.pipeline(requests, responses, 64));
+    assert(responses.size() == requests.size());
+    for (int i = 0; i < count; ++i) {
+        assert(responses[i].status == StatusCode::SUCCESS);
+        assert(responses[i].value == entries[i].second);
+    }
+    assert(responses[count].status == StatusCode::KEY_NOT_FOUND);
+    assert(responses[count + 1].status == StatusCode::SUCCESS);
+    
+    // Large values in a window bigger than the socket buffers
+    std::vector<Request> large;
+    for (int i = 0; i < 16; ++i) {
+        large.emplace_back(OpCode::PUT, std::vector<uint8_t>({'L', static_cast<uint8_t>('a' + i)}),
+                           std::vector<uint8_t>(512 * 1024, static_cast<uint8_t>(i)));
+    }
+    assert(client.pipeline(large, responses, 16));
+    for (const auto& resp : responses) {
+        assert(resp.status == StatusCode::SUCCESS);
+    }
+    
+    // The connection remains usable for ordinary requests
+    std::vector<uint8_t> value;
+    assert(client.get("pipe7", value));
+    assert(value == entries[7].second);
+    
+    server.stop();
+    
+    std::cout << "✓ test_pipelined_requests passed" << std::endl;
+}
+
+void test_batch_requests() {
+    Server server(8010, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    Client client("127.0.0.1", 8010);
+    assert(client.connect());
+    
+    std::vector<BatchEntry> entries;
+    entries.emplace_back("m1", std::vector<uint8_t>{'1'});
+    entries.emplace_back("m2", std::vector<uint8_t>{'2'});
+    std::vector<BatchResult> results;
+    assert(client.multi_put(entries, results));
+    assert(results.size() == 2);
+    
+    assert(client.multi_get({"m2", "absent", "m1"}, results));
+    assert(results.size() == 3);
+    assert(results[0].status == StatusCode::SUCCESS && results[0].value == entries[1].value);
+    assert(results[1].status == StatusCode::KEY_NOT_FOUND);
+    assert(results[2].status == StatusCode::SUCCESS && results[2].value == entries[0].value);
+    
+    assert(client.multi_remove({"m1", "m1"}, results));
+    assert(results[0].status == StatusCode::SUCCESS);
+    assert(results[1].status == StatusCode::KEY_NOT_FOUND);
+    
+    server.stop();
+    
+    std::cout << "✓ test_batch_requests passed" << std::endl;
+}
+
+void test_ttl_limits() {
+    Server server(8012, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    Client client("127.0.0.1", 8012);
+    assert(client.connect());
+    std::vector<uint8_t> value;
+    
+    // A TTL of 0 is refused; a huge one is capped, not wrapped
+    assert(!client.put_with_ttl("ttl_zero", {'0'}, 0));
+    assert(!client.get("ttl_zero", value));
+    assert(client.put_with_ttl("ttl_huge", {'h'}, UINT64_MAX));
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    assert(client.get("ttl_huge", value) && value == std::vector<uint8_t>{'h'});
+    
+    server.stop();
+    
+    std::cout << "✓ test_ttl_limits passed" << std::endl;
+}
+
+void test_disconnect_during_large_response() {
+    Server server(8011, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    Client client("127.0.0.1", 8011);
+    assert(client.connect());
+    std::vector<uint8_t> value(200 * 1024, 'x');
+    assert(client.put("large", value));
+    
+    // Pipeline GETs of a value large enough to be sent vectored, then hang
+    // up without reading the responses. The server's writes then fail;
+    // they must not raise SIGPIPE, which would end this process.
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    // A small receive buffer keeps most of the responses unsent at hang up
+    int buffer = 4096;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(8011);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    assert(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    std::vector<uint8_t> burst;
+    for (int i = 0; i < 40; ++i) {
+        std::vector<uint8_t> frame = Protocol::encodeRequest(Request(OpCode::GET, {'l', 'a', 'r', 'g', 'e'}));
+        burst.insert(burst.end(), frame.begin(), frame.end());
+    }
+    assert(send(fd, burst.data(), burst.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(burst.size()));
+    // Half-close first: the reset that the close then sends reaches a
+    // socket that has seen our FIN, and the server's next write to it
+    // fails with EPIPE
+    shutdown(fd, SHUT_WR);
+    uint8_t chunk[4096];
+    assert(recv(fd, chunk, sizeof(chunk), 0) > 0);
+    close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    
+    // The server is still up for everyone else
+    std::vector<uint8_t> read;
+    assert(client.get("large", read) && read == value);
+    
+    client.disconnect();
+    server.stop();
+    
+    std::cout << "✓ test_disconnect_during_large_response passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running integration tests..." << std::endl;
     
@@ -190,6 +416,12 @@ int main() {
     test_large_values();
     test_concurrent_operations();
     test_reconnect();
+    test_idle_connections_do_not_starve_workers();
+    test_multiple_event_loops();
+    test_pipelined_requests();
+    test_batch_requests();
+    test_ttl_limits();
+    test_disconnect_during_large_response();
     
     std::cout << "\nAll integration tests passed!" << std::endl;
     return 0;
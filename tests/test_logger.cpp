@@ -0,0 +1,141 @@
+#include "../include/logger.h"
+#include <iostream>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace funnelkvs;
+
+namespace {
+
+std::string read_all(std::FILE* file) {
+    std::fflush(file);
+    std::rewind(file);
+    std::string text;
+    char buffer[4096];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, n);
+    }
+    return text;
+}
+
+size_t count_lines(const std::string& text) {
+    size_t lines = 0;
+    for (char c : text) {
+        lines += c == '\n';
+    }
+    return lines;
+}
+
+int evaluations = 0;
+
+int counted() {
+    return ++evaluations;
+}
+
+} // namespace
+
+void test_parse_level() {
+    LogLevel level;
+    assert(Logger::parse_level("debug", level) && level == LogLevel::DEBUG);
+    assert(Logger::parse_level("INFO", level) && level == LogLevel::INFO);
+    assert(Logger::parse_level("Warn", level) && level == LogLevel::WARN);
+    assert(Logger::parse_level("error", level) && level == LogLevel::ERROR);
+    assert(Logger::parse_level("off", level) && level == LogLevel::OFF);
+    assert(!Logger::parse_level("verbose", level));
+    assert(std::string(Logger::level_name(LogLevel::WARN)) == "WARN");
+    std::cout << "✓ test_parse_level passed" << std::endl;
+}
+
+void test_levels_and_streams() {
+    std::FILE* out = std::tmpfile();
+    std::FILE* err = std::tmpfile();
+    assert(out && err);
+    Logger& logger = Logger::instance();
+    logger.redirect(out, err);
+
+    logger.set_level(LogLevel::INFO);
+    evaluations = 0;
+    FKVS_DEBUG("hidden " << counted());
+    assert(evaluations == 0); // disabled: arguments not evaluated
+    FKVS_INFO("info line " << counted());
+    FKVS_WARN("warn line");
+    FKVS_ERROR("error line");
+    assert(evaluations == 1);
+
+    logger.set_level(LogLevel::ERROR);
+    assert(logger.level() == LogLevel::ERROR);
+    FKVS_INFO("skipped");
+    FKVS_WARN("skipped");
+    logger.set_level(LogLevel::DEBUG);
+    FKVS_DEBUG("debug line");
+    logger.flush();
+
+    std::string out_text = read_all(out);
+    std::string err_text = read_all(err);
+    assert(out_text.find("INFO info line 1\n") != std::string::npos);
+    assert(out_text.find("DEBUG debug line\n") != std::string::npos);
+    assert(out_text.find("hidden") == std::string::npos);
+    assert(out_text.find("skipped") == std::string::npos);
+    assert(count_lines(out_text) == 2);
+    assert(err_text.find("WARN warn line\n") != std::string::npos);
+    assert(err_text.find("ERROR error line\n") != std::string::npos);
+    assert(count_lines(err_text) == 2);
+    // Lines start with a timestamp: "HH:MM:SS.mmm LEVEL ..."
+    assert(out_text.size() > 13 && out_text[2] == ':' && out_text[8] == '.' && out_text[12] == ' ');
+
+    logger.redirect(stdout, stderr);
+    logger.set_level(LogLevel::INFO);
+    std::fclose(out);
+    std::fclose(err);
+    std::cout << "✓ test_levels_and_streams passed" << std::endl;
+}
+
+void test_concurrent_logging() {
+    std::FILE* out = std::tmpfile();
+    assert(out);
+    Logger& logger = Logger::instance();
+    logger.redirect(out, out);
+    Logger::Stats before = logger.stats();
+
+    const int THREADS = 8;
+    const int LINES = 5000; // more in total than the ring holds
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < LINES; ++i) {
+                FKVS_INFO("thread " << t << " line " << i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    logger.flush();
+
+    Logger::Stats after = logger.stats();
+    uint64_t written = after.written - before.written;
+    uint64_t dropped = after.dropped - before.dropped;
+    // Every line is either written whole or counted as dropped
+    assert(written + dropped == static_cast<uint64_t>(THREADS * LINES));
+    assert(written >= Logger::RING_CAPACITY / 2);
+    assert(count_lines(read_all(out)) == written);
+
+    logger.redirect(stdout, stderr);
+    std::fclose(out);
+    std::cout << "✓ test_concurrent_logging passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running logger tests..." << std::endl;
+
+    test_parse_level();
+    test_levels_and_streams();
+    test_concurrent_logging();
+
+    std::cout << "\nAll logger tests passed!" << std::endl;
+    return 0;
+}
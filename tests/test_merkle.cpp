@@ -0,0 +1,176 @@
+#include "../include/merkle.h"
+#include "../include/storage.h"
+#include <iostream>
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace funnelkvs;
+
+static uint64_t digest_of(const std::string& key, const std::vector<uint8_t>& value) {
+    return MerkleTree::entry_digest(key.data(), key.size(), value.data(), value.size());
+}
+
+// Digest sum of node index of level over (start, end], computed entry by entry
+static uint64_t expected_digest(const std::map<std::string, std::vector<uint8_t>>& entries,
+                                const Hash160& start, const Hash160& end, int level, size_t index) {
+    uint64_t sum = 0;
+    size_t lo = MerkleTree::first_leaf(level, index);
+    for (const auto& entry : entries) {
+        Hash160 id = SHA1::hash(entry.first);
+        size_t leaf = MerkleTree::leaf_of(id);
+        if (leaf < lo || leaf >= lo + MerkleTree::leaf_span(level)) {
+            continue;
+        }
+        if (start == end || in_range(id, start, end, true)) {
+            sum += digest_of(entry.first, entry.second);
+        }
+    }
+    return sum;
+}
+
+void test_tree_layout() {
+    assert(MerkleTree::LEAVES == 4096);
+    assert(MerkleTree::level_size(0) == 1);
+    assert(MerkleTree::level_size(MerkleTree::DEPTH) == MerkleTree::LEAVES);
+    assert(MerkleTree::leaf_span(0) == MerkleTree::LEAVES);
+    assert(MerkleTree::first_leaf(1, 3) == 3 * 256);
+
+    Hash160 id{};
+    assert(MerkleTree::leaf_of(id) == 0);
+    id[0] = 0xFF;
+    id[1] = 0xF0;
+    assert(MerkleTree::leaf_of(id) == MerkleTree::LEAVES - 1);
+    for (size_t leaf : {size_t(0), size_t(1), size_t(777), MerkleTree::LEAVES - 1}) {
+        assert(MerkleTree::leaf_of(MerkleTree::leaf_start(leaf)) == leaf);
+    }
+
+    std::cout << "✓ test_tree_layout passed" << std::endl;
+}
+
+void test_incremental_updates() {
+    MerkleTree tree;
+    Hash160 a = SHA1::hash("a");
+    Hash160 b = SHA1::hash("b");
+    tree.add(a, 10);
+    tree.add(b, 32);
+    assert(tree.root() == 42);
+    assert(tree.node(MerkleTree::DEPTH, MerkleTree::leaf_of(a)) ==
+           (MerkleTree::leaf_of(a) == MerkleTree::leaf_of(b) ? 42u : 10u));
+
+    // Order does not matter, and a removal undoes an add exactly
+    tree.update(a, 10, 7);
+    tree.remove(b, 32);
+    assert(tree.root() == 7);
+    tree.remove(a, 7);
+    assert(tree.root() == 0);
+    for (size_t i = 0; i < MerkleTree::level_size(1); ++i) {
+        assert(tree.node(1, i) == 0);
+    }
+
+    std::cout << "✓ test_incremental_updates passed" << std::endl;
+}
+
+void test_storage_maintains_tree() {
+    Storage storage(8);
+    Storage other(4);
+    assert(storage.merkle_root() == 0);
+
+    // Same contents reached by different histories give the same root
+    for (int i = 0; i < 500; ++i) {
+        std::string key = "key" + std::to_string(i);
+        storage.put(key, std::vector<uint8_t>(i % 50, 'x'));
+        storage.put(key, std::vector<uint8_t>(i % 7 + 1, static_cast<uint8_t>(i)));
+    }
+    for (int i = 499; i >= 0; --i) {
+        other.put("key" + std::to_string(i), std::vector<uint8_t>(i % 7 + 1, static_cast<uint8_t>(i)));
+    }
+    other.put("extra", std::vector<uint8_t>{'e'});
+    assert(storage.merkle_root() != other.merkle_root());
+    assert(other.remove("extra"));
+    assert(storage.merkle_root() == other.merkle_root());
+
+    // A one-byte change moves the root
+    uint64_t before = storage.merkle_root();
+    storage.put("key7", std::vector<uint8_t>{'y'});
+    assert(storage.merkle_root() != before);
+
+    storage.clear();
+    assert(storage.merkle_root() == 0);
+
+    std::cout << "✓ test_storage_maintains_tree passed" << std::endl;
+}
+
+void test_range_digests_match_entries() {
+    Storage storage(4);
+    std::map<std::string, std::vector<uint8_t>> entries;
+    for (int i = 0; i < 3000; ++i) {
+        std::string key = "range" + std::to_string(i);
+        std::vector<uint8_t> value(1 + i % 13, static_cast<uint8_t>(i));
+        storage.put(key, value);
+        entries[key] = value;
+    }
+
+    // Plain, wrapping, single-leaf, wrap-within-one-leaf and whole ring
+    Hash160 low = SHA1::hash("low");
+    Hash160 high = low;
+    high[0] = static_cast<uint8_t>(low[0] + 0x60);
+    Hash160 near = low;
+    near[2] ^= 0x01;
+    std::vector<std::pair<Hash160, Hash160>> ranges = {
+        {low, high}, {high, low}, {std::min(low, near), std::max(low, near)},
+        {std::max(low, near), std::min(low, near)}, {low, low}};
+
+    for (const auto& range : ranges) {
+        for (int level = 0; level <= MerkleTree::DEPTH; ++level) {
+            std::vector<uint32_t> indices;
+            for (size_t i = 0; i < MerkleTree::level_size(level); i += level == MerkleTree::DEPTH ? 37 : 1) {
+                indices.push_back(static_cast<uint32_t>(i));
+            }
+            // Always include the leaves the boundaries cut
+            if (level == MerkleTree::DEPTH) {
+                indices.push_back(static_cast<uint32_t>(MerkleTree::leaf_of(range.first)));
+                indices.push_back(static_cast<uint32_t>(MerkleTree::leaf_of(range.second)));
+            }
+            std::vector<uint64_t> digests;
+            storage.range_digests(range.first, range.second, level, indices, digests);
+            assert(digests.size() == indices.size());
+            for (size_t i = 0; i < indices.size(); ++i) {
+                assert(digests[i] == expected_digest(entries, range.first, range.second, level, indices[i]));
+            }
+        }
+    }
+
+    // Leaf listings agree with the leaf digests
+    std::vector<uint32_t> leaves = {static_cast<uint32_t>(MerkleTree::leaf_of(low)),
+                                    static_cast<uint32_t>(MerkleTree::leaf_of(high))};
+    Storage::DigestList listed;
+    storage.leaf_digests(low, high, leaves, listed);
+    std::vector<uint64_t> digests;
+    storage.range_digests(low, high, MerkleTree::DEPTH, leaves, digests);
+    uint64_t sum = 0;
+    for (const auto& entry : listed) {
+        Hash160 id = SHA1::hash(entry.first);
+        assert(in_range(id, low, high, true));
+        assert(entry.second == digest_of(entry.first, entries[entry.first]));
+        sum += entry.second;
+    }
+    assert(sum == digests[0] + digests[1]);
+
+    std::cout << "✓ test_range_digests_match_entries passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running Merkle tree tests..." << std::endl;
+    std::cout << std::endl;
+
+    test_tree_layout();
+    test_incremental_updates();
+    test_storage_maintains_tree();
+    test_range_digests_match_entries();
+
+    std::cout << std::endl;
+    std::cout << "All Merkle tree tests passed!" << std::endl;
+    return 0;
+}
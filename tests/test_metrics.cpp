@@ -0,0 +1,141 @@
+#include "../include/metrics.h"
+#include <iostream>
+#include <cassert>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace funnelkvs;
+
+namespace {
+
+const RequestMetrics::OpSnapshot* find_op(const std::vector<RequestMetrics::OpSnapshot>& ops,
+                                          OpCode opcode) {
+    for (const auto& op : ops) {
+        if (op.opcode == opcode) {
+            return &op;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+void test_snapshot_merge() {
+    Histogram a;
+    Histogram b;
+    a.record(10);
+    a.record(20);
+    b.record(5000);
+
+    Histogram::Snapshot merged = a.snapshot();
+    merged.merge(b.snapshot());
+    assert(merged.count == 3);
+    assert(merged.sum == 5030);
+    assert(merged.max == 5000);
+    assert(merged.percentile(0.5) < 64);
+    assert(merged.percentile(1.0) >= 5000);
+
+    // Merging into an empty snapshot copies
+    Histogram::Snapshot empty = Histogram::Snapshot();
+    empty.merge(merged);
+    assert(empty.count == 3 && empty.max == 5000);
+    std::cout << "✓ test_snapshot_merge passed" << std::endl;
+}
+
+void test_request_metrics() {
+    RequestMetrics metrics;
+    assert(metrics.snapshot().empty());
+
+    metrics.record(OpCode::GET, StatusCode::SUCCESS, 20, 105, 40);
+    metrics.record(OpCode::GET, StatusCode::KEY_NOT_FOUND, 20, 5, 30);
+    metrics.record(OpCode::GET, StatusCode::REDIRECT, 20, 30, 10);
+    metrics.record(OpCode::PUT, StatusCode::ERROR, 120, 5, 900);
+
+    std::vector<RequestMetrics::OpSnapshot> ops = metrics.snapshot();
+    assert(ops.size() == 2);
+    const RequestMetrics::OpSnapshot* get = find_op(ops, OpCode::GET);
+    const RequestMetrics::OpSnapshot* put = find_op(ops, OpCode::PUT);
+    assert(get && put);
+    assert(get->latency_us.count == 3 && get->latency_us.max == 40);
+    assert(get->bytes_in == 60 && get->bytes_out == 140);
+    assert(get->redirects == 1 && get->errors == 0);
+    assert(put->errors == 1 && put->latency_us.sum == 900);
+    std::cout << "✓ test_request_metrics passed" << std::endl;
+}
+
+void test_concurrent_recording() {
+    RequestMetrics metrics;
+    const int THREADS = 24; // more threads than stripes
+    const int OPS = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&metrics, t] {
+            OpCode opcode = t % 2 ? OpCode::GET : OpCode::MULTI_GET;
+            for (int i = 0; i < OPS; ++i) {
+                metrics.record(opcode, StatusCode::SUCCESS, 10, 20, static_cast<uint64_t>(i % 100));
+            }
+        });
+    }
+    // Snapshots while recording must be safe
+    for (int i = 0; i < 20; ++i) {
+        metrics.snapshot();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<RequestMetrics::OpSnapshot> ops = metrics.snapshot();
+    assert(ops.size() == 2);
+    for (const auto& op : ops) {
+        assert(op.latency_us.count == static_cast<uint64_t>(THREADS / 2 * OPS));
+        assert(op.bytes_in == static_cast<uint64_t>(THREADS / 2 * OPS * 10));
+        assert(op.bytes_out == static_cast<uint64_t>(THREADS / 2 * OPS * 20));
+    }
+    std::cout << "✓ test_concurrent_recording passed" << std::endl;
+}
+
+void test_stats_report() {
+    Histogram latency;
+    latency.record(100);
+    latency.record(300);
+
+    StatsReport report;
+    report.add("server.connections.active", static_cast<uint64_t>(3));
+    report.add("chord.lookup_mean_hops", 1.5);
+    report.add("node", std::string("127.0.0.1:8001"));
+    report.add_latency("request.GET", latency.snapshot());
+
+    StatsReport::Entries parsed = StatsReport::parse(report.to_text());
+    assert(parsed == report.entries());
+
+    std::map<std::string, std::string> values(parsed.begin(), parsed.end());
+    assert(values["server.connections.active"] == "3");
+    assert(values["chord.lookup_mean_hops"] == "1.500");
+    assert(values["node"] == "127.0.0.1:8001");
+    assert(values["request.GET.count"] == "2");
+    assert(values["request.GET.max_us"] == "300");
+    assert(values.count("request.GET.mean_us") && values.count("request.GET.p50_us") &&
+           values.count("request.GET.p99_us") && values.count("request.GET.p999_us"));
+
+    // Blank and malformed lines are skipped
+    assert(StatsReport::parse("\nnovalue\n a b\nx 1\n").size() == 1);
+
+    assert(Protocol::opcodeName(OpCode::GET) == "GET");
+    assert(Protocol::opcodeName(OpCode::STATS) == "STATS");
+    assert(Protocol::opcodeName(static_cast<OpCode>(0x7f)) == "0x7f");
+    std::cout << "✓ test_stats_report passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running metrics tests..." << std::endl;
+
+    test_snapshot_merge();
+    test_request_metrics();
+    test_concurrent_recording();
+    test_stats_report();
+
+    std::cout << "\nAll metrics tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,418 @@
+#include "../include/persistence.h"
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace funnelkvs;
+
+namespace {
+
+std::string make_temp_dir() {
+    char path[] = "/tmp/funnelkvs_persistence_XXXXXX";
+    assert(mkdtemp(path) != nullptr);
+    return path;
+}
+
+std::vector<std::string> list_files(const std::string& dir) {
+    std::vector<std::string> names;
+    DIR* d = opendir(dir.c_str());
+    assert(d);
+    while (struct dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    return names;
+}
+
+size_t count_segments(const std::string& dir) {
+    size_t n = 0;
+    for (const auto& name : list_files(dir)) {
+        n += name.compare(0, 4, "wal-") == 0;
+    }
+    return n;
+}
+
+void remove_dir(const std::string& dir) {
+    for (const auto& name : list_files(dir)) {
+        unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+std::vector<uint8_t> bytes(const std::string& s) {
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+} // namespace
+
+void test_log_replay() {
+    std::string dir = make_temp_dir();
+    {
+        Storage storage;
+        Persistence persistence(dir);
+        persistence.recover(storage);
+        persistence.start(storage);
+        for (int i = 0; i < 100; ++i) {
+            storage.put("key_" + std::to_string(i), bytes("value_" + std::to_string(i)));
+        }
+        storage.put("key_5", bytes("overwritten"));
+        storage.remove("key_7");
+        storage.put("empty", std::vector<uint8_t>());
+        persistence.stop();
+        assert(persistence.get_stats().records == 103);
+    }
+
+    Storage recovered;
+    Persistence persistence(dir);
+    Persistence::RecoveryStats stats = persistence.recover(recovered);
+    assert(stats.snapshot_entries == 0);
+    assert(stats.log_records == 103);
+    assert(!stats.truncated);
+    assert(recovered.size() == 100);
+    std::vector<uint8_t> value;
+    assert(recovered.get("key_5", value) && value == bytes("overwritten"));
+    assert(recovered.get("key_99", value) && value == bytes("value_99"));
+    assert(!recovered.exists("key_7"));
+    assert(recovered.get("empty", value) && value.empty());
+    // Ids come back from the log rather than being recomputed
+    for (const auto& entry : recovered.get_all_key_ids()) {
+        assert(entry.second == SHA1::hash(entry.first));
+    }
+
+    remove_dir(dir);
+    std::cout << "✓ test_log_replay passed" << std::endl;
+}
+
+void test_snapshot_and_log_tail() {
+    std::string dir = make_temp_dir();
+    {
+        Storage storage;
+        // Tiny segments, so the snapshot has whole segments to drop
+        Persistence persistence(dir, Persistence::DEFAULT_SNAPSHOT_BYTES, 512);
+        persistence.recover(storage);
+        persistence.start(storage);
+        for (int i = 0; i < 200; ++i) {
+            storage.put("snap_" + std::to_string(i), bytes("before"));
+        }
+        size_t segments_before = count_segments(dir);
+        assert(segments_before > 1);
+        assert(persistence.snapshot());
+        assert(count_segments(dir) < segments_before);
+
+        // Changes after the snapshot live only in the log
+        storage.put("snap_0", bytes("after"));
+        storage.remove("snap_1");
+        storage.put("snap_new", bytes("after"));
+        persistence.stop();
+        assert(persistence.get_stats().snapshots == 1);
+    }
+
+    Storage recovered;
+    Persistence persistence(dir);
+    Persistence::RecoveryStats stats = persistence.recover(recovered);
+    assert(stats.snapshot_entries == 200);
+    assert(stats.log_records == 3);
+    assert(recovered.size() == 200);
+    std::vector<uint8_t> value;
+    assert(recovered.get("snap_0", value) && value == bytes("after"));
+    assert(!recovered.exists("snap_1"));
+    assert(recovered.get("snap_new", value) && value == bytes("after"));
+    assert(recovered.get("snap_199", value) && value == bytes("before"));
+
+    // Recovered state keeps accumulating across restarts
+    persistence.start(recovered);
+    recovered.put("third_run", bytes("x"));
+    persistence.stop();
+    Storage again;
+    Persistence reopened(dir);
+    reopened.recover(again);
+    assert(again.size() == 201);
+    assert(again.exists("third_run"));
+
+    remove_dir(dir);
+    std::cout << "✓ test_snapshot_and_log_tail passed" << std::endl;
+}
+
+void test_torn_tail() {
+    std::string dir = make_temp_dir();
+    {
+        Storage storage;
+        Persistence persistence(dir);
+        persistence.recover(storage);
+        persistence.start(storage);
+        storage.put("a", bytes("1"));
+        storage.put("b", bytes("2"));
+        persistence.stop();
+    }
+
+    // Simulate a crash in the middle of appending a record
+    std::vector<std::string> files = list_files(dir);
+    assert(files.size() == 1);
+    std::string path = dir + "/" + files[0];
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    assert(fd >= 0);
+    const uint8_t partial[] = {40, 0, 0, 0, 0xAB, 0xCD, 1, 2, 3};
+    assert(write(fd, partial, sizeof(partial)) == static_cast<ssize_t>(sizeof(partial)));
+    close(fd);
+
+    {
+        Storage recovered;
+        Persistence persistence(dir);
+        Persistence::RecoveryStats stats = persistence.recover(recovered);
+        assert(stats.truncated);
+        assert(stats.log_records == 2);
+        assert(recovered.size() == 2);
+
+        // The torn bytes are gone, so new records follow the good ones
+        persistence.start(recovered);
+        recovered.put("c", bytes("3"));
+        persistence.stop();
+    }
+
+    Storage recovered;
+    Persistence persistence(dir);
+    Persistence::RecoveryStats stats = persistence.recover(recovered);
+    assert(!stats.truncated);
+    assert(recovered.size() == 3);
+
+    remove_dir(dir);
+    std::cout << "✓ test_torn_tail passed" << std::endl;
+}
+
+void test_group_commit() {
+    std::string dir = make_temp_dir();
+    const int THREADS = 8;
+    const int PER_THREAD = 200;
+    {
+        Storage storage;
+        Persistence persistence(dir);
+        persistence.recover(storage);
+        persistence.start(storage);
+
+        std::vector<std::thread> writers;
+        for (int t = 0; t < THREADS; ++t) {
+            writers.emplace_back([&storage, t] {
+                for (int i = 0; i < PER_THREAD; ++i) {
+                    storage.put("t" + std::to_string(t) + "_" + std::to_string(i),
+                                std::vector<uint8_t>(64, static_cast<uint8_t>(t)));
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        persistence.stop();
+
+        // Concurrent writers shared syncs
+        Persistence::Stats stats = persistence.get_stats();
+        assert(stats.records == THREADS * PER_THREAD);
+        assert(stats.syncs < stats.records);
+    }
+
+    Storage recovered;
+    Persistence persistence(dir);
+    persistence.recover(recovered);
+    assert(recovered.size() == THREADS * PER_THREAD);
+
+    remove_dir(dir);
+    std::cout << "✓ test_group_commit passed" << std::endl;
+}
+
+void test_automatic_snapshot() {
+    std::string dir = make_temp_dir();
+    {
+        Storage storage;
+        Persistence persistence(dir, 16 * 1024, 4 * 1024);
+        persistence.recover(storage);
+        persistence.start(storage);
+        for (int i = 0; i < 2000; ++i) {
+            storage.put("auto_" + std::to_string(i % 100), std::vector<uint8_t>(100, 'a'));
+        }
+        for (int i = 0; i < 100 && persistence.get_stats().snapshots == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        assert(persistence.get_stats().snapshots > 0);
+        storage.clear();
+        storage.put("after_clear", bytes("x"));
+        persistence.stop();
+    }
+
+    // Rewrites of the same keys do not pile up on disk
+    assert(count_segments(dir) < 2000 * 128 / (4 * 1024));
+
+    Storage recovered;
+    Persistence persistence(dir);
+    persistence.recover(recovered);
+    assert(recovered.size() == 1);
+    assert(recovered.exists("after_clear"));
+
+    remove_dir(dir);
+    std::cout << "✓ test_automatic_snapshot passed" << std::endl;
+}
+
+void test_versions_survive_recovery() {
+    std::string dir = make_temp_dir();
+    uint64_t in_snapshot = 0;
+    uint64_t in_log = 0;
+    uint64_t applied = 0;
+    {
+        Storage storage;
+        Persistence persistence(dir);
+        persistence.recover(storage);
+        persistence.start(storage);
+        in_snapshot = storage.put("snapshotted", bytes("a"));
+        assert(persistence.snapshot());
+        in_log = storage.put("logged", bytes("b"));
+        applied = in_log + 12345;
+        assert(storage.apply("replica", SHA1::hash("replica"), bytes("c"), applied));
+        persistence.stop();
+    }
+
+    Storage recovered;
+    Persistence persistence(dir);
+    persistence.recover(recovered);
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    assert(recovered.get("snapshotted", value, version) && version == in_snapshot);
+    assert(recovered.get("logged", value, version) && version == in_log);
+    assert(recovered.get("replica", value, version) && version == applied);
+    // Writes after a restart are stamped after every recovered one
+    assert(recovered.put("next", bytes("d")) > applied);
+
+    remove_dir(dir);
+    std::cout << "✓ test_versions_survive_recovery passed" << std::endl;
+}
+
+void test_compressed_values_survive_recovery() {
+    std::string dir = make_temp_dir();
+    std::vector<uint8_t> large(8192, 'z');
+    {
+        Storage storage;
+        storage.set_compression(1024);
+        Persistence persistence(dir);
+        persistence.recover(storage);
+        persistence.start(storage);
+        storage.put("snapshotted", large);
+        assert(persistence.snapshot());
+        storage.put("logged", large);
+        storage.put("plain", bytes("small"));
+        persistence.stop();
+    }
+
+    // Both the snapshot and the log keep the stored form and its flag,
+    // whatever the recovering store's own setting
+    Storage recovered;
+    Persistence persistence(dir);
+    persistence.recover(recovered);
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    bool compressed = false;
+    for (const char* key : {"snapshotted", "logged"}) {
+        assert(recovered.get_stored(key, value, version, compressed) && compressed);
+        assert(value.size() < large.size());
+        assert(recovered.get(key, value) && value == large);
+    }
+    assert(recovered.get_stored("plain", value, version, compressed) && !compressed);
+    assert(value == bytes("small"));
+
+    remove_dir(dir);
+    std::cout << "✓ test_compressed_values_survive_recovery passed" << std::endl;
+}
+
+void test_expiry_survives_recovery() {
+    std::string dir = make_temp_dir();
+    std::vector<uint8_t> large(8192, 'z');
+    uint64_t deadline = HybridClock::wall_ms() + 600000;
+    {
+        Storage storage;
+        storage.set_compression(1024);
+        Persistence persistence(dir);
+        persistence.recover(storage);
+        persistence.start(storage);
+        storage.put("snapshotted", SHA1::hash("snapshotted"), std::vector<uint8_t>(large), false, deadline);
+        storage.put("plain", bytes("small"));
+        assert(persistence.snapshot());
+        storage.put("logged", SHA1::hash("logged"), std::vector<uint8_t>(large), false, deadline + 1);
+        storage.put("lapsing", SHA1::hash("lapsing"), bytes("gone"), false, HybridClock::wall_ms() + 100);
+        // Its removal by expiry is logged like a delete
+        for (int i = 0; i < 100 && storage.memory_stats().expired_entries == 0; ++i) {
+            usleep(20000);
+        }
+        assert(storage.memory_stats().expired_entries == 1);
+        persistence.stop();
+    }
+
+    // Snapshot and log entries keep their expiry times, and compression
+    // alongside them
+    Storage recovered;
+    Persistence persistence(dir);
+    persistence.recover(recovered);
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    bool compressed = false;
+    uint64_t expires = 0;
+    assert(recovered.get_stored("snapshotted", value, version, compressed, &expires));
+    assert(compressed && expires == deadline);
+    assert(recovered.get_stored("logged", value, version, compressed, &expires));
+    assert(compressed && expires == deadline + 1);
+    assert(recovered.get("logged", value) && value == large);
+    assert(recovered.get_stored("plain", value, version, compressed, &expires) && expires == 0);
+    assert(recovered.size() == 3 && !recovered.exists("lapsing"));
+
+    remove_dir(dir);
+    std::cout << "✓ test_expiry_survives_recovery passed" << std::endl;
+}
+
+void test_failed_log_is_not_acknowledged() {
+    std::string dir = make_temp_dir();
+    Storage storage;
+    // Every batch opens a new segment, so removing the directory makes
+    // the next log write fail
+    Persistence persistence(dir, 1 << 30, 1);
+    persistence.recover(storage);
+    persistence.start(storage);
+
+    storage.put("before", bytes("1"));
+    assert(storage.durable());
+
+    remove_dir(dir);
+    storage.put("after", bytes("2"));
+    assert(!storage.durable());
+    assert(persistence.get_stats().failed);
+
+    // The failure is sticky: later writes return instead of waiting forever
+    storage.put("later", bytes("3"));
+    storage.remove("before");
+    assert(!storage.durable());
+    persistence.stop();
+
+    std::cout << "✓ test_failed_log_is_not_acknowledged passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running persistence tests..." << std::endl;
+
+    test_log_replay();
+    test_snapshot_and_log_tail();
+    test_torn_tail();
+    test_group_commit();
+    test_automatic_snapshot();
+    test_versions_survive_recovery();
+    test_compressed_values_survive_recovery();
+    test_expiry_survives_recovery();
+    test_failed_log_is_not_acknowledged();
+
+    std::cout << "\nAll persistence tests passed!" << std::endl;
+    return 0;
+}
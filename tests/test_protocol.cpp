@@ -105,7 +105,8 @@ void test_all_opcodes() {
     std::vector<OpCode> opcodes = {
         OpCode::GET, OpCode::PUT, OpCode::DELETE,
         OpCode::JOIN, OpCode::STABILIZE, OpCode::NOTIFY,
-        OpCode::PING, OpCode::REPLICATE
+        OpCode::PING, OpCode::REPLICATE, OpCode::CAS, OpCode::GET_VERSIONED,
+        OpCode::PUT_TTL, OpCode::SCAN, OpCode::GET_ROUTING
     };
     
     std::vector<uint8_t> key = {'k'};
@@ -123,7 +124,7 @@ void test_all_opcodes() {
 void test_all_status_codes() {
     std::vector<StatusCode> statuses = {
         StatusCode::SUCCESS, StatusCode::KEY_NOT_FOUND,
-        StatusCode::ERROR, StatusCode::REDIRECT
+        StatusCode::ERROR, StatusCode::REDIRECT, StatusCode::VERSION_MISMATCH
     };
     
     for (StatusCode status : statuses) {
@@ -137,6 +138,301 @@ void test_all_status_codes() {
     std::cout << "✓ test_all_status_codes passed" << std::endl;
 }
 
+void test_decode_request_view() {
+    std::vector<uint8_t> key = {'v', 'k'};
+    std::vector<uint8_t> value(1000, 0x5A);
+    std::vector<uint8_t> encoded = Protocol::encodeRequest(Request(OpCode::PUT, key, value));
+    
+    RequestView view;
+    assert(Protocol::decodeRequestView(encoded.data(), encoded.size(), view));
+    assert(view.opcode == OpCode::PUT);
+    assert(view.key.to_string() == "vk");
+    assert(view.value.size == value.size());
+    // The view points into the frame instead of copying it
+    assert(view.key.data == encoded.data() + 5);
+    assert(view.value.data == encoded.data() + 5 + key.size() + 4);
+    
+    assert(!Protocol::decodeRequestView(encoded.data(), encoded.size() - 1, view));
+    
+    std::cout << "✓ test_decode_request_view passed" << std::endl;
+}
+
+void test_request_frame_size() {
+    std::vector<uint8_t> first = Protocol::encodeRequest(Request(OpCode::PUT, {'a'}, {'1', '2'}));
+    std::vector<uint8_t> second = Protocol::encodeRequest(Request(OpCode::GET, {'b'}));
+    std::vector<uint8_t> stream = first;
+    stream.insert(stream.end(), second.begin(), second.end());
+    
+    size_t frame_size = 0;
+    assert(Protocol::requestFrameSize(stream.data(), stream.size(), frame_size) == FrameStatus::COMPLETE);
+    assert(frame_size == first.size());
+    assert(Protocol::requestFrameSize(stream.data() + frame_size, stream.size() - frame_size, frame_size) ==
+           FrameStatus::COMPLETE);
+    assert(frame_size == second.size());
+    
+    // Every strict prefix of a frame is incomplete
+    for (size_t len = 0; len < first.size(); ++len) {
+        assert(Protocol::requestFrameSize(first.data(), len, frame_size) == FrameStatus::INCOMPLETE);
+    }
+    
+    // Absurd length fields are rejected instead of buffered
+    std::vector<uint8_t> bogus = {0x02, 0xFF, 0xFF, 0xFF, 0xFF};
+    assert(Protocol::requestFrameSize(bogus.data(), bogus.size(), frame_size) == FrameStatus::INVALID);
+    
+    std::cout << "✓ test_request_frame_size passed" << std::endl;
+}
+
+void test_response_frame_size_and_append() {
+    std::vector<uint8_t> stream = Protocol::encodeResponse(Response(StatusCode::SUCCESS, {'x', 'y'}));
+    std::vector<uint8_t> second = Protocol::encodeResponse(Response(StatusCode::KEY_NOT_FOUND));
+    stream.insert(stream.end(), second.begin(), second.end());
+    
+    size_t frame_size = 0;
+    assert(Protocol::responseFrameSize(stream.data(), stream.size(), frame_size) == FrameStatus::COMPLETE);
+    assert(frame_size == 7);
+    Response resp;
+    assert(Protocol::decodeResponse(stream.data(), frame_size, resp));
+    assert(resp.status == StatusCode::SUCCESS);
+    assert(resp.value == std::vector<uint8_t>({'x', 'y'}));
+    assert(Protocol::responseFrameSize(stream.data() + 7, 4, frame_size) == FrameStatus::INCOMPLETE);
+    assert(Protocol::responseFrameSize(stream.data() + 7, 5, frame_size) == FrameStatus::COMPLETE);
+    
+    // Appended requests are byte-identical to individually encoded ones
+    Request a(OpCode::PUT, {'k'}, {'v'});
+    Request b(OpCode::DELETE, {'k'});
+    std::vector<uint8_t> batch;
+    Protocol::appendRequest(batch, a);
+    Protocol::appendRequest(batch, b);
+    std::vector<uint8_t> expected = Protocol::encodeRequest(a);
+    std::vector<uint8_t> encoded_b = Protocol::encodeRequest(b);
+    expected.insert(expected.end(), encoded_b.begin(), encoded_b.end());
+    assert(batch == expected);
+    
+    std::cout << "✓ test_response_frame_size_and_append passed" << std::endl;
+}
+
+void test_batch_encoding() {
+    std::vector<BatchEntry> entries;
+    entries.emplace_back("alpha", std::vector<uint8_t>{1, 2, 3});
+    entries.emplace_back("", std::vector<uint8_t>());
+    entries.emplace_back("gamma");
+    
+    std::vector<uint8_t> encoded = Protocol::encodeBatch(entries);
+    std::vector<BatchEntry> decoded;
+    assert(Protocol::decodeBatch(encoded.data(), encoded.size(), decoded));
+    assert(decoded.size() == 3);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        assert(decoded[i].key == entries[i].key);
+        assert(decoded[i].value == entries[i].value);
+    }
+    
+    // Truncated, trailing-garbage and oversized-count payloads are rejected
+    assert(!Protocol::decodeBatch(encoded.data(), encoded.size() - 1, decoded));
+    std::vector<uint8_t> padded = encoded;
+    padded.push_back(0);
+    assert(!Protocol::decodeBatch(padded.data(), padded.size(), decoded));
+    std::vector<uint8_t> huge_count = {0xFF, 0xFF, 0xFF, 0xFF};
+    assert(!Protocol::decodeBatch(huge_count.data(), huge_count.size(), decoded));
+    
+    std::vector<BatchResult> results(2);
+    results[0].status = StatusCode::SUCCESS;
+    results[0].value = {'v'};
+    results[1].status = StatusCode::KEY_NOT_FOUND;
+    encoded = Protocol::encodeBatchResults(results);
+    std::vector<BatchResult> decoded_results;
+    assert(Protocol::decodeBatchResults(encoded.data(), encoded.size(), decoded_results));
+    assert(decoded_results.size() == 2);
+    assert(decoded_results[0].status == StatusCode::SUCCESS);
+    assert(decoded_results[0].value == std::vector<uint8_t>({'v'}));
+    assert(decoded_results[1].status == StatusCode::KEY_NOT_FOUND);
+    assert(decoded_results[1].value.empty());
+    assert(!Protocol::decodeBatchResults(encoded.data(), encoded.size() - 1, decoded_results));
+    
+    assert(Protocol::isBatchOpcode(OpCode::MULTI_PUT));
+    assert(!Protocol::isBatchOpcode(OpCode::PUT));
+    
+    std::cout << "✓ test_batch_encoding passed" << std::endl;
+}
+
+void test_header_encoders_match_frames() {
+    Request request(OpCode::DELETE, {'x', 'y', 'z'}, {'v'});
+    std::vector<uint8_t> encoded = Protocol::encodeRequest(request);
+    
+    uint8_t prefix[5];
+    uint8_t value_len[4];
+    Protocol::encodeRequestPrefix(request.opcode, 3, prefix);
+    Protocol::encodeLength(1, value_len);
+    assert(std::memcmp(prefix, encoded.data(), 5) == 0);
+    assert(std::memcmp(value_len, encoded.data() + 8, 4) == 0);
+    
+    Response response(StatusCode::KEY_NOT_FOUND, {'a', 'b'});
+    std::vector<uint8_t> encoded_response = Protocol::encodeResponse(response);
+    uint8_t header[5];
+    Protocol::encodeResponseHeader(response.status, 2, header);
+    assert(std::memcmp(header, encoded_response.data(), 5) == 0);
+    
+    std::cout << "✓ test_header_encoders_match_frames passed" << std::endl;
+}
+
+void test_node_list_encoding() {
+    std::vector<std::string> nodes = {"127.0.0.1:9001", "10.0.0.2:80", "host:65535"};
+    std::vector<uint8_t> encoded = Protocol::encodeNodeList(nodes);
+    std::vector<std::string> decoded;
+    Protocol::decodeNodeList(encoded.data(), encoded.size(), decoded);
+    assert(decoded == nodes);
+    
+    Protocol::decodeNodeList(nullptr, 0, decoded);
+    assert(decoded.empty());
+    
+    // Empty items are skipped
+    std::string sparse = ",a:1,,b:2,";
+    Protocol::decodeNodeList(reinterpret_cast<const uint8_t*>(sparse.data()), sparse.size(), decoded);
+    assert(decoded.size() == 2 && decoded[0] == "a:1" && decoded[1] == "b:2");
+    
+    std::cout << "✓ test_node_list_encoding passed" << std::endl;
+}
+
+void test_read_consistency_byte() {
+    ReadConsistency consistency = ReadConsistency::ANY;
+    assert(Protocol::decodeReadConsistency({}, consistency));
+    assert(consistency == ReadConsistency::PRIMARY);
+    assert(Protocol::decodeReadConsistency({1}, consistency));
+    assert(consistency == ReadConsistency::ANY);
+    assert(Protocol::decodeReadConsistency({2}, consistency));
+    assert(consistency == ReadConsistency::QUORUM);
+    assert(!Protocol::decodeReadConsistency({3}, consistency));
+    assert(!Protocol::decodeReadConsistency({1, 0}, consistency));
+    
+    std::cout << "✓ test_read_consistency_byte passed" << std::endl;
+}
+
+void test_versioned_values() {
+    std::vector<uint8_t> value = {'v', 'a', 'l'};
+    std::vector<uint8_t> encoded = Protocol::encodeVersioned(0x0102030405060708ULL, value);
+    assert(encoded.size() == 8 + value.size());
+    assert(encoded[0] == 0x01 && encoded[7] == 0x08);
+    
+    uint64_t version = 0;
+    assert(Protocol::decodeVersioned(encoded, version));
+    assert(version == 0x0102030405060708ULL);
+    assert(encoded == value);
+    
+    // A bare version, as REPLICATE_DELETE and CAS replies carry it
+    std::vector<uint8_t> bare = Protocol::encodeVersioned(42, nullptr, 0);
+    assert(Protocol::decodeVersioned(bare, version) && version == 42 && bare.empty());
+    std::vector<uint8_t> short_data = {1, 2, 3};
+    assert(!Protocol::decodeVersioned(short_data, version));
+    assert(Protocol::opcodeName(OpCode::CAS) == "CAS");
+    
+    std::cout << "✓ test_versioned_values passed" << std::endl;
+}
+
+void test_ttl_values() {
+    std::vector<uint8_t> value = {'t'};
+    uint64_t ttl = 0;
+    std::vector<uint8_t> encoded = Protocol::encodeVersioned(1500, value);
+    assert(Protocol::decodeTtl(encoded, ttl) && ttl == 1500 && encoded == value);
+    
+    // 0 would expire the key at once; a huge TTL would wrap the expiry time
+    std::vector<uint8_t> zero = Protocol::encodeVersioned(0, value);
+    assert(!Protocol::decodeTtl(zero, ttl));
+    std::vector<uint8_t> huge = Protocol::encodeVersioned(UINT64_MAX, value);
+    assert(Protocol::decodeTtl(huge, ttl) && ttl == Protocol::MAX_TTL_MS);
+    std::vector<uint8_t> short_data = {1, 2, 3};
+    assert(!Protocol::decodeTtl(short_data, ttl));
+    
+    std::cout << "✓ test_ttl_values passed" << std::endl;
+}
+
+void test_compressed_flag() {
+    std::vector<uint8_t> key = {'k'};
+    std::vector<uint8_t> value = {1, 2, 3};
+    
+    // The flag rides in the high bit of the opcode and status bytes
+    Request request(OpCode::PUT, key, value);
+    request.compressed = true;
+    std::vector<uint8_t> encoded = Protocol::encodeRequest(request);
+    assert(encoded[0] == (static_cast<uint8_t>(OpCode::PUT) | Protocol::COMPRESSED_FLAG));
+    Request decoded;
+    assert(Protocol::decodeRequest(encoded, decoded));
+    assert(decoded.opcode == OpCode::PUT && decoded.compressed && decoded.value == value);
+    RequestView view;
+    assert(Protocol::decodeRequestView(encoded.data(), encoded.size(), view));
+    assert(view.opcode == OpCode::PUT && view.compressed);
+    assert(Protocol::decodeRequest(Protocol::encodeRequest(Request(OpCode::PUT, key, value)), decoded));
+    assert(!decoded.compressed);
+    
+    Response response(StatusCode::SUCCESS, value);
+    response.compressed = true;
+    Response decoded_response;
+    assert(Protocol::decodeResponse(Protocol::encodeResponse(response), decoded_response));
+    assert(decoded_response.status == StatusCode::SUCCESS && decoded_response.compressed);
+    bool compressed = false;
+    assert(Protocol::decodeStatus(static_cast<uint8_t>(StatusCode::KEY_NOT_FOUND), compressed) ==
+           StatusCode::KEY_NOT_FOUND && !compressed);
+    
+    // Stored values carry the flag after their version
+    std::vector<uint8_t> stored = Protocol::encodeStored(77, true, value);
+    assert(stored.size() == 9 + value.size());
+    uint64_t version = 0;
+    assert(Protocol::decodeStored(stored, version, compressed));
+    assert(version == 77 && compressed && stored == value);
+    stored = Protocol::encodeStored(5, false, nullptr, 0);
+    assert(Protocol::decodeStored(stored, version, compressed) && version == 5 && !compressed && stored.empty());
+    std::vector<uint8_t> bare = Protocol::encodeVersioned(5, nullptr, 0);
+    assert(!Protocol::decodeStored(bare, version, compressed));
+    
+    // ... and an expiry time after the flags if they say so
+    uint64_t expires = 0;
+    stored = Protocol::encodeStored(9, true, value, 123456789);
+    assert(stored.size() == 17 + value.size());
+    assert(Protocol::decodeStored(stored, version, compressed, &expires));
+    assert(version == 9 && compressed && expires == 123456789 && stored == value);
+    stored = Protocol::encodeStored(9, false, value);
+    assert(Protocol::decodeStored(stored, version, compressed, &expires) && expires == 0);
+    stored = Protocol::encodeStored(9, false, nullptr, 0, 1);
+    stored.pop_back();
+    assert(!Protocol::decodeStored(stored, version, compressed, &expires));
+    assert(Protocol::opcodeName(OpCode::PUT_TTL) == "PUT_TTL");
+    
+    std::cout << "✓ test_compressed_flag passed" << std::endl;
+}
+
+void test_scan_encoding() {
+    std::vector<uint8_t> cursor = {1, 2, 3, 4};
+    std::vector<uint8_t> request = Protocol::encodeScanRequest(Protocol::SCAN_LOCAL, 50, 4096, cursor);
+    uint8_t flags = 0;
+    uint32_t max_entries = 0;
+    uint32_t max_bytes = 0;
+    std::vector<uint8_t> decoded_cursor;
+    assert(Protocol::decodeScanRequest(request.data(), request.size(), flags, max_entries, max_bytes,
+                                       decoded_cursor));
+    assert(flags == Protocol::SCAN_LOCAL && max_entries == 50 && max_bytes == 4096 && decoded_cursor == cursor);
+    
+    // Zero means the defaults, and oversized limits are capped
+    request = Protocol::encodeScanRequest(0, 0, 0, {});
+    assert(Protocol::decodeScanRequest(request.data(), request.size(), flags, max_entries, max_bytes,
+                                       decoded_cursor));
+    assert(max_entries == Protocol::SCAN_DEFAULT_ENTRIES && max_bytes == Protocol::SCAN_MAX_BYTES);
+    assert(decoded_cursor.empty());
+    request = Protocol::encodeScanRequest(0, 1u << 30, 1u << 30, {});
+    assert(Protocol::decodeScanRequest(request.data(), request.size(), flags, max_entries, max_bytes,
+                                       decoded_cursor));
+    assert(max_entries == Protocol::SCAN_MAX_ENTRIES && max_bytes == Protocol::SCAN_MAX_BYTES);
+    assert(!Protocol::decodeScanRequest(request.data(), 8, flags, max_entries, max_bytes, decoded_cursor));
+    
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> entries = {{"a", {1}}, {"b", {}}};
+    std::vector<uint8_t> reply = Protocol::encodeScanReply(cursor, entries);
+    std::vector<BatchEntry> decoded;
+    assert(Protocol::decodeScanReply(reply.data(), reply.size(), decoded_cursor, decoded));
+    assert(decoded_cursor == cursor && decoded.size() == 2);
+    assert(decoded[0].key == "a" && decoded[0].value == std::vector<uint8_t>{1} && decoded[1].value.empty());
+    assert(!Protocol::decodeScanReply(reply.data(), 6, decoded_cursor, decoded));
+    assert(Protocol::opcodeName(OpCode::SCAN) == "SCAN");
+    
+    std::cout << "✓ test_scan_encoding passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running protocol tests..." << std::endl;
     
@@ -149,6 +445,17 @@ int main() {
     test_large_data();
     test_all_opcodes();
     test_all_status_codes();
+    test_decode_request_view();
+    test_request_frame_size();
+    test_response_frame_size_and_append();
+    test_batch_encoding();
+    test_header_encoders_match_frames();
+    test_node_list_encoding();
+    test_read_consistency_byte();
+    test_versioned_values();
+    test_ttl_values();
+    test_compressed_flag();
+    test_scan_encoding();
     
     std::cout << "\nAll protocol tests passed!" << std::endl;
     return 0;
@@ -0,0 +1,164 @@
+#include "../include/read_cache.h"
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+
+using namespace funnelkvs;
+
+namespace {
+
+std::vector<uint8_t> bytes(const std::string& s) {
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+const std::chrono::milliseconds LEASE(60000);
+
+// Read key a few times so the sketch counts it
+void warm(ReadCache& cache, const std::string& key, int reads) {
+    std::vector<uint8_t> value;
+    for (int i = 0; i < reads; ++i) {
+        cache.get(key, value);
+    }
+}
+
+} // namespace
+
+void test_get_put_invalidate() {
+    ReadCache cache(1024 * 1024, 4);
+    std::vector<uint8_t> value;
+    assert(!cache.get("k", value));
+
+    assert(cache.put("k", bytes("v1"), LEASE, cache.ticket("k")));
+    assert(cache.get("k", value) && value == bytes("v1"));
+    assert(cache.put("k", bytes("v2"), LEASE, cache.ticket("k")));
+    assert(cache.get("k", value) && value == bytes("v2"));
+
+    cache.invalidate("k");
+    assert(!cache.get("k", value));
+
+    // A fetch that started before the invalidation must not be cached
+    uint64_t ticket = cache.ticket("k");
+    cache.invalidate("k");
+    assert(!cache.put("k", bytes("stale"), LEASE, ticket));
+    assert(!cache.get("k", value));
+
+    // No lease, nothing to cache
+    assert(!cache.put("k", bytes("v3"), std::chrono::milliseconds(0), cache.ticket("k")));
+
+    ReadCache::Stats stats = cache.stats();
+    assert(stats.hits == 2);
+    assert(stats.invalidations == 1);
+    assert(stats.rejections == 2);
+    assert(stats.entries == 0 && stats.bytes == 0);
+
+    cache.put("a", bytes("1"), LEASE, cache.ticket("a"));
+    cache.put("b", bytes("2"), LEASE, cache.ticket("b"));
+    cache.clear();
+    assert(!cache.get("a", value) && !cache.get("b", value));
+    assert(cache.stats().entries == 0);
+    std::cout << "✓ test_get_put_invalidate passed" << std::endl;
+}
+
+void test_lease_expiry() {
+    ReadCache cache(1024 * 1024, 1);
+    assert(cache.put("short", bytes("v"), std::chrono::milliseconds(20), cache.ticket("short")));
+    std::vector<uint8_t> value;
+    assert(cache.get("short", value));
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    assert(!cache.get("short", value));
+    assert(cache.stats().entries == 0);
+    std::cout << "✓ test_lease_expiry passed" << std::endl;
+}
+
+void test_frequency_admission() {
+    // One shard with room for about ten 200-byte values
+    const size_t CAPACITY = 10 * (200 + 8 + ReadCache::ENTRY_OVERHEAD);
+    ReadCache cache(CAPACITY, 1);
+    std::vector<uint8_t> payload(200, 'x');
+
+    std::vector<std::string> hot;
+    for (int i = 0; i < 8; ++i) {
+        hot.push_back("hot_" + std::to_string(i));
+        warm(cache, hot.back(), 6);
+        assert(cache.put(hot.back(), payload, LEASE, cache.ticket(hot.back())));
+        warm(cache, hot.back(), 2); // into the protected segment
+    }
+
+    // A scan of keys read once each cannot push the hot set out
+    for (int i = 0; i < 200; ++i) {
+        std::string key = "scan_" + std::to_string(i);
+        warm(cache, key, 1);
+        cache.put(key, payload, LEASE, cache.ticket(key));
+    }
+    std::vector<uint8_t> value;
+    for (const auto& key : hot) {
+        assert(cache.get(key, value) && value == payload);
+    }
+    ReadCache::Stats stats = cache.stats();
+    assert(stats.rejections > 0);
+    assert(stats.bytes <= CAPACITY);
+
+    // A key that becomes popular does get in
+    warm(cache, "rising", 10);
+    assert(cache.put("rising", payload, LEASE, cache.ticket("rising")));
+    assert(cache.get("rising", value));
+    assert(cache.stats().bytes <= CAPACITY);
+
+    // should_cache: cached keys and often-read keys, not one-offs
+    assert(cache.should_cache("rising"));
+    assert(!cache.should_cache("once"));
+    for (int i = 0; i < ReadCache::HOT_READS; ++i) {
+        cache.should_cache("often");
+    }
+    assert(cache.should_cache("often"));
+
+    // Nothing bigger than an eighth of the shard
+    std::vector<uint8_t> huge(CAPACITY / 4, 'h');
+    warm(cache, "huge", 10);
+    assert(!cache.put("huge", huge, LEASE, cache.ticket("huge")));
+    std::cout << "✓ test_frequency_admission passed" << std::endl;
+}
+
+void test_concurrent_access() {
+    ReadCache cache(256 * 1024, 8);
+    const int THREADS = 8;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&cache, t] {
+            std::vector<uint8_t> value;
+            for (int i = 0; i < 5000; ++i) {
+                std::string key = "key_" + std::to_string((i * 7 + t) % 300);
+                if (!cache.get(key, value)) {
+                    cache.put(key, std::vector<uint8_t>(100, static_cast<uint8_t>(i)),
+                              LEASE, cache.ticket(key));
+                }
+                if (i % 50 == 0) {
+                    cache.invalidate(key);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ReadCache::Stats stats = cache.stats();
+    assert(stats.hits + stats.misses == THREADS * 5000);
+    assert(stats.hits > 0);
+    assert(stats.bytes <= cache.capacity());
+    std::cout << "✓ test_concurrent_access passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running read cache tests..." << std::endl;
+
+    test_get_put_invalidate();
+    test_lease_expiry();
+    test_frequency_admission();
+    test_concurrent_access();
+
+    std::cout << "\nAll read cache tests passed!" << std::endl;
+    return 0;
+}
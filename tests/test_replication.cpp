@@ -1,5 +1,7 @@
 #include "../include/replication.h"
 #include "../include/chord.h"
+#include "../include/server.h"
+#include "../include/heartbeat.h"
 #include <iostream>
 #include <cassert>
 #include <thread>
@@ -193,6 +195,278 @@ void test_network_error_handling() {
     std::cout << "✓ test_network_error_handling passed" << std::endl;
 }
 
+// Replica that answers every request only after a delay
+class SlowServer : public Server {
+public:
+    SlowServer(uint16_t port, int delay) : Server(port, 2), delay_ms(delay) {}
+    
+protected:
+    void process_request(Request& request, Response& response) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        Server::process_request(request, response);
+    }
+    
+private:
+    int delay_ms;
+};
+
+static std::shared_ptr<NodeInfo> local_node(uint16_t port) {
+    return std::make_shared<NodeInfo>(NodeInfo::from_address("127.0.0.1", port));
+}
+
+void test_quorum_write_tolerates_dead_replica() {
+    Server first(8201, 2);
+    Server second(8202, 2);
+    first.start();
+    second.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    // Three replicas, one of which refuses connections
+    std::vector<std::shared_ptr<NodeInfo>> replicas = {local_node(8201), local_node(8209), local_node(8202)};
+    std::vector<uint8_t> value = {'q', 'w'};
+    
+    ReplicationManager::ReplicationConfig config;
+    config.replication_factor = 4;
+    ReplicationManager all_replicas(config);
+    assert(!all_replicas.replicate_put("quorum_key", value, replicas));
+    
+    config.write_quorum = 3; // coordinator + 2 replicas
+    ReplicationManager quorum(config);
+    assert(quorum.get_write_quorum() == 3);
+    assert(quorum.replicate_put("quorum_key", value, replicas));
+    
+    // Both live replicas hold the value, stored via REPLICATE
+    Client client("127.0.0.1", 8201);
+    assert(client.connect());
+    std::vector<uint8_t> stored;
+    assert(client.get("quorum_key", stored));
+    assert(stored == value);
+    
+    assert(quorum.replicate_delete("quorum_key", replicas));
+    assert(!client.get("quorum_key", stored));
+    
+    first.stop();
+    second.stop();
+    std::cout << "✓ test_quorum_write_tolerates_dead_replica passed" << std::endl;
+}
+
+void test_quorum_write_does_not_wait_for_stragglers() {
+    Server fast(8203, 2);
+    SlowServer slow(8204, 600);
+    fast.start();
+    slow.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    std::vector<std::shared_ptr<NodeInfo>> replicas = {local_node(8204), local_node(8203)};
+    std::vector<uint8_t> value = {'s'};
+    
+    ReplicationManager::ReplicationConfig config;
+    config.replication_factor = 3;
+    config.write_quorum = 2;
+    ReplicationManager replicator(config);
+    
+    auto start = std::chrono::steady_clock::now();
+    assert(replicator.replicate_put("straggler_key", value, replicas));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    assert(elapsed < std::chrono::milliseconds(400));
+    
+    // The slow replica still receives the write in the background
+    std::this_thread::sleep_for(std::chrono::milliseconds(900));
+    Client client("127.0.0.1", 8204);
+    assert(client.connect());
+    std::vector<uint8_t> stored;
+    assert(client.replica_get("straggler_key", stored));
+    assert(stored == value);
+    assert(replicator.get_straggler_failures() == 0);
+    
+    fast.stop();
+    slow.stop();
+    std::cout << "✓ test_quorum_write_does_not_wait_for_stragglers passed" << std::endl;
+}
+
+void test_parallel_replica_reads() {
+    Server holder(8205, 2);
+    Server empty(8206, 2);
+    holder.start();
+    empty.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    Client client("127.0.0.1", 8205);
+    assert(client.connect());
+    assert(client.replicate("read_key", {'r'}));
+    
+    std::vector<std::shared_ptr<NodeInfo>> replicas = {local_node(8206), local_node(8205)};
+    ReplicationManager replicator;
+    std::vector<uint8_t> value;
+    assert(replicator.get_from_replicas("read_key", value, replicas));
+    assert(value == std::vector<uint8_t>({'r'}));
+    assert(!replicator.get_from_replicas("absent_key", value, replicas));
+    
+    holder.stop();
+    empty.stop();
+    std::cout << "✓ test_parallel_replica_reads passed" << std::endl;
+}
+
+void test_async_stream_coalesces_and_drains() {
+    SlowServer replica(8207, 200);
+    replica.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    ReplicationManager::ReplicationConfig config;
+    config.replication_factor = 2;
+    config.enable_async_replication = true;
+    ReplicationManager replicator(config);
+    std::vector<std::shared_ptr<NodeInfo>> replicas = {local_node(8207)};
+    
+    // The first write goes out alone; overwrites of the hot key pile up
+    // behind the slow replica and collapse into one queued operation
+    for (int i = 0; i < 100; ++i) {
+        assert(replicator.replicate_put("hot", {static_cast<uint8_t>(i)}, replicas));
+    }
+    for (int i = 0; i < 20; ++i) {
+        assert(replicator.replicate_put("cold" + std::to_string(i), {'c'}, replicas));
+    }
+    assert(replicator.replicate_delete("cold0", replicas));
+    
+    auto stats = replicator.get_stream_stats();
+    assert(stats.size() == 1);
+    assert(stats[0].pending_ops > 0);
+    assert(stats[0].coalesced_ops >= 98);
+    assert(replicator.get_max_replication_lag_ms() >= 0);
+    
+    assert(replicator.flush_async(std::chrono::milliseconds(10000)));
+    stats = replicator.get_stream_stats();
+    assert(stats[0].pending_ops == 0);
+    assert(stats[0].pending_bytes == 0);
+    assert(stats[0].lag_ms == 0);
+    // Far fewer round trips than operations
+    assert(stats[0].batches_sent <= 4);
+    
+    Client client("127.0.0.1", 8207);
+    assert(client.connect());
+    std::vector<uint8_t> value;
+    assert(client.replica_get("hot", value));
+    assert(value == std::vector<uint8_t>({99}));
+    assert(client.replica_get("cold19", value));
+    assert(!client.replica_get("cold0", value));
+    
+    replicator.stop_async_processing();
+    replica.stop();
+    std::cout << "✓ test_async_stream_coalesces_and_drains passed" << std::endl;
+}
+
+void test_async_stream_backpressure() {
+    ReplicationManager::ReplicationConfig config;
+    config.replication_factor = 2;
+    config.enable_async_replication = true;
+    config.sync_timeout_ms = 100;
+    config.async_max_pending_bytes = 1024;
+    ReplicationManager replicator(config);
+    
+    // Nothing listens here, so queued bytes are never released quickly
+    std::vector<std::shared_ptr<NodeInfo>> replicas = {local_node(8208)};
+    std::vector<uint8_t> value(600, 'b');
+    
+    assert(replicator.replicate_put("first", value, replicas));
+    auto start = std::chrono::steady_clock::now();
+    assert(!replicator.replicate_put("second", value, replicas));
+    assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(90));
+    
+    auto stats = replicator.get_stream_stats();
+    assert(stats.size() == 1);
+    assert(stats[0].rejected_ops == 1);
+    assert(stats[0].pending_bytes <= config.async_max_pending_bytes);
+    assert(stats[0].lag_ms >= 90);
+    
+    replicator.stop_async_processing();
+    assert(replicator.get_stream_stats().empty());
+    std::cout << "✓ test_async_stream_backpressure passed" << std::endl;
+}
+
+void test_phi_accrual_piggybacked_heartbeats() {
+    FailureDetector::FailureConfig config;
+    config.ping_interval_ms = 50;
+    config.min_std_dev_ms = 10;
+    FailureDetector detector(config);
+    
+    // Nothing listens here: every probe fails, so only the stamps that
+    // other traffic leaves in the registry keep the node alive
+    auto node = local_node(8219);
+    std::string node_key = "127.0.0.1:8219";
+    for (int round = 0; round < 20; ++round) {
+        HeartbeatRegistry::instance().heard(node_key);
+        detector.probe({node});
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    assert(!detector.is_node_failed(node));
+    FailureDetector::Stats stats = detector.get_stats();
+    assert(stats.rounds == 20);
+    assert(stats.probes_skipped >= 19); // freshly heard from: no PING needed
+    
+    // Silence: phi climbs past the threshold well within a second
+    auto silent_since = std::chrono::steady_clock::now();
+    while (!detector.is_node_failed(node)) {
+        assert(std::chrono::steady_clock::now() - silent_since < std::chrono::milliseconds(1000));
+        detector.probe({node});
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    assert(detector.is_node_suspected(node));
+    assert(detector.phi(node) >= config.phi_threshold);
+    assert(detector.get_stats().failures_detected == 1);
+    assert(detector.get_failed_nodes().size() == 1);
+    
+    // A later heartbeat revives it
+    HeartbeatRegistry::instance().heard(node_key);
+    detector.probe({node});
+    assert(!detector.is_node_failed(node));
+    
+    // Rounds that leave the node out do not count against it once it is
+    // watched again
+    for (int round = 0; round < 30; ++round) {
+        detector.probe({});
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    detector.probe({node});
+    assert(!detector.is_node_failed(node));
+    
+    std::cout << "✓ test_phi_accrual_piggybacked_heartbeats passed" << std::endl;
+}
+
+void test_probe_rounds_detect_stopped_server() {
+    Server server(8210, 2);
+    server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    FailureDetector::FailureConfig config;
+    config.ping_interval_ms = 50;
+    config.ping_timeout_ms = 200;
+    FailureDetector detector(config);
+    auto node = local_node(8210);
+    for (int round = 0; round < 20; ++round) {
+        detector.probe({node});
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    assert(!detector.is_node_failed(node));
+    assert(detector.get_stats().probes_sent > 0);
+    
+    server.stop();
+    auto stopped_at = std::chrono::steady_clock::now();
+    while (!detector.is_node_failed(node)) {
+        assert(std::chrono::steady_clock::now() - stopped_at < std::chrono::milliseconds(1000));
+        detector.probe({node});
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    
+    // A node that never answered is failed by missed probes alone
+    auto never_seen = local_node(8218);
+    for (int round = 0; round < config.failure_threshold + 2 && !detector.is_node_failed(never_seen); ++round) {
+        detector.ping_node(never_seen);
+    }
+    assert(detector.is_node_failed(never_seen));
+    
+    std::cout << "✓ test_probe_rounds_detect_stopped_server passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running replication and failure detection tests..." << std::endl;
     std::cout << std::endl;
@@ -207,6 +481,13 @@ int main() {
     test_failure_detector_cleanup();
     test_concurrent_replication_operations();
     test_network_error_handling();
+    test_quorum_write_tolerates_dead_replica();
+    test_quorum_write_does_not_wait_for_stragglers();
+    test_parallel_replica_reads();
+    test_async_stream_coalesces_and_drains();
+    test_async_stream_backpressure();
+    test_phi_accrual_piggybacked_heartbeats();
+    test_probe_rounds_detect_stopped_server();
     
     std::cout << std::endl;
     std::cout << "All replication tests passed!" << std::endl;
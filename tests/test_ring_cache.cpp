@@ -0,0 +1,136 @@
+#include "../include/ring_cache.h"
+#include <iostream>
+#include <cassert>
+
+using namespace funnelkvs;
+
+void test_owner_selection() {
+    RingCache ring;
+    std::string owner;
+    assert(!ring.owner_of(SHA1::hash("key"), owner));
+    
+    std::vector<std::string> endpoints = {"127.0.0.1:7001", "127.0.0.1:7002", "127.0.0.1:7003"};
+    ring.add(endpoints);
+    ring.add("127.0.0.1:7002"); // duplicates are ignored
+    ring.add("not-an-endpoint");
+    assert(ring.size() == 3);
+    
+    // The owner is the first node clockwise from the key, as on the servers
+    for (int i = 0; i < 100; ++i) {
+        Hash160 id = SHA1::hash("key_" + std::to_string(i));
+        assert(ring.owner_of(id, owner));
+        Hash160 owner_id = SHA1::hash(owner);
+        for (const auto& other : endpoints) {
+            Hash160 other_id = SHA1::hash(other);
+            if (other != owner) {
+                // No other node lies between the key and its owner
+                assert(!in_range(other_id, id, owner_id, true) || other_id == id);
+            }
+        }
+    }
+    
+    // A node owns its own id
+    for (const auto& endpoint : endpoints) {
+        assert(ring.owner_of(SHA1::hash(endpoint), owner));
+        assert(owner == endpoint);
+    }
+    
+    std::cout << "✓ test_owner_selection passed" << std::endl;
+}
+
+void test_membership_changes() {
+    RingCache ring;
+    ring.add("10.0.0.1:80");
+    assert(ring.contains("10.0.0.1:80"));
+    
+    std::string owner;
+    assert(ring.owner_of(SHA1::hash("anything"), owner));
+    assert(owner == "10.0.0.1:80");
+    
+    ring.add("10.0.0.2:80");
+    assert(ring.nodes().size() == 2);
+    assert(ring.remove("10.0.0.1:80"));
+    assert(!ring.remove("10.0.0.1:80"));
+    assert(ring.owner_of(SHA1::hash("anything"), owner));
+    assert(owner == "10.0.0.2:80");
+    
+    std::cout << "✓ test_membership_changes passed" << std::endl;
+}
+
+void test_split_endpoint() {
+    std::string host;
+    uint16_t port = 0;
+    assert(RingCache::split_endpoint("127.0.0.1:9001", host, port));
+    assert(host == "127.0.0.1" && port == 9001);
+    assert(!RingCache::split_endpoint("127.0.0.1", host, port));
+    assert(!RingCache::split_endpoint(":9001", host, port));
+    assert(!RingCache::split_endpoint("host:", host, port));
+    assert(!RingCache::split_endpoint("host:70000", host, port));
+    assert(!RingCache::split_endpoint("host:12a", host, port));
+    
+    // Ring positions of a server with several tokens
+    uint16_t token = 7;
+    assert(RingCache::split_endpoint("127.0.0.1:9001", host, port, &token) && token == 0);
+    assert(RingCache::split_endpoint("127.0.0.1:9001#12", host, port, &token));
+    assert(host == "127.0.0.1" && port == 9001 && token == 12);
+    assert(RingCache::split_endpoint("127.0.0.1:9001#12", host, port));
+    assert(!RingCache::split_endpoint("127.0.0.1:9001#", host, port, &token));
+    assert(!RingCache::split_endpoint("127.0.0.1:9001#x", host, port, &token));
+    assert(!RingCache::split_endpoint("127.0.0.1:9001#70000", host, port, &token));
+    assert(!RingCache::split_endpoint("127.0.0.1#3", host, port, &token));
+    
+    std::cout << "✓ test_split_endpoint passed" << std::endl;
+}
+
+void test_replica_selection() {
+    RingCache ring;
+    assert(ring.replicas_of(SHA1::hash("key"), 3).empty());
+    
+    // Three servers, two ring positions each
+    for (int port = 7001; port <= 7003; ++port) {
+        ring.add("127.0.0.1:" + std::to_string(port));
+        ring.add("127.0.0.1:" + std::to_string(port) + "#1");
+    }
+    for (int i = 0; i < 100; ++i) {
+        Hash160 id = SHA1::hash("key_" + std::to_string(i));
+        std::string owner;
+        assert(ring.owner_of(id, owner));
+        std::vector<std::string> replicas = ring.replicas_of(id, 3);
+        assert(replicas.size() == 3);
+        assert(replicas[0] == owner);
+        
+        // One copy per server, and no server skipped on the way
+        std::string host;
+        uint16_t ports[3] = {0, 0, 0};
+        for (int r = 0; r < 3; ++r) {
+            assert(RingCache::split_endpoint(replicas[r], host, ports[r]));
+        }
+        assert(ports[0] != ports[1] && ports[1] != ports[2] && ports[0] != ports[2]);
+        Hash160 second_id = SHA1::hash(replicas[1]);
+        for (const auto& node : ring.nodes()) {
+            uint16_t port = 0;
+            RingCache::split_endpoint(node, host, port);
+            Hash160 node_id = SHA1::hash(node);
+            if (port != ports[0] && node_id != second_id) {
+                assert(!in_range(node_id, SHA1::hash(owner), second_id, false));
+            }
+        }
+        assert(ring.replicas_of(id, 1) == std::vector<std::string>(1, owner));
+    }
+    // Never more copies than servers
+    assert(ring.replicas_of(SHA1::hash("key"), 5).size() == 3);
+    
+    std::cout << "✓ test_replica_selection passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running ring cache tests..." << std::endl;
+    
+    test_owner_selection();
+    test_membership_changes();
+    test_split_endpoint();
+    test_replica_selection();
+    
+    std::cout << "\nAll ring cache tests passed!" << std::endl;
+    return 0;
+}
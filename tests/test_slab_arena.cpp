@@ -0,0 +1,131 @@
+#include "../include/slab_arena.h"
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace funnelkvs;
+
+void test_size_classes() {
+    assert(SlabArena::capacity(1) == 16);
+    assert(SlabArena::capacity(16) == 16);
+    assert(SlabArena::capacity(17) == 24);
+    assert(SlabArena::capacity(100) == 112);
+    assert(SlabArena::capacity(4096) == 4096);
+    assert(SlabArena::capacity(4097) == 4097);
+
+    // Every class is a multiple of the alignment and wastes at most ~20%
+    for (size_t size = 16; size <= SlabArena::MAX_SLOT_SIZE; ++size) {
+        size_t cap = SlabArena::capacity(size);
+        assert(cap >= size);
+        assert(cap % SlabArena::ALIGNMENT == 0);
+        assert(cap - size <= size / 4 + SlabArena::ALIGNMENT);
+    }
+
+    std::cout << "✓ test_size_classes passed" << std::endl;
+}
+
+void test_allocate_and_reuse() {
+    SlabArena arena;
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 1000; ++i) {
+        void* p = arena.allocate(100);
+        assert(reinterpret_cast<uintptr_t>(p) % SlabArena::ALIGNMENT == 0);
+        std::memset(p, i & 0xFF, 100);
+        ptrs.push_back(p);
+    }
+    // Slots never overlap
+    std::set<void*> distinct(ptrs.begin(), ptrs.end());
+    assert(distinct.size() == ptrs.size());
+    for (int i = 0; i < 1000; ++i) {
+        assert(static_cast<uint8_t*>(ptrs[i])[99] == (i & 0xFF));
+    }
+
+    SlabArena::Stats stats = arena.stats();
+    assert(stats.allocations == 1000);
+    assert(stats.slot_bytes == 1000 * SlabArena::capacity(100));
+    assert(stats.slab_bytes >= stats.slot_bytes);
+    assert(stats.large_bytes == 0);
+
+    // Freed slots are handed out again before any new slab is reserved,
+    // including to requests of a different size in the same class
+    for (void* p : ptrs) {
+        arena.deallocate(p, 100);
+    }
+    assert(arena.stats().allocations == 0);
+    assert(arena.stats().slot_bytes == 0);
+    for (int i = 0; i < 1000; ++i) {
+        void* p = arena.allocate(i % 2 ? 100 : 112);
+        assert(distinct.count(p) == 1);
+    }
+    assert(arena.stats().slab_bytes == stats.slab_bytes);
+
+    std::cout << "✓ test_allocate_and_reuse passed" << std::endl;
+}
+
+void test_large_allocations() {
+    SlabArena arena;
+    void* small = arena.allocate(64);
+    void* large = arena.allocate(100000);
+    std::memset(large, 'x', 100000);
+
+    SlabArena::Stats stats = arena.stats();
+    assert(stats.large_bytes == 100000);
+    assert(stats.allocations == 2);
+    assert(stats.slab_bytes == SlabArena::SLAB_SIZE);
+
+    arena.deallocate(large, 100000);
+    arena.deallocate(small, 64);
+    arena.deallocate(nullptr, 64);
+    assert(arena.stats().large_bytes == 0);
+    assert(arena.stats().allocations == 0);
+
+    std::cout << "✓ test_large_allocations passed" << std::endl;
+}
+
+void test_container_allocator() {
+    SlabArena arena;
+    {
+        typedef std::map<int, std::string, std::less<int>,
+                         ArenaAllocator<std::pair<const int, std::string>>> ArenaMap;
+        ArenaMap map{std::less<int>(), ArenaAllocator<std::pair<const int, std::string>>(&arena)};
+        for (int i = 0; i < 500; ++i) {
+            map[i] = std::to_string(i);
+        }
+        assert(map.size() == 500);
+        assert(map[250] == "250");
+        assert(arena.stats().allocations == 500);
+
+        for (int i = 0; i < 500; i += 2) {
+            map.erase(i);
+        }
+        assert(arena.stats().allocations == 250);
+    }
+    assert(arena.stats().allocations == 0);
+
+    std::vector<int, ArenaAllocator<int>> vec{ArenaAllocator<int>(&arena)};
+    for (int i = 0; i < 10000; ++i) {
+        vec.push_back(i);
+    }
+    assert(vec[9999] == 9999);
+    // Outgrew the largest class, so the buffer now lives on the heap
+    assert(arena.stats().large_bytes >= 10000 * sizeof(int));
+
+    std::cout << "✓ test_container_allocator passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running slab arena tests..." << std::endl;
+
+    test_size_classes();
+    test_allocate_and_reuse();
+    test_large_allocations();
+    test_container_allocator();
+
+    std::cout << "\nAll slab arena tests passed!" << std::endl;
+    return 0;
+}
@@ -1,8 +1,14 @@
 #include "../include/storage.h"
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <set>
 #include <thread>
 #include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <unistd.h>
 
 using namespace funnelkvs;
 
@@ -181,6 +187,723 @@ void test_empty_key_value() {
     std::cout << "✓ test_empty_key_value passed" << std::endl;
 }
 
+void test_sharded_aggregates() {
+    Storage storage(16);
+    assert(storage.shard_count() == 16);
+    
+    for (int i = 0; i < 500; ++i) {
+        storage.put("agg_" + std::to_string(i), {static_cast<uint8_t>(i % 256)});
+    }
+    
+    assert(storage.size() == 500);
+    assert(storage.get_all_keys().size() == 500);
+    
+    auto all_data = storage.get_all_data();
+    assert(all_data.size() == 500);
+    assert(all_data["agg_42"] == std::vector<uint8_t>{42});
+    
+    auto even = storage.get_keys_in_range([](const std::string& key) {
+        return std::stoi(key.substr(4)) % 2 == 0;
+    });
+    assert(even.size() == 250);
+    assert(even.count("agg_10") == 1);
+    assert(even.count("agg_11") == 0);
+    
+    // Shard counts are rounded up to a power of two; a single shard still works
+    Storage rounded(10);
+    assert(rounded.shard_count() == 16);
+    Storage single(1);
+    single.put("a", {1});
+    single.put("b", {2});
+    assert(single.size() == 2);
+    
+    std::cout << "✓ test_sharded_aggregates passed" << std::endl;
+}
+
+void test_concurrent_readers_and_writers() {
+    Storage storage;
+    for (int i = 0; i < 100; ++i) {
+        storage.put("rw_" + std::to_string(i), {static_cast<uint8_t>(i)});
+    }
+    
+    std::atomic<bool> stop_flag(false);
+    std::atomic<int> reads(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&storage, &stop_flag, &reads]() {
+            std::vector<uint8_t> value;
+            while (!stop_flag.load()) {
+                for (int i = 0; i < 100; ++i) {
+                    if (storage.get("rw_" + std::to_string(i), value)) {
+                        assert(value.size() == 1);
+                    }
+                    reads++;
+                }
+            }
+        });
+    }
+    
+    std::thread writer([&storage]() {
+        for (int round = 0; round < 50; ++round) {
+            for (int i = 0; i < 100; ++i) {
+                storage.put("rw_" + std::to_string(i), {static_cast<uint8_t>(round)});
+            }
+            // Aggregates must stay usable while other threads touch the shards
+            assert(storage.size() == 100);
+        }
+    });
+    
+    writer.join();
+    stop_flag.store(true);
+    for (auto& t : readers) {
+        t.join();
+    }
+    
+    assert(reads.load() > 0);
+    assert(storage.size() == 100);
+    
+    std::cout << "✓ test_concurrent_readers_and_writers passed" << std::endl;
+}
+
+void test_chunked_scan() {
+    Storage storage(8);
+    for (int i = 0; i < 1000; ++i) {
+        storage.put("scan_" + std::to_string(i), std::vector<uint8_t>(10, static_cast<uint8_t>(i)));
+    }
+    
+    // Only even-numbered keys match
+    auto even = [](const std::string& key) {
+        return (std::stoi(key.substr(5)) % 2) == 0;
+    };
+    
+    Storage::ScanCursor cursor;
+    Storage::EntryList chunk;
+    std::set<std::string> seen;
+    size_t chunks = 0;
+    bool more = true;
+    while (more) {
+        more = storage.scan(cursor, even, 32, 1024 * 1024, chunk);
+        chunks++;
+        for (const auto& entry : chunk) {
+            assert(even(entry.first));
+            std::vector<uint8_t> value;
+            assert(storage.get(entry.first, value));
+            assert(value == entry.second);
+            seen.insert(entry.first);
+        }
+        // Chunks end at a bucket boundary, so they overshoot the cap by
+        // at most one bucket's worth of keys
+        assert(chunk.size() < 64);
+    }
+    assert(seen.size() == 500);
+    assert(chunks > 500 / 64);
+    
+    // The byte cap applies too
+    Storage::ScanCursor small;
+    assert(storage.scan(small, even, 1000, 100, chunk));
+    assert(!chunk.empty() && chunk.size() < 500);
+    
+    // Entries added mid-scan that force a rehash restart the shard, but
+    // nothing present throughout the scan is missed
+    Storage::ScanCursor growing;
+    std::set<std::string> all;
+    assert(storage.scan(growing, even, 16, 1024 * 1024, chunk));
+    for (const auto& entry : chunk) {
+        all.insert(entry.first);
+    }
+    for (int i = 1000; i < 5000; ++i) {
+        storage.put("scan_" + std::to_string(i), {1});
+    }
+    while (storage.scan(growing, even, 16, 1024 * 1024, chunk)) {
+        for (const auto& entry : chunk) {
+            all.insert(entry.first);
+        }
+    }
+    for (const auto& entry : chunk) {
+        all.insert(entry.first);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        assert(all.count("scan_" + std::to_string(i)) == 1);
+    }
+    
+    std::cout << "✓ test_chunked_scan passed" << std::endl;
+}
+
+void test_remove_if_unchanged() {
+    Storage storage;
+    Storage::EntryList batch;
+    for (int i = 0; i < 100; ++i) {
+        std::string key = "rm_" + std::to_string(i);
+        storage.put(key, {static_cast<uint8_t>(i)});
+        batch.push_back(std::make_pair(key, std::vector<uint8_t>{static_cast<uint8_t>(i)}));
+    }
+    batch.push_back(std::make_pair(std::string("rm_absent"), std::vector<uint8_t>{0}));
+    
+    // Overwritten after the batch was read: must survive
+    storage.put("rm_3", {'n', 'e', 'w'});
+    storage.put("rm_50", {'n', 'e', 'w'});
+    
+    assert(storage.remove_if_unchanged(batch) == 98);
+    assert(storage.size() == 2);
+    std::vector<uint8_t> value;
+    assert(storage.get("rm_3", value));
+    assert(value == std::vector<uint8_t>({'n', 'e', 'w'}));
+    assert(storage.exists("rm_50"));
+    
+    std::cout << "✓ test_remove_if_unchanged passed" << std::endl;
+}
+
+void test_cached_key_ids() {
+    Storage storage(4);
+    for (int i = 0; i < 100; ++i) {
+        std::string key = "id_" + std::to_string(i);
+        if (i % 2 == 0) {
+            storage.put(key, {'v'});
+        } else {
+            storage.put(key, SHA1::hash(key), std::vector<uint8_t>{'w'});
+        }
+    }
+    
+    // Ids are recorded with every entry, however it was written
+    auto ids = storage.get_all_key_ids();
+    assert(ids.size() == 100);
+    for (const auto& item : ids) {
+        assert(item.second == SHA1::hash(item.first));
+    }
+    
+    // Scans can filter on the cached id
+    Hash160 pivot = SHA1::hash("pivot");
+    size_t expected = 0;
+    for (const auto& item : ids) {
+        if (item.second < pivot) {
+            expected++;
+        }
+    }
+    Storage::ScanCursor cursor;
+    Storage::EntryList chunk;
+    size_t matched = 0;
+    bool more = true;
+    while (more) {
+        more = storage.scan(cursor, [&pivot](const std::string& key, const Hash160& id) {
+            assert(id == SHA1::hash(key));
+            return id < pivot;
+        }, 8, 1024, chunk);
+        matched += chunk.size();
+    }
+    assert(matched == expected);
+    
+    std::cout << "✓ test_cached_key_ids passed" << std::endl;
+}
+
+static std::set<std::string> scan_whole_range(Storage& storage, const Hash160& start, const Hash160& end,
+                                              size_t max_entries) {
+    std::set<std::string> seen;
+    Storage::RangeCursor cursor;
+    Storage::EntryList chunk;
+    bool more = true;
+    while (more) {
+        more = storage.scan_range(cursor, start, end, max_entries, 1024 * 1024, chunk);
+        assert(chunk.size() <= max_entries);
+        for (const auto& entry : chunk) {
+            assert(seen.insert(entry.first).second); // never returned twice
+        }
+    }
+    return seen;
+}
+
+void test_ring_range_scan() {
+    Storage storage(4);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 300; ++i) {
+        keys.push_back("ring_" + std::to_string(i));
+        storage.put(keys.back(), {static_cast<uint8_t>(i)});
+    }
+    
+    Hash160 low = SHA1::hash("range_low");
+    Hash160 high = SHA1::hash("range_high");
+    if (high < low) {
+        std::swap(low, high);
+    }
+    
+    // Plain, wrapping and whole-ring ranges match in_range exactly
+    const Hash160 ranges[][2] = {{low, high}, {high, low}, {low, low}};
+    for (const auto& range : ranges) {
+        std::set<std::string> expected;
+        for (const auto& key : keys) {
+            Hash160 id = SHA1::hash(key);
+            if (range[0] == range[1] || in_range(id, range[0], range[1], true)) {
+                expected.insert(key);
+            }
+        }
+        assert(scan_whole_range(storage, range[0], range[1], 7) == expected);
+    }
+    assert(scan_whole_range(storage, low, low, 1000).size() == keys.size());
+    
+    // A range ending exactly on an entry's id includes it; starting there excludes it
+    Hash160 pivot = SHA1::hash(keys[0]);
+    assert(scan_whole_range(storage, low, pivot, 5).count(keys[0]) == 1);
+    assert(scan_whole_range(storage, pivot, high, 5).count(keys[0]) == 0);
+    
+    // Writes between chunks: survivors are returned exactly once and
+    // removed entries are not returned after their removal
+    Storage::RangeCursor cursor;
+    Storage::EntryList chunk;
+    std::set<std::string> seen;
+    bool more = true;
+    int round = 0;
+    while (more) {
+        more = storage.scan_range(cursor, high, high, 16, 1024 * 1024, chunk);
+        for (const auto& entry : chunk) {
+            assert(seen.insert(entry.first).second);
+        }
+        storage.remove(keys[round % keys.size()]);
+        storage.put("late_" + std::to_string(round), {'x'});
+        round++;
+    }
+    for (size_t i = static_cast<size_t>(round); i < keys.size(); ++i) {
+        assert(seen.count(keys[i]) == 1);
+    }
+    
+    // Byte limits cut chunks short as well
+    Storage::RangeCursor small;
+    assert(storage.scan_range(small, low, low, 1000, 10, chunk));
+    assert(!chunk.empty() && chunk.size() < 20);
+    
+    std::cout << "✓ test_ring_range_scan passed" << std::endl;
+}
+
+void test_memory_accounting() {
+    Storage storage(4);
+    Storage::MemoryStats empty = storage.memory_stats();
+    assert(empty.entries == 0);
+    assert(empty.key_bytes == 0 && empty.value_bytes == 0);
+    assert(empty.slab_used_bytes == 0 && empty.large_bytes == 0);
+
+    const int N = 1000;
+    for (int i = 0; i < N; ++i) {
+        storage.put("mem_key_" + std::to_string(i), std::vector<uint8_t>(100, 'v'));
+    }
+    std::vector<uint8_t> big(64 * 1024, 'b');
+    storage.put("big", big);
+
+    Storage::MemoryStats stats = storage.memory_stats();
+    size_t key_bytes = 3;
+    for (int i = 0; i < N; ++i) {
+        key_bytes += ("mem_key_" + std::to_string(i)).size();
+    }
+    assert(stats.entries == N + 1);
+    assert(stats.key_bytes == key_bytes);
+    assert(stats.value_bytes == N * 100 + big.size());
+    assert(stats.large_bytes >= big.size());
+    assert(stats.slab_used_bytes <= stats.slab_bytes);
+    assert(stats.allocated_bytes == stats.slab_bytes + stats.large_bytes);
+    // Small entries cost little beyond their payload
+    assert(stats.slab_used_bytes < N * (100 + 16) * 3);
+
+    // Overwrites in the same size class, and shrinking ones, keep the totals exact
+    storage.put("mem_key_0", std::vector<uint8_t>(101, 'w'));
+    storage.put("mem_key_1", std::vector<uint8_t>(10, 'w'));
+    std::vector<uint8_t> value;
+    assert(storage.get("mem_key_0", value) && value == std::vector<uint8_t>(101, 'w'));
+    assert(storage.get("mem_key_1", value) && value == std::vector<uint8_t>(10, 'w'));
+    assert(storage.memory_stats().value_bytes == stats.value_bytes + 1 - 90);
+
+    // Freed slots are reused rather than reserving new slabs
+    for (int i = 0; i < N; ++i) {
+        storage.remove("mem_key_" + std::to_string(i));
+    }
+    storage.remove("big");
+    Storage::MemoryStats drained = storage.memory_stats();
+    assert(drained.entries == 0);
+    assert(drained.key_bytes == 0 && drained.value_bytes == 0);
+    // Only the hash tables' bucket arrays remain outside the slabs
+    assert(drained.large_bytes + big.size() <= stats.large_bytes);
+    for (int i = 0; i < N; ++i) {
+        storage.put("mem_key_" + std::to_string(i), std::vector<uint8_t>(100, 'v'));
+    }
+    assert(storage.memory_stats().slab_bytes == drained.slab_bytes);
+
+    storage.clear();
+    assert(storage.memory_stats().value_bytes == 0);
+    assert(storage.size() == 0);
+
+    std::cout << "✓ test_memory_accounting passed" << std::endl;
+}
+
+void test_cold_tier() {
+    char dir[] = "/tmp/funnelkvs_storage_cold_XXXXXX";
+    assert(mkdtemp(dir) != nullptr);
+    {
+        Storage storage(4);
+        const size_t HOT_LIMIT = 64 * 1024;
+        storage.enable_cold_tier(dir, HOT_LIMIT, 256 * 1024);
+
+        // 64 times the hot limit
+        const int N = 4096;
+        for (int i = 0; i < N; ++i) {
+            storage.put("cold_" + std::to_string(i), std::vector<uint8_t>(1024, static_cast<uint8_t>(i)));
+            // Keep one key hot by reading it
+            std::vector<uint8_t> value;
+            assert(storage.get("cold_0", value));
+        }
+        Storage::MemoryStats stats = storage.memory_stats();
+        assert(stats.entries == N);
+        assert(stats.value_bytes == N * 1024);
+        assert(stats.value_bytes - stats.cold_value_bytes <= HOT_LIMIT);
+        assert(stats.cold_file_bytes >= stats.cold_value_bytes);
+        // What stays in memory per cold entry is its key and location
+        assert(stats.slab_used_bytes + stats.large_bytes < stats.value_bytes / 4);
+
+        // Every value reads back, wherever it lives
+        for (int i = 0; i < N; ++i) {
+            std::vector<uint8_t> value;
+            assert(storage.get("cold_" + std::to_string(i), value));
+            assert(value == std::vector<uint8_t>(1024, static_cast<uint8_t>(i)));
+        }
+
+        // Views of cold values point into the mapping and outlive removal
+        Storage::ValueView view;
+        assert(storage.get("cold_1", view));
+        assert(view.size == 1024 && view.data[1023] == 1);
+        storage.remove("cold_1");
+        assert(view.data[0] == 1);
+
+        // Scans and the other bulk paths see cold values too
+        size_t seen = 0;
+        Storage::RangeCursor cursor;
+        Storage::EntryList chunk;
+        Hash160 origin = {};
+        bool more = true;
+        while (more) {
+            more = storage.scan_range(cursor, origin, origin, 100, SIZE_MAX, chunk);
+            for (const auto& entry : chunk) {
+                int i = std::stoi(entry.first.substr(5));
+                assert(entry.second == std::vector<uint8_t>(1024, static_cast<uint8_t>(i)));
+                seen++;
+            }
+        }
+        assert(seen == N - 1);
+
+        // Overwrite most keys so their old cold copies become garbage, then
+        // compact: values survive and the dead segments go away
+        for (int i = 2; i < N; ++i) {
+            storage.put("cold_" + std::to_string(i), std::vector<uint8_t>(1024, 0xEE));
+        }
+        size_t before = storage.memory_stats().cold_file_bytes;
+        storage.compact_cold_tier(0.9);
+        assert(storage.memory_stats().cold_file_bytes < before);
+        for (int i = 2; i < N; i += 37) {
+            std::vector<uint8_t> value;
+            assert(storage.get("cold_" + std::to_string(i), value));
+            assert(value == std::vector<uint8_t>(1024, 0xEE));
+        }
+        std::vector<uint8_t> value;
+        assert(storage.get("cold_0", value) && value == std::vector<uint8_t>(1024, 0));
+
+        storage.clear();
+        assert(storage.memory_stats().cold_value_bytes == 0);
+    }
+    rmdir(dir);
+
+    std::cout << "✓ test_cold_tier passed" << std::endl;
+}
+
+void test_versions_last_writer_wins() {
+    Storage storage;
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    Hash160 id = SHA1::hash("lww");
+
+    // Local writes get increasing stamps
+    uint64_t first = storage.put("lww", std::vector<uint8_t>{'1'});
+    uint64_t second = storage.put("lww", std::vector<uint8_t>{'2'});
+    assert(first != 0 && second > first);
+    assert(storage.get("lww", value, version) && version == second);
+
+    // A replicated write older than the copy held is dropped, a newer one
+    // is taken, and the clock moves past it
+    assert(!storage.apply("lww", id, std::vector<uint8_t>{'o', 'l', 'd'}, first));
+    assert(storage.get("lww", value) && value == std::vector<uint8_t>{'2'});
+    uint64_t future = second + (1000ULL << HybridClock::LOGICAL_BITS);
+    assert(storage.apply("lww", id, std::vector<uint8_t>{'n', 'e', 'w'}, future));
+    assert(storage.get("lww", value, version) && version == future);
+    assert(storage.stamp() > future);
+
+    // Equal stamps settle on the same value whichever arrives first
+    Storage a;
+    Storage b;
+    std::vector<uint8_t> x = {'x'};
+    std::vector<uint8_t> y = {'y'};
+    a.apply("tie", SHA1::hash("tie"), std::vector<uint8_t>(x), 7);
+    a.apply("tie", SHA1::hash("tie"), std::vector<uint8_t>(y), 7);
+    b.apply("tie", SHA1::hash("tie"), std::vector<uint8_t>(y), 7);
+    b.apply("tie", SHA1::hash("tie"), std::vector<uint8_t>(x), 7);
+    std::vector<uint8_t> from_a;
+    std::vector<uint8_t> from_b;
+    assert(a.get("tie", from_a) && b.get("tie", from_b) && from_a == from_b);
+
+    // A delete leaves a tombstone: older writes arriving after it do not
+    // bring the key back, newer ones do
+    uint64_t deleted_at = storage.stamp();
+    assert(storage.apply_remove("lww", deleted_at));
+    assert(!storage.apply("lww", id, std::vector<uint8_t>{'l', 'a', 't', 'e'}, future));
+    assert(!storage.exists("lww"));
+    assert(storage.apply("lww", id, std::vector<uint8_t>{'b', 'a', 'c', 'k'}, deleted_at + 1));
+    assert(storage.exists("lww"));
+    // ... and a delete older than the copy held is ignored
+    assert(!storage.apply_remove("lww", deleted_at));
+    assert(storage.exists("lww"));
+
+    // Unversioned writes and restores always apply
+    assert(storage.apply("lww", id, std::vector<uint8_t>{'z'}, 0));
+    assert(storage.get("lww", value, version) && value == std::vector<uint8_t>{'z'} && version == 0);
+    storage.restore("lww", id, std::vector<uint8_t>{'r'}, 5);
+    assert(storage.get("lww", value, version) && version == 5);
+
+    std::cout << "✓ test_versions_last_writer_wins passed" << std::endl;
+}
+
+void test_compare_and_put() {
+    Storage storage;
+    Hash160 id = SHA1::hash("cas");
+    uint64_t version = 0;
+
+    // 0 expects the key to be absent
+    assert(storage.compare_and_put("cas", id, {'a'}, 0, version));
+    uint64_t created = version;
+    assert(!storage.compare_and_put("cas", id, {'b'}, 0, version));
+    assert(version == created);
+    assert(storage.compare_and_put("cas", id, {'b'}, created, version));
+    assert(version > created);
+    assert(!storage.compare_and_put("cas", id, {'c'}, created, version));
+    std::vector<uint8_t> value;
+    assert(storage.get("cas", value) && value == std::vector<uint8_t>{'b'});
+    assert(storage.remove("cas"));
+    assert(!storage.compare_and_put("cas", id, {'d'}, created, version) && version == 0);
+
+    // Concurrent read-modify-write loops lose no update
+    storage.put("counter", std::vector<uint8_t>(1, 0));
+    Hash160 counter_id = SHA1::hash("counter");
+    const int threads = 4;
+    const int increments = 50;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&storage, &counter_id]() {
+            for (int i = 0; i < increments; ++i) {
+                while (true) {
+                    std::vector<uint8_t> current;
+                    uint64_t seen = 0;
+                    uint64_t stored = 0;
+                    assert(storage.get("counter", current, seen));
+                    current[0]++;
+                    if (storage.compare_and_put("counter", counter_id, current, seen, stored)) {
+                        break;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    assert(storage.get("counter", value) && value[0] == threads * increments);
+
+    std::cout << "✓ test_compare_and_put passed" << std::endl;
+}
+
+void test_compressed_values() {
+    Storage storage(4);
+    std::string text;
+    for (int i = 0; i < 100; ++i) {
+        text += "{\"id\":" + std::to_string(i) + ",\"kind\":\"compressible\"}";
+    }
+    std::vector<uint8_t> large(text.begin(), text.end());
+    std::vector<uint8_t> small(large.begin(), large.begin() + 100);
+    storage.set_compression(1024);
+    storage.put("large", large);
+    storage.put("small", small);
+
+    // Reads decode; the stored form is smaller and decodes to the same
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    bool compressed = false;
+    assert(storage.get("large", value) && value == large);
+    assert(storage.get_stored("large", value, version, compressed) && compressed);
+    assert(value.size() < large.size());
+    std::vector<uint8_t> stored = value;
+    std::vector<uint8_t> raw;
+    assert(Compression::decompress(stored, raw) && raw == large);
+    assert(storage.get_stored("small", value, version, compressed) && !compressed && value == small);
+    Storage::ValueView view;
+    assert(storage.get("large", view) && view.size == large.size());
+    assert(std::equal(large.begin(), large.end(), view.data));
+
+    Storage::MemoryStats stats = storage.memory_stats();
+    assert(stats.compressed_value_bytes == stored.size());
+    assert(stats.value_bytes == stored.size() + small.size());
+
+    // Stored bytes pass between stores as they are, flag and all
+    Storage replica;
+    assert(replica.apply("large", SHA1::hash("large"), std::vector<uint8_t>(stored), version, true));
+    assert(replica.get("large", value) && value == large);
+    assert(replica.merkle_root() != 0);
+    Storage::RangeCursor cursor;
+    Storage::EntryList chunk;
+    std::vector<Storage::EntryMeta> meta;
+    Hash160 origin = {};
+    storage.scan_range(cursor, origin, origin, 10, SIZE_MAX, chunk, &meta);
+    assert(chunk.size() == 2 && meta.size() == 2);
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        assert(meta[i].compressed == (chunk[i].first == "large"));
+        assert(chunk[i].second == (meta[i].compressed ? stored : small));
+    }
+    auto all = storage.get_all_data();
+    assert(all.size() == 2);
+    for (const auto& entry : all) {
+        assert(entry.second == (entry.first == "large" ? large : small));
+    }
+
+    // Overwrites switch between the forms, and the totals follow
+    storage.put("large", small);
+    assert(storage.get_stored("large", value, version, compressed) && !compressed && value == small);
+    assert(storage.memory_stats().compressed_value_bytes == 0);
+    assert(storage.compare_and_put("large", SHA1::hash("large"), stored, version, version, true));
+    assert(storage.get("large", value) && value == large);
+
+    // Off again, values are stored as written
+    storage.set_compression(0);
+    value = large;
+    assert(!storage.compress(value) && value == large);
+    storage.put("plain", large);
+    assert(storage.get_stored("plain", value, version, compressed) && !compressed);
+
+    std::cout << "✓ test_compressed_values passed" << std::endl;
+}
+
+void test_expiring_keys() {
+    Storage storage(4);
+    uint64_t now = HybridClock::wall_ms();
+    Hash160 id = SHA1::hash("lapsed");
+    std::vector<uint8_t> value;
+    uint64_t version = 0;
+    bool compressed = false;
+    uint64_t expires = 0;
+
+    // A lapsed entry is hidden at once; a live one reports its expiry
+    uint64_t lapsed = storage.put("lapsed", id, std::vector<uint8_t>{'a'}, false, now - 1);
+    uint64_t deadline = now + 60000;
+    storage.put("live", SHA1::hash("live"), std::vector<uint8_t>{'b'}, false, deadline);
+    storage.put("plain", std::vector<uint8_t>{'c'});
+    assert(!storage.get("lapsed", value) && !storage.exists("lapsed"));
+    assert(!storage.get_stored("lapsed", value, version, compressed));
+    assert(storage.get_stored("live", value, version, compressed, &expires) && expires == deadline);
+    assert(storage.expiry("live") == deadline && storage.expiry("plain") == 0);
+    assert(storage.get_all_keys().size() == 2);
+    Storage::RangeCursor cursor;
+    Storage::EntryList chunk;
+    std::vector<Storage::EntryMeta> meta;
+    Hash160 origin = {};
+    storage.scan_range(cursor, origin, origin, 10, SIZE_MAX, chunk, &meta);
+    assert(chunk.size() == 2);
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        assert(meta[i].expires == (chunk[i].first == "live" ? deadline : 0));
+    }
+
+    // The background thread removes it within a tick or two, and a late
+    // copy of the same write does not bring it back
+    for (int i = 0; i < 100 && storage.memory_stats().expired_entries == 0; ++i) {
+        usleep(20000);
+    }
+    assert(storage.memory_stats().expired_entries == 1 && storage.size() == 2);
+    assert(storage.expire(HybridClock::wall_ms()) == 0);
+    assert(!storage.apply("lapsed", id, std::vector<uint8_t>{'a'}, lapsed, false, now - 1));
+
+    // A conditional put finds a lapsed key absent, and like any write
+    // without an expiry clears it
+    storage.put("lapsing", SHA1::hash("lapsing"), std::vector<uint8_t>{'d'}, false,
+                HybridClock::wall_ms() + 150);
+    assert(!storage.compare_and_put("lapsing", SHA1::hash("lapsing"), {'e'}, 0, version));
+    usleep(200000);
+    assert(storage.compare_and_put("lapsing", SHA1::hash("lapsing"), {'e'}, 0, version));
+    assert(storage.expiry("lapsing") == 0);
+    storage.put("live", std::vector<uint8_t>{'f'});
+    assert(storage.expiry("live") == 0);
+    usleep(200000);
+    assert(storage.get("lapsing", value) && value == std::vector<uint8_t>{'e'});
+
+    // The expiry is part of the entry's digest
+    Storage a;
+    Storage b;
+    a.apply("k", SHA1::hash("k"), std::vector<uint8_t>{'v'}, 1, false, deadline);
+    b.apply("k", SHA1::hash("k"), std::vector<uint8_t>{'v'}, 1, false, 0);
+    assert(a.merkle_root() != b.merkle_root());
+
+    std::cout << "✓ test_expiring_keys passed" << std::endl;
+}
+
+void test_ordered_scan() {
+    Storage storage(8);
+    std::vector<std::pair<Hash160, std::string>> expected;
+    for (int i = 0; i < 500; ++i) {
+        std::string key = (i % 5 == 0 ? "user:" : "item:") + std::to_string(i);
+        storage.put(key, std::vector<uint8_t>(i % 40, 'v'));
+        expected.push_back(std::make_pair(SHA1::hash(key), key));
+    }
+    std::sort(expected.begin(), expected.end());
+    Hash160 top;
+    top.fill(0xFF);
+    
+    // Chunks come in id order across shards and resume from the token
+    std::vector<std::pair<Hash160, std::string>> seen;
+    std::vector<uint8_t> token;
+    bool more = true;
+    while (more) {
+        Storage::RingPosition position;
+        assert(position.parse(token));
+        Storage::EntryList chunk;
+        more = storage.scan_ordered(position, top, "", 37, 1 << 20, chunk);
+        assert(chunk.size() <= 37 && (!more || chunk.size() == 37));
+        for (const auto& entry : chunk) {
+            seen.push_back(std::make_pair(SHA1::hash(entry.first), entry.first));
+        }
+        token = position.token();
+    }
+    assert(seen == expected);
+    
+    // The prefix filters, and byte limits cut chunks short
+    Storage::RingPosition position;
+    Storage::EntryList chunk;
+    assert(!storage.scan_ordered(position, top, "user:", 1000, 1 << 20, chunk));
+    assert(chunk.size() == 100);
+    for (const auto& entry : chunk) {
+        assert(entry.first.compare(0, 5, "user:") == 0);
+    }
+    Storage::RingPosition small;
+    assert(storage.scan_ordered(small, top, "", 1000, 100, chunk));
+    assert(!chunk.empty() && chunk.size() < 50);
+    
+    // Limits of 0 still return one entry per chunk, so the walk moves on
+    Storage::RingPosition zero;
+    assert(storage.scan_ordered(zero, top, "", 1000, 0, chunk));
+    assert(chunk.size() == 1 && chunk[0].first == expected[0].second);
+    assert(storage.scan_ordered(zero, top, "", 0, 0, chunk));
+    assert(chunk.size() == 1 && chunk[0].first == expected[1].second);
+    
+    // A walk bounded by last ends just past it
+    Hash160 last = expected[99].first;
+    Storage::RingPosition bounded;
+    assert(!storage.scan_ordered(bounded, last, "", 1000, 1 << 20, chunk));
+    assert(chunk.size() == 100 && bounded.past_id && bounded.id == last);
+    assert(!storage.scan_ordered(bounded, expected[199].first, "", 1000, 1 << 20, chunk));
+    assert(chunk.size() == 100 && chunk[0].first == expected[100].second);
+    
+    // Malformed tokens are refused
+    Storage::RingPosition parsed;
+    assert(!parsed.parse(std::vector<uint8_t>(5, 0)));
+    
+    std::cout << "✓ test_ordered_scan passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running storage tests..." << std::endl;
     
@@ -191,6 +914,19 @@ int main() {
     test_concurrent_mixed_operations();
     test_large_values();
     test_empty_key_value();
+    test_sharded_aggregates();
+    test_concurrent_readers_and_writers();
+    test_chunked_scan();
+    test_remove_if_unchanged();
+    test_cached_key_ids();
+    test_ring_range_scan();
+    test_memory_accounting();
+    test_cold_tier();
+    test_versions_last_writer_wins();
+    test_compare_and_put();
+    test_compressed_values();
+    test_expiring_keys();
+    test_ordered_scan();
     
     std::cout << "\nAll storage tests passed!" << std::endl;
     return 0;
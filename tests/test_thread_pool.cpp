@@ -0,0 +1,212 @@
+#include "../include/thread_pool.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace funnelkvs;
+
+void test_task_storage() {
+    // Small callables live inline, big ones on the heap; both run and move
+    int calls = 0;
+    Task small([&calls] { calls++; });
+    assert(small);
+    small();
+    Task moved(std::move(small));
+    assert(!small && moved);
+    moved();
+    assert(calls == 2);
+
+    char big[200] = {'x'};
+    Task large([big, &calls] { calls += big[0] == 'x' ? 10 : 0; });
+    Task target;
+    target = std::move(large);
+    target();
+    assert(calls == 12);
+
+    // Move-only callables work too
+    {
+        std::unique_ptr<int> owned(new int(7));
+        Task move_only(std::bind([&calls](std::unique_ptr<int>& value) { calls += *value; },
+                                 std::move(owned)));
+        Task moved_again(std::move(move_only));
+        moved_again();
+        assert(calls == 19);
+    }
+    {
+        std::promise<int> promise;
+        std::future<int> future = promise.get_future();
+        Task fulfil(std::bind([](std::promise<int>& p) { p.set_value(42); }, std::move(promise)));
+        fulfil();
+        assert(future.get() == 42);
+    }
+    std::cout << "✓ test_task_storage passed" << std::endl;
+}
+
+void test_enqueue_and_submit() {
+    ThreadPool pool(4);
+    assert(pool.size() == 4);
+
+    std::atomic<int> counter(0);
+    const int TASKS = 20000; // more than all queues together hold
+    for (int i = 0; i < TASKS; ++i) {
+        pool.enqueue([&counter] { counter.fetch_add(1); });
+    }
+    std::future<int> last = pool.submit([] { return 5; });
+    assert(last.get() == 5);
+    while (counter.load() < TASKS) {
+        std::this_thread::yield();
+    }
+
+    // Tasks submitted by tasks stay on the submitting worker's queue and
+    // get stolen by idle ones
+    std::atomic<int> nested(0);
+    std::vector<std::future<void>> parents;
+    for (int p = 0; p < 4; ++p) {
+        parents.push_back(pool.submit([&pool, &nested] {
+            for (int i = 0; i < 500; ++i) {
+                pool.enqueue([&nested] {
+                    std::this_thread::sleep_for(std::chrono::microseconds(20));
+                    nested.fetch_add(1);
+                });
+            }
+        }));
+    }
+    for (auto& parent : parents) {
+        parent.get();
+    }
+    while (nested.load() < 2000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(pool.queue_depth() == 0);
+    assert(pool.busy_workers() <= pool.size());
+    std::cout << "✓ test_enqueue_and_submit passed" << std::endl;
+}
+
+void test_many_producers() {
+    ThreadPool pool(3);
+    std::atomic<long> sum(0);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 6; ++t) {
+        producers.emplace_back([&pool, &sum] {
+            std::vector<std::future<int>> results;
+            for (int i = 1; i <= 2000; ++i) {
+                results.push_back(pool.submit([i] { return i; }));
+            }
+            for (auto& result : results) {
+                sum.fetch_add(result.get());
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    assert(sum.load() == 6L * 2000 * 2001 / 2);
+    std::cout << "✓ test_many_producers passed" << std::endl;
+}
+
+void test_dropped_on_destruction() {
+    std::future<int> pending;
+    std::atomic<bool> release(false);
+    std::thread releaser;
+    {
+        ThreadPool pool(1);
+        std::promise<void> started;
+        pool.enqueue([&release, &started] {
+            started.set_value();
+            while (!release.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        started.get_future().wait();
+        pending = pool.submit([] { return 1; });
+        releaser = std::thread([&release] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            release.store(true);
+        });
+        // Destroyed while the second task is still queued
+    }
+    releaser.join();
+    bool broken = false;
+    try {
+        pending.get();
+    } catch (const std::future_error& e) {
+        broken = e.code() == std::future_errc::broken_promise;
+    }
+    assert(broken);
+    std::cout << "✓ test_dropped_on_destruction passed" << std::endl;
+}
+
+void test_periodic_jobs() {
+    ThreadPool pool(2);
+    std::atomic<int> ticks(0);
+    std::atomic<int> running(0);
+    std::atomic<bool> overlapped(false);
+    uint64_t job = pool.schedule_every(std::chrono::milliseconds(5), [&] {
+        if (running.fetch_add(1) > 0) {
+            overlapped.store(true);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        ticks.fetch_add(1);
+        running.fetch_sub(1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    pool.cancel(job);
+    int after_cancel = ticks.load();
+    assert(after_cancel >= 5);
+    assert(!overlapped.load());
+    assert(running.load() == 0); // cancel waited for the run in progress
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    assert(ticks.load() == after_cancel);
+
+    // A job may cancel itself
+    std::atomic<int> self_runs(0);
+    std::shared_ptr<uint64_t> self_id = std::make_shared<uint64_t>(0);
+    std::atomic<bool> scheduled(false);
+    *self_id = pool.schedule_every(std::chrono::milliseconds(1), [&pool, self_id, &self_runs, &scheduled] {
+        while (!scheduled.load()) {
+            std::this_thread::yield();
+        }
+        if (self_runs.fetch_add(1) == 2) {
+            pool.cancel(*self_id);
+        }
+    });
+    scheduled.store(true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(self_runs.load() == 3);
+
+    // Destroying the pool stops periodic jobs too
+    {
+        ThreadPool short_lived(1);
+        short_lived.schedule_every(std::chrono::milliseconds(1), [] {});
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::cout << "✓ test_periodic_jobs passed" << std::endl;
+}
+
+void test_pin_workers() {
+    ThreadPool pool(2);
+    // Not every sandbox allows it; it must not break the pool either way
+    pool.pin_workers();
+    assert(pool.submit([] { return 3; }).get() == 3);
+    std::cout << "✓ test_pin_workers passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running thread pool tests..." << std::endl;
+
+    test_task_storage();
+    test_enqueue_and_submit();
+    test_many_producers();
+    test_dropped_on_destruction();
+    test_periodic_jobs();
+    test_pin_workers();
+
+    std::cout << "\nAll thread pool tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "../include/timer_wheel.h"
+#include <iostream>
+#include <cassert>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace funnelkvs;
+
+void test_fires_on_deadline() {
+    TimerWheel wheel(10);
+    const uint64_t start = 1000000;
+    wheel.schedule("a", start + 25, start);
+    wheel.schedule("b", start + 30, start);
+    wheel.schedule("late", start - 50, start);
+    assert(wheel.size() == 3);
+
+    // A timer already due fires on the next tick; none fires early
+    std::vector<std::string> due;
+    wheel.advance(start + 9, due);
+    assert(due.empty());
+    wheel.advance(start + 10, due);
+    assert(due == std::vector<std::string>{"late"});
+    due.clear();
+    wheel.advance(start + 29, due);
+    assert(due.empty());
+    wheel.advance(start + 30, due);
+    assert(due.size() == 2 && wheel.size() == 0);
+
+    // An idle wheel jumps straight to the present
+    due.clear();
+    wheel.schedule("c", start + 1000000, start + 999990);
+    wheel.advance(start + 999999, due);
+    assert(due.empty());
+    wheel.advance(start + 1000000, due);
+    assert(due == std::vector<std::string>{"c"});
+
+    std::cout << "✓ test_fires_on_deadline passed" << std::endl;
+}
+
+void test_cascades_through_levels() {
+    // Deadlines spread over every level, including beyond the top one
+    const uint64_t tick = 1;
+    TimerWheel wheel(tick);
+    std::mt19937_64 rng(11);
+    const uint64_t start = 123456789;
+    const uint64_t top_span = static_cast<uint64_t>(1) << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS);
+    std::map<std::string, uint64_t> deadlines;
+    for (int i = 0; i < 3000; ++i) {
+        uint64_t range = i % 3 == 0 ? 64 : i % 3 == 1 ? 64 * 64 * 64 : top_span + top_span / 2;
+        uint64_t deadline = start + 1 + rng() % range;
+        std::string key = "k" + std::to_string(i);
+        deadlines[key] = deadline;
+        wheel.schedule(key, deadline, start);
+    }
+
+    // Turn in uneven steps; each timer fires on the first advance that
+    // reaches its deadline
+    uint64_t now = start;
+    size_t fired = 0;
+    while (wheel.size() > 0) {
+        uint64_t previous = now;
+        now += 1 + rng() % 5000;
+        std::vector<std::string> due;
+        wheel.advance(now, due);
+        for (const auto& key : due) {
+            assert(deadlines[key] > previous && deadlines[key] <= now);
+            fired++;
+        }
+    }
+    assert(fired == deadlines.size());
+
+    std::cout << "✓ test_cascades_through_levels passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running timer wheel tests..." << std::endl;
+    std::cout << std::endl;
+
+    test_fires_on_deadline();
+    test_cascades_through_levels();
+
+    std::cout << std::endl;
+    std::cout << "All timer wheel tests passed!" << std::endl;
+    return 0;
+}